@@ -0,0 +1,93 @@
+/*
+ * ANVIL - IR Arena Allocation Benchmark
+ *
+ * Builds a synthetic module with many small functions and reports the
+ * time to build and destroy it, together with the allocation counts of
+ * the IR arenas. "Allocation requests" is the number of objects that
+ * used to be individual malloc/calloc/realloc calls; "chunks" is the
+ * number of mallocs actually made by the arenas.
+ *
+ * Usage: arena_bench [num_funcs]
+ *   num_funcs: number of functions to build (default: 100000)
+ */
+
+#include <anvil/anvil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double elapsed_ms(clock_t start, clock_t end)
+{
+    return (double)(end - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/*
+ * Each function is:
+ *
+ * int fN(int a, int b) {
+ *     int s = a + b;
+ *     int m = s * 3;
+ *     return m - a;
+ * }
+ */
+static void build_module(anvil_ctx_t *ctx, anvil_module_t *mod, int num_funcs)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+    anvil_value_t *three = anvil_const_i32(ctx, 3);
+    char name[32];
+
+    for (int i = 0; i < num_funcs; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+        anvil_value_t *a = anvil_func_get_param(func, 0);
+        anvil_value_t *b = anvil_func_get_param(func, 1);
+        anvil_value_t *s = anvil_build_add(ctx, a, b, "s");
+        anvil_value_t *m = anvil_build_mul(ctx, s, three, "m");
+        anvil_value_t *r = anvil_build_sub(ctx, m, a, "r");
+        anvil_build_ret(ctx, r);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int num_funcs = 100000;
+    if (argc > 1) {
+        num_funcs = atoi(argv[1]);
+        if (num_funcs <= 0) {
+            fprintf(stderr, "Invalid function count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+
+    anvil_module_t *mod = anvil_module_create(ctx, "arena_bench");
+
+    clock_t t0 = clock();
+    build_module(ctx, mod, num_funcs);
+    clock_t t1 = clock();
+
+    anvil_mem_stats_t stats;
+    anvil_ctx_get_mem_stats(ctx, &stats);
+
+    anvil_module_destroy(mod);
+    clock_t t2 = clock();
+
+    printf("=== Arena benchmark: %d functions ===\n", num_funcs);
+    printf("Build:    %8.2f ms\n", elapsed_ms(t0, t1));
+    printf("Destroy:  %8.2f ms\n", elapsed_ms(t1, t2));
+    printf("Allocation requests: %zu\n", stats.num_allocs);
+    printf("Arena chunks (mallocs): %zu\n", stats.num_chunks);
+    printf("Bytes used / reserved: %zu / %zu\n", stats.bytes_used, stats.bytes_reserved);
+
+    anvil_ctx_destroy(ctx);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * ANVIL - IR Builder Microbenchmark
+ *
+ * Times anvil_build_add in a tight loop. The adds are built in batches,
+ * one function per batch, and each batch's module is destroyed before
+ * the next so memory stays bounded.
+ *
+ * Usage: build_bench [num_adds]
+ *   num_adds: total number of anvil_build_add calls (default: 10000000)
+ */
+
+#include <anvil/anvil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BATCH_SIZE 100000
+
+static double elapsed_ms(clock_t start, clock_t end)
+{
+    return (double)(end - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/* Build one function: acc = acc + x, repeated count times */
+static void build_batch(anvil_ctx_t *ctx, anvil_module_t *mod, long count, clock_t *build_time)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 1, false);
+    anvil_func_t *func = anvil_func_create(mod, "f", func_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *acc = x;
+
+    clock_t start = clock();
+    for (long i = 0; i < count; i++) {
+        acc = anvil_build_add(ctx, acc, x, NULL);
+    }
+    *build_time += clock() - start;
+
+    anvil_build_ret(ctx, acc);
+}
+
+int main(int argc, char **argv)
+{
+    long num_adds = 10000000;
+    if (argc > 1) {
+        num_adds = atol(argv[1]);
+        if (num_adds <= 0) {
+            fprintf(stderr, "Invalid add count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+
+    clock_t build_time = 0;
+    clock_t total_start = clock();
+
+    for (long done = 0; done < num_adds; done += BATCH_SIZE) {
+        long count = num_adds - done < BATCH_SIZE ? num_adds - done : BATCH_SIZE;
+        anvil_module_t *mod = anvil_module_create(ctx, "build_bench");
+        build_batch(ctx, mod, count, &build_time);
+        anvil_module_destroy(mod);
+    }
+
+    clock_t total_end = clock();
+    double build_ms = elapsed_ms(0, build_time);
+
+    printf("=== Builder benchmark: %ld anvil_build_add calls ===\n", num_adds);
+    printf("Build:    %8.2f ms (%.1f ns/add)\n", build_ms, build_ms * 1e6 / (double)num_adds);
+    printf("Total:    %8.2f ms (including module create/destroy)\n",
+           elapsed_ms(total_start, total_end));
+
+    anvil_ctx_destroy(ctx);
+    return 0;
+}
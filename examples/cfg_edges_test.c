@@ -0,0 +1,224 @@
+/*
+ * ANVIL - CFG Edge List Test
+ *
+ * Checks that the builder and the instruction helpers keep each block's
+ * predecessor and successor lists in step with its terminator, that
+ * simplify-cfg and unannounced edits by custom passes leave them
+ * consistent, and that simplify-cfg handles functions with thousands
+ * of blocks.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+static anvil_value_t *cond(anvil_ctx_t *ctx, anvil_func_t *func)
+{
+    return anvil_build_cmp_lt(ctx, anvil_func_get_param(func, 0), anvil_func_get_param(func, 1), NULL);
+}
+
+static size_t count_in(anvil_block_t **list, size_t n, const anvil_block_t *block)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) count += list[i] == block;
+    return count;
+}
+
+/*
+ * entry: br_cond then, else
+ * then:  -> merge
+ * else:  br_cond merge, merge
+ * merge: ret
+ */
+static void test_builder(anvil_ctx_t *ctx)
+{
+    printf("\nBuilder:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "builder");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *then_bb = anvil_block_create(func, "then");
+    anvil_block_t *else_bb = anvil_block_create(func, "else");
+    anvil_block_t *merge = anvil_block_create(func, "merge");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br_cond(ctx, cond(ctx, func), then_bb, else_bb);
+    anvil_set_insert_point(ctx, then_bb);
+    anvil_build_br(ctx, merge);
+    anvil_set_insert_point(ctx, else_bb);
+    anvil_build_br_cond(ctx, cond(ctx, func), merge, merge);
+    anvil_set_insert_point(ctx, merge);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+
+    CHECK(entry->num_succs == 2 && entry->succs[0] == then_bb && entry->succs[1] == else_bb,
+          "br_cond lists both targets in order");
+    CHECK(entry->num_preds == 0 && merge->num_succs == 0, "entry has no preds, ret no succs");
+    CHECK(then_bb->num_preds == 1 && then_bb->preds[0] == entry, "then's pred is entry");
+    CHECK(merge->num_preds == 3 && count_in(merge->preds, 3, else_bb) == 2,
+          "br_cond with both arms on one block adds two edges");
+    CHECK(anvil_func_verify_cfg(func), "lists match the terminators");
+    anvil_module_destroy(mod);
+}
+
+static void test_edits(anvil_ctx_t *ctx)
+{
+    printf("\nInstruction edits:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "edits");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *a = anvil_block_create(func, "a");
+    anvil_block_t *b = anvil_block_create(func, "b");
+    anvil_set_insert_point(ctx, a);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 1));
+    anvil_set_insert_point(ctx, b);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 2));
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, a);
+    CHECK(entry->num_succs == 1 && a->num_preds == 1, "br adds an edge");
+
+    /* Code after a terminator is dead: the block's edges follow its last instruction */
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 3));
+    CHECK(entry->num_succs == 0 && a->num_preds == 0, "instruction appended after br takes its edge");
+    anvil_instr_remove(entry->last);
+    CHECK(entry->num_succs == 1 && a->num_preds == 1, "removing it brings the edge back");
+
+    anvil_instr_t *br = entry->last;
+    anvil_instr_set_succ(br, 0, b);
+    CHECK(a->num_preds == 0 && b->num_preds == 1 && entry->succs[0] == b,
+          "set_succ moves the edge");
+    anvil_instr_set_succ(br, 1, a);
+    CHECK(a->num_preds == 0 && entry->num_succs == 1, "false target of a br is not an edge");
+
+    anvil_instr_kill(br);
+    CHECK(entry->num_succs == 0 && b->num_preds == 0, "killing the branch drops its edge");
+    anvil_instr_remove(br);
+
+    anvil_instr_t *cbr = anvil_instr_create(ctx, ANVIL_OP_BR_COND, anvil_type_void(ctx), NULL);
+    anvil_instr_add_operand(cbr, anvil_const_i32(ctx, 1));
+    cbr->true_block = a;
+    cbr->false_block = b;
+    anvil_instr_insert_before(entry, NULL, cbr);
+    CHECK(entry->num_succs == 2 && a->num_preds == 1 && b->num_preds == 1,
+          "insert at the end links a br_cond");
+    CHECK(anvil_func_verify_cfg(func), "lists match the terminators");
+
+    anvil_pass_simplify_cfg(func);
+    CHECK(func->num_blocks == 1 && entry->num_succs == 0 && entry->last->op == ANVIL_OP_RET &&
+          b->num_preds == 0, "simplify-cfg folds the constant branch and merges");
+    CHECK(anvil_func_verify_cfg(func), "lists match after simplify-cfg");
+    anvil_module_destroy(mod);
+}
+
+/* Custom pass that retargets every conditional branch to its false side
+ * by assigning the fields, as code outside the library may */
+static bool take_false_branch(anvil_func_t *func)
+{
+    bool changed = false;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        anvil_instr_t *term = block->last;
+        if (!term || term->op != ANVIL_OP_BR_COND) continue;
+        term->op = ANVIL_OP_BR;
+        term->true_block = term->false_block;
+        term->false_block = NULL;
+        anvil_instr_clear_operands(term);
+        changed = true;
+    }
+    return changed;
+}
+
+static void test_custom_pass(anvil_ctx_t *ctx)
+{
+    printf("\nCustom pass:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "custom");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *a = anvil_block_create(func, "a");
+    anvil_block_t *b = anvil_block_create(func, "b");
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br_cond(ctx, cond(ctx, func), a, b);
+    anvil_set_insert_point(ctx, a);
+    anvil_build_br(ctx, b);
+    anvil_set_insert_point(ctx, b);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+
+    anvil_pass_manager_t *pm = anvil_pass_manager_create(ctx);
+    anvil_pass_info_t info = { .name = "take-false", .description = "Take false branches",
+                               .run = take_false_branch };
+    anvil_pass_manager_register(pm, &info);
+    anvil_pass_manager_set_pipeline(pm, "take-false");
+    anvil_pass_manager_set_verify(pm, true);
+    CHECK(anvil_pass_manager_run_func(pm, func), "custom pass changed the function");
+    CHECK(a->num_preds == 0 && b->num_preds == 2 && entry->num_succs == 1,
+          "pass manager rebuilds the edges after it");
+    CHECK(anvil_func_verify_cfg(func), "lists match the terminators");
+    anvil_pass_manager_destroy(pm);
+    anvil_module_destroy(mod);
+}
+
+#define NUM_LINKS 5000
+
+/*
+ * A long chain: each link adds, then either falls through, goes through
+ * an empty block, or branches on a constant to the next link and a dead
+ * block.
+ */
+static void test_large(anvil_ctx_t *ctx)
+{
+    printf("\nLarge function:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "large");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t **links = malloc((NUM_LINKS + 1) * sizeof(anvil_block_t *));
+    links[0] = anvil_func_get_entry(func);
+    for (size_t i = 1; i <= NUM_LINKS; i++) links[i] = anvil_block_create(func, "link");
+    anvil_block_t *dead = anvil_block_create(func, "dead");
+
+    anvil_value_t *acc = anvil_func_get_param(func, 0);
+    for (size_t i = 0; i < NUM_LINKS; i++) {
+        anvil_set_insert_point(ctx, links[i]);
+        acc = anvil_build_add(ctx, acc, anvil_func_get_param(func, 1), NULL);
+        if (i % 3 == 1) {
+            anvil_block_t *empty = anvil_block_create(func, "empty");
+            anvil_build_br(ctx, empty);
+            anvil_set_insert_point(ctx, empty);
+            anvil_build_br(ctx, links[i + 1]);
+        } else if (i % 3 == 2) {
+            anvil_build_br_cond(ctx, anvil_const_i32(ctx, 1), links[i + 1], dead);
+        } else {
+            anvil_build_br(ctx, links[i + 1]);
+        }
+    }
+    anvil_set_insert_point(ctx, links[NUM_LINKS]);
+    anvil_build_ret(ctx, acc);
+    anvil_set_insert_point(ctx, dead);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+
+    CHECK(dead->num_preds == NUM_LINKS / 3, "dead block has a pred per constant branch");
+    CHECK(anvil_func_verify_cfg(func), "lists match the terminators");
+    CHECK(anvil_pass_simplify_cfg(func), "simplify-cfg changed the function");
+    CHECK(func->num_blocks == 1 && func->entry->num_succs == 0 && func->entry->num_preds == 0,
+          "whole chain merged into the entry");
+    CHECK(func->entry->last && func->entry->last->op == ANVIL_OP_RET, "entry ends in the ret");
+    CHECK(anvil_func_verify_cfg(func), "lists match after simplify-cfg");
+    free(links);
+    anvil_module_destroy(mod);
+}
+
+int main(void)
+{
+    printf("=== CFG Edge List Test ===\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    test_builder(ctx);
+    test_edits(ctx);
+    test_custom_pass(ctx);
+    test_large(ctx);
+
+    anvil_ctx_destroy(ctx);
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * ANVIL - Change Tracking Test
+ *
+ * Checks that the instruction helpers mark the blocks they edit with the
+ * function's change stamp, including the block defining a value that
+ * gains or loses a use; that block-local passes only look at blocks
+ * changed since visit_since, in block order, including blocks marked
+ * while they walk; and that the pass manager hands a pass only the
+ * blocks edited since its last run.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+static anvil_instr_t *instr_of(anvil_value_t *val)
+{
+    return val->data.instr;
+}
+
+/*
+ * entry: v = add x, y; br next
+ * next:  w = add v, 1; br exit
+ * exit:  ret w
+ */
+static void test_marks(anvil_ctx_t *ctx)
+{
+    printf("\nInstruction helpers mark what they edit:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "marks");
+    anvil_func_t *func = make_func(ctx, mod, "marks");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *next = anvil_block_create(func, "next");
+    anvil_block_t *exit = anvil_block_create(func, "exit");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *v = anvil_build_add(ctx, x, y, "v");
+    anvil_build_br(ctx, next);
+    anvil_set_insert_point(ctx, next);
+    anvil_value_t *w = anvil_build_add(ctx, v, anvil_const_i32(ctx, 1), "w");
+    anvil_build_br(ctx, exit);
+    anvil_set_insert_point(ctx, exit);
+    anvil_build_ret(ctx, w);
+
+    func->change_stamp = 1;
+    anvil_instr_set_operand(instr_of(w), 1, anvil_const_i32(ctx, 2));
+    CHECK(next->changed_at == 1, "operand edit marks the user's block");
+    CHECK(entry->changed_at == 0 && exit->changed_at == 0, "... and nothing else for a constant");
+    CHECK(func->last_change == 1, "function records its latest edit");
+
+    func->change_stamp = 2;
+    anvil_instr_set_operand(instr_of(w), 0, y);
+    CHECK(next->changed_at == 2 && entry->changed_at == 2,
+          "value losing a use marks its defining block");
+
+    func->change_stamp = 3;
+    anvil_instr_set_operand(instr_of(w), 0, v);
+    CHECK(entry->changed_at == 3, "value gaining a use marks its defining block");
+
+    func->change_stamp = 4;
+    anvil_value_replace_all_uses(w, x);
+    CHECK(exit->changed_at == 4 && next->changed_at == 4, "replacing all uses marks users and definer");
+    CHECK(entry->changed_at == 3, "... but not an unrelated block");
+
+    func->change_stamp = 5;
+    anvil_instr_kill(instr_of(w));
+    CHECK(next->changed_at == 5 && entry->changed_at == 5, "kill marks its block and its operands'");
+
+    func->change_stamp = 6;
+    anvil_instr_set_succ(entry->last, 0, exit);
+    CHECK(entry->changed_at == 6 && exit->changed_at == 4, "retargeting marks the branch's block");
+
+    func->visit_since = 5;
+    CHECK(anvil_block_needs_visit(entry) && anvil_block_needs_visit(next) &&
+          !anvil_block_needs_visit(exit), "blocks changed at or after visit_since need a visit");
+    func->visit_since = 0;
+    CHECK(anvil_block_needs_visit(exit), "visit_since 0: every block");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * entry: a = add 2, 3; store a, g; d = add x, 1; br next
+ * next:  b = add 4, 5; store b, g; ret 0
+ */
+static void test_region(anvil_ctx_t *ctx)
+{
+    printf("\nBlock-local passes visit changed blocks only:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "region");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_value_t *g = anvil_module_add_global(mod, "g", i32, ANVIL_LINK_EXTERNAL);
+    anvil_func_t *func = make_func(ctx, mod, "region");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *next = anvil_block_create(func, "next");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *a = anvil_build_add(ctx, anvil_const_i32(ctx, 2), anvil_const_i32(ctx, 3), "a");
+    anvil_build_store(ctx, a, g);
+    anvil_value_t *d = anvil_build_add(ctx, anvil_func_get_param(func, 0), anvil_const_i32(ctx, 1), "d");
+    anvil_build_br(ctx, next);
+    anvil_set_insert_point(ctx, next);
+    anvil_value_t *b = anvil_build_add(ctx, anvil_const_i32(ctx, 4), anvil_const_i32(ctx, 5), "b");
+    anvil_build_store(ctx, b, g);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+
+    func->change_stamp = 1;
+    anvil_block_mark_changed(next);
+    func->change_stamp = 2;
+    func->visit_since = 1;
+    CHECK(anvil_pass_const_fold(func), "const-fold changes the marked block");
+    CHECK(anvil_value_num_uses(b) == 0 && anvil_value_num_uses(a) == 1,
+          "... and leaves the unmarked one alone");
+    CHECK(anvil_pass_dce(func) && instr_of(d)->parent == entry, "dce sweeps only the marked block");
+
+    func->visit_since = 0;
+    CHECK(anvil_pass_const_fold(func) && anvil_value_num_uses(a) == 0,
+          "visit_since 0 folds everywhere");
+    CHECK(anvil_pass_dce(func) && !instr_of(d)->parent, "... and dce sweeps everywhere");
+    anvil_module_destroy(mod);
+}
+
+#define LOG_BLOCKS 16
+
+/* The worklist built from the change log, as the pass manager sets it up */
+static void test_worklist(anvil_ctx_t *ctx)
+{
+    printf("\nWorklist from the change log:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "worklist");
+    anvil_func_t *func = make_func(ctx, mod, "worklist");
+    anvil_block_t *blocks[LOG_BLOCKS];
+    blocks[0] = anvil_func_get_entry(func);
+    for (int k = 1; k < LOG_BLOCKS; k++) blocks[k] = anvil_block_create(func, "b");
+
+    func->log_changes = true;
+    func->num_change_log = 0;
+    func->change_stamp = 1;
+    anvil_block_mark_changed(blocks[9]);
+    anvil_block_mark_changed(blocks[3]);
+    anvil_block_mark_changed(blocks[9]);
+    func->change_stamp = 2;
+    func->visit_since = 1;
+    func->visit_log = 0;
+    func->worklist_state = ANVIL_WORKLIST_NONE;
+
+    anvil_block_t *block = anvil_func_changed_first(func);
+    CHECK(func->worklist_state == ANVIL_WORKLIST_LIST && func->num_worklist == 2,
+          "a few logged blocks make a worklist, each once");
+    CHECK(block == blocks[3], "first: the earliest in block order");
+    anvil_block_mark_changed(blocks[12]);
+    anvil_block_mark_changed(blocks[1]);
+    block = anvil_func_changed_next(block);
+    CHECK(block == blocks[9], "next: the following one");
+    block = anvil_func_changed_next(block);
+    CHECK(block == blocks[12], "a block marked ahead of the walk joins it");
+    CHECK(!anvil_func_changed_next(block), "... and one marked behind it does not");
+    CHECK(anvil_func_changed_first(func) == blocks[1], "first again starts over, with it");
+
+    func->worklist_state = ANVIL_WORKLIST_NONE;
+    func->num_worklist = 0;
+    func->change_stamp = 3;
+    for (int k = 0; k < LOG_BLOCKS; k += 2) anvil_block_mark_changed(blocks[k]);
+    func->change_stamp = 4;
+    func->visit_since = 3;
+    func->visit_log = 4;
+    size_t n = 0;
+    for (block = anvil_func_changed_first(func); block; block = anvil_func_changed_next(block)) n++;
+    CHECK(func->worklist_state == ANVIL_WORKLIST_WALK && n == LOG_BLOCKS / 2,
+          "half the function changed: walks by stamp instead");
+
+    func->visit_since = 0;
+    func->worklist_state = ANVIL_WORKLIST_NONE;
+    func->num_worklist = 0;
+    func->log_changes = false;
+    free(func->change_log);
+    free(func->worklist);
+    func->change_log = NULL;
+    func->worklist = NULL;
+    func->num_change_log = func->cap_change_log = 0;
+    func->cap_worklist = 0;
+    anvil_module_destroy(mod);
+}
+
+/* A custom pass that counts the blocks it would have to look at */
+static size_t region_sizes[8];
+static size_t num_regions = 0;
+
+static bool region_pass(anvil_func_t *func)
+{
+    size_t n = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        if (anvil_block_needs_visit(block)) n++;
+    }
+    if (num_regions < 8) region_sizes[num_regions++] = n;
+    return false;
+}
+
+#define CHAIN_BLOCKS 200
+
+/* CHAIN_BLOCKS blocks storing x + k + 1 to g, one of them a constant add */
+static void test_pass_manager(void)
+{
+    printf("\nThe pass manager hands each pass the blocks changed since its last run:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    anvil_pass_manager_set_verify(pm, true);
+    anvil_pass_manager_set_stats(pm, true);
+    anvil_pass_info_t info = { .name = "region", .description = "Counts its region", .run = region_pass };
+    anvil_pass_manager_register(pm, &info);
+    CHECK(anvil_pass_manager_set_pipeline(pm, "const-fold,region,dce,copy-prop") == ANVIL_OK,
+          "pipeline set");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "chain");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_value_t *g = anvil_module_add_global(mod, "g", i32, ANVIL_LINK_EXTERNAL);
+    anvil_func_t *func = make_func(ctx, mod, "chain");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    for (int k = 0; k < CHAIN_BLOCKS - 1; k++) {
+        anvil_value_t *lhs = k == CHAIN_BLOCKS / 2 ? anvil_const_i32(ctx, 7) : x;
+        anvil_build_store(ctx, anvil_build_add(ctx, lhs, anvil_const_i32(ctx, k + 1), NULL), g);
+        anvil_block_t *next = anvil_block_create(func, "b");
+        anvil_build_br(ctx, next);
+        anvil_set_insert_point(ctx, next);
+    }
+    anvil_build_ret(ctx, x);
+
+    anvil_module_optimize(mod);
+    CHECK(num_regions == 2, "custom pass ran in both rounds");
+    CHECK(region_sizes[0] == CHAIN_BLOCKS, "first run: every block");
+    CHECK(num_regions == 2 && region_sizes[1] == 1, "second run: the one block dce edited");
+
+    size_t count = 0;
+    const anvil_pass_stats_t *stats = anvil_pass_manager_get_pass_stats(pm, &count);
+    const anvil_pass_stats_t *fold = &stats[ANVIL_PASS_CONST_FOLD];
+    const anvil_pass_stats_t *dce = &stats[ANVIL_PASS_DCE];
+    CHECK(fold->blocks_changed == 1 && dce->blocks_changed == 1, "stats: one block changed by each");
+    const anvil_pass_stats_t *copy = &stats[ANVIL_PASS_COPY_PROP];
+    CHECK(fold->runs == 2 && copy->runs == 1 && copy->skipped == 1,
+          "stats: a pass with nothing changed since its last run is skipped");
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== Change Tracking Test ===\n");
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    test_marks(ctx);
+    test_region(ctx);
+    test_worklist(ctx);
+    anvil_ctx_destroy(ctx);
+    test_pass_manager();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
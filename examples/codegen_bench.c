@@ -0,0 +1,109 @@
+/*
+ * ANVIL - Code Generation Scaling Benchmark
+ *
+ * Times anvil_module_codegen on one large function per target while the
+ * function size doubles. Every step stores a fresh add into a fresh alloca
+ * and loads it back, so each backend records and looks up a stack slot per
+ * value. With slot lookup through a dense value map, ns/value should stay
+ * roughly flat as the function grows.
+ *
+ * Usage: codegen_bench [max_steps]
+ *   max_steps: largest function size in steps (default: 16000)
+ */
+
+#include <anvil/anvil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double elapsed_ms(clock_t start, clock_t end)
+{
+    return (double)(end - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static const struct {
+    anvil_arch_t arch;
+    const char *name;
+} targets[] = {
+    { ANVIL_ARCH_X86,     "x86" },
+    { ANVIL_ARCH_X86_64,  "x86_64" },
+    { ANVIL_ARCH_S370,    "s370" },
+    { ANVIL_ARCH_S370_XA, "s370_xa" },
+    { ANVIL_ARCH_S390,    "s390" },
+    { ANVIL_ARCH_ZARCH,   "zarch" },
+    { ANVIL_ARCH_PPC32,   "ppc32" },
+    { ANVIL_ARCH_PPC64,   "ppc64" },
+    { ANVIL_ARCH_PPC64LE, "ppc64le" },
+    { ANVIL_ARCH_ARM64,   "arm64" },
+};
+
+/* Build f(x): per step p = alloca; store acc + x -> p; acc = load p */
+static size_t build_func(anvil_ctx_t *ctx, anvil_module_t *mod, long steps)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 1, false);
+    anvil_func_t *func = anvil_func_create(mod, "f", func_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *acc = x;
+
+    for (long i = 0; i < steps; i++) {
+        anvil_value_t *p = anvil_build_alloca(ctx, i32, NULL);
+        anvil_build_store(ctx, anvil_build_add(ctx, acc, x, NULL), p);
+        acc = anvil_build_load(ctx, i32, p, NULL);
+    }
+    anvil_build_ret(ctx, acc);
+
+    /* alloca, add and load each define a value */
+    return 1 + 3 * (size_t)steps;
+}
+
+int main(int argc, char **argv)
+{
+    long max_steps = 16000;
+    if (argc > 1) {
+        max_steps = atol(argv[1]);
+        if (max_steps <= 0) {
+            fprintf(stderr, "Invalid step count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    printf("=== Codegen benchmark: one function, doubling size ===\n");
+    printf("%-8s %8s %10s %10s\n", "target", "values", "ms", "ns/value");
+
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        for (long steps = 1000; steps <= max_steps; steps *= 2) {
+            anvil_ctx_t *ctx = anvil_ctx_create();
+            if (!ctx) {
+                fprintf(stderr, "Failed to create context\n");
+                return 1;
+            }
+            anvil_ctx_set_target(ctx, targets[t].arch);
+            anvil_module_t *mod = anvil_module_create(ctx, "codegen_bench");
+            size_t values = build_func(ctx, mod, steps);
+
+            char *out = NULL;
+            size_t len = 0;
+            clock_t start = clock();
+            anvil_error_t err = anvil_module_codegen(mod, &out, &len);
+            clock_t end = clock();
+
+            if (err != ANVIL_OK) {
+                printf("%-8s %8zu %10s\n", targets[t].name, values, "failed");
+            } else {
+                double ms = elapsed_ms(start, end);
+                printf("%-8s %8zu %10.2f %10.1f\n", targets[t].name, values, ms,
+                       ms * 1e6 / (double)values);
+            }
+
+            free(out);
+            anvil_module_destroy(mod);
+            anvil_ctx_destroy(ctx);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * ANVIL - Constant Uniquing Test
+ *
+ * Integer, float, null and string constants are uniqued per context,
+ * keyed by type and value. Building the same constant twice must return
+ * the same value, and local CSE must then match x + 1 against a second
+ * x + 1 by pointer.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include "test_util.h"
+
+static void test_scalars(anvil_ctx_t *ctx)
+{
+    printf("\nTest 1: integer and float constants\n");
+
+    CHECK(anvil_const_i32(ctx, 0) == anvil_const_i32(ctx, 0), "i32 0 is unique");
+    CHECK(anvil_const_i32(ctx, -7) == anvil_const_i32(ctx, -7), "i32 -7 is unique");
+    CHECK(anvil_const_i32(ctx, 1) != anvil_const_i32(ctx, 2), "i32 1 != i32 2");
+    CHECK(anvil_const_i32(ctx, 1) != anvil_const_i64(ctx, 1), "type is part of the key");
+    CHECK(anvil_const_u8(ctx, 255) != anvil_const_i8(ctx, -1), "u8 255 != i8 -1");
+    CHECK(anvil_const_u64(ctx, UINT64_MAX) == anvil_const_u64(ctx, UINT64_MAX), "u64 max is unique");
+
+    CHECK(anvil_const_f64(ctx, 1.5) == anvil_const_f64(ctx, 1.5), "f64 1.5 is unique");
+    CHECK(anvil_const_f64(ctx, 0.0) != anvil_const_f64(ctx, -0.0), "0.0 != -0.0");
+    CHECK(anvil_const_f32(ctx, 1.5f) != anvil_const_f64(ctx, 1.5), "f32 1.5 != f64 1.5");
+}
+
+static void test_null_and_strings(anvil_ctx_t *ctx)
+{
+    printf("\nTest 2: null and string constants\n");
+
+    anvil_type_t *pi8 = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+    anvil_type_t *pi32 = anvil_type_ptr(ctx, anvil_type_i32(ctx));
+    CHECK(anvil_const_null(ctx, pi8) == anvil_const_null(ctx, pi8), "null i8* is unique");
+    CHECK(anvil_const_null(ctx, pi8) != anvil_const_null(ctx, pi32), "null i8* != null i32*");
+
+    char buf[] = "hello";
+    anvil_value_t *s1 = anvil_const_string(ctx, "hello");
+    anvil_value_t *s2 = anvil_const_string(ctx, buf);
+    CHECK(s1 == s2, "strings are keyed by contents");
+    CHECK(s1 != anvil_const_string(ctx, "world"), "\"hello\" != \"world\"");
+
+    buf[0] = 'j';
+    CHECK(anvil_const_string(ctx, "hello") == s1, "string contents are copied");
+}
+
+/*
+ * int f(int x) { return (x + 1) * (x + 1); }
+ */
+static void test_cse(anvil_ctx_t *ctx)
+{
+    printf("\nTest 3: CSE on shared constants\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "const_cse");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 1, false);
+    anvil_func_t *func = anvil_func_create(mod, "f", func_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *a = anvil_build_add(ctx, x, anvil_const_i32(ctx, 1), "a");
+    anvil_value_t *b = anvil_build_add(ctx, x, anvil_const_i32(ctx, 1), "b");
+    anvil_build_ret(ctx, anvil_build_mul(ctx, a, b, "m"));
+
+    CHECK(anvil_pass_cse(func), "CSE reports a change");
+    CHECK(anvil_value_num_uses(a) == 2, "x + 1 is reused");
+    CHECK(anvil_value_num_uses(b) == 0, "second x + 1 is dead");
+
+    anvil_module_destroy(mod);
+
+    /* Constants outlive modules that used them */
+    CHECK(anvil_const_i32(ctx, 1) == anvil_const_i32(ctx, 1), "constants survive module destroy");
+}
+
+int main(void)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    test_scalars(ctx);
+    test_null_and_strings(ctx);
+    test_cse(ctx);
+
+    anvil_ctx_destroy(ctx);
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * ANVIL - Def-Use Chain Test
+ *
+ * Checks anvil_value_num_uses / anvil_value_replace_all_uses and times
+ * O2 on large straight-line functions. With use-lists the optimizer
+ * should scale roughly linearly with function size.
+ *
+ * Usage: def_use_test [num_instrs]
+ *   num_instrs: size of the largest timed function (default: 50000)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "test_util.h"
+
+/*
+ * Test 1: use counts and replace-all-uses-with
+ *
+ * int f(int x, int y) {
+ *     int a = x + y;
+ *     int b = a * a;
+ *     int c = a - y;
+ *     return b + c;
+ * }
+ */
+static void test_use_lists(anvil_ctx_t *ctx)
+{
+    printf("\nTest 1: use counts and replace_all_uses\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "def_use");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+    anvil_func_t *func = anvil_func_create(mod, "f", func_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_value_t *a = anvil_build_add(ctx, x, y, "a");
+    anvil_value_t *b = anvil_build_mul(ctx, a, a, "b");
+    anvil_value_t *c = anvil_build_sub(ctx, a, y, "c");
+    anvil_value_t *r = anvil_build_add(ctx, b, c, "r");
+    anvil_build_ret(ctx, r);
+
+    CHECK(anvil_value_num_uses(x) == 1, "x has 1 use");
+    CHECK(anvil_value_num_uses(y) == 2, "y has 2 uses");
+    CHECK(anvil_value_num_uses(a) == 3, "a has 3 uses (a * a counts twice)");
+    CHECK(anvil_value_num_uses(r) == 1, "r has 1 use (ret)");
+
+    size_t n = anvil_value_replace_all_uses(a, x);
+    CHECK(n == 3, "replace_all_uses(a, x) rewrote 3 uses");
+    CHECK(anvil_value_num_uses(a) == 0, "a has no uses left");
+    CHECK(anvil_value_num_uses(x) == 4, "x now has 4 uses");
+
+    n = anvil_value_replace_all_uses(x, x);
+    CHECK(n == 0, "replacing a value with itself is a no-op");
+
+    anvil_module_destroy(mod);
+}
+
+/*
+ * Build a straight-line function with num_instrs instructions that gives
+ * every O2 pass something to do:
+ *
+ *   t0 = x + k         (constant operand)
+ *   t1 = x + k         (common subexpression of t0)
+ *   t2 = t1 * 4        (strength reduction)
+ *   t3 = t2 + 0        (copy)
+ *   acc = acc ^ t3
+ *   d  = t0 - y        (dead)
+ */
+static anvil_module_t *build_large_func(anvil_ctx_t *ctx, int num_instrs)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "large");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+    anvil_func_t *func = anvil_func_create(mod, "large", func_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_value_t *acc = y;
+
+    for (int i = 0; i + 6 <= num_instrs; i += 6) {
+        anvil_value_t *k = anvil_const_i32(ctx, i % 251);
+        anvil_value_t *t0 = anvil_build_add(ctx, x, k, NULL);
+        anvil_value_t *t1 = anvil_build_add(ctx, x, k, NULL);
+        anvil_value_t *t2 = anvil_build_mul(ctx, t1, anvil_const_i32(ctx, 4), NULL);
+        anvil_value_t *t3 = anvil_build_add(ctx, t2, anvil_const_i32(ctx, 0), NULL);
+        acc = anvil_build_xor(ctx, acc, t3, NULL);
+        anvil_build_sub(ctx, t0, y, NULL);
+    }
+    anvil_build_ret(ctx, acc);
+
+    return mod;
+}
+
+static void time_o2(anvil_ctx_t *ctx, int num_instrs)
+{
+    printf("\nTest 2: O2 on large functions\n");
+
+    for (int n = num_instrs / 4; n <= num_instrs; n *= 2) {
+        anvil_module_t *mod = build_large_func(ctx, n);
+
+        clock_t start = clock();
+        anvil_module_optimize(mod);
+        clock_t end = clock();
+
+        printf("  %6d instructions: %8.2f ms\n", n,
+               (double)(end - start) * 1000.0 / CLOCKS_PER_SEC);
+        anvil_module_destroy(mod);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int num_instrs = 50000;
+    if (argc > 1) {
+        num_instrs = atoi(argv[1]);
+        if (num_instrs < 24) {
+            fprintf(stderr, "Invalid instruction count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+
+    test_use_lists(ctx);
+    time_o2(ctx, num_instrs);
+
+    anvil_ctx_destroy(ctx);
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * ANVIL - ELF Object Writer Test
+ *
+ * Exercises the shared ELF writer (an internal API used by backends that
+ * encode machine code) without a backend: global variables laid out from
+ * their initializers, string literals in .rodata, relocations in .data,
+ * big-endian objects for ppc64, and the file descriptor path.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define STB_LOCAL           0
+#define STB_GLOBAL          1
+#define STT_OBJECT          1
+#define R_X86_64_64         1
+
+/* View of an object: byte order comes from e_ident */
+typedef struct {
+    const char *data;
+    size_t len;
+    bool big_endian;
+} elf_t;
+
+static uint64_t rd(const elf_t *e, const char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) {
+        int b = e->big_endian ? i : bytes - 1 - i;
+        v = (v << 8) | (unsigned char)p[b];
+    }
+    return v;
+}
+
+static const char *sh_field(const elf_t *e, int idx, int off)
+{
+    return e->data + rd(e, e->data + 40, 8) + (uint64_t)idx * 64 + off;
+}
+
+static uint64_t sh_offset(const elf_t *e, int idx) { return rd(e, sh_field(e, idx, 24), 8); }
+static uint64_t sh_size(const elf_t *e, int idx) { return rd(e, sh_field(e, idx, 32), 8); }
+
+static int find_section(const elf_t *e, const char *name)
+{
+    int shnum = (int)rd(e, e->data + 60, 2);
+    int shstrndx = (int)rd(e, e->data + 62, 2);
+    for (int i = 1; i < shnum; i++) {
+        const char *n = e->data + sh_offset(e, shstrndx) + rd(e, sh_field(e, i, 0), 4);
+        if (strcmp(n, name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Symbol index of name, or -1; the other fields are optional outputs */
+static int find_symbol(const elf_t *e, const char *name, int *info, int *shndx,
+                       uint64_t *value, uint64_t *size)
+{
+    int symtab = find_section(e, ".symtab");
+    int strtab = find_section(e, ".strtab");
+    if (symtab < 0 || strtab < 0) return -1;
+    for (uint64_t i = 1; i < sh_size(e, symtab) / 24; i++) {
+        const char *sym = e->data + sh_offset(e, symtab) + i * 24;
+        if (strcmp(e->data + sh_offset(e, strtab) + rd(e, sym, 4), name) != 0) continue;
+        if (info) *info = (unsigned char)sym[4];
+        if (shndx) *shndx = (int)rd(e, sym + 6, 2);
+        if (value) *value = rd(e, sym + 8, 8);
+        if (size) *size = rd(e, sym + 16, 8);
+        return (int)i;
+    }
+    return -1;
+}
+
+/* Bytes of symbol name in its section, or NULL */
+static const char *symbol_data(const elf_t *e, const char *name)
+{
+    int shndx = 0;
+    uint64_t value = 0;
+    if (find_symbol(e, name, NULL, &shndx, &value, NULL) < 0 || shndx <= 0) return NULL;
+    return e->data + sh_offset(e, shndx) + value;
+}
+
+/* .rela.data entry at offset: symbol index and addend */
+static bool data_reloc(const elf_t *e, uint64_t offset, uint32_t *type, int *sym, int64_t *addend)
+{
+    int rela = find_section(e, ".rela.data");
+    if (rela < 0) return false;
+    for (uint64_t off = 0; off < sh_size(e, rela); off += 24) {
+        const char *r = e->data + sh_offset(e, rela) + off;
+        if (rd(e, r, 8) != offset) continue;
+        uint64_t info = rd(e, r + 8, 8);
+        *type = (uint32_t)info;
+        *sym = (int)(info >> 32);
+        *addend = (int64_t)rd(e, r + 16, 8);
+        return true;
+    }
+    return false;
+}
+
+/* Object holding the module's globals only */
+static char *globals_object(anvil_module_t *mod, size_t *len)
+{
+    anvil_elf_object_t obj;
+    char *out = NULL;
+    if (anvil_elf_init(&obj, mod->ctx) != ANVIL_OK) return NULL;
+    if (anvil_elf_add_globals(&obj, mod) != ANVIL_OK ||
+        anvil_elf_write(&obj, &out, len) != ANVIL_OK) {
+        out = NULL;
+    }
+    anvil_elf_free(&obj);
+    return out;
+}
+
+/* Test 1: initializers of every kind on x86-64 */
+static void test_globals(void)
+{
+    printf("\nTest 1: global variables from initializers\n");
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_module_t *mod = anvil_module_create(ctx, "globals");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8 = anvil_type_i8(ctx);
+    anvil_type_t *str_type = anvil_type_ptr(ctx, i8);
+
+    anvil_value_t *answer = anvil_module_add_global(mod, "answer", i32, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(answer, anvil_const_i32(ctx, 42));
+    anvil_value_t *ratio = anvil_module_add_global(mod, "ratio", anvil_type_f64(ctx), ANVIL_LINK_INTERNAL);
+    anvil_global_set_initializer(ratio, anvil_const_f64(ctx, 0.5));
+    anvil_value_t *elems[] = { anvil_const_i64(ctx, 1), anvil_const_i64(ctx, -2) };
+    anvil_value_t *table = anvil_module_add_global(mod, "table", anvil_type_array(ctx, i32, 4),
+                                                   ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(table, anvil_const_array(ctx, i32, elems, 2));
+    anvil_value_t *greeting = anvil_module_add_global(mod, "greeting", str_type, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(greeting, anvil_const_string(ctx, "hello"));
+    anvil_value_t *alias = anvil_module_add_global(mod, "alias", anvil_type_ptr(ctx, i32),
+                                                   ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(alias, answer);
+    anvil_module_add_global(mod, "zeroed", anvil_type_i64(ctx), ANVIL_LINK_EXTERNAL);
+    anvil_module_add_extern(mod, "elsewhere", i32);
+
+    size_t len = 0;
+    char *out = globals_object(mod, &len);
+    CHECK(out != NULL, "object written");
+    if (!out) goto done;
+    elf_t e = { out, len, false };
+
+    int info = 0, shndx = 0;
+    uint64_t value = 0, size = 0;
+    const char *p;
+    int data = find_section(&e, ".data");
+    CHECK(find_symbol(&e, "answer", &info, &shndx, NULL, &size) > 0 && shndx == data &&
+          info == ((STB_GLOBAL << 4) | STT_OBJECT) && size == 4,
+          "answer is a 4-byte global object in .data");
+    CHECK((p = symbol_data(&e, "answer")) && rd(&e, p, 4) == 42, "answer = 42");
+
+    double half;
+    p = symbol_data(&e, "ratio");
+    if (p) memcpy(&half, p, sizeof(half));
+    CHECK(p && half == 0.5 && find_symbol(&e, "ratio", &info, NULL, &value, NULL) > 0 &&
+          (info >> 4) == STB_LOCAL && value % 8 == 0,
+          "internal ratio is a local, aligned f64 0.5");
+
+    p = symbol_data(&e, "table");
+    CHECK(p && find_symbol(&e, "table", NULL, NULL, NULL, &size) > 0 && size == 16 &&
+          rd(&e, p, 4) == 1 && rd(&e, p + 4, 4) == 0xfffffffe &&
+          rd(&e, p + 8, 4) == 0 && rd(&e, p + 12, 4) == 0,
+          "table[4] = {1, -2} is padded with zeros");
+
+    uint32_t type = 0;
+    int sym = 0;
+    int64_t addend = 0;
+    int rodata = find_section(&e, ".rodata");
+    find_symbol(&e, "greeting", NULL, NULL, &value, NULL);
+    bool reloc = data_reloc(&e, value, &type, &sym, &addend);
+    CHECK(rodata > 0 && reloc && type == R_X86_64_64 &&
+          memcmp(out + sh_offset(&e, rodata) + addend, "hello", 6) == 0,
+          "greeting points at \"hello\" in .rodata through R_X86_64_64");
+
+    find_symbol(&e, "alias", NULL, NULL, &value, NULL);
+    reloc = data_reloc(&e, value, &type, &sym, &addend);
+    CHECK(reloc && type == R_X86_64_64 && sym == find_symbol(&e, "answer", NULL, NULL, NULL, NULL) &&
+          addend == 0, "alias = &answer is a relocation against answer");
+
+    CHECK((p = symbol_data(&e, "zeroed")) && rd(&e, p, 8) == 0,
+          "a global without initializer is zero");
+    CHECK(find_symbol(&e, "elsewhere", NULL, NULL, NULL, NULL) < 0,
+          "an extern declaration defines nothing");
+    free(out);
+
+done:
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* Test 2: byte order and header fields follow the target */
+static void test_big_endian(void)
+{
+    printf("\nTest 2: ppc64 big-endian object\n");
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_PPC64);
+    anvil_module_t *mod = anvil_module_create(ctx, "be");
+    anvil_value_t *word = anvil_module_add_global(mod, "word", anvil_type_i32(ctx), ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(word, anvil_const_i32(ctx, 0x01020304));
+
+    size_t len = 0;
+    char *out = globals_object(mod, &len);
+    CHECK(out != NULL, "object written");
+    if (out) {
+        elf_t e = { out, len, true };
+        CHECK(out[4] == 2 && out[5] == 2, "ELFCLASS64, ELFDATA2MSB");
+        CHECK(rd(&e, out + 18, 2) == 21 && rd(&e, out + 48, 4) == 1,
+              "e_machine EM_PPC64, e_flags ELFv1");
+        const char *p = symbol_data(&e, "word");
+        CHECK(p && memcmp(p, "\x01\x02\x03\x04", 4) == 0, "word is stored most significant byte first");
+        free(out);
+    }
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* Test 3: the fd path writes the same bytes as the buffer path */
+static void test_file(void)
+{
+    printf("\nTest 3: writing through the file descriptor\n");
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_module_t *mod = anvil_module_create(ctx, "file");
+    anvil_value_t *msg = anvil_module_add_global(mod, "msg", anvil_type_ptr(ctx, anvil_type_i8(ctx)),
+                                                 ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(msg, anvil_const_string(ctx, "on disk"));
+
+    anvil_elf_object_t obj;
+    char *buf = NULL;
+    size_t len = 0;
+    anvil_elf_init(&obj, ctx);
+    anvil_elf_add_globals(&obj, mod);
+    anvil_elf_write(&obj, &buf, &len);
+
+    /* Existing bytes before the object stay; the object follows them */
+    FILE *f = tmpfile();
+    bool ok = f && buf && fwrite("pre", 1, 3, f) == 3 && anvil_elf_write_file(&obj, f) == ANVIL_OK;
+    CHECK(ok, "anvil_elf_write_file succeeds");
+    if (ok) {
+        long end = ftell(f);
+        char *back = malloc(len + 3);
+        rewind(f);
+        bool same = back && fread(back, 1, len + 3, f) == len + 3 && fgetc(f) == EOF &&
+                    memcmp(back, "pre", 3) == 0 && memcmp(back + 3, buf, len) == 0;
+        CHECK(same, "file holds the prefix and then the same bytes as the buffer");
+        CHECK(end == (long)(len + 3), "the stream is left after the object");
+        free(back);
+    }
+    if (f) fclose(f);
+    free(buf);
+    anvil_elf_free(&obj);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* Test 4: targets without an ELF64 encoding */
+static void test_unsupported(void)
+{
+    printf("\nTest 4: targets without ELF64 objects\n");
+
+    anvil_elf_object_t obj;
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_S390);
+    CHECK(anvil_elf_init(&obj, ctx) == ANVIL_ERR_CODEGEN, "s390 is rejected");
+    anvil_ctx_destroy(ctx);
+
+    ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_ARM64);
+    anvil_ctx_set_abi(ctx, ANVIL_ABI_DARWIN);
+    CHECK(anvil_elf_init(&obj, ctx) == ANVIL_ERR_CODEGEN, "arm64 for Darwin (Mach-O) is rejected");
+    anvil_ctx_set_abi(ctx, ANVIL_ABI_SYSV);
+    bool ok = anvil_elf_init(&obj, ctx) == ANVIL_OK;
+    CHECK(ok && obj.machine == 183 && !obj.big_endian, "arm64 for Linux is EM_AARCH64");
+    if (ok) anvil_elf_free(&obj);
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== ELF object writer ===\n");
+
+    test_globals();
+    test_big_endian();
+    test_file();
+    test_unsupported();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * ANVIL - Code Emission Throughput Benchmark
+ *
+ * Measures how many IR instructions per second each backend turns into
+ * assembly text. The module is a batch of straight-line functions mixing
+ * arithmetic, compares, memory accesses and calls, so the time goes to
+ * instruction selection and text formatting rather than to analysis.
+ * At -O2 the module is optimized first and only codegen is timed.
+ *
+ * Usage: emit_bench [num_instrs]
+ *   num_instrs: IR instructions per target (default: 200000)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FUNC_SIZE 2000
+
+static double elapsed_ms(clock_t start, clock_t end)
+{
+    return (double)(end - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static const struct {
+    anvil_arch_t arch;
+    const char *name;
+} targets[] = {
+    { ANVIL_ARCH_X86,     "x86" },
+    { ANVIL_ARCH_X86_64,  "x86_64" },
+    { ANVIL_ARCH_S370,    "s370" },
+    { ANVIL_ARCH_S370_XA, "s370_xa" },
+    { ANVIL_ARCH_S390,    "s390" },
+    { ANVIL_ARCH_ZARCH,   "zarch" },
+    { ANVIL_ARCH_PPC32,   "ppc32" },
+    { ANVIL_ARCH_PPC64,   "ppc64" },
+    { ANVIL_ARCH_PPC64LE, "ppc64le" },
+    { ANVIL_ARCH_ARM64,   "arm64" },
+};
+
+/* One function of about `count` instructions; returns the number built */
+static long build_func(anvil_ctx_t *ctx, anvil_module_t *mod, anvil_func_t *callee,
+                       int index, long count)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+    char name[32];
+    snprintf(name, sizeof(name), "f%d", index);
+    anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *a = anvil_func_get_param(func, 0);
+    anvil_value_t *b = anvil_func_get_param(func, 1);
+    anvil_value_t *slot = anvil_build_alloca(ctx, i32, NULL);
+    anvil_value_t *acc = a;
+    long built = 1;
+
+    while (built < count) {
+        anvil_value_t *t = anvil_build_add(ctx, acc, b, NULL);
+        anvil_value_t *u = anvil_build_mul(ctx, t, anvil_const_i32(ctx, (int32_t)built), NULL);
+        anvil_value_t *v = anvil_build_sub(ctx, u, acc, NULL);
+        anvil_value_t *w = anvil_build_xor(ctx, v, anvil_const_i32(ctx, 0x5a5a), NULL);
+        anvil_build_store(ctx, w, slot);
+        anvil_value_t *x = anvil_build_load(ctx, i32, slot, NULL);
+        anvil_value_t *c = anvil_build_cmp_lt(ctx, x, t, NULL);
+        anvil_value_t *y = anvil_build_select(ctx, c, x, t, NULL);
+        built += 8;
+        if (built % 64 == 1) {
+            anvil_value_t *args[] = { y, a };
+            y = anvil_build_call(ctx, i32, anvil_func_get_value(callee), args, 2, NULL);
+            built++;
+        }
+        acc = y;
+    }
+    anvil_build_ret(ctx, acc);
+    return built + 1;
+}
+
+static void bench_target(size_t t, anvil_opt_level_t level, long num_instrs)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, targets[t].arch);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_module_t *mod = anvil_module_create(ctx, "emit_bench");
+
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_func_t *callee = anvil_func_declare(mod, "g",
+        anvil_type_func(ctx, i32, params, 2, false));
+
+    long built = 0;
+    for (int i = 0; built < num_instrs; i++) {
+        built += build_func(ctx, mod, callee, i, FUNC_SIZE);
+    }
+    if (level != ANVIL_OPT_NONE) anvil_module_optimize(mod);
+
+    char *out = NULL;
+    size_t len = 0;
+    clock_t start = clock();
+    anvil_error_t err = anvil_module_codegen(mod, &out, &len);
+    clock_t end = clock();
+
+    if (err != ANVIL_OK) {
+        printf("%-8s %-4s %10s\n", targets[t].name, level ? "-O2" : "-O0", "failed");
+    } else {
+        double ms = elapsed_ms(start, end);
+        double secs = ms > 0 ? ms / 1000.0 : 1e-9;
+        printf("%-8s %-4s %10.2f %12.2f %10.1f\n", targets[t].name, level ? "-O2" : "-O0",
+               ms, (double)built / secs / 1e6, (double)len / secs / 1e6);
+    }
+
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+int main(int argc, char **argv)
+{
+    long num_instrs = 200000;
+    if (argc > 1) {
+        num_instrs = atol(argv[1]);
+        if (num_instrs <= 0) {
+            fprintf(stderr, "Invalid instruction count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    printf("=== Emission benchmark: %ld IR instructions per target ===\n", num_instrs);
+    printf("%-8s %-4s %10s %12s %10s\n", "target", "opt", "ms", "M instr/s", "MB/s");
+
+    for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+        bench_target(t, ANVIL_OPT_NONE, num_instrs);
+        bench_target(t, ANVIL_OPT_STANDARD, num_instrs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,357 @@
+/*
+ * ANVIL - Global Value Numbering Test
+ *
+ * GVN reuses a pure computation made in a dominating block. Checks that
+ * it looks across blocks but not between siblings, that commutative and
+ * swapped-compare forms meet while different types and operand orders
+ * do not, and that it keeps finding repeats in blocks far larger than
+ * the table of the block-local CSE pass it replaces at O2. Finally runs
+ * branchy functions compiled with GVN and with CSE through the JIT and
+ * compares their results.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+/*
+ * a = x + y; if (x < y) return (y + x) * 2; else return x + y;
+ */
+static void test_dominating(anvil_ctx_t *ctx)
+{
+    printf("\nDominating blocks:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "dom");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_block_t *then_bb = anvil_block_create(func, "then");
+    anvil_block_t *else_bb = anvil_block_create(func, "else");
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *a = anvil_build_add(ctx, x, y, "a");
+    anvil_value_t *lt = anvil_build_cmp_lt(ctx, x, y, "lt");
+    anvil_build_br_cond(ctx, lt, then_bb, else_bb);
+
+    anvil_set_insert_point(ctx, then_bb);
+    anvil_value_t *b = anvil_build_add(ctx, y, x, "b");
+    anvil_value_t *gt = anvil_build_cmp_gt(ctx, y, x, "gt");
+    anvil_value_t *sel = anvil_build_select(ctx, gt, b, x, "sel");
+    anvil_build_ret(ctx, anvil_build_mul(ctx, sel, anvil_const_i32(ctx, 2), NULL));
+
+    anvil_set_insert_point(ctx, else_bb);
+    anvil_value_t *c = anvil_build_add(ctx, x, y, "c");
+    anvil_build_ret(ctx, c);
+
+    CHECK(anvil_pass_gvn(func), "GVN reports a change");
+    CHECK(anvil_value_num_uses(b) == 0 && anvil_value_num_uses(c) == 0,
+          "x + y in both branches reuses the entry's");
+    CHECK(anvil_value_num_uses(a) == 2, "entry's x + y has both uses");
+    CHECK(anvil_value_num_uses(gt) == 0 && anvil_value_num_uses(lt) == 2,
+          "y > x reuses x < y");
+    CHECK(!anvil_pass_gvn(func), "second run finds nothing");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * if (x < y) t = x * y; else e = x * y; join: return x * y;
+ */
+static void test_siblings(anvil_ctx_t *ctx)
+{
+    printf("\nSibling blocks:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "siblings");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_block_t *then_bb = anvil_block_create(func, "then");
+    anvil_block_t *else_bb = anvil_block_create(func, "else");
+    anvil_block_t *join = anvil_block_create(func, "join");
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, x, y, NULL), then_bb, else_bb);
+
+    anvil_set_insert_point(ctx, then_bb);
+    anvil_value_t *t = anvil_build_mul(ctx, x, y, "t");
+    anvil_build_br(ctx, join);
+
+    anvil_set_insert_point(ctx, else_bb);
+    anvil_value_t *e = anvil_build_mul(ctx, x, y, "e");
+    anvil_build_br(ctx, join);
+
+    anvil_set_insert_point(ctx, join);
+    anvil_value_t *phi = anvil_build_phi(ctx, anvil_type_i32(ctx), "p");
+    anvil_phi_add_incoming(phi, t, then_bb);
+    anvil_phi_add_incoming(phi, e, else_bb);
+    anvil_value_t *j = anvil_build_mul(ctx, x, y, "j");
+    anvil_build_ret(ctx, anvil_build_add(ctx, phi, j, NULL));
+
+    CHECK(!anvil_pass_gvn(func), "nothing to reuse");
+    CHECK(anvil_value_num_uses(t) == 1 && anvil_value_num_uses(e) == 1 &&
+          anvil_value_num_uses(j) == 1, "branch and join products all kept");
+    anvil_module_destroy(mod);
+}
+
+static void test_keys(anvil_ctx_t *ctx)
+{
+    printf("\nExpression keys:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "keys");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_type_t *i64 = anvil_type_i64(ctx);
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *s1 = anvil_build_sub(ctx, x, y, "s1");
+    anvil_value_t *s2 = anvil_build_sub(ctx, y, x, "s2");
+    anvil_value_t *k1 = anvil_build_xor(ctx, anvil_const_i32(ctx, 7), x, "k1");
+    anvil_value_t *k2 = anvil_build_xor(ctx, x, anvil_const_i32(ctx, 7), "k2");
+    anvil_value_t *u1 = anvil_build_cmp_uge(ctx, x, y, "u1");
+    anvil_value_t *u2 = anvil_build_cmp_ule(ctx, y, x, "u2");
+    anvil_value_t *u3 = anvil_build_cmp_ge(ctx, x, y, "u3");
+    anvil_value_t *w1 = anvil_build_sext(ctx, x, i64, "w1");
+    anvil_value_t *w2 = anvil_build_sext(ctx, x, i64, "w2");
+    anvil_value_t *z1 = anvil_build_zext(ctx, x, i64, "z1");
+    anvil_value_t *n1 = anvil_build_trunc(ctx, w1, i32, "n1");
+    anvil_value_t *n2 = anvil_build_trunc(ctx, w2, i32, "n2");
+
+    anvil_value_t *r = anvil_build_add(ctx, s1, s2, NULL);
+    r = anvil_build_add(ctx, r, anvil_build_add(ctx, k1, k2, NULL), NULL);
+    r = anvil_build_add(ctx, r, anvil_build_add(ctx, u1, anvil_build_add(ctx, u2, u3, NULL), NULL), NULL);
+    r = anvil_build_add(ctx, r, anvil_build_add(ctx, n1, n2, NULL), NULL);
+    r = anvil_build_add(ctx, r, anvil_build_trunc(ctx, z1, i32, NULL), NULL);
+    anvil_build_ret(ctx, r);
+
+    anvil_pass_gvn(func);
+    CHECK(anvil_value_num_uses(s1) == 1 && anvil_value_num_uses(s2) == 1, "x - y and y - x differ");
+    CHECK(anvil_value_num_uses(k2) == 0, "7 ^ x and x ^ 7 meet");
+    CHECK(anvil_value_num_uses(u2) == 0, "x >=u y and y <=u x meet");
+    CHECK(anvil_value_num_uses(u3) == 1, "signed and unsigned compares differ");
+    CHECK(anvil_value_num_uses(w2) == 0 && anvil_value_num_uses(n2) == 0,
+          "repeated casts meet, then their users");
+    CHECK(anvil_value_num_uses(z1) == 1, "zext and sext differ");
+    anvil_module_destroy(mod);
+}
+
+/* CSE kept 256 expressions per block; GVN has no limit */
+#define BIG_EXPRS 600
+
+static void test_big_block(anvil_ctx_t *ctx)
+{
+    printf("\nLarge block:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "big");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_value_t *first[BIG_EXPRS], *second[BIG_EXPRS];
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    for (int i = 0; i < BIG_EXPRS; i++) {
+        first[i] = anvil_build_mul(ctx, x, anvil_const_i32(ctx, i + 2), NULL);
+    }
+    anvil_value_t *r = y;
+    for (int i = 0; i < BIG_EXPRS; i++) {
+        second[i] = anvil_build_mul(ctx, anvil_const_i32(ctx, i + 2), x, NULL);
+        r = anvil_build_add(ctx, r, anvil_build_add(ctx, first[i], second[i], NULL), NULL);
+    }
+    anvil_build_ret(ctx, r);
+
+    anvil_pass_gvn(func);
+    int reused = 0;
+    for (int i = 0; i < BIG_EXPRS; i++) {
+        if (anvil_value_num_uses(second[i]) == 0 && anvil_value_num_uses(first[i]) == 2) reused++;
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%d of %d repeats reused", reused, BIG_EXPRS);
+    CHECK(reused == BIG_EXPRS, msg);
+    anvil_module_destroy(mod);
+}
+
+#define NUM_KERNELS 24
+
+/* fk(x, y): a chain of diamonds whose arms repeat the dominator's work in
+ * varying forms, with a loop around every third diamond */
+static anvil_module_t *build_kernels(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "kernels");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = make_func(ctx, mod, name);
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+        anvil_value_t *y = anvil_func_get_param(func, 1);
+        anvil_block_t *block = anvil_func_get_entry(func);
+        anvil_set_insert_point(ctx, block);
+        anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+        anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+        anvil_build_store(ctx, x, acc);
+        anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+        anvil_value_t *v = anvil_build_add(ctx, x, y, NULL);
+
+        for (int d = 0; d < 2 + k % 4; d++) {
+            snprintf(name, sizeof(name), "t%d", d);
+            anvil_block_t *then_bb = anvil_block_create(func, name);
+            snprintf(name, sizeof(name), "e%d", d);
+            anvil_block_t *else_bb = anvil_block_create(func, name);
+            snprintf(name, sizeof(name), "j%d", d);
+            anvil_block_t *join = anvil_block_create(func, name);
+
+            anvil_value_t *m = anvil_build_mul(ctx, v, anvil_const_i32(ctx, d + k + 1), NULL);
+            anvil_value_t *s = anvil_build_sub(ctx, m, y, NULL);
+            anvil_value_t *c = anvil_build_cmp_gt(ctx, s, x, NULL);
+            anvil_build_br_cond(ctx, c, then_bb, else_bb);
+
+            anvil_set_insert_point(ctx, then_bb);
+            anvil_value_t *m2 = anvil_build_mul(ctx, anvil_const_i32(ctx, d + k + 1), v, NULL);
+            anvil_value_t *tv = anvil_build_xor(ctx, anvil_build_sub(ctx, m2, y, NULL),
+                                                anvil_build_cmp_lt(ctx, x, s, NULL), NULL);
+            anvil_build_br(ctx, join);
+
+            anvil_set_insert_point(ctx, else_bb);
+            anvil_value_t *ev = anvil_build_select(ctx, anvil_build_cmp_gt(ctx, s, x, NULL),
+                                                   anvil_build_sar(ctx, s, anvil_const_i32(ctx, 1), NULL),
+                                                   anvil_build_sub(ctx, y, m, NULL), NULL);
+            anvil_build_br(ctx, join);
+
+            anvil_set_insert_point(ctx, join);
+            anvil_value_t *phi = anvil_build_phi(ctx, i32, NULL);
+            anvil_phi_add_incoming(phi, tv, then_bb);
+            anvil_phi_add_incoming(phi, ev, else_bb);
+            v = anvil_build_add(ctx, phi, anvil_build_mul(ctx, v, anvil_const_i32(ctx, d + k + 1), NULL), NULL);
+
+            if (d % 3 == 2) {
+                /* acc += v * i + (i * v) for i in [0, y & 7) */
+                anvil_block_t *loop = anvil_block_create(func, "loop");
+                anvil_block_t *body = anvil_block_create(func, "body");
+                anvil_block_t *done = anvil_block_create(func, "done");
+                anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+                anvil_build_br(ctx, loop);
+                anvil_set_insert_point(ctx, loop);
+                anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+                anvil_value_t *n = anvil_build_and(ctx, y, anvil_const_i32(ctx, 7), NULL);
+                anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, iv, n, NULL), body, done);
+                anvil_set_insert_point(ctx, body);
+                iv = anvil_build_load(ctx, i32, i, NULL);
+                anvil_value_t *p1 = anvil_build_mul(ctx, v, iv, NULL);
+                anvil_value_t *p2 = anvil_build_mul(ctx, iv, v, NULL);
+                anvil_value_t *a = anvil_build_load(ctx, i32, acc, NULL);
+                anvil_build_store(ctx, anvil_build_add(ctx, a, anvil_build_add(ctx, p1, p2, NULL), NULL), acc);
+                anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+                anvil_build_br(ctx, loop);
+                anvil_set_insert_point(ctx, done);
+            }
+        }
+        anvil_build_ret(ctx, anvil_build_add(ctx, v, anvil_build_load(ctx, i32, acc, NULL), NULL));
+    }
+    return mod;
+}
+
+typedef int (*kernel_fn)(int, int);
+
+static const int inputs[] = { -1000, -37, -2, -1, 0, 1, 2, 3, 9, 15, 64, 1001 };
+#define NUM_INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+/* Results of every kernel on every input pair, or NULL if JIT failed */
+static int *run_kernels(const char *pipeline)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+    anvil_pass_manager_set_pipeline(anvil_ctx_get_pass_manager(ctx), pipeline);
+    anvil_pass_manager_set_verify(anvil_ctx_get_pass_manager(ctx), true);
+    anvil_module_t *mod = build_kernels(ctx);
+    anvil_module_optimize(mod);
+
+    anvil_jit_t *jit = NULL;
+    int *results = NULL;
+    if (anvil_module_jit(mod, NULL, NULL, &jit) == ANVIL_OK) {
+        results = malloc(NUM_KERNELS * NUM_INPUTS * NUM_INPUTS * sizeof(int));
+        for (int k = 0; results && k < NUM_KERNELS; k++) {
+            char name[32];
+            snprintf(name, sizeof(name), "f%d", k);
+            kernel_fn fn = (kernel_fn)anvil_jit_get_function(jit, name);
+            if (!fn) {
+                free(results);
+                results = NULL;
+                break;
+            }
+            for (size_t a = 0; a < NUM_INPUTS; a++) {
+                for (size_t b = 0; b < NUM_INPUTS; b++) {
+                    results[(k * NUM_INPUTS + a) * NUM_INPUTS + b] = fn(inputs[a], inputs[b]);
+                }
+            }
+        }
+        anvil_jit_destroy(jit);
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+    return results;
+}
+
+static void test_execution(void)
+{
+    printf("\nExecution (x86_64 JIT):\n");
+    const char *with_cse = "const-fold,dce,simplify-cfg,strength-reduce,copy-prop,dead-store,"
+                           "load-elim,store-load-prop,cse";
+    const char *none = "copy-prop";
+    int *gvn = run_kernels(NULL);
+    int *cse = run_kernels(with_cse);
+    int *plain = run_kernels(none);
+    CHECK(gvn && cse && plain, "kernels compiled with GVN, CSE and neither");
+
+    size_t total = NUM_KERNELS * NUM_INPUTS * NUM_INPUTS;
+    size_t same_cse = 0, same_plain = 0;
+    for (size_t i = 0; gvn && cse && plain && i < total; i++) {
+        if (gvn[i] == cse[i]) same_cse++;
+        if (gvn[i] == plain[i]) same_plain++;
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%zu of %zu results match CSE", same_cse, total);
+    CHECK(same_cse == total, msg);
+    snprintf(msg, sizeof(msg), "%zu of %zu results match unoptimized IR", same_plain, total);
+    CHECK(same_plain == total, msg);
+    free(gvn);
+    free(cse);
+    free(plain);
+}
+
+static void test_levels(void)
+{
+    printf("\nOptimization levels:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    char buf[256];
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+    anvil_pass_manager_get_pipeline(pm, buf, sizeof(buf));
+    CHECK(strstr(buf, "gvn") && !strstr(buf, "cse"), "O2 runs gvn instead of cse");
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_pass_manager_get_pipeline(pm, buf, sizeof(buf));
+    CHECK(!strstr(buf, "gvn"), "O1 does not run gvn");
+    anvil_pass_manager_enable(pm, ANVIL_PASS_COMMON_SUBEXPR);
+    anvil_pass_manager_get_pipeline(pm, buf, sizeof(buf));
+    CHECK(strstr(buf, "cse") != NULL, "cse can still be enabled");
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== GVN Test ===\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    test_dominating(ctx);
+    test_siblings(ctx);
+    test_keys(ctx);
+    test_big_block(ctx);
+    anvil_ctx_destroy(ctx);
+
+    test_execution();
+    test_levels();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
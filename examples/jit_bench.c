@@ -0,0 +1,186 @@
+/*
+ * ANVIL - JIT Latency Benchmark
+ *
+ * Times how long it takes to go from IR to a callable function pointer
+ * with anvil_module_jit, per kernel and optimization level. For
+ * comparison it also times producing the assembly text that the
+ * external route (as, ld, dlopen) would start from.
+ *
+ * Usage: jit_bench [iterations]
+ *   iterations: compilations per kernel and level (default: 200)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double elapsed_us(clock_t start, clock_t end)
+{
+    return (double)(end - start) * 1000000.0 / CLOCKS_PER_SEC;
+}
+
+static int host_scale(int x)
+{
+    return x * 10;
+}
+
+static void *resolve(void *user, const char *name)
+{
+    (void)user;
+    (void)name;
+    return (void *)host_scale;
+}
+
+/* add(a, b) = a + b */
+static void build_add(anvil_ctx_t *ctx, anvil_module_t *mod)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_func_t *func = anvil_func_create(mod, "kernel", anvil_type_func(ctx, i32, params, 2, false),
+                                           ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_build_ret(ctx, anvil_build_add(ctx, anvil_func_get_param(func, 0),
+                                         anvil_func_get_param(func, 1), NULL));
+}
+
+/* poly(x) = c0 + x * (c1 + x * (... c15)), Horner's rule */
+static void build_poly(anvil_ctx_t *ctx, anvil_module_t *mod)
+{
+    anvil_type_t *f64 = anvil_type_f64(ctx);
+    anvil_func_t *func = anvil_func_create(mod, "kernel", anvil_type_func(ctx, f64, &f64, 1, false),
+                                           ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *acc = anvil_const_f64(ctx, 1.0 / 16);
+    for (int i = 15; i > 0; i--) {
+        acc = anvil_build_fadd(ctx, anvil_build_fmul(ctx, acc, x, NULL),
+                               anvil_const_f64(ctx, 1.0 / i), NULL);
+    }
+    anvil_build_ret(ctx, acc);
+}
+
+/* sum(n) = 0 + 1 + ... + (n - 1) over a counted loop */
+static void build_sum(anvil_ctx_t *ctx, anvil_module_t *mod)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_func_t *func = anvil_func_create(mod, "kernel", anvil_type_func(ctx, i32, &i32, 1, false),
+                                           ANVIL_LINK_EXTERNAL);
+    anvil_block_t *loop = anvil_block_create(func, "loop");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), acc);
+    anvil_build_br(ctx, loop);
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, iv, anvil_func_get_param(func, 0), NULL),
+                        body, done);
+    anvil_set_insert_point(ctx, body);
+    iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, acc, NULL), iv, NULL), acc);
+    anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, loop);
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, acc, NULL));
+}
+
+/* call(x) = host_scale(x) + 1, through the resolver */
+static void build_call(anvil_ctx_t *ctx, anvil_module_t *mod)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *fn_type = anvil_type_func(ctx, i32, &i32, 1, false);
+    anvil_func_t *scale = anvil_func_declare(mod, "host_scale", fn_type);
+    anvil_func_t *func = anvil_func_create(mod, "kernel", fn_type, ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *r = anvil_build_call(ctx, i32, anvil_func_get_value(scale), &x, 1, NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, r, anvil_const_i32(ctx, 1), NULL));
+}
+
+static const struct {
+    const char *name;
+    void (*build)(anvil_ctx_t *ctx, anvil_module_t *mod);
+} kernels[] = {
+    { "add",  build_add },
+    { "poly", build_poly },
+    { "sum",  build_sum },
+    { "call", build_call },
+};
+
+static const struct {
+    anvil_opt_level_t level;
+    const char *name;
+} levels[] = {
+    { ANVIL_OPT_NONE,     "O0" },
+    { ANVIL_OPT_STANDARD, "O2" },
+};
+
+int main(int argc, char **argv)
+{
+    long iterations = 200;
+    if (argc > 1) {
+        iterations = atol(argv[1]);
+        if (iterations <= 0) {
+            fprintf(stderr, "Invalid iteration count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    printf("=== JIT latency: IR to callable function (x86_64, %ld runs) ===\n", iterations);
+    printf("%-6s %-4s %10s %10s %10s %10s %8s\n",
+           "kernel", "opt", "build us", "asm us", "jit us", "total us", "asm B");
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            double build = 0, text = 0, jit = 0;
+            size_t text_len = 0;
+
+            for (long it = 0; it < iterations; it++) {
+                clock_t t0 = clock();
+                anvil_ctx_t *ctx = anvil_ctx_create();
+                anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+                anvil_ctx_set_opt_level(ctx, levels[l].level);
+                anvil_module_t *mod = anvil_module_create(ctx, "bench");
+                kernels[k].build(ctx, mod);
+                clock_t t1 = clock();
+
+                char *out = NULL;
+                anvil_module_codegen(mod, &out, &text_len);
+                free(out);
+                clock_t t2 = clock();
+
+                anvil_jit_t *handle = NULL;
+                anvil_error_t err = anvil_module_jit(mod, resolve, NULL, &handle);
+                void *fn = anvil_jit_get_function(handle, "kernel");
+                clock_t t3 = clock();
+
+                if (err != ANVIL_OK || !fn) {
+                    printf("JIT unavailable: %s\n", anvil_ctx_get_error(ctx));
+                    anvil_module_destroy(mod);
+                    anvil_ctx_destroy(ctx);
+                    return 0;
+                }
+                anvil_jit_destroy(handle);
+                anvil_module_destroy(mod);
+                anvil_ctx_destroy(ctx);
+
+                build += elapsed_us(t0, t1);
+                text += elapsed_us(t1, t2);
+                jit += elapsed_us(t2, t3);
+            }
+
+            printf("%-6s %-4s %10.1f %10.1f %10.1f %10.1f %8zu\n",
+                   kernels[k].name, levels[l].name, build / iterations, text / iterations,
+                   jit / iterations, (build + jit) / iterations, text_len);
+        }
+    }
+
+    printf("\nbuild: create context and IR; asm: assembly text only (input to as/ld);\n");
+    printf("jit: object, load, relocate and map executable; total: build + jit.\n");
+    return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * ANVIL - JIT Test
+ *
+ * anvil_module_jit compiles a module into executable memory and returns
+ * callable function pointers. Runs integer, branch, loop and
+ * floating-point kernels, calls back into the host through the resolver
+ * (functions, a string argument, a host variable), and checks the error
+ * paths: unresolved symbols and non-host targets.
+ *
+ * The kernels run at O2: the O0 emitter compares i32 values with 64-bit
+ * instructions, passes doubles in integer registers and loses loaded
+ * values reused across instructions, whatever the output format. O0 is
+ * covered by a call passing a string, which it addresses with an
+ * absolute 32-bit immediate.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+/* Host side of the callbacks */
+static int host_counter = 40;
+static char host_seen[32];
+
+static int host_scale(int x)
+{
+    return x * 10;
+}
+
+static int host_note(const char *s)
+{
+    snprintf(host_seen, sizeof(host_seen), "%s", s);
+    return (int)strlen(s);
+}
+
+static void *resolve(void *user, const char *name)
+{
+    int *calls = user;
+    (*calls)++;
+    if (strcmp(name, "host_scale") == 0) return (void *)host_scale;
+    if (strcmp(name, "host_note") == 0) return (void *)host_note;
+    if (strcmp(name, "host_counter") == 0) return &host_counter;
+    return NULL;
+}
+
+static anvil_ctx_t *make_ctx(anvil_opt_level_t level)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    return ctx;
+}
+
+/* add(a, b) = a + b; max(a, b); sum(n) = 0 + 1 + ... + (n - 1); axpy(a, x, y) = a * x + y */
+static anvil_module_t *build_kernels(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "kernels");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *f64 = anvil_type_f64(ctx);
+
+    anvil_type_t *add_params[] = { i32, i32 };
+    anvil_func_t *add = anvil_func_create(mod, "add", anvil_type_func(ctx, i32, add_params, 2, false),
+                                          ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(add));
+    anvil_build_ret(ctx, anvil_build_add(ctx, anvil_func_get_param(add, 0),
+                                         anvil_func_get_param(add, 1), NULL));
+
+    anvil_func_t *max = anvil_func_create(mod, "max", anvil_type_func(ctx, i32, add_params, 2, false),
+                                          ANVIL_LINK_EXTERNAL);
+    anvil_block_t *first = anvil_block_create(max, "first");
+    anvil_block_t *second = anvil_block_create(max, "second");
+    anvil_set_insert_point(ctx, anvil_func_get_entry(max));
+    anvil_build_br_cond(ctx, anvil_build_cmp_gt(ctx, anvil_func_get_param(max, 0),
+                                                anvil_func_get_param(max, 1), NULL),
+                        first, second);
+    anvil_set_insert_point(ctx, first);
+    anvil_build_ret(ctx, anvil_func_get_param(max, 0));
+    anvil_set_insert_point(ctx, second);
+    anvil_build_ret(ctx, anvil_func_get_param(max, 1));
+
+    anvil_func_t *sum = anvil_func_create(mod, "sum", anvil_type_func(ctx, i32, &i32, 1, false),
+                                          ANVIL_LINK_EXTERNAL);
+    anvil_block_t *entry = anvil_func_get_entry(sum);
+    anvil_block_t *loop = anvil_block_create(sum, "loop");
+    anvil_block_t *body = anvil_block_create(sum, "body");
+    anvil_block_t *done = anvil_block_create(sum, "done");
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), acc);
+    anvil_build_br(ctx, loop);
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, iv, anvil_func_get_param(sum, 0), NULL),
+                        body, done);
+    anvil_set_insert_point(ctx, body);
+    iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, acc, NULL), iv, NULL), acc);
+    anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, loop);
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, acc, NULL));
+
+    anvil_type_t *axpy_params[] = { f64, f64, f64 };
+    anvil_func_t *axpy = anvil_func_create(mod, "axpy", anvil_type_func(ctx, f64, axpy_params, 3, false),
+                                           ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(axpy));
+    anvil_value_t *ax = anvil_build_fmul(ctx, anvil_func_get_param(axpy, 0),
+                                         anvil_func_get_param(axpy, 1), NULL);
+    anvil_build_ret(ctx, anvil_build_fadd(ctx, ax, anvil_func_get_param(axpy, 2), NULL));
+    return mod;
+}
+
+static void test_kernels(void)
+{
+    printf("\nKernels at O2:\n");
+    anvil_ctx_t *ctx = make_ctx(ANVIL_OPT_STANDARD);
+    anvil_module_t *mod = build_kernels(ctx);
+
+    anvil_jit_t *jit = NULL;
+    anvil_error_t err = anvil_module_jit(mod, NULL, NULL, &jit);
+    CHECK(err == ANVIL_OK && jit, "module compiles without a resolver");
+    if (err != ANVIL_OK) {
+        printf("    error: %s\n", anvil_ctx_get_error(ctx));
+        anvil_module_destroy(mod);
+        anvil_ctx_destroy(ctx);
+        return;
+    }
+
+    /* The JIT keeps working after the IR is gone */
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    int (*add)(int, int) = (int (*)(int, int))anvil_jit_get_function(jit, "add");
+    int (*max)(int, int) = (int (*)(int, int))anvil_jit_get_function(jit, "max");
+    int (*sum)(int) = (int (*)(int))anvil_jit_get_function(jit, "sum");
+    double (*axpy)(double, double, double) =
+        (double (*)(double, double, double))anvil_jit_get_function(jit, "axpy");
+
+    CHECK(add && add(2, 3) == 5 && add(-7, 4) == -3, "add(2, 3) == 5, add(-7, 4) == -3");
+    CHECK(max && max(3, 9) == 9 && max(4, -2) == 4, "max(3, 9) == 9, max(4, -2) == 4");
+    CHECK(sum && sum(0) == 0 && sum(10) == 45 && sum(1000) == 499500, "sum(n) loops n times");
+    CHECK(axpy && axpy(2.0, 3.5, 0.25) == 7.25, "axpy(2, 3.5, 0.25) == 7.25");
+    CHECK(anvil_jit_get_function(jit, "missing") == NULL, "unknown names return NULL");
+    anvil_jit_destroy(jit);
+}
+
+/* calls(x) = host_scale(x) + host_note("jit") + host_counter */
+static void test_host_calls(void)
+{
+    printf("\nCalls into the host at O2:\n");
+    anvil_ctx_t *ctx = make_ctx(ANVIL_OPT_STANDARD);
+    anvil_module_t *mod = anvil_module_create(ctx, "calls");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+
+    anvil_func_t *scale = anvil_func_declare(mod, "host_scale", anvil_type_func(ctx, i32, &i32, 1, false));
+    anvil_func_t *note = anvil_func_declare(mod, "host_note", anvil_type_func(ctx, i32, &i8p, 1, false));
+    anvil_value_t *counter = anvil_module_add_extern(mod, "host_counter", i32);
+
+    anvil_func_t *calls = anvil_func_create(mod, "calls", anvil_type_func(ctx, i32, &i32, 1, false),
+                                            ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(calls));
+    anvil_value_t *x = anvil_func_get_param(calls, 0);
+    anvil_value_t *r = anvil_build_call(ctx, i32, anvil_func_get_value(scale), &x, 1, NULL);
+    anvil_value_t *msg = anvil_const_string(ctx, "jit");
+    anvil_value_t *n = anvil_build_call(ctx, i32, anvil_func_get_value(note), &msg, 1, NULL);
+    r = anvil_build_add(ctx, r, n, NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, r, anvil_build_load(ctx, i32, counter, NULL), NULL));
+
+    int lookups = 0;
+    anvil_jit_t *jit = NULL;
+    anvil_error_t err = anvil_module_jit(mod, resolve, &lookups, &jit);
+    CHECK(err == ANVIL_OK && jit, "externs resolve through the resolver");
+    if (err != ANVIL_OK) printf("    error: %s\n", anvil_ctx_get_error(ctx));
+    CHECK(lookups == 3, "the resolver is asked once per extern");
+
+    int (*fn)(int) = jit ? (int (*)(int))anvil_jit_get_function(jit, "calls") : NULL;
+    host_seen[0] = '\0';
+    host_counter = 40;
+    CHECK(fn && fn(5) == 50 + 3 + 40, "calls(5) == host_scale(5) + 3 + host_counter");
+    CHECK(strcmp(host_seen, "jit") == 0, "the host receives the string constant");
+    host_counter = 100;
+    CHECK(fn && fn(1) == 10 + 3 + 100, "host_counter is read at run time");
+
+    anvil_jit_destroy(jit);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* greet() = host_note("jit"). O0 addresses the string with an absolute
+ * 32-bit immediate, so the code has to be mapped in the low 2GB. */
+static void test_absolute_string(void)
+{
+    printf("\nAbsolute addresses at O0:\n");
+    anvil_ctx_t *ctx = make_ctx(ANVIL_OPT_NONE);
+    anvil_module_t *mod = anvil_module_create(ctx, "greet");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+
+    anvil_func_t *note = anvil_func_declare(mod, "host_note", anvil_type_func(ctx, i32, &i8p, 1, false));
+    anvil_func_t *greet = anvil_func_create(mod, "greet", anvil_type_func(ctx, i32, NULL, 0, false),
+                                            ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(greet));
+    anvil_value_t *msg = anvil_const_string(ctx, "hello");
+    anvil_build_ret(ctx, anvil_build_call(ctx, i32, anvil_func_get_value(note), &msg, 1, NULL));
+
+    int lookups = 0;
+    anvil_jit_t *jit = NULL;
+    anvil_error_t err = anvil_module_jit(mod, resolve, &lookups, &jit);
+    CHECK(err == ANVIL_OK && jit, "module with an absolute string address loads");
+    if (err != ANVIL_OK) printf("    error: %s\n", anvil_ctx_get_error(ctx));
+
+    int (*fn)(void) = jit ? (int (*)(void))anvil_jit_get_function(jit, "greet") : NULL;
+    host_seen[0] = '\0';
+    CHECK(fn && fn() == 5 && strcmp(host_seen, "hello") == 0, "greet() passes \"hello\" to the host");
+
+    anvil_jit_destroy(jit);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_errors(void)
+{
+    printf("\nErrors:\n");
+    anvil_ctx_t *ctx = make_ctx(ANVIL_OPT_NONE);
+    anvil_module_t *mod = anvil_module_create(ctx, "unresolved");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_func_t *ext = anvil_func_declare(mod, "no_such_function", anvil_type_func(ctx, i32, NULL, 0, false));
+    anvil_func_t *fn = anvil_func_create(mod, "f", anvil_type_func(ctx, i32, NULL, 0, false),
+                                         ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(fn));
+    anvil_build_ret(ctx, anvil_build_call(ctx, i32, anvil_func_get_value(ext), NULL, 0, NULL));
+
+    int lookups = 0;
+    anvil_jit_t *jit = (anvil_jit_t *)&lookups;
+    anvil_error_t err = anvil_module_jit(mod, resolve, &lookups, &jit);
+    const char *msg = anvil_ctx_get_error(ctx);
+    CHECK(err == ANVIL_ERR_CODEGEN && jit == NULL, "unresolved extern fails with ANVIL_ERR_CODEGEN");
+    CHECK(msg && strstr(msg, "no_such_function") != NULL, "error names the symbol");
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_ARM64);
+    mod = build_kernels(ctx);
+    err = anvil_module_jit(mod, NULL, NULL, &jit);
+    CHECK(err == ANVIL_ERR_CODEGEN && jit == NULL, "non-host target is rejected");
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("ANVIL JIT Test\n");
+    printf("==============\n");
+
+    test_kernels();
+    test_host_calls();
+    test_absolute_string();
+    test_errors();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,508 @@
+/*
+ * ANVIL - Loop-Invariant Code Motion Test
+ *
+ * Builds loop kernels over an int array, checks which computations and
+ * loads licm moves out of their loops and which it must leave in place,
+ * and runs every kernel through the x86_64 JIT at O2 with and without
+ * licm against C references, including inputs where hoisting a load or
+ * a division past the loop test would fault.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+/* ============================================================================
+ * Kernels: int f(int *a, int n, int m)
+ * ============================================================================ */
+
+static anvil_func_t *make_kernel(anvil_ctx_t *ctx, anvil_module_t *mod, const char *name)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { anvil_type_ptr(ctx, i32), i32, i32 };
+    return make_func_with(ctx, mod, name, params, 3);
+}
+
+#define PARAM_A(func) anvil_func_get_param(func, 0)
+#define PARAM_N(func) anvil_func_get_param(func, 1)
+#define PARAM_M(func) anvil_func_get_param(func, 2)
+
+typedef struct {
+    anvil_block_t *head;
+    anvil_value_t *slot;
+} for_loop_t;
+
+static anvil_value_t *load_i32(anvil_ctx_t *ctx, anvil_value_t *slot)
+{
+    return anvil_build_load(ctx, anvil_type_i32(ctx), slot, NULL);
+}
+
+static void add_to(anvil_ctx_t *ctx, anvil_value_t *slot, anvil_value_t *val)
+{
+    anvil_build_store(ctx, anvil_build_add(ctx, load_i32(ctx, slot), val, NULL), slot);
+}
+
+/* for (*slot = from; *slot < limit; ...) { -- leaves the builder in the body.
+ * Block labels must be unique in a function, so they take the slot's name. */
+static for_loop_t begin_for(anvil_ctx_t *ctx, anvil_func_t *func, anvil_value_t *slot,
+                            anvil_value_t *from, anvil_value_t *limit, anvil_block_t **done)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%s_head", slot->name);
+    for_loop_t loop = { anvil_block_create(func, name), slot };
+    snprintf(name, sizeof(name), "%s_body", slot->name);
+    anvil_block_t *body = anvil_block_create(func, name);
+    snprintf(name, sizeof(name), "%s_done", slot->name);
+    *done = anvil_block_create(func, name);
+    anvil_build_store(ctx, from, slot);
+    anvil_build_br(ctx, loop.head);
+    anvil_set_insert_point(ctx, loop.head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, load_i32(ctx, slot), limit, NULL), body, *done);
+    anvil_set_insert_point(ctx, body);
+    return loop;
+}
+
+/* ...; ++*slot) } -- leaves the builder after the loop */
+static void end_for(anvil_ctx_t *ctx, for_loop_t loop, anvil_block_t *done)
+{
+    add_to(ctx, loop.slot, anvil_const_i32(ctx, 1));
+    anvil_build_br(ctx, loop.head);
+    anvil_set_insert_point(ctx, done);
+}
+
+static anvil_value_t *elem(anvil_ctx_t *ctx, anvil_value_t *base, anvil_value_t *index)
+{
+    return anvil_build_gep(ctx, anvil_type_i32(ctx), base, &index, 1, NULL);
+}
+
+static anvil_value_t *new_slot(anvil_ctx_t *ctx, const char *name, int init)
+{
+    anvil_value_t *slot = anvil_build_alloca(ctx, anvil_type_i32(ctx), name);
+    anvil_build_store(ctx, anvil_const_i32(ctx, init), slot);
+    return slot;
+}
+
+/* for i < n: for j < m: s += a[i * m + j], through row = a + i * m */
+static void build_matrix(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    (void)bump;
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_value_t *j = new_slot(ctx, "j", 0);
+    anvil_block_t *outer_done, *inner_done;
+    for_loop_t outer = begin_for(ctx, func, i, anvil_const_i32(ctx, 0), PARAM_N(func), &outer_done);
+    for_loop_t inner = begin_for(ctx, func, j, anvil_const_i32(ctx, 0), PARAM_M(func), &inner_done);
+    anvil_value_t *row = elem(ctx, PARAM_A(func), anvil_build_mul(ctx, load_i32(ctx, i), PARAM_M(func), NULL));
+    add_to(ctx, s, load_i32(ctx, elem(ctx, row, load_i32(ctx, j))));
+    end_for(ctx, inner, inner_done);
+    end_for(ctx, outer, outer_done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/* for i in [1, n): a[i] += a[0] * m; s += a[i] -- the store may hit a[0] */
+static void build_aliased(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    (void)bump;
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_block_t *done;
+    for_loop_t loop = begin_for(ctx, func, i, anvil_const_i32(ctx, 1), PARAM_N(func), &done);
+    anvil_value_t *scaled = anvil_build_mul(ctx, load_i32(ctx, PARAM_A(func)), PARAM_M(func), NULL);
+    anvil_value_t *p = elem(ctx, PARAM_A(func), load_i32(ctx, i));
+    anvil_value_t *v = anvil_build_add(ctx, load_i32(ctx, p), scaled, NULL);
+    anvil_build_store(ctx, v, p);
+    add_to(ctx, s, v);
+    end_for(ctx, loop, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/* i = 0; do { s += a[0] * i; } while (++i < n) -- one block runs every trip */
+static void build_do_while(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    (void)bump;
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_build_br(ctx, body);
+    anvil_set_insert_point(ctx, body);
+    add_to(ctx, s, anvil_build_mul(ctx, load_i32(ctx, PARAM_A(func)), load_i32(ctx, i), NULL));
+    add_to(ctx, i, anvil_const_i32(ctx, 1));
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, load_i32(ctx, i), PARAM_N(func), NULL), body, done);
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/*
+ * if (n > 5) i = 1 else i = 0, both arms branching straight to the loop
+ * header; for (; i < n; i++) s += m * m + 7
+ */
+static void build_two_entries(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    (void)bump;
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_block_t *big = anvil_block_create(func, "big");
+    anvil_block_t *small = anvil_block_create(func, "small");
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_build_br_cond(ctx, anvil_build_cmp_gt(ctx, PARAM_N(func), anvil_const_i32(ctx, 5), NULL), big, small);
+    anvil_set_insert_point(ctx, big);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 1), i);
+    anvil_build_br(ctx, head);
+    anvil_set_insert_point(ctx, small);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, load_i32(ctx, i), PARAM_N(func), NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *sq = anvil_build_mul(ctx, PARAM_M(func), PARAM_M(func), NULL);
+    add_to(ctx, s, anvil_build_add(ctx, sq, anvil_const_i32(ctx, 7), NULL));
+    add_to(ctx, i, anvil_const_i32(ctx, 1));
+    anvil_build_br(ctx, head);
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/* for i < n: c = host_bump(a); s += a[0] + c -- the call writes a[0] */
+static void build_call(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_value_t *a = PARAM_A(func);
+    anvil_block_t *done;
+    for_loop_t loop = begin_for(ctx, func, i, anvil_const_i32(ctx, 0), PARAM_N(func), &done);
+    anvil_value_t *c = anvil_build_call(ctx, anvil_type_i32(ctx), anvil_func_get_value(bump), &a, 1, NULL);
+    add_to(ctx, s, anvil_build_add(ctx, load_i32(ctx, a), c, NULL));
+    end_for(ctx, loop, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/* for i < n: s += 100 / m + n / 7 -- m may be 0 when the loop does not run */
+static void build_divide(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    (void)bump;
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_block_t *done;
+    for_loop_t loop = begin_for(ctx, func, i, anvil_const_i32(ctx, 0), PARAM_N(func), &done);
+    anvil_value_t *q = anvil_build_sdiv(ctx, anvil_const_i32(ctx, 100), PARAM_M(func), NULL);
+    anvil_value_t *r = anvil_build_sdiv(ctx, PARAM_N(func), anvil_const_i32(ctx, 7), NULL);
+    add_to(ctx, s, anvil_build_add(ctx, q, r, NULL));
+    end_for(ctx, loop, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/* for i < n: s += a[m] -- a is NULL when n is 0 */
+static void build_guarded(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    (void)bump;
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_block_t *done;
+    for_loop_t loop = begin_for(ctx, func, i, anvil_const_i32(ctx, 0), PARAM_N(func), &done);
+    add_to(ctx, s, load_i32(ctx, elem(ctx, PARAM_A(func), PARAM_M(func))));
+    end_for(ctx, loop, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+/* t = m * 3; for i < n: host_bump(a); s += t -- t never escapes */
+static void build_local(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump)
+{
+    anvil_value_t *s = new_slot(ctx, "s", 0);
+    anvil_value_t *i = new_slot(ctx, "i", 0);
+    anvil_value_t *t = new_slot(ctx, "t", 0);
+    anvil_value_t *a = PARAM_A(func);
+    anvil_build_store(ctx, anvil_build_mul(ctx, PARAM_M(func), anvil_const_i32(ctx, 3), NULL), t);
+    anvil_block_t *done;
+    for_loop_t loop = begin_for(ctx, func, i, anvil_const_i32(ctx, 0), PARAM_N(func), &done);
+    anvil_build_call(ctx, anvil_type_i32(ctx), anvil_func_get_value(bump), &a, 1, NULL);
+    add_to(ctx, s, load_i32(ctx, t));
+    end_for(ctx, loop, done);
+    anvil_build_ret(ctx, load_i32(ctx, s));
+}
+
+typedef void (*build_fn)(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump);
+
+static const build_fn builders[] = {
+    build_matrix, build_aliased, build_do_while, build_two_entries,
+    build_call, build_divide, build_guarded, build_local,
+};
+#define NUM_KERNELS (sizeof(builders) / sizeof(builders[0]))
+
+static int host_bump(int *p)
+{
+    *p += 1;
+    return *p & 1;
+}
+
+static void *resolve(void *user, const char *name)
+{
+    (void)user;
+    return strcmp(name, "host_bump") == 0 ? (void *)host_bump : NULL;
+}
+
+static anvil_module_t *build_kernels(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "kernels");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i32p = anvil_type_ptr(ctx, i32);
+    anvil_func_t *bump = anvil_func_declare(mod, "host_bump", anvil_type_func(ctx, i32, &i32p, 1, false));
+
+    for (size_t k = 0; k < NUM_KERNELS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%zu", k);
+        anvil_func_t *func = make_kernel(ctx, mod, name);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+        builders[k](ctx, func, bump);
+    }
+    return mod;
+}
+
+/* ============================================================================
+ * Placement
+ * ============================================================================ */
+
+static anvil_module_t *optimized_kernels(anvil_ctx_t *ctx, anvil_opt_level_t level, const char *pipeline)
+{
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_pass_manager_set_pipeline(anvil_ctx_get_pass_manager(ctx), pipeline);
+    anvil_pass_manager_set_verify(anvil_ctx_get_pass_manager(ctx), true);
+    anvil_module_t *mod = build_kernels(ctx);
+    anvil_module_optimize(mod);
+    return mod;
+}
+
+static anvil_func_t *kernel(anvil_module_t *mod, size_t k)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "f%zu", k);
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        if (strcmp(func->name, name) == 0) return func;
+    }
+    return NULL;
+}
+
+/* Instructions of an op at loop depth >= depth */
+static size_t count_at_depth(anvil_func_t *func, anvil_op_t op, uint32_t depth)
+{
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    size_t n = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        if (anvil_loop_depth(li, block) < depth) continue;
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == op) n++;
+        }
+    }
+    return n;
+}
+
+/* Loads inside any loop */
+static size_t loads_in_loops(anvil_func_t *func)
+{
+    return count_at_depth(func, ANVIL_OP_LOAD, 1);
+}
+
+static bool all_loops_have_preheaders(anvil_func_t *func)
+{
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    for (size_t l = 0; l < li->num_loops; l++) {
+        if (li->loops[l].preheader < 0) return false;
+    }
+    return li->num_loops > 0;
+}
+
+static void test_placement(void)
+{
+    printf("\nPlacement (mem2reg,licm):\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *mod = optimized_kernels(ctx, ANVIL_OPT_STANDARD, "mem2reg,licm");
+
+    anvil_func_t *matrix = kernel(mod, 0);
+    CHECK(count_at_depth(matrix, ANVIL_OP_MUL, 1) == 1 && count_at_depth(matrix, ANVIL_OP_MUL, 2) == 0,
+          "row offset leaves the inner loop but not the outer one");
+    CHECK(count_at_depth(matrix, ANVIL_OP_GEP, 2) == 1, "only the element address stays in the inner loop");
+
+    anvil_func_t *aliased = kernel(mod, 1);
+    CHECK(loads_in_loops(aliased) == 2, "load that a store in the loop may write stays");
+    CHECK(count_at_depth(aliased, ANVIL_OP_MUL, 1) == 1, "so does the mul that uses it");
+
+    anvil_func_t *do_while = kernel(mod, 2);
+    CHECK(loads_in_loops(do_while) == 0, "load in a block that runs every trip is hoisted");
+
+    anvil_func_t *two = kernel(mod, 3);
+    CHECK(count_at_depth(two, ANVIL_OP_MUL, 1) == 0 && count_at_depth(two, ANVIL_OP_ADD, 1) == 2,
+          "m * m + 7 hoisted from a loop entered from two blocks");
+    CHECK(all_loops_have_preheaders(two), "a preheader was made for it");
+    anvil_loop_info_t *li = anvil_func_loops(two);
+    anvil_block_t *head = li->num_loops ? li->dt->blocks[li->loops[0].header] : NULL;
+    CHECK(head && head->num_preds == 2, "header keeps one pred from outside and the latch");
+    CHECK(head && head->first->op == ANVIL_OP_PHI && head->first->num_operands == 2,
+          "header phi takes the entry value through the preheader");
+
+    anvil_func_t *call = kernel(mod, 4);
+    CHECK(loads_in_loops(call) == 1, "load stays in a loop with a call that may write it");
+
+    anvil_func_t *divide = kernel(mod, 5);
+    CHECK(count_at_depth(divide, ANVIL_OP_SDIV, 1) == 1 && count_at_depth(divide, ANVIL_OP_SDIV, 0) == 2,
+          "division by a constant hoisted, division by m kept");
+
+    anvil_func_t *guarded = kernel(mod, 6);
+    CHECK(loads_in_loops(guarded) == 1, "load behind the loop test is not run ahead of it");
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    /* Without mem2reg the loop variables stay in memory */
+    ctx = anvil_ctx_create();
+    mod = optimized_kernels(ctx, ANVIL_OPT_STANDARD, "licm");
+    anvil_func_t *local = kernel(mod, 7);
+    CHECK(loads_in_loops(local) == 3, "load of a local that never escapes hoisted past a call");
+    anvil_func_t *two_mem = kernel(mod, 3);
+    CHECK(count_at_depth(two_mem, ANVIL_OP_MUL, 1) == 0, "invariant mul hoisted with memory loop variables");
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* ============================================================================
+ * Execution
+ * ============================================================================ */
+
+typedef int (*kernel_fn)(int *, int, int);
+
+#define ARRAY_LEN 64
+
+static void fill(int *a)
+{
+    for (int k = 0; k < ARRAY_LEN; k++) a[k] = k * 7 - 20;
+}
+
+/* What each kernel computes, in wrapping 32-bit arithmetic */
+static int reference(size_t k, int *a, int n, int m)
+{
+    uint32_t s = 0;
+    switch (k) {
+        case 0:
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < m; j++) s += (uint32_t)a[i * m + j];
+            }
+            break;
+        case 1:
+            for (int i = 1; i < n; i++) {
+                a[i] = (int)((uint32_t)a[i] + (uint32_t)a[0] * (uint32_t)m);
+                s += (uint32_t)a[i];
+            }
+            break;
+        case 2: {
+            int i = 0;
+            do {
+                s += (uint32_t)a[0] * (uint32_t)i;
+            } while (++i < n);
+            break;
+        }
+        case 3:
+            for (int i = n > 5 ? 1 : 0; i < n; i++) s += (uint32_t)m * (uint32_t)m + 7;
+            break;
+        case 4:
+            for (int i = 0; i < n; i++) {
+                int c = host_bump(a);
+                s += (uint32_t)a[0] + (uint32_t)c;
+            }
+            break;
+        case 5:
+            for (int i = 0; i < n; i++) s += (uint32_t)(100 / m + n / 7);
+            break;
+        case 6:
+            for (int i = 0; i < n; i++) s += (uint32_t)a[m];
+            break;
+        default:
+            for (int i = 0; i < n; i++) {
+                host_bump(a);
+                s += (uint32_t)m * 3;
+            }
+            break;
+    }
+    return (int)s;
+}
+
+static const int ns[] = { 0, 1, 2, 5, 6, 7 };
+static const int ms[] = { 0, 1, 3, 8 };
+#define NUM_NS (sizeof(ns) / sizeof(ns[0]))
+#define NUM_MS (sizeof(ms) / sizeof(ms[0]))
+
+/* Run f(a, n, m) as the reference would, or return false if the
+ * reference itself would divide by zero */
+static bool run_case(kernel_fn fn, size_t k, int n, int m, bool *same)
+{
+    if (k == 5 && m == 0 && n > 0) return false;
+    int got_a[ARRAY_LEN], want_a[ARRAY_LEN];
+    fill(got_a);
+    fill(want_a);
+    /* Nothing may be read through a when the loop does not run */
+    int *arg = (k == 6 && n == 0) ? NULL : got_a;
+    int got = fn(arg, n, m);
+    int want = reference(k, want_a, n, m);
+    *same = got == want && memcmp(got_a, want_a, sizeof(got_a)) == 0;
+    return true;
+}
+
+/* JIT every kernel and count the inputs whose result and array match */
+static void check_kernels(const char *pipeline, const char *what)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *mod = optimized_kernels(ctx, ANVIL_OPT_STANDARD, pipeline);
+
+    anvil_jit_t *jit = NULL;
+    size_t same = 0, total = 0;
+    if (anvil_module_jit(mod, resolve, NULL, &jit) == ANVIL_OK) {
+        for (size_t k = 0; k < NUM_KERNELS; k++) {
+            char name[32];
+            snprintf(name, sizeof(name), "f%zu", k);
+            kernel_fn fn = (kernel_fn)anvil_jit_get_function(jit, name);
+            for (size_t a = 0; a < NUM_NS; a++) {
+                for (size_t b = 0; b < NUM_MS; b++) {
+                    bool ok = false;
+                    if (!fn || !run_case(fn, k, ns[a], ms[b], &ok)) continue;
+                    total++;
+                    same += ok;
+                }
+            }
+        }
+        anvil_jit_destroy(jit);
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%s: %zu of %zu results match", what, same, total);
+    CHECK(total > 0 && same == total, msg);
+}
+
+/* O2 without licm */
+static const char *without_licm = "const-fold,dce,simplify-cfg,strength-reduce,copy-prop,"
+                                  "dead-store,load-elim,store-load-prop,mem2reg,gvn";
+
+static void test_execution(void)
+{
+    printf("\nExecution (x86_64 JIT):\n");
+    check_kernels(NULL, "O2");
+    check_kernels(without_licm, "O2 without licm");
+    check_kernels("licm", "licm alone");
+}
+
+int main(void)
+{
+    printf("=== Loop-Invariant Code Motion Test ===\n");
+
+    test_placement();
+    test_execution();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * ANVIL - Liveness Analysis Test
+ *
+ * Checks the block live-in/live-out sets and live ranges computed by the
+ * shared liveness analysis (an internal API used by the backends), then
+ * times it on a long chain of blocks with tens of thousands of values.
+ *
+ * Usage: liveness_test [num_blocks]
+ *   num_blocks: blocks in the timed function (default: 2000)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "test_util.h"
+
+/*
+ * Test 1: loop with phis
+ *
+ * long fib(long n) {
+ *     long a = 0, b = 1;
+ *     while (n != 0) { long t = a + b; a = b; b = t; n = n - 1; }
+ *     return a;
+ * }
+ */
+static void test_loop(anvil_ctx_t *ctx)
+{
+    printf("\nTest 1: loop with phis\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "fib");
+    anvil_type_t *i64 = anvil_type_i64(ctx);
+    anvil_type_t *params[] = { i64 };
+    anvil_func_t *func = anvil_func_create(mod, "fib",
+        anvil_type_func(ctx, i64, params, 1, false), ANVIL_LINK_EXTERNAL);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *loop = anvil_block_create(func, "loop");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_value_t *n0 = anvil_func_get_param(func, 0);
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, loop);
+
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *n = anvil_build_phi(ctx, i64, "n");
+    anvil_value_t *a = anvil_build_phi(ctx, i64, "a");
+    anvil_value_t *b = anvil_build_phi(ctx, i64, "b");
+    anvil_value_t *cond = anvil_build_cmp_ne(ctx, n, anvil_const_i64(ctx, 0), "c");
+    anvil_build_br_cond(ctx, cond, body, done);
+
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *t = anvil_build_add(ctx, a, b, "t");
+    anvil_value_t *n1 = anvil_build_sub(ctx, n, anvil_const_i64(ctx, 1), "n1");
+    anvil_build_br(ctx, loop);
+
+    anvil_phi_add_incoming(n, n0, entry);
+    anvil_phi_add_incoming(n, n1, body);
+    anvil_phi_add_incoming(a, anvil_const_i64(ctx, 0), entry);
+    anvil_phi_add_incoming(a, b, body);
+    anvil_phi_add_incoming(b, anvil_const_i64(ctx, 1), entry);
+    anvil_phi_add_incoming(b, t, body);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, a);
+
+    anvil_liveness_t lv;
+    CHECK(anvil_liveness_compute(&lv, func) == ANVIL_OK, "analysis succeeds");
+    CHECK(lv.num_values == 7, "7 values (1 param, 3 phis, cmp, add, sub)");
+    CHECK(anvil_liveness_value_num(&lv, n0) == 0, "parameters are numbered first");
+
+    CHECK(anvil_liveness_live_out(&lv, entry, n0), "n0 is live out of entry (phi input)");
+    CHECK(!anvil_liveness_live_in(&lv, loop, n), "phi n is not live into its own block");
+    CHECK(anvil_liveness_live_in(&lv, body, a) && anvil_liveness_live_in(&lv, body, b) &&
+          anvil_liveness_live_in(&lv, body, n), "a, b and n are live into body");
+    CHECK(anvil_liveness_live_out(&lv, body, t) && anvil_liveness_live_out(&lv, body, n1),
+          "t and n1 are live out of body");
+    CHECK(anvil_liveness_live_out(&lv, body, b), "b is live out of body (input of phi a)");
+    CHECK(!anvil_liveness_live_out(&lv, body, a), "a dies in body");
+    CHECK(anvil_liveness_live_in(&lv, done, a) && !anvil_liveness_live_in(&lv, done, b),
+          "only a is live into done");
+    CHECK(lv.value_bit[anvil_liveness_value_num(&lv, cond)] < 0,
+          "the condition is block-local and has no bit");
+    CHECK(lv.num_bits == 6, "every other value has a bit");
+
+    anvil_live_range_t *rn0 = &lv.ranges[anvil_liveness_value_num(&lv, n0)];
+    anvil_live_block_t *le = anvil_liveness_block(&lv, entry);
+    CHECK(rn0->start == 1 && rn0->end == 2 * le->last + 1, "n0 lives through entry");
+
+    anvil_live_range_t *rt = &lv.ranges[anvil_liveness_value_num(&lv, t)];
+    anvil_live_block_t *lbody = anvil_liveness_block(&lv, body);
+    CHECK(rt->start == 2 * lbody->first + 1 && rt->end == 2 * lbody->last + 1,
+          "t lives from its definition to the end of body");
+
+    anvil_liveness_free(&lv);
+    anvil_module_destroy(mod);
+}
+
+/*
+ * Test 2: scaling
+ *
+ * A chain of blocks, each computing a run of temporaries that die inside
+ * the block. One accumulator flows from block to block, and the first
+ * block's value is used only by the last one, so it stays live throughout.
+ */
+#define VALUES_PER_BLOCK 30
+
+static void test_scale(anvil_ctx_t *ctx, int num_blocks)
+{
+    printf("\nTest 2: %d blocks x %d values\n", num_blocks, VALUES_PER_BLOCK);
+
+    anvil_module_t *mod = anvil_module_create(ctx, "chain");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32 };
+    anvil_func_t *func = anvil_func_create(mod, "chain",
+        anvil_type_func(ctx, i32, params, 1, false), ANVIL_LINK_EXTERNAL);
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+
+    anvil_block_t *block = anvil_func_get_entry(func);
+    anvil_set_insert_point(ctx, block);
+    anvil_value_t *first = NULL, *acc = x;
+    for (int i = 0; i < num_blocks; i++) {
+        for (int j = 0; j < VALUES_PER_BLOCK; j++)
+            acc = (j & 1) ? anvil_build_mul(ctx, acc, x, NULL) : anvil_build_add(ctx, acc, x, NULL);
+        if (!first) first = acc;
+        anvil_block_t *next = anvil_block_create(func, NULL);
+        anvil_build_br(ctx, next);
+        anvil_set_insert_point(ctx, next);
+        block = next;
+    }
+    anvil_build_ret(ctx, anvil_build_add(ctx, acc, first, NULL));
+
+    anvil_liveness_t lv;
+    clock_t start = clock();
+    anvil_error_t err = anvil_liveness_compute(&lv, func);
+    double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+
+    CHECK(err == ANVIL_OK, "analysis succeeds");
+    if (err == ANVIL_OK) {
+        CHECK(lv.num_values == (size_t)num_blocks * VALUES_PER_BLOCK + 2, "every result is numbered");
+        CHECK(lv.num_bits == (size_t)num_blocks + 1, "only cross-block values get bits");
+        CHECK(anvil_liveness_live_in(&lv, block, first), "first value is live into the last block");
+        anvil_live_range_t *r = &lv.ranges[anvil_liveness_value_num(&lv, first)];
+        CHECK(r->end > 2 * lv.blocks[lv.num_blocks - 2].last, "its range spans the chain");
+        printf("  %zu values, %zu bits, %zu blocks: %.2f ms\n",
+               lv.num_values, lv.num_bits, lv.num_blocks, ms);
+        anvil_liveness_free(&lv);
+    }
+    anvil_module_destroy(mod);
+}
+
+int main(int argc, char **argv)
+{
+    int num_blocks = 2000;
+    if (argc > 1) {
+        num_blocks = atoi(argv[1]);
+        if (num_blocks <= 0) {
+            fprintf(stderr, "Invalid block count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+
+    printf("=== Liveness Analysis Test ===\n");
+    test_loop(ctx);
+    test_scale(ctx, num_blocks);
+
+    anvil_ctx_destroy(ctx);
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
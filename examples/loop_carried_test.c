@@ -0,0 +1,536 @@
+/*
+ * ANVIL - Loop-Carried Values on Every Backend
+ *
+ * Builds loops whose locals carry a value from one trip to the next (a
+ * running sum, a pair swapped on every trip, a sum under a branch) and
+ * optimizes them at O1 and O3 for every backend. x86_64 and arm64 set
+ * supports_phi: mem2reg turns the locals into header phis and O3 unrolls
+ * the loops. The other backends keep one value at a time in a fixed
+ * register, so the pass manager leaves out the passes that create phis
+ * and the locals stay in memory.
+ *
+ * Every module is run by a small IR interpreter, as the backend receives
+ * it, against a C model; the x86_64 modules are also run through the JIT,
+ * at Og as well, where copy-prop leaves operands that refer back past the
+ * previous instruction.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "test_util.h"
+
+/* ============================================================================
+ * Kernels: int f(int x, int y), locals in allocas as a front end emits them
+ * ============================================================================ */
+
+#define NUM_KERNELS 3
+static const char *kernel_names[NUM_KERNELS] = { "sum", "swap", "branchy" };
+
+static anvil_value_t *load(anvil_ctx_t *ctx, anvil_value_t *slot)
+{
+    return anvil_build_load(ctx, anvil_type_i32(ctx), slot, NULL);
+}
+
+/* s = x; for (i = 0; i < (y & 31); i++) s = s * 3 + i; return s; */
+static void build_sum(anvil_ctx_t *ctx, anvil_func_t *func)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_value_t *s = anvil_build_alloca(ctx, i32, "s");
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_value_t *n = anvil_build_alloca(ctx, i32, "n");
+    anvil_build_store(ctx, anvil_func_get_param(func, 0), s);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_build_store(ctx, anvil_build_and(ctx, anvil_func_get_param(func, 1), anvil_const_i32(ctx, 31), NULL), n);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, load(ctx, i), load(ctx, n), NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *scaled = anvil_build_mul(ctx, load(ctx, s), anvil_const_i32(ctx, 3), NULL);
+    anvil_build_store(ctx, anvil_build_add(ctx, scaled, load(ctx, i), NULL), s);
+    anvil_build_store(ctx, anvil_build_add(ctx, load(ctx, i), anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, load(ctx, s));
+}
+
+/* a = x; b = y; for (k = y & 15; k > 0; k--) { t = a; a = b + k; b = t; } return a * 7 - b; */
+static void build_swap(anvil_ctx_t *ctx, anvil_func_t *func)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_value_t *a = anvil_build_alloca(ctx, i32, "a");
+    anvil_value_t *b = anvil_build_alloca(ctx, i32, "b");
+    anvil_value_t *t = anvil_build_alloca(ctx, i32, "t");
+    anvil_value_t *k = anvil_build_alloca(ctx, i32, "k");
+    anvil_build_store(ctx, anvil_func_get_param(func, 0), a);
+    anvil_build_store(ctx, anvil_func_get_param(func, 1), b);
+    anvil_build_store(ctx, anvil_build_and(ctx, anvil_func_get_param(func, 1), anvil_const_i32(ctx, 15), NULL), k);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_gt(ctx, load(ctx, k), anvil_const_i32(ctx, 0), NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_build_store(ctx, load(ctx, a), t);
+    anvil_build_store(ctx, anvil_build_add(ctx, load(ctx, b), load(ctx, k), NULL), a);
+    anvil_build_store(ctx, load(ctx, t), b);
+    anvil_build_store(ctx, anvil_build_sub(ctx, load(ctx, k), anvil_const_i32(ctx, 1), NULL), k);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_value_t *scaled = anvil_build_mul(ctx, load(ctx, a), anvil_const_i32(ctx, 7), NULL);
+    anvil_build_ret(ctx, anvil_build_sub(ctx, scaled, load(ctx, b), NULL));
+}
+
+/* s = 0; for (i = 0; i < (x & 63); i++) { if (i & 1) s += y; else s ^= i; } return s; */
+static void build_branchy(anvil_ctx_t *ctx, anvil_func_t *func)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *odd = anvil_block_create(func, "odd");
+    anvil_block_t *even = anvil_block_create(func, "even");
+    anvil_block_t *next = anvil_block_create(func, "next");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_value_t *s = anvil_build_alloca(ctx, i32, "s");
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), s);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_value_t *n = anvil_build_and(ctx, anvil_func_get_param(func, 0), anvil_const_i32(ctx, 63), NULL);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, load(ctx, i), n, NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *bit = anvil_build_and(ctx, load(ctx, i), anvil_const_i32(ctx, 1), NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_ne(ctx, bit, anvil_const_i32(ctx, 0), NULL), odd, even);
+    anvil_set_insert_point(ctx, odd);
+    anvil_build_store(ctx, anvil_build_add(ctx, load(ctx, s), anvil_func_get_param(func, 1), NULL), s);
+    anvil_build_br(ctx, next);
+    anvil_set_insert_point(ctx, even);
+    anvil_build_store(ctx, anvil_build_xor(ctx, load(ctx, s), load(ctx, i), NULL), s);
+    anvil_build_br(ctx, next);
+    anvil_set_insert_point(ctx, next);
+    anvil_build_store(ctx, anvil_build_add(ctx, load(ctx, i), anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, load(ctx, s));
+}
+
+static anvil_module_t *build_kernels(anvil_ctx_t *ctx, anvil_opt_level_t level)
+{
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_module_t *mod = anvil_module_create(ctx, "loops");
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        anvil_func_t *func = make_func(ctx, mod, kernel_names[k]);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+        switch (k) {
+            case 0: build_sum(ctx, func); break;
+            case 1: build_swap(ctx, func); break;
+            default: build_branchy(ctx, func); break;
+        }
+    }
+    anvil_pass_manager_set_verify(anvil_ctx_get_pass_manager(ctx), true);
+    anvil_module_optimize(mod);
+    return mod;
+}
+
+/* What each kernel computes, in wrapping 32-bit arithmetic */
+static int reference(int k, int x, int y)
+{
+    switch (k) {
+        case 0: {
+            uint32_t s = (uint32_t)x;
+            for (int i = 0; i < (y & 31); i++) s = s * 3 + (uint32_t)i;
+            return (int)s;
+        }
+        case 1: {
+            uint32_t a = (uint32_t)x, b = (uint32_t)y;
+            for (int k2 = y & 15; k2 > 0; k2--) {
+                uint32_t t = a;
+                a = b + (uint32_t)k2;
+                b = t;
+            }
+            return (int)(a * 7 - b);
+        }
+        default: {
+            uint32_t s = 0;
+            for (int i = 0; i < (x & 63); i++) s = (i & 1) ? s + (uint32_t)y : s ^ (uint32_t)i;
+            return (int)s;
+        }
+    }
+}
+
+static int kernel_index(const char *name)
+{
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        if (strcmp(kernel_names[k], name) == 0) return k;
+    }
+    return -1;
+}
+
+/* Trip counts 0, 1, and multiples of 8 and of 2 plus 0, 1 and factor - 1 */
+static const int inputs[] = { -7, 0, 1, 2, 5, 8, 9, 15, 16, 17, 23, 31, 63, 100 };
+#define NUM_INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+/* ============================================================================
+ * IR interpreter: integer ops, branches, phis and stack slots
+ * ============================================================================ */
+
+#define MAX_CELLS 64
+#define MAX_STEPS 100000
+
+typedef struct {
+    anvil_value_map_t map;
+    int64_t *vals;
+    int64_t cells[MAX_CELLS];
+    size_t num_cells;
+} interp_t;
+
+/* Wrap to the width of type, sign-extended */
+static int64_t fit(const anvil_type_t *type, int64_t v)
+{
+    switch (type->kind) {
+        case ANVIL_TYPE_I8:  return (int8_t)v;
+        case ANVIL_TYPE_I16: return (int16_t)v;
+        case ANVIL_TYPE_I32: return (int32_t)v;
+        default:             return v;
+    }
+}
+
+static uint64_t unsigned_of(const anvil_type_t *type, int64_t v)
+{
+    switch (type->kind) {
+        case ANVIL_TYPE_I8:  return (uint8_t)v;
+        case ANVIL_TYPE_I16: return (uint16_t)v;
+        case ANVIL_TYPE_I32: return (uint32_t)v;
+        default:             return (uint64_t)v;
+    }
+}
+
+static int64_t get(const interp_t *in, anvil_value_t *v)
+{
+    if (v->kind == ANVIL_VAL_CONST_INT) return v->data.i;
+    return in->vals[anvil_value_map_get(&in->map, v)];
+}
+
+/* Result of a non-control instruction; false if the op is not handled */
+static bool eval(interp_t *in, anvil_instr_t *instr, int64_t *out)
+{
+    anvil_value_t **ops = instr->operands;
+    int64_t a = instr->num_operands > 0 ? get(in, ops[0]) : 0;
+    int64_t b = instr->num_operands > 1 ? get(in, ops[1]) : 0;
+    uint64_t ua = instr->num_operands > 0 ? unsigned_of(ops[0]->type, a) : 0;
+    uint64_t ub = instr->num_operands > 1 ? unsigned_of(ops[1]->type, b) : 0;
+
+    switch (instr->op) {
+        case ANVIL_OP_ADD:     *out = (int64_t)((uint64_t)a + (uint64_t)b); break;
+        case ANVIL_OP_SUB:     *out = (int64_t)((uint64_t)a - (uint64_t)b); break;
+        case ANVIL_OP_MUL:     *out = (int64_t)((uint64_t)a * (uint64_t)b); break;
+        case ANVIL_OP_AND:     *out = a & b; break;
+        case ANVIL_OP_OR:      *out = a | b; break;
+        case ANVIL_OP_XOR:     *out = a ^ b; break;
+        case ANVIL_OP_SHL:     *out = (int64_t)((uint64_t)a << (b & 63)); break;
+        case ANVIL_OP_SHR:     *out = (int64_t)(ua >> (b & 63)); break;
+        case ANVIL_OP_SAR:     *out = a >> (b & 63); break;
+        case ANVIL_OP_NEG:     *out = (int64_t)(0 - (uint64_t)a); break;
+        case ANVIL_OP_NOT:     *out = ~a; break;
+        case ANVIL_OP_CMP_EQ:  *out = a == b; break;
+        case ANVIL_OP_CMP_NE:  *out = a != b; break;
+        case ANVIL_OP_CMP_LT:  *out = a < b; break;
+        case ANVIL_OP_CMP_LE:  *out = a <= b; break;
+        case ANVIL_OP_CMP_GT:  *out = a > b; break;
+        case ANVIL_OP_CMP_GE:  *out = a >= b; break;
+        case ANVIL_OP_CMP_ULT: *out = ua < ub; break;
+        case ANVIL_OP_CMP_ULE: *out = ua <= ub; break;
+        case ANVIL_OP_CMP_UGT: *out = ua > ub; break;
+        case ANVIL_OP_CMP_UGE: *out = ua >= ub; break;
+        case ANVIL_OP_SELECT:  *out = a ? b : get(in, ops[2]); break;
+        case ANVIL_OP_TRUNC:
+        case ANVIL_OP_SEXT:    *out = a; break;
+        case ANVIL_OP_ZEXT:    *out = (int64_t)ua; break;
+        case ANVIL_OP_ALLOCA:
+            if (in->num_cells == MAX_CELLS) return false;
+            in->cells[in->num_cells] = 0;
+            *out = (int64_t)in->num_cells++;
+            break;
+        case ANVIL_OP_LOAD:
+            if (a < 0 || (size_t)a >= in->num_cells) return false;
+            *out = in->cells[a];
+            break;
+        case ANVIL_OP_STORE:
+            if (b < 0 || (size_t)b >= in->num_cells) return false;
+            in->cells[b] = a;
+            return true;
+        default:
+            return false;
+    }
+    if (instr->result) *out = fit(instr->result->type, *out);
+    return true;
+}
+
+/* Run func on (x, y); false if it uses something the interpreter lacks */
+static bool interpret(anvil_func_t *func, int x, int y, int *result)
+{
+    interp_t in;
+    memset(&in, 0, sizeof(in));
+    if (anvil_value_map_reset(&in.map, func) != ANVIL_OK) return false;
+    int32_t n = 0;
+    for (size_t p = 0; p < func->num_params; p++) anvil_value_map_set(&in.map, func->params[p], n++);
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->result) anvil_value_map_set(&in.map, instr->result, n++);
+        }
+    }
+    in.vals = calloc((size_t)n + 1, sizeof(int64_t));
+    in.vals[0] = x;
+    in.vals[1] = y;
+
+    bool ok = false;
+    anvil_block_t *block = func->entry, *prev = NULL;
+    for (int steps = 0; block && steps < MAX_STEPS; steps++) {
+        /* Phis read their inputs on the edge, before any of them is written */
+        int64_t incoming[16];
+        size_t num_phis = 0;
+        anvil_instr_t *instr = block->first;
+        for (; instr && instr->op == ANVIL_OP_PHI && num_phis < 16; instr = instr->next) {
+            size_t e = 0;
+            while (e < instr->num_phi_incoming && instr->phi_blocks[e] != prev) e++;
+            if (e == instr->num_phi_incoming) goto out;
+            incoming[num_phis++] = get(&in, instr->operands[e]);
+        }
+        if (instr && instr->op == ANVIL_OP_PHI) goto out;
+        size_t k = 0;
+        for (anvil_instr_t *phi = block->first; k < num_phis; phi = phi->next) {
+            in.vals[anvil_value_map_get(&in.map, phi->result)] = incoming[k++];
+        }
+
+        anvil_block_t *to = NULL;
+        for (; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_NOP) continue;
+            if (instr->op == ANVIL_OP_BR) {
+                to = instr->true_block;
+                break;
+            }
+            if (instr->op == ANVIL_OP_BR_COND) {
+                to = get(&in, instr->operands[0]) ? instr->true_block : instr->false_block;
+                break;
+            }
+            if (instr->op == ANVIL_OP_RET) {
+                *result = (int)get(&in, instr->operands[0]);
+                ok = true;
+                goto out;
+            }
+            int64_t v = 0;
+            if (!eval(&in, instr, &v)) goto out;
+            if (instr->result) in.vals[anvil_value_map_get(&in.map, instr->result)] = v;
+        }
+        prev = block;
+        block = to;
+    }
+out:
+    free(in.vals);
+    anvil_value_map_free(&in.map);
+    return ok;
+}
+
+/* ============================================================================
+ * Backends
+ * ============================================================================ */
+
+static const struct {
+    const char *name;
+    anvil_arch_t arch;
+    bool phis;
+} targets[] = {
+    { "x86",     ANVIL_ARCH_X86,     false },
+    { "x86_64",  ANVIL_ARCH_X86_64,  true  },
+    { "s370",    ANVIL_ARCH_S370,    false },
+    { "s370_xa", ANVIL_ARCH_S370_XA, false },
+    { "s390",    ANVIL_ARCH_S390,    false },
+    { "zarch",   ANVIL_ARCH_ZARCH,   false },
+    { "ppc32",   ANVIL_ARCH_PPC32,   false },
+    { "ppc64",   ANVIL_ARCH_PPC64,   false },
+    { "ppc64le", ANVIL_ARCH_PPC64LE, false },
+    { "arm64",   ANVIL_ARCH_ARM64,   true  },
+};
+#define NUM_TARGETS (sizeof(targets) / sizeof(targets[0]))
+
+static size_t count_ops(anvil_module_t *mod, anvil_op_t op)
+{
+    size_t n = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        for (anvil_block_t *block = func->blocks; block; block = block->next) {
+            for (anvil_instr_t *instr = block->first; instr; instr = instr->next) n += instr->op == op;
+        }
+    }
+    return n;
+}
+
+static size_t count_loops(anvil_module_t *mod)
+{
+    size_t n = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) n += anvil_func_loops(func)->num_loops;
+    return n;
+}
+
+/* Interpret every kernel over every input pair */
+static size_t interpret_kernels(anvil_module_t *mod, size_t *total)
+{
+    size_t same = 0;
+    *total = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        int k = kernel_index(func->name);
+        for (size_t p = 0; p < NUM_INPUTS; p++) {
+            for (size_t q = 0; q < NUM_INPUTS; q++) {
+                int got;
+                (*total)++;
+                same += interpret(func, inputs[p], inputs[q], &got) && got == reference(k, inputs[p], inputs[q]);
+            }
+        }
+    }
+    return same;
+}
+
+static void check_target(size_t t, anvil_opt_level_t level, const char *what)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, targets[t].arch);
+    anvil_module_t *mod = build_kernels(ctx, level);
+    char msg[128];
+
+    size_t phis = count_ops(mod, ANVIL_OP_PHI), allocas = count_ops(mod, ANVIL_OP_ALLOCA);
+    if (targets[t].phis) {
+        snprintf(msg, sizeof(msg), "%s %s: locals promoted (%zu phis, %zu allocas)", targets[t].name, what, phis, allocas);
+        CHECK(phis > 0 && allocas == 0, msg);
+    } else {
+        snprintf(msg, sizeof(msg), "%s %s: locals kept in memory (%zu allocas)", targets[t].name, what, allocas);
+        CHECK(phis == 0 && allocas == 9, msg);
+    }
+    if (level == ANVIL_OPT_AGGRESSIVE) {
+        size_t loops = count_loops(mod);
+        snprintf(msg, sizeof(msg), "%s %s: %zu loops", targets[t].name, what, loops);
+        CHECK(targets[t].phis ? loops > NUM_KERNELS : loops == NUM_KERNELS, msg);
+    }
+
+    size_t total;
+    size_t same = interpret_kernels(mod, &total);
+    snprintf(msg, sizeof(msg), "%s %s: %zu of %zu interpreted results match", targets[t].name, what, same, total);
+    CHECK(same == total, msg);
+
+    char *out = NULL;
+    size_t len = 0;
+    snprintf(msg, sizeof(msg), "%s %s: code generated", targets[t].name, what);
+    CHECK(anvil_module_codegen(mod, &out, &len) == ANVIL_OK && len > 0, msg);
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_targets(void)
+{
+    printf("\nEvery backend (interpreted):\n");
+    for (size_t t = 0; t < NUM_TARGETS; t++) {
+        check_target(t, ANVIL_OPT_BASIC, "O1");
+        check_target(t, ANVIL_OPT_AGGRESSIVE, "O3");
+    }
+}
+
+/* A backend without supports_phi is not handed phis built by hand */
+static void test_rejected(void)
+{
+    printf("\nPhis on a backend without them:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_PPC32);
+    anvil_module_t *mod = anvil_module_create(ctx, "phi");
+    anvil_func_t *func = make_func(ctx, mod, "pick");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *left = anvil_block_create(func, "left");
+    anvil_block_t *join = anvil_block_create(func, "join");
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, anvil_func_get_param(func, 0),
+                                                anvil_func_get_param(func, 1), NULL), left, join);
+    anvil_set_insert_point(ctx, left);
+    anvil_build_br(ctx, join);
+    anvil_set_insert_point(ctx, join);
+    anvil_value_t *phi = anvil_build_phi(ctx, anvil_type_i32(ctx), "v");
+    anvil_phi_add_incoming(phi, anvil_func_get_param(func, 0), entry);
+    anvil_phi_add_incoming(phi, anvil_func_get_param(func, 1), left);
+    anvil_build_ret(ctx, phi);
+
+    char *out = NULL;
+    size_t len = 0;
+    CHECK(anvil_module_codegen(mod, &out, &len) == ANVIL_ERR_CODEGEN && !out,
+          "codegen refuses the module");
+    CHECK(strstr(anvil_ctx_get_error(ctx), "phi") != NULL, "error names the phis");
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* ============================================================================
+ * Execution
+ * ============================================================================ */
+
+typedef int (*kernel_fn)(int, int);
+
+static void check_jit(anvil_opt_level_t level, const char *what)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_module_t *mod = build_kernels(ctx, level);
+
+    anvil_jit_t *jit = NULL;
+    size_t same = 0, total = NUM_KERNELS * NUM_INPUTS * NUM_INPUTS;
+    if (anvil_module_jit(mod, NULL, NULL, &jit) == ANVIL_OK) {
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            kernel_fn fn = (kernel_fn)anvil_jit_get_function(jit, kernel_names[k]);
+            for (size_t p = 0; fn && p < NUM_INPUTS; p++) {
+                for (size_t q = 0; q < NUM_INPUTS; q++) {
+                    same += fn(inputs[p], inputs[q]) == reference(k, inputs[p], inputs[q]);
+                }
+            }
+        }
+        anvil_jit_destroy(jit);
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%s: %zu of %zu results match", what, same, total);
+    CHECK(same == total, msg);
+}
+
+static void test_execution(void)
+{
+    printf("\nExecution (x86_64 JIT):\n");
+    check_jit(ANVIL_OPT_DEBUG, "Og");
+    check_jit(ANVIL_OPT_BASIC, "O1");
+    check_jit(ANVIL_OPT_AGGRESSIVE, "O3");
+}
+
+int main(void)
+{
+    printf("=== Loop-Carried Values Test ===\n");
+
+    test_targets();
+    test_rejected();
+    test_execution();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
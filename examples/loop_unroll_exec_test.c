@@ -0,0 +1,662 @@
+/*
+ * ANVIL - Loop Unrolling Execution Test
+ *
+ * Builds counted loops in SSA form over every shape the unroller takes:
+ * up and down counting, each compare kind, the test in the header or the
+ * latch and on the induction variable or its next value, constant and
+ * runtime bounds, and bodies with branches, stores and calls. Checks
+ * which loops are fully or partially unrolled and which are left alone,
+ * and runs every kernel through the x86_64 JIT at O3, at O2 and with the
+ * unroller alone against a C model of the same loop. Runtime trip counts
+ * are also run at every multiple of the unroll factor plus 0, 1 and
+ * factor - 1, so the remainder loop runs no trip, one trip and its most.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "test_util.h"
+
+/* ============================================================================
+ * Kernels: int f(int *a, int x, int y)
+ * ============================================================================ */
+
+/* Where the start and the bound of a loop come from */
+enum { FROM_X, FROM_Y, FROM_CONST };
+
+/* Where the loop test is, and what it reads */
+enum {
+    TEST_HEAD,          /* while (i op n) { ...; i += step; } */
+    TEST_HEAD_NEXT,     /* while (i + step op n) { ...; i += step; } */
+    TEST_LATCH,         /* do { ...; i += step; } while (old i op n) */
+    TEST_LATCH_NEXT     /* do { ...; i += step; } while (i op n) */
+};
+
+enum {
+    BODY_LINEAR,        /* acc = acc * 3 + i */
+    BODY_DIAMOND,       /* if (i & 1) acc += a[i & 15]; else acc ^= i * 5 */
+    BODY_STORE,         /* a[i & 15] += acc; acc += i */
+    BODY_CALL,          /* acc += host_bump(a) + i */
+    BODY_CHAIN          /* acc = acc * 3 + i, chain times */
+};
+
+enum {
+    INVERTED = 1,       /* Branch out on the inverse compare */
+    SWAPPED = 2,        /* Bound on the left of the compare */
+    ADD_STEP = 4,       /* i + step even when step < 0 */
+    WIDE = 8            /* 64-bit induction variable */
+};
+
+typedef struct {
+    const char *name;
+    int start_from, start;
+    int bound_from, bound;
+    int step;
+    anvil_op_t op;      /* i op bound: go round again */
+    int test;
+    int body;
+    int chain;          /* Links of BODY_CHAIN */
+    unsigned flags;
+} spec_t;
+
+static const spec_t specs[] = {
+    { "up_lt",         FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "up_le_3",       FROM_X,     0,   FROM_Y,     0,    3,  ANVIL_OP_CMP_LE,  TEST_HEAD,       BODY_DIAMOND, 0,  0 },
+    { "up_ne",         FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_NE,  TEST_HEAD,       BODY_STORE,   0,  0 },
+    { "up_ult_2",      FROM_X,     0,   FROM_Y,     0,    2,  ANVIL_OP_CMP_ULT, TEST_HEAD,       BODY_CALL,    0,  0 },
+    { "up_ule_5",      FROM_X,     0,   FROM_Y,     0,    5,  ANVIL_OP_CMP_ULE, TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "down_gt",       FROM_Y,     0,   FROM_X,     0,    -1, ANVIL_OP_CMP_GT,  TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "down_ge_2",     FROM_Y,     0,   FROM_X,     0,    -2, ANVIL_OP_CMP_GE,  TEST_HEAD,       BODY_DIAMOND, 0,  0 },
+    { "down_ne",       FROM_Y,     0,   FROM_X,     0,    -1, ANVIL_OP_CMP_NE,  TEST_HEAD,       BODY_STORE,   0,  0 },
+    { "down_ugt_3",    FROM_Y,     0,   FROM_X,     0,    -3, ANVIL_OP_CMP_UGT, TEST_HEAD,       BODY_LINEAR,  0,  ADD_STEP },
+    { "down_uge_2",    FROM_Y,     0,   FROM_X,     0,    -2, ANVIL_OP_CMP_UGE, TEST_HEAD,       BODY_CALL,    0,  0 },
+    { "inverted",      FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_DIAMOND, 0,  INVERTED },
+    { "swapped",       FROM_X,     0,   FROM_Y,     0,    2,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_LINEAR,  0,  SWAPPED },
+    { "inv_swapped",   FROM_Y,     0,   FROM_X,     0,    -1, ANVIL_OP_CMP_GE,  TEST_HEAD,       BODY_STORE,   0,  INVERTED | SWAPPED },
+    { "head_next",     FROM_X,     0,   FROM_Y,     0,    2,  ANVIL_OP_CMP_LE,  TEST_HEAD_NEXT,  BODY_STORE,   0,  0 },
+    { "latch",         FROM_X,     0,   FROM_Y,     0,    3,  ANVIL_OP_CMP_LT,  TEST_LATCH,      BODY_CALL,    0,  0 },
+    { "latch_next",    FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_LATCH_NEXT, BODY_LINEAR,  0,  0 },
+    { "latch_diamond", FROM_Y,     0,   FROM_X,     0,    -1, ANVIL_OP_CMP_NE,  TEST_LATCH_NEXT, BODY_DIAMOND, 0,  0 },
+    { "const_start",   FROM_CONST, 0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_DIAMOND, 0,  0 },
+    { "const_bound",   FROM_X,     0,   FROM_CONST, 20,   1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "wide",          FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_LINEAR,  0,  WIDE },
+    { "wide_down",     FROM_Y,     0,   FROM_X,     0,    -3, ANVIL_OP_CMP_UGT, TEST_LATCH_NEXT, BODY_DIAMOND, 0,  WIDE },
+    { "full_diamond",  FROM_CONST, 0,   FROM_CONST, 6,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_DIAMOND, 0,  0 },
+    { "full_down",     FROM_CONST, 100, FROM_CONST, 0,    -7, ANVIL_OP_CMP_GT,  TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "full_latch",    FROM_CONST, 0,   FROM_CONST, 5,    1,  ANVIL_OP_CMP_LT,  TEST_LATCH_NEXT, BODY_STORE,   0,  0 },
+    { "full_udown",    FROM_CONST, 20,  FROM_CONST, 2,    -3, ANVIL_OP_CMP_UGT, TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "long_const",    FROM_CONST, 0,   FROM_CONST, 1000, 1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_LINEAR,  0,  0 },
+    { "chain_10",      FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_CHAIN,   10, 0 },
+    { "chain_20",      FROM_X,     0,   FROM_Y,     0,    1,  ANVIL_OP_CMP_LT,  TEST_HEAD,       BODY_CHAIN,   20, 0 },
+};
+#define NUM_SPECS (sizeof(specs) / sizeof(specs[0]))
+
+static anvil_value_t *build_compare(anvil_ctx_t *ctx, anvil_op_t op, anvil_value_t *a, anvil_value_t *b)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_EQ:  return anvil_build_cmp_eq(ctx, a, b, "c");
+        case ANVIL_OP_CMP_NE:  return anvil_build_cmp_ne(ctx, a, b, "c");
+        case ANVIL_OP_CMP_LT:  return anvil_build_cmp_lt(ctx, a, b, "c");
+        case ANVIL_OP_CMP_LE:  return anvil_build_cmp_le(ctx, a, b, "c");
+        case ANVIL_OP_CMP_GT:  return anvil_build_cmp_gt(ctx, a, b, "c");
+        case ANVIL_OP_CMP_GE:  return anvil_build_cmp_ge(ctx, a, b, "c");
+        case ANVIL_OP_CMP_ULT: return anvil_build_cmp_ult(ctx, a, b, "c");
+        case ANVIL_OP_CMP_ULE: return anvil_build_cmp_ule(ctx, a, b, "c");
+        case ANVIL_OP_CMP_UGT: return anvil_build_cmp_ugt(ctx, a, b, "c");
+        default:               return anvil_build_cmp_uge(ctx, a, b, "c");
+    }
+}
+
+static anvil_op_t inverse(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_NE:  return ANVIL_OP_CMP_EQ;
+        case ANVIL_OP_CMP_LT:  return ANVIL_OP_CMP_GE;
+        case ANVIL_OP_CMP_LE:  return ANVIL_OP_CMP_GT;
+        case ANVIL_OP_CMP_GT:  return ANVIL_OP_CMP_LE;
+        case ANVIL_OP_CMP_GE:  return ANVIL_OP_CMP_LT;
+        case ANVIL_OP_CMP_ULT: return ANVIL_OP_CMP_UGE;
+        case ANVIL_OP_CMP_ULE: return ANVIL_OP_CMP_UGT;
+        case ANVIL_OP_CMP_UGT: return ANVIL_OP_CMP_ULE;
+        default:               return ANVIL_OP_CMP_ULT;
+    }
+}
+
+static anvil_op_t mirrored(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_LT:  return ANVIL_OP_CMP_GT;
+        case ANVIL_OP_CMP_LE:  return ANVIL_OP_CMP_GE;
+        case ANVIL_OP_CMP_GT:  return ANVIL_OP_CMP_LT;
+        case ANVIL_OP_CMP_GE:  return ANVIL_OP_CMP_LE;
+        case ANVIL_OP_CMP_ULT: return ANVIL_OP_CMP_UGT;
+        case ANVIL_OP_CMP_ULE: return ANVIL_OP_CMP_UGE;
+        case ANVIL_OP_CMP_UGT: return ANVIL_OP_CMP_ULT;
+        case ANVIL_OP_CMP_UGE: return ANVIL_OP_CMP_ULE;
+        default:               return op;
+    }
+}
+
+/* Branch to stay while iv op bound holds, as the spec writes the test */
+static void build_test(anvil_ctx_t *ctx, const spec_t *spec, anvil_value_t *iv, anvil_value_t *bound,
+                       anvil_block_t *stay, anvil_block_t *leave)
+{
+    anvil_op_t op = (spec->flags & INVERTED) ? inverse(spec->op) : spec->op;
+    anvil_value_t *c = (spec->flags & SWAPPED) ? build_compare(ctx, mirrored(op), bound, iv)
+                                     : build_compare(ctx, op, iv, bound);
+    if (spec->flags & INVERTED) anvil_build_br_cond(ctx, c, leave, stay);
+    else anvil_build_br_cond(ctx, c, stay, leave);
+}
+
+static anvil_value_t *build_step(anvil_ctx_t *ctx, const spec_t *spec, anvil_value_t *iv)
+{
+    int64_t step = spec->step;
+    bool sub = step < 0 && !(spec->flags & ADD_STEP);
+    if (sub) step = -step;
+    anvil_value_t *c = (spec->flags & WIDE) ? anvil_const_i64(ctx, step) : anvil_const_i32(ctx, (int32_t)step);
+    return sub ? anvil_build_sub(ctx, iv, c, "i_next") : anvil_build_add(ctx, iv, c, "i_next");
+}
+
+static anvil_value_t *elem(anvil_ctx_t *ctx, anvil_value_t *base, anvil_value_t *index)
+{
+    return anvil_build_gep(ctx, anvil_type_i32(ctx), base, &index, 1, NULL);
+}
+
+/* The loop body from the builder's block on; returns the new acc and
+ * leaves the builder in the block that ends the body */
+static anvil_value_t *build_body(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump,
+                                 const spec_t *spec, anvil_value_t *i, anvil_value_t *acc)
+{
+    anvil_value_t *a = anvil_func_get_param(func, 0);
+    anvil_value_t *three = anvil_const_i32(ctx, 3);
+    anvil_value_t *low = anvil_build_and(ctx, i, anvil_const_i32(ctx, 15), NULL);
+
+    switch (spec->body) {
+        case BODY_DIAMOND: {
+            anvil_block_t *odd = anvil_block_create(func, "odd");
+            anvil_block_t *even = anvil_block_create(func, "even");
+            anvil_block_t *join = anvil_block_create(func, "join");
+            anvil_value_t *bit = anvil_build_and(ctx, i, anvil_const_i32(ctx, 1), NULL);
+            anvil_build_br_cond(ctx, anvil_build_cmp_ne(ctx, bit, anvil_const_i32(ctx, 0), NULL), odd, even);
+            anvil_set_insert_point(ctx, odd);
+            anvil_value_t *v = anvil_build_add(ctx, acc,
+                anvil_build_load(ctx, anvil_type_i32(ctx), elem(ctx, a, low), NULL), NULL);
+            anvil_build_br(ctx, join);
+            anvil_set_insert_point(ctx, even);
+            anvil_value_t *w = anvil_build_xor(ctx, acc, anvil_build_mul(ctx, i, anvil_const_i32(ctx, 5), NULL), NULL);
+            anvil_build_br(ctx, join);
+            anvil_set_insert_point(ctx, join);
+            anvil_value_t *phi = anvil_build_phi(ctx, anvil_type_i32(ctx), "acc_join");
+            anvil_phi_add_incoming(phi, v, odd);
+            anvil_phi_add_incoming(phi, w, even);
+            return phi;
+        }
+        case BODY_STORE: {
+            anvil_value_t *p = elem(ctx, a, low);
+            anvil_value_t *sum = anvil_build_add(ctx, anvil_build_load(ctx, anvil_type_i32(ctx), p, NULL), acc, NULL);
+            anvil_build_store(ctx, sum, p);
+            return anvil_build_add(ctx, acc, i, NULL);
+        }
+        case BODY_CALL: {
+            anvil_value_t *c = anvil_build_call(ctx, anvil_type_i32(ctx), anvil_func_get_value(bump), &a, 1, NULL);
+            return anvil_build_add(ctx, anvil_build_add(ctx, acc, c, NULL), i, NULL);
+        }
+        default: {
+            int times = spec->body == BODY_CHAIN ? spec->chain : 1;
+            for (int t = 0; t < times; t++) {
+                acc = anvil_build_add(ctx, anvil_build_mul(ctx, acc, three, NULL), i, NULL);
+            }
+            return acc;
+        }
+    }
+}
+
+static anvil_value_t *source(anvil_ctx_t *ctx, anvil_func_t *func, const spec_t *spec, int from, int val)
+{
+    anvil_value_t *v = from == FROM_CONST ? anvil_const_i32(ctx, val) : anvil_func_get_param(func, from == FROM_X ? 1 : 2);
+    if (!(spec->flags & WIDE)) return v;
+    return from == FROM_CONST ? anvil_const_i64(ctx, val) : anvil_build_sext(ctx, v, anvil_type_i64(ctx), NULL);
+}
+
+static void build_kernel(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump, const spec_t *spec)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *iv_type = (spec->flags & WIDE) ? anvil_type_i64(ctx) : i32;
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *start = source(ctx, func, spec, spec->start_from, spec->start);
+    anvil_value_t *bound = source(ctx, func, spec, spec->bound_from, spec->bound);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_value_t *i = anvil_build_phi(ctx, iv_type, "i");
+    anvil_value_t *acc = anvil_build_phi(ctx, i32, "acc");
+    anvil_value_t *i32_i = (spec->flags & WIDE) ? anvil_build_trunc(ctx, i, i32, NULL) : i;
+    anvil_value_t *next, *acc_next, *out_i, *out_acc;
+
+    if (spec->test == TEST_HEAD || spec->test == TEST_HEAD_NEXT) {
+        anvil_block_t *body = anvil_block_create(func, "body");
+        next = spec->test == TEST_HEAD_NEXT ? build_step(ctx, spec, i) : NULL;
+        build_test(ctx, spec, next ? next : i, bound, body, done);
+        anvil_set_insert_point(ctx, body);
+        acc_next = build_body(ctx, func, bump, spec, i32_i, acc);
+        if (!next) next = build_step(ctx, spec, i);
+        anvil_build_br(ctx, head);
+        out_i = i32_i;
+        out_acc = acc;
+    } else {
+        acc_next = build_body(ctx, func, bump, spec, i32_i, acc);
+        next = build_step(ctx, spec, i);
+        build_test(ctx, spec, spec->test == TEST_LATCH_NEXT ? next : i, bound, head, done);
+        out_i = next;
+        out_acc = acc_next;
+    }
+    anvil_block_t *latch = ctx->insert_block;
+    anvil_phi_add_incoming(i, start, entry);
+    anvil_phi_add_incoming(i, next, latch);
+    anvil_phi_add_incoming(acc, anvil_const_i32(ctx, 0), entry);
+    anvil_phi_add_incoming(acc, acc_next, latch);
+
+    anvil_set_insert_point(ctx, done);
+    if ((spec->flags & WIDE) && out_i == next) out_i = anvil_build_trunc(ctx, next, i32, NULL);
+    anvil_value_t *scaled = anvil_build_mul(ctx, out_acc, anvil_const_i32(ctx, 31), NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, scaled, out_i, NULL));
+}
+
+static int host_bump(int *p)
+{
+    *p += 1;
+    return *p & 1;
+}
+
+static void *resolve(void *user, const char *name)
+{
+    (void)user;
+    return strcmp(name, "host_bump") == 0 ? (void *)host_bump : NULL;
+}
+
+static anvil_module_t *build_kernels(anvil_ctx_t *ctx, anvil_opt_level_t level, const char *pipeline)
+{
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_pass_manager_set_pipeline(anvil_ctx_get_pass_manager(ctx), pipeline);
+
+    anvil_module_t *mod = anvil_module_create(ctx, "kernels");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i32p = anvil_type_ptr(ctx, i32);
+    anvil_type_t *params[] = { i32p, i32, i32 };
+    anvil_func_t *bump = anvil_func_declare(mod, "host_bump", anvil_type_func(ctx, i32, &i32p, 1, false));
+    for (size_t k = 0; k < NUM_SPECS; k++) {
+        anvil_func_t *func = make_func_with(ctx, mod, specs[k].name, params, 3);
+        build_kernel(ctx, func, bump, &specs[k]);
+    }
+    anvil_pass_manager_set_verify(anvil_ctx_get_pass_manager(ctx), true);
+    anvil_module_optimize(mod);
+    return mod;
+}
+
+/* ============================================================================
+ * Shape
+ * ============================================================================ */
+
+static anvil_func_t *kernel(anvil_module_t *mod, const char *name)
+{
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        if (strcmp(func->name, name) == 0) return func;
+    }
+    return NULL;
+}
+
+static size_t num_loops(anvil_func_t *func)
+{
+    return anvil_func_loops(func)->num_loops;
+}
+
+/* Instructions of an op inside loops, or anywhere */
+static size_t count_ops(anvil_func_t *func, anvil_op_t op, bool in_loops)
+{
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    size_t n = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        if (in_loops && anvil_loop_depth(li, block) == 0) continue;
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == op) n++;
+        }
+    }
+    return n;
+}
+
+/* A loop with a second way out: for (i = x; i < y; i++) if (a[i & 15] == 0) break; */
+static anvil_func_t *build_two_exits(anvil_ctx_t *ctx, anvil_module_t *mod)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { anvil_type_ptr(ctx, i32), i32, i32 };
+    anvil_func_t *func = make_func_with(ctx, mod, "two_exits", params, 3);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *latch = anvil_block_create(func, "latch");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, head);
+    anvil_set_insert_point(ctx, head);
+    anvil_value_t *i = anvil_build_phi(ctx, i32, "i");
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, i, anvil_func_get_param(func, 2), NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *low = anvil_build_and(ctx, i, anvil_const_i32(ctx, 15), NULL);
+    anvil_value_t *v = anvil_build_load(ctx, i32, elem(ctx, anvil_func_get_param(func, 0), low), NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_eq(ctx, v, anvil_const_i32(ctx, 0), NULL), done, latch);
+    anvil_set_insert_point(ctx, latch);
+    anvil_value_t *next = anvil_build_add(ctx, i, anvil_const_i32(ctx, 1), NULL);
+    anvil_build_br(ctx, head);
+    anvil_phi_add_incoming(i, anvil_func_get_param(func, 1), entry);
+    anvil_phi_add_incoming(i, next, latch);
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, i);
+    return func;
+}
+
+/* The bound moves: for (i = 0, s = x; i < s; i++) s -= 1 */
+static anvil_func_t *build_moving_bound(anvil_ctx_t *ctx, anvil_module_t *mod)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { anvil_type_ptr(ctx, i32), i32, i32 };
+    anvil_func_t *func = make_func_with(ctx, mod, "moving_bound", params, 3);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, head);
+    anvil_set_insert_point(ctx, head);
+    anvil_value_t *i = anvil_build_phi(ctx, i32, "i");
+    anvil_value_t *s = anvil_build_phi(ctx, i32, "s");
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, i, s, NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *next = anvil_build_add(ctx, i, anvil_const_i32(ctx, 1), NULL);
+    anvil_value_t *s_next = anvil_build_sub(ctx, s, anvil_const_i32(ctx, 1), NULL);
+    anvil_build_br(ctx, head);
+    anvil_phi_add_incoming(i, anvil_const_i32(ctx, 0), entry);
+    anvil_phi_add_incoming(i, next, body);
+    anvil_phi_add_incoming(s, anvil_func_get_param(func, 1), entry);
+    anvil_phi_add_incoming(s, s_next, body);
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, i);
+    return func;
+}
+
+static void test_shape(void)
+{
+    printf("\nShape (loop-unroll alone):\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *mod = build_kernels(ctx, ANVIL_OPT_AGGRESSIVE, "loop-unroll");
+
+    anvil_func_t *up = kernel(mod, "up_lt");
+    CHECK(num_loops(up) == 2, "runtime trip count: unrolled loop plus remainder");
+    CHECK(count_ops(up, ANVIL_OP_MUL, true) == 9, "eight copies of the body and the original");
+    CHECK(!anvil_pass_loop_unroll(up), "neither loop is unrolled again");
+
+    anvil_func_t *diamond = kernel(mod, "up_le_3");
+    CHECK(num_loops(diamond) == 2 && count_ops(diamond, ANVIL_OP_XOR, true) > 2,
+          "body with its own branches unrolled");
+
+    anvil_func_t *latch = kernel(mod, "latch_diamond");
+    CHECK(num_loops(latch) == 2, "loop tested in the latch unrolled");
+
+    anvil_func_t *full = kernel(mod, "full_diamond");
+    CHECK(num_loops(full) == 0, "six trips of a diamond body fully unrolled");
+    CHECK(count_ops(full, ANVIL_OP_XOR, false) == 6, "one copy per trip");
+
+    anvil_func_t *full_latch = kernel(mod, "full_latch");
+    CHECK(num_loops(full_latch) == 0 && count_ops(full_latch, ANVIL_OP_STORE, false) == 5,
+          "do-while with five trips fully unrolled");
+
+    anvil_func_t *udown = kernel(mod, "full_udown");
+    CHECK(num_loops(udown) == 0 && count_ops(udown, ANVIL_OP_MUL, false) == 7,
+          "unsigned countdown fully unrolled");
+
+    anvil_func_t *long_loop = kernel(mod, "long_const");
+    CHECK(num_loops(long_loop) == 2, "long constant trip count unrolled at run time");
+
+    CHECK(num_loops(kernel(mod, "chain_10")) == 2 &&
+          count_ops(kernel(mod, "chain_10"), ANVIL_OP_MUL, true) == 30,
+          "24-instruction body unrolled by 2");
+    CHECK(num_loops(kernel(mod, "chain_20")) == 1 &&
+          count_ops(kernel(mod, "chain_20"), ANVIL_OP_MUL, true) == 20,
+          "44-instruction body left alone");
+
+    bool edges_ok = true;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        edges_ok = edges_ok && anvil_func_verify_cfg(func);
+    }
+    CHECK(edges_ok, "edge lists match the terminators after unrolling");
+
+    anvil_func_t *two_exits = build_two_exits(ctx, mod);
+    CHECK(!anvil_pass_loop_unroll(two_exits), "loop with two exits left alone");
+    anvil_func_t *moving = build_moving_bound(ctx, mod);
+    CHECK(!anvil_pass_loop_unroll(moving), "loop whose bound changes left alone");
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    printf("\nShape (O3):\n");
+    ctx = anvil_ctx_create();
+    mod = build_kernels(ctx, ANVIL_OPT_AGGRESSIVE, NULL);
+    anvil_func_t *folded = kernel(mod, "full_down");
+    anvil_instr_t *ret = folded && folded->num_blocks == 1 ? folded->blocks->last : NULL;
+    CHECK(ret && ret->op == ANVIL_OP_RET && ret->num_operands == 1 &&
+          ret->operands[0]->kind == ANVIL_VAL_CONST_INT,
+          "constant loop folds to a constant return");
+    CHECK(num_loops(kernel(mod, "up_lt")) == 2, "runtime unrolling survives the pipeline");
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* ============================================================================
+ * Execution
+ * ============================================================================ */
+
+typedef int (*kernel_fn)(int *, int, int);
+
+#define ARRAY_LEN 16
+#define MAX_TRIPS 1000
+
+static void fill(int *a)
+{
+    for (int k = 0; k < ARRAY_LEN; k++) a[k] = k * 7 - 20;
+}
+
+static bool holds(anvil_op_t op, uint64_t a, uint64_t b, bool wide)
+{
+    int64_t sa = wide ? (int64_t)a : (int32_t)a, sb = wide ? (int64_t)b : (int32_t)b;
+    if (!wide) {
+        a = (uint32_t)a;
+        b = (uint32_t)b;
+    }
+    switch (op) {
+        case ANVIL_OP_CMP_NE:  return a != b;
+        case ANVIL_OP_CMP_LT:  return sa < sb;
+        case ANVIL_OP_CMP_LE:  return sa <= sb;
+        case ANVIL_OP_CMP_GT:  return sa > sb;
+        case ANVIL_OP_CMP_GE:  return sa >= sb;
+        case ANVIL_OP_CMP_ULT: return a < b;
+        case ANVIL_OP_CMP_ULE: return a <= b;
+        case ANVIL_OP_CMP_UGT: return a > b;
+        default:               return a >= b;
+    }
+}
+
+static uint32_t run_body(const spec_t *spec, int *a, uint32_t i, uint32_t acc)
+{
+    switch (spec->body) {
+        case BODY_DIAMOND:
+            return (i & 1) ? acc + (uint32_t)a[i & 15] : acc ^ (i * 5);
+        case BODY_STORE:
+            a[i & 15] = (int)((uint32_t)a[i & 15] + acc);
+            return acc + i;
+        case BODY_CALL:
+            return acc + (uint32_t)host_bump(a) + i;
+        default: {
+            int times = spec->body == BODY_CHAIN ? spec->chain : 1;
+            for (int t = 0; t < times; t++) acc = acc * 3 + i;
+            return acc;
+        }
+    }
+}
+
+static uint64_t value_of(const spec_t *spec, int from, int val, int x, int y)
+{
+    int v = from == FROM_CONST ? val : from == FROM_X ? x : y;
+    return (spec->flags & WIDE) ? (uint64_t)(int64_t)v : (uint32_t)v;
+}
+
+/* What the kernel returns, or false if the loop runs more than MAX_TRIPS times */
+static bool reference(const spec_t *spec, int *a, int x, int y, int *result)
+{
+    uint64_t i = value_of(spec, spec->start_from, spec->start, x, y);
+    uint64_t bound = value_of(spec, spec->bound_from, spec->bound, x, y);
+    uint64_t step = (uint64_t)(int64_t)spec->step;
+    uint32_t acc = 0;
+    bool latch = spec->test == TEST_LATCH || spec->test == TEST_LATCH_NEXT;
+    bool next = spec->test == TEST_HEAD_NEXT || spec->test == TEST_LATCH_NEXT;
+
+    for (int trips = 0; ; trips++) {
+        if (trips > MAX_TRIPS) return false;
+        if (!latch && !holds(spec->op, next ? i + step : i, bound, spec->flags & WIDE)) break;
+        acc = run_body(spec, a, (uint32_t)i, acc);
+        uint64_t tested = next ? i + step : i;
+        i += step;
+        if (latch && !holds(spec->op, tested, bound, spec->flags & WIDE)) break;
+    }
+    *result = (int)(acc * 31 + (uint32_t)i);
+    return true;
+}
+
+static const int inputs[] = { -3, 0, 1, 2, 5, 9, 16, 17, 40, 333, 2147483646, -2147483647 };
+#define NUM_INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+/* JIT every kernel and count the inputs whose result and array match */
+static void check_kernels(anvil_opt_level_t level, const char *pipeline, const char *what)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *mod = build_kernels(ctx, level, pipeline);
+
+    anvil_jit_t *jit = NULL;
+    size_t same = 0, total = 0;
+    if (anvil_module_jit(mod, resolve, NULL, &jit) == ANVIL_OK) {
+        for (size_t k = 0; k < NUM_SPECS; k++) {
+            kernel_fn fn = (kernel_fn)anvil_jit_get_function(jit, specs[k].name);
+            for (size_t p = 0; fn && p < NUM_INPUTS; p++) {
+                for (size_t q = 0; q < NUM_INPUTS; q++) {
+                    int got_a[ARRAY_LEN], want_a[ARRAY_LEN], want;
+                    fill(want_a);
+                    if (!reference(&specs[k], want_a, inputs[p], inputs[q], &want)) continue;
+                    fill(got_a);
+                    int got = fn(got_a, inputs[p], inputs[q]);
+                    total++;
+                    same += got == want && memcmp(got_a, want_a, sizeof(got_a)) == 0;
+                }
+            }
+        }
+        anvil_jit_destroy(jit);
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%s: %zu of %zu results match", what, same, total);
+    CHECK(total > 0 && same == total, msg);
+}
+
+/* Runtime-count kernels whose body has a fixed number of multiplies per trip */
+static const char *remainder_kernels[] = { "up_lt", "down_gt", "latch_next", "wide", "chain_10" };
+#define NUM_REMAINDER_KERNELS (sizeof(remainder_kernels) / sizeof(remainder_kernels[0]))
+
+static const spec_t *spec_named(const char *name)
+{
+    for (size_t k = 0; k < NUM_SPECS; k++) {
+        if (strcmp(specs[k].name, name) == 0) return &specs[k];
+    }
+    return NULL;
+}
+
+/* Unroll factor of a kernel: the unrolled loop and the remainder hold factor + 1 bodies */
+static int unroll_factor(anvil_module_t *mod, const spec_t *spec)
+{
+    size_t links = spec->body == BODY_CHAIN ? (size_t)spec->chain : 1;
+    return (int)(count_ops(kernel(mod, spec->name), ANVIL_OP_MUL, true) / links) - 1;
+}
+
+static void check_remainders(anvil_opt_level_t level, const char *pipeline, const char *what)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *shape = build_kernels(ctx, ANVIL_OPT_AGGRESSIVE, "loop-unroll");
+    int factors[NUM_REMAINDER_KERNELS];
+    for (size_t k = 0; k < NUM_REMAINDER_KERNELS; k++) {
+        factors[k] = unroll_factor(shape, spec_named(remainder_kernels[k]));
+    }
+    anvil_module_destroy(shape);
+    anvil_ctx_destroy(ctx);
+
+    ctx = anvil_ctx_create();
+    anvil_module_t *mod = build_kernels(ctx, level, pipeline);
+    anvil_jit_t *jit = NULL;
+    size_t same = 0, total = 0;
+    if (anvil_module_jit(mod, resolve, NULL, &jit) == ANVIL_OK) {
+        for (size_t k = 0; k < NUM_REMAINDER_KERNELS; k++) {
+            const spec_t *spec = spec_named(remainder_kernels[k]);
+            kernel_fn fn = (kernel_fn)anvil_jit_get_function(jit, spec->name);
+            int u = factors[k];
+            int rems[] = { 0, 1, u - 1 };
+            for (int m = 0; fn && u > 1 && m <= 5; m++) {
+                for (size_t r = 0; r < 3; r++) {
+                    /* Counting up from x to y or down from y to x, trips apart */
+                    int x = -4, y = x + m * u + rems[r];
+                    int got_a[ARRAY_LEN], want_a[ARRAY_LEN], want;
+                    fill(want_a);
+                    if (!reference(spec, want_a, x, y, &want)) continue;
+                    fill(got_a);
+                    int got = fn(got_a, x, y);
+                    total++;
+                    same += got == want && memcmp(got_a, want_a, sizeof(got_a)) == 0;
+                }
+            }
+        }
+        anvil_jit_destroy(jit);
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s: %zu of %zu remainder cases match (factors %d, %d, %d, %d, %d)",
+             what, same, total, factors[0], factors[1], factors[2], factors[3], factors[4]);
+    CHECK(total == NUM_REMAINDER_KERNELS * 6 * 3 && same == total, msg);
+}
+
+static void test_execution(void)
+{
+    printf("\nExecution (x86_64 JIT):\n");
+    check_kernels(ANVIL_OPT_AGGRESSIVE, NULL, "O3");
+    check_kernels(ANVIL_OPT_STANDARD, NULL, "O2");
+    check_kernels(ANVIL_OPT_AGGRESSIVE, "loop-unroll", "loop-unroll alone");
+    check_remainders(ANVIL_OPT_AGGRESSIVE, NULL, "O3");
+    check_remainders(ANVIL_OPT_AGGRESSIVE, "loop-unroll", "loop-unroll alone");
+}
+
+int main(void)
+{
+    printf("=== Loop Unrolling Execution Test ===\n");
+
+    test_shape();
+    test_execution();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
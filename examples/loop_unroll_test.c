@@ -6,6 +6,9 @@
  * 
  * Usage: loop_unroll_test [arch]
  *   arch: x86, x86_64, s370, s370_xa, s390, zarch, ppc32, ppc64, ppc64le, arm64
+ *
+ * The loops are built with phis, so only x86_64 and arm64 unroll and
+ * generate them; the other backends report the phis as unsupported.
  */
 
 #include <anvil/anvil.h>
@@ -15,7 +18,7 @@
 #include "arch_select.h"
 
 /* Helper to print generated code */
-static void print_code(anvil_module_t *mod, const char *title)
+static void print_code(anvil_ctx_t *ctx, anvil_module_t *mod, const char *title)
 {
     char *output = NULL;
     size_t len = 0;
@@ -23,6 +26,8 @@ static void print_code(anvil_module_t *mod, const char *title)
     if (anvil_module_codegen(mod, &output, &len) == ANVIL_OK) {
         printf("=== %s ===\n%s\n", title, output);
         free(output);
+    } else {
+        printf("=== %s ===\nCodegen failed: %s\n\n", title, anvil_ctx_get_error(ctx));
     }
 }
 
@@ -86,13 +91,13 @@ static void test_full_unroll(anvil_ctx_t *ctx)
     anvil_set_insert_point(ctx, loop_exit);
     anvil_build_ret(ctx, sum_phi);
     
-    print_code(mod, "Before Optimization (with loop)");
+    print_code(ctx, mod, "Before Optimization (with loop)");
     
     /* Enable O3 optimization (includes loop unrolling) */
     anvil_ctx_set_opt_level(ctx, ANVIL_OPT_AGGRESSIVE);
     anvil_module_optimize(mod);
     
-    print_code(mod, "After Optimization (loop should be unrolled)");
+    print_code(ctx, mod, "After Optimization (loop should be unrolled)");
     
     anvil_module_destroy(mod);
     anvil_ctx_set_opt_level(ctx, ANVIL_OPT_NONE);
@@ -164,13 +169,13 @@ static void test_array_sum(anvil_ctx_t *ctx)
     anvil_set_insert_point(ctx, loop_exit);
     anvil_build_ret(ctx, sum_phi);
     
-    print_code(mod, "Before Optimization");
+    print_code(ctx, mod, "Before Optimization");
     
     /* Enable O3 optimization */
     anvil_ctx_set_opt_level(ctx, ANVIL_OPT_AGGRESSIVE);
     anvil_module_optimize(mod);
     
-    print_code(mod, "After Optimization");
+    print_code(ctx, mod, "After Optimization");
     
     anvil_module_destroy(mod);
     anvil_ctx_set_opt_level(ctx, ANVIL_OPT_NONE);
@@ -239,13 +244,13 @@ static void test_mul_loop(anvil_ctx_t *ctx)
     anvil_set_insert_point(ctx, loop_exit);
     anvil_build_ret(ctx, result_phi);
     
-    print_code(mod, "Before Optimization");
+    print_code(ctx, mod, "Before Optimization");
     
     /* Enable O3 optimization */
     anvil_ctx_set_opt_level(ctx, ANVIL_OPT_AGGRESSIVE);
     anvil_module_optimize(mod);
     
-    print_code(mod, "After Optimization (8 additions unrolled)");
+    print_code(ctx, mod, "After Optimization (8 additions unrolled)");
     
     anvil_module_destroy(mod);
     anvil_ctx_set_opt_level(ctx, ANVIL_OPT_NONE);
@@ -0,0 +1,355 @@
+/*
+ * ANVIL - Loop Nest and Cached Analysis Test
+ *
+ * Checks the natural loops found over the dominator tree (nesting,
+ * preheaders, latches and exits, shared headers, irreducible cycles),
+ * that the dominator tree and loop nest are cached on the function and
+ * dropped when the CFG changes, and that the x86-64 register allocator
+ * uses the loop nest to keep loop values out of the frame.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+static anvil_value_t *cond(anvil_ctx_t *ctx, anvil_func_t *func)
+{
+    return anvil_build_cmp_lt(ctx, anvil_func_get_param(func, 0), anvil_func_get_param(func, 1), NULL);
+}
+
+static int32_t idx(anvil_func_t *func, anvil_block_t *block)
+{
+    return anvil_domtree_index(anvil_func_domtree(func), block);
+}
+
+/* Loop headed by block, or NULL */
+static const anvil_loop_t *loop_at(anvil_func_t *func, anvil_block_t *header)
+{
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    for (size_t l = 0; li && l < li->num_loops; l++) {
+        if (li->loops[l].header == idx(func, header)) return &li->loops[l];
+    }
+    return NULL;
+}
+
+static bool has_index(const int32_t *list, size_t n, int32_t b)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (list[i] == b) return true;
+    }
+    return false;
+}
+
+/*
+ * entry -> outer
+ * outer:  br_cond pre, exit
+ * pre:    -> inner
+ * inner:  br_cond body, latch
+ * body:   -> inner
+ * latch:  -> outer
+ * exit:   ret
+ */
+static void test_nest(anvil_ctx_t *ctx)
+{
+    printf("\nNested loops:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "nest");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *outer = anvil_block_create(func, "outer");
+    anvil_block_t *pre = anvil_block_create(func, "pre");
+    anvil_block_t *inner = anvil_block_create(func, "inner");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *latch = anvil_block_create(func, "latch");
+    anvil_block_t *exit_bb = anvil_block_create(func, "exit");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, outer);
+    anvil_set_insert_point(ctx, outer);
+    anvil_build_br_cond(ctx, cond(ctx, func), pre, exit_bb);
+    anvil_set_insert_point(ctx, pre);
+    anvil_build_br(ctx, inner);
+    anvil_set_insert_point(ctx, inner);
+    anvil_build_br_cond(ctx, cond(ctx, func), body, latch);
+    anvil_set_insert_point(ctx, body);
+    anvil_build_br(ctx, inner);
+    anvil_set_insert_point(ctx, latch);
+    anvil_build_br(ctx, outer);
+    anvil_set_insert_point(ctx, exit_bb);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 2, "two loops");
+    const anvil_loop_t *lo = loop_at(func, outer);
+    const anvil_loop_t *in = loop_at(func, inner);
+    CHECK(lo && in && lo == &li->loops[0], "outer loop comes first");
+    if (!lo || !in) {
+        anvil_module_destroy(mod);
+        return;
+    }
+    CHECK(lo->depth == 1 && lo->parent == -1, "outer loop is outermost");
+    CHECK(in->depth == 2 && in->parent == 0, "inner loop nests in the outer one");
+    CHECK(lo->num_blocks == 5 && lo->blocks[0] == idx(func, outer), "outer loop has five blocks, header first");
+    CHECK(in->num_blocks == 2 && has_index(in->blocks, 2, idx(func, body)), "inner loop is header and body");
+    CHECK(lo->preheader == idx(func, entry) && in->preheader == idx(func, pre), "preheaders");
+    CHECK(lo->num_latches == 1 && lo->latches[0] == idx(func, latch) &&
+          in->num_latches == 1 && in->latches[0] == idx(func, body), "latches");
+    CHECK(lo->num_exits == 1 && lo->exits[0] == idx(func, exit_bb) &&
+          in->num_exits == 1 && in->exits[0] == idx(func, latch), "exits");
+    CHECK(anvil_loop_contains(li, 0, idx(func, body)) && !anvil_loop_contains(li, 1, idx(func, latch)) &&
+          !anvil_loop_contains(li, 0, idx(func, exit_bb)), "containment follows the nesting");
+    CHECK(anvil_loop_depth(li, body) == 2 && anvil_loop_depth(li, pre) == 1 &&
+          anvil_loop_depth(li, entry) == 0 && anvil_loop_depth(li, exit_bb) == 0, "block depths");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * entry:  br_cond head, other
+ * other:  -> head                 (second way in: no preheader)
+ * head:   br_cond a, exit
+ * a:      br_cond head, b         (continue)
+ * b:      -> head
+ * self:   br_cond self, exit      (unreachable, no loop)
+ */
+static void test_shapes(anvil_ctx_t *ctx)
+{
+    printf("\nLoop shapes:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "shapes");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *other = anvil_block_create(func, "other");
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *a = anvil_block_create(func, "a");
+    anvil_block_t *b = anvil_block_create(func, "b");
+    anvil_block_t *exit_bb = anvil_block_create(func, "exit");
+    anvil_block_t *self = anvil_block_create(func, "self");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br_cond(ctx, cond(ctx, func), head, other);
+    anvil_set_insert_point(ctx, other);
+    anvil_build_br(ctx, head);
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, cond(ctx, func), a, exit_bb);
+    anvil_set_insert_point(ctx, a);
+    anvil_build_br_cond(ctx, cond(ctx, func), head, b);
+    anvil_set_insert_point(ctx, b);
+    anvil_build_br(ctx, head);
+    anvil_set_insert_point(ctx, self);
+    anvil_build_br_cond(ctx, cond(ctx, func), self, exit_bb);
+    anvil_set_insert_point(ctx, exit_bb);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    const anvil_loop_t *loop = loop_at(func, head);
+    CHECK(li && li->num_loops == 1 && loop, "back edges into one header make one loop");
+    CHECK(loop && loop->num_latches == 2 && loop->num_blocks == 3, "two latches, three blocks");
+    CHECK(loop && loop->preheader == -1, "no preheader with two ways in");
+    CHECK(idx(func, self) == -1 && li && anvil_loop_depth(li, self) == 0, "unreachable self loop is ignored");
+    anvil_module_destroy(mod);
+
+    /* entry: br_cond x, y; x: br_cond y, exit; y: -> x  -- a cycle entered twice */
+    mod = anvil_module_create(ctx, "irreducible");
+    func = make_func(ctx, mod, "f");
+    anvil_block_t *x = anvil_block_create(func, "x");
+    anvil_block_t *y = anvil_block_create(func, "y");
+    exit_bb = anvil_block_create(func, "exit");
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_build_br_cond(ctx, cond(ctx, func), x, y);
+    anvil_set_insert_point(ctx, x);
+    anvil_build_br_cond(ctx, cond(ctx, func), y, exit_bb);
+    anvil_set_insert_point(ctx, y);
+    anvil_build_br(ctx, x);
+    anvil_set_insert_point(ctx, exit_bb);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+    li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 0, "irreducible cycle is not a loop");
+    anvil_module_destroy(mod);
+
+    /* A block that branches to itself */
+    mod = anvil_module_create(ctx, "self");
+    func = make_func(ctx, mod, "f");
+    self = anvil_block_create(func, "self");
+    exit_bb = anvil_block_create(func, "exit");
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_build_br(ctx, self);
+    anvil_set_insert_point(ctx, self);
+    anvil_build_br_cond(ctx, cond(ctx, func), self, exit_bb);
+    anvil_set_insert_point(ctx, exit_bb);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+    loop = loop_at(func, self);
+    CHECK(loop && loop->num_blocks == 1 && loop->num_latches == 1 &&
+          loop->latches[0] == loop->header, "self loop is its own latch");
+    anvil_module_destroy(mod);
+}
+
+/* Custom pass that turns the first conditional branch into a branch to
+ * its false target, editing it in place */
+static bool take_false_branch(anvil_func_t *func)
+{
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        anvil_instr_t *term = block->last;
+        if (!term || term->op != ANVIL_OP_BR_COND) continue;
+        term->op = ANVIL_OP_BR;
+        term->true_block = term->false_block;
+        term->false_block = NULL;
+        anvil_instr_clear_operands(term);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * entry: br_cond loop, exit
+ * loop:  br_cond loop, exit
+ * exit:  ret
+ */
+static anvil_func_t *build_guarded_loop(anvil_ctx_t *ctx, anvil_module_t *mod, anvil_value_t *guard)
+{
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_block_t *loop = anvil_block_create(func, "loop");
+    anvil_block_t *exit_bb = anvil_block_create(func, "exit");
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_build_br_cond(ctx, guard ? guard : cond(ctx, func), loop, exit_bb);
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *sum = anvil_build_add(ctx, anvil_func_get_param(func, 0), anvil_func_get_param(func, 1), NULL);
+    anvil_value_t *again = anvil_build_add(ctx, anvil_func_get_param(func, 1), anvil_func_get_param(func, 0), NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_ne(ctx, sum, again, NULL), loop, exit_bb);
+    anvil_set_insert_point(ctx, exit_bb);
+    anvil_build_ret(ctx, anvil_const_i32(ctx, 0));
+    return func;
+}
+
+static void test_cache(anvil_ctx_t *ctx)
+{
+    printf("\nCaching:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "cache");
+    anvil_func_t *func = build_guarded_loop(ctx, mod, NULL);
+    anvil_block_t *loop = func->entry->next;
+
+    anvil_domtree_t *dt = anvil_func_domtree(func);
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    CHECK(dt && dt == anvil_func_domtree(func) && li == anvil_func_loops(func) && li->dt == dt,
+          "second request returns the cached analyses");
+    CHECK(anvil_pass_gvn(func) && func->domtree == dt && func->loops == li,
+          "GVN runs on the cached tree and keeps it");
+
+    anvil_block_create(func, "late");
+    CHECK(!func->domtree && !func->loops, "creating a block drops the analyses");
+    li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 1 && func->domtree, "loop nest rebuilt with its tree");
+    anvil_instr_kill(loop->last);
+    CHECK(!func->domtree && !func->loops, "killing a branch drops the analyses");
+    li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 0, "rebuilt nest sees the loop is gone");
+    anvil_module_destroy(mod);
+}
+
+static void test_invalidation(anvil_ctx_t *ctx)
+{
+    printf("\nPasses that edit the CFG:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "simplify");
+    anvil_func_t *func = build_guarded_loop(ctx, mod, anvil_const_i32(ctx, 0));
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 1, "loop before simplify-cfg");
+    anvil_pass_simplify_cfg(func);
+    CHECK(anvil_func_verify_cfg(func), "edge lists match after simplify-cfg");
+    li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 0, "simplify-cfg folds the guard and the loop goes");
+    CHECK(func->domtree && func->domtree->num_blocks == func->num_blocks,
+          "tree left cached by simplify-cfg matches the blocks");
+    anvil_module_destroy(mod);
+
+    /* A custom pass edits a branch in place; the pass manager drops the cache */
+    anvil_pass_manager_t *pm = anvil_pass_manager_create(ctx);
+    anvil_pass_info_t info = { .name = "take-false", .description = "Take false branches",
+                               .run = take_false_branch };
+    anvil_pass_manager_register(pm, &info);
+    anvil_pass_manager_set_pipeline(pm, "take-false");
+    anvil_pass_manager_set_verify(pm, true);
+    mod = anvil_module_create(ctx, "custom");
+    func = build_guarded_loop(ctx, mod, NULL);
+    li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 1, "loop before the custom pass");
+    CHECK(anvil_pass_manager_run_func(pm, func), "custom pass changed the function");
+    li = anvil_func_loops(func);
+    CHECK(li && li->num_loops == 0 && func->domtree->num_blocks == 2,
+          "analyses rebuilt after the custom pass");
+    anvil_module_destroy(mod);
+    anvil_pass_manager_destroy(pm);
+}
+
+/*
+ * Fourteen values computed before a loop and summed after it, with the
+ * loop's counter and accumulator competing for what registers are left
+ */
+static void test_regalloc(anvil_ctx_t *ctx)
+{
+    printf("\nSpill choice (x86-64 O1):\n");
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_module_t *mod = anvil_module_create(ctx, "pressure");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *loop = anvil_block_create(func, "loop");
+    anvil_block_t *done = anvil_block_create(func, "done");
+    anvil_value_t *a = anvil_func_get_param(func, 0);
+    anvil_value_t *b = anvil_func_get_param(func, 1);
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *v[10];
+    for (int k = 0; k < 10; k++) v[k] = anvil_build_mul(ctx, a, anvil_const_i32(ctx, k + 3), NULL);
+    anvil_build_br(ctx, loop);
+
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *i = anvil_build_phi(ctx, i32, "i");
+    anvil_value_t *acc = anvil_build_phi(ctx, i32, "acc");
+    anvil_value_t *next_acc = anvil_build_add(ctx, acc, anvil_build_xor(ctx, i, b, NULL), NULL);
+    anvil_value_t *next_i = anvil_build_add(ctx, i, anvil_const_i32(ctx, 1), NULL);
+    anvil_phi_add_incoming(i, anvil_const_i32(ctx, 0), entry);
+    anvil_phi_add_incoming(i, next_i, loop);
+    anvil_phi_add_incoming(acc, a, entry);
+    anvil_phi_add_incoming(acc, next_acc, loop);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, next_i, b, NULL), loop, done);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_value_t *sum = v[0];
+    for (int k = 1; k < 10; k++) sum = anvil_build_add(ctx, sum, v[k], NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, sum, next_acc, NULL));
+
+    char *out = NULL;
+    size_t len = 0;
+    CHECK(anvil_module_codegen(mod, &out, &len) == ANVIL_OK, "code generated");
+    const char *start = out ? strstr(out, ".Lf_loop:") : NULL;
+    const char *end = start ? strstr(start, ".Lf_done:") : NULL;
+    int in_loop = 0, total = 0;
+    for (const char *p = out; p && (p = strstr(p, "(%rbp)")) != NULL; p++) {
+        total++;
+        if (start && end && p > start && p < end) in_loop++;
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%d frame accesses, %d of them in the loop", total, in_loop);
+    CHECK(start && end && total > 0 && in_loop == 0, msg);
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_NONE);
+}
+
+int main(void)
+{
+    printf("=== Loop Nest Test ===\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    test_nest(ctx);
+    test_shapes(ctx);
+    test_cache(ctx);
+    test_invalidation(ctx);
+    test_regalloc(ctx);
+
+    anvil_ctx_destroy(ctx);
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
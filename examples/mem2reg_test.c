@@ -0,0 +1,671 @@
+/*
+ * ANVIL - Register Promotion Test
+ *
+ * mem2reg turns locals whose address never escapes into SSA values.
+ * Checks the phis it places (at joins and loop headers, and only where
+ * the local is still live), that escaping and oddly typed locals stay in
+ * memory, that reads before any store see zero, and that struct locals
+ * reached through constant struct_gep are split into fields first.
+ * Finally runs loop, swap, struct and escaping kernels through the JIT
+ * with and without promotion against C versions of them, and checks
+ * that the generated code touches the frame much less.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+static size_t count_ops(anvil_func_t *func, anvil_op_t op)
+{
+    size_t n = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == op) n++;
+        }
+    }
+    return n;
+}
+
+static size_t count_block_phis(anvil_block_t *block)
+{
+    size_t n = 0;
+    for (anvil_instr_t *instr = block->first; instr && instr->op == ANVIL_OP_PHI; instr = instr->next) {
+        n++;
+    }
+    return n;
+}
+
+static bool no_memory_ops(anvil_func_t *func)
+{
+    return count_ops(func, ANVIL_OP_ALLOCA) == 0 && count_ops(func, ANVIL_OP_LOAD) == 0 &&
+           count_ops(func, ANVIL_OP_STORE) == 0;
+}
+
+/* mem2reg, then DCE to unlink what it killed */
+static bool promote(anvil_func_t *func)
+{
+    bool changed = anvil_pass_mem2reg(func);
+    anvil_pass_dce(func);
+    return changed;
+}
+
+/*
+ * v = 1; if (x < y) v = 2; return v;
+ */
+static void test_diamond(anvil_ctx_t *ctx)
+{
+    printf("\nDiamond:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "diamond");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *then_bb = anvil_block_create(func, "then");
+    anvil_block_t *join = anvil_block_create(func, "join");
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *v = anvil_build_alloca(ctx, i32, "v");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 1), v);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, anvil_func_get_param(func, 0),
+                                                anvil_func_get_param(func, 1), NULL),
+                        then_bb, join);
+    anvil_set_insert_point(ctx, then_bb);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 2), v);
+    anvil_build_br(ctx, join);
+    anvil_set_insert_point(ctx, join);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, v, NULL));
+
+    CHECK(promote(func), "mem2reg reports a change");
+    CHECK(no_memory_ops(func), "alloca, stores and load are gone");
+    anvil_instr_t *phi = join->first;
+    CHECK(count_ops(func, ANVIL_OP_PHI) == 1 && phi->op == ANVIL_OP_PHI &&
+          phi->num_phi_incoming == 2, "one phi with two incoming values at the join");
+    bool incoming_ok = phi->op == ANVIL_OP_PHI && phi->num_operands == 2;
+    for (size_t i = 0; incoming_ok && i < 2; i++) {
+        int64_t want = phi->phi_blocks[i] == then_bb ? 2 : 1;
+        incoming_ok = phi->operands[i]->kind == ANVIL_VAL_CONST_INT && phi->operands[i]->data.i == want;
+    }
+    CHECK(incoming_ok, "1 comes from the entry, 2 from the then block");
+    CHECK(join->last->op == ANVIL_OP_RET && join->last->operands[0] == phi->result,
+          "the return reads the phi");
+    CHECK(!promote(func), "second run finds nothing");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * i = 0; acc = 0; t;
+ * while (i < x) { t = i * 2; acc += t; i++; }
+ * return acc;
+ */
+static void test_loop(anvil_ctx_t *ctx)
+{
+    printf("\nLoop:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "loop");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+    anvil_value_t *t = anvil_build_alloca(ctx, i32, "t");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), acc);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, anvil_build_load(ctx, i32, i, NULL),
+                                                anvil_func_get_param(func, 0), NULL),
+                        body, done);
+
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_build_store(ctx, anvil_build_mul(ctx, iv, anvil_const_i32(ctx, 2), NULL), t);
+    anvil_value_t *sum = anvil_build_add(ctx, anvil_build_load(ctx, i32, acc, NULL),
+                                         anvil_build_load(ctx, i32, t, NULL), NULL);
+    anvil_build_store(ctx, sum, acc);
+    anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, acc, NULL));
+
+    CHECK(promote(func), "mem2reg reports a change");
+    CHECK(no_memory_ops(func), "all three locals promoted");
+    CHECK(count_block_phis(head) == 2, "phis for i and acc in the loop header");
+    CHECK(count_ops(func, ANVIL_OP_PHI) == 2, "no phi for t, which is dead at the header");
+    CHECK(done->first->op == ANVIL_OP_RET && done->first->operands[0] != NULL &&
+          done->first->operands[0]->data.instr->parent == head,
+          "the exit returns the header's acc");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * v; if (x) v = x; return v;  -- v is read before any store on one path
+ */
+static void test_uninitialized(anvil_ctx_t *ctx)
+{
+    printf("\nReads before any store:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "undef");
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i32p = anvil_type_ptr(ctx, i32);
+    anvil_block_t *then_bb = anvil_block_create(func, "then");
+    anvil_block_t *join = anvil_block_create(func, "join");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *v = anvil_build_alloca(ctx, i32, "v");
+    anvil_value_t *p = anvil_build_alloca(ctx, i32p, "p");
+    anvil_value_t *first = anvil_build_load(ctx, i32p, p, NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_ne(ctx, x, anvil_const_i32(ctx, 0), NULL), then_bb, join);
+    anvil_set_insert_point(ctx, then_bb);
+    anvil_build_store(ctx, x, v);
+    anvil_build_br(ctx, join);
+    anvil_set_insert_point(ctx, join);
+    anvil_value_t *cmp = anvil_build_cmp_eq(ctx, first, anvil_const_null(ctx, i32p), NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, v, NULL),
+                                         anvil_build_zext(ctx, cmp, i32, NULL), NULL));
+
+    promote(func);
+    CHECK(no_memory_ops(func), "both locals promoted");
+    anvil_instr_t *phi = join->first;
+    bool zero = false;
+    for (size_t i = 0; phi->op == ANVIL_OP_PHI && i < phi->num_operands; i++) {
+        if (phi->phi_blocks[i] == anvil_func_get_entry(func)) {
+            zero = phi->operands[i] == anvil_const_i32(ctx, 0);
+        }
+    }
+    CHECK(zero, "the path without a store merges zero");
+    CHECK(cmp->data.instr->operands[0] == anvil_const_null(ctx, i32p),
+          "an unset pointer reads as null");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * Locals that must stay in memory next to one that need not
+ */
+static void test_escaping(anvil_ctx_t *ctx)
+{
+    printf("\nEscaping locals:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "escape");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8 = anvil_type_i8(ctx);
+    anvil_type_t *i32p = anvil_type_ptr(ctx, i32);
+    anvil_func_t *sink = anvil_func_declare(mod, "sink", anvil_type_func(ctx, i32, &i32p, 1, false));
+    anvil_func_t *func = make_func(ctx, mod, "f");
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *passed = anvil_build_alloca(ctx, i32, "passed");
+    anvil_value_t *stored = anvil_build_alloca(ctx, i32, "stored");
+    anvil_value_t *holder = anvil_build_alloca(ctx, i32p, "holder");
+    anvil_value_t *punned = anvil_build_alloca(ctx, i32, "punned");
+    anvil_value_t *plain = anvil_build_alloca(ctx, i32, "plain");
+
+    anvil_build_store(ctx, anvil_func_get_param(func, 0), passed);
+    anvil_value_t *r = anvil_build_call(ctx, i32, anvil_func_get_value(sink), &passed, 1, NULL);
+    anvil_build_store(ctx, stored, holder);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 7), stored);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0x1234), punned);
+    anvil_value_t *low = anvil_build_load(ctx, i8, punned, NULL);
+    anvil_build_store(ctx, r, plain);
+    anvil_value_t *sum = anvil_build_add(ctx, anvil_build_load(ctx, i32, plain, NULL),
+                                         anvil_build_load(ctx, i32, passed, NULL), NULL);
+    sum = anvil_build_add(ctx, sum, anvil_build_sext(ctx, low, i32, NULL), NULL);
+    anvil_value_t *h = anvil_build_load(ctx, i32p, holder, NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, sum, anvil_build_load(ctx, i32, h, NULL), NULL));
+
+    CHECK(promote(func), "mem2reg reports a change");
+    CHECK(anvil_value_num_uses(plain) == 0 && anvil_value_num_uses(holder) == 0,
+          "plain and the pointer holder are promoted");
+    CHECK(anvil_value_num_uses(passed) == 3, "local passed to a call stays in memory");
+    CHECK(anvil_value_num_uses(stored) == 2, "local whose address is stored stays in memory");
+    CHECK(anvil_value_num_uses(punned) == 2, "local read with another type stays in memory");
+    CHECK(count_ops(func, ANVIL_OP_ALLOCA) == 3, "three allocas left");
+    anvil_module_destroy(mod);
+}
+
+/*
+ * struct { i32 a; i64 b; struct { i32 c; i32 d; } in; } s;
+ * s.a = x; s.b = y; s.in.c = x + y; s.in.d = s.a * 3;
+ * return s.a + (i32)s.b + s.in.c + s.in.d;
+ */
+static anvil_value_t *field(anvil_ctx_t *ctx, anvil_type_t *st, anvil_value_t *base, unsigned i)
+{
+    return anvil_build_struct_gep(ctx, st, base, i, NULL);
+}
+
+static void test_struct(anvil_ctx_t *ctx)
+{
+    printf("\nStruct locals:\n");
+    anvil_module_t *mod = anvil_module_create(ctx, "struct");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i64 = anvil_type_i64(ctx);
+    anvil_type_t *in_fields[] = { i32, i32 };
+    anvil_type_t *inner = anvil_type_struct(ctx, "inner", in_fields, 2);
+    anvil_type_t *out_fields[] = { i32, i64, inner };
+    anvil_type_t *outer = anvil_type_struct(ctx, "outer", out_fields, 3);
+    anvil_type_t *outer_p = anvil_type_ptr(ctx, outer);
+    anvil_func_t *sink = anvil_func_declare(mod, "sink", anvil_type_func(ctx, i32, &outer_p, 1, false));
+    anvil_func_t *func = make_func(ctx, mod, "f");
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *s = anvil_build_alloca(ctx, outer, "s");
+    anvil_value_t *kept = anvil_build_alloca(ctx, outer, "kept");
+    anvil_build_store(ctx, x, field(ctx, outer, s, 0));
+    anvil_build_store(ctx, anvil_build_sext(ctx, y, i64, NULL), field(ctx, outer, s, 1));
+    anvil_value_t *in = field(ctx, outer, s, 2);
+    anvil_build_store(ctx, anvil_build_add(ctx, x, y, NULL), field(ctx, inner, in, 0));
+    anvil_value_t *a = anvil_build_load(ctx, i32, field(ctx, outer, s, 0), NULL);
+    anvil_build_store(ctx, anvil_build_mul(ctx, a, anvil_const_i32(ctx, 3), NULL),
+                      field(ctx, inner, field(ctx, outer, s, 2), 1));
+    anvil_value_t *b = anvil_build_load(ctx, i64, field(ctx, outer, s, 1), NULL);
+    anvil_value_t *sum = anvil_build_add(ctx, a, anvil_build_trunc(ctx, b, i32, NULL), NULL);
+    sum = anvil_build_add(ctx, sum, anvil_build_load(ctx, i32, field(ctx, inner, in, 0), NULL), NULL);
+    sum = anvil_build_add(ctx, sum, anvil_build_load(ctx, i32, field(ctx, inner, in, 1), NULL), NULL);
+
+    anvil_build_store(ctx, x, field(ctx, outer, kept, 0));
+    sum = anvil_build_add(ctx, sum, anvil_build_call(ctx, i32, anvil_func_get_value(sink), &kept, 1, NULL), NULL);
+    anvil_build_ret(ctx, sum);
+
+    CHECK(promote(func), "mem2reg reports a change");
+    CHECK(anvil_value_num_uses(s) == 0, "struct reached only through struct_gep is split");
+    CHECK(count_ops(func, ANVIL_OP_ALLOCA) == 1 && anvil_value_num_uses(kept) == 2,
+          "struct passed to a call is kept whole");
+    CHECK(count_ops(func, ANVIL_OP_LOAD) == 0 && count_ops(func, ANVIL_OP_STORE) == 1,
+          "every field of the split struct promoted, nested ones too");
+    CHECK(count_ops(func, ANVIL_OP_STRUCT_GEP) == 1, "only the kept struct's field access is left");
+    anvil_module_destroy(mod);
+}
+
+/* ============================================================================
+ * Execution
+ * ============================================================================ */
+
+#define NUM_KERNELS 32
+
+static int host_bump(int *p)
+{
+    *p += 5;
+    return *p & 3;
+}
+
+static void *resolve(void *user, const char *name)
+{
+    (void)user;
+    return strcmp(name, "host_bump") == 0 ? (void *)host_bump : NULL;
+}
+
+/* acc += i * x (odd i) or acc -= y (even i), i in [0, n) */
+static void build_loop(anvil_ctx_t *ctx, anvil_func_t *func, int k)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *odd = anvil_block_create(func, "odd");
+    anvil_block_t *even = anvil_block_create(func, "even");
+    anvil_block_t *next = anvil_block_create(func, "next");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+    anvil_value_t *n = anvil_build_alloca(ctx, i32, "n");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_build_store(ctx, anvil_const_i32(ctx, k), acc);
+    anvil_build_store(ctx, anvil_build_and(ctx, y, anvil_const_i32(ctx, 15), NULL), n);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, anvil_build_load(ctx, i32, i, NULL),
+                                                anvil_build_load(ctx, i32, n, NULL), NULL),
+                        body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *bit = anvil_build_and(ctx, anvil_build_load(ctx, i32, i, NULL), anvil_const_i32(ctx, 1), NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_ne(ctx, bit, anvil_const_i32(ctx, 0), NULL), odd, even);
+    anvil_set_insert_point(ctx, odd);
+    anvil_value_t *prod = anvil_build_mul(ctx, anvil_build_load(ctx, i32, i, NULL), x, NULL);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, acc, NULL), prod, NULL), acc);
+    anvil_build_br(ctx, next);
+    anvil_set_insert_point(ctx, even);
+    anvil_build_store(ctx, anvil_build_sub(ctx, anvil_build_load(ctx, i32, acc, NULL), y, NULL), acc);
+    anvil_build_br(ctx, next);
+    anvil_set_insert_point(ctx, next);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, i, NULL),
+                                           anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, acc, NULL));
+}
+
+/* a = x; b = y; repeat n times { t = a; a = b; b = t + b * k; } -- the
+ * header's phis read each other on the back edge */
+static void build_swap(anvil_ctx_t *ctx, anvil_func_t *func, int k)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_value_t *a = anvil_build_alloca(ctx, i32, "a");
+    anvil_value_t *b = anvil_build_alloca(ctx, i32, "b");
+    anvil_value_t *t = anvil_build_alloca(ctx, i32, "t");
+    anvil_value_t *n = anvil_build_alloca(ctx, i32, "n");
+    anvil_build_store(ctx, anvil_func_get_param(func, 0), a);
+    anvil_build_store(ctx, anvil_func_get_param(func, 1), b);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 3 + k % 5), n);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_value_t *nv = anvil_build_load(ctx, i32, n, NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_gt(ctx, nv, anvil_const_i32(ctx, 0), NULL), body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, a, NULL), t);
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, b, NULL), a);
+    anvil_value_t *bk = anvil_build_mul(ctx, anvil_build_load(ctx, i32, b, NULL), anvil_const_i32(ctx, k), NULL);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, t, NULL), bk, NULL), b);
+    anvil_build_store(ctx, anvil_build_sub(ctx, anvil_build_load(ctx, i32, n, NULL),
+                                           anvil_const_i32(ctx, 1), NULL), n);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_value_t *r = anvil_build_sub(ctx, anvil_build_load(ctx, i32, a, NULL),
+                                       anvil_build_load(ctx, i32, b, NULL), NULL);
+    anvil_build_ret(ctx, r);
+}
+
+/* struct { i32 lo; i32 hi; } p = { x, y }; while (p.lo < p.hi + k) { p.lo += 3; p.hi -= 1; }
+ * return p.lo * 2 + p.hi; */
+static void build_struct(anvil_ctx_t *ctx, anvil_func_t *func, int k)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *fields[] = { i32, i32 };
+    anvil_type_t *pair = anvil_type_struct(ctx, NULL, fields, 2);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_value_t *p = anvil_build_alloca(ctx, pair, "p");
+    anvil_build_store(ctx, anvil_build_and(ctx, anvil_func_get_param(func, 0), anvil_const_i32(ctx, 255), NULL),
+                      field(ctx, pair, p, 0));
+    anvil_build_store(ctx, anvil_build_and(ctx, anvil_func_get_param(func, 1), anvil_const_i32(ctx, 255), NULL),
+                      field(ctx, pair, p, 1));
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_value_t *lo = anvil_build_load(ctx, i32, field(ctx, pair, p, 0), NULL);
+    anvil_value_t *hi = anvil_build_load(ctx, i32, field(ctx, pair, p, 1), NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, lo, anvil_build_add(ctx, hi, anvil_const_i32(ctx, k), NULL), NULL),
+                        body, done);
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *lp = field(ctx, pair, p, 0);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, lp, NULL), anvil_const_i32(ctx, 3), NULL), lp);
+    anvil_value_t *hp = field(ctx, pair, p, 1);
+    anvil_build_store(ctx, anvil_build_sub(ctx, anvil_build_load(ctx, i32, hp, NULL), anvil_const_i32(ctx, 1), NULL), hp);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_value_t *l2 = anvil_build_mul(ctx, anvil_build_load(ctx, i32, field(ctx, pair, p, 0), NULL),
+                                        anvil_const_i32(ctx, 2), NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, l2, anvil_build_load(ctx, i32, field(ctx, pair, p, 1), NULL), NULL));
+}
+
+/* v = x; c = 0; if (y > k) { c = host_bump(&v); } else if (y < -k) v = y;
+ * return v * 4 + c;  -- v escapes, c does not */
+static void build_escape(anvil_ctx_t *ctx, anvil_func_t *func, anvil_func_t *bump, int k)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_block_t *call_bb = anvil_block_create(func, "call");
+    anvil_block_t *test_bb = anvil_block_create(func, "test");
+    anvil_block_t *neg_bb = anvil_block_create(func, "neg");
+    anvil_block_t *join = anvil_block_create(func, "join");
+
+    anvil_value_t *v = anvil_build_alloca(ctx, i32, "v");
+    anvil_value_t *c = anvil_build_alloca(ctx, i32, "c");
+    anvil_build_store(ctx, anvil_func_get_param(func, 0), v);
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), c);
+    anvil_build_br_cond(ctx, anvil_build_cmp_gt(ctx, y, anvil_const_i32(ctx, k), NULL), call_bb, test_bb);
+    anvil_set_insert_point(ctx, call_bb);
+    anvil_build_store(ctx, anvil_build_call(ctx, i32, anvil_func_get_value(bump), &v, 1, NULL), c);
+    anvil_build_br(ctx, join);
+    anvil_set_insert_point(ctx, test_bb);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, y, anvil_const_i32(ctx, -k), NULL), neg_bb, join);
+    anvil_set_insert_point(ctx, neg_bb);
+    anvil_build_store(ctx, y, v);
+    anvil_build_br(ctx, join);
+    anvil_set_insert_point(ctx, join);
+    anvil_value_t *v4 = anvil_build_mul(ctx, anvil_build_load(ctx, i32, v, NULL), anvil_const_i32(ctx, 4), NULL);
+    anvil_build_ret(ctx, anvil_build_add(ctx, v4, anvil_build_load(ctx, i32, c, NULL), NULL));
+}
+
+static anvil_module_t *build_kernels(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "kernels");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i32p = anvil_type_ptr(ctx, i32);
+    anvil_func_t *bump = anvil_func_declare(mod, "host_bump", anvil_type_func(ctx, i32, &i32p, 1, false));
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = make_func(ctx, mod, name);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+        switch (k % 4) {
+            case 0: build_loop(ctx, func, k); break;
+            case 1: build_swap(ctx, func, k); break;
+            case 2: build_struct(ctx, func, k); break;
+            default: build_escape(ctx, func, bump, k); break;
+        }
+    }
+    return mod;
+}
+
+typedef int (*kernel_fn)(int, int);
+
+/* What each kernel computes, in wrapping 32-bit arithmetic */
+static int reference(int k, int x, int y)
+{
+    uint32_t ux = (uint32_t)x, uy = (uint32_t)y;
+    switch (k % 4) {
+        case 0: {
+            uint32_t acc = (uint32_t)k;
+            for (int i = 0; i < (y & 15); i++) acc = (i & 1) ? acc + (uint32_t)i * ux : acc - uy;
+            return (int)acc;
+        }
+        case 1: {
+            uint32_t a = ux, b = uy;
+            for (int n = 3 + k % 5; n > 0; n--) {
+                uint32_t t = a;
+                a = b;
+                b = t + b * (uint32_t)k;
+            }
+            return (int)(a - b);
+        }
+        case 2: {
+            int lo = x & 255, hi = y & 255;
+            while (lo < hi + k) {
+                lo += 3;
+                hi -= 1;
+            }
+            return lo * 2 + hi;
+        }
+        default: {
+            int v = x, c = 0;
+            if (y > k) c = host_bump(&v);
+            else if (y < -k) v = y;
+            return (int)((uint32_t)v * 4 + (uint32_t)c);
+        }
+    }
+}
+
+static const int inputs[] = { -1000, -37, -2, -1, 0, 1, 2, 3, 9, 15, 64, 1001 };
+#define NUM_INPUTS (sizeof(inputs) / sizeof(inputs[0]))
+
+static anvil_module_t *optimized_kernels(anvil_ctx_t *ctx, anvil_opt_level_t level, const char *pipeline)
+{
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_pass_manager_set_pipeline(anvil_ctx_get_pass_manager(ctx), pipeline);
+    anvil_pass_manager_set_verify(anvil_ctx_get_pass_manager(ctx), true);
+    anvil_module_t *mod = build_kernels(ctx);
+    anvil_module_optimize(mod);
+    return mod;
+}
+
+/* JIT every kernel and count the input pairs that match the reference */
+static void check_kernels(anvil_opt_level_t level, const char *pipeline, const char *what)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *mod = optimized_kernels(ctx, level, pipeline);
+
+    anvil_jit_t *jit = NULL;
+    size_t same = 0, total = NUM_KERNELS * NUM_INPUTS * NUM_INPUTS;
+    if (anvil_module_jit(mod, resolve, NULL, &jit) == ANVIL_OK) {
+        for (int k = 0; k < NUM_KERNELS; k++) {
+            char name[32];
+            snprintf(name, sizeof(name), "f%d", k);
+            kernel_fn fn = (kernel_fn)anvil_jit_get_function(jit, name);
+            for (size_t a = 0; fn && a < NUM_INPUTS; a++) {
+                for (size_t b = 0; b < NUM_INPUTS; b++) {
+                    if (fn(inputs[a], inputs[b]) == reference(k, inputs[a], inputs[b])) same++;
+                }
+            }
+        }
+        anvil_jit_destroy(jit);
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%s: %zu of %zu results match", what, same, total);
+    CHECK(same == total, msg);
+}
+
+/* O2 without mem2reg */
+static const char *without_mem2reg = "const-fold,dce,simplify-cfg,strength-reduce,copy-prop,"
+                                     "dead-store,load-elim,store-load-prop,gvn";
+
+/* The O0 x86_64 emitter keeps one value in flight at a time, so the
+ * register-allocated levels are checked against C instead */
+static void test_execution(void)
+{
+    printf("\nExecution (x86_64 JIT):\n");
+    check_kernels(ANVIL_OPT_BASIC, NULL, "O1");
+    check_kernels(ANVIL_OPT_STANDARD, NULL, "O2");
+    check_kernels(ANVIL_OPT_STANDARD, without_mem2reg, "O2 without mem2reg");
+}
+
+/* Lines of generated code that address the frame */
+static size_t frame_accesses(anvil_opt_level_t level, const char *pipeline, size_t *allocas)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_module_t *mod = optimized_kernels(ctx, level, pipeline);
+    *allocas = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        if (!func->is_declaration) *allocas += count_ops(func, ANVIL_OP_ALLOCA);
+    }
+
+    char *out = NULL;
+    size_t len = 0, n = 0;
+    if (anvil_module_codegen(mod, &out, &len) == ANVIL_OK) {
+        for (const char *p = out; (p = strstr(p, "(%rbp)")) != NULL; p++) n++;
+    }
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+    return n;
+}
+
+static void test_stack_traffic(void)
+{
+    printf("\nStack traffic (x86_64, O2):\n");
+    size_t allocas_with = 0, allocas_without = 0;
+    size_t with = frame_accesses(ANVIL_OPT_STANDARD, NULL, &allocas_with);
+    size_t without = frame_accesses(ANVIL_OPT_STANDARD, without_mem2reg, &allocas_without);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "allocas: %zu with mem2reg, %zu without", allocas_with, allocas_without);
+    /* 3 + 4 + 1 + 2 locals per group of kernels; only the escaping one stays */
+    CHECK(allocas_with == NUM_KERNELS / 4 && allocas_without == 10 * (NUM_KERNELS / 4), msg);
+    snprintf(msg, sizeof(msg), "frame accesses: %zu with mem2reg, %zu without", with, without);
+    CHECK(with * 3 < without, msg);
+}
+
+/* arm64 copies phis one at a time: a phi reading another must see its old value */
+static void test_arm64_swap(void)
+{
+    printf("\nPhi copies on arm64:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_ARM64);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_module_t *mod = anvil_module_create(ctx, "swap");
+    anvil_func_t *func = make_func(ctx, mod, "swap");
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    build_swap(ctx, func, 1);
+    anvil_module_optimize(mod);
+
+    anvil_block_t *head = func->blocks->next;
+    bool reads_phi = false;
+    for (anvil_instr_t *phi = head->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        for (size_t i = 0; i < phi->num_operands; i++) {
+            anvil_value_t *v = phi->operands[i];
+            if (v != phi->result && v->kind == ANVIL_VAL_INSTR && v->data.instr->op == ANVIL_OP_PHI)
+                reads_phi = true;
+        }
+    }
+    CHECK(reads_phi, "promoted swap has a header phi reading another");
+
+    char *out = NULL;
+    size_t len = 0;
+    CHECK(anvil_module_codegen(mod, &out, &len) == ANVIL_OK, "arm64 code generated");
+    CHECK(out && strstr(out, "str x9, [sp, #-16]!") && strstr(out, "ldr x9, [sp], #16"),
+          "back-edge copies read every value before writing");
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_levels(void)
+{
+    printf("\nOptimization levels:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    char buf[256];
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_pass_manager_get_pipeline(pm, buf, sizeof(buf));
+    CHECK(strncmp(buf, "mem2reg,", 8) == 0, "O1 runs mem2reg first");
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_DEBUG);
+    anvil_pass_manager_get_pipeline(pm, buf, sizeof(buf));
+    CHECK(!strstr(buf, "mem2reg"), "Og keeps locals in memory");
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== mem2reg Test ===\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    test_diamond(ctx);
+    test_loop(ctx);
+    test_uninitialized(ctx);
+    test_escaping(ctx);
+    test_struct(ctx);
+    anvil_ctx_destroy(ctx);
+
+    test_execution();
+    test_stack_traffic();
+    test_arm64_swap();
+    test_levels();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
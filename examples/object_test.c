@@ -0,0 +1,321 @@
+/*
+ * ANVIL - Object Output Test
+ *
+ * With ANVIL_OUTPUT_BINARY the x86-64 backend produces a relocatable
+ * ELF64 object instead of assembly text. Walks the object's headers,
+ * symbol table and relocations, checks that every output path (buffer,
+ * sink, file) yields the same bytes, and that other targets report
+ * binary output as unsupported.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_FUNCS 3
+
+/* ELF constants the checks need */
+#define SHT_SYMTAB          2
+#define SHT_RELA            4
+#define STB_GLOBAL          1
+#define STT_OBJECT          1
+#define STT_FUNC            2
+#define R_X86_64_PC32       2
+#define R_X86_64_PLT32      4
+
+static uint64_t rd(const char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | (unsigned char)p[i];
+    return v;
+}
+
+/* View of the sections in an object */
+typedef struct {
+    const char *data;
+    size_t len;
+    uint16_t shnum;
+    uint64_t shoff;
+} elf_t;
+
+static const char *sh_field(const elf_t *e, int idx, int off)
+{
+    return e->data + e->shoff + (uint64_t)idx * 64 + off;
+}
+
+static uint32_t sh_type(const elf_t *e, int idx) { return (uint32_t)rd(sh_field(e, idx, 4), 4); }
+static uint64_t sh_offset(const elf_t *e, int idx) { return rd(sh_field(e, idx, 24), 8); }
+static uint64_t sh_size(const elf_t *e, int idx) { return rd(sh_field(e, idx, 32), 8); }
+static uint32_t sh_link(const elf_t *e, int idx) { return (uint32_t)rd(sh_field(e, idx, 40), 4); }
+static uint32_t sh_info(const elf_t *e, int idx) { return (uint32_t)rd(sh_field(e, idx, 44), 4); }
+
+static const char *sh_name(const elf_t *e, int idx)
+{
+    int shstrndx = (int)rd(e->data + 62, 2);
+    return e->data + sh_offset(e, shstrndx) + rd(sh_field(e, idx, 0), 4);
+}
+
+static int find_section(const elf_t *e, const char *name)
+{
+    for (int i = 1; i < e->shnum; i++) {
+        if (strcmp(sh_name(e, i), name) == 0) return i;
+    }
+    return -1;
+}
+
+/* Symbol index of name in .symtab, or -1; info and shndx receive its fields */
+static int find_symbol(const elf_t *e, const char *name, int *info, int *shndx)
+{
+    int symtab = find_section(e, ".symtab");
+    if (symtab < 0) return -1;
+    const char *strtab = e->data + sh_offset(e, (int)sh_link(e, symtab));
+    int count = (int)(sh_size(e, symtab) / 24);
+    for (int i = 1; i < count; i++) {
+        const char *sym = e->data + sh_offset(e, symtab) + (uint64_t)i * 24;
+        if (strcmp(strtab + rd(sym, 4), name) == 0) {
+            if (info) *info = (unsigned char)sym[4];
+            if (shndx) *shndx = (int)rd(sym + 6, 2);
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* st_value of symbol idx */
+static uint64_t sym_value(const elf_t *e, int idx)
+{
+    int symtab = find_section(e, ".symtab");
+    return rd(e->data + sh_offset(e, symtab) + (uint64_t)idx * 24 + 8, 8);
+}
+
+/* Number of .rela.text entries of the given type against symbol sym */
+static int count_relocs(const elf_t *e, int sym, uint32_t type)
+{
+    int rela = find_section(e, ".rela.text");
+    if (rela < 0) return 0;
+    int n = 0;
+    for (uint64_t off = 0; off < sh_size(e, rela); off += 24) {
+        uint64_t info = rd(e->data + sh_offset(e, rela) + off + 8, 8);
+        if ((int)(info >> 32) == sym && (uint32_t)info == type) n++;
+    }
+    return n;
+}
+
+/* An external global, a string, a branch, an external call and calls
+ * between local functions */
+static anvil_module_t *build_module(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "object");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+    anvil_type_t *params[] = { i32 };
+
+    anvil_value_t *counter = anvil_module_add_global(mod, "counter", i32, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(counter, anvil_const_i32(ctx, 7));
+
+    anvil_type_t *puts_type = anvil_type_func(ctx, i32, &i8p, 1, false);
+    anvil_func_t *puts_fn = anvil_func_declare(mod, "puts", puts_type);
+
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 1, false);
+    anvil_func_t *prev = NULL;
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+        anvil_value_t *args[] = { anvil_const_string(ctx, "hello") };
+        anvil_build_call(ctx, i32, anvil_func_get_value(puts_fn), args, 1, NULL);
+        anvil_value_t *r = anvil_build_mul(ctx, x, anvil_const_i32(ctx, k + 1), NULL);
+        if (prev) {
+            anvil_value_t *call_args[] = { r };
+            r = anvil_build_call(ctx, i32, anvil_func_get_value(prev), call_args, 1, NULL);
+        }
+        anvil_block_t *done = anvil_block_create(func, "done");
+        anvil_build_br(ctx, done);
+        anvil_set_insert_point(ctx, done);
+        anvil_build_ret(ctx, anvil_build_add(ctx, r, anvil_build_load(ctx, i32, counter, NULL), NULL));
+        prev = func;
+    }
+    return mod;
+}
+
+static void check_object(const char *out, size_t len, const char *level)
+{
+    char msg[128];
+    elf_t e = { out, len, 0, 0 };
+    bool header = len >= 64 && memcmp(out, "\177ELF", 4) == 0 && out[4] == 2 && out[5] == 1 &&
+                  rd(out + 16, 2) == 1 && rd(out + 18, 2) == 62;
+    snprintf(msg, sizeof(msg), "%s: ELF64 little-endian ET_REL for x86-64 (%zu bytes)", level, len);
+    CHECK(header, msg);
+    if (!header) return;
+
+    e.shoff = rd(out + 40, 8);
+    e.shnum = (uint16_t)rd(out + 60, 2);
+    snprintf(msg, sizeof(msg), "%s: section headers inside the file", level);
+    CHECK(e.shoff + (uint64_t)e.shnum * 64 == len, msg);
+
+    int text = find_section(&e, ".text");
+    int data = find_section(&e, ".data");
+    int rela = find_section(&e, ".rela.text");
+    int symtab = find_section(&e, ".symtab");
+    snprintf(msg, sizeof(msg), "%s: .text, .data, .rela.text, .symtab, .note.GNU-stack", level);
+    CHECK(text > 0 && data > 0 && rela > 0 && symtab > 0 &&
+          find_section(&e, ".note.GNU-stack") > 0 &&
+          sh_type(&e, rela) == SHT_RELA && sh_info(&e, rela) == (uint32_t)text &&
+          sh_type(&e, symtab) == SHT_SYMTAB, msg);
+    if (text < 0 || data < 0 || rela < 0 || symtab < 0) return;
+
+    /* Every function starts with push %rbp; mov %rsp, %rbp */
+    int info = 0, shndx = 0;
+    bool funcs = true;
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%d", k);
+        int idx = find_symbol(&e, name, &info, &shndx);
+        funcs = funcs && idx > 0 && shndx == text &&
+                info == ((STB_GLOBAL << 4) | STT_FUNC) &&
+                (uint32_t)idx >= sh_info(&e, symtab);
+    }
+    snprintf(msg, sizeof(msg), "%s: f0..f%d are global functions in .text", level, NUM_FUNCS - 1);
+    CHECK(funcs, msg);
+    snprintf(msg, sizeof(msg), "%s: .text starts with the f0 prologue", level);
+    CHECK(sh_size(&e, text) > 4 && memcmp(out + sh_offset(&e, text), "\x55\x48\x89\xe5", 4) == 0, msg);
+
+    int str = find_symbol(&e, ".str0", &info, &shndx);
+    snprintf(msg, sizeof(msg), "%s: the string constant is a local in .data", level);
+    CHECK(str > 0 && shndx == data && (info >> 4) != STB_GLOBAL &&
+          sh_size(&e, data) >= sym_value(&e, str) + 6 &&
+          memcmp(out + sh_offset(&e, data) + sym_value(&e, str), "hello", 6) == 0, msg);
+
+    int var = find_symbol(&e, "counter", &info, &shndx);
+    snprintf(msg, sizeof(msg), "%s: counter is defined in .data from its initializer", level);
+    CHECK(var > 0 && shndx == data && info == ((STB_GLOBAL << 4) | STT_OBJECT) &&
+          sh_size(&e, data) >= sym_value(&e, var) + 4 &&
+          rd(out + sh_offset(&e, data) + sym_value(&e, var), 4) == 7, msg);
+
+    int puts_sym = find_symbol(&e, "puts", &info, &shndx);
+    snprintf(msg, sizeof(msg), "%s: puts is undefined and called through R_X86_64_PLT32", level);
+    CHECK(puts_sym > 0 && shndx == 0 && (info >> 4) == STB_GLOBAL &&
+          count_relocs(&e, puts_sym, R_X86_64_PLT32) == NUM_FUNCS, msg);
+
+    int f0 = find_symbol(&e, "f0", NULL, NULL);
+    snprintf(msg, sizeof(msg), "%s: calls to global f0 go through the PLT", level);
+    CHECK(count_relocs(&e, f0, R_X86_64_PLT32) == 1, msg);
+
+    int counter = find_symbol(&e, "counter", NULL, NULL);
+    snprintf(msg, sizeof(msg), "%s: counter is addressed rip-relative", level);
+    CHECK(count_relocs(&e, counter, R_X86_64_PC32) >= NUM_FUNCS, msg);
+
+    snprintf(msg, sizeof(msg), "%s: assembler-local labels stay out of .symtab", level);
+    CHECK(find_symbol(&e, ".Lf0_done", NULL, NULL) < 0, msg);
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+} sink_t;
+
+static anvil_error_t collect(void *user, const char *data, size_t len)
+{
+    sink_t *s = user;
+    char *grown = realloc(s->data, s->len + len);
+    if (!grown) return ANVIL_ERR_NOMEM;
+    s->data = grown;
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+    return ANVIL_OK;
+}
+
+static void test_object(anvil_opt_level_t level, const char *name)
+{
+    printf("\nObject file at %s:\n", name);
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_ctx_set_output(ctx, ANVIL_OUTPUT_BINARY);
+    anvil_module_t *mod = build_module(ctx);
+
+    char *out = NULL;
+    size_t len = 0;
+    anvil_error_t err = anvil_module_codegen(mod, &out, &len);
+    CHECK(err == ANVIL_OK && out && len > 0, "codegen succeeds");
+    if (err != ANVIL_OK) {
+        printf("    error: %s\n", anvil_ctx_get_error(ctx));
+    } else {
+        check_object(out, len, name);
+
+        /* Same bytes when regenerated, through a sink and through a file */
+        char *again = NULL;
+        size_t again_len = 0;
+        CHECK(anvil_module_codegen(mod, &again, &again_len) == ANVIL_OK && again_len == len &&
+              memcmp(again, out, len) == 0, "regenerated object is identical");
+        free(again);
+
+        sink_t sink = { 0 };
+        CHECK(anvil_module_codegen_to_sink(mod, collect, &sink) == ANVIL_OK && sink.len == len &&
+              memcmp(sink.data, out, len) == 0, "sink receives the same object");
+        free(sink.data);
+
+        const char *path = "object_test.o";
+        bool same = false;
+        if (anvil_module_write(mod, path) == ANVIL_OK) {
+            FILE *f = fopen(path, "rb");
+            char *buf = malloc(len + 1);
+            same = f && buf && fread(buf, 1, len + 1, f) == len && memcmp(buf, out, len) == 0;
+            free(buf);
+            if (f) fclose(f);
+            remove(path);
+        }
+        CHECK(same, "anvil_module_write writes the same object");
+    }
+
+    /* Switching back gives assembly text again */
+    anvil_ctx_set_output(ctx, ANVIL_OUTPUT_ASM);
+    char *text = NULL;
+    size_t text_len = 0;
+    CHECK(anvil_module_codegen(mod, &text, &text_len) == ANVIL_OK && text &&
+          strstr(text, "f0:") != NULL, "ANVIL_OUTPUT_ASM still produces assembly");
+    free(text);
+
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_unsupported(void)
+{
+    printf("\nOther targets:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_ARM64);
+    anvil_ctx_set_output(ctx, ANVIL_OUTPUT_BINARY);
+    anvil_module_t *mod = build_module(ctx);
+
+    char *out = NULL;
+    size_t len = 0;
+    anvil_error_t err = anvil_module_codegen(mod, &out, &len);
+    const char *msg = anvil_ctx_get_error(ctx);
+    CHECK(err == ANVIL_ERR_CODEGEN && !out, "arm64 binary output fails with ANVIL_ERR_CODEGEN");
+    CHECK(msg && strstr(msg, "not supported") != NULL, "error message names the limitation");
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("ANVIL Object Output Test\n");
+    printf("========================\n");
+
+    test_object(ANVIL_OPT_NONE, "O0");
+    test_object(ANVIL_OPT_STANDARD, "O2");
+    test_unsupported();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
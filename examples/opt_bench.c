@@ -0,0 +1,188 @@
+/*
+ * ANVIL - Pass Scheduling Benchmark
+ *
+ * Times O2 on one large function whose code is mostly in final form,
+ * with a small busy region that needs several rounds of the passes to
+ * settle. The pass manager re-runs a pass only when something changed
+ * since its last run, and block-local passes only on the changed blocks;
+ * this is compared with the blind schedule (every O2 pass on every
+ * block, every round, until a round changes nothing), replayed with the
+ * public pass functions. Both must give the same code. Times are wall
+ * clock, best of three, and exclude building the module and codegen.
+ *
+ * Usage: opt_bench [segments] [busy]
+ *   segments: settled if/else diamonds in the function (default: 4000)
+ *   busy:     segments with work for the passes (default: 16)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPEATS 3
+
+typedef bool (*pass_fn)(anvil_func_t *func);
+
+/* The O2 passes in default order */
+static const pass_fn o2_passes[] = {
+    anvil_pass_mem2reg, anvil_pass_const_fold, anvil_pass_dce, anvil_pass_simplify_cfg,
+    anvil_pass_strength_reduce, anvil_pass_copy_prop, anvil_pass_dead_store,
+    anvil_pass_load_elim, anvil_pass_store_load_prop, anvil_pass_gvn, anvil_pass_licm,
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* big(x, y): segments diamonds storing to g, then busy rounds of
+ * mixing through a local with foldable constants and repeated work */
+static anvil_module_t *build_module(anvil_ctx_t *ctx, long segments, long busy, anvil_func_t **out)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "bench");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_func_t *func = anvil_func_create(mod, "big", anvil_type_func(ctx, i32, params, 2, false),
+                                           ANVIL_LINK_EXTERNAL);
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_func_get_param(func, 1);
+    anvil_value_t *g = anvil_module_add_global(mod, "g", i32, ANVIL_LINK_EXTERNAL);
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+    anvil_build_store(ctx, x, acc);
+
+    for (long s = 0; s < segments; s++) {
+        anvil_block_t *then = anvil_block_create(func, "then");
+        anvil_block_t *other = anvil_block_create(func, "else");
+        anvil_block_t *join = anvil_block_create(func, "join");
+        anvil_value_t *t = anvil_build_load(ctx, i32, g, NULL);
+        anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, t, x, NULL), then, other);
+        anvil_set_insert_point(ctx, then);
+        anvil_build_store(ctx, anvil_build_add(ctx, x, anvil_const_i32(ctx, (int)s + 1), NULL), g);
+        anvil_build_br(ctx, join);
+        anvil_set_insert_point(ctx, other);
+        anvil_build_store(ctx, anvil_build_sub(ctx, y, t, NULL), g);
+        anvil_build_br(ctx, join);
+        anvil_set_insert_point(ctx, join);
+    }
+
+    for (long s = 0; s < busy; s++) {
+        anvil_block_t *next = anvil_block_create(func, "busy");
+        anvil_value_t *a = anvil_build_load(ctx, i32, acc, NULL);
+        anvil_value_t *c = anvil_build_mul(ctx, anvil_const_i32(ctx, (int)s + 1), anvil_const_i32(ctx, 4), NULL);
+        anvil_value_t *t1 = anvil_build_mul(ctx, a, c, NULL);
+        anvil_value_t *t2 = anvil_build_mul(ctx, a, c, NULL);
+        a = anvil_build_add(ctx, a, anvil_build_xor(ctx, t1, t2, NULL), NULL);
+        anvil_build_store(ctx, anvil_build_add(ctx, a, anvil_build_load(ctx, i32, g, NULL), NULL), acc);
+        anvil_build_br_cond(ctx, anvil_const_i32(ctx, (int)(s % 2)), next, next);
+        anvil_set_insert_point(ctx, next);
+    }
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, acc, NULL));
+
+    *out = func;
+    return mod;
+}
+
+/* Optimize one fresh module, the blind way or with the pass manager;
+ * returns the time and, if asked, the code and pass statistics */
+static double run(long segments, long busy, bool blind, char **code, size_t *len,
+                  anvil_opt_stats_t *stats, uint64_t *runs, uint64_t *skipped)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    if (stats) anvil_pass_manager_set_stats(pm, true);
+    anvil_func_t *func;
+    anvil_module_t *mod = build_module(ctx, segments, busy, &func);
+
+    double start = now_ms();
+    if (blind) {
+        bool any_changed;
+        int iterations = 0;
+        do {
+            any_changed = false;
+            for (size_t p = 0; p < sizeof(o2_passes) / sizeof(o2_passes[0]); p++) {
+                if (o2_passes[p](func)) any_changed = true;
+            }
+            iterations++;
+        } while (any_changed && iterations < 10);
+    } else {
+        anvil_module_optimize(mod);
+    }
+    double ms = now_ms() - start;
+
+    if (code && anvil_module_codegen(mod, code, len) != ANVIL_OK) *code = NULL;
+    if (stats) {
+        *stats = *anvil_pass_manager_get_stats(pm);
+        size_t count = 0;
+        const anvil_pass_stats_t *ps = anvil_pass_manager_get_pass_stats(pm, &count);
+        *runs = *skipped = 0;
+        for (size_t i = 0; i < count; i++) {
+            *runs += ps[i].runs;
+            *skipped += ps[i].skipped;
+        }
+    }
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+    return ms;
+}
+
+static double best_of(long segments, long busy, bool blind)
+{
+    double best = 0;
+    for (int i = 0; i < REPEATS; i++) {
+        double ms = run(segments, busy, blind, NULL, NULL, NULL, NULL, NULL);
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    long segments = 4000;
+    long busy = 16;
+    if (argc > 1) {
+        segments = atol(argv[1]);
+        if (segments < 0) {
+            fprintf(stderr, "Invalid segment count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+    if (argc > 2) {
+        busy = atol(argv[2]);
+        if (busy < 0) {
+            fprintf(stderr, "Invalid busy count: %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    printf("=== Pass scheduling: %ld settled segments, %ld busy (O2) ===\n", segments, busy);
+
+    char *blind_code = NULL, *code = NULL;
+    size_t blind_len = 0, len = 0;
+    anvil_opt_stats_t stats;
+    uint64_t runs = 0, skipped = 0;
+    run(segments, busy, true, &blind_code, &blind_len, NULL, NULL, NULL);
+    run(segments, busy, false, &code, &len, &stats, &runs, &skipped);
+    bool same = blind_code && code && blind_len == len && memcmp(blind_code, code, len) == 0;
+    free(blind_code);
+    free(code);
+
+    double blind_ms = best_of(segments, busy, true);
+    double ms = best_of(segments, busy, false);
+    printf("%-14s %10s %8s\n", "schedule", "ms", "speedup");
+    printf("%-14s %10.1f %7.2fx\n", "blind", blind_ms, 1.0);
+    printf("%-14s %10.1f %7.2fx\n", "pass manager", ms, ms > 0 ? blind_ms / ms : 0.0);
+    printf("Rounds: %llu, pass runs: %llu, skipped: %llu\n",
+           (unsigned long long)stats.iterations, (unsigned long long)runs,
+           (unsigned long long)skipped);
+    printf("Same code: %s\n", same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
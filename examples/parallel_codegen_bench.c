@@ -0,0 +1,131 @@
+/*
+ * ANVIL - Parallel Codegen Benchmark
+ *
+ * Times x86-64 anvil_module_codegen on a module of many independent
+ * functions while the codegen thread count doubles, ending with one
+ * thread per online CPU. Times are wall clock and exclude building the
+ * module.
+ *
+ * Usage: parallel_codegen_bench [functions] [max_threads]
+ *   functions:   functions in the module (default: 4000)
+ *   max_threads: largest thread count (default: one per online CPU)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STEPS_PER_FUNC 40
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* fk(x, y): STEPS_PER_FUNC rounds of mixing plus a branch per round */
+static anvil_module_t *build_module(anvil_ctx_t *ctx, long num_funcs)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "bench");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+
+    for (long k = 0; k < num_funcs; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%ld", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_value_t *a = anvil_func_get_param(func, 0);
+        anvil_value_t *b = anvil_func_get_param(func, 1);
+        anvil_block_t *block = anvil_func_get_entry(func);
+
+        for (int i = 0; i < STEPS_PER_FUNC; i++) {
+            anvil_set_insert_point(ctx, block);
+            anvil_value_t *t = anvil_build_mul(ctx, a, anvil_const_i32(ctx, i + 3), NULL);
+            a = anvil_build_add(ctx, t, b, NULL);
+            b = anvil_build_xor(ctx, b, anvil_const_i32(ctx, (int)k + i), NULL);
+
+            snprintf(name, sizeof(name), "b%d", i);
+            anvil_block_t *next = anvil_block_create(func, name);
+            anvil_build_br(ctx, next);
+            block = next;
+        }
+        anvil_set_insert_point(ctx, block);
+        anvil_build_ret(ctx, anvil_build_add(ctx, a, b, NULL));
+    }
+    return mod;
+}
+
+int main(int argc, char **argv)
+{
+    long num_funcs = 4000;
+    int max_threads = 0;
+    if (argc > 1) {
+        num_funcs = atol(argv[1]);
+        if (num_funcs <= 0) {
+            fprintf(stderr, "Invalid function count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+    if (argc > 2) {
+        max_threads = atoi(argv[2]);
+        if (max_threads <= 0) {
+            fprintf(stderr, "Invalid thread count: %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    static const struct {
+        anvil_opt_level_t level;
+        const char *name;
+    } levels[] = {
+        { ANVIL_OPT_NONE,     "O0" },
+        { ANVIL_OPT_STANDARD, "O2" },
+    };
+
+    printf("=== Parallel codegen: %ld functions (x86_64) ===\n", num_funcs);
+    printf("%-4s %8s %10s %10s %10s\n", "opt", "threads", "ms", "speedup", "bytes");
+
+    /* 1, 2, 4, ... below max_threads, then max_threads (0 = every CPU) */
+    int counts[16];
+    size_t num_counts = 0;
+    for (int t = 1; t < (max_threads ? max_threads : 16) && num_counts < 15; t *= 2) {
+        counts[num_counts++] = t;
+    }
+    counts[num_counts++] = max_threads;
+
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        double serial_ms = 0;
+        for (size_t c = 0; c < num_counts; c++) {
+            anvil_ctx_t *ctx = anvil_ctx_create();
+            anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+            anvil_ctx_set_opt_level(ctx, levels[l].level);
+            anvil_ctx_set_codegen_threads(ctx, counts[c]);
+            anvil_module_t *mod = build_module(ctx, num_funcs);
+
+            char *out = NULL;
+            size_t len = 0;
+            double start = now_ms();
+            anvil_error_t err = anvil_module_codegen(mod, &out, &len);
+            double ms = now_ms() - start;
+            free(out);
+            anvil_module_destroy(mod);
+            anvil_ctx_destroy(ctx);
+
+            char threads[16];
+            if (counts[c] == 0) snprintf(threads, sizeof(threads), "all");
+            else snprintf(threads, sizeof(threads), "%d", counts[c]);
+            if (err != ANVIL_OK) {
+                printf("%-4s %8s %10s\n", levels[l].name, threads, "failed");
+                break;
+            }
+            if (c == 0) serial_ms = ms;
+            printf("%-4s %8s %10.1f %9.2fx %10zu\n", levels[l].name, threads, ms,
+                   serial_ms / ms, len);
+        }
+    }
+    return 0;
+}
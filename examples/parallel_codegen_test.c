@@ -0,0 +1,192 @@
+/*
+ * ANVIL - Parallel Codegen Test
+ *
+ * With anvil_ctx_set_codegen_threads, x86-64 functions are generated on
+ * worker threads and merged in module order. The output must not depend
+ * on the thread count: checks assembly at O0 and O2 in both syntaxes,
+ * streamed output and object files against the serial result, on a
+ * module large enough to span several batches and with strings shared
+ * between functions.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_FUNCS 300
+
+static const int thread_counts[] = { 2, 3, 8, 0 };
+
+/* fk(x) = x < k ? puts(<string>) + select(x == 1, k, x) : f(k-1)(x - 1)
+ * Strings: one shared by all functions, one per group of five and one
+ * unique to every third function, so first uses interleave */
+static anvil_module_t *build_module(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "parallel");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+    anvil_type_t *puts_type = anvil_type_func(ctx, i32, &i8p, 1, false);
+    anvil_func_t *puts_fn = anvil_func_declare(mod, "puts", puts_type);
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, &i32, 1, false);
+
+    anvil_func_t *prev = NULL;
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_block_t *then_bb = anvil_block_create(func, "then");
+        anvil_block_t *else_bb = anvil_block_create(func, "else");
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+        anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, x, anvil_const_i32(ctx, k), NULL),
+                            then_bb, else_bb);
+
+        anvil_set_insert_point(ctx, then_bb);
+        if (k % 3 == 0) snprintf(name, sizeof(name), "unique %d\n", k);
+        else if (k % 3 == 1) snprintf(name, sizeof(name), "group %d\n", k / 5);
+        else snprintf(name, sizeof(name), "hello\n");
+        anvil_value_t *msg = anvil_const_string(ctx, name);
+        anvil_value_t *r = anvil_build_call(ctx, i32, anvil_func_get_value(puts_fn), &msg, 1, NULL);
+        anvil_value_t *sel = anvil_build_select(ctx,
+            anvil_build_cmp_eq(ctx, x, anvil_const_i32(ctx, 1), NULL),
+            anvil_const_i32(ctx, k), x, NULL);
+        anvil_build_ret(ctx, anvil_build_add(ctx, r, sel, NULL));
+
+        anvil_set_insert_point(ctx, else_bb);
+        if (prev) {
+            anvil_value_t *arg = anvil_build_sub(ctx, x, anvil_const_i32(ctx, 1), NULL);
+            anvil_build_ret(ctx, anvil_build_call(ctx, i32, anvil_func_get_value(prev), &arg, 1, NULL));
+        } else {
+            anvil_build_ret(ctx, x);
+        }
+        prev = func;
+    }
+    return mod;
+}
+
+typedef enum { OUT_BUFFER, OUT_SINK } out_mode_t;
+
+typedef struct {
+    char *data;
+    size_t len;
+} sink_t;
+
+static anvil_error_t collect(void *user, const char *data, size_t len)
+{
+    sink_t *s = user;
+    char *grown = realloc(s->data, s->len + len);
+    if (!grown) return ANVIL_ERR_NOMEM;
+    s->data = grown;
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+    return ANVIL_OK;
+}
+
+/* Generate the module from scratch with the given settings */
+static char *generate(int threads, anvil_opt_level_t level, anvil_syntax_t syntax,
+                      anvil_output_t output, out_mode_t mode, size_t *len)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_ctx_set_syntax(ctx, syntax);
+    anvil_ctx_set_output(ctx, output);
+    anvil_ctx_set_codegen_threads(ctx, threads);
+    anvil_module_t *mod = build_module(ctx);
+
+    char *out = NULL;
+    anvil_error_t err;
+    if (mode == OUT_SINK) {
+        sink_t sink = { 0 };
+        err = anvil_module_codegen_to_sink(mod, collect, &sink);
+        out = sink.data;
+        *len = sink.len;
+    } else {
+        err = anvil_module_codegen(mod, &out, len);
+    }
+    if (err != ANVIL_OK) {
+        free(out);
+        out = NULL;
+    }
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+    return out;
+}
+
+static void check_config(const char *name, anvil_opt_level_t level, anvil_syntax_t syntax,
+                         anvil_output_t output, out_mode_t mode)
+{
+    size_t serial_len = 0;
+    char *serial = generate(1, level, syntax, output, OUT_BUFFER, &serial_len);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s: serial codegen (%zu bytes)", name, serial_len);
+    CHECK(serial != NULL && serial_len > 0, msg);
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        size_t len = 0;
+        char *out = generate(thread_counts[i], level, syntax, output, mode, &len);
+        snprintf(msg, sizeof(msg), "%s: %d threads identical to serial", name, thread_counts[i]);
+        CHECK(serial && out && len == serial_len && memcmp(out, serial, len) == 0, msg);
+        free(out);
+    }
+    free(serial);
+}
+
+static void test_assembly(void)
+{
+    printf("\nAssembly text:\n");
+    check_config("GAS O0", ANVIL_OPT_NONE, ANVIL_SYNTAX_GAS, ANVIL_OUTPUT_ASM, OUT_BUFFER);
+    check_config("GAS O2", ANVIL_OPT_STANDARD, ANVIL_SYNTAX_GAS, ANVIL_OUTPUT_ASM, OUT_BUFFER);
+    check_config("NASM O0", ANVIL_OPT_NONE, ANVIL_SYNTAX_NASM, ANVIL_OUTPUT_ASM, OUT_BUFFER);
+    check_config("NASM O2", ANVIL_OPT_STANDARD, ANVIL_SYNTAX_NASM, ANVIL_OUTPUT_ASM, OUT_BUFFER);
+}
+
+static void test_streamed(void)
+{
+    printf("\nStreamed to a sink:\n");
+    check_config("sink O2", ANVIL_OPT_STANDARD, ANVIL_SYNTAX_GAS, ANVIL_OUTPUT_ASM, OUT_SINK);
+}
+
+static void test_object(void)
+{
+    printf("\nObject files:\n");
+    check_config("object O0", ANVIL_OPT_NONE, ANVIL_SYNTAX_GAS, ANVIL_OUTPUT_BINARY, OUT_BUFFER);
+    check_config("object O2", ANVIL_OPT_STANDARD, ANVIL_SYNTAX_GAS, ANVIL_OUTPUT_BINARY, OUT_BUFFER);
+}
+
+static void test_setting(void)
+{
+    printf("\nSetting:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    CHECK(anvil_ctx_set_codegen_threads(ctx, -1) == ANVIL_ERR_INVALID_ARG,
+          "negative thread count rejected");
+    CHECK(anvil_ctx_set_codegen_threads(NULL, 4) == ANVIL_ERR_INVALID_ARG,
+          "NULL context rejected");
+    CHECK(anvil_ctx_set_codegen_threads(ctx, 0) == ANVIL_OK, "0 (one per CPU) accepted");
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    CHECK(anvil_ctx_set_codegen_threads(ctx, 4) == ANVIL_OK, "x86_64 takes a thread count");
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_ARM64);
+    CHECK(anvil_ctx_set_codegen_threads(ctx, 4) == ANVIL_ERR_CODEGEN,
+          "serial backend reports the thread count has no effect");
+    CHECK(strstr(anvil_ctx_get_error(ctx), "serially") != NULL, "error says codegen is serial");
+    CHECK(anvil_ctx_set_codegen_threads(ctx, 1) == ANVIL_OK, "serial count accepted anywhere");
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== Parallel Codegen Test ===\n");
+
+    test_assembly();
+    test_streamed();
+    test_object();
+    test_setting();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * ANVIL - Parallel Optimization Benchmark
+ *
+ * Times anvil_module_optimize at O2 on a module of many mid-sized
+ * functions while the pass manager's thread count doubles, ending with
+ * one thread per online CPU. Times are wall clock and exclude building
+ * the module and codegen.
+ *
+ * Usage: parallel_opt_bench [functions] [max_threads]
+ *   functions:   functions in the module (default: 2000)
+ *   max_threads: largest thread count (default: one per online CPU)
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define STEPS_PER_FUNC 40
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* fk(x, y): STEPS_PER_FUNC rounds of mixing through locals, with
+ * foldable constants, redundant loads and a branch per round */
+static anvil_module_t *build_module(anvil_ctx_t *ctx, long num_funcs)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "bench");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+
+    for (long k = 0; k < num_funcs; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%ld", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_block_t *block = anvil_func_get_entry(func);
+
+        anvil_set_insert_point(ctx, block);
+        anvil_value_t *a = anvil_build_alloca(ctx, i32, "a");
+        anvil_value_t *b = anvil_build_alloca(ctx, i32, "b");
+        anvil_build_store(ctx, anvil_func_get_param(func, 0), a);
+        anvil_build_store(ctx, anvil_func_get_param(func, 1), b);
+
+        for (int i = 0; i < STEPS_PER_FUNC; i++) {
+            anvil_value_t *c = anvil_build_add(ctx, anvil_const_i32(ctx, i),
+                                               anvil_const_i32(ctx, (int)k), NULL);
+            anvil_value_t *t = anvil_build_mul(ctx, anvil_build_load(ctx, i32, a, NULL), c, NULL);
+            anvil_value_t *u = anvil_build_mul(ctx, anvil_build_load(ctx, i32, a, NULL), c, NULL);
+            anvil_build_store(ctx, anvil_build_add(ctx, t, anvil_build_load(ctx, i32, b, NULL), NULL), a);
+            anvil_build_store(ctx, anvil_build_xor(ctx, u, anvil_const_i32(ctx, 8), NULL), b);
+
+            snprintf(name, sizeof(name), "b%d", i);
+            anvil_block_t *next = anvil_block_create(func, name);
+            anvil_build_br(ctx, next);
+            anvil_set_insert_point(ctx, next);
+        }
+        anvil_build_ret(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, a, NULL),
+                                             anvil_build_load(ctx, i32, b, NULL), NULL));
+    }
+    return mod;
+}
+
+int main(int argc, char **argv)
+{
+    long num_funcs = 2000;
+    int max_threads = 0;
+    if (argc > 1) {
+        num_funcs = atol(argv[1]);
+        if (num_funcs <= 0) {
+            fprintf(stderr, "Invalid function count: %s\n", argv[1]);
+            return 1;
+        }
+    }
+    if (argc > 2) {
+        max_threads = atoi(argv[2]);
+        if (max_threads <= 0) {
+            fprintf(stderr, "Invalid thread count: %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    printf("=== Parallel optimization: %ld functions (O2) ===\n", num_funcs);
+    printf("%8s %10s %10s\n", "threads", "ms", "speedup");
+
+    /* 1, 2, 4, ... below max_threads, then max_threads (0 = every CPU) */
+    int counts[16];
+    size_t num_counts = 0;
+    for (int t = 1; t < (max_threads ? max_threads : 16) && num_counts < 15; t *= 2) {
+        counts[num_counts++] = t;
+    }
+    counts[num_counts++] = max_threads;
+
+    double serial_ms = 0;
+    for (size_t c = 0; c < num_counts; c++) {
+        anvil_ctx_t *ctx = anvil_ctx_create();
+        anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+        anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+        anvil_pass_manager_set_threads(anvil_ctx_get_pass_manager(ctx), counts[c]);
+        anvil_module_t *mod = build_module(ctx, num_funcs);
+
+        double start = now_ms();
+        anvil_error_t err = anvil_module_optimize(mod);
+        double ms = now_ms() - start;
+        anvil_module_destroy(mod);
+        anvil_ctx_destroy(ctx);
+
+        char threads[16];
+        if (counts[c] == 0) snprintf(threads, sizeof(threads), "all");
+        else snprintf(threads, sizeof(threads), "%d", counts[c]);
+        if (err != ANVIL_OK) {
+            printf("%8s %10s\n", threads, "failed");
+            break;
+        }
+        if (c == 0) serial_ms = ms;
+        printf("%8s %10.1f %9.2fx\n", threads, ms, serial_ms / ms);
+    }
+    return 0;
+}
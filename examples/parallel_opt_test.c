@@ -0,0 +1,224 @@
+/*
+ * ANVIL - Parallel Optimization Test
+ *
+ * With anvil_pass_manager_set_threads, anvil_module_optimize runs the
+ * passes of different functions on worker threads. Functions fold new
+ * constants, call each other and share a global and strings, so workers
+ * meet in the context's shared tables. The optimized module must
+ * generate exactly the code of a serial run for every thread count.
+ * Workers take value and block ids from reserved ranges, so ids must
+ * stay unique across the module.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <anvil/anvil_internal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_FUNCS 200
+
+static const int thread_counts[] = { 2, 3, 8, 0 };
+
+/* fk(x): counted loop over a local with foldable constants, a load of a
+ * shared global, a string call and a call to f(k-1); sizes vary with k */
+static anvil_module_t *build_module(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "parallel_opt");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+    anvil_func_t *puts_fn = anvil_func_declare(mod, "puts", anvil_type_func(ctx, i32, &i8p, 1, false));
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, &i32, 1, false);
+    anvil_value_t *scale = anvil_module_add_global(mod, "scale", i32, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(scale, anvil_const_i32(ctx, 3));
+
+    anvil_func_t *prev = NULL;
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_block_t *loop = anvil_block_create(func, "loop");
+        anvil_block_t *body = anvil_block_create(func, "body");
+        anvil_block_t *done = anvil_block_create(func, "done");
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+        anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+        anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+        anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+        anvil_build_store(ctx, x, acc);
+        anvil_build_br(ctx, loop);
+
+        anvil_set_insert_point(ctx, loop);
+        anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+        anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, iv, x, NULL), body, done);
+
+        anvil_set_insert_point(ctx, body);
+        iv = anvil_build_load(ctx, i32, i, NULL);
+        anvil_value_t *a = anvil_build_load(ctx, i32, acc, NULL);
+        for (int s = 0; s < 1 + k % 7; s++) {
+            /* (k + s) * 4 folds to a constant no other function has */
+            anvil_value_t *c = anvil_build_mul(ctx, anvil_const_i32(ctx, k + s),
+                                               anvil_const_i32(ctx, 4), NULL);
+            anvil_value_t *t = anvil_build_mul(ctx, iv, c, NULL);
+            a = anvil_build_add(ctx, a, anvil_build_mul(ctx, t, anvil_const_i32(ctx, 8), NULL), NULL);
+            a = anvil_build_xor(ctx, a, anvil_build_load(ctx, i32, scale, NULL), NULL);
+        }
+        anvil_build_store(ctx, a, acc);
+        anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+        anvil_build_br(ctx, loop);
+
+        anvil_set_insert_point(ctx, done);
+        if (k % 2) snprintf(name, sizeof(name), "odd\n");
+        else snprintf(name, sizeof(name), "f%d\n", k);
+        anvil_value_t *msg = anvil_const_string(ctx, name);
+        anvil_build_call(ctx, i32, anvil_func_get_value(puts_fn), &msg, 1, NULL);
+        anvil_value_t *r = anvil_build_load(ctx, i32, acc, NULL);
+        if (prev) r = anvil_build_add(ctx, r, anvil_build_call(ctx, i32, anvil_func_get_value(prev), &r, 1, NULL), NULL);
+        anvil_build_ret(ctx, r);
+        prev = func;
+    }
+    return mod;
+}
+
+/* Optimize with the given thread count, then generate serially */
+static char *generate(anvil_arch_t arch, anvil_opt_level_t level, int threads, size_t *len)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, arch);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_pass_manager_set_threads(anvil_ctx_get_pass_manager(ctx), threads);
+    anvil_pass_manager_set_verify(anvil_ctx_get_pass_manager(ctx), true);
+    anvil_module_t *mod = build_module(ctx);
+
+    char *out = NULL;
+    anvil_error_t err = anvil_module_optimize(mod);
+    if (err == ANVIL_OK) err = anvil_module_codegen(mod, &out, len);
+    if (err != ANVIL_OK) {
+        free(out);
+        out = NULL;
+    }
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+    return out;
+}
+
+static void check_config(const char *name, anvil_arch_t arch, anvil_opt_level_t level)
+{
+    size_t serial_len = 0;
+    char *serial = generate(arch, level, 1, &serial_len);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%s: serial (%zu bytes)", name, serial_len);
+    CHECK(serial != NULL && serial_len > 0, msg);
+
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        size_t len = 0;
+        char *out = generate(arch, level, thread_counts[i], &len);
+        snprintf(msg, sizeof(msg), "%s: %d threads identical to serial", name, thread_counts[i]);
+        CHECK(serial && out && len == serial_len && memcmp(out, serial, len) == 0, msg);
+        free(out);
+    }
+    free(serial);
+}
+
+static void test_output(void)
+{
+    printf("\nGenerated code after optimization:\n");
+    check_config("x86_64 O1", ANVIL_ARCH_X86_64, ANVIL_OPT_BASIC);
+    check_config("x86_64 O2", ANVIL_ARCH_X86_64, ANVIL_OPT_STANDARD);
+    check_config("arm64 O2", ANVIL_ARCH_ARM64, ANVIL_OPT_STANDARD);
+    check_config("zarch O3", ANVIL_ARCH_ZARCH, ANVIL_OPT_AGGRESSIVE);
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Sort and look for neighbours that match */
+static bool ids_unique(uint32_t *ids, size_t n)
+{
+    qsort(ids, n, sizeof(*ids), cmp_id);
+    for (size_t i = 1; i < n; i++)
+        if (ids[i] == ids[i - 1]) return false;
+    return true;
+}
+
+static void test_ids(void)
+{
+    printf("\nIds after a parallel run:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_AGGRESSIVE);
+    anvil_pass_manager_set_threads(anvil_ctx_get_pass_manager(ctx), 8);
+    anvil_module_t *mod = build_module(ctx);
+    CHECK(anvil_module_optimize(mod) == ANVIL_OK, "optimized with 8 threads");
+
+    size_t num_values = 0, num_blocks = 0;
+    /* Declarations carry a parameter count but no parameter values */
+    for (anvil_func_t *f = mod->funcs; f; f = f->next) {
+        if (f->params) num_values += f->num_params;
+        for (anvil_block_t *b = f->blocks; b; b = b->next) {
+            num_blocks++;
+            for (anvil_instr_t *in = b->first; in; in = in->next)
+                if (in->result) num_values++;
+        }
+    }
+
+    uint32_t *values = malloc((num_values + 1) * sizeof(*values));
+    uint32_t *blocks = malloc((num_blocks + 1) * sizeof(*blocks));
+    size_t nv = 0, nb = 0;
+    for (anvil_func_t *f = mod->funcs; f; f = f->next) {
+        for (size_t i = 0; f->params && i < f->num_params; i++)
+            values[nv++] = f->params[i]->id;
+        for (anvil_block_t *b = f->blocks; b; b = b->next) {
+            blocks[nb++] = b->id;
+            for (anvil_instr_t *in = b->first; in; in = in->next)
+                if (in->result) values[nv++] = in->result->id;
+        }
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%zu value ids unique", nv);
+    CHECK(nv > NUM_FUNCS && ids_unique(values, nv), msg);
+    snprintf(msg, sizeof(msg), "%zu block ids unique", nb);
+    CHECK(nb >= NUM_FUNCS && ids_unique(blocks, nb), msg);
+    CHECK(!ctx->workers && !mod->pool.workers, "workers detached after the run");
+
+    free(values);
+    free(blocks);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_setting(void)
+{
+    printf("\nSetting:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    CHECK(anvil_pass_manager_get_threads(pm) == 1, "serial by default");
+    anvil_pass_manager_set_threads(pm, 4);
+    CHECK(anvil_pass_manager_get_threads(pm) == 4, "thread count set");
+    anvil_pass_manager_set_threads(pm, 0);
+    CHECK(anvil_pass_manager_get_threads(pm) == 0, "0 (one per CPU) accepted");
+    anvil_pass_manager_set_threads(pm, -2);
+    CHECK(anvil_pass_manager_get_threads(pm) == 1, "negative count means serial");
+    CHECK(anvil_pass_manager_get_threads(NULL) == 1, "NULL pass manager is serial");
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== Parallel Optimization Test ===\n");
+
+    test_output();
+    test_ids();
+    test_setting();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * ANVIL - Pass Pipeline Test
+ *
+ * The pass manager only re-runs a pass when the function changed since
+ * its last run, and block-local passes then only look at the blocks that
+ * changed. Checks that this produces exactly the code of the old
+ * schedule (every enabled pass on every block, every round, until a
+ * round changes nothing), replayed here with the public pass functions,
+ * while running fewer passes. Also checks pipeline strings: the default
+ * order per level, custom orders with repeats and custom passes, and
+ * errors.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_FUNCS 40
+
+typedef bool (*pass_fn)(anvil_func_t *func);
+
+typedef struct {
+    const char *name;
+    pass_fn run;
+} named_pass_t;
+
+/* Built-in passes in default order */
+static const named_pass_t all_passes[] = {
+    { "mem2reg",         anvil_pass_mem2reg },
+    { "const-fold",      anvil_pass_const_fold },
+    { "dce",             anvil_pass_dce },
+    { "simplify-cfg",    anvil_pass_simplify_cfg },
+    { "strength-reduce", anvil_pass_strength_reduce },
+    { "copy-prop",       anvil_pass_copy_prop },
+    { "dead-store",      anvil_pass_dead_store },
+    { "load-elim",       anvil_pass_load_elim },
+    { "store-load-prop", anvil_pass_store_load_prop },
+    { "gvn",             anvil_pass_gvn },
+    { "licm",            anvil_pass_licm },
+    { "cse",             anvil_pass_cse },
+    { "loop-unroll",     anvil_pass_loop_unroll },
+};
+
+#define NUM_PASSES 11  /* The O2 passes */
+
+static anvil_func_t *funcs[NUM_FUNCS];
+
+/* Functions mix a counted loop, a constant branch, a diamond with a phi,
+ * redundant loads and arithmetic to fold and reduce, in varying amounts */
+static anvil_module_t *build_module(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "pipeline");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 2, false);
+    anvil_value_t *g = anvil_module_add_global(mod, "g", i32, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(g, anvil_const_i32(ctx, 5));
+
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        funcs[k] = func;
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+        anvil_value_t *y = anvil_func_get_param(func, 1);
+        anvil_block_t *loop = anvil_block_create(func, "loop");
+        anvil_block_t *body = anvil_block_create(func, "body");
+        anvil_block_t *dead = anvil_block_create(func, "dead");
+        anvil_block_t *left = anvil_block_create(func, "left");
+        anvil_block_t *right = anvil_block_create(func, "right");
+        anvil_block_t *join = anvil_block_create(func, "join");
+
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+        anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+        anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+        anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+        anvil_build_store(ctx, anvil_build_add(ctx, x, anvil_const_i32(ctx, 0), NULL), acc);
+        anvil_build_br(ctx, loop);
+
+        anvil_set_insert_point(ctx, loop);
+        anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+        anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, iv, y, NULL), body, left);
+
+        anvil_set_insert_point(ctx, body);
+        iv = anvil_build_load(ctx, i32, i, NULL);
+        anvil_value_t *a = anvil_build_load(ctx, i32, acc, NULL);
+        for (int s = 0; s < 1 + k % 5; s++) {
+            anvil_value_t *c = anvil_build_mul(ctx, anvil_const_i32(ctx, s + 1), anvil_const_i32(ctx, 4), NULL);
+            anvil_value_t *t1 = anvil_build_mul(ctx, iv, c, NULL);
+            anvil_value_t *t2 = anvil_build_mul(ctx, iv, c, NULL);
+            a = anvil_build_add(ctx, a, anvil_build_xor(ctx, t1, t2, NULL), NULL);
+            a = anvil_build_add(ctx, a, anvil_build_load(ctx, i32, g, NULL), NULL);
+        }
+        anvil_build_store(ctx, a, acc);
+        anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+        anvil_build_br_cond(ctx, anvil_const_i32(ctx, k % 2), loop, dead);
+
+        anvil_set_insert_point(ctx, dead);
+        anvil_build_store(ctx, anvil_build_udiv(ctx, a, anvil_const_i32(ctx, 8), NULL), acc);
+        anvil_build_br(ctx, loop);
+
+        anvil_set_insert_point(ctx, left);
+        anvil_value_t *l = anvil_build_load(ctx, i32, acc, NULL);
+        anvil_build_br_cond(ctx, anvil_build_cmp_gt(ctx, l, x, NULL), right, join);
+
+        anvil_set_insert_point(ctx, right);
+        anvil_value_t *r = anvil_build_mul(ctx, l, anvil_const_i32(ctx, 16), NULL);
+        anvil_build_br(ctx, join);
+
+        anvil_set_insert_point(ctx, join);
+        anvil_value_t *phi = anvil_build_phi(ctx, i32, "p");
+        anvil_phi_add_incoming(phi, l, left);
+        anvil_phi_add_incoming(phi, r, right);
+        anvil_build_ret(ctx, anvil_build_add(ctx, phi, anvil_build_load(ctx, i32, acc, NULL), NULL));
+    }
+    return mod;
+}
+
+static char *codegen(anvil_module_t *mod, size_t *len)
+{
+    char *out = NULL;
+    if (anvil_module_codegen(mod, &out, len) != ANVIL_OK) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+/* The old schedule: every pass, every round, until a round changes nothing */
+static char *reference(anvil_opt_level_t level, const named_pass_t *passes, size_t num_passes,
+                       size_t *len, unsigned long *runs)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_module_t *mod = build_module(ctx);
+
+    *runs = 0;
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        bool any_changed;
+        int iterations = 0;
+        do {
+            any_changed = false;
+            for (size_t p = 0; p < num_passes; p++) {
+                (*runs)++;
+                if (passes[p].run(funcs[k])) any_changed = true;
+            }
+            iterations++;
+        } while (any_changed && iterations < 10);
+    }
+
+    char *out = codegen(mod, len);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+    return out;
+}
+
+/* The pass manager at level with an optional pipeline */
+static char *managed(anvil_opt_level_t level, const char *pipeline, size_t *len, unsigned long *runs)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, level);
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    anvil_pass_manager_set_stats(pm, true);
+    anvil_pass_manager_set_verify(pm, true);
+    char *out = NULL;
+    if (anvil_pass_manager_set_pipeline(pm, pipeline) == ANVIL_OK) {
+        anvil_module_t *mod = build_module(ctx);
+        anvil_module_optimize(mod);
+        out = codegen(mod, len);
+        anvil_module_destroy(mod);
+    }
+
+    size_t count = 0;
+    const anvil_pass_stats_t *stats = anvil_pass_manager_get_pass_stats(pm, &count);
+    *runs = 0;
+    for (size_t i = 0; i < count; i++) *runs += stats[i].runs;
+    anvil_ctx_destroy(ctx);
+    return out;
+}
+
+/* A pass is skipped only when nothing changed since its last run, so a
+ * pipeline whose every round changes something saves no runs */
+static void check_same(const char *what, anvil_opt_level_t level, const char *pipeline,
+                       const named_pass_t *passes, size_t num_passes, bool fewer)
+{
+    size_t ref_len = 0, len = 0;
+    unsigned long ref_runs, runs;
+    char *ref = reference(level, passes, num_passes, &ref_len, &ref_runs);
+    char *out = managed(level, pipeline, &len, &runs);
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s: identical to running every pass every round", what);
+    CHECK(ref && out && len == ref_len && memcmp(ref, out, len) == 0, msg);
+    snprintf(msg, sizeof(msg), "%s: %lu pass runs instead of %lu", what, runs, ref_runs);
+    CHECK(fewer ? runs < ref_runs : runs <= ref_runs, msg);
+    free(ref);
+    free(out);
+}
+
+static void test_change_driven(void)
+{
+    printf("\nRunning passes on what changed since their last run:\n");
+    check_same("O2 default", ANVIL_OPT_STANDARD, NULL, all_passes, NUM_PASSES, true);
+
+    const named_pass_t o3[] = {
+        all_passes[0], all_passes[1], all_passes[2], all_passes[3], all_passes[4], all_passes[5],
+        all_passes[6], all_passes[7], all_passes[8], all_passes[12], all_passes[9], all_passes[10],
+    };
+    check_same("O3 default", ANVIL_OPT_AGGRESSIVE, NULL, o3, sizeof(o3) / sizeof(o3[0]), true);
+
+    const named_pass_t unrolled[] = {
+        all_passes[0], all_passes[1], all_passes[3], all_passes[12], all_passes[11],
+        all_passes[5], all_passes[2], all_passes[9],
+    };
+    check_same("with loop-unroll", ANVIL_OPT_STANDARD,
+               "mem2reg,const-fold,simplify-cfg,loop-unroll,cse,copy-prop,dce,gvn",
+               unrolled, sizeof(unrolled) / sizeof(unrolled[0]), true);
+
+    const named_pass_t reordered[] = {
+        all_passes[9], all_passes[2], all_passes[3], all_passes[1], all_passes[8],
+        all_passes[2], all_passes[4],
+    };
+    check_same("custom order", ANVIL_OPT_STANDARD, "gvn,dce,simplify-cfg,const-fold,store-load-prop,dce,strength-reduce",
+               reordered, sizeof(reordered) / sizeof(reordered[0]), false);
+}
+
+static void check_pipeline(anvil_pass_manager_t *pm, const char *expected, const char *msg)
+{
+    char buf[256];
+    size_t len = anvil_pass_manager_get_pipeline(pm, buf, sizeof(buf));
+    CHECK(len == strlen(expected) && strcmp(buf, expected) == 0, msg);
+    if (strcmp(buf, expected) != 0) printf("    got \"%s\"\n", buf);
+}
+
+static int custom_runs = 0;
+
+static bool custom_pass(anvil_func_t *func)
+{
+    (void)func;
+    custom_runs++;
+    return false;
+}
+
+static void test_pipeline_strings(void)
+{
+    printf("\nPipeline strings:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    check_pipeline(pm, "mem2reg,const-fold,dce,copy-prop,store-load-prop", "O1 default order");
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+    check_pipeline(pm, "mem2reg,const-fold,dce,simplify-cfg,strength-reduce,copy-prop,dead-store,"
+                       "load-elim,store-load-prop,gvn,licm", "O2 default order");
+
+    CHECK(anvil_pass_manager_set_pipeline(pm, " dce , const-fold,dce") == ANVIL_OK,
+          "pipeline with spaces and a repeat accepted");
+    check_pipeline(pm, "dce,const-fold,dce", "pipeline read back");
+
+    CHECK(anvil_pass_manager_set_pipeline(pm, "dce,no-such-pass") == ANVIL_ERR_INVALID_ARG,
+          "unknown pass rejected");
+    const char *err = anvil_ctx_get_error(ctx);
+    CHECK(err && strstr(err, "no-such-pass"), "error names the pass");
+    CHECK(anvil_pass_manager_set_pipeline(pm, "dce,,cse") == ANVIL_ERR_INVALID_ARG,
+          "empty entry rejected");
+    check_pipeline(pm, "dce,const-fold,dce", "failed set keeps the previous pipeline");
+
+    anvil_pass_manager_disable(pm, ANVIL_PASS_DCE);
+    check_pipeline(pm, "const-fold", "disabled passes are skipped");
+    anvil_pass_manager_enable(pm, ANVIL_PASS_DCE);
+
+    anvil_pass_info_t info = { .name = "counter", .description = "Counts runs", .run = custom_pass };
+    anvil_pass_manager_register(pm, &info);
+    check_pipeline(pm, "dce,const-fold,dce", "custom pass not listed does not run");
+    CHECK(anvil_pass_manager_set_pipeline(pm, "counter,dce") == ANVIL_OK, "custom pass by name");
+    check_pipeline(pm, "counter,dce", "custom pass in pipeline");
+
+    anvil_module_t *mod = build_module(ctx);
+    anvil_module_optimize(mod);
+    anvil_module_destroy(mod);
+    CHECK(custom_runs >= NUM_FUNCS, "custom pass ran from the pipeline");
+
+    CHECK(anvil_pass_manager_set_pipeline(pm, NULL) == ANVIL_OK, "NULL restores the default");
+    check_pipeline(pm, "mem2reg,const-fold,dce,simplify-cfg,strength-reduce,copy-prop,dead-store,"
+                       "load-elim,store-load-prop,gvn,licm,counter", "default order with custom pass last");
+
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_DEBUG);
+    anvil_pass_manager_set_pipeline(pm, "cse");
+    check_pipeline(pm, "cse", "listed pass runs below its level");
+
+    char small[4];
+    size_t len = anvil_pass_manager_get_pipeline(pm, small, sizeof(small));
+    CHECK(len == 3 && strcmp(small, "cse") == 0, "exact-fit buffer");
+    anvil_pass_manager_set_pipeline(pm, "const-fold,dce");
+    len = anvil_pass_manager_get_pipeline(pm, small, sizeof(small));
+    CHECK(len == 14 && strcmp(small, "con") == 0, "short buffer truncated, full length returned");
+    CHECK(anvil_pass_manager_get_pipeline(pm, NULL, 0) == 14, "NULL buffer returns the length");
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== Pass Pipeline Test ===\n");
+
+    test_change_driven();
+    test_pipeline_strings();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
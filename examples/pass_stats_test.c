@@ -0,0 +1,229 @@
+/*
+ * ANVIL - Pass Statistics Test
+ *
+ * anvil_pass_manager_set_stats records per-pass time, runs and
+ * instruction changes plus per-run totals. Checks that the counts add up
+ * (instructions removed minus added equals the net shrink), that known
+ * rewrites are charged to the right pass, that custom passes get a row,
+ * that a parallel run reports the same counts as a serial one, and the
+ * printed report.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_FUNCS 24
+
+/* fk(x) = ((2 + 3) * x) * 8 + (x - x) + k through a local: const-fold
+ * folds 2 + 3, strength-reduce turns * 8 into a shift and mem2reg
+ * replaces the local's store and load by the stored value */
+static anvil_module_t *build_module(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "stats");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, &i32, 1, false);
+    anvil_func_declare(mod, "ext", func_type);
+
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+        anvil_value_t *tmp = anvil_build_alloca(ctx, i32, "tmp");
+        anvil_value_t *c = anvil_build_add(ctx, anvil_const_i32(ctx, 2), anvil_const_i32(ctx, 3), NULL);
+        anvil_build_store(ctx, anvil_build_mul(ctx, c, x, NULL), tmp);
+        anvil_value_t *v = anvil_build_mul(ctx, anvil_build_load(ctx, i32, tmp, NULL),
+                                           anvil_const_i32(ctx, 8), NULL);
+        for (int i = 0; i < k % 4; i++) {
+            v = anvil_build_add(ctx, v, anvil_build_sub(ctx, x, x, NULL), NULL);
+        }
+        anvil_build_ret(ctx, anvil_build_add(ctx, v, anvil_const_i32(ctx, k), NULL));
+    }
+    return mod;
+}
+
+static int custom_calls = 0;
+
+static bool count_pass(anvil_func_t *func)
+{
+    (void)func;
+    custom_calls++;
+    return false;
+}
+
+static const anvil_pass_stats_t *find_pass(anvil_pass_manager_t *pm, const char *name)
+{
+    size_t count = 0;
+    const anvil_pass_stats_t *stats = anvil_pass_manager_get_pass_stats(pm, &count);
+    for (size_t i = 0; i < count; i++) {
+        if (stats[i].name && strcmp(stats[i].name, name) == 0) return &stats[i];
+    }
+    return NULL;
+}
+
+/* Optimize a fresh module; the caller reads the statistics from *pm_out */
+static anvil_ctx_t *optimize(int threads, bool stats, anvil_pass_manager_t **pm_out)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_STANDARD);
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    anvil_pass_manager_set_threads(pm, threads);
+    anvil_pass_manager_set_stats(pm, stats);
+
+    anvil_module_t *mod = build_module(ctx);
+    anvil_module_optimize(mod);
+    anvil_module_destroy(mod);
+    *pm_out = pm;
+    return ctx;
+}
+
+static void test_totals(void)
+{
+    printf("\nTotals:\n");
+    anvil_pass_manager_t *pm;
+    anvil_ctx_t *ctx = optimize(1, true, &pm);
+    const anvil_opt_stats_t *st = anvil_pass_manager_get_stats(pm);
+
+    CHECK(st->funcs == NUM_FUNCS, "every function body counted, declarations skipped");
+    CHECK(st->iterations >= NUM_FUNCS && st->max_iterations >= 2 && st->max_iterations <= 10,
+          "iterations to fixpoint recorded");
+    CHECK(st->instrs_after < st->instrs_before, "IR shrank");
+    CHECK(st->peak_instrs >= 13, "peak covers the largest function");
+
+    size_t count = 0;
+    const anvil_pass_stats_t *passes = anvil_pass_manager_get_pass_stats(pm, &count);
+    uint64_t removed = 0, added = 0;
+    double time_ms = 0;
+    for (size_t i = 0; i < count; i++) {
+        removed += passes[i].instrs_removed;
+        added += passes[i].instrs_added;
+        time_ms += passes[i].time_ms;
+    }
+    CHECK(count == ANVIL_PASS_COUNT, "one entry per built-in pass");
+    CHECK(removed - added == st->instrs_before - st->instrs_after,
+          "removed minus added equals the net shrink");
+    CHECK(time_ms > 0 && time_ms <= st->time_ms * 1.0001 + 1e-9, "pass times add up to the total");
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_per_pass(void)
+{
+    printf("\nPer pass:\n");
+    anvil_pass_manager_t *pm;
+    anvil_ctx_t *ctx = optimize(1, true, &pm);
+
+    const anvil_pass_stats_t *fold = find_pass(pm, "const-fold");
+    const anvil_pass_stats_t *sr = find_pass(pm, "strength-reduce");
+    const anvil_pass_stats_t *m2r = find_pass(pm, "mem2reg");
+    const anvil_pass_stats_t *unroll = find_pass(pm, "loop-unroll");
+    CHECK(fold && fold->runs >= NUM_FUNCS && fold->changed >= NUM_FUNCS, "const-fold ran and changed");
+    CHECK(fold && fold->instrs_rewritten + fold->instrs_removed >= NUM_FUNCS,
+          "const-fold charged for the folded add");
+    CHECK(sr && sr->instrs_rewritten >= NUM_FUNCS, "strength-reduce charged for mul -> shl");
+    CHECK(m2r && m2r->instrs_removed >= 3 * NUM_FUNCS, "mem2reg charged for the promoted local");
+    CHECK(unroll && unroll->runs == 0, "passes that never ran stay zero");
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_custom(void)
+{
+    printf("\nCustom passes:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_opt_level(ctx, ANVIL_OPT_BASIC);
+    anvil_pass_manager_t *pm = anvil_ctx_get_pass_manager(ctx);
+    anvil_pass_manager_set_stats(pm, true);
+    anvil_pass_info_t info = { .name = "counter", .description = "Counts calls", .run = count_pass };
+    for (int i = 0; i < 5; i++) anvil_pass_manager_register(pm, &info);
+
+    anvil_module_t *mod = build_module(ctx);
+    anvil_module_optimize(mod);
+    anvil_module_destroy(mod);
+
+    size_t count = 0;
+    const anvil_pass_stats_t *passes = anvil_pass_manager_get_pass_stats(pm, &count);
+    uint64_t runs = 0;
+    for (size_t i = ANVIL_PASS_COUNT; i < count; i++) runs += passes[i].runs;
+    CHECK(count == ANVIL_PASS_COUNT + 5, "one entry per registered pass");
+    CHECK(passes[ANVIL_PASS_COUNT].name && strcmp(passes[ANVIL_PASS_COUNT].name, "counter") == 0,
+          "custom entry carries the pass name");
+    CHECK(runs == (uint64_t)custom_calls && runs > 0, "custom runs counted");
+    CHECK(passes[ANVIL_PASS_COUNT].changed == 0, "custom pass reported no change");
+
+    anvil_pass_manager_reset_stats(pm);
+    passes = anvil_pass_manager_get_pass_stats(pm, &count);
+    CHECK(anvil_pass_manager_get_stats(pm)->funcs == 0 && passes[ANVIL_PASS_COUNT].runs == 0 &&
+          strcmp(passes[ANVIL_PASS_COUNT].name, "counter") == 0, "reset clears counts, keeps names");
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_parallel(void)
+{
+    printf("\nParallel run:\n");
+    anvil_pass_manager_t *serial_pm, *par_pm;
+    anvil_ctx_t *serial = optimize(1, true, &serial_pm);
+    anvil_ctx_t *par = optimize(4, true, &par_pm);
+    const anvil_opt_stats_t *a = anvil_pass_manager_get_stats(serial_pm);
+    const anvil_opt_stats_t *b = anvil_pass_manager_get_stats(par_pm);
+    CHECK(a->funcs == b->funcs && a->iterations == b->iterations &&
+          a->instrs_before == b->instrs_before && a->instrs_after == b->instrs_after &&
+          a->peak_instrs == b->peak_instrs, "totals match serial");
+
+    size_t count = 0;
+    const anvil_pass_stats_t *x = anvil_pass_manager_get_pass_stats(serial_pm, &count);
+    const anvil_pass_stats_t *y = anvil_pass_manager_get_pass_stats(par_pm, NULL);
+    int same = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (x[i].runs != y[i].runs || x[i].changed != y[i].changed ||
+            x[i].instrs_removed != y[i].instrs_removed || x[i].instrs_added != y[i].instrs_added ||
+            x[i].instrs_rewritten != y[i].instrs_rewritten) same = 0;
+    }
+    CHECK(same, "per-pass counts match serial");
+    anvil_ctx_destroy(serial);
+    anvil_ctx_destroy(par);
+}
+
+static void test_disabled_and_report(void)
+{
+    printf("\nDisabled and report:\n");
+    anvil_pass_manager_t *pm;
+    anvil_ctx_t *ctx = optimize(1, false, &pm);
+    CHECK(anvil_pass_manager_get_stats(pm)->funcs == 0, "nothing recorded by default");
+    anvil_ctx_destroy(ctx);
+
+    ctx = optimize(1, true, &pm);
+    FILE *f = tmpfile();
+    char buf[4096] = { 0 };
+    if (f) {
+        anvil_pass_manager_print_stats(pm, f);
+        rewind(f);
+        buf[fread(buf, 1, sizeof(buf) - 1, f)] = '\0';
+        fclose(f);
+    }
+    CHECK(strstr(buf, "ANVIL pass statistics") && strstr(buf, "Functions: 24"),
+          "report has the totals");
+    CHECK(strstr(buf, "const-fold") && strstr(buf, "Rewritten") && !strstr(buf, "loop-unroll"),
+          "report lists the passes that ran");
+    printf("%s", buf);
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== Pass Statistics Test ===\n");
+
+    test_totals();
+    test_per_pass();
+    test_custom();
+    test_parallel();
+    test_disabled_and_report();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
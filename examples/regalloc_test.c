@@ -0,0 +1,245 @@
+/*
+ * ANVIL - x86-64 Register Allocation Test
+ *
+ * At O1 and above the x86-64 backend assigns SSA values to registers with
+ * a linear-scan allocator instead of routing every value through the
+ * stack. Checks the generated assembly: leaf functions need no frame
+ * slots, values live across calls land in callee-saved registers, high
+ * register pressure falls back to spill slots, and a constant stored to
+ * an array slot is as wide as the constant.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+/* Loads and stores through %rbp; the epilogue's leaq does not count */
+static int frame_accesses(const char *out)
+{
+    int count = 0;
+    char line[256];
+    while (*out) {
+        size_t len = strcspn(out, "\n");
+        size_t n = len < sizeof(line) - 1 ? len : sizeof(line) - 1;
+        memcpy(line, out, n);
+        line[n] = '\0';
+        if (strstr(line, "(%rbp)") && !strstr(line, "leaq"))
+            count++;
+        out += len;
+        if (*out)
+            out++;
+    }
+    return count;
+}
+
+static char *codegen(anvil_ctx_t *ctx, anvil_module_t *mod, anvil_opt_level_t level)
+{
+    char *output = NULL;
+    size_t len = 0;
+
+    anvil_ctx_set_opt_level(ctx, level);
+    if (anvil_module_codegen(mod, &output, &len) != ANVIL_OK)
+        return NULL;
+    return output;
+}
+
+/* int leaf(int a, int b, int c) { return (a + b) * (c - a) ^ b; } */
+static void test_leaf(anvil_ctx_t *ctx)
+{
+    printf("\nTest 1: leaf function stays in registers\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "leaf");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32, i32 };
+    anvil_func_t *func = anvil_func_create(mod, "leaf",
+        anvil_type_func(ctx, i32, params, 3, false), ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *a = anvil_func_get_param(func, 0);
+    anvil_value_t *b = anvil_func_get_param(func, 1);
+    anvil_value_t *c = anvil_func_get_param(func, 2);
+    anvil_value_t *s = anvil_build_add(ctx, a, b, "s");
+    anvil_value_t *d = anvil_build_sub(ctx, c, a, "d");
+    anvil_value_t *m = anvil_build_mul(ctx, s, d, "m");
+    anvil_build_ret(ctx, anvil_build_xor(ctx, m, b, "r"));
+
+    char *out = codegen(ctx, mod, ANVIL_OPT_STANDARD);
+    CHECK(out != NULL, "codegen succeeds");
+    if (out) {
+        CHECK(frame_accesses(out) == 0, "no frame slots are used");
+        CHECK(strstr(out, "pushq %rbx") == NULL, "no callee-saved registers are saved");
+        CHECK(strstr(out, "subq $") == NULL, "no stack frame is allocated");
+    }
+    free(out);
+    anvil_module_destroy(mod);
+}
+
+/* long keep(long x) { long y = x * 3; ext(); return x + y; } */
+static void test_across_call(anvil_ctx_t *ctx)
+{
+    printf("\nTest 2: values live across a call\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "keep");
+    anvil_type_t *i64 = anvil_type_i64(ctx);
+    anvil_type_t *params[] = { i64 };
+    anvil_type_t *ext_type = anvil_type_func(ctx, anvil_type_void(ctx), NULL, 0, false);
+    anvil_func_t *ext = anvil_func_declare(mod, "ext", ext_type);
+    anvil_func_t *func = anvil_func_create(mod, "keep",
+        anvil_type_func(ctx, i64, params, 1, false), ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *x = anvil_func_get_param(func, 0);
+    anvil_value_t *y = anvil_build_mul(ctx, x, anvil_const_i64(ctx, 3), "y");
+    anvil_build_call(ctx, ext_type, anvil_func_get_value(ext), NULL, 0, "");
+    anvil_build_ret(ctx, anvil_build_add(ctx, x, y, "r"));
+
+    char *out = codegen(ctx, mod, ANVIL_OPT_STANDARD);
+    CHECK(out != NULL, "codegen succeeds");
+    if (out) {
+        CHECK(strstr(out, "pushq %rbx") && strstr(out, "popq %rbx"),
+              "rbx is saved and restored");
+        CHECK(strstr(out, "pushq %r13") == NULL, "unused callee-saved registers are not saved");
+        CHECK(frame_accesses(out) == 0, "nothing is spilled");
+    }
+    free(out);
+    anvil_module_destroy(mod);
+}
+
+/* 20 values p+i all live until the final sum */
+static void test_pressure(anvil_ctx_t *ctx)
+{
+    printf("\nTest 3: register pressure spills\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "pressure");
+    anvil_type_t *i64 = anvil_type_i64(ctx);
+    anvil_type_t *params[] = { i64 };
+    anvil_func_t *func = anvil_func_create(mod, "pressure",
+        anvil_type_func(ctx, i64, params, 1, false), ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *p = anvil_func_get_param(func, 0);
+    anvil_value_t *vals[20];
+    for (int i = 0; i < 20; i++)
+        vals[i] = anvil_build_mul(ctx, p, anvil_const_i64(ctx, i + 2), NULL);
+    anvil_value_t *sum = vals[0];
+    for (int i = 1; i < 20; i++)
+        sum = anvil_build_add(ctx, sum, vals[i], NULL);
+    anvil_build_ret(ctx, sum);
+
+    char *out = codegen(ctx, mod, ANVIL_OPT_STANDARD);
+    CHECK(out != NULL, "codegen succeeds");
+    if (out) {
+        CHECK(frame_accesses(out) > 0, "excess values are spilled to the frame");
+        CHECK(strstr(out, "pushq %r15") != NULL, "all callee-saved registers are in use");
+    }
+    free(out);
+    anvil_module_destroy(mod);
+}
+
+/*
+ * long fib(long n) {
+ *     long a = 0, b = 1;
+ *     while (n != 0) { long t = a + b; a = b; b = t; n = n - 1; }
+ *     return a;
+ * }
+ */
+static void test_loop_phis(anvil_ctx_t *ctx)
+{
+    printf("\nTest 4: loop-carried phis\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "fib");
+    anvil_type_t *i64 = anvil_type_i64(ctx);
+    anvil_type_t *params[] = { i64 };
+    anvil_func_t *func = anvil_func_create(mod, "fib",
+        anvil_type_func(ctx, i64, params, 1, false), ANVIL_LINK_EXTERNAL);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *loop = anvil_block_create(func, "loop");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, loop);
+
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *n = anvil_build_phi(ctx, i64, "n");
+    anvil_value_t *a = anvil_build_phi(ctx, i64, "a");
+    anvil_value_t *b = anvil_build_phi(ctx, i64, "b");
+    anvil_value_t *cond = anvil_build_cmp_ne(ctx, n, anvil_const_i64(ctx, 0), "c");
+    anvil_build_br_cond(ctx, cond, body, done);
+
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *t = anvil_build_add(ctx, a, b, "t");
+    anvil_value_t *n1 = anvil_build_sub(ctx, n, anvil_const_i64(ctx, 1), "n1");
+    anvil_build_br(ctx, loop);
+
+    anvil_phi_add_incoming(n, anvil_func_get_param(func, 0), entry);
+    anvil_phi_add_incoming(n, n1, body);
+    anvil_phi_add_incoming(a, anvil_const_i64(ctx, 0), entry);
+    anvil_phi_add_incoming(a, b, body);
+    anvil_phi_add_incoming(b, anvil_const_i64(ctx, 1), entry);
+    anvil_phi_add_incoming(b, t, body);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_ret(ctx, a);
+
+    char *out = codegen(ctx, mod, ANVIL_OPT_STANDARD);
+    CHECK(out != NULL, "codegen succeeds");
+    if (out) {
+        CHECK(frame_accesses(out) == 0, "phis stay in registers");
+        CHECK(strstr(out, "set") == NULL, "comparison is fused into the branch");
+    }
+    free(out);
+    anvil_module_destroy(mod);
+}
+
+/* char first(void) { char s[6]; s[0] = 'a'; return s[0]; } with the
+ * store made straight to the array, as const-fold leaves `gep s, 0` */
+static void test_array_slot(anvil_ctx_t *ctx)
+{
+    printf("\nTest 5: constant store to an array slot\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "array_slot");
+    anvil_type_t *i8 = anvil_type_i8(ctx);
+    anvil_func_t *func = anvil_func_create(mod, "first",
+        anvil_type_func(ctx, i8, NULL, 0, false), ANVIL_LINK_EXTERNAL);
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+    anvil_value_t *s = anvil_build_alloca(ctx, anvil_type_array(ctx, i8, 6), "s");
+    anvil_build_store(ctx, anvil_const_i8(ctx, 'a'), s);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i8, s, "c"));
+
+    char *out = codegen(ctx, mod, ANVIL_OPT_STANDARD);
+    CHECK(out != NULL, "codegen succeeds");
+    if (out) {
+        CHECK(strstr(out, "movb $97") != NULL, "the char is stored as a byte");
+        CHECK(strstr(out, "movq $97") == NULL && strstr(out, "movl $97") == NULL,
+              "no wider store spills past the element");
+    }
+    free(out);
+    anvil_module_destroy(mod);
+}
+
+int main(void)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    printf("=== x86-64 Register Allocation Test ===\n");
+    test_leaf(ctx);
+    test_across_call(ctx);
+    test_pressure(ctx);
+    test_loop_phis(ctx);
+    test_array_slot(ctx);
+
+    anvil_ctx_destroy(ctx);
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * ANVIL - Streaming Codegen Test
+ *
+ * anvil_module_codegen_to_sink must produce exactly the text
+ * anvil_module_codegen returns, delivered one function at a time with
+ * data and strings at the end. Checks every target, that a failing sink
+ * stops codegen with its error, and the FILE* and anvil_module_write
+ * paths. A failed anvil_module_write must leave an existing file alone.
+ */
+
+#include <anvil/anvil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_FUNCS 4
+
+static const struct {
+    anvil_arch_t arch;
+    const char *name;
+} targets[] = {
+    { ANVIL_ARCH_X86,     "x86" },
+    { ANVIL_ARCH_X86_64,  "x86_64" },
+    { ANVIL_ARCH_S370,    "s370" },
+    { ANVIL_ARCH_S370_XA, "s370_xa" },
+    { ANVIL_ARCH_S390,    "s390" },
+    { ANVIL_ARCH_ZARCH,   "zarch" },
+    { ANVIL_ARCH_PPC32,   "ppc32" },
+    { ANVIL_ARCH_PPC64,   "ppc64" },
+    { ANVIL_ARCH_PPC64LE, "ppc64le" },
+    { ANVIL_ARCH_ARM64,   "arm64" },
+};
+
+/* Collects the chunks a sink receives; can be told to fail */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t chunks;
+    size_t max_chunk;
+    size_t fail_at;             /* Fail on this chunk (1-based), 0 = never */
+} sink_t;
+
+static anvil_error_t collect(void *user, const char *data, size_t len)
+{
+    sink_t *s = user;
+    s->chunks++;
+    if (s->fail_at && s->chunks == s->fail_at) return ANVIL_ERR_IO;
+
+    char *grown = realloc(s->data, s->len + len + 1);
+    if (!grown) return ANVIL_ERR_NOMEM;
+    s->data = grown;
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+    s->data[s->len] = '\0';
+    if (len > s->max_chunk) s->max_chunk = len;
+    return ANVIL_OK;
+}
+
+/* A global, a string and NUM_FUNCS functions f0..fN: fk(x) = x * k + strlen-ish call */
+static anvil_module_t *build_module(anvil_ctx_t *ctx)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "sink");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+    anvil_type_t *params[] = { i32 };
+
+    anvil_value_t *counter = anvil_module_add_global(mod, "counter", i32, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(counter, anvil_const_i32(ctx, 7));
+
+    anvil_type_t *puts_type = anvil_type_func(ctx, i32, &i8p, 1, false);
+    anvil_func_t *puts_fn = anvil_func_declare(mod, "puts", puts_type);
+
+    anvil_type_t *func_type = anvil_type_func(ctx, i32, params, 1, false);
+    for (int k = 0; k < NUM_FUNCS; k++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%d", k);
+        anvil_func_t *func = anvil_func_create(mod, name, func_type, ANVIL_LINK_EXTERNAL);
+        anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+
+        anvil_value_t *x = anvil_func_get_param(func, 0);
+        anvil_value_t *msg = anvil_const_string(ctx, "hello\n");
+        anvil_value_t *args[] = { msg };
+        anvil_build_call(ctx, i32, anvil_func_get_value(puts_fn), args, 1, NULL);
+        anvil_value_t *r = anvil_build_mul(ctx, x, anvil_const_i32(ctx, k + 1), NULL);
+        anvil_build_ret(ctx, anvil_build_add(ctx, r, anvil_build_load(ctx, i32, counter, NULL), NULL));
+    }
+    return mod;
+}
+
+static void test_targets(void)
+{
+    printf("\nStreamed output matches buffered output:\n");
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        anvil_ctx_t *ctx = anvil_ctx_create();
+        anvil_ctx_set_target(ctx, targets[i].arch);
+        anvil_module_t *mod = build_module(ctx);
+
+        char *out = NULL;
+        size_t len = 0;
+        bool ok = anvil_module_codegen(mod, &out, &len) == ANVIL_OK;
+
+        sink_t sink = { 0 };
+        ok = ok && anvil_module_codegen_to_sink(mod, collect, &sink) == ANVIL_OK;
+
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s: identical (%zu bytes)", targets[i].name, len);
+        CHECK(ok && sink.len == len && memcmp(sink.data, out, len) == 0, msg);
+
+        /* One chunk per function plus the tail; no chunk holds everything */
+        snprintf(msg, sizeof(msg), "%s: %zu chunks, largest %zu bytes", targets[i].name,
+                 sink.chunks, sink.max_chunk);
+        CHECK(sink.chunks >= NUM_FUNCS && sink.max_chunk < len, msg);
+
+        free(sink.data);
+        free(out);
+        anvil_module_destroy(mod);
+        anvil_ctx_destroy(ctx);
+    }
+}
+
+static void test_sink_error(void)
+{
+    printf("\nFailing sink:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+    anvil_module_t *mod = build_module(ctx);
+
+    sink_t sink = { .fail_at = 2 };
+    anvil_error_t err = anvil_module_codegen_to_sink(mod, collect, &sink);
+    CHECK(err == ANVIL_ERR_IO, "sink error is returned");
+    CHECK(sink.chunks == 2, "codegen stops at the failing chunk");
+    free(sink.data);
+
+    /* The backend is usable again afterwards */
+    char *out = NULL;
+    size_t len = 0;
+    CHECK(anvil_module_codegen(mod, &out, &len) == ANVIL_OK && out && len > 0,
+          "buffered codegen still works");
+    free(out);
+
+    CHECK(anvil_module_codegen_to_sink(mod, NULL, NULL) == ANVIL_ERR_INVALID_ARG,
+          "NULL sink rejected");
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void test_file(void)
+{
+    printf("\nFILE* and anvil_module_write:\n");
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_ARM64);
+    anvil_module_t *mod = build_module(ctx);
+
+    char *out = NULL;
+    size_t len = 0;
+    anvil_module_codegen(mod, &out, &len);
+
+    FILE *f = tmpfile();
+    CHECK(f && anvil_module_codegen_to_file(mod, f) == ANVIL_OK, "codegen_to_file succeeds");
+    if (f) {
+        char *buf = calloc(1, len + 2);
+        rewind(f);
+        size_t got = fread(buf, 1, len + 1, f);
+        CHECK(got == len && memcmp(buf, out, len) == 0, "file holds the buffered output");
+        free(buf);
+        fclose(f);
+    }
+
+    const char *path = "sink_test_output.s";
+    CHECK(anvil_module_write(mod, path) == ANVIL_OK, "anvil_module_write succeeds");
+    f = fopen(path, "r");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        CHECK((size_t)ftell(f) == len, "written file has the full output");
+        fclose(f);
+    } else {
+        CHECK(0, "written file exists");
+    }
+    f = fopen("sink_test_output.s.tmp", "r");
+    CHECK(!f, "no temporary left behind");
+    if (f) fclose(f);
+    remove(path);
+
+    free(out);
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+/* ppc32 refuses phis before generating anything */
+static void test_failed_write(void)
+{
+    printf("\nFailed anvil_module_write:\n");
+    const char *path = "sink_test_keep.s";
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs("keep\n", f);
+        fclose(f);
+    }
+
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_PPC32);
+    anvil_module_t *mod = anvil_module_create(ctx, "phi");
+    anvil_func_t *func = make_func(ctx, mod, "pick");
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *join = anvil_block_create(func, "join");
+    anvil_set_insert_point(ctx, entry);
+    anvil_build_br(ctx, join);
+    anvil_set_insert_point(ctx, join);
+    anvil_value_t *phi = anvil_build_phi(ctx, anvil_type_i32(ctx), "v");
+    anvil_phi_add_incoming(phi, anvil_func_get_param(func, 0), entry);
+    anvil_build_ret(ctx, phi);
+
+    CHECK(anvil_module_write(mod, path) == ANVIL_ERR_CODEGEN, "codegen error is returned");
+    char buf[16] = { 0 };
+    f = fopen(path, "r");
+    if (f) {
+        size_t got = fread(buf, 1, sizeof(buf) - 1, f);
+        buf[got] = '\0';
+        fclose(f);
+    }
+    CHECK(strcmp(buf, "keep\n") == 0, "existing file is untouched");
+    f = fopen("sink_test_keep.s.tmp", "r");
+    CHECK(!f, "temporary is removed");
+    if (f) fclose(f);
+    remove(path);
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+int main(void)
+{
+    printf("=== Streaming Codegen Test ===\n");
+    test_targets();
+    test_sink_error();
+    test_file();
+    test_failed_write();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * ANVIL - Stack-Slot Coloring Test
+ *
+ * Values whose lifetimes never overlap share a frame slot. Checks the
+ * coloring computed by the shared analysis (an internal API used by the
+ * backends): block-scoped locals and ternary temporaries share, while
+ * locals that are live at the same time, live around a loop or whose
+ * address escapes keep their own slots. Then generates code for every
+ * target and prints the frame-size report.
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_internal.h>
+#include <anvil/anvil_debug.h>
+#include <anvil/anvil_opt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "test_util.h"
+
+/* Eight bytes for every alloca, as most backends do */
+static int alloca_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 8;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 8 : 0;
+}
+
+static bool same_slot(anvil_stack_colors_t *sc, anvil_value_t *a, anvil_value_t *b)
+{
+    anvil_frame_slot_t *sa = anvil_stack_color_slot(sc, a);
+    return sa && sa == anvil_stack_color_slot(sc, b);
+}
+
+/*
+ * int scopes(int c, int x) {
+ *     int r;
+ *     if (c) { int a = x * 2; int b = a + 1; r = b; }
+ *     else   { int d = x * 3; int e = d - 1; r = e; }
+ *     int t = c ? x : -x;           (t and the ternary temporary)
+ *     ext(&r);
+ *     return r + t;
+ * }
+ */
+static anvil_func_t *build_scopes(anvil_ctx_t *ctx, anvil_module_t *mod, anvil_value_t **locals)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *ptr = anvil_type_ptr(ctx, i32);
+    anvil_type_t *params[] = { i32, i32 };
+    anvil_type_t *ext_type = anvil_type_func(ctx, anvil_type_void(ctx), &ptr, 1, false);
+    anvil_func_t *ext = anvil_func_declare(mod, "ext", ext_type);
+    anvil_func_t *func = anvil_func_create(mod, "scopes",
+        anvil_type_func(ctx, i32, params, 2, false), ANVIL_LINK_EXTERNAL);
+    anvil_value_t *c = anvil_func_get_param(func, 0);
+    anvil_value_t *x = anvil_func_get_param(func, 1);
+
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *then_bb = anvil_block_create(func, "then");
+    anvil_block_t *else_bb = anvil_block_create(func, "else");
+    anvil_block_t *join = anvil_block_create(func, "join");
+    anvil_block_t *pos = anvil_block_create(func, "pos");
+    anvil_block_t *neg = anvil_block_create(func, "neg");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *r = anvil_build_alloca(ctx, i32, "r");
+    anvil_value_t *cond = anvil_build_cmp_ne(ctx, c, anvil_const_i32(ctx, 0), "cond");
+    anvil_build_br_cond(ctx, cond, then_bb, else_bb);
+
+    anvil_set_insert_point(ctx, then_bb);
+    anvil_value_t *a = anvil_build_alloca(ctx, i32, "a");
+    anvil_build_store(ctx, anvil_build_mul(ctx, x, anvil_const_i32(ctx, 2), NULL), a);
+    anvil_value_t *b = anvil_build_alloca(ctx, i32, "b");
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, a, NULL),
+                                           anvil_const_i32(ctx, 1), NULL), b);
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, b, NULL), r);
+    anvil_build_br(ctx, join);
+
+    anvil_set_insert_point(ctx, else_bb);
+    anvil_value_t *d = anvil_build_alloca(ctx, i32, "d");
+    anvil_build_store(ctx, anvil_build_mul(ctx, x, anvil_const_i32(ctx, 3), NULL), d);
+    anvil_value_t *e = anvil_build_alloca(ctx, i32, "e");
+    anvil_build_store(ctx, anvil_build_sub(ctx, anvil_build_load(ctx, i32, d, NULL),
+                                           anvil_const_i32(ctx, 1), NULL), e);
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, e, NULL), r);
+    anvil_build_br(ctx, join);
+
+    anvil_set_insert_point(ctx, join);
+    anvil_value_t *t = anvil_build_alloca(ctx, i32, "t");
+    anvil_value_t *tmp = anvil_build_alloca(ctx, i32, "ternary.result");
+    anvil_build_br_cond(ctx, cond, pos, neg);
+
+    anvil_set_insert_point(ctx, pos);
+    anvil_build_store(ctx, x, tmp);
+    anvil_build_br(ctx, done);
+
+    anvil_set_insert_point(ctx, neg);
+    anvil_build_store(ctx, anvil_build_neg(ctx, x, NULL), tmp);
+    anvil_build_br(ctx, done);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, tmp, NULL), t);
+    anvil_value_t *args[] = { r };
+    anvil_build_call(ctx, ext_type, anvil_func_get_value(ext), args, 1, "");
+    anvil_build_ret(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, r, NULL),
+                                         anvil_build_load(ctx, i32, t, NULL), NULL));
+
+    if (locals) {
+        anvil_value_t *all[] = { r, a, b, d, e, t, tmp };
+        for (int i = 0; i < 7; i++) locals[i] = all[i];
+    }
+    return func;
+}
+
+static void test_scopes(anvil_ctx_t *ctx)
+{
+    printf("\nTest 1: block-scoped locals and temporaries\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "scopes");
+    anvil_value_t *v[7];
+    anvil_func_t *func = build_scopes(ctx, mod, v);
+    anvil_value_t *r = v[0], *a = v[1], *b = v[2], *d = v[3], *e = v[4], *t = v[5], *tmp = v[6];
+
+    anvil_stack_colors_t sc;
+    CHECK(anvil_stack_color(&sc, func, NULL, alloca_size, NULL) == ANVIL_OK, "coloring succeeds");
+    CHECK(sc.num_values == 7, "every alloca asks for a slot");
+    CHECK(same_slot(&sc, a, d) || same_slot(&sc, a, e), "locals of the two branches share");
+    CHECK(!same_slot(&sc, a, b) && !same_slot(&sc, d, e), "locals live together do not");
+    CHECK(same_slot(&sc, t, a) || same_slot(&sc, t, b) || same_slot(&sc, t, d) ||
+          same_slot(&sc, t, e), "a later local reuses a branch slot");
+    CHECK(!same_slot(&sc, t, tmp), "the temporary and its destination do not share");
+    CHECK(!same_slot(&sc, r, a) && !same_slot(&sc, r, tmp) && !same_slot(&sc, r, t),
+          "the escaping local keeps its own slot");
+    CHECK(sc.num_slots == 3, "7 locals fit in 3 slots");
+    CHECK(sc.bytes_requested == 56 && sc.bytes_colored == 24, "frame slots shrink from 56 to 24 bytes");
+    anvil_stack_colors_free(&sc);
+
+    anvil_module_destroy(mod);
+}
+
+/*
+ * int loop(int n) {
+ *     int s = 0;
+ *     for (...) { int k = n; s = s + k; n = n - 1; }     (while n != 0)
+ *     return s;
+ * }
+ */
+static void test_loop(anvil_ctx_t *ctx)
+{
+    printf("\nTest 2: locals live around a loop\n");
+
+    anvil_module_t *mod = anvil_module_create(ctx, "loop");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32 };
+    anvil_func_t *func = anvil_func_create(mod, "loop",
+        anvil_type_func(ctx, i32, params, 1, false), ANVIL_LINK_EXTERNAL);
+    anvil_block_t *entry = anvil_func_get_entry(func);
+    anvil_block_t *head = anvil_block_create(func, "head");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_set_insert_point(ctx, entry);
+    anvil_value_t *n = anvil_build_alloca(ctx, i32, "n");
+    anvil_build_store(ctx, anvil_func_get_param(func, 0), n);
+    anvil_value_t *s = anvil_build_alloca(ctx, i32, "s");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), s);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, head);
+    anvil_value_t *nv = anvil_build_load(ctx, i32, n, NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_ne(ctx, nv, anvil_const_i32(ctx, 0), NULL), body, done);
+
+    anvil_set_insert_point(ctx, body);
+    anvil_value_t *k = anvil_build_alloca(ctx, i32, "k");
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, n, NULL), k);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, s, NULL),
+                                           anvil_build_load(ctx, i32, k, NULL), NULL), s);
+    anvil_build_store(ctx, anvil_build_sub(ctx, anvil_build_load(ctx, i32, n, NULL),
+                                           anvil_const_i32(ctx, 1), NULL), n);
+    anvil_build_br(ctx, head);
+
+    anvil_set_insert_point(ctx, done);
+    anvil_value_t *out = anvil_build_alloca(ctx, i32, "out");
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, s, NULL), out);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, out, NULL));
+
+    anvil_stack_colors_t sc;
+    CHECK(anvil_stack_color(&sc, func, NULL, alloca_size, NULL) == ANVIL_OK, "coloring succeeds");
+    CHECK(!same_slot(&sc, k, n) && !same_slot(&sc, k, s), "the loop local does not take a loop-carried slot");
+    CHECK(same_slot(&sc, out, k) || same_slot(&sc, out, n),
+          "a local after the loop reuses a dead slot");
+    CHECK(!same_slot(&sc, out, s), "but not the one it is copied from");
+    anvil_stack_colors_free(&sc);
+
+    anvil_module_destroy(mod);
+}
+
+static const struct {
+    anvil_arch_t arch;
+    const char *name;
+} targets[] = {
+    { ANVIL_ARCH_X86, "x86" },
+    { ANVIL_ARCH_X86_64, "x86-64" },
+    { ANVIL_ARCH_S370, "S/370" },
+    { ANVIL_ARCH_S370_XA, "S/370-XA" },
+    { ANVIL_ARCH_S390, "S/390" },
+    { ANVIL_ARCH_ZARCH, "z/Architecture" },
+    { ANVIL_ARCH_PPC32, "PPC32" },
+    { ANVIL_ARCH_PPC64, "PPC64" },
+    { ANVIL_ARCH_PPC64LE, "PPC64LE" },
+    { ANVIL_ARCH_ARM64, "ARM64" },
+};
+
+static void test_targets(void)
+{
+    printf("\nTest 3: frames on every target\n");
+
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        for (int opt = 0; opt < 2; opt++) {
+            anvil_ctx_t *ctx = anvil_ctx_create();
+            anvil_ctx_set_target(ctx, targets[i].arch);
+            anvil_ctx_set_opt_level(ctx, opt ? ANVIL_OPT_STANDARD : ANVIL_OPT_NONE);
+            anvil_module_t *mod = anvil_module_create(ctx, "scopes");
+            anvil_func_t *func = build_scopes(ctx, mod, NULL);
+
+            char *out = NULL;
+            size_t len = 0;
+            char msg[96];
+            bool ok = anvil_module_codegen(mod, &out, &len) == ANVIL_OK;
+            snprintf(msg, sizeof(msg), "%s %s: slot bytes shrink (%zu -> %zu)", targets[i].name,
+                     opt ? "-O2" : "-O0", func->slot_bytes, func->slot_bytes_colored);
+            CHECK(ok && func->slot_bytes_colored < func->slot_bytes, msg);
+            if (ok && i == 0 && opt == 0) anvil_dump_frame_sizes(stdout, mod);
+
+            free(out);
+            anvil_module_destroy(mod);
+            anvil_ctx_destroy(ctx);
+        }
+    }
+}
+
+int main(void)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+
+    printf("=== Stack-Slot Coloring Test ===\n");
+    test_scopes(ctx);
+    test_loop(ctx);
+    anvil_ctx_destroy(ctx);
+
+    test_targets();
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * ANVIL Examples - Test Helpers
+ *
+ * Shared by the self-checking examples: a CHECK macro that prints a
+ * PASS/FAIL line and counts failures, and a factory for the small test
+ * functions most of them build.
+ *
+ * Usage in examples:
+ *   #include "test_util.h"
+ *
+ *   CHECK(value == 42, "folds to 42");
+ *   ...
+ *   printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+ *   return failures ? 1 : 0;
+ */
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <anvil/anvil.h>
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, msg) do { \
+    if (cond) { \
+        printf("  PASS: %s\n", msg); \
+    } else { \
+        printf("  FAIL: %s\n", msg); \
+        failures++; \
+    } \
+} while (0)
+
+/* External function returning i32 */
+static inline anvil_func_t *make_func_with(anvil_ctx_t *ctx, anvil_module_t *mod, const char *name,
+                                           anvil_type_t **params, size_t num_params)
+{
+    return anvil_func_create(mod, name,
+                             anvil_type_func(ctx, anvil_type_i32(ctx), params, num_params, false),
+                             ANVIL_LINK_EXTERNAL);
+}
+
+/* int name(int, int) */
+static inline anvil_func_t *make_func(anvil_ctx_t *ctx, anvil_module_t *mod, const char *name)
+{
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+    return make_func_with(ctx, mod, name, params, 2);
+}
+
+#endif /* TEST_UTIL_H */
@@ -0,0 +1,182 @@
+/*
+ * ANVIL - Thread Stress Test
+ *
+ * 32 threads start at once and each creates its own context, so the
+ * first contexts race on backend registration. Every thread then builds,
+ * optimizes and generates a module for one of the targets, some with
+ * parallel codegen on top. Each result must equal the output of the
+ * same work done serially afterwards.
+ *
+ * Meant to run under ThreadSanitizer as well: make test-tsan
+ */
+
+#include <anvil/anvil.h>
+#include <anvil/anvil_opt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "test_util.h"
+
+#define NUM_THREADS 32
+
+static const struct {
+    anvil_arch_t arch;
+    const char *name;
+} targets[] = {
+    { ANVIL_ARCH_X86,     "x86" },
+    { ANVIL_ARCH_X86_64,  "x86_64" },
+    { ANVIL_ARCH_S370,    "s370" },
+    { ANVIL_ARCH_S370_XA, "s370_xa" },
+    { ANVIL_ARCH_S390,    "s390" },
+    { ANVIL_ARCH_ZARCH,   "zarch" },
+    { ANVIL_ARCH_PPC32,   "ppc32" },
+    { ANVIL_ARCH_PPC64,   "ppc64" },
+    { ANVIL_ARCH_PPC64LE, "ppc64le" },
+    { ANVIL_ARCH_ARM64,   "arm64" },
+};
+
+#define NUM_TARGETS (sizeof(targets) / sizeof(targets[0]))
+
+typedef struct {
+    int id;
+    char *out;
+    size_t len;
+    anvil_error_t err;
+} job_t;
+
+static atomic_int ready;
+static atomic_bool go;
+
+/* Thread id picks the target, the optimization level and the codegen threads */
+static anvil_arch_t job_arch(int id) { return targets[id % NUM_TARGETS].arch; }
+static anvil_opt_level_t job_level(int id) { return (id / NUM_TARGETS) % 2 ? ANVIL_OPT_STANDARD : ANVIL_OPT_NONE; }
+static int job_threads(int id) { return id >= 2 * (int)NUM_TARGETS ? 2 : 1; }
+
+/* sum(n) over a counted loop, a string call and a global, named per id */
+static anvil_module_t *build_module(anvil_ctx_t *ctx, int id)
+{
+    anvil_module_t *mod = anvil_module_create(ctx, "stress");
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *i8p = anvil_type_ptr(ctx, anvil_type_i8(ctx));
+
+    anvil_value_t *total = anvil_module_add_global(mod, "total", i32, ANVIL_LINK_EXTERNAL);
+    anvil_global_set_initializer(total, anvil_const_i32(ctx, id));
+    anvil_func_t *puts_fn = anvil_func_declare(mod, "puts", anvil_type_func(ctx, i32, &i8p, 1, false));
+
+    char name[32];
+    snprintf(name, sizeof(name), "sum%d", id);
+    anvil_func_t *func = anvil_func_create(mod, name, anvil_type_func(ctx, i32, &i32, 1, false),
+                                           ANVIL_LINK_EXTERNAL);
+    anvil_block_t *loop = anvil_block_create(func, "loop");
+    anvil_block_t *body = anvil_block_create(func, "body");
+    anvil_block_t *done = anvil_block_create(func, "done");
+
+    anvil_set_insert_point(ctx, anvil_func_get_entry(func));
+    anvil_value_t *i = anvil_build_alloca(ctx, i32, "i");
+    anvil_value_t *acc = anvil_build_alloca(ctx, i32, "acc");
+    anvil_build_store(ctx, anvil_const_i32(ctx, 0), i);
+    anvil_build_store(ctx, anvil_build_load(ctx, i32, total, NULL), acc);
+    anvil_build_br(ctx, loop);
+
+    anvil_set_insert_point(ctx, loop);
+    anvil_value_t *iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_build_br_cond(ctx, anvil_build_cmp_lt(ctx, iv, anvil_func_get_param(func, 0), NULL),
+                        body, done);
+
+    anvil_set_insert_point(ctx, body);
+    iv = anvil_build_load(ctx, i32, i, NULL);
+    anvil_value_t *scaled = anvil_build_mul(ctx, iv, anvil_const_i32(ctx, id + 1), NULL);
+    anvil_build_store(ctx, anvil_build_add(ctx, anvil_build_load(ctx, i32, acc, NULL), scaled, NULL), acc);
+    anvil_build_store(ctx, anvil_build_add(ctx, iv, anvil_const_i32(ctx, 1), NULL), i);
+    anvil_build_br(ctx, loop);
+
+    anvil_set_insert_point(ctx, done);
+    snprintf(name, sizeof(name), "done %d", id);
+    anvil_value_t *msg = anvil_const_string(ctx, name);
+    anvil_build_call(ctx, i32, anvil_func_get_value(puts_fn), &msg, 1, NULL);
+    anvil_build_ret(ctx, anvil_build_load(ctx, i32, acc, NULL));
+    return mod;
+}
+
+static void run_job(job_t *job)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        job->err = ANVIL_ERR_NOMEM;
+        return;
+    }
+    job->err = anvil_ctx_set_target(ctx, job_arch(job->id));
+    anvil_ctx_set_opt_level(ctx, job_level(job->id));
+    anvil_ctx_set_codegen_threads(ctx, job_threads(job->id));
+
+    anvil_module_t *mod = build_module(ctx, job->id);
+    if (job->err == ANVIL_OK) job->err = anvil_module_optimize(mod);
+    if (job->err == ANVIL_OK) job->err = anvil_module_codegen(mod, &job->out, &job->len);
+
+    anvil_module_destroy(mod);
+    anvil_ctx_destroy(ctx);
+}
+
+static void *thread_main(void *arg)
+{
+    /* Line everyone up so the first contexts are created together */
+    atomic_fetch_add(&ready, 1);
+    while (!atomic_load(&go))
+        ;
+    run_job(arg);
+    return NULL;
+}
+
+int main(void)
+{
+    printf("=== Thread Stress Test (%d contexts) ===\n", NUM_THREADS);
+
+    pthread_t tids[NUM_THREADS];
+    job_t jobs[NUM_THREADS] = { 0 };
+    int started = 0;
+    for (int i = 0; i < NUM_THREADS; i++) {
+        jobs[i].id = i;
+        if (pthread_create(&tids[i], NULL, thread_main, &jobs[i]) != 0) break;
+        started++;
+    }
+    while (atomic_load(&ready) < started)
+        ;
+    atomic_store(&go, true);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+
+    printf("\nConcurrent contexts:\n");
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%d threads started", started);
+    CHECK(started == NUM_THREADS, msg);
+
+    int ok = 0;
+    for (int i = 0; i < started; i++) {
+        if (jobs[i].err == ANVIL_OK && jobs[i].out && jobs[i].len > 0) ok++;
+    }
+    snprintf(msg, sizeof(msg), "%d of %d contexts generated code", ok, started);
+    CHECK(ok == started, msg);
+
+    printf("\nMatches serial codegen:\n");
+    for (size_t t = 0; t < NUM_TARGETS; t++) {
+        int same = 0, total = 0;
+        for (int i = (int)t; i < started; i += NUM_TARGETS) {
+            job_t serial = { .id = i };
+            run_job(&serial);
+            total++;
+            if (serial.err == ANVIL_OK && serial.len == jobs[i].len && jobs[i].out &&
+                memcmp(serial.out, jobs[i].out, serial.len) == 0) {
+                same++;
+            }
+            free(serial.out);
+        }
+        snprintf(msg, sizeof(msg), "%s: %d of %d identical", targets[t].name, same, total);
+        CHECK(same == total, msg);
+    }
+
+    for (int i = 0; i < started; i++) free(jobs[i].out);
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * ANVIL - Type Interning Test
+ *
+ * Derived types are hash-consed per context, so building the same
+ * pointer, array, struct or function type twice must return the same
+ * object and type equality is a pointer comparison.
+ */
+
+#include <anvil/anvil.h>
+#include <stdio.h>
+#include "test_util.h"
+
+static void test_pointers(anvil_ctx_t *ctx)
+{
+    printf("\nTest 1: pointer types\n");
+
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *p1 = anvil_type_ptr(ctx, i32);
+    anvil_type_t *p2 = anvil_type_ptr(ctx, i32);
+    CHECK(p1 == p2, "ptr(i32) is interned");
+    CHECK(anvil_type_ptr(ctx, p1) == anvil_type_ptr(ctx, p2), "ptr(ptr(i32)) is interned");
+    CHECK(anvil_type_ptr(ctx, i32) != anvil_type_ptr(ctx, anvil_type_u32(ctx)),
+          "ptr(i32) != ptr(u32)");
+    CHECK(anvil_type_ptr(ctx, NULL) == anvil_type_ptr(ctx, NULL), "opaque ptr is interned");
+}
+
+static void test_arrays(anvil_ctx_t *ctx)
+{
+    printf("\nTest 2: array types\n");
+
+    anvil_type_t *i8 = anvil_type_i8(ctx);
+    anvil_type_t *a1 = anvil_type_array(ctx, i8, 16);
+    CHECK(a1 == anvil_type_array(ctx, i8, 16), "[16 x i8] is interned");
+    CHECK(a1 != anvil_type_array(ctx, i8, 17), "[16 x i8] != [17 x i8]");
+    CHECK(anvil_type_array(ctx, a1, 4) == anvil_type_array(ctx, anvil_type_array(ctx, i8, 16), 4),
+          "nested arrays are interned");
+}
+
+static void test_structs(anvil_ctx_t *ctx)
+{
+    printf("\nTest 3: struct types\n");
+
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *f1[] = { i32, anvil_type_ptr(ctx, i32) };
+    anvil_type_t *f2[] = { i32, anvil_type_ptr(ctx, i32) };
+
+    anvil_type_t *s1 = anvil_type_struct(ctx, "node", f1, 2);
+    anvil_type_t *s2 = anvil_type_struct(ctx, "node", f2, 2);
+    CHECK(s1 == s2, "struct node is interned");
+    CHECK(s1 != anvil_type_struct(ctx, "other", f1, 2), "name is part of the key");
+    CHECK(anvil_type_struct(ctx, NULL, f1, 2) == anvil_type_struct(ctx, NULL, f2, 2),
+          "anonymous structs are interned");
+    CHECK(anvil_type_struct(ctx, "node", f1, 1) != s1, "field count is part of the key");
+
+    /* The intern key must not alias the caller's field array */
+    f1[0] = anvil_type_i64(ctx);
+    CHECK(anvil_type_struct(ctx, "node", f2, 2) == s1, "caller array is copied");
+}
+
+static void test_funcs(anvil_ctx_t *ctx)
+{
+    printf("\nTest 4: function types\n");
+
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *params[] = { i32, i32 };
+
+    anvil_type_t *t1 = anvil_type_func(ctx, i32, params, 2, false);
+    CHECK(t1 == anvil_type_func(ctx, i32, params, 2, false), "i32(i32, i32) is interned");
+    CHECK(t1 != anvil_type_func(ctx, i32, params, 2, true), "variadic is part of the key");
+    CHECK(t1 != anvil_type_func(ctx, i32, params, 1, false), "param count is part of the key");
+    CHECK(anvil_type_func(ctx, NULL, NULL, 0, false) ==
+          anvil_type_func(ctx, anvil_type_void(ctx), NULL, 0, false),
+          "NULL return type is void");
+}
+
+static void test_many(anvil_ctx_t *ctx)
+{
+    printf("\nTest 5: table growth\n");
+
+    anvil_type_t *i32 = anvil_type_i32(ctx);
+    anvil_type_t *first[1000];
+    int same = 1;
+
+    for (int i = 0; i < 1000; i++) {
+        first[i] = anvil_type_array(ctx, i32, (size_t)i);
+    }
+    for (int i = 0; i < 1000; i++) {
+        if (anvil_type_array(ctx, i32, (size_t)i) != first[i]) same = 0;
+    }
+    CHECK(same, "1000 array types survive rehashing");
+}
+
+int main(void)
+{
+    anvil_ctx_t *ctx = anvil_ctx_create();
+    if (!ctx) {
+        fprintf(stderr, "Failed to create context\n");
+        return 1;
+    }
+    anvil_ctx_set_target(ctx, ANVIL_ARCH_X86_64);
+
+    test_pointers(ctx);
+    test_arrays(ctx);
+    test_structs(ctx);
+    test_funcs(ctx);
+    test_many(ctx);
+
+    anvil_ctx_destroy(ctx);
+
+    printf("\n%s\n", failures ? "SOME TESTS FAILED" : "All tests passed");
+    return failures ? 1 : 0;
+}
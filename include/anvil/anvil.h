@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 /* CPU Model System - models and feature flags */
 #include "anvil_cpu.h"
@@ -33,6 +34,7 @@ typedef struct anvil_block anvil_block_t;
 typedef struct anvil_value anvil_value_t;
 typedef struct anvil_type anvil_type_t;
 typedef struct anvil_backend anvil_backend_t;
+typedef struct anvil_elf_object anvil_elf_object_t;
 
 /* Target architecture */
 typedef enum {
@@ -52,7 +54,7 @@ typedef enum {
 /* Output format */
 typedef enum {
     ANVIL_OUTPUT_ASM,        /* Assembly text output */
-    ANVIL_OUTPUT_BINARY      /* Binary opcodes (future) */
+    ANVIL_OUTPUT_BINARY      /* Relocatable object file (x86-64 ELF) */
 } anvil_output_t;
 
 /* Assembly syntax for mainframe */
@@ -240,6 +242,14 @@ typedef enum {
     ANVIL_ERR_IO
 } anvil_error_t;
 
+/* IR memory statistics (context arena plus all module arenas) */
+typedef struct {
+    size_t num_allocs;       /* Allocation requests served by the arenas */
+    size_t num_chunks;       /* Backing chunks obtained from malloc */
+    size_t bytes_used;       /* Bytes handed out */
+    size_t bytes_reserved;   /* Bytes held in chunks */
+} anvil_mem_stats_t;
+
 /* ============================================================================
  * Context API
  * ============================================================================ */
@@ -256,6 +266,13 @@ anvil_error_t anvil_ctx_set_target(anvil_ctx_t *ctx, anvil_arch_t arch);
 /* Set output format */
 anvil_error_t anvil_ctx_set_output(anvil_ctx_t *ctx, anvil_output_t output);
 
+/* Generate functions on up to threads threads (1 = serial, the default;
+ * 0 = one per online CPU). Output is identical for every setting.
+ * Only x86-64 generates in parallel: for any other target (set the target
+ * first) a count other than 1 is kept but has no effect, and the call
+ * returns ANVIL_ERR_CODEGEN with the reason in anvil_ctx_get_error. */
+anvil_error_t anvil_ctx_set_codegen_threads(anvil_ctx_t *ctx, int threads);
+
 /* Set assembly syntax */
 anvil_error_t anvil_ctx_set_syntax(anvil_ctx_t *ctx, anvil_syntax_t syntax);
 
@@ -277,6 +294,11 @@ const anvil_arch_info_t *anvil_ctx_get_arch_info(anvil_ctx_t *ctx);
 /* Get architecture info without context (for early initialization) */
 const anvil_arch_info_t *anvil_arch_get_info(anvil_arch_t arch);
 
+/* Whether the target backend keeps SSA values live across instructions
+ * and takes phis (x86-64, ARM64). The other backends hold one result at
+ * a time and expect IR as a front end emits it. */
+bool anvil_ctx_supports_phi(anvil_ctx_t *ctx);
+
 /* Get last error message */
 const char *anvil_ctx_get_error(anvil_ctx_t *ctx);
 
@@ -296,6 +318,9 @@ bool anvil_ctx_has_feature(anvil_ctx_t *ctx, anvil_cpu_features_t feature);
 anvil_error_t anvil_ctx_enable_feature(anvil_ctx_t *ctx, anvil_cpu_features_t feature);
 anvil_error_t anvil_ctx_disable_feature(anvil_ctx_t *ctx, anvil_cpu_features_t feature);
 
+/* Get IR memory statistics */
+void anvil_ctx_get_mem_stats(anvil_ctx_t *ctx, anvil_mem_stats_t *stats);
+
 /* Get CPU model name as string */
 const char *anvil_cpu_model_name(anvil_cpu_model_t cpu);
 
@@ -329,6 +354,42 @@ anvil_error_t anvil_module_codegen(anvil_module_t *mod, char **output, size_t *l
 /* Write generated code to file */
 anvil_error_t anvil_module_write(anvil_module_t *mod, const char *filename);
 
+/* Output sink for streaming codegen: receives the output in order, one
+ * chunk at a time. Returning anything but ANVIL_OK stops codegen. */
+typedef anvil_error_t (*anvil_write_fn)(void *user, const char *data, size_t len);
+
+/* Generate code for the module, streaming it to a sink. Each function is
+ * written as soon as it is emitted; data and strings are buffered and
+ * written at the end, so peak memory is bounded by the largest function
+ * plus the data sections rather than the whole output. */
+anvil_error_t anvil_module_codegen_to_sink(anvil_module_t *mod, anvil_write_fn write, void *user);
+
+/* Stream generated code to an open file */
+anvil_error_t anvil_module_codegen_to_file(anvil_module_t *mod, FILE *file);
+
+/* ============================================================================
+ * JIT API
+ * ============================================================================ */
+
+/* Module compiled into executable memory */
+typedef struct anvil_jit anvil_jit_t;
+
+/* Returns the address of an external symbol, or NULL if it is unknown */
+typedef void *(*anvil_resolve_fn)(void *user, const char *name);
+
+/* Compile the module for the host and load it into executable memory.
+ * References to declared externs are resolved through resolve. Only the
+ * native host architecture is supported (x86-64). The result does not
+ * refer to the module or context and stays valid after they are destroyed. */
+anvil_error_t anvil_module_jit(anvil_module_t *mod, anvil_resolve_fn resolve, void *user,
+                               anvil_jit_t **jit);
+
+/* Address of a global function defined by the module, or NULL */
+void *anvil_jit_get_function(anvil_jit_t *jit, const char *name);
+
+/* Unmap the code and free the JIT */
+void anvil_jit_destroy(anvil_jit_t *jit);
+
 /* ============================================================================
  * Type API
  * ============================================================================ */
@@ -377,6 +438,12 @@ anvil_type_t *anvil_value_get_type(anvil_value_t *val);
 /* Check if value is a comparison result (boolean) */
 bool anvil_value_is_bool(anvil_value_t *val);
 
+/* Number of instruction operands that use this value */
+size_t anvil_value_num_uses(anvil_value_t *val);
+
+/* Replace every use of old_val with new_val; returns the number of uses rewritten */
+size_t anvil_value_replace_all_uses(anvil_value_t *old_val, anvil_value_t *new_val);
+
 /* ============================================================================
  * Function API
  * ============================================================================ */
@@ -546,6 +613,17 @@ typedef struct anvil_backend_ops {
      * Returns ANVIL_OK on success. If NULL, this step is skipped. */
     anvil_error_t (*prepare_ir)(anvil_backend_t *be, anvil_module_t *mod);
     
+    /* Codegen keeps SSA values live across instructions and copies phi
+     * inputs on the incoming edges. When false, the pass manager skips the
+     * passes that create phis (mem2reg, licm, loop-unroll) and codegen
+     * rejects a module that still has any. */
+    bool supports_phi;
+    
+    /* codegen_module honours the context's codegen thread count and
+     * generates functions on worker threads. When false, codegen is
+     * serial and anvil_ctx_set_codegen_threads reports so. */
+    bool parallel_codegen;
+    
     /* Generate code for a module */
     anvil_error_t (*codegen_module)(anvil_backend_t *be, anvil_module_t *mod,
                                      char **output, size_t *len);
@@ -554,6 +632,14 @@ typedef struct anvil_backend_ops {
     anvil_error_t (*codegen_func)(anvil_backend_t *be, anvil_func_t *func,
                                    char **output, size_t *len);
     
+    /* Generate a relocatable object for a module (optional).
+     * Used instead of codegen_module when the context output is
+     * ANVIL_OUTPUT_BINARY. The backend fills in obj (machine code,
+     * symbols, relocations; see anvil_internal.h) and the core writes
+     * the ELF file. If NULL, the backend only produces assembly text. */
+    anvil_error_t (*codegen_object)(anvil_backend_t *be, anvil_module_t *mod,
+                                     anvil_elf_object_t *obj);
+    
     /* Get architecture info */
     const anvil_arch_info_t *(*get_arch_info)(anvil_backend_t *be);
     
@@ -46,6 +46,10 @@ void anvil_dump_global(FILE *out, anvil_global_t *global);
 /* Dump module to file */
 void anvil_dump_module(FILE *out, anvil_module_t *mod);
 
+/* Dump per-function frame sizes and the stack-slot bytes saved by slot
+ * sharing. Sizes are recorded by the backend, so call after codegen. */
+void anvil_dump_frame_sizes(FILE *out, anvil_module_t *mod);
+
 /* ============================================================================
  * Print to stdout API (convenience wrappers)
  * ============================================================================ */
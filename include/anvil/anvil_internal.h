@@ -9,23 +9,62 @@
 #include "anvil.h"
 #include <stdio.h>
 
+/* Recursive mutex (see parallel.c); lock and unlock accept NULL */
+#ifndef _WIN32
+#include <pthread.h>
+typedef pthread_mutex_t anvil_mutex_t;
+
+static inline void anvil_mutex_lock(anvil_mutex_t *mutex)
+{
+    if (mutex) pthread_mutex_lock(mutex);
+}
+
+static inline void anvil_mutex_unlock(anvil_mutex_t *mutex)
+{
+    if (mutex) pthread_mutex_unlock(mutex);
+}
+#else
+typedef int anvil_mutex_t;      /* No worker threads: locking is a no-op */
+
+static inline void anvil_mutex_lock(anvil_mutex_t *mutex) { (void)mutex; }
+static inline void anvil_mutex_unlock(anvil_mutex_t *mutex) { (void)mutex; }
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* Memory pool for efficient allocation */
-typedef struct anvil_pool {
-    void *blocks;
-    size_t block_size;
+/* Arena chunk (data follows the header) */
+typedef struct anvil_pool_chunk {
+    struct anvil_pool_chunk *next;
+    size_t size;
     size_t used;
-    struct anvil_pool *next;
+} anvil_pool_chunk_t;
+
+/* Bump-pointer arena: objects are never freed individually */
+typedef struct anvil_pool {
+    anvil_pool_chunk_t *chunks;   /* Current chunk first */
+    size_t block_size;            /* Default chunk size */
+    void *last;                   /* Last allocation (grown in place by realloc) */
+    anvil_mutex_t *lock;          /* Set while parallel passes run (see parallel.c) */
+    bool workers;                 /* Workers allocate from their own arenas instead */
+    
+    /* Statistics */
+    size_t num_allocs;
+    size_t num_chunks;
+    size_t bytes_used;
+    size_t bytes_reserved;
 } anvil_pool_t;
 
-/* String buffer for code generation */
+/* String buffer for code generation. With a sink attached, flushes hand
+ * the contents to the sink and empty the buffer. */
 typedef struct anvil_strbuf {
     char *data;
     size_t len;
     size_t cap;
+    anvil_write_fn sink;
+    void *sink_data;
+    anvil_error_t sink_err;     /* First sink error, sticky */
 } anvil_strbuf_t;
 
 /* Value kinds */
@@ -42,12 +81,27 @@ typedef enum {
     ANVIL_VAL_BLOCK
 } anvil_val_kind_t;
 
+/* Use of a value by an instruction operand (intrusive def-use chain).
+ * An instruction's use nodes are parallel to its operands[] array, so the
+ * operand index is (use - use->user->uses). */
+typedef struct anvil_use {
+    struct anvil_instr *user;
+    struct anvil_use *prev;
+    struct anvil_use *next;
+} anvil_use_t;
+
+/* Operands stored inside the instruction; more spill to the arena */
+#define ANVIL_INSTR_INLINE_OPS 3
+
 /* Instruction structure */
 typedef struct anvil_instr {
     anvil_op_t op;
+    anvil_pool_t *pool;            /* Arena owning this instruction */
     anvil_value_t *result;
-    anvil_value_t **operands;
+    anvil_value_t **operands;      /* inline_ops until spilled */
+    anvil_use_t *uses;             /* One use node per operand */
     size_t num_operands;
+    size_t cap_operands;
     anvil_block_t *parent;
     struct anvil_instr *prev;
     struct anvil_instr *next;
@@ -62,6 +116,10 @@ typedef struct anvil_instr {
     
     /* For struct_gep - stores struct type for offset calculation */
     anvil_type_t *aux_type;
+    
+    /* Inline operand storage (binops, loads, stores, branches) */
+    anvil_value_t *inline_ops[ANVIL_INSTR_INLINE_OPS];
+    anvil_use_t inline_uses[ANVIL_INSTR_INLINE_OPS];
 } anvil_instr_t;
 
 /* Value structure */
@@ -71,6 +129,10 @@ struct anvil_value {
     char *name;
     uint32_t id;
     
+    /* Def-use chain: operands referring to this value */
+    anvil_use_t *uses;
+    size_t num_uses;
+    
     union {
         int64_t i;
         uint64_t u;
@@ -81,6 +143,7 @@ struct anvil_value {
         struct {
             anvil_linkage_t linkage;
             anvil_value_t *init;
+            bool is_extern;     /* Declared by anvil_module_add_extern */
         } global;
         struct {
             size_t index;
@@ -100,6 +163,9 @@ struct anvil_type {
     size_t align;          /* Alignment in bytes */
     bool is_signed;
     
+    /* Interned pointer-to-this type (see anvil_type_ptr) */
+    anvil_type_t *ptr_to;
+    
     union {
         /* Pointer type */
         anvil_type_t *pointee;
@@ -138,11 +204,20 @@ struct anvil_block {
     struct anvil_block *next;
     uint32_t id;
     
-    /* For control flow analysis */
+    /* CFG edges, one entry per edge of the last instruction (a br_cond
+     * with both arms on one block adds two). Kept current by the
+     * instruction helpers and anvil_instr_set_succ. */
     anvil_block_t **preds;
     size_t num_preds;
+    size_t cap_preds;
     anvil_block_t **succs;
     size_t num_succs;
+    size_t cap_succs;
+    
+    bool no_unroll;                /* Loop header made or kept by unrolling */
+    uint32_t changed_at;           /* parent->change_stamp at the last edit */
+    uint32_t order;                /* Grows along the block list; 0 once unlinked */
+    uint32_t worklist_stamp;       /* parent->change_stamp when last queued */
 };
 
 /* Function structure */
@@ -166,10 +241,34 @@ struct anvil_func {
     /* Stack frame info */
     size_t stack_size;
     size_t max_call_args;
+    size_t slot_bytes;              /* Frame slot bytes without sharing */
+    size_t slot_bytes_colored;      /* ... and after stack-slot coloring */
     
     /* Declaration only (no body) - for external functions */
     bool is_declaration;
     
+    /* Cached CFG analyses, built on first use (see opt/dom.c) */
+    struct anvil_domtree *domtree;
+    struct anvil_loop_info *loops;
+    
+    /* Change tracking (see core/function.c): the pass manager bumps
+     * change_stamp before each pass, and a block-local pass visits the
+     * blocks changed at or after visit_since, taken from the log */
+    uint32_t change_stamp;
+    uint32_t last_change;           /* Stamp of the latest edit anywhere */
+    uint32_t visit_since;           /* 0: every block */
+    uint32_t last_order;            /* Order of the last block in the list */
+    bool order_stale;               /* Blocks moved: renumber before use */
+    bool log_changes;               /* Set while the pass manager runs */
+    anvil_block_t **change_log;     /* Blocks as first marked at each stamp */
+    size_t num_change_log;
+    size_t cap_change_log;
+    size_t visit_log;               /* Log entries since visit_since start here */
+    anvil_block_t **worklist;       /* Blocks to visit, in block-list order */
+    size_t num_worklist;
+    size_t cap_worklist;
+    int worklist_state;             /* ANVIL_WORKLIST_* */
+    
     /* Associated value for use in calls */
     anvil_value_t *value;
 };
@@ -198,6 +297,9 @@ struct anvil_module {
         size_t cap;
     } strings;
     
+    /* Arena for all IR owned by this module */
+    anvil_pool_t pool;
+    
     struct anvil_module *next;
 };
 
@@ -206,6 +308,8 @@ struct anvil_backend {
     const anvil_backend_ops_t *ops;
     anvil_ctx_t *ctx;
     anvil_syntax_t syntax;
+    anvil_write_fn sink;        /* Streaming output, set during codegen_to_sink */
+    void *sink_data;
     void *priv;
 };
 
@@ -242,16 +346,31 @@ struct anvil_ctx {
     anvil_type_t *type_f32;
     anvil_type_t *type_f64;
     
-    /* Memory pool */
-    anvil_pool_t *pool;
+    /* Structural intern table for derived types (see types.c) */
+    struct {
+        anvil_type_t **slots;
+        size_t count;
+        size_t cap;
+    } type_table;
+    
+    /* Uniquing table for scalar, null and string constants (see value.c) */
+    struct {
+        anvil_value_t **slots;
+        size_t count;
+        size_t cap;
+    } const_table;
+    
+    /* Arena for context-lifetime objects (types, constants) */
+    anvil_pool_t pool;
     
     /* Modules */
     anvil_module_t *modules;
     
-    /* ID counters */
+    /* ID counters; optimization workers reserve ranges of them */
     uint32_t next_value_id;
     uint32_t next_block_id;
     uint32_t next_func_id;
+    bool workers;
     
     /* Error handling */
     char error_msg[256];
@@ -260,6 +379,12 @@ struct anvil_ctx {
     /* Optimization */
     struct anvil_pass_manager *pass_manager;
     int opt_level;  /* anvil_opt_level_t */
+    
+    /* Code generation threads (0 = one per online CPU) */
+    int codegen_threads;
+    
+    /* Recursive; the arenas point at it while passes run in parallel */
+    anvil_mutex_t lock;
 };
 
 /* ============================================================================
@@ -272,6 +397,15 @@ void *anvil_realloc(anvil_ctx_t *ctx, void *ptr, size_t old_size, size_t new_siz
 char *anvil_strdup(anvil_ctx_t *ctx, const char *str);
 void anvil_pool_init(anvil_pool_t *pool, size_t block_size);
 void anvil_pool_destroy(anvil_pool_t *pool);
+void *anvil_pool_alloc(anvil_pool_t *pool, size_t size);
+void *anvil_pool_realloc(anvil_pool_t *pool, void *ptr, size_t old_size, size_t new_size);
+char *anvil_pool_strdup(anvil_pool_t *pool, const char *str);
+
+/* Give src's chunks to dst, behind dst's current chunk; src is left empty */
+void anvil_pool_merge(anvil_pool_t *dst, anvil_pool_t *src);
+
+/* Arena for IR built at the current insertion point */
+anvil_pool_t *anvil_ctx_ir_pool(anvil_ctx_t *ctx);
 
 /* String buffer */
 void anvil_strbuf_init(anvil_strbuf_t *sb);
@@ -280,24 +414,543 @@ void anvil_strbuf_append(anvil_strbuf_t *sb, const char *str);
 void anvil_strbuf_appendf(anvil_strbuf_t *sb, const char *fmt, ...);
 void anvil_strbuf_append_char(anvil_strbuf_t *sb, char c);
 char *anvil_strbuf_detach(anvil_strbuf_t *sb, size_t *len);
+void anvil_strbuf_set_sink(anvil_strbuf_t *sb, anvil_write_fn sink, void *data);
+anvil_error_t anvil_strbuf_flush(anvil_strbuf_t *sb);
+/* Finish module output: flush to the sink if one is attached (output
+ * becomes NULL), otherwise detach the buffer into output */
+anvil_error_t anvil_strbuf_finish(anvil_strbuf_t *sb, char **output, size_t *len);
+
+/* Emission primitives for hot backend paths: no format parsing */
+void anvil_strbuf_append_n(anvil_strbuf_t *sb, const char *str, size_t len);
+void anvil_strbuf_append_int(anvil_strbuf_t *sb, int64_t val);
+void anvil_strbuf_append_uint(anvil_strbuf_t *sb, uint64_t val);
+/* Lowercase hex without prefix, zero-padded to min_digits */
+void anvil_strbuf_append_hex(anvil_strbuf_t *sb, uint64_t val, int min_digits);
+/* "\t<mnemonic><suffix> "; suffix may be NULL */
+void anvil_strbuf_append_mnemonic(anvil_strbuf_t *sb, const char *mnemonic, const char *suffix);
+/* "<prefix><name>" and "<prefix><decimal>"; prefix ("%", "$", "#") may be NULL */
+void anvil_strbuf_append_reg(anvil_strbuf_t *sb, const char *prefix, const char *name);
+void anvil_strbuf_append_imm(anvil_strbuf_t *sb, const char *prefix, int64_t val);
+/* Block label "<prefix><func>_<block>", e.g. ".Lmain_entry" */
+void anvil_strbuf_append_label(anvil_strbuf_t *sb, const char *prefix,
+                               const char *func, const char *block);
 
 /* Value creation */
-anvil_value_t *anvil_value_create(anvil_ctx_t *ctx, anvil_val_kind_t kind,
+anvil_value_t *anvil_value_create(anvil_ctx_t *ctx, anvil_pool_t *pool, anvil_val_kind_t kind,
                                    anvil_type_t *type, const char *name);
 
+/* Constant uniquing table teardown */
+void anvil_const_table_destroy(anvil_ctx_t *ctx);
+
 /* Instruction creation */
 anvil_instr_t *anvil_instr_create(anvil_ctx_t *ctx, anvil_op_t op,
                                    anvil_type_t *type, const char *name);
+anvil_instr_t *anvil_instr_create_in(anvil_ctx_t *ctx, anvil_pool_t *pool, anvil_op_t op,
+                                      anvil_type_t *type, const char *name);
 void anvil_instr_add_operand(anvil_instr_t *instr, anvil_value_t *val);
+void anvil_instr_reserve_operands(anvil_instr_t *instr, size_t count);
 void anvil_instr_insert(anvil_ctx_t *ctx, anvil_instr_t *instr);
 
+/* Link instr into block before pos (pos NULL: at the end) */
+void anvil_instr_insert_before(anvil_block_t *block, anvil_instr_t *pos, anvil_instr_t *instr);
+
+/* Operand mutation (keeps def-use chains up to date).
+ * Passes must never assign instr->operands[i] directly. */
+void anvil_instr_set_operand(anvil_instr_t *instr, size_t index, anvil_value_t *val);
+void anvil_instr_clear_operands(anvil_instr_t *instr);
+
+/* Drop a phi's incoming entry; the last entry moves into its place */
+void anvil_phi_remove_incoming(anvil_instr_t *phi, size_t index);
+
+/* Turn an instruction into a NOP and drop its uses; DCE unlinks it later */
+void anvil_instr_kill(anvil_instr_t *instr);
+
+/* Unlink an instruction from its block and drop its uses */
+void anvil_instr_remove(anvil_instr_t *instr);
+
+/* Move an instruction, operands and all, before pos in block (pos NULL: at the end) */
+void anvil_instr_move_before(anvil_block_t *block, anvil_instr_t *pos, anvil_instr_t *instr);
+
+/* Retarget a branch (index 0: true_block, 1: false_block). Passes must
+ * never assign the target fields of a linked terminator directly. */
+void anvil_instr_set_succ(anvil_instr_t *term, size_t index, anvil_block_t *dest);
+
+/* CFG edge lists (see core/function.c). The instruction helpers call
+ * these; passes that move instructions between blocks by hand call
+ * anvil_block_update_succs on the blocks whose last instruction changed.
+ * Unlike the helpers, these leave the cached CFG analyses to the caller. */
+void anvil_block_add_edge(anvil_block_t *from, anvil_block_t *to);
+void anvil_block_remove_edge(anvil_block_t *from, anvil_block_t *to);
+void anvil_block_clear_succs(anvil_block_t *block);
+void anvil_block_update_succs(anvil_block_t *block);
+
+/* Change tracking (see core/function.c). The instruction helpers mark
+ * the block they edit, and the defining block of every value that gains
+ * or loses a use; code that edits fields by hand marks the block itself. */
+void anvil_block_mark_changed(anvil_block_t *block);
+void anvil_func_mark_changed(anvil_func_t *func);
+
+/* Whether a pass confined to changed blocks must look at block: it was
+ * edited since the pass last ran (always true outside the pass manager) */
+static inline bool anvil_block_needs_visit(const anvil_block_t *block)
+{
+    return block->changed_at >= block->parent->visit_since;
+}
+
+/* The blocks a block-local pass visits, in block-list order: those that
+ * need a visit, including ones the pass itself edits ahead of it. Every
+ * block when visit_since is 0. Calling first again starts over. */
+anvil_block_t *anvil_func_changed_first(anvil_func_t *func);
+anvil_block_t *anvil_func_changed_next(anvil_block_t *block);
+
+enum {
+    ANVIL_WORKLIST_NONE,            /* Not built yet for this pass */
+    ANVIL_WORKLIST_LIST,            /* worklist holds the blocks */
+    ANVIL_WORKLIST_WALK             /* Too many: walk the block list */
+};
+
+/* Block list edits that keep the order numbers valid */
+void anvil_block_unlink(anvil_block_t *block);
+void anvil_block_move_before(anvil_block_t *block, anvil_block_t *pos);
+
+/* Rebuild every block's edges from its terminator and drop the cached
+ * analyses, after code that may have assigned branch targets directly */
+void anvil_func_update_cfg(anvil_func_t *func);
+
+/* Check every block's edge lists against the terminators. The pass
+ * manager checks it after each pass when anvil_pass_manager_set_verify
+ * turned checking on. */
+bool anvil_func_verify_cfg(const anvil_func_t *func);
+
 /* Type utilities */
 void anvil_type_init_sizes(anvil_ctx_t *ctx);
 anvil_type_t *anvil_type_create(anvil_ctx_t *ctx, anvil_type_kind_t kind);
+void anvil_type_table_destroy(anvil_ctx_t *ctx);
 
 /* Error handling */
 void anvil_set_error(anvil_ctx_t *ctx, anvil_error_t err, const char *fmt, ...);
 
+/* ============================================================================
+ * Dense value map (see value_map.c)
+ * ============================================================================
+ *
+ * Maps the parameters and instruction results of one function to an
+ * int32_t (a frame offset, an index, ...) in O(1). Entries are indexed by
+ * value id relative to the lowest id in the function; values created
+ * later grow the table. When the ids are scattered (passes that run after
+ * the whole module was built create values with much later ids), the map
+ * switches to an open-addressed hash on the id instead.
+ */
+
+#define ANVIL_VALUE_MAP_NONE INT32_MIN
+
+typedef struct {
+    int32_t *entries;       /* Entry per slot, or ANVIL_VALUE_MAP_NONE */
+    uint32_t *keys;         /* Hashed: value id per slot */
+    uint32_t base;          /* Dense: id of entries[0] */
+    uint32_t count;         /* Dense: ids covered; hashed: table size */
+    size_t used;            /* Entries set */
+    size_t cap;             /* Allocated slots, kept across resets */
+    bool hashed;
+} anvil_value_map_t;
+
+/* Clear the map and size it for func's values */
+anvil_error_t anvil_value_map_reset(anvil_value_map_t *map, anvil_func_t *func);
+anvil_error_t anvil_value_map_set(anvil_value_map_t *map, anvil_value_t *val, int32_t entry);
+int32_t anvil_value_map_get(const anvil_value_map_t *map, const anvil_value_t *val);
+void anvil_value_map_free(anvil_value_map_t *map);
+
+/* ============================================================================
+ * Liveness analysis (see liveness.c)
+ * ============================================================================
+ *
+ * Instructions are numbered in block layout order. Every block gets one
+ * extra index just before its terminator, the copy point, where backends
+ * place the moves for successor phis. Instruction k reads its operands at
+ * position 2k and writes its result at 2k+1; index 0 is the function
+ * entry, so parameters are defined at position 1.
+ *
+ * Values are numbered densely: parameters first, then instruction results
+ * in layout order, so the values a block defines form one contiguous range.
+ * Only values that are live across a block boundary (used in another
+ * block or by a phi, and all parameters) get a bit in the block sets;
+ * block-local values only have a live range. This keeps the sets small
+ * for large functions where most temporaries die where they are defined.
+ */
+
+/* Bitsets */
+#define ANVIL_BITSET_WORDS(n)     (((n) + 63) / 64)
+#define ANVIL_BITSET_SET(s, i)    ((s)[(i) >> 6] |= (uint64_t)1 << ((i) & 63))
+#define ANVIL_BITSET_CLEAR(s, i)  ((s)[(i) >> 6] &= ~((uint64_t)1 << ((i) & 63)))
+#define ANVIL_BITSET_TEST(s, i)   ((((s)[(i) >> 6]) >> ((i) & 63)) & 1)
+
+typedef struct {
+    anvil_block_t *block;
+    int first;              /* Index of the first instruction */
+    int copy;               /* Copy point */
+    int last;               /* Last index in the block */
+    uint32_t def_lo;        /* Value numbers defined here: [def_lo, def_hi) */
+    uint32_t def_hi;
+    uint32_t bit_lo;        /* Their bits: [bit_lo, bit_hi) */
+    uint32_t bit_hi;
+    uint64_t *live_in;      /* Indexed by bit */
+    uint64_t *live_out;     /* Includes operands of successor phis on this edge */
+} anvil_live_block_t;
+
+/* Hull of the positions where a value is live (start < 0: never live) */
+typedef struct {
+    anvil_value_t *value;
+    int start;
+    int end;
+} anvil_live_range_t;
+
+typedef struct {
+    anvil_func_t *func;
+
+    anvil_live_range_t *ranges;     /* Indexed by value number */
+    size_t num_values;
+    anvil_value_map_t value_num;    /* Value -> value number */
+
+    int32_t *value_bit;             /* Value number -> bit, or -1 if block-local */
+    int32_t *bit_value;             /* Bit -> value number */
+    size_t num_bits;
+
+    anvil_live_block_t *blocks;     /* Layout order */
+    size_t num_blocks;
+    int32_t *block_num;             /* block id - block_base -> blocks[] index, or -1 */
+    uint32_t block_base;
+    uint32_t block_count;
+    int32_t (*succs)[2];            /* Successor indices from the terminator, -1 = none */
+    int32_t *preds;                 /* Block b: preds[pred_start[b] .. pred_start[b + 1]) */
+    size_t *pred_start;
+
+    size_t words;                   /* uint64_t words per bitset */
+    int num_indices;                /* Instruction indices, copy points included */
+    uint64_t *sets;                 /* Storage for all live_in/live_out sets */
+} anvil_liveness_t;
+
+anvil_error_t anvil_liveness_compute(anvil_liveness_t *lv, anvil_func_t *func);
+void anvil_liveness_free(anvil_liveness_t *lv);
+
+/* Value number of an instruction result or parameter, or -1 */
+int32_t anvil_liveness_value_num(const anvil_liveness_t *lv, anvil_value_t *val);
+anvil_live_block_t *anvil_liveness_block(const anvil_liveness_t *lv, anvil_block_t *block);
+
+/* True if the copy point comes right before instr. Walking a block:
+ *   k = lb->first; for each instr { if (copy_before(instr)) k++; ...; k++; } */
+bool anvil_liveness_copy_before(const anvil_instr_t *instr);
+
+/* True if val is live on entry to / exit from block */
+bool anvil_liveness_live_in(const anvil_liveness_t *lv, anvil_block_t *block,
+                            anvil_value_t *val);
+bool anvil_liveness_live_out(const anvil_liveness_t *lv, anvil_block_t *block,
+                             anvil_value_t *val);
+
+/* ============================================================================
+ * Dominator tree and loops (see opt/dom.c, opt/loops.c; freed by core/function.c)
+ * ============================================================================
+ *
+ * Blocks reachable from the entry are numbered in reverse postorder
+ * (the entry is 0) and every array below is indexed by that number.
+ * Unreachable blocks have no number.
+ *
+ * anvil_func_domtree() and anvil_func_loops() cache their result on the
+ * function until anvil_func_invalidate_cfg() drops it. The builder and
+ * the instruction helpers call that when they add or remove a branch or
+ * a block; a pass that retargets branches in place must call it itself,
+ * and the pass manager calls it after a custom pass changes anything.
+ */
+
+typedef struct anvil_domtree {
+    anvil_func_t *func;
+
+    anvil_block_t **blocks;         /* Reverse postorder */
+    size_t num_blocks;
+    int32_t *block_num;             /* block id - block_base -> RPO index, or -1 */
+    uint32_t block_base;
+    uint32_t block_count;
+    int32_t *preds;                 /* Block b: preds[pred_start[b] .. pred_start[b + 1]) */
+    int32_t *pred_start;
+
+    int32_t *idom;                  /* Immediate dominator; the entry is its own */
+    int32_t *children;              /* Dominator tree, CSR like preds */
+    int32_t *child_start;
+    int32_t *pre;                   /* Preorder number in the tree */
+    int32_t *last;                  /* Highest preorder number in the subtree */
+
+    int32_t *df;                    /* Dominance frontiers, CSR like preds; */
+    int32_t *df_start;              /* NULL until anvil_domtree_frontiers() */
+} anvil_domtree_t;
+
+anvil_error_t anvil_domtree_compute(anvil_domtree_t *dt, anvil_func_t *func);
+void anvil_domtree_free(anvil_domtree_t *dt);
+
+/* Build the dominance frontiers (the entry never counts as a join point) */
+anvil_error_t anvil_domtree_frontiers(anvil_domtree_t *dt);
+
+/* RPO index of a block, or -1 if it is unreachable */
+int32_t anvil_domtree_index(const anvil_domtree_t *dt, const anvil_block_t *block);
+
+/* True if block a dominates block b (by RPO index) */
+bool anvil_domtree_dominates(const anvil_domtree_t *dt, int32_t a, int32_t b);
+
+/* Successors named by a block's terminator, without duplicates */
+size_t anvil_block_succs(const anvil_block_t *block, anvil_block_t *succs[2]);
+
+/* Natural loop: the blocks that reach a back edge into the header
+ * without passing through it. Irreducible cycles are not loops. */
+typedef struct {
+    int32_t header;
+    int32_t preheader;              /* Only pred from outside, branching only to the header; or -1 */
+    int32_t parent;                 /* Enclosing loop, or -1 */
+    uint32_t depth;                 /* 1 for an outermost loop */
+    int32_t *blocks;                /* In RPO, the header first */
+    size_t num_blocks;
+    int32_t *latches;               /* Sources of the back edges */
+    size_t num_latches;
+    int32_t *exits;                 /* Blocks outside the loop entered from inside */
+    size_t num_exits;
+} anvil_loop_t;
+
+typedef struct anvil_loop_info {
+    const anvil_domtree_t *dt;      /* Block numbering of the sets below */
+    anvil_loop_t *loops;            /* By header RPO: outer loops before inner */
+    size_t num_loops;
+    int32_t *block_loop;            /* Innermost loop of each block, or -1 */
+    int32_t *storage;               /* Backs the loops' block lists */
+} anvil_loop_info_t;
+
+anvil_error_t anvil_loops_compute(anvil_loop_info_t *li, const anvil_domtree_t *dt);
+void anvil_loops_free(anvil_loop_info_t *li);
+
+/* True if block b (RPO index) is inside loop l, nested loops included */
+bool anvil_loop_contains(const anvil_loop_info_t *li, int32_t l, int32_t b);
+
+/* Loop depth of a block: 0 outside loops or when it is unreachable */
+uint32_t anvil_loop_depth(const anvil_loop_info_t *li, const anvil_block_t *block);
+
+/* Cached analyses of a function, or NULL when out of memory */
+anvil_domtree_t *anvil_func_domtree(anvil_func_t *func);
+anvil_domtree_t *anvil_func_dom_frontiers(anvil_func_t *func);
+anvil_loop_info_t *anvil_func_loops(anvil_func_t *func);
+void anvil_func_invalidate_cfg(anvil_func_t *func);
+
+/* ============================================================================
+ * Stack-slot coloring (see stack_color.c)
+ * ============================================================================
+ *
+ * Values whose lifetimes do not overlap share a frame slot. An SSA value
+ * occupies its slot over its live range. An alloca occupies it from the
+ * first to the last access of the memory (loads and stores through the
+ * alloca or pointers derived from it with gep/bitcast, plus the alloca
+ * itself, which some backends zero-initialize); an alloca whose address
+ * escapes keeps its slot for the whole function.
+ *
+ * Backends keep their own offset scheme: the first value placed in a slot
+ * picks the offset, the others reuse it. A slot is as large as its
+ * largest member.
+ */
+
+/* Size of the frame slot a backend wants for val (0 = none); sets *align */
+typedef int (*anvil_slot_size_fn)(anvil_value_t *val, int *align, void *data);
+
+typedef struct {
+    int size;
+    int align;
+    int offset;             /* Backend frame offset, valid once placed */
+    bool placed;
+} anvil_frame_slot_t;
+
+typedef struct {
+    const anvil_liveness_t *live;
+    anvil_liveness_t own_live;      /* Used when the caller passes no liveness */
+
+    int32_t *value_slot;            /* Value number -> slot, or -1 */
+    anvil_frame_slot_t *slots;
+    size_t num_slots;
+
+    size_t num_values;              /* Values that asked for a slot */
+    size_t bytes_requested;         /* Frame bytes without sharing */
+    size_t bytes_colored;           /* Frame bytes after sharing */
+} anvil_stack_colors_t;
+
+/* lv may be NULL, in which case liveness is computed (and owned) here.
+ * Records bytes_requested/bytes_colored on func for the frame report. */
+anvil_error_t anvil_stack_color(anvil_stack_colors_t *sc, anvil_func_t *func,
+                                const anvil_liveness_t *lv,
+                                anvil_slot_size_fn size_fn, void *data);
+void anvil_stack_colors_free(anvil_stack_colors_t *sc);
+
+/* Slot assigned to val, or NULL if it has none */
+anvil_frame_slot_t *anvil_stack_color_slot(const anvil_stack_colors_t *sc, anvil_value_t *val);
+
+/* ============================================================================
+ * Parallel work (see parallel.c)
+ * ============================================================================ */
+
+/* Runs one item on the given worker (0 .. threads - 1) */
+typedef anvil_error_t (*anvil_parallel_fn)(void *data, size_t worker, size_t index);
+
+/* Worker count for a thread setting (0 = one per online CPU; at least 1) */
+int anvil_parallel_threads(int threads);
+
+/* Run fn on items 0 .. count - 1 with up to threads workers, the calling
+ * thread included. Returns the error of the lowest failing item; items
+ * after a failure may be skipped. */
+anvil_error_t anvil_parallel_for(int threads, size_t count, anvil_parallel_fn fn, void *data);
+
+void anvil_mutex_init(anvil_mutex_t *mutex);
+void anvil_mutex_destroy(anvil_mutex_t *mutex);
+
+/* Private state of an optimization worker. What it allocates from the
+ * module arena goes to its own arena, and it numbers values and blocks
+ * from id ranges it reserves in batches. */
+typedef struct {
+    anvil_pool_t *shared;           /* Module arena redirected to arena */
+    anvil_pool_t arena;
+    uint32_t next_value_id, end_value_id;
+    uint32_t next_block_id, end_block_id;
+} anvil_worker_t;
+
+/* Between begin and end, workers may transform different functions of
+ * mod at once. Each calls anvil_worker_enter() with its own state from
+ * the returned array (NULL if out of memory) before touching the IR.
+ * Only the state every function shares takes ctx->lock, which the
+ * context arena and mod's arena point at: constant and type interning
+ * and the use-lists of globals and functions. End moves the workers'
+ * arenas into mod's. */
+anvil_worker_t *anvil_parallel_begin(anvil_ctx_t *ctx, anvil_module_t *mod, int threads);
+void anvil_worker_enter(anvil_worker_t *worker);
+void anvil_parallel_end(anvil_ctx_t *ctx, anvil_module_t *mod, anvil_worker_t *workers, int threads);
+
+/* The calling worker's arena for allocations from pool */
+anvil_pool_t *anvil_worker_pool(anvil_pool_t *pool);
+
+uint32_t anvil_worker_value_id(anvil_ctx_t *ctx);
+uint32_t anvil_worker_block_id(anvil_ctx_t *ctx);
+
+static inline uint32_t anvil_new_value_id(anvil_ctx_t *ctx)
+{
+    return ctx->workers ? anvil_worker_value_id(ctx) : ctx->next_value_id++;
+}
+
+static inline uint32_t anvil_new_block_id(anvil_ctx_t *ctx)
+{
+    return ctx->workers ? anvil_worker_block_id(ctx) : ctx->next_block_id++;
+}
+
+/* ============================================================================
+ * ELF object writer (see elf.c)
+ * ============================================================================
+ *
+ * Backends that encode machine code fill in an anvil_elf_object_t from
+ * their codegen_object hook: section bytes, symbols and relocations with
+ * the target's own R_* numbers. The core lays out the ELF64 relocatable
+ * object (header, .symtab, .strtab, .rela.* and .shstrtab) and writes it
+ * to a buffer or, one pwrite per section, to a file descriptor.
+ *
+ * Relocations name either a symbol (index into syms) or a section
+ * (-1 - section, e.g. for references to local labels). Symbols are kept
+ * in the order they were added; the writer puts locals before globals.
+ */
+
+typedef enum {
+    ANVIL_ELF_TEXT,
+    ANVIL_ELF_DATA,
+    ANVIL_ELF_RODATA,
+    ANVIL_ELF_NUM_SECTIONS
+} anvil_elf_section_t;
+
+#define ANVIL_ELF_UNDEF (-1)
+
+/* Values are the ELF STB_ and STT_ codes */
+typedef enum {
+    ANVIL_ELF_LOCAL,
+    ANVIL_ELF_GLOBAL,
+    ANVIL_ELF_WEAK
+} anvil_elf_bind_t;
+
+typedef enum {
+    ANVIL_ELF_NOTYPE,
+    ANVIL_ELF_OBJECT,
+    ANVIL_ELF_FUNC
+} anvil_elf_sym_type_t;
+
+typedef struct {
+    char *name;
+    int section;                /* anvil_elf_section_t, or ANVIL_ELF_UNDEF */
+    uint64_t offset;
+    uint64_t size;
+    anvil_elf_bind_t bind;      /* Undefined symbols are always global */
+    anvil_elf_sym_type_t type;
+} anvil_elf_symbol_t;
+
+typedef struct {
+    int section;                /* Section holding the field */
+    uint64_t offset;
+    uint32_t type;              /* R_* code for the machine */
+    long sym;                   /* Symbol index, or -1 - section */
+    int64_t addend;
+} anvil_elf_reloc_t;
+
+struct anvil_elf_object {
+    anvil_ctx_t *ctx;
+    uint16_t machine;           /* e_machine */
+    uint32_t flags;             /* e_flags */
+    bool big_endian;
+    uint32_t reloc_abs64;       /* R_* code of a 64-bit absolute address */
+
+    anvil_strbuf_t sec[ANVIL_ELF_NUM_SECTIONS];
+    size_t align[ANVIL_ELF_NUM_SECTIONS];
+
+    anvil_elf_symbol_t *syms;
+    size_t num_syms, syms_cap;
+    size_t *sym_table;          /* name -> index + 1, open addressing */
+    size_t sym_table_cap;
+
+    anvil_elf_reloc_t *relocs;
+    size_t num_relocs, relocs_cap;
+
+    anvil_error_t err;          /* First allocation failure */
+};
+
+/* Set up an empty object for ctx's target; fails for targets without
+ * an ELF64 machine code */
+anvil_error_t anvil_elf_init(anvil_elf_object_t *obj, anvil_ctx_t *ctx);
+void anvil_elf_free(anvil_elf_object_t *obj);
+
+/* Index of the symbol with this name, created undefined if new */
+long anvil_elf_symbol(anvil_elf_object_t *obj, const char *name, size_t len);
+
+/* Define name at offset in section (an existing undefined symbol is
+ * reused). Returns the symbol index, or -1 if it is already defined. */
+long anvil_elf_define(anvil_elf_object_t *obj, const char *name, int section,
+                      uint64_t offset, anvil_elf_bind_t bind, anvil_elf_sym_type_t type);
+
+void anvil_elf_add_reloc(anvil_elf_object_t *obj, int section, uint64_t offset,
+                         uint32_t type, long sym, int64_t addend);
+
+/* Append a value in the object's byte order */
+void anvil_elf_put(anvil_elf_object_t *obj, int section, uint64_t value, int bytes);
+
+/* Pad section to a multiple of align with zeros */
+void anvil_elf_align(anvil_elf_object_t *obj, int section, size_t align);
+
+/* Lay out the module's global variables from their initializers: .data,
+ * with string literals they point to in .rodata. Function declarations
+ * and anvil_module_add_extern symbols are left undefined. */
+anvil_error_t anvil_elf_add_globals(anvil_elf_object_t *obj, anvil_module_t *mod);
+
+/* Serialize the object into a malloc'd buffer */
+anvil_error_t anvil_elf_write(const anvil_elf_object_t *obj, char **output, size_t *len);
+
+/* Write the object at offset base of fd, one pwrite per section */
+anvil_error_t anvil_elf_write_fd(const anvil_elf_object_t *obj, int fd, uint64_t base);
+
+/* Write the object to file: through its descriptor when the stream is
+ * positioned at its end, otherwise through a buffer */
+anvil_error_t anvil_elf_write_file(const anvil_elf_object_t *obj, FILE *file);
+
 /* ============================================================================
  * Backend registration
  * ============================================================================ */
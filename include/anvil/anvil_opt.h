@@ -34,7 +34,10 @@ typedef enum {
     ANVIL_PASS_LOAD_ELIM,        /* Redundant load elimination (O2+) */
     ANVIL_PASS_STORE_LOAD_PROP,  /* Store-load propagation (Og+) */
     ANVIL_PASS_LOOP_UNROLL,      /* Loop unrolling (O3+) */
-    ANVIL_PASS_COMMON_SUBEXPR,   /* Common subexpression elimination (O2+) */
+    ANVIL_PASS_COMMON_SUBEXPR,   /* Block-local CSE (off by default, superseded by GVN) */
+    ANVIL_PASS_GVN,              /* Global value numbering (O2+) */
+    ANVIL_PASS_MEM2REG,          /* Promote allocas to SSA values (O1+) */
+    ANVIL_PASS_LICM,             /* Loop-invariant code motion (O2+) */
     ANVIL_PASS_COUNT
 } anvil_pass_id_t;
 
@@ -53,6 +56,30 @@ typedef struct {
     anvil_opt_level_t min_level;  /* Minimum opt level to enable this pass */
 } anvil_pass_info_t;
 
+/* Statistics for one pass, summed over every function it ran on */
+typedef struct {
+    const char *name;
+    uint64_t runs;              /* Times the pass was run */
+    uint64_t skipped;           /* Turns skipped: nothing changed since its last run */
+    uint64_t changed;           /* Runs that reported a change */
+    uint64_t blocks_changed;    /* Blocks it edited, summed over runs */
+    double time_ms;             /* Wall time spent in the pass */
+    uint64_t instrs_removed;    /* Instructions killed or unlinked */
+    uint64_t instrs_added;      /* Instructions inserted */
+    uint64_t instrs_rewritten;  /* Kept instructions with a new opcode or operands */
+} anvil_pass_stats_t;
+
+/* Statistics for the pass manager as a whole */
+typedef struct {
+    uint64_t funcs;             /* Function bodies optimized */
+    uint64_t iterations;        /* Iterations to fixpoint, summed over functions */
+    uint64_t max_iterations;    /* Most iterations one function needed */
+    uint64_t instrs_before;     /* Instructions on entry, summed over functions */
+    uint64_t instrs_after;      /* Instructions on exit, summed over functions */
+    uint64_t peak_instrs;       /* Largest function seen, after any pass */
+    double time_ms;             /* Wall time in passes, summed over threads */
+} anvil_opt_stats_t;
+
 /* ============================================================================
  * Pass Manager API
  * ============================================================================ */
@@ -78,6 +105,32 @@ void anvil_pass_manager_disable(anvil_pass_manager_t *pm, anvil_pass_id_t pass);
 /* Check if a pass is enabled */
 bool anvil_pass_manager_is_enabled(anvil_pass_manager_t *pm, anvil_pass_id_t pass);
 
+/* Set how many functions anvil_pass_manager_run_module optimizes at once
+ * (default 1; 0 = one per online CPU). With more than one, custom passes
+ * must be safe to run concurrently on different functions. */
+void anvil_pass_manager_set_threads(anvil_pass_manager_t *pm, int threads);
+
+/* Get the thread count set above */
+int anvil_pass_manager_get_threads(anvil_pass_manager_t *pm);
+
+/* Check every block's edge lists against the terminators after each pass
+ * (off by default; a debugging aid that scans the whole CFG per pass).
+ * A pass that leaves them out of step aborts the run with its name. */
+void anvil_pass_manager_set_verify(anvil_pass_manager_t *pm, bool enable);
+
+/* Set the pass order from a comma-separated list of pass names, e.g.
+ * "const-fold,dce,simplify-cfg,dce" (built-in names as in the pass table,
+ * custom passes by the name they were registered with; a pass may be
+ * listed more than once). Listed built-in passes are enabled; passes not
+ * listed do not run. NULL or "" restores the default order: built-in
+ * passes in anvil_pass_id_t order, then custom passes.
+ * Returns ANVIL_ERR_INVALID_ARG for an unknown name. */
+anvil_error_t anvil_pass_manager_set_pipeline(anvil_pass_manager_t *pm, const char *pipeline);
+
+/* Write the passes that will run, in order, as a pipeline string.
+ * Returns its length; like snprintf, buf may be NULL or too small. */
+size_t anvil_pass_manager_get_pipeline(anvil_pass_manager_t *pm, char *buf, size_t size);
+
 /* Run all enabled passes on a function */
 bool anvil_pass_manager_run_func(anvil_pass_manager_t *pm, anvil_func_t *func);
 
@@ -88,6 +141,22 @@ bool anvil_pass_manager_run_module(anvil_pass_manager_t *pm, anvil_module_t *mod
 anvil_error_t anvil_pass_manager_register(anvil_pass_manager_t *pm, 
                                            const anvil_pass_info_t *pass);
 
+/* Collect statistics on later runs (off by default). Counting changed
+ * instructions costs a scan of the function around every pass. */
+void anvil_pass_manager_set_stats(anvil_pass_manager_t *pm, bool enable);
+
+/* Clear collected statistics */
+void anvil_pass_manager_reset_stats(anvil_pass_manager_t *pm);
+
+/* Totals, and per-pass statistics: built-in passes in anvil_pass_id_t
+ * order, then custom passes in registration order (*count entries) */
+const anvil_opt_stats_t *anvil_pass_manager_get_stats(anvil_pass_manager_t *pm);
+const anvil_pass_stats_t *anvil_pass_manager_get_pass_stats(anvil_pass_manager_t *pm,
+                                                            size_t *count);
+
+/* Print the statistics as a table, slowest pass first */
+void anvil_pass_manager_print_stats(anvil_pass_manager_t *pm, FILE *out);
+
 /* ============================================================================
  * Context Integration API
  * ============================================================================ */
@@ -120,7 +189,7 @@ bool anvil_pass_simplify_cfg(anvil_func_t *func);
 /* Strength reduction: replace expensive ops with cheaper ones */
 bool anvil_pass_strength_reduce(anvil_func_t *func);
 
-/* Loop unrolling: unroll small loops with known trip count */
+/* Loop unrolling: unroll counted loops, fully or with a remainder loop */
 bool anvil_pass_loop_unroll(anvil_func_t *func);
 
 /* Copy propagation: replace uses of copied values with original */
@@ -135,9 +204,20 @@ bool anvil_pass_load_elim(anvil_func_t *func);
 /* Common subexpression elimination: reuse computed values */
 bool anvil_pass_cse(anvil_func_t *func);
 
+/* Global value numbering: reuse values computed in a dominating block */
+bool anvil_pass_gvn(anvil_func_t *func);
+
 /* Store-load propagation: replace load after store with stored value */
 bool anvil_pass_store_load_prop(anvil_func_t *func);
 
+/* Register promotion: turn non-escaping allocas into SSA values and phis,
+ * splitting struct allocas into one alloca per field first */
+bool anvil_pass_mem2reg(anvil_func_t *func);
+
+/* Loop-invariant code motion: hoist invariant pure operations and loads
+ * nothing in the loop can write into the preheader, creating one if needed */
+bool anvil_pass_licm(anvil_func_t *func);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,59 @@
+// Generated by ANVIL for ARM64 (AArch64) - Linux
+	.arch armv8-a
+	.text
+
+	.globl sum_array
+	.type sum_array, %function
+sum_array:
+	str x29, [sp, #-16]!
+	mov x29, sp
+	sub sp, sp, #32
+	str x0, [x29, #-16]
+	str w1, [x29, #-24]
+	ldr x9, [x29, #-16]
+	ldrsw x0, [x9]
+	str w0, [x29, #-8]
+	ldrsw x9, [x29, #-8]
+	ldrsw x10, [x29, #-24]
+	mul w0, w9, w10
+	str w0, [x29, #-16]
+	ldrsw x0, [x29, #-16]
+	add sp, sp, #32
+	ldr x29, [sp], #16
+	ret
+	.size sum_array, .-sum_array
+
+	.globl factorial
+	.type factorial, %function
+factorial:
+	stp x29, x30, [sp, #-16]!
+	mov x29, sp
+	sub sp, sp, #32
+	str w0, [x29, #-24]
+	ldrsw x9, [x29, #-24]
+	cmp x9, #1
+	b.le .Lfactorial_base_case
+	b .Lfactorial_recurse
+.Lfactorial_recurse:
+	ldrsw x9, [x29, #-24]
+	sub w0, w9, #1
+	str w0, [x29, #-8]
+	ldrsw x9, [x29, #-8]
+	mov x0, x9
+	bl factorial
+	str w0, [x29, #-16]
+	ldrsw x9, [x29, #-24]
+	ldrsw x10, [x29, #-16]
+	mul w0, w9, w10
+	str w0, [x29, #-8]
+	ldrsw x0, [x29, #-8]
+	add sp, sp, #32
+	ldp x29, x30, [sp], #16
+	ret
+.Lfactorial_base_case:
+	mov x0, #1
+	add sp, sp, #32
+	ldp x29, x30, [sp], #16
+	ret
+	.size factorial, .-factorial
+
@@ -0,0 +1,58 @@
+# Generated by ANVIL for PowerPC 32-bit (big-endian)
+	.text
+
+	.globl sum_array
+	.type sum_array, @function
+sum_array:
+	mflr r0
+	stw r0, 4(r1)
+	stw r31, -4(r1)
+	stwu r1, -64(r1)
+	addi r31, r1, 64
+	mr r4, r3
+	lwz r3, 0(r4)
+	mullw r3, r3, r4
+	addi r1, r1, 64
+	lwz r31, -4(r1)
+	lwz r0, 4(r1)
+	mtlr r0
+	blr
+	.size sum_array, .-sum_array
+
+	.globl factorial
+	.type factorial, @function
+factorial:
+	mflr r0
+	stw r0, 4(r1)
+	stw r31, -4(r1)
+	stwu r1, -64(r1)
+	addi r31, r1, 64
+	li r4, 1
+	cmpw cr0, r3, r4
+	li r3, 0
+	ble cr0, .Lskip0
+	li r3, 1
+.Lskip0:
+	cmpwi cr0, r3, 0
+	bne cr0, .Lfactorial_base_case
+	b .Lfactorial_recurse
+.Lfactorial_recurse:
+	li r4, 1
+	sub r3, r3, r4
+	bl factorial
+	mr r4, r3
+	mullw r3, r3, r4
+	addi r1, r1, 64
+	lwz r31, -4(r1)
+	lwz r0, 4(r1)
+	mtlr r0
+	blr
+.Lfactorial_base_case:
+	li r3, 1
+	addi r1, r1, 64
+	lwz r31, -4(r1)
+	lwz r0, 4(r1)
+	mtlr r0
+	blr
+	.size factorial, .-factorial
+
@@ -0,0 +1,78 @@
+# Generated by ANVIL for PowerPC 64-bit (big-endian, ELFv1 ABI)
+	.machine "power4"
+	.abiversion 1
+	.text
+
+	.section ".opd","aw"
+	.align 3
+	.globl sum_array
+sum_array:
+	.quad .L.sum_array,.TOC.@tocbase,0
+	.previous
+	.type sum_array, @function
+.L.sum_array:
+	mflr r0
+	std r0, 16(r1)
+	std r2, 40(r1)
+	std r31, -8(r1)
+	stdu r1, -176(r1)
+	addi r31, r1, 176
+	mr r4, r3
+	ld r3, 0(r4)
+	mulld r3, r3, r4
+	addi r1, r1, 176
+	ld r31, -8(r1)
+	ld r2, 40(r1)
+	ld r0, 16(r1)
+	mtlr r0
+	blr
+	.size sum_array, .-.L.sum_array
+
+	.section ".opd","aw"
+	.align 3
+	.globl factorial
+factorial:
+	.quad .L.factorial,.TOC.@tocbase,0
+	.previous
+	.type factorial, @function
+.L.factorial:
+	mflr r0
+	std r0, 16(r1)
+	std r2, 40(r1)
+	std r31, -8(r1)
+	stdu r1, -176(r1)
+	addi r31, r1, 176
+	li r4, 1
+	cmpd cr0, r3, r4
+	li r3, 0
+	ble cr0, .Lskip0
+	li r3, 1
+.Lskip0:
+	cmpdi cr0, r3, 0
+	bne cr0, .Lfactorial_base_case
+	b .Lfactorial_recurse
+.Lfactorial_recurse:
+	li r4, 1
+	sub r3, r3, r4
+	std r2, 40(r1)
+	bl factorial
+	nop
+	ld r2, 40(r1)
+	mr r4, r3
+	mulld r3, r3, r4
+	addi r1, r1, 176
+	ld r31, -8(r1)
+	ld r2, 40(r1)
+	ld r0, 16(r1)
+	mtlr r0
+	blr
+.Lfactorial_base_case:
+	li r3, 1
+	addi r1, r1, 176
+	ld r31, -8(r1)
+	ld r2, 40(r1)
+	ld r0, 16(r1)
+	mtlr r0
+	blr
+	.size factorial, .-.L.factorial
+
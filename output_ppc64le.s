@@ -0,0 +1,66 @@
+# Generated by ANVIL for PowerPC 64-bit (little-endian, ELFv2 ABI)
+	.abiversion 2
+	.text
+
+	.globl sum_array
+	.type sum_array, @function
+sum_array:
+0:	addis r2, r12, (.TOC.-0b)@ha
+	addi r2, r2, (.TOC.-0b)@l
+	.localentry sum_array, .-0b
+	mflr r0
+	std r0, 16(r1)
+	std r31, -8(r1)
+	stdu r1, -96(r1)
+	addi r31, r1, 96
+	mr r4, r3
+	ld r3, 0(r4)
+	mulld r3, r3, r4
+	addi r1, r1, 96
+	ld r31, -8(r1)
+	ld r0, 16(r1)
+	mtlr r0
+	blr
+	.size sum_array, .-sum_array
+
+	.globl factorial
+	.type factorial, @function
+factorial:
+0:	addis r2, r12, (.TOC.-0b)@ha
+	addi r2, r2, (.TOC.-0b)@l
+	.localentry factorial, .-0b
+	mflr r0
+	std r0, 16(r1)
+	std r31, -8(r1)
+	stdu r1, -96(r1)
+	addi r31, r1, 96
+	li r4, 1
+	cmpd cr0, r3, r4
+	li r3, 0
+	ble cr0, .Lskip0
+	li r3, 1
+.Lskip0:
+	cmpdi cr0, r3, 0
+	bne cr0, .Lfactorial_base_case
+	b .Lfactorial_recurse
+.Lfactorial_recurse:
+	li r4, 1
+	sub r3, r3, r4
+	bl factorial
+	nop
+	mr r4, r3
+	mulld r3, r3, r4
+	addi r1, r1, 96
+	ld r31, -8(r1)
+	ld r0, 16(r1)
+	mtlr r0
+	blr
+.Lfactorial_base_case:
+	li r3, 1
+	addi r1, r1, 96
+	ld r31, -8(r1)
+	ld r0, 16(r1)
+	mtlr r0
+	blr
+	.size factorial, .-factorial
+
@@ -0,0 +1,118 @@
+***********************************************************************
+*        Generated by ANVIL for IBM S/390
+***********************************************************************
+         CSECT
+         AMODE ANY
+         RMODE ANY
+*
+SUM_ARRAY DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING SUM_ARRAY,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+SUM_ARRAY$ENTRY DS    0H
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         L     R15,0(,R2)        Load from address
+         LR    R2,R15            Copy result
+         L     R3,4(,R11)       Load addr of param 1
+         L     R3,0(,R3)         Load param value
+         MSR   R2,R3             Multiply single
+         LR    R15,R2            Result in R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+FACTORIAL DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING FACTORIAL,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+FACTORIAL$ENTRY DS    0H
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         LA    R3,1            Load constant
+         CR    R2,R3             Compare registers
+         LHI   R15,1             Assume true
+         JNH   *+6               Skip if condition met
+         SR    R15,R15           Set false
+         LR    R2,R15            Copy result
+         LTR   R2,R2             Test register
+         JNZ   FACTORIAL$BASE_CASE            Branch if not zero
+         J     FACTORIAL$RECURSE            Branch to else
+FACTORIAL$RECURSE DS    0H
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         LA    R3,1            Load constant
+         SR    R2,R3             Subtract registers
+         LR    R15,R2            Result in R15
+*        Call setup (reentrant)
+         LR    R0,R15            Copy result
+         ST    R0,88(,R13)       Store param 0
+         LA    R1,88(,R13)       R1 -> param list
+         OI    88(R13),X'80'     Mark last param (VL)
+         L     R15,=V(FACTORIAL)        Load entry point
+         BASR  R14,R15           Call subroutine
+         NI    88(R13),X'7F'     Clear VL bit
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         LR    R3,R15            Copy result
+         MSR   R2,R3             Multiply single
+         LR    R15,R2            Result in R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+FACTORIAL$BASE_CASE DS    0H
+         LA    R15,1            Load constant
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+*
+*        Dynamic area sizes (for GETMAIN/FREEMAIN)
+DYN@SUM_ARRAY EQU   88                 Stack frame size for SUM_ARRAY
+DYN@FACTORIAL EQU   96                 Stack frame size for FACTORIAL
+*
+         LTORG                    Literal pool
+*
+*        Register equates
+R0       EQU   0
+R1       EQU   1
+R2       EQU   2
+R3       EQU   3
+R4       EQU   4
+R5       EQU   5
+R6       EQU   6
+R7       EQU   7
+R8       EQU   8
+R9       EQU   9
+R10      EQU   10
+R11      EQU   11
+R12      EQU   12
+R13      EQU   13
+R14      EQU   14
+R15      EQU   15
+*
+         END   SUM_ARRAY
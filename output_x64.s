@@ -0,0 +1,48 @@
+# Generated by ANVIL for x86-64
+	.text
+	.globl sum_array
+	.type sum_array, @function
+sum_array:
+	pushq %rbp
+	movq %rsp, %rbp
+	subq $32, %rsp
+	movq %rdi, %rcx
+	movq (%rcx), %rax
+	movq %rsi, %rcx
+	imulq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
+	.globl factorial
+	.type factorial, @function
+factorial:
+	pushq %rbp
+	movq %rsp, %rbp
+	subq $32, %rsp
+	movq %rdi, %rax
+	movq $1, %rcx
+	cmpq %rcx, %rax
+	setle %al
+	movzbq %al, %rax
+	testq %rax, %rax
+	jnz .Lfactorial_base_case
+	jmp .Lfactorial_recurse
+.Lfactorial_recurse:
+	movq %rdi, %rax
+	movq $1, %rcx
+	subq %rcx, %rax
+	movq %rax, %rdi
+	call factorial
+	movq %rdi, %rax
+	movq %rax, %rcx
+	imulq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+.Lfactorial_base_case:
+	movq $1, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
@@ -0,0 +1,49 @@
+# Generated by ANVIL for x86
+	.text
+	.globl sum_array
+	.type sum_array, @function
+sum_array:
+	pushl %ebp
+	movl %esp, %ebp
+	subl $16, %esp
+	movl 8(%ebp), %ecx
+	movl (%ecx), %eax
+	movl 12(%ebp), %ecx
+	imull %ecx, %eax
+	movl %ebp, %esp
+	popl %ebp
+	ret
+
+	.globl factorial
+	.type factorial, @function
+factorial:
+	pushl %ebp
+	movl %esp, %ebp
+	subl $16, %esp
+	movl 8(%ebp), %eax
+	movl $1, %ecx
+	cmpl %ecx, %eax
+	setle %al
+	movzbl %al, %eax
+	testl %eax, %eax
+	jnz .Lfactorial_base_case
+	jmp .Lfactorial_recurse
+.Lfactorial_recurse:
+	movl 8(%ebp), %eax
+	movl $1, %ecx
+	subl %ecx, %eax
+	pushl %eax
+	call factorial
+	addl $4, %esp
+	movl 8(%ebp), %eax
+	movl %eax, %ecx
+	imull %ecx, %eax
+	movl %ebp, %esp
+	popl %ebp
+	ret
+.Lfactorial_base_case:
+	movl $1, %eax
+	movl %ebp, %esp
+	popl %ebp
+	ret
+
@@ -0,0 +1,117 @@
+***********************************************************************
+*        Generated by ANVIL for IBM z/Architecture
+***********************************************************************
+         CSECT
+         AMODE ANY
+         RMODE ANY
+*
+SUM_ARRAY DS    0H
+         STMG  R14,R12,24(R13)    Save caller's registers
+         LGR   R12,R15            Copy entry point to base reg
+         USING SUM_ARRAY,R12            Establish addressability
+         LGR   R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,144(,R13)       R2 -> our save area (144 bytes for 64-bit SA)
+         STG   R13,8(,R2)         Chain: new->prev = caller's
+         STG   R2,16(,R13)        Chain: caller->next = new
+         LGR   R13,R2             R13 -> our save area
+*
+SUM_ARRAY$ENTRY DS    0H
+         LG    R2,0(,R11)       Load addr of param 0
+         LG    R2,0(,R2)         Load param value
+         LG    R15,0(,R2)        Load 64-bit from address
+         LGR   R2,R15            Copy result
+         LG    R3,8(,R11)       Load addr of param 1
+         LG    R3,0(,R3)         Load param value
+         MSGR  R2,R3             Multiply single 64-bit
+         LGR   R15,R2            Result in R15
+*        Function epilogue
+         LG    R13,8(,R13)        Restore caller's SA pointer
+         LG    R14,24(,R13)       Restore return address
+         LMG   R0,R12,40(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+FACTORIAL DS    0H
+         STMG  R14,R12,24(R13)    Save caller's registers
+         LGR   R12,R15            Copy entry point to base reg
+         USING FACTORIAL,R12            Establish addressability
+         LGR   R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,144(,R13)       R2 -> our save area (144 bytes for 64-bit SA)
+         STG   R13,8(,R2)         Chain: new->prev = caller's
+         STG   R2,16(,R13)        Chain: caller->next = new
+         LGR   R13,R2             R13 -> our save area
+*
+FACTORIAL$ENTRY DS    0H
+         LG    R2,0(,R11)       Load addr of param 0
+         LG    R2,0(,R2)         Load param value
+         LGHI  R3,1           Load constant
+         CGR   R2,R3             Compare 64-bit registers
+         LGHI  R15,1             Assume true
+         JNH   *+8               Skip if condition met
+         SGR   R15,R15           Set false
+         LGR   R2,R15            Copy result
+         LTGR  R2,R2             Test 64-bit register
+         JNZ   FACTORIAL$BASE_CASE            Branch if not zero
+         J     FACTORIAL$RECURSE            Branch to else
+FACTORIAL$RECURSE DS    0H
+         LG    R2,0(,R11)       Load addr of param 0
+         LG    R2,0(,R2)         Load param value
+         LGHI  R3,1           Load constant
+         SGR   R2,R3             Subtract 64-bit registers
+         LGR   R15,R2            Result in R15
+*        Call setup (reentrant, 64-bit)
+         LGR   R0,R15            Copy result
+         STG   R0,160(,R13)       Store param 0
+         LA    R1,160(,R13)       R1 -> param list
+         OI    160(R13),X'80'     Mark last param (VL)
+         BRASL R14,FACTORIAL           Branch relative and save
+         NI    160(R13),X'7F'     Clear VL bit
+         LG    R2,0(,R11)       Load addr of param 0
+         LG    R2,0(,R2)         Load param value
+         LGR   R3,R15            Copy result
+         MSGR  R2,R3             Multiply single 64-bit
+         LGR   R15,R2            Result in R15
+*        Function epilogue
+         LG    R13,8(,R13)        Restore caller's SA pointer
+         LG    R14,24(,R13)       Restore return address
+         LMG   R0,R12,40(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+FACTORIAL$BASE_CASE DS    0H
+         LGHI  R15,1           Load constant
+*        Function epilogue
+         LG    R13,8(,R13)        Restore caller's SA pointer
+         LG    R14,24(,R13)       Restore return address
+         LMG   R0,R12,40(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+*
+*        Dynamic area sizes (for STORAGE OBTAIN/RELEASE)
+DYN@SUM_ARRAY EQU   160                 Stack frame size for SUM_ARRAY
+DYN@FACTORIAL EQU   176                 Stack frame size for FACTORIAL
+*
+         LTORG                    Literal pool
+*
+*        Register equates
+R0       EQU   0
+R1       EQU   1
+R2       EQU   2
+R3       EQU   3
+R4       EQU   4
+R5       EQU   5
+R6       EQU   6
+R7       EQU   7
+R8       EQU   8
+R9       EQU   9
+R10      EQU   10
+R11      EQU   11
+R12      EQU   12
+R13      EQU   13
+R14      EQU   14
+R15      EQU   15
+*
+         END   SUM_ARRAY
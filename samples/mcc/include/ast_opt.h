@@ -10,6 +10,7 @@
 #define MCC_AST_OPT_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -239,6 +240,13 @@ typedef struct mcc_ast_opt {
     int pass_changes[MCC_OPT_PASS_COUNT]; /* Changes per pass */
     int iterations;                 /* Number of optimization iterations */
     
+    /* Report (-ftime-report), summed over every mcc_ast_opt_run */
+    int pass_runs[MCC_OPT_PASS_COUNT];
+    int pass_total_changes[MCC_OPT_PASS_COUNT];
+    double pass_time_ms[MCC_OPT_PASS_COUNT]; /* Processor time */
+    int total_runs;                 /* Calls to mcc_ast_opt_run */
+    int total_iterations;
+    
     /* Debug */
     bool verbose;                   /* Print optimization info */
     bool dump_after_pass;           /* Dump AST after each pass */
@@ -278,4 +286,7 @@ void mcc_ast_opt_init_passes(int opt_level, mcc_opt_passes_t *passes);
 int mcc_ast_opt_get_total_changes(mcc_ast_opt_t *opt);
 int mcc_ast_opt_get_pass_changes(mcc_ast_opt_t *opt, mcc_opt_pass_id_t pass);
 
+/* Print time and changes per pass, slowest first (-ftime-report) */
+void mcc_ast_opt_print_report(mcc_ast_opt_t *opt, FILE *out);
+
 #endif /* MCC_AST_OPT_H */
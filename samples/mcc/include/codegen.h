@@ -92,6 +92,11 @@ void mcc_codegen_destroy(mcc_codegen_t *cg);
 /* Configuration */
 void mcc_codegen_set_target(mcc_codegen_t *cg, mcc_arch_t arch);
 void mcc_codegen_set_opt_level(mcc_codegen_t *cg, mcc_opt_level_t level);
+void mcc_codegen_set_object_output(mcc_codegen_t *cg, bool object);
+void mcc_codegen_set_pass_stats(mcc_codegen_t *cg, bool enable);
+
+/* Print ANVIL's IR pass statistics (needs mcc_codegen_set_pass_stats) */
+void mcc_codegen_print_pass_stats(mcc_codegen_t *cg, FILE *out);
 
 /* Main code generation entry point */
 bool mcc_codegen_generate(mcc_codegen_t *cg, mcc_ast_node_t *ast);
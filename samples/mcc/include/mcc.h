@@ -76,6 +76,8 @@ struct mcc_options {
     bool emit_sema;             /* -sema-dump */
     bool emit_sema_verbose;     /* -dump-sema-verbose */
     bool dump_ir;               /* -dump-ir */
+    bool time_report;           /* -ftime-report */
+    bool emit_object;           /* -c: ELF object instead of assembly */
     
     /* Input files (multiple file support) */
     const char **input_files;
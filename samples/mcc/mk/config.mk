@@ -6,7 +6,7 @@
 # Compiler settings
 CC = gcc
 CFLAGS = -Wall -Wextra -std=c99 -g -I../../include -Iinclude -Isrc/preprocessor -Isrc/lexer -Isrc/parser -Isrc/sema -Isrc/codegen -Isrc/opt -Isrc/ast
-LDFLAGS = -L../../lib -lanvil
+LDFLAGS = -L../../lib -lanvil -pthread
 
 # Directories
 SRCDIR = src
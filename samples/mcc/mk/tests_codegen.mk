@@ -106,6 +106,37 @@ test-codegen-multifile: $(TARGET) | $(TEST_OUTPUT_DIR)
 	fi
 	@echo ""
 
+# ============================================================
+# Optimizer Report Test
+# ============================================================
+
+# Pass rows in the ANVIL table that ran at least once
+TIME_REPORT_ROWS = awk '/ANVIL pass statistics/ { anvil = 1 } \
+	anvil && $$1 ~ /^[a-z0-9-]+$$/ && $$2 ~ /^[0-9.]+$$/ && $$4 > 0 { rows++ } \
+	END { print rows + 0 }'
+
+# -O2 -ftime-report must list at least one ANVIL IR pass that ran; on a
+# backend without phi support (s390) mcc leaves the IR alone and lists none
+test-time-report: $(TARGET) | $(TEST_OUTPUT_DIR)
+	@echo "=== Optimizer Report Test ==="
+	@printf "  %-50s " "-O2 -ftime-report $(TESTDIR)/arithmetic.c"
+	@if ./$(TARGET) -std=c99 -I includes -O2 -ftime-report -o $(TEST_OUTPUT_DIR)/time_report.s \
+		$(TESTDIR)/arithmetic.c 2>$(TEST_OUTPUT_DIR)/time_report.txt && \
+	   [ "$$($(TIME_REPORT_ROWS) $(TEST_OUTPUT_DIR)/time_report.txt)" -gt 0 ]; then \
+		echo "OK"; \
+	else \
+		echo "FAILED"; exit 1; \
+	fi
+	@printf "  %-50s " "-arch=s390 -O2 -ftime-report $(TESTDIR)/arithmetic.c"
+	@if ./$(TARGET) -arch=s390 -std=c99 -I includes -O2 -ftime-report -o $(TEST_OUTPUT_DIR)/time_report_s390.s \
+		$(TESTDIR)/arithmetic.c 2>$(TEST_OUTPUT_DIR)/time_report_s390.txt && \
+	   [ "$$($(TIME_REPORT_ROWS) $(TEST_OUTPUT_DIR)/time_report_s390.txt)" -eq 0 ]; then \
+		echo "OK"; \
+	else \
+		echo "FAILED"; exit 1; \
+	fi
+	@echo ""
+
 # ============================================================
 # Architecture-Specific Code Generation Tests
 # ============================================================
@@ -79,6 +79,21 @@ void mcc_codegen_set_opt_level(mcc_codegen_t *cg, mcc_opt_level_t level)
     cg->opt_level = level;
 }
 
+void mcc_codegen_set_object_output(mcc_codegen_t *cg, bool object)
+{
+    anvil_ctx_set_output(cg->anvil_ctx, object ? ANVIL_OUTPUT_BINARY : ANVIL_OUTPUT_ASM);
+}
+
+void mcc_codegen_set_pass_stats(mcc_codegen_t *cg, bool enable)
+{
+    anvil_pass_manager_set_stats(anvil_ctx_get_pass_manager(cg->anvil_ctx), enable);
+}
+
+void mcc_codegen_print_pass_stats(mcc_codegen_t *cg, FILE *out)
+{
+    anvil_pass_manager_print_stats(anvil_ctx_get_pass_manager(cg->anvil_ctx), out);
+}
+
 /* ============================================================
  * Local Variable Management
  * ============================================================ */
@@ -321,10 +336,25 @@ char *mcc_codegen_get_output(mcc_codegen_t *cg, size_t *len)
         return NULL;
     }
     
+    /* Run the IR passes for the level (nothing at O0). Only backends that
+     * keep SSA values live take their output; the others have only been
+     * exercised on IR as mcc emits it. */
+    anvil_error_t err;
+    if (anvil_ctx_supports_phi(cg->anvil_ctx)) {
+        err = anvil_module_optimize(cg->anvil_mod);
+        if (err != ANVIL_OK) {
+            mcc_error(cg->mcc_ctx, "optimization failed");
+            *len = 0;
+            return NULL;
+        }
+    }
+    
     /* Generate code */
     char *output = NULL;
-    anvil_error_t err = anvil_module_codegen(cg->anvil_mod, &output, len);
+    err = anvil_module_codegen(cg->anvil_mod, &output, len);
     if (err != ANVIL_OK) {
+        const char *msg = anvil_ctx_get_error(cg->anvil_ctx);
+        mcc_error(cg->mcc_ctx, "code generation failed: %s", msg ? msg : "unknown error");
         *len = 0;
         return NULL;
     }
@@ -25,11 +25,13 @@ static void print_usage(const char *prog)
     printf("                      ppc32, ppc64, ppc64le, arm64, arm64_macos\n");
     printf("  -O<level>         Optimization level (0, g, 1, 2, 3)\n");
     printf("  -E                Preprocess only\n");
+    printf("  -c                Emit an ELF object file (x86_64 only)\n");
     printf("  -fsyntax-only     Parse and check syntax only\n");
     printf("  -dump-ast         Print AST\n");
     printf("  -dump-sema        Print semantic analysis info (symbol table)\n");
     printf("  -dump-sema-verbose Print detailed semantic analysis (all info)\n");
     printf("  -dump-ir          Dump ANVIL IR (for debugging)\n");
+    printf("  -ftime-report     Print time and changes per optimization pass\n");
     printf("  -I<path>          Add include path\n");
     printf("  -D<name>[=value]  Define macro\n");
     printf("  -Wall             Enable all warnings\n");
@@ -217,12 +219,15 @@ static int compile_file(mcc_context_t *ctx, const char *filename)
     mcc_ast_opt_set_sema(ast_opt, sema);
     mcc_ast_opt_set_verbose(ast_opt, ctx->options.verbose);
     mcc_ast_opt_run(ast_opt, ast);
+    if (ctx->options.time_report) mcc_ast_opt_print_report(ast_opt, stderr);
     mcc_ast_opt_destroy(ast_opt);
     
     /* Code generation - use symtab and types from sema */
     mcc_codegen_t *cg = mcc_codegen_create(ctx, sema->symtab, sema->types);
     mcc_codegen_set_target(cg, ctx->options.arch);
     mcc_codegen_set_opt_level(cg, ctx->options.opt_level);
+    mcc_codegen_set_object_output(cg, ctx->options.emit_object);
+    mcc_codegen_set_pass_stats(cg, ctx->options.time_report);
     
     if (!mcc_codegen_generate(cg, ast)) {
         mcc_codegen_destroy(cg);
@@ -255,11 +260,12 @@ static int compile_file(mcc_context_t *ctx, const char *filename)
     /* Get output */
     size_t output_len;
     char *output = mcc_codegen_get_output(cg, &output_len);
+    if (ctx->options.time_report) mcc_codegen_print_pass_stats(cg, stderr);
     
     /* Write output */
     FILE *out = stdout;
     if (ctx->options.output_file) {
-        out = fopen(ctx->options.output_file, "w");
+        out = fopen(ctx->options.output_file, ctx->options.emit_object ? "wb" : "w");
         if (!out) {
             mcc_fatal(ctx, "Cannot open output file: %s", ctx->options.output_file);
             free(output);
@@ -444,12 +450,15 @@ static int compile_files(mcc_context_t *ctx, const char **files, size_t num_file
         }
         mcc_ast_opt_run(ast_opt, asts[i]);
     }
+    if (ctx->options.time_report) mcc_ast_opt_print_report(ast_opt, stderr);
     mcc_ast_opt_destroy(ast_opt);
     
     /* Code generation - use shared symtab and types from sema */
     mcc_codegen_t *cg = mcc_codegen_create(ctx, sema->symtab, sema->types);
     mcc_codegen_set_target(cg, ctx->options.arch);
     mcc_codegen_set_opt_level(cg, ctx->options.opt_level);
+    mcc_codegen_set_object_output(cg, ctx->options.emit_object);
+    mcc_codegen_set_pass_stats(cg, ctx->options.time_report);
     
     /* Add all ASTs to the same module */
     for (size_t i = 0; i < num_files; i++) {
@@ -509,11 +518,12 @@ static int compile_files(mcc_context_t *ctx, const char **files, size_t num_file
     /* Get output */
     size_t output_len;
     char *output = mcc_codegen_get_output(cg, &output_len);
+    if (ctx->options.time_report) mcc_codegen_print_pass_stats(cg, stderr);
     
     /* Write output */
     FILE *out = stdout;
     if (ctx->options.output_file) {
-        out = fopen(ctx->options.output_file, "w");
+        out = fopen(ctx->options.output_file, ctx->options.emit_object ? "wb" : "w");
         if (!out) {
             mcc_fatal(ctx, "Cannot open output file: %s", ctx->options.output_file);
             free(output);
@@ -635,6 +645,11 @@ int main(int argc, char **argv)
             continue;
         }
         
+        if (strcmp(arg, "-c") == 0) {
+            opts.emit_object = true;
+            continue;
+        }
+        
         if (strcmp(arg, "-fsyntax-only") == 0) {
             opts.syntax_only = true;
             continue;
@@ -660,6 +675,11 @@ int main(int argc, char **argv)
             continue;
         }
         
+        if (strcmp(arg, "-ftime-report") == 0) {
+            opts.time_report = true;
+            continue;
+        }
+        
         if (strncmp(arg, "-I", 2) == 0) {
             const char *path = arg[2] ? arg + 2 : argv[++i];
             if (num_include_paths >= cap_include_paths) {
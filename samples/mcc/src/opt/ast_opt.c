@@ -6,6 +6,7 @@
  */
 
 #include "opt_internal.h"
+#include <time.h>
 
 /* ============================================================
  * Pass Information Table
@@ -467,11 +468,15 @@ int mcc_ast_opt_run_pass(mcc_ast_opt_t *opt, mcc_ast_node_t *ast,
         fprintf(stderr, "  [run] %s\n", entry->name);
     }
     
+    clock_t start = clock();
     int changes = entry->fn(opt, ast);
+    opt->pass_time_ms[pass] += (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+    opt->pass_runs[pass]++;
     
     if (changes > 0) {
         opt->total_changes += changes;
         opt->pass_changes[pass] += changes;
+        opt->pass_total_changes[pass] += changes;
         
         if (opt->verbose) {
             fprintf(stderr, "    -> %d change(s)\n", changes);
@@ -514,6 +519,9 @@ bool mcc_ast_opt_run(mcc_ast_opt_t *opt, mcc_ast_node_t *ast)
         
     } while (changes > 0 && opt->iterations < max_iterations);
     
+    opt->total_runs++;
+    opt->total_iterations += opt->iterations;
+    
     if (opt->verbose) {
         fprintf(stderr, "Optimization complete: %d total changes in %d iterations\n",
                 opt->total_changes, opt->iterations);
@@ -532,3 +540,35 @@ int mcc_ast_opt_get_pass_changes(mcc_ast_opt_t *opt, mcc_opt_pass_id_t pass)
     if (!opt || pass >= MCC_OPT_PASS_COUNT) return 0;
     return opt->pass_changes[pass];
 }
+
+void mcc_ast_opt_print_report(mcc_ast_opt_t *opt, FILE *out)
+{
+    if (!opt || !out) return;
+    
+    /* Passes that ran, slowest first (insertion sort; there are few) */
+    int order[MCC_OPT_PASS_COUNT];
+    int n = 0;
+    double total_ms = 0;
+    for (int pass = 0; pass < MCC_OPT_PASS_COUNT; pass++) {
+        if (opt->pass_runs[pass] == 0) continue;
+        total_ms += opt->pass_time_ms[pass];
+        int i = n++;
+        while (i > 0 && opt->pass_time_ms[order[i - 1]] < opt->pass_time_ms[pass]) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = pass;
+    }
+    
+    fprintf(out, "===== MCC AST pass statistics =====\n");
+    fprintf(out, "  Runs: %d, iterations: %d\n", opt->total_runs, opt->total_iterations);
+    fprintf(out, "  Pass time: %.3f ms\n\n", total_ms);
+    fprintf(out, "  %-26s %10s %6s %7s %8s\n", "Pass", "Time (ms)", "%", "Runs", "Changes");
+    for (int i = 0; i < n; i++) {
+        int pass = order[i];
+        double pct = total_ms > 0 ? 100.0 * opt->pass_time_ms[pass] / total_ms : 0.0;
+        fprintf(out, "  %-26s %10.3f %6.1f %7d %8d\n", mcc_ast_opt_pass_name(pass),
+                opt->pass_time_ms[pass], pct, opt->pass_runs[pass],
+                opt->pass_total_changes[pass]);
+    }
+}
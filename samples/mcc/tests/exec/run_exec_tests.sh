@@ -19,6 +19,7 @@ TIMEOUT_SEC=5
 OPT_LEVEL=""
 ALL_OPTS=false
 COMPARE_CLANG=false
+OBJECT=false
 
 # Timeout function using Perl (works on macOS and Linux)
 run_with_timeout() {
@@ -69,6 +70,10 @@ while [[ $# -gt 0 ]]; do
             COMPARE_CLANG=true
             shift
             ;;
+        --object)
+            OBJECT=true
+            shift
+            ;;
         -h|--help)
             echo "Usage: $0 [options] [test_file.c]"
             echo ""
@@ -76,6 +81,7 @@ while [[ $# -gt 0 ]]; do
             echo "  -O0, -O1, -O2, -O3, -Og  Set optimization level (default: none)"
             echo "  --all-opts               Run tests with all optimization levels"
             echo "  --compare-clang          Compare assembly size with Clang"
+            echo "  --object                 Link MCC's ELF objects (-c) instead of assembly"
             echo "  -h, --help               Show this help"
             exit 0
             ;;
@@ -128,6 +134,7 @@ run_test() {
     local native_bin="$OUTPUT_DIR/${name}_native"
     local native_out="$OUTPUT_DIR/${name}_native.out"
     local mcc_asm="$OUTPUT_DIR/${name}_mcc${opt_suffix}.s"
+    [ "$OBJECT" = true ] && mcc_asm="$OUTPUT_DIR/${name}_mcc${opt_suffix}.o"
     local mcc_bin="$OUTPUT_DIR/${name}_mcc${opt_suffix}"
     local mcc_out="$OUTPUT_DIR/${name}_mcc${opt_suffix}.out"
     local result="PASS"
@@ -167,6 +174,7 @@ run_test() {
     # Step 2: Compile with MCC (may crash with trace trap but still generate output)
     local mcc_opts="-arch=$MCC_ARCH -std=$std -I$MCC_DIR/includes"
     [ -n "$opt" ] && mcc_opts="$mcc_opts $opt"
+    [ "$OBJECT" = true ] && mcc_opts="$mcc_opts -c"
     "$MCC" $mcc_opts -o "$mcc_asm" "$src" 2>/dev/null
     
     # Check if assembly was generated (even if MCC crashed after generating it)
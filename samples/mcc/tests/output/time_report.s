@@ -0,0 +1,98 @@
+# Generated by ANVIL for x86-64
+	.text
+	.globl main
+	.type main, @function
+main:
+	pushq %rbp
+	movq %rsp, %rbp
+	movq $10, %rdi
+	movq $3, %rsi
+	call add
+	movq %rax, %rcx
+	movq $10, %rdi
+	movq $3, %rsi
+	call sub
+	movq %rax, %rcx
+	movq $10, %rdi
+	movq $3, %rsi
+	call mul
+	movq %rax, %rcx
+	movq $10, %rdi
+	movq $3, %rsi
+	call div_test
+	movq %rax, %rcx
+	movq $10, %rdi
+	movq $3, %rsi
+	call mod
+	movq %rax, %rcx
+	movq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
+	.globl mod
+	.type mod, @function
+mod:
+	pushq %rbp
+	movq %rsp, %rbp
+	movslq %edi, %rax
+	movslq %esi, %r11
+	cqto
+	idivq %r11
+	movq %rdx, %rcx
+	movq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
+	.globl div_test
+	.type div_test, @function
+div_test:
+	pushq %rbp
+	movq %rsp, %rbp
+	movslq %edi, %rax
+	movslq %esi, %r11
+	cqto
+	idivq %r11
+	movq %rax, %rcx
+	movq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
+	.globl mul
+	.type mul, @function
+mul:
+	pushq %rbp
+	movq %rsp, %rbp
+	movq %rdi, %rcx
+	imulq %rsi, %rcx
+	movq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
+	.globl sub
+	.type sub, @function
+sub:
+	pushq %rbp
+	movq %rsp, %rbp
+	movq %rdi, %rcx
+	subq %rsi, %rcx
+	movq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
+	.globl add
+	.type add, @function
+add:
+	pushq %rbp
+	movq %rsp, %rbp
+	movq %rdi, %rcx
+	addq %rsi, %rcx
+	movq %rcx, %rax
+	movq %rbp, %rsp
+	popq %rbp
+	ret
+
@@ -0,0 +1,298 @@
+***********************************************************************
+*        Generated by ANVIL for IBM S/390
+***********************************************************************
+         CSECT
+         AMODE ANY
+         RMODE ANY
+*
+MAIN     DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING MAIN,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+MAIN$ENTRY DS    0H
+         XC    88(4,R13),88(R13)  Init local var to 0
+         XC    92(4,R13),92(R13)  Init local var to 0
+         XC    96(4,R13),96(R13)  Init local var to 0
+         LA    R2,10            Load constant
+         ST    R2,88(,R13)        Store to stack slot
+         LA    R2,3            Load constant
+         ST    R2,92(,R13)        Store to stack slot
+*        Call setup (reentrant)
+         LA    R0,10            Load constant
+         ST    R0,100(,R13)       Store param 0
+         LA    R0,3            Load constant
+         ST    R0,104(,R13)       Store param 1
+         LA    R1,100(,R13)       R1 -> param list
+         OI    104(R13),X'80'     Mark last param (VL)
+         L     R15,=V(ADD)        Load entry point
+         BASR  R14,R15           Call subroutine
+         NI    104(R13),X'7F'     Clear VL bit
+         LR    R2,R15            Copy result
+         ST    R2,96(,R13)        Store to stack slot
+*        Call setup (reentrant)
+         LA    R0,10            Load constant
+         ST    R0,100(,R13)       Store param 0
+         LA    R0,3            Load constant
+         ST    R0,104(,R13)       Store param 1
+         LA    R1,100(,R13)       R1 -> param list
+         OI    104(R13),X'80'     Mark last param (VL)
+         L     R15,=V(SUB)        Load entry point
+         BASR  R14,R15           Call subroutine
+         NI    104(R13),X'7F'     Clear VL bit
+         LR    R2,R15            Copy result
+         ST    R2,96(,R13)        Store to stack slot
+*        Call setup (reentrant)
+         LA    R0,10            Load constant
+         ST    R0,100(,R13)       Store param 0
+         LA    R0,3            Load constant
+         ST    R0,104(,R13)       Store param 1
+         LA    R1,100(,R13)       R1 -> param list
+         OI    104(R13),X'80'     Mark last param (VL)
+         L     R15,=V(MUL)        Load entry point
+         BASR  R14,R15           Call subroutine
+         NI    104(R13),X'7F'     Clear VL bit
+         LR    R2,R15            Copy result
+         ST    R2,96(,R13)        Store to stack slot
+*        Call setup (reentrant)
+         LA    R0,10            Load constant
+         ST    R0,100(,R13)       Store param 0
+         LA    R0,3            Load constant
+         ST    R0,104(,R13)       Store param 1
+         LA    R1,100(,R13)       R1 -> param list
+         OI    104(R13),X'80'     Mark last param (VL)
+         L     R15,=V(DIV_TEST)        Load entry point
+         BASR  R14,R15           Call subroutine
+         NI    104(R13),X'7F'     Clear VL bit
+         LR    R2,R15            Copy result
+         ST    R2,96(,R13)        Store to stack slot
+*        Call setup (reentrant)
+         LA    R0,10            Load constant
+         ST    R0,100(,R13)       Store param 0
+         LA    R0,3            Load constant
+         ST    R0,104(,R13)       Store param 1
+         LA    R1,100(,R13)       R1 -> param list
+         OI    104(R13),X'80'     Mark last param (VL)
+         L     R15,=V(MOD)        Load entry point
+         BASR  R14,R15           Call subroutine
+         NI    104(R13),X'7F'     Clear VL bit
+         LR    R2,R15            Copy result
+         ST    R2,96(,R13)        Store to stack slot
+         L     R15,96(,R13)       Load from stack slot
+         L     R15,96(,R13)       Load value from stack slot
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+MOD      DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING MOD,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+MOD$ENTRY DS    0H
+         XC    88(4,R13),88(R13)  Init local var to 0
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         ST    R2,88(,R13)        Store to stack slot
+         XC    92(4,R13),92(R13)  Init local var to 0
+         L     R2,4(,R11)       Load addr of param 1
+         L     R2,0(,R2)         Load param value
+         ST    R2,92(,R13)        Store to stack slot
+         L     R15,88(,R13)       Load from stack slot
+         L     R15,92(,R13)       Load from stack slot
+         L     R3,88(,R13)       Load value from stack slot
+         SRDA  R2,32             Sign extend
+         L     R0,92(,R13)       Load value from stack slot
+         DR    R2,R0             Divide
+         LR    R15,R2            Remainder to R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+DIV_TEST DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING DIV_TEST,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+DIV_TEST$ENTRY DS    0H
+         XC    88(4,R13),88(R13)  Init local var to 0
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         ST    R2,88(,R13)        Store to stack slot
+         XC    92(4,R13),92(R13)  Init local var to 0
+         L     R2,4(,R11)       Load addr of param 1
+         L     R2,0(,R2)         Load param value
+         ST    R2,92(,R13)        Store to stack slot
+         L     R15,88(,R13)       Load from stack slot
+         L     R15,92(,R13)       Load from stack slot
+         L     R3,88(,R13)       Load value from stack slot
+         SRDA  R2,32             Sign extend R3 into R2:R3
+         L     R0,92(,R13)       Load value from stack slot
+         DR    R2,R0             Divide R2:R3 by R0
+         LR    R15,R3            Quotient to R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+MUL      DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING MUL,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+MUL$ENTRY DS    0H
+         XC    88(4,R13),88(R13)  Init local var to 0
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         ST    R2,88(,R13)        Store to stack slot
+         XC    92(4,R13),92(R13)  Init local var to 0
+         L     R2,4(,R11)       Load addr of param 1
+         L     R2,0(,R2)         Load param value
+         ST    R2,92(,R13)        Store to stack slot
+         L     R15,88(,R13)       Load from stack slot
+         L     R15,92(,R13)       Load from stack slot
+         L     R2,88(,R13)       Load value from stack slot
+         L     R3,92(,R13)       Load value from stack slot
+         MSR   R2,R3             Multiply single
+         LR    R15,R2            Result in R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+SUB      DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING SUB,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+SUB$ENTRY DS    0H
+         XC    88(4,R13),88(R13)  Init local var to 0
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         ST    R2,88(,R13)        Store to stack slot
+         XC    92(4,R13),92(R13)  Init local var to 0
+         L     R2,4(,R11)       Load addr of param 1
+         L     R2,0(,R2)         Load param value
+         ST    R2,92(,R13)        Store to stack slot
+         L     R15,88(,R13)       Load from stack slot
+         L     R15,92(,R13)       Load from stack slot
+         L     R2,88(,R13)       Load value from stack slot
+         L     R3,92(,R13)       Load value from stack slot
+         SR    R2,R3             Subtract registers
+         LR    R15,R2            Result in R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+ADD      DS    0H
+         STM   R14,R12,12(R13)    Save caller's registers
+         LR    R12,R15            Copy entry point to base reg
+         USING ADD,R12            Establish addressability
+         LR    R11,R1             Save parameter list pointer
+*        Set up save area chain (stack allocation)
+         LA    R2,72(,R13)        R2 -> our save area
+         ST    R13,4(,R2)         Chain: new->prev = caller's
+         ST    R2,8(,R13)         Chain: caller->next = new
+         LR    R13,R2             R13 -> our save area
+*
+ADD$ENTRY DS    0H
+         XC    88(4,R13),88(R13)  Init local var to 0
+         L     R2,0(,R11)       Load addr of param 0
+         L     R2,0(,R2)         Load param value
+         ST    R2,88(,R13)        Store to stack slot
+         XC    92(4,R13),92(R13)  Init local var to 0
+         L     R2,4(,R11)       Load addr of param 1
+         L     R2,0(,R2)         Load param value
+         ST    R2,92(,R13)        Store to stack slot
+         L     R15,88(,R13)       Load from stack slot
+         L     R15,92(,R13)       Load from stack slot
+         L     R2,88(,R13)       Load value from stack slot
+         L     R3,92(,R13)       Load value from stack slot
+         AR    R2,R3             Add registers
+         LR    R15,R2            Result in R15
+*        Function epilogue
+         L     R13,4(,R13)        Restore caller's SA pointer
+         L     R14,12(,R13)       Restore return address
+         LM    R0,R12,20(,R13)    Restore R0-R12
+         BR    R14                Return to caller
+*
+         DROP  R12
+*
+*
+*        Dynamic area sizes (for GETMAIN/FREEMAIN)
+DYN@MAIN EQU   112                 Stack frame size for MAIN
+DYN@MOD  EQU   96                 Stack frame size for MOD
+DYN@DIV_TEST EQU   96                 Stack frame size for DIV_TEST
+DYN@MUL  EQU   96                 Stack frame size for MUL
+DYN@SUB  EQU   96                 Stack frame size for SUB
+DYN@ADD  EQU   96                 Stack frame size for ADD
+*
+         LTORG                    Literal pool
+*
+*        Register equates
+R0       EQU   0
+R1       EQU   1
+R2       EQU   2
+R3       EQU   3
+R4       EQU   4
+R5       EQU   5
+R6       EQU   6
+R7       EQU   7
+R8       EQU   8
+R9       EQU   9
+R10      EQU   10
+R11      EQU   11
+R12      EQU   12
+R13      EQU   13
+R14      EQU   14
+R15      EQU   15
+*
+         END   MAIN
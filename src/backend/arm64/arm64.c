@@ -58,7 +58,8 @@ static void arm64_cleanup(anvil_backend_t *be)
     anvil_strbuf_destroy(&priv->code);
     anvil_strbuf_destroy(&priv->data);
     free(priv->strings);
-    free(priv->stack_slots);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
     free(priv->value_locs);
     free(priv);
     be->priv = NULL;
@@ -71,8 +72,9 @@ static void arm64_reset(anvil_backend_t *be)
     arm64_backend_t *priv = be->priv;
     
     /* Clear stack slots */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->next_stack_offset = 0;
+    anvil_stack_colors_free(&priv->colors);
     
     /* Clear string table */
     priv->num_strings = 0;
@@ -119,15 +121,38 @@ static void arm64_emit_block(arm64_backend_t *be, anvil_block_t *block)
     }
 }
 
+/* Frame slot size for stack-slot coloring: the memory of allocas, every
+ * instruction result and the register parameters (see arm64_emit_func) */
+static int arm64_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    int size = 8;
+    *align = 8;
+    if (val->kind == ANVIL_VAL_PARAM) {
+        if (val->data.param.index >= ARM64_NUM_ARG_REGS) return 0;
+        if (val->type) size = arm64_type_size(val->type);
+    } else if (val->data.instr->op == ANVIL_OP_ALLOCA) {
+        if (val->type && val->type->kind == ANVIL_TYPE_PTR && val->type->data.pointee)
+            size = arm64_type_size(val->type->data.pointee);
+    } else if (val->type) {
+        size = arm64_type_size(val->type);
+    }
+    return (size + 7) & ~7;
+}
+
 static void arm64_emit_func(arm64_backend_t *be, anvil_func_t *func)
 {
     if (!func || func->is_declaration) return;
     
     be->current_func = func;
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     be->next_stack_offset = 0;
     be->is_leaf_func = true;  /* Assume leaf until we find a call */
     
+    /* Share slots between values with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, arm64_slot_size, be);
+    
     /* First pass: allocate stack slots for allocas and instruction results,
      * and detect if this is a leaf function */
     for (anvil_block_t *block = func->blocks; block; block = block->next) {
@@ -345,8 +370,10 @@ static anvil_error_t arm64_codegen_module(anvil_backend_t *be, anvil_module_t *m
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     priv->label_counter = 0;
     priv->num_strings = 0;
+    priv->string_counter = 0;
     
     /* Emit header */
     if (arm64_is_darwin(priv)) {
@@ -362,28 +389,17 @@ static anvil_error_t arm64_codegen_module(anvil_backend_t *be, anvil_module_t *m
     /* Emit functions (prepare_ir already called by anvil_module_codegen) */
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         arm64_emit_func(priv, func);
+        anvil_error_t err = anvil_strbuf_flush(&priv->code);
+        if (err != ANVIL_OK) return err;
     }
     
     /* Emit globals and strings */
     arm64_emit_globals(priv, mod);
     arm64_emit_strings(priv);
     
-    /* Combine output */
-    anvil_strbuf_t result;
-    anvil_strbuf_init(&result);
-    char *code_str = anvil_strbuf_detach(&priv->code, NULL);
-    char *data_str = anvil_strbuf_detach(&priv->data, NULL);
-    if (code_str) {
-        anvil_strbuf_append(&result, code_str);
-        free(code_str);
-    }
-    if (data_str) {
-        anvil_strbuf_append(&result, data_str);
-        free(data_str);
-    }
-    
-    *output = anvil_strbuf_detach(&result, len);
-    return ANVIL_OK;
+    /* Data and strings follow the code */
+    anvil_strbuf_append(&priv->code, priv->data.data);
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t arm64_codegen_func(anvil_backend_t *be, anvil_func_t *func,
@@ -438,6 +454,7 @@ const anvil_backend_ops_t anvil_backend_arm64 = {
     .cleanup = arm64_cleanup,
     .reset = arm64_reset,
     .prepare_ir = arm64_prepare_ir,
+    .supports_phi = true,
     .codegen_module = arm64_codegen_module,
     .codegen_func = arm64_codegen_func,
     .get_arch_info = arm64_get_arch_info
@@ -69,8 +69,7 @@ void arm64_emit_load_value(arm64_backend_t *be, anvil_value_t *val, int target_r
     int cached_reg = arm64_find_cached_value(be, val);
     if (cached_reg >= 0 && cached_reg != target_reg) {
         /* Value already in a register, just move it */
-        anvil_strbuf_appendf(&be->code, "\tmov %s, %s\n",
-            arm64_xreg_names[target_reg], arm64_xreg_names[cached_reg]);
+        arm64_emit_rr(be, "mov", arm64_xreg_names[target_reg], arm64_xreg_names[cached_reg]);
         arm64_cache_value(be, target_reg, val);
         return;
     }
@@ -98,7 +97,7 @@ void arm64_emit_load_value(arm64_backend_t *be, anvil_value_t *val, int target_r
                     anvil_strbuf_appendf(&be->code, "\tadrp %s, %s@PAGE\n", xreg, label);
                     anvil_strbuf_appendf(&be->code, "\tadd %s, %s, %s@PAGEOFF\n", xreg, xreg, label);
                 } else {
-                    anvil_strbuf_appendf(&be->code, "\tadrp %s, %s\n", xreg, label);
+                    arm64_emit_rr(be, "adrp", xreg, label);
                     anvil_strbuf_appendf(&be->code, "\tadd %s, %s, :lo12:%s\n", xreg, xreg, label);
                 }
             }
@@ -114,8 +113,7 @@ void arm64_emit_load_value(arm64_backend_t *be, anvil_value_t *val, int target_r
                 } else {
                     size_t idx = val->data.param.index;
                     if (idx < ARM64_NUM_ARG_REGS && target_reg != (int)idx) {
-                        anvil_strbuf_appendf(&be->code, "\tmov %s, %s\n",
-                            xreg, arm64_xreg_names[idx]);
+                        arm64_emit_rr(be, "mov", xreg, arm64_xreg_names[idx]);
                     }
                 }
             }
@@ -222,28 +220,59 @@ void arm64_emit_load_fp_value(arm64_backend_t *be, anvil_value_t *val, int targe
  * PHI Node Handling
  * ============================================================================ */
 
+/* Incoming value of a phi on the edge from src_block, or NULL */
+static anvil_value_t *phi_incoming(anvil_instr_t *phi, anvil_block_t *src_block)
+{
+    for (size_t i = 0; i < phi->num_phi_incoming && i < phi->num_operands; i++) {
+        if (phi->phi_blocks && phi->phi_blocks[i] == src_block) return phi->operands[i];
+    }
+    return NULL;
+}
+
 void arm64_emit_phi_copies(arm64_backend_t *be, anvil_block_t *src_block, anvil_block_t *dest_block)
 {
     if (!dest_block) return;
     
-    for (anvil_instr_t *instr = dest_block->first; instr; instr = instr->next) {
-        if (instr->op != ANVIL_OP_PHI) break;
-        
-        for (size_t i = 0; i < instr->num_phi_incoming; i++) {
-            if (instr->phi_blocks && instr->phi_blocks[i] == src_block) {
-                if (i < instr->num_operands && instr->operands[i]) {
-                    arm64_emit_load_value(be, instr->operands[i], ARM64_X9);
-                    if (instr->result) {
-                        int offset = arm64_get_stack_slot(be, instr->result);
-                        if (offset >= 0) {
-                            arm64_emit_store_to_stack(be, ARM64_X9, offset, 8);
-                        }
-                    }
-                }
-                break;
-            }
+    /* The copies happen at once: when one phi reads another phi of the
+     * same block (a swap in a loop), read every value before writing */
+    bool reads_phi = false;
+    for (anvil_instr_t *instr = dest_block->first; instr && instr->op == ANVIL_OP_PHI; instr = instr->next) {
+        anvil_value_t *val = phi_incoming(instr, src_block);
+        if (val && val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_PHI &&
+            val->data.instr->parent == dest_block && val != instr->result) {
+            reads_phi = true;
         }
     }
+    
+    if (reads_phi) {
+        for (anvil_instr_t *instr = dest_block->first; instr && instr->op == ANVIL_OP_PHI; instr = instr->next) {
+            anvil_value_t *val = phi_incoming(instr, src_block);
+            if (!val || !instr->result || arm64_get_stack_slot(be, instr->result) < 0) continue;
+            arm64_emit_load_value(be, val, ARM64_X9);
+            anvil_strbuf_append(&be->code, "\tstr x9, [sp, #-16]!\n");
+        }
+    }
+    
+    /* Without the hazard, copy directly; with it, pop in reverse order */
+    anvil_instr_t *last = dest_block->first;
+    while (last && last->next && last->next->op == ANVIL_OP_PHI) last = last->next;
+    for (anvil_instr_t *instr = reads_phi ? last : dest_block->first;
+         instr && instr->op == ANVIL_OP_PHI;
+         instr = reads_phi ? instr->prev : instr->next) {
+        anvil_value_t *val = phi_incoming(instr, src_block);
+        if (!val) continue;
+        if (reads_phi) {
+            if (!instr->result || arm64_get_stack_slot(be, instr->result) < 0) continue;
+            anvil_strbuf_append(&be->code, "\tldr x9, [sp], #16\n");
+        } else {
+            arm64_emit_load_value(be, val, ARM64_X9);
+        }
+        int offset = instr->result ? arm64_get_stack_slot(be, instr->result) : -1;
+        if (offset >= 0) arm64_emit_store_to_stack(be, ARM64_X9, offset, 8);
+    }
+    
+    /* x9 no longer holds what the register cache last saw loaded */
+    if (reads_phi) arm64_clear_reg_cache(be);
 }
 
 /* ============================================================================
@@ -407,20 +436,17 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             /* Check if second operand is immediate */
             if (arm64_is_imm12(instr->operands[1], &imm)) {
                 arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
-                anvil_strbuf_appendf(&be->code, "\tadd %s, %s, #%lld\n",
-                    arm64_sized_reg(0, w), arm64_sized_reg(9, w), (long long)imm);
+                arm64_emit_rri(be, "add", arm64_sized_reg(0, w), arm64_sized_reg(9, w), imm);
             }
             /* Check if first operand is immediate (commutative) */
             else if (arm64_is_imm12(instr->operands[0], &imm)) {
                 arm64_emit_load_value(be, instr->operands[1], ARM64_X9);
-                anvil_strbuf_appendf(&be->code, "\tadd %s, %s, #%lld\n",
-                    arm64_sized_reg(0, w), arm64_sized_reg(9, w), (long long)imm);
+                arm64_emit_rri(be, "add", arm64_sized_reg(0, w), arm64_sized_reg(9, w), imm);
             }
             else {
                 arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
                 arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-                anvil_strbuf_appendf(&be->code, "\tadd %s, %s, %s\n",
-                    arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+                arm64_emit_rrr(be, "add", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             }
             arm64_save_result(be, instr);
             break;
@@ -432,14 +458,12 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             /* Check if second operand is immediate */
             if (arm64_is_imm12(instr->operands[1], &imm)) {
                 arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
-                anvil_strbuf_appendf(&be->code, "\tsub %s, %s, #%lld\n",
-                    arm64_sized_reg(0, w), arm64_sized_reg(9, w), (long long)imm);
+                arm64_emit_rri(be, "sub", arm64_sized_reg(0, w), arm64_sized_reg(9, w), imm);
             }
             else {
                 arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
                 arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-                anvil_strbuf_appendf(&be->code, "\tsub %s, %s, %s\n",
-                    arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+                arm64_emit_rrr(be, "sub", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             }
             arm64_save_result(be, instr);
             break;
@@ -449,8 +473,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tmul %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "mul", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -459,8 +482,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tsdiv %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "sdiv", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -469,8 +491,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tudiv %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "udiv", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -479,8 +500,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tsdiv %s, %s, %s\n",
-                arm64_sized_reg(11, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "sdiv", arm64_sized_reg(11, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             anvil_strbuf_appendf(&be->code, "\tmsub %s, %s, %s, %s\n",
                 arm64_sized_reg(0, w), arm64_sized_reg(11, w), arm64_sized_reg(10, w), arm64_sized_reg(9, w));
             arm64_save_result(be, instr);
@@ -491,8 +511,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tudiv %s, %s, %s\n",
-                arm64_sized_reg(11, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "udiv", arm64_sized_reg(11, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             anvil_strbuf_appendf(&be->code, "\tmsub %s, %s, %s, %s\n",
                 arm64_sized_reg(0, w), arm64_sized_reg(11, w), arm64_sized_reg(10, w), arm64_sized_reg(9, w));
             arm64_save_result(be, instr);
@@ -502,8 +521,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
         case ANVIL_OP_NEG: {
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
-            anvil_strbuf_appendf(&be->code, "\tneg %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w));
+            arm64_emit_rr(be, "neg", arm64_sized_reg(0, w), arm64_sized_reg(9, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -513,8 +531,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tand %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "and", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -523,8 +540,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\torr %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "orr", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -533,8 +549,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\teor %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "eor", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -542,8 +557,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
         case ANVIL_OP_NOT: {
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
-            anvil_strbuf_appendf(&be->code, "\tmvn %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w));
+            arm64_emit_rr(be, "mvn", arm64_sized_reg(0, w), arm64_sized_reg(9, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -552,8 +566,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tlsl %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "lsl", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -562,8 +575,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tlsr %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "lsr", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
@@ -572,8 +584,7 @@ void arm64_emit_instr(arm64_backend_t *be, anvil_instr_t *instr)
             bool w = arm64_use_32bit_regs(instr);
             arm64_emit_load_value(be, instr->operands[0], ARM64_X9);
             arm64_emit_load_value(be, instr->operands[1], ARM64_X10);
-            anvil_strbuf_appendf(&be->code, "\tasr %s, %s, %s\n",
-                arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
+            arm64_emit_rrr(be, "asr", arm64_sized_reg(0, w), arm64_sized_reg(9, w), arm64_sized_reg(10, w));
             arm64_save_result(be, instr);
             break;
         }
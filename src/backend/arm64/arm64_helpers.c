@@ -180,41 +180,36 @@ bool arm64_type_is_float(anvil_type_t *type)
 
 int arm64_alloc_stack_slot(arm64_backend_t *be, anvil_value_t *val, int size)
 {
-    /* Grow array if needed */
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 32;
-        arm64_stack_slot_t *new_slots = realloc(be->stack_slots,
-            new_cap * sizeof(arm64_stack_slot_t));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
-    }
-    
     /* Align size to 8 bytes minimum */
     int aligned_size = (size + 7) & ~7;
     
-    /* Allocate slot (stack grows down, offsets are negative from FP) */
-    be->next_stack_offset += aligned_size;
-    int offset = be->next_stack_offset;
+    /* Allocate slot (stack grows down, offsets are negative from FP);
+     * values with disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *colored = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (colored && colored->placed) {
+        offset = colored->offset;
+    } else {
+        be->next_stack_offset += colored ? colored->size : aligned_size;
+        offset = be->next_stack_offset;
+        if (colored) {
+            colored->offset = offset;
+            colored->placed = true;
+        }
+    }
     
-    arm64_stack_slot_t *slot = &be->stack_slots[be->num_stack_slots++];
-    slot->value = val;
-    slot->offset = offset;
-    slot->size = size;
-    slot->is_param = false;
-    slot->is_alloca = false;
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
 
 int arm64_get_stack_slot(arm64_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
 }
 
 int arm64_get_or_alloc_slot(arm64_backend_t *be, anvil_value_t *val)
@@ -277,16 +272,58 @@ void arm64_set_value_loc(arm64_backend_t *be, anvil_value_t *val, arm64_value_lo
  * Code Emission Helpers
  * ============================================================================ */
 
+/* Common instruction shapes, appended without format parsing */
+void arm64_emit_rr(arm64_backend_t *be, const char *op, const char *rd, const char *rn)
+{
+    anvil_strbuf_append_mnemonic(&be->code, op, NULL);
+    anvil_strbuf_append(&be->code, rd);
+    anvil_strbuf_append_reg(&be->code, ", ", rn);
+    anvil_strbuf_append_char(&be->code, '\n');
+}
+
+void arm64_emit_rrr(arm64_backend_t *be, const char *op, const char *rd, const char *rn,
+                    const char *rm)
+{
+    anvil_strbuf_append_mnemonic(&be->code, op, NULL);
+    anvil_strbuf_append(&be->code, rd);
+    anvil_strbuf_append_reg(&be->code, ", ", rn);
+    anvil_strbuf_append_reg(&be->code, ", ", rm);
+    anvil_strbuf_append_char(&be->code, '\n');
+}
+
+void arm64_emit_rri(arm64_backend_t *be, const char *op, const char *rd, const char *rn,
+                    int64_t imm)
+{
+    anvil_strbuf_append_mnemonic(&be->code, op, NULL);
+    anvil_strbuf_append(&be->code, rd);
+    anvil_strbuf_append_reg(&be->code, ", ", rn);
+    anvil_strbuf_append_imm(&be->code, ", #", imm);
+    anvil_strbuf_append_char(&be->code, '\n');
+}
+
+/* "\t<op> <reg>, [x29, #-<offset>]" */
+static void emit_fp_slot(arm64_backend_t *be, const char *op, const char *reg, int offset)
+{
+    anvil_strbuf_append_mnemonic(&be->code, op, NULL);
+    anvil_strbuf_append(&be->code, reg);
+    anvil_strbuf_append_imm(&be->code, ", [x29, #-", offset);
+    anvil_strbuf_append_n(&be->code, "]\n", 2);
+}
+
 void arm64_emit_mov_imm(arm64_backend_t *be, int reg, int64_t imm)
 {
     const char *xreg = arm64_xreg_names[reg];
     
     if (imm >= 0 && imm <= 65535) {
         /* Small positive - single MOV */
-        anvil_strbuf_appendf(&be->code, "\tmov %s, #%lld\n", xreg, (long long)imm);
+        anvil_strbuf_append_reg(&be->code, "\tmov ", xreg);
+        anvil_strbuf_append_imm(&be->code, ", #", imm);
+        anvil_strbuf_append_char(&be->code, '\n');
     } else if (imm >= -65536 && imm < 0) {
         /* Small negative - single MOV (assembler handles it) */
-        anvil_strbuf_appendf(&be->code, "\tmov %s, #%lld\n", xreg, (long long)imm);
+        anvil_strbuf_append_reg(&be->code, "\tmov ", xreg);
+        anvil_strbuf_append_imm(&be->code, ", #", imm);
+        anvil_strbuf_append_char(&be->code, '\n');
     } else if ((uint64_t)imm <= 0xFFFFFFFF) {
         /* 32-bit value - use MOV + MOVK */
         uint32_t lo = (uint32_t)imm & 0xFFFF;
@@ -342,7 +379,7 @@ void arm64_emit_load_from_stack_signed(arm64_backend_t *be, int reg, int offset,
     
     if (offset <= 255) {
         /* Small offset - direct addressing */
-        anvil_strbuf_appendf(&be->code, "\t%s %s, [x29, #-%d]\n", instr, reg_name, offset);
+        emit_fp_slot(be, instr, reg_name, offset);
     } else if (offset <= 4095) {
         /* Medium offset - use SUB + LDR */
         anvil_strbuf_appendf(&be->code, "\tsub x16, x29, #%d\n", offset);
@@ -397,7 +434,7 @@ void arm64_emit_store_to_stack(arm64_backend_t *be, int reg, int offset, int siz
     
     if (offset <= 255) {
         /* Small offset - direct addressing */
-        anvil_strbuf_appendf(&be->code, "\t%s %s, [x29, #-%d]\n", instr, reg_name, offset);
+        emit_fp_slot(be, instr, reg_name, offset);
     } else if (offset <= 4095) {
         /* Medium offset - use SUB + STR */
         anvil_strbuf_appendf(&be->code, "\tsub x16, x29, #%d\n", offset);
@@ -419,7 +456,7 @@ void arm64_emit_load_global(arm64_backend_t *be, int reg, const char *name)
         anvil_strbuf_appendf(&be->code, "\tadrp %s, %s%s@PAGE\n", xreg, prefix, name);
         anvil_strbuf_appendf(&be->code, "\tadd %s, %s, %s%s@PAGEOFF\n", xreg, xreg, prefix, name);
     } else {
-        anvil_strbuf_appendf(&be->code, "\tadrp %s, %s\n", xreg, name);
+        arm64_emit_rr(be, "adrp", xreg, name);
         anvil_strbuf_appendf(&be->code, "\tadd %s, %s, :lo12:%s\n", xreg, xreg, name);
     }
 }
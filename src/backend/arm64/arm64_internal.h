@@ -129,14 +129,6 @@ typedef struct {
  * Stack Slot Management
  * ============================================================================ */
 
-typedef struct {
-    anvil_value_t *value;     /* Associated IR value */
-    int offset;               /* Offset from FP (negative) */
-    int size;                 /* Size in bytes */
-    bool is_param;            /* Is this a parameter slot? */
-    bool is_alloca;           /* Is this an alloca slot? */
-} arm64_stack_slot_t;
-
 /* ============================================================================
  * Register State
  * ============================================================================ */
@@ -180,10 +172,9 @@ typedef struct {
     arm64_frame_layout_t frame;
     
     /* Stack slots */
-    arm64_stack_slot_t *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
     int next_stack_offset;
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function */
     
     /* Register state */
     arm64_reg_state_t gpr[ARM64_NUM_GPR];
@@ -251,6 +242,11 @@ void arm64_free_temp_reg(arm64_backend_t *be, int reg);
 int arm64_alloc_callee_saved(arm64_backend_t *be);
 
 /* Code emission helpers */
+void arm64_emit_rr(arm64_backend_t *be, const char *op, const char *rd, const char *rn);
+void arm64_emit_rrr(arm64_backend_t *be, const char *op, const char *rd, const char *rn,
+                    const char *rm);
+void arm64_emit_rri(arm64_backend_t *be, const char *op, const char *rd, const char *rn,
+                    int64_t imm);
 void arm64_emit_mov_imm(arm64_backend_t *be, int reg, int64_t imm);
 void arm64_emit_load_from_stack(arm64_backend_t *be, int reg, int offset, int size);
 void arm64_emit_load_from_stack_signed(arm64_backend_t *be, int reg, int offset, int size, bool is_signed);
@@ -97,7 +97,8 @@ static void ppc64_cleanup(anvil_backend_t *be)
     anvil_strbuf_destroy(&priv->code);
     anvil_strbuf_destroy(&priv->data);
     free(priv->strings);
-    free(priv->stack_slots);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
     free(priv);
     be->priv = NULL;
 }
@@ -109,8 +110,9 @@ static void ppc64_reset(anvil_backend_t *be)
     ppc64_backend_t *priv = be->priv;
     
     /* Clear stack slots (contain pointers to anvil_value_t) */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->next_stack_offset = 0;
+    anvil_stack_colors_free(&priv->colors);
     priv->stack_offset = 0;
     priv->local_offset = 0;
     
@@ -130,33 +132,32 @@ static void ppc64_reset(anvil_backend_t *be)
 
 int ppc64_add_stack_slot(ppc64_backend_t *be, anvil_value_t *val)
 {
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 16;
-        ppc64_stack_slot_t *new_slots = realloc(be->stack_slots,
-            new_cap * sizeof(ppc64_stack_slot_t));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
+    /* 8 bytes per slot; values with disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (slot && slot->placed) {
+        offset = slot->offset;
+    } else {
+        be->next_stack_offset += slot ? slot->size : 8;
+        offset = be->next_stack_offset;
+        if (slot) {
+            slot->offset = offset;
+            slot->placed = true;
+        }
     }
     
-    be->next_stack_offset += 8;
-    int offset = be->next_stack_offset;
-    
-    be->stack_slots[be->num_stack_slots].value = val;
-    be->stack_slots[be->num_stack_slots].offset = offset;
-    be->num_stack_slots++;
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
 
 int ppc64_get_stack_slot(ppc64_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
 }
 
 const char *ppc64_add_string(ppc64_backend_t *be, const char *str)
@@ -206,6 +207,7 @@ static anvil_error_t ppc64_codegen_module(anvil_backend_t *be, anvil_module_t *m
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     priv->label_counter = 0;
     priv->num_strings = 0;
     priv->string_counter = 0;
@@ -230,6 +232,8 @@ static anvil_error_t ppc64_codegen_module(anvil_backend_t *be, anvil_module_t *m
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         if (!func->is_declaration) {
             ppc64_emit_func(priv, func);
+            anvil_error_t err = anvil_strbuf_flush(&priv->code);
+            if (err != ANVIL_OK) return err;
         }
     }
     
@@ -239,22 +243,9 @@ static anvil_error_t ppc64_codegen_module(anvil_backend_t *be, anvil_module_t *m
     /* Emit strings */
     ppc64_emit_strings(priv);
     
-    /* Combine code and data sections */
-    anvil_strbuf_t result;
-    anvil_strbuf_init(&result);
-    char *code_str = anvil_strbuf_detach(&priv->code, NULL);
-    char *data_str = anvil_strbuf_detach(&priv->data, NULL);
-    if (code_str) {
-        anvil_strbuf_append(&result, code_str);
-        free(code_str);
-    }
-    if (data_str) {
-        anvil_strbuf_append(&result, data_str);
-        free(data_str);
-    }
-    
-    *output = anvil_strbuf_detach(&result, len);
-    return ANVIL_OK;
+    /* Data and strings follow the code */
+    anvil_strbuf_append(&priv->code, priv->data.data);
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t ppc64_codegen_func(anvil_backend_t *be, anvil_func_t *func,
@@ -278,7 +278,7 @@ void ppc64_emit_instr(ppc64_backend_t *be, anvil_instr_t *instr, anvil_func_t *f
             break;
             
         case ANVIL_OP_PHI:
-            /* PHI nodes handled during SSA resolution */
+            /* Not reached: codegen refuses phis without supports_phi */
             break;
             
         case ANVIL_OP_ALLOCA:
@@ -718,14 +718,26 @@ void ppc64_emit_block(ppc64_backend_t *be, anvil_block_t *block, anvil_func_t *f
     }
 }
 
+/* Frame slot size for stack-slot coloring */
+static int ppc64_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 8;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 8 : 0;
+}
+
 void ppc64_emit_func(ppc64_backend_t *be, anvil_func_t *func)
 {
     if (!func || func->is_declaration) return;
     
     be->current_func = func;
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     be->next_stack_offset = 0;
     
+    /* Share slots between allocas with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, ppc64_slot_size, be);
+    
     /* First pass: count stack slots needed */
     for (anvil_block_t *block = func->blocks; block; block = block->next) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
@@ -739,7 +751,7 @@ void ppc64_emit_func(ppc64_backend_t *be, anvil_func_t *func)
     func->stack_size = PPC64_MIN_FRAME_SIZE + be->next_stack_offset + 64;
     
     /* Reset for actual emission */
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     
     ppc64_emit_prologue(be, func);
     
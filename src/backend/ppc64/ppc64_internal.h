@@ -47,12 +47,6 @@ typedef struct {
     size_t len;
 } ppc64_string_entry_t;
 
-/* Stack slot tracking */
-typedef struct {
-    anvil_value_t *value;
-    int offset;
-} ppc64_stack_slot_t;
-
 /* Backend private data */
 typedef struct {
     anvil_strbuf_t code;
@@ -64,10 +58,9 @@ typedef struct {
     size_t frame_size;
     
     /* Stack slots for local variables */
-    ppc64_stack_slot_t *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
     int next_stack_offset;
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function */
     
     /* String table */
     ppc64_string_entry_t *strings;
@@ -77,12 +77,6 @@ typedef struct {
     size_t len;
 } ppc64le_string_entry_t;
 
-/* Stack slot tracking */
-typedef struct {
-    anvil_value_t *value;
-    int offset;
-} ppc64le_stack_slot_t;
-
 /* Backend private data */
 typedef struct {
     anvil_strbuf_t code;
@@ -94,10 +88,9 @@ typedef struct {
     size_t frame_size;
     
     /* Stack slots for local variables */
-    ppc64le_stack_slot_t *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
     int next_stack_offset;
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function */
     
     /* String table */
     ppc64le_string_entry_t *strings;
@@ -151,7 +144,8 @@ static void ppc64le_cleanup(anvil_backend_t *be)
     anvil_strbuf_destroy(&priv->code);
     anvil_strbuf_destroy(&priv->data);
     free(priv->strings);
-    free(priv->stack_slots);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
     free(priv);
     be->priv = NULL;
 }
@@ -163,8 +157,9 @@ static void ppc64le_reset(anvil_backend_t *be)
     ppc64le_backend_t *priv = be->priv;
     
     /* Clear stack slots (contain pointers to anvil_value_t) */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->next_stack_offset = 0;
+    anvil_stack_colors_free(&priv->colors);
     priv->stack_offset = 0;
     priv->local_offset = 0;
     
@@ -181,21 +176,24 @@ static void ppc64le_reset(anvil_backend_t *be)
 /* Add stack slot for local variable */
 static int ppc64le_add_stack_slot(ppc64le_backend_t *be, anvil_value_t *val)
 {
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 16;
-        ppc64le_stack_slot_t *new_slots = realloc(be->stack_slots,
-            new_cap * sizeof(ppc64le_stack_slot_t));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
+    /* 8 bytes per slot; values with disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (slot && slot->placed) {
+        offset = slot->offset;
+    } else {
+        be->next_stack_offset += slot ? slot->size : 8;
+        offset = be->next_stack_offset;
+        if (slot) {
+            slot->offset = offset;
+            slot->placed = true;
+        }
     }
     
-    be->next_stack_offset += 8;
-    int offset = be->next_stack_offset;
-    
-    be->stack_slots[be->num_stack_slots].value = val;
-    be->stack_slots[be->num_stack_slots].offset = offset;
-    be->num_stack_slots++;
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
@@ -203,12 +201,8 @@ static int ppc64le_add_stack_slot(ppc64le_backend_t *be, anvil_value_t *val)
 /* Get stack slot offset for a value */
 static int ppc64le_get_stack_slot(ppc64le_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
 }
 
 /* Add string to string table */
@@ -496,7 +490,7 @@ static void ppc64le_emit_instr(ppc64le_backend_t *be, anvil_instr_t *instr, anvi
             break;
             
         case ANVIL_OP_PHI:
-            /* PHI nodes handled during SSA resolution */
+            /* Not reached: codegen refuses phis without supports_phi */
             break;
             
         case ANVIL_OP_ALLOCA:
@@ -922,14 +916,26 @@ static void ppc64le_emit_block(ppc64le_backend_t *be, anvil_block_t *block, anvi
     }
 }
 
+/* Frame slot size for stack-slot coloring */
+static int ppc64le_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 8;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 8 : 0;
+}
+
 static void ppc64le_emit_func(ppc64le_backend_t *be, anvil_func_t *func)
 {
     if (!func || func->is_declaration) return;
     
     be->current_func = func;
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     be->next_stack_offset = 0;
     
+    /* Share slots between allocas with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, ppc64le_slot_size, be);
+    
     /* First pass: count stack slots needed */
     for (anvil_block_t *block = func->blocks; block; block = block->next) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
@@ -943,7 +949,7 @@ static void ppc64le_emit_func(ppc64le_backend_t *be, anvil_func_t *func)
     func->stack_size = PPC64LE_MIN_FRAME_SIZE + be->next_stack_offset + 64;
     
     /* Reset for actual emission */
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     
     ppc64le_emit_prologue(be, func);
     
@@ -1054,6 +1060,7 @@ static anvil_error_t ppc64le_codegen_module(anvil_backend_t *be, anvil_module_t
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     priv->label_counter = 0;
     priv->num_strings = 0;
     priv->string_counter = 0;
@@ -1074,6 +1081,8 @@ static anvil_error_t ppc64le_codegen_module(anvil_backend_t *be, anvil_module_t
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         if (!func->is_declaration) {
             ppc64le_emit_func(priv, func);
+            anvil_error_t err = anvil_strbuf_flush(&priv->code);
+            if (err != ANVIL_OK) return err;
         }
     }
     
@@ -1083,22 +1092,9 @@ static anvil_error_t ppc64le_codegen_module(anvil_backend_t *be, anvil_module_t
     /* Emit strings */
     ppc64le_emit_strings(priv);
     
-    /* Combine code and data sections */
-    anvil_strbuf_t result;
-    anvil_strbuf_init(&result);
-    char *code_str = anvil_strbuf_detach(&priv->code, NULL);
-    char *data_str = anvil_strbuf_detach(&priv->data, NULL);
-    if (code_str) {
-        anvil_strbuf_append(&result, code_str);
-        free(code_str);
-    }
-    if (data_str) {
-        anvil_strbuf_append(&result, data_str);
-        free(data_str);
-    }
-    
-    *output = anvil_strbuf_detach(&result, len);
-    return ANVIL_OK;
+    /* Data and strings follow the code */
+    anvil_strbuf_append(&priv->code, priv->data.data);
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t ppc64le_codegen_func(anvil_backend_t *be, anvil_func_t *func,
@@ -92,12 +92,6 @@ typedef struct {
     size_t len;
 } s370_string_entry_t;
 
-/* Stack slot for local variables */
-typedef struct {
-    anvil_value_t *value;     /* The ALLOCA result value */
-    int offset;               /* Offset from R13 */
-} s370_stack_slot_t;
-
 /* Backend private data */
 typedef struct {
     anvil_strbuf_t code;
@@ -112,9 +106,8 @@ typedef struct {
     const char *current_func; /* Current function name for DYNSIZE */
     
     /* Stack slots for local variables */
-    s370_stack_slot_t *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function */
     
     /* String table */
     s370_string_entry_t *strings;
@@ -158,7 +151,8 @@ static void s370_cleanup(anvil_backend_t *be)
     anvil_strbuf_destroy(&priv->code);
     anvil_strbuf_destroy(&priv->data);
     free(priv->strings);
-    free(priv->stack_slots);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
     free(priv);
     be->priv = NULL;
 }
@@ -170,8 +164,9 @@ static void s370_reset(anvil_backend_t *be)
     s370_backend_t *priv = be->priv;
     
     /* Clear stack slots (contain pointers to anvil_value_t) */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->local_vars_size = 0;
+    anvil_stack_colors_free(&priv->colors);
     
     /* Clear string table (contain pointers to string data) */
     priv->num_strings = 0;
@@ -188,34 +183,42 @@ static void s370_reset(anvil_backend_t *be)
 /* Get stack slot offset for an ALLOCA result value */
 static int s370_get_stack_slot(s370_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;  /* Not found */
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
 }
 
 /* Add a stack slot for an ALLOCA */
 static int s370_add_stack_slot(s370_backend_t *be, anvil_value_t *val)
 {
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 16;
-        s370_stack_slot_t *new_slots = realloc(be->stack_slots, new_cap * sizeof(s370_stack_slot_t));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
+    /* Values with disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (slot && slot->placed) {
+        offset = slot->offset;
+    } else {
+        offset = DYN_LOCALS_OFFSET + be->local_vars_size;
+        be->local_vars_size += slot ? slot->size : 4;
+        if (slot) {
+            slot->offset = offset;
+            slot->placed = true;
+        }
     }
-    
-    int offset = DYN_LOCALS_OFFSET + be->local_vars_size;
-    be->stack_slots[be->num_stack_slots].value = val;
-    be->stack_slots[be->num_stack_slots].offset = offset;
-    be->num_stack_slots++;
-    be->local_vars_size += 4;  /* 4 bytes per slot */
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
 
+/* Frame slot size for stack-slot coloring */
+static int s370_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 4;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 4 : 0;
+}
+
 static const anvil_arch_info_t *s370_get_arch_info(anvil_backend_t *be)
 {
     (void)be;
@@ -476,9 +479,7 @@ static void s370_emit_instr(s370_backend_t *be, anvil_instr_t *instr)
     
     switch (instr->op) {
         case ANVIL_OP_PHI:
-            /* PHI nodes are SSA abstractions - at codegen time they become
-             * copies in predecessor blocks. For simple register allocation,
-             * the value should already be in R15 from the predecessor. */
+            /* Not reached: codegen refuses phis without supports_phi */
             break;
             
         case ANVIL_OP_ALLOCA:
@@ -1041,7 +1042,11 @@ static void s370_emit_func(s370_backend_t *be, anvil_func_t *func)
     /* Reset per-function state */
     be->local_vars_size = 0;
     be->max_call_args = 0;
-    be->num_stack_slots = 0;  /* Reset stack slots for new function */
+    anvil_value_map_reset(&be->stack_slots, func);  /* Reset stack slots for new function */
+    
+    /* Share slots between allocas with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, s370_slot_size, be);
     
     s370_emit_prologue(be, func);
     
@@ -1093,6 +1098,7 @@ static anvil_error_t s370_codegen_module(anvil_backend_t *be, anvil_module_t *mo
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     
     /* Reset string table */
     priv->num_strings = 0;
@@ -1104,6 +1110,8 @@ static anvil_error_t s370_codegen_module(anvil_backend_t *be, anvil_module_t *mo
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         if (!func->is_declaration) {
             s370_emit_func(priv, func);
+            anvil_error_t err = anvil_strbuf_flush(&priv->code);
+            if (err != ANVIL_OK) return err;
             /* First non-declaration function is entry point */
             if (!entry_point) entry_point = func->name;
         }
@@ -1125,11 +1133,11 @@ static anvil_error_t s370_codegen_module(anvil_backend_t *be, anvil_module_t *mo
                     if (num_args > priv->max_call_args) {
                         priv->max_call_args = num_args;
                     }
-                } else if (instr->op == ANVIL_OP_ALLOCA) {
-                    priv->local_vars_size += 4;  /* 4 bytes per local var */
                 }
             }
         }
+        /* Locals as laid out by s370_emit_func (slots may be shared) */
+        priv->local_vars_size = (int)func->stack_size - SA_SIZE - priv->max_call_args * 4;
         s370_emit_func_dynsize(priv, func);
     }
     
@@ -1266,8 +1274,7 @@ static anvil_error_t s370_codegen_module(anvil_backend_t *be, anvil_module_t *mo
     
     s370_emit_footer(priv, entry_point);
     
-    *output = anvil_strbuf_detach(&priv->code, len);
-    return ANVIL_OK;
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t s370_codegen_func(anvil_backend_t *be, anvil_func_t *func,
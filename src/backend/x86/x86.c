@@ -40,12 +40,6 @@ typedef struct {
     size_t len;
 } x86_string_entry_t;
 
-/* Stack slot for local variables */
-typedef struct {
-    anvil_value_t *value;
-    int offset;
-} x86_stack_slot_t;
-
 /* Backend private data */
 typedef struct {
     anvil_strbuf_t code;
@@ -57,9 +51,8 @@ typedef struct {
     int next_stack_offset;
     
     /* Stack slots for local variables */
-    x86_stack_slot_t *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function */
     
     /* String table */
     x86_string_entry_t *strings;
@@ -110,7 +103,8 @@ static void x86_cleanup(anvil_backend_t *be)
     anvil_strbuf_destroy(&priv->code);
     anvil_strbuf_destroy(&priv->data);
     free(priv->strings);
-    free(priv->stack_slots);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
     free(priv);
     be->priv = NULL;
 }
@@ -122,9 +116,10 @@ static void x86_reset(anvil_backend_t *be)
     x86_backend_t *priv = be->priv;
     
     /* Clear stack slots (contain pointers to anvil_value_t) */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->next_stack_offset = 0;
     priv->stack_offset = 0;
+    anvil_stack_colors_free(&priv->colors);
     
     /* Clear string table (contain pointers to string data) */
     priv->num_strings = 0;
@@ -138,22 +133,25 @@ static void x86_reset(anvil_backend_t *be)
 /* Add stack slot for local variable */
 static int x86_add_stack_slot(x86_backend_t *be, anvil_value_t *val)
 {
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 16;
-        x86_stack_slot_t *new_slots = realloc(be->stack_slots,
-            new_cap * sizeof(x86_stack_slot_t));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
+    /* x86 stack grows down, allocate 4 bytes per slot; values with
+     * disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (slot && slot->placed) {
+        offset = slot->offset;
+    } else {
+        be->next_stack_offset += slot ? slot->size : 4;
+        offset = be->next_stack_offset;
+        if (slot) {
+            slot->offset = offset;
+            slot->placed = true;
+        }
     }
     
-    /* x86 stack grows down, allocate 4 bytes per slot */
-    be->next_stack_offset += 4;
-    int offset = be->next_stack_offset;
-    
-    be->stack_slots[be->num_stack_slots].value = val;
-    be->stack_slots[be->num_stack_slots].offset = offset;
-    be->num_stack_slots++;
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
@@ -161,12 +159,16 @@ static int x86_add_stack_slot(x86_backend_t *be, anvil_value_t *val)
 /* Get stack slot offset for a value */
 static int x86_get_stack_slot(x86_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
+}
+
+/* Frame slot size for stack-slot coloring */
+static int x86_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 4;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 4 : 0;
 }
 
 static const anvil_arch_info_t *x86_get_arch_info(anvil_backend_t *be)
@@ -408,6 +410,7 @@ static void x86_emit_instr(x86_backend_t *be, anvil_instr_t *instr, anvil_syntax
     
     switch (instr->op) {
         case ANVIL_OP_PHI:
+            /* Not reached: codegen refuses phis without supports_phi */
             break;
             
         case ANVIL_OP_ALLOCA:
@@ -1036,9 +1039,13 @@ static void x86_emit_func(x86_backend_t *be, anvil_func_t *func, anvil_syntax_t
     if (!func || func->is_declaration) return;
     
     be->current_func = func;
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     be->next_stack_offset = 0;
     
+    /* Share slots between allocas with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, x86_slot_size, be);
+    
     /* First pass: count stack slots needed */
     for (anvil_block_t *block = func->blocks; block; block = block->next) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
@@ -1076,6 +1083,7 @@ static anvil_error_t x86_codegen_module(anvil_backend_t *be, anvil_module_t *mod
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     
     /* Reset string table */
     priv->num_strings = 0;
@@ -1105,6 +1113,8 @@ static anvil_error_t x86_codegen_module(anvil_backend_t *be, anvil_module_t *mod
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         if (!func->is_declaration) {
             x86_emit_func(priv, func, syntax);
+            anvil_error_t err = anvil_strbuf_flush(&priv->code);
+            if (err != ANVIL_OK) return err;
         }
     }
     
@@ -1151,8 +1161,7 @@ static anvil_error_t x86_codegen_module(anvil_backend_t *be, anvil_module_t *mod
         }
     }
     
-    *output = anvil_strbuf_detach(&priv->code, len);
-    return ANVIL_OK;
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t x86_codegen_func(anvil_backend_t *be, anvil_func_t *func,
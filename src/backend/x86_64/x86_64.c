@@ -6,90 +6,35 @@
  * Uses System V AMD64 ABI by default
  */
 
-#include "anvil/anvil_internal.h"
+#include "x86_64_internal.h"
+#include "anvil/anvil_opt.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 /* x86-64 registers */
-static const char *x64_gpr64_names[] = {
+const char *x64_gpr64_names[] = {
     "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
     "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
 };
 
-static const char *x64_gpr32_names[] = {
+const char *x64_gpr32_names[] = {
     "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
     "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
 };
 
-static const char *x64_gpr16_names[] = {
+const char *x64_gpr16_names[] = {
     "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
     "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"
 };
 
-static const char *x64_gpr8_names[] = {
+const char *x64_gpr8_names[] = {
     "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
     "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
 };
 
 /* System V AMD64 ABI: argument registers */
-static const int sysv_arg_regs[] = { 7, 6, 2, 1, 8, 9 }; /* rdi, rsi, rdx, rcx, r8, r9 */
-#define SYSV_NUM_ARG_REGS 6
-
-/* Register indices */
-#define X64_RAX 0
-#define X64_RCX 1
-#define X64_RDX 2
-#define X64_RBX 3
-#define X64_RSP 4
-#define X64_RBP 5
-#define X64_RSI 6
-#define X64_RDI 7
-#define X64_R8  8
-#define X64_R9  9
-#define X64_R10 10
-#define X64_R11 11
-#define X64_R12 12
-#define X64_R13 13
-#define X64_R14 14
-#define X64_R15 15
-
-/* String table entry */
-typedef struct {
-    const char *str;
-    char label[16];
-    size_t len;
-} x64_string_entry_t;
-
-/* Stack slot for local variables */
-typedef struct {
-    anvil_value_t *value;
-    int offset;
-} x64_stack_slot_t;
-
-/* Backend private data */
-typedef struct {
-    anvil_strbuf_t code;
-    anvil_strbuf_t data;
-    anvil_syntax_t syntax;
-    int label_counter;
-    int string_counter;
-    int stack_offset;
-    int next_stack_offset;
-    
-    /* Stack slots for local variables */
-    x64_stack_slot_t *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
-    
-    /* String table */
-    x64_string_entry_t *strings;
-    size_t num_strings;
-    size_t strings_cap;
-    
-    /* Current function being generated */
-    anvil_func_t *current_func;
-} x64_backend_t;
+const int sysv_arg_regs[] = { 7, 6, 2, 1, 8, 9 }; /* rdi, rsi, rdx, rcx, r8, r9 */
 
 static const anvil_arch_info_t x64_arch_info = {
     .arch = ANVIL_ARCH_X86_64,
@@ -105,14 +50,35 @@ static const anvil_arch_info_t x64_arch_info = {
     .has_delay_slots = false
 };
 
-static anvil_error_t x64_init(anvil_backend_t *be, anvil_ctx_t *ctx)
+static x64_backend_t *x64_priv_create(anvil_ctx_t *ctx)
 {
     x64_backend_t *priv = calloc(1, sizeof(x64_backend_t));
-    if (!priv) return ANVIL_ERR_NOMEM;
+    if (!priv) return NULL;
     
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
     priv->syntax = ctx->syntax == ANVIL_SYNTAX_DEFAULT ? ANVIL_SYNTAX_GAS : ctx->syntax;
+    priv->ctx = ctx;
+    return priv;
+}
+
+static void x64_priv_free(x64_backend_t *priv)
+{
+    if (!priv) return;
+    
+    anvil_strbuf_destroy(&priv->code);
+    anvil_strbuf_destroy(&priv->data);
+    free(priv->strings);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
+    x64_regalloc_free(&priv->ra);
+    free(priv);
+}
+
+static anvil_error_t x64_init(anvil_backend_t *be, anvil_ctx_t *ctx)
+{
+    x64_backend_t *priv = x64_priv_create(ctx);
+    if (!priv) return ANVIL_ERR_NOMEM;
     
     be->priv = priv;
     return ANVIL_OK;
@@ -122,12 +88,7 @@ static void x64_cleanup(anvil_backend_t *be)
 {
     if (!be || !be->priv) return;
     
-    x64_backend_t *priv = be->priv;
-    anvil_strbuf_destroy(&priv->code);
-    anvil_strbuf_destroy(&priv->data);
-    free(priv->strings);
-    free(priv->stack_slots);
-    free(priv);
+    x64_priv_free(be->priv);
     be->priv = NULL;
 }
 
@@ -138,7 +99,7 @@ static void x64_reset(anvil_backend_t *be)
     x64_backend_t *priv = be->priv;
     
     /* Clear stack slots (contain pointers to anvil_value_t) */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->next_stack_offset = 0;
     priv->stack_offset = 0;
     
@@ -149,27 +110,32 @@ static void x64_reset(anvil_backend_t *be)
     /* Reset other state */
     priv->label_counter = 0;
     priv->current_func = NULL;
+    anvil_stack_colors_free(&priv->colors);
+    x64_regalloc_free(&priv->ra);
 }
 
 /* Add stack slot for local variable */
 static int x64_add_stack_slot(x64_backend_t *be, anvil_value_t *val)
 {
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 16;
-        x64_stack_slot_t *new_slots = realloc(be->stack_slots,
-            new_cap * sizeof(x64_stack_slot_t));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
+    /* x86-64 stack grows down, allocate 8 bytes per slot; values with
+     * disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (slot && slot->placed) {
+        offset = slot->offset;
+    } else {
+        be->next_stack_offset += slot ? slot->size : 8;
+        offset = be->next_stack_offset;
+        if (slot) {
+            slot->offset = offset;
+            slot->placed = true;
+        }
     }
     
-    /* x86-64 stack grows down, allocate 8 bytes per slot */
-    be->next_stack_offset += 8;
-    int offset = be->next_stack_offset;
-    
-    be->stack_slots[be->num_stack_slots].value = val;
-    be->stack_slots[be->num_stack_slots].offset = offset;
-    be->num_stack_slots++;
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
@@ -177,12 +143,16 @@ static int x64_add_stack_slot(x64_backend_t *be, anvil_value_t *val)
 /* Get stack slot offset for a value */
 static int x64_get_stack_slot(x64_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
+}
+
+/* Frame slot size for stack-slot coloring */
+static int x64_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 8;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 8 : 0;
 }
 
 static const anvil_arch_info_t *x64_get_arch_info(anvil_backend_t *be)
@@ -250,13 +220,13 @@ static void x64_emit_epilogue(x64_backend_t *be, anvil_syntax_t syntax)
     }
 }
 
-/* Add string to string table and return its label */
-static const char *x64_add_string(x64_backend_t *be, const char *str)
+/* Index of str in the string table, added if new; -1 if out of memory */
+static long x64_string_index(x64_backend_t *be, const char *str)
 {
     /* Check if string already exists */
     for (size_t i = 0; i < be->num_strings; i++) {
         if (strcmp(be->strings[i].str, str) == 0) {
-            return be->strings[i].label;
+            return (long)i;
         }
     }
     
@@ -265,19 +235,70 @@ static const char *x64_add_string(x64_backend_t *be, const char *str)
         size_t new_cap = be->strings_cap ? be->strings_cap * 2 : 16;
         x64_string_entry_t *new_strings = realloc(be->strings, 
             new_cap * sizeof(x64_string_entry_t));
-        if (!new_strings) return ".str_err";
+        if (!new_strings) return -1;
         be->strings = new_strings;
         be->strings_cap = new_cap;
     }
     
-    /* Add new string */
+    /* Add new string; a worker's labels are placeholders that
+     * x64_emit_funcs_parallel replaces with the module-wide label */
     x64_string_entry_t *entry = &be->strings[be->num_strings];
     entry->str = str;
     entry->len = strlen(str);
-    snprintf(entry->label, sizeof(entry->label), ".str%d", be->string_counter++);
-    be->num_strings++;
-    
-    return entry->label;
+    if (be->is_worker) {
+        snprintf(entry->label, sizeof(entry->label), "%c%d%c",
+                 X64_STRING_MARK, be->string_counter++, X64_STRING_MARK);
+    } else {
+        snprintf(entry->label, sizeof(entry->label), ".str%d", be->string_counter++);
+    }
+    return (long)be->num_strings++;
+}
+
+/* Add string to string table and return its label */
+const char *x64_add_string(x64_backend_t *be, const char *str)
+{
+    long index = x64_string_index(be, str);
+    return index < 0 ? ".str_err" : be->strings[index].label;
+}
+
+/* Operand writers for the hot paths below (no format parsing) */
+static void x64_put_reg(x64_backend_t *be, const char *reg, anvil_syntax_t syntax)
+{
+    anvil_strbuf_append_reg(&be->code, syntax == ANVIL_SYNTAX_GAS ? "%" : NULL, reg);
+}
+
+/* disp(%rbp) / [rbp+disp] */
+static void x64_put_rbp(x64_backend_t *be, int64_t disp, anvil_syntax_t syntax)
+{
+    if (syntax == ANVIL_SYNTAX_GAS) {
+        anvil_strbuf_append_int(&be->code, disp);
+        anvil_strbuf_append_n(&be->code, "(%rbp)", 6);
+    } else {
+        anvil_strbuf_append_n(&be->code, disp < 0 ? "[rbp" : "[rbp+", disp < 0 ? 4 : 5);
+        anvil_strbuf_append_int(&be->code, disp);
+        anvil_strbuf_append_char(&be->code, ']');
+    }
+}
+
+/* "\t<op> <src>, <dst>\n" in GAS order; NASM swaps the operands */
+static void x64_emit_reg_rbp(x64_backend_t *be, const char *op, bool to_mem,
+                             const char *reg, int64_t disp, anvil_syntax_t syntax)
+{
+    bool reg_first = (syntax == ANVIL_SYNTAX_GAS) == to_mem;
+    anvil_strbuf_append_mnemonic(&be->code, op, NULL);
+    if (reg_first) x64_put_reg(be, reg, syntax);
+    else x64_put_rbp(be, disp, syntax);
+    anvil_strbuf_append_n(&be->code, ", ", 2);
+    if (reg_first) x64_put_rbp(be, disp, syntax);
+    else x64_put_reg(be, reg, syntax);
+    anvil_strbuf_append_char(&be->code, '\n');
+}
+
+static void x64_emit_jump(x64_backend_t *be, const char *op, anvil_block_t *block)
+{
+    anvil_strbuf_append_mnemonic(&be->code, op, NULL);
+    anvil_strbuf_append_label(&be->code, ".L", be->current_func->name, block->name);
+    anvil_strbuf_append_char(&be->code, '\n');
 }
 
 /* Load a value into a register */
@@ -290,10 +311,14 @@ static void x64_emit_load_value(x64_backend_t *be, anvil_value_t *val, int targe
     switch (val->kind) {
         case ANVIL_VAL_CONST_INT:
             if (syntax == ANVIL_SYNTAX_GAS) {
-                anvil_strbuf_appendf(&be->code, "\tmovq $%lld, %%%s\n", (long long)val->data.i, reg);
+                anvil_strbuf_append_imm(&be->code, "\tmovq $", val->data.i);
+                anvil_strbuf_append_n(&be->code, ", ", 2);
+                x64_put_reg(be, reg, syntax);
             } else {
-                anvil_strbuf_appendf(&be->code, "\tmov %s, %lld\n", reg, (long long)val->data.i);
+                anvil_strbuf_append_reg(&be->code, "\tmov ", reg);
+                anvil_strbuf_append_imm(&be->code, ", ", val->data.i);
             }
+            anvil_strbuf_append_char(&be->code, '\n');
             break;
             
         case ANVIL_VAL_CONST_NULL:
@@ -319,19 +344,18 @@ static void x64_emit_load_value(x64_backend_t *be, anvil_value_t *val, int targe
             if (val->data.param.index < SYSV_NUM_ARG_REGS) {
                 int src_reg = sysv_arg_regs[val->data.param.index];
                 if (src_reg != target_reg) {
-                    if (syntax == ANVIL_SYNTAX_GAS) {
-                        anvil_strbuf_appendf(&be->code, "\tmovq %%%s, %%%s\n", x64_gpr64_names[src_reg], reg);
-                    } else {
-                        anvil_strbuf_appendf(&be->code, "\tmov %s, %s\n", reg, x64_gpr64_names[src_reg]);
-                    }
+                    const char *first = syntax == ANVIL_SYNTAX_GAS ? x64_gpr64_names[src_reg] : reg;
+                    const char *second = syntax == ANVIL_SYNTAX_GAS ? reg : x64_gpr64_names[src_reg];
+                    anvil_strbuf_append_mnemonic(&be->code, syntax == ANVIL_SYNTAX_GAS ? "movq" : "mov", NULL);
+                    x64_put_reg(be, first, syntax);
+                    anvil_strbuf_append_n(&be->code, ", ", 2);
+                    x64_put_reg(be, second, syntax);
+                    anvil_strbuf_append_char(&be->code, '\n');
                 }
             } else {
                 size_t offset = 16 + (val->data.param.index - SYSV_NUM_ARG_REGS) * 8;
-                if (syntax == ANVIL_SYNTAX_GAS) {
-                    anvil_strbuf_appendf(&be->code, "\tmovq %zu(%%rbp), %%%s\n", offset, reg);
-                } else {
-                    anvil_strbuf_appendf(&be->code, "\tmov %s, [rbp+%zu]\n", reg, offset);
-                }
+                x64_emit_reg_rbp(be, syntax == ANVIL_SYNTAX_GAS ? "movq" : "mov", false,
+                                 reg, (int64_t)offset, syntax);
             }
             break;
             
@@ -339,19 +363,18 @@ static void x64_emit_load_value(x64_backend_t *be, anvil_value_t *val, int targe
             if (val->data.instr && val->data.instr->op == ANVIL_OP_ALLOCA) {
                 int offset = x64_get_stack_slot(be, val);
                 if (offset >= 0) {
-                    if (syntax == ANVIL_SYNTAX_GAS) {
-                        anvil_strbuf_appendf(&be->code, "\tleaq -%d(%%rbp), %%%s\n", offset, reg);
-                    } else {
-                        anvil_strbuf_appendf(&be->code, "\tlea %s, [rbp-%d]\n", reg, offset);
-                    }
+                    x64_emit_reg_rbp(be, syntax == ANVIL_SYNTAX_GAS ? "leaq" : "lea", false,
+                                     reg, -offset, syntax);
                 }
             } else {
                 if (target_reg != X64_RAX) {
                     if (syntax == ANVIL_SYNTAX_GAS) {
-                        anvil_strbuf_appendf(&be->code, "\tmovq %%rax, %%%s\n", reg);
+                        anvil_strbuf_append_reg(&be->code, "\tmovq %rax, %", reg);
                     } else {
-                        anvil_strbuf_appendf(&be->code, "\tmov %s, rax\n", reg);
+                        anvil_strbuf_append_reg(&be->code, "\tmov ", reg);
+                        anvil_strbuf_append_n(&be->code, ", rax", 5);
                     }
+                    anvil_strbuf_append_char(&be->code, '\n');
                 }
             }
             break;
@@ -384,11 +407,7 @@ static void x64_emit_value(x64_backend_t *be, anvil_value_t *val, anvil_syntax_t
     
     switch (val->kind) {
         case ANVIL_VAL_CONST_INT:
-            if (syntax == ANVIL_SYNTAX_GAS) {
-                anvil_strbuf_appendf(&be->code, "$%lld", (long long)val->data.i);
-            } else {
-                anvil_strbuf_appendf(&be->code, "%lld", (long long)val->data.i);
-            }
+            anvil_strbuf_append_imm(&be->code, syntax == ANVIL_SYNTAX_GAS ? "$" : NULL, val->data.i);
             break;
             
         case ANVIL_VAL_CONST_STRING:
@@ -406,19 +425,11 @@ static void x64_emit_value(x64_backend_t *be, anvil_value_t *val, anvil_syntax_t
             /* System V ABI: first 6 args in registers, rest on stack */
             if (val->data.param.index < SYSV_NUM_ARG_REGS) {
                 int reg = sysv_arg_regs[val->data.param.index];
-                if (syntax == ANVIL_SYNTAX_GAS) {
-                    anvil_strbuf_appendf(&be->code, "%%%s", x64_gpr64_names[reg]);
-                } else {
-                    anvil_strbuf_appendf(&be->code, "%s", x64_gpr64_names[reg]);
-                }
+                x64_put_reg(be, x64_gpr64_names[reg], syntax);
             } else {
                 /* Stack args at positive offset from RBP */
                 size_t offset = 16 + (val->data.param.index - SYSV_NUM_ARG_REGS) * 8;
-                if (syntax == ANVIL_SYNTAX_GAS) {
-                    anvil_strbuf_appendf(&be->code, "%zu(%%rbp)", offset);
-                } else {
-                    anvil_strbuf_appendf(&be->code, "[rbp+%zu]", offset);
-                }
+                x64_put_rbp(be, (int64_t)offset, syntax);
             }
             break;
             
@@ -455,15 +466,20 @@ static void x64_emit_instr(x64_backend_t *be, anvil_instr_t *instr, anvil_syntax
     
     switch (instr->op) {
         case ANVIL_OP_PHI:
+            /* Not reached: x64_emit_func sends functions with phis to the allocator */
             break;
             
         case ANVIL_OP_ALLOCA:
             {
                 int offset = x64_add_stack_slot(be, instr->result);
                 if (syntax == ANVIL_SYNTAX_GAS) {
-                    anvil_strbuf_appendf(&be->code, "\tmovq $0, -%d(%%rbp)\n", offset);
+                    anvil_strbuf_append_n(&be->code, "\tmovq $0, ", 10);
+                    x64_put_rbp(be, -offset, syntax);
+                    anvil_strbuf_append_char(&be->code, '\n');
                 } else {
-                    anvil_strbuf_appendf(&be->code, "\tmov qword [rbp-%d], 0\n", offset);
+                    anvil_strbuf_append_n(&be->code, "\tmov qword ", 11);
+                    x64_put_rbp(be, -offset, syntax);
+                    anvil_strbuf_append_n(&be->code, ", 0\n", 4);
                 }
             }
             break;
@@ -626,11 +642,8 @@ static void x64_emit_instr(x64_backend_t *be, anvil_instr_t *instr, anvil_syntax
                 instr->operands[0]->data.instr->op == ANVIL_OP_ALLOCA) {
                 int offset = x64_get_stack_slot(be, instr->operands[0]);
                 if (offset >= 0) {
-                    if (syntax == ANVIL_SYNTAX_GAS) {
-                        anvil_strbuf_appendf(&be->code, "\tmovq -%d(%%rbp), %%rax\n", offset);
-                    } else {
-                        anvil_strbuf_appendf(&be->code, "\tmov rax, [rbp-%d]\n", offset);
-                    }
+                    x64_emit_reg_rbp(be, syntax == ANVIL_SYNTAX_GAS ? "movq" : "mov", false,
+                                     "rax", -offset, syntax);
                     break;
                 }
             }
@@ -657,11 +670,8 @@ static void x64_emit_instr(x64_backend_t *be, anvil_instr_t *instr, anvil_syntax
                 int offset = x64_get_stack_slot(be, instr->operands[1]);
                 if (offset >= 0) {
                     x64_emit_load_value(be, instr->operands[0], X64_RAX, syntax);
-                    if (syntax == ANVIL_SYNTAX_GAS) {
-                        anvil_strbuf_appendf(&be->code, "\tmovq %%rax, -%d(%%rbp)\n", offset);
-                    } else {
-                        anvil_strbuf_appendf(&be->code, "\tmov [rbp-%d], rax\n", offset);
-                    }
+                    x64_emit_reg_rbp(be, syntax == ANVIL_SYNTAX_GAS ? "movq" : "mov", true,
+                                     "rax", -offset, syntax);
                     break;
                 }
             }
@@ -735,7 +745,7 @@ static void x64_emit_instr(x64_backend_t *be, anvil_instr_t *instr, anvil_syntax
             
         case ANVIL_OP_BR:
             if (instr->true_block) {
-                anvil_strbuf_appendf(&be->code, "\tjmp .L%s_%s\n", be->current_func->name, instr->true_block->name);
+                x64_emit_jump(be, "jmp", instr->true_block);
             }
             break;
             
@@ -744,8 +754,8 @@ static void x64_emit_instr(x64_backend_t *be, anvil_instr_t *instr, anvil_syntax
             if (syntax == ANVIL_SYNTAX_GAS) anvil_strbuf_append(&be->code, "\ttestq %rax, %rax\n");
             else anvil_strbuf_append(&be->code, "\ttest rax, rax\n");
             if (instr->true_block && instr->false_block) {
-                anvil_strbuf_appendf(&be->code, "\tjnz .L%s_%s\n", be->current_func->name, instr->true_block->name);
-                anvil_strbuf_appendf(&be->code, "\tjmp .L%s_%s\n", be->current_func->name, instr->false_block->name);
+                x64_emit_jump(be, "jnz", instr->true_block);
+                x64_emit_jump(be, "jmp", instr->false_block);
             }
             break;
             
@@ -1146,7 +1156,8 @@ static void x64_emit_block(x64_backend_t *be, anvil_block_t *block, anvil_syntax
     
     /* Emit label with function prefix (skip for entry block) */
     if (block != be->current_func->blocks) {
-        anvil_strbuf_appendf(&be->code, ".L%s_%s:\n", be->current_func->name, block->name);
+        anvil_strbuf_append_label(&be->code, ".L", be->current_func->name, block->name);
+        anvil_strbuf_append_n(&be->code, ":\n", 2);
     }
     
     for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
@@ -1154,14 +1165,39 @@ static void x64_emit_block(x64_backend_t *be, anvil_block_t *block, anvil_syntax
     }
 }
 
+static bool x64_has_phis(const anvil_func_t *func)
+{
+    for (const anvil_block_t *block = func->blocks; block; block = block->next) {
+        if (block->first && block->first->op == ANVIL_OP_PHI) return true;
+    }
+    return false;
+}
+
 static void x64_emit_func(x64_backend_t *be, anvil_func_t *func, anvil_syntax_t syntax)
 {
     if (!func || func->is_declaration) return;
     
+    /* Internal labels carry the function name, so numbering restarts per
+     * function and a function's text does not depend on the ones before it */
+    be->label_counter = 0;
+    
+    /* Og and above: linear-scan register allocation (x86_64_ra_emit.c).
+     * At O0 the emitter keeps only the last result in rax, which cannot
+     * carry a value an optimized operand refers to from further back or a
+     * phi, so functions with phis take the allocator too. */
+    if ((be->ctx && be->ctx->opt_level > ANVIL_OPT_NONE) || x64_has_phis(func)) {
+        x64_ra_emit_func(be, func, syntax);
+        return;
+    }
+    
     be->current_func = func;
-    be->num_stack_slots = 0;
+    anvil_value_map_reset(&be->stack_slots, func);
     be->next_stack_offset = 0;
     
+    /* Share slots between allocas with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, x64_slot_size, be);
+    
     /* First pass: count stack slots needed */
     for (anvil_block_t *block = func->blocks; block; block = block->next) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
@@ -1184,6 +1220,126 @@ static void x64_emit_func(x64_backend_t *be, anvil_func_t *func, anvil_syntax_t
     anvil_strbuf_append(&be->code, "\n");
 }
 
+/*
+ * Parallel codegen: functions are emitted on worker threads, each with
+ * its own x64_backend_t, into per-function buffers. The calling thread
+ * then appends them to be->code in module order. Workers number their
+ * strings per function behind X64_STRING_MARK placeholders; merging a
+ * function's strings into the module table in first-use order and
+ * substituting the labels reproduces the serial output exactly.
+ * Functions go in batches so that streamed output is not held back
+ * until the whole module is done.
+ */
+
+#define X64_FUNCS_PER_WORKER 16
+
+typedef struct {
+    anvil_func_t *func;
+    char *text;
+    size_t len;
+    const char **strings;   /* Placeholder n stands for strings[n] */
+    size_t num_strings;
+} x64_func_job_t;
+
+typedef struct {
+    x64_backend_t **workers;
+    x64_func_job_t *jobs;
+    anvil_syntax_t syntax;
+} x64_parallel_t;
+
+static anvil_error_t x64_emit_job(void *data, size_t worker, size_t index)
+{
+    x64_parallel_t *par = data;
+    x64_backend_t *be = par->workers[worker];
+    x64_func_job_t *job = &par->jobs[index];
+    
+    be->num_strings = 0;
+    be->string_counter = 0;
+    anvil_strbuf_destroy(&be->code);
+    anvil_strbuf_init(&be->code);
+    x64_emit_func(be, job->func, par->syntax);
+    job->text = anvil_strbuf_detach(&be->code, &job->len);
+    if (!job->text) return ANVIL_ERR_NOMEM;
+    
+    if (be->num_strings > 0) {
+        job->strings = malloc(be->num_strings * sizeof(const char *));
+        if (!job->strings) return ANVIL_ERR_NOMEM;
+        for (size_t i = 0; i < be->num_strings; i++) {
+            job->strings[i] = be->strings[i].str;
+        }
+        job->num_strings = be->num_strings;
+    }
+    return ANVIL_OK;
+}
+
+/* Append a worker's text to be->code with module-wide string labels */
+static anvil_error_t x64_merge_job(x64_backend_t *be, x64_func_job_t *job)
+{
+    long *index = NULL;
+    if (job->num_strings > 0) {
+        index = malloc(job->num_strings * sizeof(long));
+        if (!index) return ANVIL_ERR_NOMEM;
+        for (size_t i = 0; i < job->num_strings; i++) {
+            index[i] = x64_string_index(be, job->strings[i]);
+            if (index[i] < 0) {
+                free(index);
+                return ANVIL_ERR_NOMEM;
+            }
+        }
+    }
+    
+    const char *p = job->text;
+    const char *end = job->text + job->len;
+    const char *mark;
+    while ((mark = memchr(p, X64_STRING_MARK, (size_t)(end - p))) != NULL) {
+        anvil_strbuf_append_n(&be->code, p, (size_t)(mark - p));
+        size_t n = strtoul(mark + 1, (char **)&p, 10);
+        p++;    /* Closing mark */
+        anvil_strbuf_append(&be->code, be->strings[index[n]].label);
+    }
+    anvil_strbuf_append_n(&be->code, p, (size_t)(end - p));
+    free(index);
+    return anvil_strbuf_flush(&be->code);
+}
+
+static anvil_error_t x64_emit_funcs_parallel(x64_backend_t *be, anvil_module_t *mod,
+                                             anvil_syntax_t syntax, int threads)
+{
+    size_t batch = (size_t)threads * X64_FUNCS_PER_WORKER;
+    x64_parallel_t par = { .syntax = syntax };
+    par.workers = calloc((size_t)threads, sizeof(x64_backend_t *));
+    par.jobs = calloc(batch, sizeof(x64_func_job_t));
+    anvil_error_t err = par.workers && par.jobs ? ANVIL_OK : ANVIL_ERR_NOMEM;
+    for (int i = 0; i < threads && err == ANVIL_OK; i++) {
+        par.workers[i] = x64_priv_create(be->ctx);
+        if (!par.workers[i]) err = ANVIL_ERR_NOMEM;
+        else par.workers[i]->is_worker = true;
+    }
+    
+    anvil_func_t *func = mod->funcs;
+    while (err == ANVIL_OK && func) {
+        size_t count = 0;
+        for (; func && count < batch; func = func->next) {
+            if (!func->is_declaration) par.jobs[count++].func = func;
+        }
+        
+        err = anvil_parallel_for(threads, count, x64_emit_job, &par);
+        for (size_t i = 0; i < count; i++) {
+            if (err == ANVIL_OK) err = x64_merge_job(be, &par.jobs[i]);
+            free(par.jobs[i].text);
+            free(par.jobs[i].strings);
+            par.jobs[i] = (x64_func_job_t){ 0 };
+        }
+    }
+    
+    if (par.workers) {
+        for (int i = 0; i < threads; i++) x64_priv_free(par.workers[i]);
+    }
+    free(par.workers);
+    free(par.jobs);
+    return err;
+}
+
 static anvil_error_t x64_codegen_module(anvil_backend_t *be, anvil_module_t *mod,
                                          char **output, size_t *len)
 {
@@ -1196,6 +1352,7 @@ static anvil_error_t x64_codegen_module(anvil_backend_t *be, anvil_module_t *mod
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     
     /* Reset string table */
     priv->num_strings = 0;
@@ -1221,9 +1378,17 @@ static anvil_error_t x64_codegen_module(anvil_backend_t *be, anvil_module_t *mod
     }
     
     /* Emit function definitions (skip declarations) */
-    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
-        if (!func->is_declaration) {
-            x64_emit_func(priv, func, syntax);
+    int threads = anvil_parallel_threads(priv->ctx->codegen_threads);
+    if (threads > 1) {
+        anvil_error_t err = x64_emit_funcs_parallel(priv, mod, syntax, threads);
+        if (err != ANVIL_OK) return err;
+    } else {
+        for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+            if (!func->is_declaration) {
+                x64_emit_func(priv, func, syntax);
+                anvil_error_t err = anvil_strbuf_flush(&priv->code);
+                if (err != ANVIL_OK) return err;
+            }
         }
     }
     
@@ -1269,8 +1434,7 @@ static anvil_error_t x64_codegen_module(anvil_backend_t *be, anvil_module_t *mod
         }
     }
     
-    *output = anvil_strbuf_detach(&priv->code, len);
-    return ANVIL_OK;
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t x64_codegen_func(anvil_backend_t *be, anvil_func_t *func,
@@ -1290,13 +1454,54 @@ static anvil_error_t x64_codegen_func(anvil_backend_t *be, anvil_func_t *func,
     return ANVIL_OK;
 }
 
+/*
+ * Object output: the emitters write GAS text as usual and the code
+ * buffer's sink hands each function to the assembler as it is flushed,
+ * so the text never accumulates. Global variables are laid out by the
+ * core from their initializers.
+ */
+static anvil_error_t x64_codegen_object(anvil_backend_t *be, anvil_module_t *mod,
+                                         anvil_elf_object_t *obj)
+{
+    if (!be || !mod || !obj) return ANVIL_ERR_INVALID_ARG;
+    
+    x64_backend_t *priv = be->priv;
+    anvil_error_t err = anvil_elf_add_globals(obj, mod);
+    if (err != ANVIL_OK) return err;
+    
+    x64_asm_t *as = x64_asm_create(priv->ctx, obj);
+    if (!as) return ANVIL_ERR_NOMEM;
+    
+    anvil_syntax_t syntax = be->syntax;
+    anvil_write_fn sink = be->sink;
+    void *sink_data = be->sink_data;
+    be->syntax = ANVIL_SYNTAX_GAS;
+    be->sink = x64_asm_write;
+    be->sink_data = as;
+    
+    char *text = NULL;
+    err = x64_codegen_module(be, mod, &text, NULL);
+    free(text);
+    
+    be->syntax = syntax;
+    be->sink = sink;
+    be->sink_data = sink_data;
+    
+    if (err == ANVIL_OK) err = x64_asm_finish(as);
+    x64_asm_destroy(as);
+    return err;
+}
+
 const anvil_backend_ops_t anvil_backend_x86_64 = {
     .name = "x86-64",
     .arch = ANVIL_ARCH_X86_64,
     .init = x64_init,
     .cleanup = x64_cleanup,
     .reset = x64_reset,
+    .supports_phi = true,
+    .parallel_codegen = true,
     .codegen_module = x64_codegen_module,
     .codegen_func = x64_codegen_func,
+    .codegen_object = x64_codegen_object,
     .get_arch_info = x64_get_arch_info
 };
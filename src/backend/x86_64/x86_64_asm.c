@@ -0,0 +1,1597 @@
+/*
+ * ANVIL - x86-64 Object Assembler
+ *
+ * Encodes the backend's own GAS output into machine code for
+ * ANVIL_OUTPUT_BINARY. The emitters stay the single place where
+ * instructions are selected; this file accepts the AT&T subset they
+ * produce and rejects anything else with ANVIL_ERR_CODEGEN rather than
+ * guessing.
+ *
+ * Text arrives one function at a time through the code buffer's sink.
+ * Each chunk is encoded with every local branch short, then branches
+ * whose target is out of rel8 range are widened until nothing changes.
+ * That is the relaxation GAS performs, and encodings follow GAS's
+ * choices, so the bytes match what `as` produces for the same text.
+ */
+
+#include "x86_64_internal.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ELF relocation types (R_X86_64_*) */
+typedef enum {
+    X64_RELOC_64 = 1,       /* Absolute address */
+    X64_RELOC_PC32 = 2,     /* rip-relative reference */
+    X64_RELOC_PLT32 = 4,    /* Call or jump to a global */
+    X64_RELOC_32 = 10,      /* Zero-extended absolute imm32 */
+    X64_RELOC_32S = 11      /* Sign-extended absolute imm32 */
+} x64_reloc_kind_t;
+
+/* Pseudo register numbers for memory operands */
+#define REG_NONE (-1)
+#define REG_RIP  (-2)
+
+typedef enum {
+    OPND_NONE,
+    OPND_GPR,
+    OPND_XMM,
+    OPND_IMM,
+    OPND_MEM
+} opnd_kind_t;
+
+typedef struct {
+    opnd_kind_t kind;
+    int reg;                /* GPR/XMM number */
+    int size;               /* GPR width in bytes */
+    int base, index, scale; /* MEM: base may be REG_NONE or REG_RIP */
+    int64_t disp;           /* MEM displacement or IMM value */
+    const char *sym;        /* Symbol in the displacement or immediate */
+    size_t sym_len;
+    bool indirect;          /* Written with a leading '*' */
+} opnd_t;
+
+/* Relaxable branch in the pending text chunk */
+typedef struct {
+    size_t at;              /* Chunk offset of the branch */
+    size_t sym;
+    int cc;                 /* Condition code, -1 for jmp */
+    bool is_long;
+} branch_t;
+
+/* Label or fixup recorded against a chunk offset; nbr branches precede it */
+typedef struct {
+    size_t at;
+    size_t nbr;
+    size_t sym;
+    int64_t addend;
+    x64_reloc_kind_t kind;
+} pending_t;
+
+/* Symbol reference at a final section offset */
+typedef struct {
+    int section;
+    size_t at;
+    size_t sym;
+    int64_t addend;
+    x64_reloc_kind_t kind;
+    bool via_section;       /* Local symbol: relocate against its section */
+} fixup_t;
+
+/* Assembler symbol. Only the ones that reach the symbol table are added
+ * to the object, at x64_asm_finish. */
+typedef struct {
+    char *name;
+    int section;            /* anvil_elf_section_t, or ANVIL_ELF_UNDEF */
+    size_t offset;
+    bool global;            /* .globl */
+    bool func;              /* .type name, @function */
+    bool used;              /* Named by a relocation */
+    size_t pending;         /* Chunk label index + 1 */
+    long elf;               /* Index in the object */
+} x64_symbol_t;
+
+struct x64_asm {
+    anvil_ctx_t *ctx;
+    anvil_elf_object_t *elf;    /* Receives section bytes, symbols, relocations */
+    int section;
+    anvil_error_t err;
+
+    x64_symbol_t *syms;
+    size_t num_syms, syms_cap;
+
+    /* name -> symbol index + 1, open addressing */
+    size_t *sym_table;
+    size_t sym_table_cap;
+
+    /* Resolved at x64_asm_finish: all references in the module */
+    fixup_t *fixups;
+    size_t num_fixups, fixups_cap;
+
+    /* Text chunk being assembled, before relaxation */
+    anvil_strbuf_t chunk;
+    branch_t *branches;
+    size_t num_branches, branches_cap;
+    pending_t *labels;
+    size_t num_labels, labels_cap;
+    pending_t *chunk_fixups;
+    size_t num_chunk_fixups, chunk_fixups_cap;
+    size_t *offsets;        /* Bytes added by the first n branches */
+    size_t offsets_cap;
+
+    anvil_strbuf_t line;    /* Current line, split in place while parsing */
+    const char *raw;        /* The same line as written, for errors */
+    size_t raw_len;
+};
+
+/* ============================================================================
+ * Buffers and symbols
+ * ============================================================================ */
+
+static bool grow(void **arr, size_t *cap, size_t need, size_t elem)
+{
+    if (need <= *cap) return true;
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    while (new_cap < need) new_cap *= 2;
+    void *p = realloc(*arr, new_cap * elem);
+    if (!p) return false;
+    *arr = p;
+    *cap = new_cap;
+    return true;
+}
+
+#define GROW(as, arr, count, cap) \
+    (grow((void **)&(arr), &(cap), (count) + 1, sizeof(*(arr))) ? true : \
+     ((as)->err = ANVIL_ERR_NOMEM, false))
+
+static uint64_t name_hash(const char *name, size_t len)
+{
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static bool sym_table_grow(x64_asm_t *as)
+{
+    size_t cap = as->sym_table_cap ? as->sym_table_cap * 2 : 256;
+    size_t *table = calloc(cap, sizeof(size_t));
+    if (!table) return false;
+    for (size_t i = 0; i < as->num_syms; i++) {
+        const char *name = as->syms[i].name;
+        size_t slot = name_hash(name, strlen(name)) & (cap - 1);
+        while (table[slot]) slot = (slot + 1) & (cap - 1);
+        table[slot] = i + 1;
+    }
+    free(as->sym_table);
+    as->sym_table = table;
+    as->sym_table_cap = cap;
+    return true;
+}
+
+/* Index of the symbol with this name, created undefined if new */
+static size_t sym_get(x64_asm_t *as, const char *name, size_t len)
+{
+    if (2 * (as->num_syms + 1) > as->sym_table_cap && !sym_table_grow(as)) {
+        as->err = ANVIL_ERR_NOMEM;
+        return 0;
+    }
+    size_t mask = as->sym_table_cap - 1;
+    size_t slot = name_hash(name, len) & mask;
+    while (as->sym_table[slot]) {
+        size_t i = as->sym_table[slot] - 1;
+        const char *s = as->syms[i].name;
+        if (strncmp(s, name, len) == 0 && s[len] == '\0') return i;
+        slot = (slot + 1) & mask;
+    }
+
+    if (!GROW(as, as->syms, as->num_syms, as->syms_cap)) return 0;
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        as->err = ANVIL_ERR_NOMEM;
+        return 0;
+    }
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    size_t i = as->num_syms++;
+    x64_symbol_t *sym = &as->syms[i];
+    memset(sym, 0, sizeof(*sym));
+    sym->name = copy;
+    sym->section = -1;
+    as->sym_table[slot] = i + 1;
+    return i;
+}
+
+static anvil_error_t fail(x64_asm_t *as, const char *what)
+{
+    if (as->err == ANVIL_OK) {
+        as->err = ANVIL_ERR_CODEGEN;
+        anvil_set_error(as->ctx, ANVIL_ERR_CODEGEN, "x86-64 object output: %s: %.*s",
+                        what, (int)as->raw_len, as->raw ? as->raw : "");
+    }
+    return as->err;
+}
+
+/* Output goes to the pending chunk in .text and straight to .data */
+static anvil_strbuf_t *out(x64_asm_t *as)
+{
+    return as->section == ANVIL_ELF_TEXT ? &as->chunk : &as->elf->sec[as->section];
+}
+
+static void put8(x64_asm_t *as, uint8_t b)
+{
+    char c = (char)b;
+    anvil_strbuf_append_n(out(as), &c, 1);
+}
+
+static void put_le(x64_asm_t *as, uint64_t v, int bytes)
+{
+    char buf[8];
+    for (int i = 0; i < bytes; i++) buf[i] = (char)(v >> (8 * i));
+    anvil_strbuf_append_n(out(as), buf, (size_t)bytes);
+}
+
+/* Reference to sym at the current output position */
+static void add_fixup(x64_asm_t *as, const char *name, size_t len, int64_t addend,
+                      x64_reloc_kind_t kind)
+{
+    size_t sym = sym_get(as, name, len);
+    if (as->err != ANVIL_OK) return;
+
+    if (as->section == ANVIL_ELF_TEXT) {
+        if (!GROW(as, as->chunk_fixups, as->num_chunk_fixups, as->chunk_fixups_cap)) return;
+        as->chunk_fixups[as->num_chunk_fixups++] =
+            (pending_t){ as->chunk.len, as->num_branches, sym, addend, kind };
+    } else {
+        if (!GROW(as, as->fixups, as->num_fixups, as->fixups_cap)) return;
+        as->fixups[as->num_fixups++] =
+            (fixup_t){ as->section, out(as)->len, sym, addend, kind, false };
+    }
+}
+
+static void define_label(x64_asm_t *as, const char *name, size_t len)
+{
+    size_t sym = sym_get(as, name, len);
+    if (as->err != ANVIL_OK) return;
+    x64_symbol_t *s = &as->syms[sym];
+    if (s->section >= 0 || s->pending) {
+        fail(as, "symbol defined twice");
+        return;
+    }
+
+    if (as->section == ANVIL_ELF_TEXT) {
+        if (!GROW(as, as->labels, as->num_labels, as->labels_cap)) return;
+        as->labels[as->num_labels++] = (pending_t){ as->chunk.len, as->num_branches, sym, 0, 0 };
+        s->pending = as->num_labels;
+    } else {
+        s->section = as->section;
+        s->offset = as->elf->sec[as->section].len;
+    }
+}
+
+/* ============================================================================
+ * Branch relaxation
+ * ============================================================================ */
+
+static int branch_size(const branch_t *br)
+{
+    if (!br->is_long) return 2;
+    return br->cc < 0 ? 5 : 6;
+}
+
+static void compute_offsets(x64_asm_t *as)
+{
+    as->offsets[0] = 0;
+    for (size_t i = 0; i < as->num_branches; i++) {
+        as->offsets[i + 1] = as->offsets[i] + (size_t)branch_size(&as->branches[i]);
+    }
+}
+
+static size_t label_addr(x64_asm_t *as, const pending_t *label)
+{
+    return label->at + as->offsets[label->nbr];
+}
+
+/* Chunk label a branch can reach directly, or NULL if it needs a fixup */
+static const pending_t *chunk_label(x64_asm_t *as, size_t sym)
+{
+    const x64_symbol_t *s = &as->syms[sym];
+    if (!s->pending || s->global) return NULL;
+    return &as->labels[s->pending - 1];
+}
+
+static void flush_text(x64_asm_t *as)
+{
+    if (as->err != ANVIL_OK) return;
+    if (as->chunk.len == 0 && as->num_branches == 0 && as->num_labels == 0) return;
+
+    if (!grow((void **)&as->offsets, &as->offsets_cap, as->num_branches + 1, sizeof(size_t))) {
+        as->err = ANVIL_ERR_NOMEM;
+        return;
+    }
+
+    /* Branches start short when their target is in the chunk */
+    const pending_t **targets = calloc(as->num_branches + 1, sizeof(*targets));
+    if (!targets) {
+        as->err = ANVIL_ERR_NOMEM;
+        return;
+    }
+    for (size_t i = 0; i < as->num_branches; i++) {
+        targets[i] = chunk_label(as, as->branches[i].sym);
+        as->branches[i].is_long = targets[i] == NULL;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        compute_offsets(as);
+        for (size_t i = 0; i < as->num_branches; i++) {
+            branch_t *br = &as->branches[i];
+            if (br->is_long) continue;
+            int64_t from = (int64_t)(br->at + as->offsets[i] + 2);
+            int64_t disp = (int64_t)label_addr(as, targets[i]) - from;
+            if (disp < -128 || disp > 127) {
+                br->is_long = true;
+                changed = true;
+            }
+        }
+    }
+
+    anvil_strbuf_t *text = &as->elf->sec[ANVIL_ELF_TEXT];
+    size_t base = text->len;
+    size_t pos = 0;
+    for (size_t i = 0; i < as->num_branches; i++) {
+        branch_t *br = &as->branches[i];
+        anvil_strbuf_append_n(text, as->chunk.data + pos, br->at - pos);
+        pos = br->at;
+
+        size_t here = base + br->at + as->offsets[i];
+        size_t size = (size_t)branch_size(br);
+        char bytes[6];
+        size_t op_len;
+        if (!br->is_long) {
+            bytes[0] = (char)(br->cc < 0 ? 0xEB : 0x70 + br->cc);
+            op_len = 1;
+        } else if (br->cc < 0) {
+            bytes[0] = (char)0xE9;
+            op_len = 1;
+        } else {
+            bytes[0] = 0x0F;
+            bytes[1] = (char)(0x80 + br->cc);
+            op_len = 2;
+        }
+
+        int64_t disp = 0;
+        if (targets[i]) {
+            disp = (int64_t)(base + label_addr(as, targets[i])) - (int64_t)(here + size);
+        } else {
+            if (!GROW(as, as->fixups, as->num_fixups, as->fixups_cap)) break;
+            as->fixups[as->num_fixups++] = (fixup_t){
+                ANVIL_ELF_TEXT, here + op_len, br->sym, -4, X64_RELOC_PLT32, false };
+        }
+        for (size_t b = op_len; b < size; b++) {
+            bytes[b] = (char)(disp >> (8 * (b - op_len)));
+        }
+        anvil_strbuf_append_n(text, bytes, size);
+    }
+    anvil_strbuf_append_n(text, as->chunk.data + pos, as->chunk.len - pos);
+    free(targets);
+
+    for (size_t i = 0; i < as->num_labels; i++) {
+        x64_symbol_t *s = &as->syms[as->labels[i].sym];
+        s->section = ANVIL_ELF_TEXT;
+        s->offset = base + label_addr(as, &as->labels[i]);
+        s->pending = 0;
+    }
+    for (size_t i = 0; i < as->num_chunk_fixups; i++) {
+        const pending_t *fix = &as->chunk_fixups[i];
+        if (!GROW(as, as->fixups, as->num_fixups, as->fixups_cap)) break;
+        as->fixups[as->num_fixups++] = (fixup_t){
+            ANVIL_ELF_TEXT, base + fix->at + as->offsets[fix->nbr], fix->sym, fix->addend,
+            fix->kind, false };
+    }
+
+    as->chunk.len = 0;
+    as->num_branches = 0;
+    as->num_labels = 0;
+    as->num_chunk_fixups = 0;
+}
+
+/* ============================================================================
+ * Operand parsing
+ * ============================================================================ */
+
+static bool is_sym_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$';
+}
+
+static const char *skip_ws(const char *p)
+{
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+static bool parse_number(const char **pp, int64_t *val)
+{
+    const char *p = *pp;
+    bool neg = false;
+    if (*p == '-' || *p == '+') {
+        neg = *p == '-';
+        p++;
+    }
+    if (!isdigit((unsigned char)*p)) return false;
+    char *end;
+    uint64_t v = strtoull(p, &end, 0);
+    *val = neg ? (int64_t)(0 - v) : (int64_t)v;
+    *pp = end;
+    return true;
+}
+
+/* number | sym | sym+number | sym-number */
+static bool parse_expr(const char **pp, opnd_t *op)
+{
+    const char *p = *pp;
+    op->disp = 0;
+    op->sym = NULL;
+    if (parse_number(&p, &op->disp)) {
+        *pp = p;
+        return true;
+    }
+    if (!is_sym_char(*p) || isdigit((unsigned char)*p)) return false;
+    op->sym = p;
+    while (is_sym_char(*p)) p++;
+    op->sym_len = (size_t)(p - op->sym);
+    if ((*p == '+' || *p == '-') && !parse_number(&p, &op->disp)) return false;
+    *pp = p;
+    return true;
+}
+
+static bool parse_reg(const char **pp, opnd_t *op)
+{
+    const char *p = *pp + 1;    /* past '%' */
+    const char *name = p;
+    while (isalnum((unsigned char)*p)) p++;
+    size_t len = (size_t)(p - name);
+    *pp = p;
+
+    if (len == 3 && strncmp(name, "rip", 3) == 0) {
+        op->kind = OPND_GPR;
+        op->reg = REG_RIP;
+        op->size = 8;
+        return true;
+    }
+    if (len > 3 && strncmp(name, "xmm", 3) == 0) {
+        int n = atoi(name + 3);
+        if (n < 0 || n >= X64_NUM_XMM) return false;
+        op->kind = OPND_XMM;
+        op->reg = n;
+        op->size = 16;
+        return true;
+    }
+
+    static const char **const tables[] = {
+        x64_gpr64_names, x64_gpr32_names, x64_gpr16_names, x64_gpr8_names
+    };
+    static const int sizes[] = { 8, 4, 2, 1 };
+    for (int t = 0; t < 4; t++) {
+        for (int r = 0; r < X64_NUM_GPR; r++) {
+            const char *rn = tables[t][r];
+            if (strlen(rn) == len && strncmp(rn, name, len) == 0) {
+                op->kind = OPND_GPR;
+                op->reg = r;
+                op->size = sizes[t];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool parse_opnd(const char *p, opnd_t *op)
+{
+    memset(op, 0, sizeof(*op));
+    op->base = REG_NONE;
+    op->index = REG_NONE;
+    op->scale = 1;
+
+    p = skip_ws(p);
+    if (*p == '*') {
+        op->indirect = true;
+        p++;
+    }
+
+    if (*p == '%') {
+        if (!parse_reg(&p, op) || op->reg == REG_RIP) return false;
+        return *skip_ws(p) == '\0';
+    }
+
+    if (*p == '$') {
+        p++;
+        op->kind = OPND_IMM;
+        return parse_expr(&p, op) && *skip_ws(p) == '\0';
+    }
+
+    /* Memory: [expr](base[,index[,scale]]), or a bare expr */
+    op->kind = OPND_MEM;
+    if (*p != '(' && !parse_expr(&p, op)) return false;
+    p = skip_ws(p);
+    if (*p == '\0') return true;
+    if (*p++ != '(') return false;
+
+    opnd_t r;
+    p = skip_ws(p);
+    if (*p == '%') {
+        if (!parse_reg(&p, &r) || r.kind != OPND_GPR || r.size != 8) return false;
+        op->base = r.reg;
+    }
+    p = skip_ws(p);
+    if (*p == ',') {
+        p = skip_ws(p + 1);
+        if (*p != '%' || !parse_reg(&p, &r) || r.kind != OPND_GPR || r.size != 8 ||
+            r.reg == REG_RIP || r.reg == X64_RSP) {
+            return false;
+        }
+        op->index = r.reg;
+        p = skip_ws(p);
+        if (*p == ',') {
+            int64_t scale;
+            p = skip_ws(p + 1);
+            if (!parse_number(&p, &scale)) return false;
+            if (scale != 1 && scale != 2 && scale != 4 && scale != 8) return false;
+            op->scale = (int)scale;
+        }
+    }
+    p = skip_ws(p);
+    if (*p++ != ')') return false;
+    if (op->base == REG_RIP && op->index != REG_NONE) return false;
+    return *skip_ws(p) == '\0';
+}
+
+/* ============================================================================
+ * Encoding
+ * ============================================================================ */
+
+static bool fits8(int64_t v)
+{
+    return v >= -128 && v <= 127;
+}
+
+static bool fits32(int64_t v)
+{
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* spl, bpl, sil and dil are only reachable with a REX prefix */
+static bool needs_rex8(const opnd_t *op)
+{
+    return op && op->kind == OPND_GPR && op->size == 1 && op->reg >= 4 && op->reg < 8;
+}
+
+static int scale_bits(int scale)
+{
+    return scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+}
+
+/*
+ * Prefixes, opcode and ModRM (plus SIB and displacement) for one
+ * instruction. reg is the ModRM.reg field: a register number or an
+ * opcode extension; reg_op, if given, is the operand it came from.
+ * imm_bytes is the size of any immediate that follows, needed for the
+ * rip-relative addend.
+ */
+static void put_insn(x64_asm_t *as, uint8_t prefix, bool w, const uint8_t *opc, size_t opc_len,
+                     int reg, const opnd_t *reg_op, const opnd_t *rm, int imm_bytes)
+{
+    uint8_t rex = 0;
+    if (w) rex |= 0x08;
+    if (reg & 8) rex |= 0x04;
+    if (rm->kind == OPND_MEM) {
+        if (rm->index >= 0 && (rm->index & 8)) rex |= 0x02;
+        if (rm->base >= 0 && (rm->base & 8)) rex |= 0x01;
+    } else if (rm->reg & 8) {
+        rex |= 0x01;
+    }
+
+    if (prefix) put8(as, prefix);
+    if (rex || needs_rex8(reg_op) || needs_rex8(rm)) put8(as, 0x40 | rex);
+    for (size_t i = 0; i < opc_len; i++) put8(as, opc[i]);
+
+    int r = (reg & 7) << 3;
+    if (rm->kind != OPND_MEM) {
+        put8(as, (uint8_t)(0xC0 | r | (rm->reg & 7)));
+        return;
+    }
+
+    if (rm->base == REG_RIP) {
+        put8(as, (uint8_t)(r | 5));
+        if (rm->sym) {
+            add_fixup(as, rm->sym, rm->sym_len, rm->disp - 4 - imm_bytes, X64_RELOC_PC32);
+            put_le(as, 0, 4);
+        } else {
+            put_le(as, (uint64_t)rm->disp, 4);
+        }
+        return;
+    }
+
+    if (rm->base == REG_NONE) {
+        /* Absolute address: SIB with no base */
+        put8(as, (uint8_t)(r | 4));
+        int index = rm->index >= 0 ? rm->index & 7 : 4;
+        put8(as, (uint8_t)((scale_bits(rm->scale) << 6) | (index << 3) | 5));
+        if (rm->sym) {
+            add_fixup(as, rm->sym, rm->sym_len, rm->disp, X64_RELOC_32S);
+            put_le(as, 0, 4);
+        } else {
+            put_le(as, (uint64_t)rm->disp, 4);
+        }
+        return;
+    }
+
+    int base = rm->base & 7;
+    bool sib = rm->index >= 0 || base == 4;
+    int mod = (rm->disp == 0 && base != 5) ? 0 : fits8(rm->disp) ? 1 : 2;
+    put8(as, (uint8_t)((mod << 6) | r | (sib ? 4 : base)));
+    if (sib) {
+        int index = rm->index >= 0 ? rm->index & 7 : 4;
+        put8(as, (uint8_t)((scale_bits(rm->scale) << 6) | (index << 3) | base));
+    }
+    if (mod == 1) put8(as, (uint8_t)rm->disp);
+    else if (mod == 2) put_le(as, (uint64_t)rm->disp, 4);
+}
+
+static void put_op(x64_asm_t *as, int size, uint8_t opc, int reg, const opnd_t *reg_op,
+                   const opnd_t *rm, int imm_bytes)
+{
+    put_insn(as, size == 2 ? 0x66 : 0, size == 8, &opc, 1, reg, reg_op, rm, imm_bytes);
+}
+
+static void put_op2(x64_asm_t *as, int size, uint8_t opc, int reg, const opnd_t *reg_op,
+                    const opnd_t *rm)
+{
+    uint8_t bytes[2] = { 0x0F, opc };
+    put_insn(as, size == 2 ? 0x66 : 0, size == 8, bytes, 2, reg, reg_op, rm, 0);
+}
+
+/* Immediate of an instruction whose operation size is size */
+static int imm_size(int size)
+{
+    return size == 1 ? 1 : size == 2 ? 2 : 4;
+}
+
+static bool imm_value(x64_asm_t *as, const opnd_t *imm, int size, int64_t *val)
+{
+    if (imm->sym) {
+        fail(as, "symbolic immediate not supported here");
+        return false;
+    }
+    int64_t v = imm->disp;
+    switch (size) {
+        case 1: v = (int8_t)v; break;
+        case 2: v = (int16_t)v; break;
+        case 4: v = (int32_t)v; break;
+        default:
+            if (!fits32(v)) {
+                fail(as, "immediate out of range");
+                return false;
+            }
+    }
+    *val = v;
+    return true;
+}
+
+static bool is_rm(const opnd_t *op)
+{
+    return op->kind == OPND_GPR || op->kind == OPND_MEM;
+}
+
+static bool is_acc(const opnd_t *op)
+{
+    return op->kind == OPND_GPR && op->reg == X64_RAX;
+}
+
+/* add, or, adc, sbb, and, sub, xor, cmp: ext is the /n opcode extension */
+static void enc_alu(x64_asm_t *as, int ext, int size, const opnd_t *src, const opnd_t *dst)
+{
+    uint8_t base = (uint8_t)(ext << 3);
+    if (src->kind == OPND_IMM && is_rm(dst)) {
+        int64_t v;
+        if (!imm_value(as, src, size, &v)) return;
+        if (size == 1) {
+            if (is_acc(dst)) {
+                put8(as, base + 4);
+            } else {
+                put_op(as, 1, 0x80, ext, NULL, dst, 1);
+            }
+            put8(as, (uint8_t)v);
+        } else if (fits8(v)) {
+            put_op(as, size, 0x83, ext, NULL, dst, 1);
+            put8(as, (uint8_t)v);
+        } else {
+            if (is_acc(dst)) {
+                if (size == 2) put8(as, 0x66);
+                if (size == 8) put8(as, 0x48);
+                put8(as, base + 5);
+            } else {
+                put_op(as, size, 0x81, ext, NULL, dst, imm_size(size));
+            }
+            put_le(as, (uint64_t)v, imm_size(size));
+        }
+    } else if (src->kind == OPND_GPR && is_rm(dst)) {
+        put_op(as, size, base + (size == 1 ? 0 : 1), src->reg, src, dst, 0);
+    } else if (src->kind == OPND_MEM && dst->kind == OPND_GPR) {
+        put_op(as, size, base + (size == 1 ? 2 : 3), dst->reg, dst, src, 0);
+    } else {
+        fail(as, "bad operands");
+    }
+}
+
+static void enc_mov(x64_asm_t *as, int size, const opnd_t *src, const opnd_t *dst)
+{
+    if (src->kind == OPND_IMM && dst->kind == OPND_GPR) {
+        if (src->sym) {
+            /* Absolute address of a symbol: only 32-bit forms exist */
+            if (size == 8) {
+                put_op(as, 8, 0xC7, 0, NULL, dst, 4);
+                add_fixup(as, src->sym, src->sym_len, src->disp, X64_RELOC_32S);
+            } else if (size == 4) {
+                if (dst->reg & 8) put8(as, 0x41);
+                put8(as, (uint8_t)(0xB8 + (dst->reg & 7)));
+                add_fixup(as, src->sym, src->sym_len, src->disp, X64_RELOC_32);
+            } else {
+                fail(as, "bad operands");
+                return;
+            }
+            put_le(as, 0, 4);
+            return;
+        }
+        if (size == 8 && !fits32(src->disp)) {
+            put8(as, (uint8_t)(0x48 | ((dst->reg & 8) ? 1 : 0)));
+            put8(as, (uint8_t)(0xB8 + (dst->reg & 7)));
+            put_le(as, (uint64_t)src->disp, 8);
+            return;
+        }
+        int64_t v;
+        if (!imm_value(as, src, size, &v)) return;
+        if (size == 8) {
+            put_op(as, 8, 0xC7, 0, NULL, dst, 4);
+            put_le(as, (uint64_t)v, 4);
+            return;
+        }
+        if (size == 2) put8(as, 0x66);
+        if ((dst->reg & 8) || needs_rex8(dst)) put8(as, (uint8_t)(0x40 | ((dst->reg & 8) ? 1 : 0)));
+        put8(as, (uint8_t)((size == 1 ? 0xB0 : 0xB8) + (dst->reg & 7)));
+        put_le(as, (uint64_t)v, imm_size(size));
+    } else if (src->kind == OPND_IMM && dst->kind == OPND_MEM) {
+        int64_t v;
+        if (!imm_value(as, src, size, &v)) return;
+        put_op(as, size, size == 1 ? 0xC6 : 0xC7, 0, NULL, dst, imm_size(size));
+        put_le(as, (uint64_t)v, imm_size(size));
+    } else if (src->kind == OPND_GPR && is_rm(dst)) {
+        put_op(as, size, size == 1 ? 0x88 : 0x89, src->reg, src, dst, 0);
+    } else if (src->kind == OPND_MEM && dst->kind == OPND_GPR) {
+        put_op(as, size, size == 1 ? 0x8A : 0x8B, dst->reg, dst, src, 0);
+    } else {
+        fail(as, "bad operands");
+    }
+}
+
+static void enc_test(x64_asm_t *as, int size, const opnd_t *src, const opnd_t *dst)
+{
+    if (src->kind == OPND_IMM && is_rm(dst)) {
+        int64_t v;
+        if (!imm_value(as, src, size, &v)) return;
+        if (is_acc(dst)) {
+            if (size == 2) put8(as, 0x66);
+            if (size == 8) put8(as, 0x48);
+            put8(as, size == 1 ? 0xA8 : 0xA9);
+        } else {
+            put_op(as, size, size == 1 ? 0xF6 : 0xF7, 0, NULL, dst, imm_size(size));
+        }
+        put_le(as, (uint64_t)v, imm_size(size));
+    } else if (src->kind == OPND_GPR && is_rm(dst)) {
+        put_op(as, size, size == 1 ? 0x84 : 0x85, src->reg, src, dst, 0);
+    } else if (src->kind == OPND_MEM && dst->kind == OPND_GPR) {
+        put_op(as, size, size == 1 ? 0x84 : 0x85, dst->reg, dst, src, 0);
+    } else {
+        fail(as, "bad operands");
+    }
+}
+
+static void enc_imul(x64_asm_t *as, int size, const opnd_t *ops, int n)
+{
+    if (n == 1 && is_rm(&ops[0])) {
+        put_op(as, size, size == 1 ? 0xF6 : 0xF7, 5, NULL, &ops[0], 0);
+        return;
+    }
+    if (size == 1) {
+        fail(as, "bad operands");
+        return;
+    }
+    if (n == 2 && is_rm(&ops[0]) && ops[1].kind == OPND_GPR) {
+        put_op2(as, size, 0xAF, ops[1].reg, &ops[1], &ops[0]);
+        return;
+    }
+
+    /* imul $imm, src, dst; the two-operand form multiplies dst in place */
+    const opnd_t *src = &ops[1];
+    const opnd_t *dst = &ops[n - 1];
+    int64_t v;
+    if (n < 2 || ops[0].kind != OPND_IMM || !is_rm(src) || dst->kind != OPND_GPR ||
+        !imm_value(as, &ops[0], size, &v)) {
+        fail(as, "bad operands");
+        return;
+    }
+    if (fits8(v)) {
+        put_op(as, size, 0x6B, dst->reg, dst, src, 1);
+        put8(as, (uint8_t)v);
+    } else {
+        put_op(as, size, 0x69, dst->reg, dst, src, imm_size(size));
+        put_le(as, (uint64_t)v, imm_size(size));
+    }
+}
+
+static void enc_shift(x64_asm_t *as, int ext, int size, const opnd_t *ops, int n)
+{
+    const opnd_t *dst = &ops[n - 1];
+    if (!is_rm(dst)) {
+        fail(as, "bad operands");
+        return;
+    }
+    if (n == 1 || (ops[0].kind == OPND_IMM && !ops[0].sym && ops[0].disp == 1)) {
+        put_op(as, size, size == 1 ? 0xD0 : 0xD1, ext, NULL, dst, 0);
+    } else if (ops[0].kind == OPND_IMM && !ops[0].sym) {
+        put_op(as, size, size == 1 ? 0xC0 : 0xC1, ext, NULL, dst, 1);
+        put8(as, (uint8_t)ops[0].disp);
+    } else if (ops[0].kind == OPND_GPR && ops[0].reg == X64_RCX && ops[0].size == 1) {
+        put_op(as, size, size == 1 ? 0xD2 : 0xD3, ext, NULL, dst, 0);
+    } else {
+        fail(as, "bad operands");
+    }
+}
+
+static void enc_push_pop(x64_asm_t *as, bool push, const opnd_t *op)
+{
+    if (op->kind == OPND_GPR && op->size == 8) {
+        if (op->reg & 8) put8(as, 0x41);
+        put8(as, (uint8_t)((push ? 0x50 : 0x58) + (op->reg & 7)));
+    } else if (op->kind == OPND_MEM) {
+        put_op(as, 4, push ? 0xFF : 0x8F, push ? 6 : 0, NULL, op, 0);
+    } else if (push && op->kind == OPND_IMM && !op->sym) {
+        if (fits8(op->disp)) {
+            put8(as, 0x6A);
+            put8(as, (uint8_t)op->disp);
+        } else if (fits32(op->disp)) {
+            put8(as, 0x68);
+            put_le(as, (uint64_t)op->disp, 4);
+        } else {
+            fail(as, "immediate out of range");
+        }
+    } else {
+        fail(as, "bad operands");
+    }
+}
+
+/* call/jmp: direct to a symbol, or indirect through a register or memory */
+static void enc_call_jmp(x64_asm_t *as, bool call, const opnd_t *op)
+{
+    if (op->indirect && is_rm(op)) {
+        put_op(as, 4, 0xFF, call ? 2 : 4, NULL, op, 0);
+        return;
+    }
+    if (op->indirect || op->kind != OPND_MEM || op->base != REG_NONE ||
+        op->index != REG_NONE || !op->sym) {
+        fail(as, "bad branch target");
+        return;
+    }
+
+    if (call) {
+        put8(as, 0xE8);
+        add_fixup(as, op->sym, op->sym_len, op->disp - 4, X64_RELOC_PLT32);
+        put_le(as, 0, 4);
+        return;
+    }
+    if (as->section != ANVIL_ELF_TEXT || op->disp) {
+        fail(as, "bad branch target");
+        return;
+    }
+    size_t sym = sym_get(as, op->sym, op->sym_len);
+    if (as->err != ANVIL_OK || !GROW(as, as->branches, as->num_branches, as->branches_cap)) return;
+    as->branches[as->num_branches++] = (branch_t){ as->chunk.len, sym, -1, false };
+}
+
+static void enc_jcc(x64_asm_t *as, int cc, const opnd_t *op)
+{
+    if (op->indirect || op->kind != OPND_MEM || op->base != REG_NONE ||
+        op->index != REG_NONE || !op->sym || op->disp || as->section != ANVIL_ELF_TEXT) {
+        fail(as, "bad branch target");
+        return;
+    }
+    size_t sym = sym_get(as, op->sym, op->sym_len);
+    if (as->err != ANVIL_OK || !GROW(as, as->branches, as->num_branches, as->branches_cap)) return;
+    as->branches[as->num_branches++] = (branch_t){ as->chunk.len, sym, cc, false };
+}
+
+/* ============================================================================
+ * Mnemonics
+ * ============================================================================ */
+
+static const struct {
+    const char *name;
+    int cc;
+} cond_codes[] = {
+    { "o", 0 }, { "no", 1 }, { "b", 2 }, { "c", 2 }, { "nae", 2 },
+    { "ae", 3 }, { "nb", 3 }, { "nc", 3 }, { "e", 4 }, { "z", 4 },
+    { "ne", 5 }, { "nz", 5 }, { "be", 6 }, { "na", 6 }, { "a", 7 },
+    { "nbe", 7 }, { "s", 8 }, { "ns", 9 }, { "p", 10 }, { "pe", 10 },
+    { "np", 11 }, { "po", 11 }, { "l", 12 }, { "nge", 12 }, { "ge", 13 },
+    { "nl", 13 }, { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 },
+};
+
+static int cond_code(const char *name, size_t len)
+{
+    for (size_t i = 0; i < sizeof(cond_codes) / sizeof(cond_codes[0]); i++) {
+        if (strlen(cond_codes[i].name) == len && strncmp(cond_codes[i].name, name, len) == 0) {
+            return cond_codes[i].cc;
+        }
+    }
+    return -1;
+}
+
+typedef enum {
+    INSN_ALU,
+    INSN_MOV,
+    INSN_TEST,
+    INSN_LEA,
+    INSN_IMUL,
+    INSN_UNARY,
+    INSN_SHIFT,
+    INSN_PUSH,
+    INSN_POP
+} insn_class_t;
+
+/* Integer instructions taking an optional b/w/l/q size suffix */
+static const struct {
+    const char *name;
+    insn_class_t cls;
+    int ext;
+} int_insns[] = {
+    { "add", INSN_ALU, 0 }, { "or", INSN_ALU, 1 }, { "adc", INSN_ALU, 2 },
+    { "sbb", INSN_ALU, 3 }, { "and", INSN_ALU, 4 }, { "sub", INSN_ALU, 5 },
+    { "xor", INSN_ALU, 6 }, { "cmp", INSN_ALU, 7 },
+    { "mov", INSN_MOV, 0 }, { "test", INSN_TEST, 0 }, { "lea", INSN_LEA, 0 },
+    { "imul", INSN_IMUL, 0 },
+    { "not", INSN_UNARY, 2 }, { "neg", INSN_UNARY, 3 }, { "mul", INSN_UNARY, 4 },
+    { "div", INSN_UNARY, 6 }, { "idiv", INSN_UNARY, 7 },
+    { "rol", INSN_SHIFT, 0 }, { "ror", INSN_SHIFT, 1 }, { "shl", INSN_SHIFT, 4 },
+    { "sal", INSN_SHIFT, 4 }, { "shr", INSN_SHIFT, 5 }, { "sar", INSN_SHIFT, 7 },
+    { "push", INSN_PUSH, 0 }, { "pop", INSN_POP, 0 },
+};
+
+typedef enum {
+    SSE_RM,         /* xmm/mem -> xmm */
+    SSE_MOV,        /* movss/movsd/movaps: loads, stores and copies */
+    SSE_FROM_INT,   /* gpr/mem -> xmm, REX.W for 64-bit sources */
+    SSE_TO_INT      /* xmm/mem -> gpr, REX.W for 64-bit results */
+} sse_class_t;
+
+static const struct {
+    const char *name;
+    uint8_t prefix;
+    uint8_t opc;
+    sse_class_t cls;
+} sse_insns[] = {
+    { "addss", 0xF3, 0x58, SSE_RM }, { "addsd", 0xF2, 0x58, SSE_RM },
+    { "subss", 0xF3, 0x5C, SSE_RM }, { "subsd", 0xF2, 0x5C, SSE_RM },
+    { "mulss", 0xF3, 0x59, SSE_RM }, { "mulsd", 0xF2, 0x59, SSE_RM },
+    { "divss", 0xF3, 0x5E, SSE_RM }, { "divsd", 0xF2, 0x5E, SSE_RM },
+    { "sqrtss", 0xF3, 0x51, SSE_RM }, { "sqrtsd", 0xF2, 0x51, SSE_RM },
+    { "ucomiss", 0, 0x2E, SSE_RM }, { "ucomisd", 0x66, 0x2E, SSE_RM },
+    { "comiss", 0, 0x2F, SSE_RM }, { "comisd", 0x66, 0x2F, SSE_RM },
+    { "cvtss2sd", 0xF3, 0x5A, SSE_RM }, { "cvtsd2ss", 0xF2, 0x5A, SSE_RM },
+    { "andps", 0, 0x54, SSE_RM }, { "andpd", 0x66, 0x54, SSE_RM },
+    { "orps", 0, 0x56, SSE_RM }, { "orpd", 0x66, 0x56, SSE_RM },
+    { "xorps", 0, 0x57, SSE_RM }, { "xorpd", 0x66, 0x57, SSE_RM },
+    { "movss", 0xF3, 0x10, SSE_MOV }, { "movsd", 0xF2, 0x10, SSE_MOV },
+    { "movaps", 0, 0x28, SSE_MOV }, { "movapd", 0x66, 0x28, SSE_MOV },
+    { "cvtsi2ss", 0xF3, 0x2A, SSE_FROM_INT }, { "cvtsi2sd", 0xF2, 0x2A, SSE_FROM_INT },
+    { "cvttss2si", 0xF3, 0x2C, SSE_TO_INT }, { "cvttsd2si", 0xF2, 0x2C, SSE_TO_INT },
+    { "cvtss2si", 0xF3, 0x2D, SSE_TO_INT }, { "cvtsd2si", 0xF2, 0x2D, SSE_TO_INT },
+};
+
+static void put_sse(x64_asm_t *as, uint8_t prefix, bool w, uint8_t opc, int reg,
+                    const opnd_t *rm)
+{
+    uint8_t bytes[2] = { 0x0F, opc };
+    put_insn(as, prefix, w, bytes, 2, reg, NULL, rm, 0);
+}
+
+static int suffix_size(char c)
+{
+    switch (c) {
+        case 'b': return 1;
+        case 'w': return 2;
+        case 'l': return 4;
+        case 'q': return 8;
+        default:  return 0;
+    }
+}
+
+static bool enc_sse(x64_asm_t *as, const char *mn, size_t len, const opnd_t *ops, int n)
+{
+    for (size_t i = 0; i < sizeof(sse_insns) / sizeof(sse_insns[0]); i++) {
+        size_t nlen = strlen(sse_insns[i].name);
+        if (strncmp(mn, sse_insns[i].name, nlen) != 0) continue;
+
+        /* The integer conversions take an optional l/q suffix */
+        int size = 0;
+        if (len == nlen + 1 && (sse_insns[i].cls == SSE_FROM_INT || sse_insns[i].cls == SSE_TO_INT)) {
+            size = suffix_size(mn[nlen]);
+            if (size != 4 && size != 8) continue;
+        } else if (len != nlen) {
+            continue;
+        }
+
+        const opnd_t *src = &ops[0], *dst = &ops[1];
+        uint8_t pfx = sse_insns[i].prefix, opc = sse_insns[i].opc;
+        if (n != 2) {
+            fail(as, "bad operands");
+            return true;
+        }
+        switch (sse_insns[i].cls) {
+            case SSE_RM:
+                if (dst->kind != OPND_XMM || (src->kind != OPND_XMM && src->kind != OPND_MEM)) break;
+                put_sse(as, pfx, false, opc, dst->reg, src);
+                return true;
+            case SSE_MOV:
+                if (dst->kind == OPND_XMM && (src->kind == OPND_XMM || src->kind == OPND_MEM)) {
+                    put_sse(as, pfx, false, opc, dst->reg, src);
+                    return true;
+                }
+                if (src->kind == OPND_XMM && dst->kind == OPND_MEM) {
+                    put_sse(as, pfx, false, (uint8_t)(opc + 1), src->reg, dst);
+                    return true;
+                }
+                break;
+            case SSE_FROM_INT:
+                if (dst->kind != OPND_XMM || !is_rm(src)) break;
+                if (src->kind == OPND_GPR) size = src->size;
+                if (size == 0) size = 4;
+                if (size != 4 && size != 8) break;
+                put_sse(as, pfx, size == 8, opc, dst->reg, src);
+                return true;
+            case SSE_TO_INT:
+                if (dst->kind != OPND_GPR || (src->kind != OPND_XMM && src->kind != OPND_MEM)) break;
+                if (dst->size != 4 && dst->size != 8) break;
+                put_sse(as, pfx, dst->size == 8, opc, dst->reg, src);
+                return true;
+        }
+        fail(as, "bad operands");
+        return true;
+    }
+    return false;
+}
+
+/* movd/movq between general registers, XMM registers and memory */
+static bool enc_movd_movq(x64_asm_t *as, bool q, const opnd_t *src, const opnd_t *dst)
+{
+    if (dst->kind == OPND_XMM && is_rm(src)) {
+        if (q && src->kind == OPND_MEM) {
+            put_sse(as, 0xF3, false, 0x7E, dst->reg, src);
+        } else {
+            put_sse(as, 0x66, q, 0x6E, dst->reg, src);
+        }
+    } else if (src->kind == OPND_XMM && is_rm(dst)) {
+        if (q && dst->kind == OPND_MEM) {
+            put_sse(as, 0x66, false, 0xD6, src->reg, dst);
+        } else {
+            put_sse(as, 0x66, q, 0x7E, src->reg, dst);
+        }
+    } else if (q && src->kind == OPND_XMM && dst->kind == OPND_XMM) {
+        put_sse(as, 0xF3, false, 0x7E, dst->reg, src);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/* movzbl, movswq, movslq, ...: extend a smaller source into a register */
+static bool enc_extend(x64_asm_t *as, const char *mn, size_t len, const opnd_t *ops, int n)
+{
+    if (len != 6 || strncmp(mn, "mov", 3) != 0 || (mn[3] != 'z' && mn[3] != 's')) return false;
+    int from = suffix_size(mn[4]);
+    int to = suffix_size(mn[5]);
+    if (!from || !to || from >= to) return false;
+
+    const opnd_t *src = &ops[0], *dst = &ops[1];
+    if (n != 2 || !is_rm(src) || dst->kind != OPND_GPR || dst->size != to ||
+        (src->kind == OPND_GPR && src->size != from)) {
+        fail(as, "bad operands");
+        return true;
+    }
+    if (from == 4) {
+        if (mn[3] != 's' || to != 8) return false;
+        put_op(as, 8, 0x63, dst->reg, dst, src, 0);
+    } else {
+        uint8_t opc = (uint8_t)((mn[3] == 'z' ? 0xB6 : 0xBE) + (from == 2));
+        uint8_t bytes[2] = { 0x0F, opc };
+        put_insn(as, to == 2 ? 0x66 : 0, to == 8, bytes, 2, dst->reg, dst, src, 0);
+    }
+    return true;
+}
+
+static int infer_size(const opnd_t *ops, int n)
+{
+    for (int i = n - 1; i >= 0; i--) {
+        if (ops[i].kind == OPND_GPR) return ops[i].size;
+    }
+    return 0;
+}
+
+static void encode(x64_asm_t *as, const char *mn, size_t len, opnd_t *ops, int n)
+{
+#define IS(s) (len == sizeof(s) - 1 && strncmp(mn, s, len) == 0)
+    if (n == 0) {
+        if (IS("ret")) put8(as, 0xC3);
+        else if (IS("cqto") || IS("cqo")) { put8(as, 0x48); put8(as, 0x99); }
+        else if (IS("cltq") || IS("cdqe")) { put8(as, 0x48); put8(as, 0x98); }
+        else if (IS("cltd") || IS("cdq")) put8(as, 0x99);
+        else if (IS("leave")) put8(as, 0xC9);
+        else if (IS("nop")) put8(as, 0x90);
+        else fail(as, "unknown instruction");
+        return;
+    }
+
+    if (IS("call") || IS("jmp")) {
+        if (n != 1) fail(as, "bad operands");
+        else enc_call_jmp(as, mn[0] == 'c', &ops[0]);
+        return;
+    }
+    if (mn[0] == 'j') {
+        int cc = cond_code(mn + 1, len - 1);
+        if (cc < 0 || n != 1) fail(as, "unknown instruction");
+        else enc_jcc(as, cc, &ops[0]);
+        return;
+    }
+    if (len > 3 && strncmp(mn, "set", 3) == 0) {
+        int cc = cond_code(mn + 3, len - 3);
+        if (cc < 0 || n != 1 || !is_rm(&ops[0]) || (ops[0].kind == OPND_GPR && ops[0].size != 1)) {
+            fail(as, "bad operands");
+            return;
+        }
+        put_op2(as, 1, (uint8_t)(0x90 + cc), 0, NULL, &ops[0]);
+        return;
+    }
+    if (len > 4 && strncmp(mn, "cmov", 4) == 0) {
+        int size = suffix_size(mn[len - 1]);
+        int cc = cond_code(mn + 4, len - 4);
+        if (cc < 0 && size) cc = cond_code(mn + 4, len - 5);
+        else size = 0;
+        if (n == 2 && !size) size = infer_size(ops, n);
+        if (cc < 0 || n != 2 || !is_rm(&ops[0]) || ops[1].kind != OPND_GPR || size < 2) {
+            fail(as, "bad operands");
+            return;
+        }
+        put_op2(as, size, (uint8_t)(0x40 + cc), ops[1].reg, &ops[1], &ops[0]);
+        return;
+    }
+    if (IS("movd") || IS("movq")) {
+        if (n == 2 && (ops[0].kind == OPND_XMM || ops[1].kind == OPND_XMM)) {
+            if (!enc_movd_movq(as, mn[3] == 'q', &ops[0], &ops[1])) fail(as, "bad operands");
+            return;
+        }
+    }
+    if (IS("movabsq") || IS("movabs")) {
+        if (n != 2 || ops[0].kind != OPND_IMM || ops[0].sym || ops[1].kind != OPND_GPR ||
+            ops[1].size != 8) {
+            fail(as, "bad operands");
+            return;
+        }
+        put8(as, (uint8_t)(0x48 | ((ops[1].reg & 8) ? 1 : 0)));
+        put8(as, (uint8_t)(0xB8 + (ops[1].reg & 7)));
+        put_le(as, (uint64_t)ops[0].disp, 8);
+        return;
+    }
+    if (enc_sse(as, mn, len, ops, n)) return;
+    if (enc_extend(as, mn, len, ops, n)) return;
+#undef IS
+
+    /* Integer instruction: exact name with inferred size, or name + suffix */
+    for (int pass = 0; pass < 2; pass++) {
+        size_t base_len = pass == 0 ? len : len - 1;
+        for (size_t i = 0; i < sizeof(int_insns) / sizeof(int_insns[0]); i++) {
+            const char *name = int_insns[i].name;
+            if (strlen(name) != base_len || strncmp(mn, name, base_len) != 0) continue;
+            int size = pass == 0 ? infer_size(ops, n) : suffix_size(mn[len - 1]);
+            if (int_insns[i].cls == INSN_PUSH || int_insns[i].cls == INSN_POP) {
+                if (size == 0) size = 8;
+            }
+            if (int_insns[i].cls == INSN_SHIFT && pass == 0 && n == 2) size = ops[1].size;
+            if (size == 0) {
+                fail(as, "operand size unknown");
+                return;
+            }
+            for (int k = 0; k < n; k++) {
+                bool count = int_insns[i].cls == INSN_SHIFT && k == 0 && n == 2;
+                bool addr = int_insns[i].cls == INSN_LEA && k == 1;
+                if (ops[k].kind == OPND_GPR && ops[k].size != size && !count && !addr) {
+                    fail(as, "operand size mismatch");
+                    return;
+                }
+            }
+
+            switch (int_insns[i].cls) {
+                case INSN_ALU:
+                    if (n != 2) break;
+                    enc_alu(as, int_insns[i].ext, size, &ops[0], &ops[1]);
+                    return;
+                case INSN_MOV:
+                    if (n != 2) break;
+                    enc_mov(as, size, &ops[0], &ops[1]);
+                    return;
+                case INSN_TEST:
+                    if (n != 2) break;
+                    enc_test(as, size, &ops[0], &ops[1]);
+                    return;
+                case INSN_LEA:
+                    if (n != 2 || ops[0].kind != OPND_MEM || ops[1].kind != OPND_GPR || size == 1) break;
+                    put_op(as, size, 0x8D, ops[1].reg, &ops[1], &ops[0], 0);
+                    return;
+                case INSN_IMUL:
+                    enc_imul(as, size, ops, n);
+                    return;
+                case INSN_UNARY:
+                    if (n != 1 || !is_rm(&ops[0])) break;
+                    put_op(as, size, size == 1 ? 0xF6 : 0xF7, int_insns[i].ext, NULL, &ops[0], 0);
+                    return;
+                case INSN_SHIFT:
+                    if (n != 1 && n != 2) break;
+                    enc_shift(as, int_insns[i].ext, size, ops, n);
+                    return;
+                case INSN_PUSH:
+                case INSN_POP:
+                    if (n != 1 || size != 8) break;
+                    enc_push_pop(as, int_insns[i].cls == INSN_PUSH, &ops[0]);
+                    return;
+            }
+            fail(as, "bad operands");
+            return;
+        }
+        if (len < 2 || !suffix_size(mn[len - 1])) break;
+    }
+    fail(as, "unknown instruction");
+}
+
+/* ============================================================================
+ * Directives and lines
+ * ============================================================================ */
+
+static void put_string(x64_asm_t *as, const char *p, bool nul)
+{
+    p = skip_ws(p);
+    if (*p++ != '"') {
+        fail(as, "expected string");
+        return;
+    }
+    while (*p && *p != '"') {
+        char c = *p++;
+        if (c == '\\') {
+            c = *p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'f': c = '\f'; break;
+                case 'b': c = '\b'; break;
+                case '\\': case '"': break;
+                default:
+                    if (c >= '0' && c <= '7') {
+                        int v = c - '0';
+                        for (int k = 0; k < 2 && *p >= '0' && *p <= '7'; k++) v = v * 8 + (*p++ - '0');
+                        c = (char)v;
+                    } else {
+                        fail(as, "bad escape");
+                        return;
+                    }
+            }
+        }
+        put8(as, (uint8_t)c);
+    }
+    if (*p != '"' || *skip_ws(p + 1) != '\0') {
+        fail(as, "unterminated string");
+        return;
+    }
+    if (nul) put8(as, 0);
+}
+
+static void put_data(x64_asm_t *as, const char *p, int size)
+{
+    for (;;) {
+        opnd_t val;
+        p = skip_ws(p);
+        if (!parse_expr(&p, &val)) {
+            fail(as, "bad data value");
+            return;
+        }
+        if (val.sym) {
+            if (size != 8) {
+                fail(as, "symbolic data must be .quad");
+                return;
+            }
+            add_fixup(as, val.sym, val.sym_len, val.disp, X64_RELOC_64);
+            put_le(as, 0, 8);
+        } else {
+            put_le(as, (uint64_t)val.disp, size);
+        }
+        p = skip_ws(p);
+        if (*p == '\0') return;
+        if (*p++ != ',') {
+            fail(as, "bad data value");
+            return;
+        }
+    }
+}
+
+static void directive(x64_asm_t *as, const char *name, size_t len, const char *args)
+{
+#define IS(s) (len == sizeof(s) - 1 && strncmp(name, s, len) == 0)
+    const char *p = skip_ws(args);
+    if (IS(".text") || IS(".data")) {
+        int section = IS(".text") ? ANVIL_ELF_TEXT : ANVIL_ELF_DATA;
+        if (section != as->section && as->section == ANVIL_ELF_TEXT) flush_text(as);
+        as->section = section;
+    } else if (IS(".globl") || IS(".global") || IS(".type")) {
+        const char *sym = p;
+        while (is_sym_char(*p)) p++;
+        if (p == sym) {
+            fail(as, "expected symbol");
+            return;
+        }
+        size_t i = sym_get(as, sym, (size_t)(p - sym));
+        if (as->err != ANVIL_OK) return;
+        if (IS(".type")) {
+            p = skip_ws(p);
+            if (*p == ',') p = skip_ws(p + 1);
+            as->syms[i].func = strncmp(p, "@function", 9) == 0;
+        } else {
+            as->syms[i].global = true;
+        }
+    } else if (IS(".extern")) {
+        /* Undefined symbols are implicit; unreferenced externs produce nothing */
+    } else if (IS(".asciz") || IS(".string")) {
+        put_string(as, p, true);
+    } else if (IS(".ascii")) {
+        put_string(as, p, false);
+    } else if (IS(".byte")) {
+        put_data(as, p, 1);
+    } else if (IS(".short") || IS(".word") || IS(".value")) {
+        put_data(as, p, 2);
+    } else if (IS(".long") || IS(".int")) {
+        put_data(as, p, 4);
+    } else if (IS(".quad")) {
+        put_data(as, p, 8);
+    } else if (IS(".zero")) {
+        int64_t n;
+        if (!parse_number(&p, &n) || n < 0) {
+            fail(as, "bad size");
+            return;
+        }
+        for (int64_t i = 0; i < n; i++) put8(as, 0);
+    } else {
+        fail(as, "unsupported directive");
+    }
+#undef IS
+}
+
+/* Split operands at top-level commas */
+static int split_operands(char *p, char **ops, int max)
+{
+    int n = 0, depth = 0;
+    p = (char *)skip_ws(p);
+    if (*p == '\0') return 0;
+    ops[n++] = p;
+    for (; *p; p++) {
+        if (*p == '(') depth++;
+        else if (*p == ')') depth--;
+        else if (*p == ',' && depth == 0) {
+            if (n == max) return -1;
+            *p = '\0';
+            ops[n++] = p + 1;
+        }
+    }
+    return n;
+}
+
+static void assemble_line(x64_asm_t *as, char *line)
+{
+    /* Strip a comment; '#' does not appear inside this backend's strings
+     * except after a quote, so only look outside quotes */
+    bool quoted = false;
+    for (char *c = line; *c; c++) {
+        if (*c == '"' && (c == line || c[-1] != '\\')) quoted = !quoted;
+        else if (*c == '#' && !quoted) {
+            *c = '\0';
+            break;
+        }
+    }
+
+    char *p = (char *)skip_ws(line);
+    size_t len = strlen(p);
+    while (len && isspace((unsigned char)p[len - 1])) p[--len] = '\0';
+    if (*p == '\0') return;
+
+    /* Label */
+    char *name = p;
+    while (is_sym_char(*p)) p++;
+    if (*p == ':' && p > name) {
+        define_label(as, name, (size_t)(p - name));
+        p = (char *)skip_ws(p + 1);
+        if (*p == '\0' || as->err != ANVIL_OK) return;
+        name = p;
+        while (is_sym_char(*p)) p++;
+    }
+    size_t name_len = (size_t)(p - name);
+    if (name_len == 0 || (*p && *p != ' ' && *p != '\t')) {
+        fail(as, "syntax error");
+        return;
+    }
+
+    if (name[0] == '.') {
+        directive(as, name, name_len, p);
+        return;
+    }
+
+    char *texts[3];
+    opnd_t ops[3];
+    int n = split_operands(p, texts, 3);
+    if (n < 0) {
+        fail(as, "too many operands");
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!parse_opnd(texts[i], &ops[i])) {
+            fail(as, "bad operand");
+            return;
+        }
+    }
+    name[name_len] = '\0';
+    encode(as, name, name_len, ops, n);
+}
+
+/* ============================================================================
+ * Interface
+ * ============================================================================ */
+
+x64_asm_t *x64_asm_create(anvil_ctx_t *ctx, anvil_elf_object_t *elf)
+{
+    x64_asm_t *as = calloc(1, sizeof(x64_asm_t));
+    if (!as) return NULL;
+    as->ctx = ctx;
+    as->elf = elf;
+    as->section = ANVIL_ELF_TEXT;
+    anvil_strbuf_init(&as->chunk);
+    anvil_strbuf_init(&as->line);
+    if (!as->chunk.data || !as->line.data) {
+        x64_asm_destroy(as);
+        return NULL;
+    }
+    return as;
+}
+
+void x64_asm_destroy(x64_asm_t *as)
+{
+    if (!as) return;
+    for (size_t i = 0; i < as->num_syms; i++) free(as->syms[i].name);
+    free(as->syms);
+    free(as->sym_table);
+    free(as->fixups);
+    anvil_strbuf_destroy(&as->chunk);
+    free(as->branches);
+    free(as->labels);
+    free(as->chunk_fixups);
+    free(as->offsets);
+    anvil_strbuf_destroy(&as->line);
+    free(as);
+}
+
+anvil_error_t x64_asm_write(void *user, const char *text, size_t len)
+{
+    x64_asm_t *as = user;
+    const char *end = text + len;
+    while (text < end && as->err == ANVIL_OK) {
+        const char *nl = memchr(text, '\n', (size_t)(end - text));
+        size_t line_len = nl ? (size_t)(nl - text) : (size_t)(end - text);
+        as->raw = text;
+        as->raw_len = line_len;
+        as->line.len = 0;
+        anvil_strbuf_append_n(&as->line, text, line_len);
+        if (as->line.len != line_len) return as->err = ANVIL_ERR_NOMEM;
+        assemble_line(as, as->line.data);
+        text += line_len + (nl ? 1 : 0);
+    }
+
+    /* Each write is one function: relax its branches now */
+    if (as->section == ANVIL_ELF_TEXT) flush_text(as);
+    return as->err;
+}
+
+/* .L labels stay assembler-internal, as with GAS */
+static bool emitted(const x64_symbol_t *sym)
+{
+    if (strncmp(sym->name, ".L", 2) == 0) return false;
+    return sym->section >= 0 || sym->used;
+}
+
+anvil_error_t x64_asm_finish(x64_asm_t *as)
+{
+    flush_text(as);
+    if (as->err != ANVIL_OK) return as->err;
+
+    /* Resolve what the assembler can; the rest become relocations */
+    size_t num_relocs = 0;
+    for (size_t i = 0; i < as->num_fixups; i++) {
+        fixup_t *fix = &as->fixups[i];
+        int section = fix->section;
+        x64_symbol_t *sym = &as->syms[fix->sym];
+
+        /* Relative references to local symbols in the same section are final */
+        bool relative = fix->kind == X64_RELOC_PC32 || fix->kind == X64_RELOC_PLT32;
+        if (relative && sym->section == section && !sym->global) {
+            int64_t disp = (int64_t)sym->offset + fix->addend - (int64_t)fix->at;
+            if (!fits32(disp)) {
+                anvil_set_error(as->ctx, ANVIL_ERR_CODEGEN,
+                                "x86-64 object output: %s out of range", sym->name);
+                return as->err = ANVIL_ERR_CODEGEN;
+            }
+            char *field = as->elf->sec[section].data + fix->at;
+            for (int b = 0; b < 4; b++) field[b] = (char)(disp >> (8 * b));
+            continue;
+        }
+
+        if (sym->section < 0 && strncmp(sym->name, ".L", 2) == 0) {
+            anvil_set_error(as->ctx, ANVIL_ERR_CODEGEN,
+                            "x86-64 object output: undefined label %s", sym->name);
+            return as->err = ANVIL_ERR_CODEGEN;
+        }
+
+        /* Local symbols are referenced through their section */
+        fix->via_section = sym->section >= 0 && !sym->global;
+        if (!fix->via_section) sym->used = true;
+        as->fixups[num_relocs++] = *fix;
+    }
+    as->num_fixups = num_relocs;
+
+    /* Symbols in definition order; names the object already has (globals
+     * laid out by the core) are shared */
+    anvil_elf_object_t *elf = as->elf;
+    for (size_t i = 0; i < as->num_syms; i++) {
+        x64_symbol_t *sym = &as->syms[i];
+        if (!emitted(sym)) continue;
+        if (sym->section < 0) {
+            sym->elf = anvil_elf_symbol(elf, sym->name, strlen(sym->name));
+        } else {
+            sym->elf = anvil_elf_define(elf, sym->name, sym->section, sym->offset,
+                                        sym->global ? ANVIL_ELF_GLOBAL : ANVIL_ELF_LOCAL,
+                                        sym->func ? ANVIL_ELF_FUNC : ANVIL_ELF_NOTYPE);
+            if (sym->elf < 0) {
+                anvil_set_error(as->ctx, ANVIL_ERR_CODEGEN,
+                                "x86-64 object output: symbol %s defined twice", sym->name);
+                return as->err = ANVIL_ERR_CODEGEN;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < as->num_fixups; i++) {
+        const fixup_t *fix = &as->fixups[i];
+        const x64_symbol_t *sym = &as->syms[fix->sym];
+        if (fix->via_section) {
+            anvil_elf_add_reloc(elf, fix->section, fix->at, fix->kind, -1 - sym->section,
+                                fix->addend + (int64_t)sym->offset);
+        } else {
+            anvil_elf_add_reloc(elf, fix->section, fix->at, fix->kind, sym->elf, fix->addend);
+        }
+    }
+    return as->err = elf->err;
+}
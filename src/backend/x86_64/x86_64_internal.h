@@ -0,0 +1,175 @@
+/*
+ * ANVIL - x86-64 Backend Internal Definitions
+ *
+ * Structures shared by the stack-machine emitter (x86_64.c), the
+ * linear-scan register allocator (x86_64_regalloc.c) and the emitter
+ * that consumes its assignment (x86_64_ra_emit.c).
+ */
+
+#ifndef X86_64_INTERNAL_H
+#define X86_64_INTERNAL_H
+
+#include "anvil/anvil_internal.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* ============================================================================
+ * Register Definitions
+ * ============================================================================ */
+
+#define X64_RAX 0   /* Scratch: return value, dividend, variadic %al */
+#define X64_RCX 1
+#define X64_RDX 2
+#define X64_RBX 3   /* Callee-saved */
+#define X64_RSP 4
+#define X64_RBP 5   /* Frame pointer */
+#define X64_RSI 6
+#define X64_RDI 7
+#define X64_R8  8
+#define X64_R9  9
+#define X64_R10 10
+#define X64_R11 11  /* Scratch: addresses, spilled results, move cycles */
+#define X64_R12 12  /* Callee-saved */
+#define X64_R13 13  /* Callee-saved */
+#define X64_R14 14  /* Callee-saved */
+#define X64_R15 15  /* Callee-saved */
+
+#define X64_NUM_GPR 16
+#define X64_NUM_XMM 16
+
+/* XMM14/XMM15 are reserved as scratch by the allocating emitter */
+#define X64_XMM_SCRATCH  15
+#define X64_XMM_CONST    14
+
+#define SYSV_NUM_ARG_REGS  6
+#define SYSV_NUM_XMM_ARGS  8
+
+/* Register masks (bit n = register n) */
+#define X64_CALLEE_SAVED_MASK \
+    ((1u << X64_RBX) | (1u << X64_R12) | (1u << X64_R13) | (1u << X64_R14) | (1u << X64_R15))
+#define X64_CALLER_SAVED_MASK \
+    ((1u << X64_RCX) | (1u << X64_RDX) | (1u << X64_RSI) | (1u << X64_RDI) | \
+     (1u << X64_R8) | (1u << X64_R9) | (1u << X64_R10))
+
+extern const char *x64_gpr64_names[];
+extern const char *x64_gpr32_names[];
+extern const char *x64_gpr16_names[];
+extern const char *x64_gpr8_names[];
+extern const int sysv_arg_regs[];
+
+/* ============================================================================
+ * Register Allocation
+ * ============================================================================ */
+
+typedef enum {
+    X64_LOC_NONE,       /* No location (not allocated) */
+    X64_LOC_GPR,        /* In a general-purpose register */
+    X64_LOC_XMM,        /* In an XMM register */
+    X64_LOC_STACK,      /* In a frame slot at offset(%rbp) */
+    X64_LOC_FRAME,      /* Alloca: the value is the address offset(%rbp) */
+    X64_LOC_FLAGS       /* Comparison folded into the following branch */
+} x64_loc_kind_t;
+
+typedef struct {
+    x64_loc_kind_t kind;
+    int reg;            /* GPR/XMM number */
+    int offset;         /* rbp-relative displacement for STACK/FRAME */
+} x64_loc_t;
+
+/* Live interval of one SSA value, in instruction positions */
+typedef struct {
+    anvil_value_t *value;
+    int start;
+    int end;
+    uint32_t forbidden;     /* Registers clobbered somewhere inside the interval */
+    int hint;               /* Preferred register, or -1 */
+    uint32_t loop_depth;    /* Deepest loop the value is defined or used in */
+    bool is_float;
+    x64_loc_t loc;
+} x64_interval_t;
+
+/* Allocation result for one function */
+typedef struct {
+    anvil_func_t *func;
+    anvil_liveness_t live;
+
+    x64_interval_t *intervals;      /* Indexed by liveness value number */
+    size_t num_intervals;
+    anvil_stack_colors_t colors;    /* Shared slots for FRAME and STACK values */
+
+    uint32_t used_callee_saved;     /* Mask of callee-saved GPRs to preserve */
+    int num_saved;                  /* Number of pushed callee-saved GPRs */
+    int frame_size;                 /* Bytes to subtract after the pushes */
+    int call_slot;                  /* Frame slot for indirect call targets (0 = none) */
+    int num_spills;
+} x64_regalloc_t;
+
+/* ============================================================================
+ * Backend State
+ * ============================================================================ */
+
+/* Opens and closes a worker's string label placeholder (parallel codegen) */
+#define X64_STRING_MARK '\001'
+
+/* String table entry */
+typedef struct {
+    const char *str;
+    char label[16];
+    size_t len;
+} x64_string_entry_t;
+
+/* Backend private data */
+typedef struct {
+    anvil_strbuf_t code;
+    anvil_strbuf_t data;
+    anvil_syntax_t syntax;
+    anvil_ctx_t *ctx;
+    int label_counter;
+    int string_counter;
+    int stack_offset;
+    int next_stack_offset;
+
+    /* Stack slots for local variables */
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function (O0) */
+
+    /* String table */
+    x64_string_entry_t *strings;
+    size_t num_strings;
+    size_t strings_cap;
+
+    /* Current function being generated */
+    anvil_func_t *current_func;
+
+    /* Register assignment for current_func (optimizing path only) */
+    x64_regalloc_t ra;
+    const char *fused_cc;           /* Condition left in EFLAGS for the next branch */
+    
+    bool is_worker;                 /* Parallel codegen worker (see x86_64.c) */
+} x64_backend_t;
+
+/* ============================================================================
+ * Object Output (ANVIL_OUTPUT_BINARY)
+ * ============================================================================ */
+
+typedef struct x64_asm x64_asm_t;
+
+/* x86_64.c */
+const char *x64_add_string(x64_backend_t *be, const char *str);
+
+/* x86_64_asm.c: encodes the GAS text the emitters produce into elf */
+x64_asm_t *x64_asm_create(anvil_ctx_t *ctx, anvil_elf_object_t *elf);
+void x64_asm_destroy(x64_asm_t *as);
+anvil_error_t x64_asm_write(void *as, const char *text, size_t len);   /* anvil_write_fn */
+anvil_error_t x64_asm_finish(x64_asm_t *as);
+
+/* x86_64_regalloc.c */
+anvil_error_t x64_regalloc_func(x64_regalloc_t *ra, anvil_func_t *func);
+void x64_regalloc_free(x64_regalloc_t *ra);
+x64_loc_t x64_regalloc_loc(const x64_regalloc_t *ra, anvil_value_t *val);
+bool x64_regalloc_fuses_cmp(anvil_instr_t *instr);
+
+/* x86_64_ra_emit.c */
+void x64_ra_emit_func(x64_backend_t *be, anvil_func_t *func, anvil_syntax_t syntax);
+
+#endif /* X86_64_INTERNAL_H */
@@ -0,0 +1,1532 @@
+/*
+ * ANVIL - x86-64 Register-Allocated Code Emission
+ *
+ * Emits a function using the assignment computed by x86_64_regalloc.c.
+ * Selected at Og and above, and for any function with phis; O0 keeps the
+ * accumulator emitter in x86_64.c.
+ *
+ * Integer values are kept with only their low type-size bytes significant.
+ * Operations whose result depends on the upper bits (division, right
+ * shifts, comparisons, conversions, indexing) extend or size their operands
+ * explicitly; everything else runs in 64-bit form.
+ *
+ * Scratch registers: RAX (dividend, variadic %al, memory-to-memory moves,
+ * constants), R11 (addresses, results headed for a spill slot, parallel
+ * move cycles), XMM15 (float results headed for a spill slot) and XMM14
+ * (float constants and masks). None of these are ever allocated, and no
+ * move emitted here touches EFLAGS, so a comparison can feed the branch
+ * that follows it across the phi copies in between.
+ */
+
+#include "x86_64_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    OPND_GPR,
+    OPND_XMM,
+    OPND_MEM,
+    OPND_IMM
+} opnd_kind_t;
+
+typedef struct {
+    opnd_kind_t kind;
+    int reg;            /* GPR/XMM number, or MEM base (-1 with sym = rip-relative) */
+    int index;          /* MEM index register, -1 = none */
+    int scale;
+    int64_t disp;       /* MEM displacement or IMM value */
+    const char *sym;
+} opnd_t;
+
+typedef struct {
+    x64_backend_t *be;
+    anvil_strbuf_t *out;
+    bool gas;
+    anvil_func_t *func;
+    x64_regalloc_t *ra;
+} emit_t;
+
+/* Parallel move: dst <- src, or dst <- val when src is X64_LOC_NONE */
+typedef struct {
+    x64_loc_t dst;
+    x64_loc_t src;
+    anvil_value_t *val;
+} pmove_t;
+
+/* ============================================================================
+ * Operands
+ * ============================================================================ */
+
+static opnd_t op_gpr(int reg)
+{
+    opnd_t op = { OPND_GPR, reg, -1, 1, 0, NULL };
+    return op;
+}
+
+static opnd_t op_xmm(int reg)
+{
+    opnd_t op = { OPND_XMM, reg, -1, 1, 0, NULL };
+    return op;
+}
+
+static opnd_t op_imm(int64_t value)
+{
+    opnd_t op = { OPND_IMM, -1, -1, 1, value, NULL };
+    return op;
+}
+
+static opnd_t op_mem(int base, int64_t disp)
+{
+    opnd_t op = { OPND_MEM, base, -1, 1, disp, NULL };
+    return op;
+}
+
+static opnd_t op_sym(const char *sym, int64_t disp)
+{
+    opnd_t op = { OPND_MEM, -1, -1, 1, disp, sym };
+    return op;
+}
+
+static opnd_t op_loc(x64_loc_t loc)
+{
+    switch (loc.kind) {
+        case X64_LOC_GPR: return op_gpr(loc.reg);
+        case X64_LOC_XMM: return op_xmm(loc.reg);
+        default: return op_mem(X64_RBP, loc.offset);
+    }
+}
+
+static const char *gpr_name(int reg, int size)
+{
+    switch (size) {
+        case 1: return x64_gpr8_names[reg];
+        case 2: return x64_gpr16_names[reg];
+        case 4: return x64_gpr32_names[reg];
+        default: return x64_gpr64_names[reg];
+    }
+}
+
+static const char *suffix(int size)
+{
+    switch (size) {
+        case 1: return "b";
+        case 2: return "w";
+        case 4: return "l";
+        default: return "q";
+    }
+}
+
+static const char *nasm_ptr(int size)
+{
+    switch (size) {
+        case 1: return "byte ";
+        case 2: return "word ";
+        case 4: return "dword ";
+        case 8: return "qword ";
+        default: return "";
+    }
+}
+
+/* size selects the GPR name and, for NASM, the memory size keyword (0 = none) */
+static void put_opnd(emit_t *e, const opnd_t *op, int size)
+{
+    anvil_strbuf_t *out = e->out;
+    const char *reg_prefix = e->gas ? "%" : NULL;
+    switch (op->kind) {
+        case OPND_GPR:
+            anvil_strbuf_append_reg(out, reg_prefix, gpr_name(op->reg, size));
+            break;
+        case OPND_XMM:
+            anvil_strbuf_append_reg(out, reg_prefix, "xmm");
+            anvil_strbuf_append_int(out, op->reg);
+            break;
+        case OPND_IMM:
+            anvil_strbuf_append_imm(out, e->gas ? "$" : NULL, op->disp);
+            break;
+        case OPND_MEM:
+            if (e->gas) {
+                if (op->sym) {
+                    anvil_strbuf_append(out, op->sym);
+                    if (op->disp > 0) anvil_strbuf_append_char(out, '+');
+                    if (op->disp) anvil_strbuf_append_int(out, op->disp);
+                    anvil_strbuf_append(out, "(%rip)");
+                    break;
+                }
+                if (op->disp) anvil_strbuf_append_int(out, op->disp);
+                anvil_strbuf_append_reg(out, "(%", x64_gpr64_names[op->reg]);
+                if (op->index >= 0) {
+                    anvil_strbuf_append_reg(out, ",%", x64_gpr64_names[op->index]);
+                    anvil_strbuf_append_imm(out, ",", op->scale);
+                }
+                anvil_strbuf_append_char(out, ')');
+            } else {
+                anvil_strbuf_append(out, nasm_ptr(size));
+                anvil_strbuf_append_char(out, '[');
+                if (op->sym) {
+                    anvil_strbuf_append_reg(out, "rel ", op->sym);
+                } else {
+                    anvil_strbuf_append(out, x64_gpr64_names[op->reg]);
+                    if (op->index >= 0) {
+                        anvil_strbuf_append_reg(out, "+", x64_gpr64_names[op->index]);
+                        anvil_strbuf_append_imm(out, "*", op->scale);
+                    }
+                }
+                if (op->disp > 0) anvil_strbuf_append_char(out, '+');
+                if (op->disp) anvil_strbuf_append_int(out, op->disp);
+                anvil_strbuf_append_char(out, ']');
+            }
+            break;
+    }
+}
+
+/* Sized integer instruction: "op<suffix> src, dst" (GAS) / "op dst, src" (NASM) */
+static void ins2(emit_t *e, const char *op, int size, opnd_t src, opnd_t dst)
+{
+    if (e->gas) {
+        anvil_strbuf_append_mnemonic(e->out, op, suffix(size));
+        put_opnd(e, &src, size);
+        anvil_strbuf_append_n(e->out, ", ", 2);
+        put_opnd(e, &dst, size);
+    } else {
+        anvil_strbuf_append_mnemonic(e->out, op, NULL);
+        put_opnd(e, &dst, size);
+        anvil_strbuf_append_n(e->out, ", ", 2);
+        put_opnd(e, &src, size);
+    }
+    anvil_strbuf_append_char(e->out, '\n');
+}
+
+static void ins1(emit_t *e, const char *op, int size, opnd_t dst)
+{
+    anvil_strbuf_append_mnemonic(e->out, op, e->gas ? suffix(size) : NULL);
+    put_opnd(e, &dst, size);
+    anvil_strbuf_append_char(e->out, '\n');
+}
+
+/* Instruction with explicit mnemonics per syntax and per-operand sizes */
+static void insx(emit_t *e, const char *gas_op, const char *nasm_op,
+                 opnd_t src, int src_size, opnd_t dst, int dst_size)
+{
+    if (e->gas) {
+        anvil_strbuf_append_mnemonic(e->out, gas_op, NULL);
+        put_opnd(e, &src, src_size);
+        anvil_strbuf_append_n(e->out, ", ", 2);
+        put_opnd(e, &dst, dst_size);
+    } else {
+        anvil_strbuf_append_mnemonic(e->out, nasm_op, NULL);
+        put_opnd(e, &dst, dst_size);
+        anvil_strbuf_append_n(e->out, ", ", 2);
+        put_opnd(e, &src, src_size);
+    }
+    anvil_strbuf_append_char(e->out, '\n');
+}
+
+static void lea(emit_t *e, opnd_t mem, int dst)
+{
+    insx(e, "leaq", "lea", mem, 0, op_gpr(dst), 8);
+}
+
+/* ============================================================================
+ * Values
+ * ============================================================================ */
+
+static x64_loc_t loc_of(emit_t *e, anvil_value_t *val)
+{
+    return x64_regalloc_loc(e->ra, val);
+}
+
+static bool loc_eq(x64_loc_t a, x64_loc_t b)
+{
+    if (a.kind != b.kind) return false;
+    if (a.kind == X64_LOC_GPR || a.kind == X64_LOC_XMM) return a.reg == b.reg;
+    if (a.kind == X64_LOC_STACK) return a.offset == b.offset;
+    return false;
+}
+
+static int type_bytes(anvil_type_t *type)
+{
+    if (!type) return 8;
+    switch (type->size) {
+        case 1: case 2: case 4: case 8: return (int)type->size;
+        default: return 8;
+    }
+}
+
+static int val_bytes(anvil_value_t *val)
+{
+    return val ? type_bytes(val->type) : 8;
+}
+
+static bool is_float(anvil_value_t *val)
+{
+    return val && val->type &&
+           (val->type->kind == ANVIL_TYPE_F32 || val->type->kind == ANVIL_TYPE_F64);
+}
+
+static bool is_f32(anvil_value_t *val)
+{
+    return val && val->type && val->type->kind == ANVIL_TYPE_F32;
+}
+
+static bool fits_i32(int64_t v)
+{
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* Sign-extend the low size bytes of v */
+static int64_t sext(int64_t v, int size)
+{
+    switch (size) {
+        case 1: return (int8_t)v;
+        case 2: return (int16_t)v;
+        case 4: return (int32_t)v;
+        default: return v;
+    }
+}
+
+static uint64_t float_bits(anvil_value_t *val)
+{
+    if (is_f32(val)) {
+        float f = (float)val->data.f;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+    uint64_t bits;
+    memcpy(&bits, &val->data.f, sizeof(bits));
+    return bits;
+}
+
+/* Integer constant usable as an immediate for an operation of the given size */
+static bool const_imm(anvil_value_t *val, int size, int64_t *out)
+{
+    int64_t v;
+    if (val->kind == ANVIL_VAL_CONST_INT) v = val->data.i;
+    else if (val->kind == ANVIL_VAL_CONST_NULL) v = 0;
+    else return false;
+    v = sext(v, size);
+    if (!fits_i32(v)) return false;
+    *out = v;
+    return true;
+}
+
+static const char *symbol_of(emit_t *e, anvil_value_t *val)
+{
+    switch (val->kind) {
+        case ANVIL_VAL_GLOBAL:
+        case ANVIL_VAL_FUNC:
+            return val->name;
+        case ANVIL_VAL_CONST_STRING:
+            return x64_add_string(e->be, val->data.str ? val->data.str : "");
+        default:
+            return NULL;
+    }
+}
+
+static void load_imm(emit_t *e, int64_t v, int reg)
+{
+    if (fits_i32(v)) {
+        ins2(e, "mov", 8, op_imm(v), op_gpr(reg));
+    } else if (e->gas) {
+        anvil_strbuf_appendf(e->out, "\tmovabsq $%lld, %%%s\n", (long long)v, x64_gpr64_names[reg]);
+    } else {
+        anvil_strbuf_appendf(e->out, "\tmov %s, %lld\n", x64_gpr64_names[reg], (long long)v);
+    }
+}
+
+/* Materialize the full 64-bit value of val into a GPR */
+static void load_gpr(emit_t *e, anvil_value_t *val, int reg)
+{
+    x64_loc_t loc = loc_of(e, val);
+    const char *sym;
+
+    switch (loc.kind) {
+        case X64_LOC_GPR:
+            if (loc.reg != reg) ins2(e, "mov", 8, op_gpr(loc.reg), op_gpr(reg));
+            return;
+        case X64_LOC_STACK:
+            ins2(e, "mov", 8, op_loc(loc), op_gpr(reg));
+            return;
+        case X64_LOC_XMM:
+            insx(e, "movq", "movq", op_xmm(loc.reg), 16, op_gpr(reg), 8);
+            return;
+        case X64_LOC_FRAME:
+            lea(e, op_mem(X64_RBP, loc.offset), reg);
+            return;
+        default:
+            break;
+    }
+
+    switch (val->kind) {
+        case ANVIL_VAL_CONST_INT:
+            load_imm(e, val->data.i, reg);
+            break;
+        case ANVIL_VAL_CONST_NULL:
+            load_imm(e, 0, reg);
+            break;
+        case ANVIL_VAL_CONST_FLOAT:
+            load_imm(e, (int64_t)float_bits(val), reg);
+            break;
+        default:
+            sym = symbol_of(e, val);
+            if (sym) {
+                lea(e, op_sym(sym, 0), reg);
+            } else {
+                anvil_strbuf_appendf(e->out, e->gas ? "\t# unsupported value kind %d\n"
+                                                    : "\t; unsupported value kind %d\n", val->kind);
+            }
+            break;
+    }
+}
+
+/* Materialize val into an XMM register */
+static void load_xmm(emit_t *e, anvil_value_t *val, int xmm)
+{
+    x64_loc_t loc = loc_of(e, val);
+    const char *mov = is_f32(val) ? "movss" : "movsd";
+    int size = is_f32(val) ? 4 : 8;
+
+    switch (loc.kind) {
+        case X64_LOC_XMM:
+            if (loc.reg != xmm) insx(e, "movaps", "movaps", op_xmm(loc.reg), 16, op_xmm(xmm), 16);
+            return;
+        case X64_LOC_STACK:
+            insx(e, mov, mov, op_loc(loc), size, op_xmm(xmm), 16);
+            return;
+        case X64_LOC_GPR:
+            insx(e, "movq", "movq", op_gpr(loc.reg), 8, op_xmm(xmm), 16);
+            return;
+        default:
+            break;
+    }
+
+    if (val->kind == ANVIL_VAL_CONST_FLOAT && float_bits(val) == 0) {
+        /* xorps leaves EFLAGS alone */
+        insx(e, "xorps", "xorps", op_xmm(xmm), 16, op_xmm(xmm), 16);
+        return;
+    }
+    load_gpr(e, val, X64_RAX);
+    insx(e, "movq", "movq", op_gpr(X64_RAX), 8, op_xmm(xmm), 16);
+}
+
+/* Integer source operand: register, frame slot or immediate; else materialize */
+static opnd_t int_src(emit_t *e, anvil_value_t *val, int scratch, int size, bool allow_imm)
+{
+    x64_loc_t loc = loc_of(e, val);
+    int64_t v;
+    if (loc.kind == X64_LOC_GPR || loc.kind == X64_LOC_STACK) return op_loc(loc);
+    if (allow_imm && const_imm(val, size, &v)) return op_imm(v);
+    load_gpr(e, val, scratch);
+    return op_gpr(scratch);
+}
+
+/* Float source operand: XMM register or frame slot; else materialize */
+static opnd_t float_src(emit_t *e, anvil_value_t *val, int scratch)
+{
+    x64_loc_t loc = loc_of(e, val);
+    if (loc.kind == X64_LOC_XMM || loc.kind == X64_LOC_STACK) return op_loc(loc);
+    load_xmm(e, val, scratch);
+    return op_xmm(scratch);
+}
+
+/* Load val into reg, extended from its low from bytes to 64 bits */
+static void load_ext(emit_t *e, anvil_value_t *val, int reg, int from, bool sign)
+{
+    x64_loc_t loc = loc_of(e, val);
+    opnd_t src;
+    if (loc.kind == X64_LOC_GPR || loc.kind == X64_LOC_STACK) {
+        src = op_loc(loc);
+    } else {
+        load_gpr(e, val, reg);
+        src = op_gpr(reg);
+    }
+
+    switch (from) {
+        case 1:
+            if (sign) insx(e, "movsbq", "movsx", src, 1, op_gpr(reg), 8);
+            else insx(e, "movzbl", "movzx", src, 1, op_gpr(reg), 4);
+            break;
+        case 2:
+            if (sign) insx(e, "movswq", "movsx", src, 2, op_gpr(reg), 8);
+            else insx(e, "movzwl", "movzx", src, 2, op_gpr(reg), 4);
+            break;
+        case 4:
+            if (sign) insx(e, "movslq", "movsxd", src, 4, op_gpr(reg), 8);
+            else ins2(e, "mov", 4, src, op_gpr(reg));
+            break;
+        default:
+            if (src.kind != OPND_GPR || src.reg != reg) ins2(e, "mov", 8, src, op_gpr(reg));
+            break;
+    }
+}
+
+/* Copy between two allocated locations */
+static void move_loc(emit_t *e, x64_loc_t dst, x64_loc_t src)
+{
+    if (loc_eq(dst, src)) return;
+
+    if (dst.kind == X64_LOC_GPR) {
+        if (src.kind == X64_LOC_XMM) insx(e, "movq", "movq", op_xmm(src.reg), 16, op_gpr(dst.reg), 8);
+        else ins2(e, "mov", 8, op_loc(src), op_gpr(dst.reg));
+    } else if (dst.kind == X64_LOC_XMM) {
+        if (src.kind == X64_LOC_XMM) insx(e, "movaps", "movaps", op_xmm(src.reg), 16, op_xmm(dst.reg), 16);
+        else if (src.kind == X64_LOC_GPR) insx(e, "movq", "movq", op_gpr(src.reg), 8, op_xmm(dst.reg), 16);
+        else insx(e, "movsd", "movsd", op_loc(src), 8, op_xmm(dst.reg), 16);
+    } else if (dst.kind == X64_LOC_STACK) {
+        if (src.kind == X64_LOC_GPR) {
+            ins2(e, "mov", 8, op_gpr(src.reg), op_loc(dst));
+        } else if (src.kind == X64_LOC_XMM) {
+            insx(e, "movsd", "movsd", op_xmm(src.reg), 16, op_loc(dst), 8);
+        } else {
+            ins2(e, "mov", 8, op_loc(src), op_gpr(X64_RAX));
+            ins2(e, "mov", 8, op_gpr(X64_RAX), op_loc(dst));
+        }
+    }
+}
+
+/* Move the value val into location dst */
+static void move_val(emit_t *e, x64_loc_t dst, anvil_value_t *val)
+{
+    x64_loc_t src = loc_of(e, val);
+    int64_t v;
+
+    if (src.kind == X64_LOC_GPR || src.kind == X64_LOC_XMM || src.kind == X64_LOC_STACK) {
+        move_loc(e, dst, src);
+    } else if (dst.kind == X64_LOC_GPR) {
+        load_gpr(e, val, dst.reg);
+    } else if (dst.kind == X64_LOC_XMM) {
+        load_xmm(e, val, dst.reg);
+    } else if (dst.kind == X64_LOC_STACK) {
+        if (const_imm(val, 8, &v)) {
+            ins2(e, "mov", 8, op_imm(v), op_loc(dst));
+        } else {
+            load_gpr(e, val, X64_RAX);
+            ins2(e, "mov", 8, op_gpr(X64_RAX), op_loc(dst));
+        }
+    }
+}
+
+static bool is_reg_or_slot(x64_loc_t loc)
+{
+    return loc.kind == X64_LOC_GPR || loc.kind == X64_LOC_XMM || loc.kind == X64_LOC_STACK;
+}
+
+/*
+ * Perform moves as if simultaneously. A move is emitted once no pending
+ * move still reads its destination; a cycle is broken by parking one
+ * destination's old value in R11.
+ */
+static void parallel_move(emit_t *e, pmove_t *moves, size_t n)
+{
+    bool *pending = calloc(n ? n : 1, sizeof(bool));
+    if (!pending) return;
+    size_t left = 0;
+    for (size_t i = 0; i < n; i++) {
+        pending[i] = !(moves[i].src.kind != X64_LOC_NONE && loc_eq(moves[i].src, moves[i].dst));
+        if (pending[i]) left++;
+    }
+
+    while (left > 0) {
+        bool progress = false;
+        for (size_t i = 0; i < n; i++) {
+            if (!pending[i]) continue;
+            bool blocked = false;
+            for (size_t j = 0; j < n && !blocked; j++) {
+                blocked = j != i && pending[j] && loc_eq(moves[j].src, moves[i].dst);
+            }
+            if (blocked) continue;
+            if (moves[i].src.kind != X64_LOC_NONE) move_loc(e, moves[i].dst, moves[i].src);
+            else move_val(e, moves[i].dst, moves[i].val);
+            pending[i] = false;
+            left--;
+            progress = true;
+        }
+        if (left == 0 || progress) continue;
+
+        for (size_t i = 0; i < n; i++) {
+            if (!pending[i]) continue;
+            x64_loc_t tmp = { X64_LOC_GPR, X64_R11, 0 };
+            x64_loc_t busy = moves[i].dst;
+            move_loc(e, tmp, busy);
+            for (size_t j = 0; j < n; j++) {
+                if (pending[j] && loc_eq(moves[j].src, busy)) moves[j].src = tmp;
+            }
+            break;
+        }
+    }
+    free(pending);
+}
+
+static void pmove_add(emit_t *e, pmove_t *moves, size_t *n, x64_loc_t dst, anvil_value_t *val)
+{
+    x64_loc_t src = loc_of(e, val);
+    moves[*n].dst = dst;
+    moves[*n].src = is_reg_or_slot(src) ? src : (x64_loc_t){ X64_LOC_NONE, -1, 0 };
+    moves[*n].val = val;
+    (*n)++;
+}
+
+/* Result register: the allocated one, or a scratch when the result is spilled */
+static int dst_gpr(x64_loc_t d)
+{
+    return d.kind == X64_LOC_GPR ? d.reg : X64_R11;
+}
+
+static int dst_xmm(x64_loc_t d)
+{
+    return d.kind == X64_LOC_XMM ? d.reg : X64_XMM_SCRATCH;
+}
+
+static void finish_gpr(emit_t *e, x64_loc_t d, int reg)
+{
+    x64_loc_t src = { X64_LOC_GPR, reg, 0 };
+    if (d.kind == X64_LOC_GPR || d.kind == X64_LOC_STACK) move_loc(e, d, src);
+}
+
+static void finish_xmm(emit_t *e, x64_loc_t d, int xmm)
+{
+    x64_loc_t src = { X64_LOC_XMM, xmm, 0 };
+    if (d.kind == X64_LOC_XMM || d.kind == X64_LOC_STACK) move_loc(e, d, src);
+}
+
+/* Memory operand addressing *ptr */
+static opnd_t addr_of(emit_t *e, anvil_value_t *ptr, int scratch)
+{
+    x64_loc_t loc = loc_of(e, ptr);
+    const char *sym;
+    if (loc.kind == X64_LOC_FRAME) return op_mem(X64_RBP, loc.offset);
+    if (loc.kind == X64_LOC_GPR) return op_mem(loc.reg, 0);
+    if (loc.kind == X64_LOC_NONE && (sym = symbol_of(e, ptr)) != NULL) return op_sym(sym, 0);
+    load_gpr(e, ptr, scratch);
+    return op_mem(scratch, 0);
+}
+
+/* ============================================================================
+ * Frame
+ * ============================================================================ */
+
+static const int saved_order[] = { X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15 };
+#define NUM_SAVED_ORDER 5
+
+static void emit_prologue(emit_t *e)
+{
+    anvil_func_t *func = e->func;
+    if (e->gas) {
+        anvil_strbuf_appendf(e->out, "\t.globl %s\n", func->name);
+        anvil_strbuf_appendf(e->out, "\t.type %s, @function\n", func->name);
+        anvil_strbuf_appendf(e->out, "%s:\n", func->name);
+        anvil_strbuf_append(e->out, "\tpushq %rbp\n");
+        anvil_strbuf_append(e->out, "\tmovq %rsp, %rbp\n");
+    } else {
+        anvil_strbuf_appendf(e->out, "global %s\n", func->name);
+        anvil_strbuf_appendf(e->out, "%s:\n", func->name);
+        anvil_strbuf_append(e->out, "\tpush rbp\n");
+        anvil_strbuf_append(e->out, "\tmov rbp, rsp\n");
+    }
+    for (int i = 0; i < NUM_SAVED_ORDER; i++) {
+        if (e->ra->used_callee_saved & (1u << saved_order[i]))
+            ins1(e, "push", 8, op_gpr(saved_order[i]));
+    }
+    if (e->ra->frame_size > 0)
+        ins2(e, "sub", 8, op_imm(e->ra->frame_size), op_gpr(X64_RSP));
+}
+
+static void emit_epilogue(emit_t *e)
+{
+    if (e->ra->num_saved > 0) {
+        lea(e, op_mem(X64_RBP, -8 * e->ra->num_saved), X64_RSP);
+        for (int i = NUM_SAVED_ORDER - 1; i >= 0; i--) {
+            if (e->ra->used_callee_saved & (1u << saved_order[i]))
+                ins1(e, "pop", 8, op_gpr(saved_order[i]));
+        }
+    } else {
+        ins2(e, "mov", 8, op_gpr(X64_RBP), op_gpr(X64_RSP));
+    }
+    ins1(e, "pop", 8, op_gpr(X64_RBP));
+    anvil_strbuf_append(e->out, "\tret\n");
+}
+
+/* Move parameters from their ABI locations to their allocated ones */
+static void emit_param_moves(emit_t *e)
+{
+    anvil_func_t *func = e->func;
+    pmove_t *moves = calloc(func->num_params ? func->num_params : 1, sizeof(pmove_t));
+    if (!moves) return;
+    size_t n = 0;
+    int gp = 0, fp = 0, stack = 0;
+
+    for (size_t i = 0; i < func->num_params; i++) {
+        anvil_value_t *param = func->params[i];
+        x64_loc_t src = { X64_LOC_NONE, -1, 0 };
+        if (is_float(param) && fp < SYSV_NUM_XMM_ARGS) {
+            src.kind = X64_LOC_XMM;
+            src.reg = fp++;
+        } else if (!is_float(param) && gp < SYSV_NUM_ARG_REGS) {
+            src.kind = X64_LOC_GPR;
+            src.reg = sysv_arg_regs[gp++];
+        } else {
+            src.kind = X64_LOC_STACK;
+            src.offset = 16 + 8 * stack++;
+        }
+        x64_loc_t dst = loc_of(e, param);
+        if (param->num_uses == 0 || !is_reg_or_slot(dst)) continue;
+        moves[n].dst = dst;
+        moves[n].src = src;
+        moves[n].val = param;
+        n++;
+    }
+    parallel_move(e, moves, n);
+    free(moves);
+}
+
+/* ============================================================================
+ * Instructions
+ * ============================================================================ */
+
+static void emit_label_ref(emit_t *e, const char *jump, anvil_block_t *block)
+{
+    anvil_strbuf_append_mnemonic(e->out, jump, NULL);
+    anvil_strbuf_append_label(e->out, ".L", e->func->name, block->name);
+    anvil_strbuf_append_char(e->out, '\n');
+}
+
+static bool is_next_block(anvil_instr_t *instr, anvil_block_t *block)
+{
+    return instr->parent && instr->parent->next == block;
+}
+
+static bool has_phis(anvil_block_t *block)
+{
+    return block && block->first && block->first->op == ANVIL_OP_PHI;
+}
+
+/* Copies for the phis of succ on the edge from -> succ */
+static void emit_phi_copies(emit_t *e, anvil_block_t *from, anvil_block_t *succ)
+{
+    size_t count = 0;
+    if (!succ) return;
+    for (anvil_instr_t *phi = succ->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next)
+        count++;
+    if (count == 0) return;
+
+    pmove_t *moves = calloc(count, sizeof(pmove_t));
+    if (!moves) return;
+    size_t n = 0;
+    for (anvil_instr_t *phi = succ->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        x64_loc_t dst = loc_of(e, phi->result);
+        if (!is_reg_or_slot(dst)) continue;
+        for (size_t i = 0; i < phi->num_phi_incoming; i++) {
+            if (phi->phi_blocks[i] != from) continue;
+            pmove_add(e, moves, &n, dst, phi->operands[i]);
+            break;
+        }
+    }
+    parallel_move(e, moves, n);
+    free(moves);
+}
+
+static const char *cmp_cc(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_EQ:  return "e";
+        case ANVIL_OP_CMP_NE:  return "ne";
+        case ANVIL_OP_CMP_LT:  return "l";
+        case ANVIL_OP_CMP_LE:  return "le";
+        case ANVIL_OP_CMP_GT:  return "g";
+        case ANVIL_OP_CMP_GE:  return "ge";
+        case ANVIL_OP_CMP_ULT: return "b";
+        case ANVIL_OP_CMP_ULE: return "be";
+        case ANVIL_OP_CMP_UGT: return "a";
+        default:               return "ae";
+    }
+}
+
+static const char *invert_cc(const char *cc)
+{
+    static const char *pairs[][2] = {
+        { "e", "ne" }, { "l", "ge" }, { "le", "g" }, { "b", "ae" }, { "be", "a" }
+    };
+    for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        if (strcmp(cc, pairs[i][0]) == 0) return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0) return pairs[i][0];
+    }
+    return "ne";
+}
+
+/*
+ * Set EFLAGS from a truth value and return the condition meaning "true",
+ * or NULL if the value is a constant (*known receives it).
+ */
+static const char *emit_test(emit_t *e, anvil_value_t *cond, bool *known)
+{
+    x64_loc_t loc = loc_of(e, cond);
+    int size = val_bytes(cond);
+
+    if (loc.kind == X64_LOC_FLAGS) return e->be->fused_cc;
+    if (loc.kind == X64_LOC_GPR) {
+        ins2(e, "test", size, op_gpr(loc.reg), op_gpr(loc.reg));
+        return "ne";
+    }
+    if (loc.kind == X64_LOC_STACK) {
+        ins2(e, "cmp", size, op_imm(0), op_loc(loc));
+        return "ne";
+    }
+    if (loc.kind == X64_LOC_XMM) {
+        load_gpr(e, cond, X64_R11);
+        ins2(e, "test", 8, op_gpr(X64_R11), op_gpr(X64_R11));
+        return "ne";
+    }
+    if (cond->kind == ANVIL_VAL_CONST_INT) *known = cond->data.i != 0;
+    else *known = cond->kind != ANVIL_VAL_CONST_NULL;
+    return NULL;
+}
+
+static void emit_jcc(emit_t *e, const char *cc, anvil_block_t *target)
+{
+    char jcc[8];
+    snprintf(jcc, sizeof(jcc), "j%s", cc);
+    emit_label_ref(e, jcc, target);
+}
+
+/* Edge to target: its phi copies, then a jump unless it falls through */
+static void emit_edge(emit_t *e, anvil_instr_t *instr, anvil_block_t *target)
+{
+    emit_phi_copies(e, instr->parent, target);
+    if (!is_next_block(instr, target)) emit_label_ref(e, "jmp", target);
+}
+
+/*
+ * Phi copies go on the edge they belong to. When both successors have
+ * phis the true edge gets a local stub, so neither edge's copies run on
+ * the other path (a value can be live out along one edge while the other
+ * edge overwrites it).
+ */
+static void emit_br_cond(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_block_t *t = instr->true_block, *f = instr->false_block;
+    bool known = false;
+    const char *cc = emit_test(e, instr->operands[0], &known);
+
+    if (!cc) {
+        emit_edge(e, instr, known ? t : f);
+    } else if (!has_phis(f) && (has_phis(t) || is_next_block(instr, t))) {
+        emit_jcc(e, invert_cc(cc), f);
+        emit_edge(e, instr, t);
+    } else if (!has_phis(t)) {
+        emit_jcc(e, cc, t);
+        emit_edge(e, instr, f);
+    } else {
+        char label[64];
+        snprintf(label, sizeof(label), ".L%s_edge%d", e->func->name, e->be->label_counter++);
+        anvil_strbuf_appendf(e->out, "	j%s %s\n", cc, label);
+        emit_phi_copies(e, instr->parent, f);
+        emit_label_ref(e, "jmp", f);
+        anvil_strbuf_appendf(e->out, "%s:\n", label);
+        emit_edge(e, instr, t);
+    }
+}
+
+static void emit_int_binop(emit_t *e, anvil_instr_t *instr, const char *op, bool commutative)
+{
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+    x64_loc_t d = loc_of(e, instr->result);
+    x64_loc_t la = loc_of(e, a), lb = loc_of(e, b);
+    int size = val_bytes(instr->result);
+    int dreg = dst_gpr(d);
+    int64_t v;
+
+    if (lb.kind == X64_LOC_GPR && lb.reg == dreg && !(la.kind == X64_LOC_GPR && la.reg == dreg)) {
+        if (commutative) {
+            anvil_value_t *tv = a; a = b; b = tv;
+            x64_loc_t tl = la; la = lb; lb = tl;
+        } else {
+            dreg = X64_R11;
+        }
+    }
+
+    /* x = y +/- imm into a different register: one lea */
+    if ((instr->op == ANVIL_OP_ADD || instr->op == ANVIL_OP_SUB) && la.kind == X64_LOC_GPR &&
+        la.reg != dreg && const_imm(b, size, &v) && v != INT32_MIN) {
+        lea(e, op_mem(la.reg, instr->op == ANVIL_OP_ADD ? v : -v), dreg);
+        finish_gpr(e, d, dreg);
+        return;
+    }
+
+    load_gpr(e, a, dreg);
+    ins2(e, op, 8, int_src(e, b, X64_RAX, size, true), op_gpr(dreg));
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_unop(emit_t *e, anvil_instr_t *instr, const char *op)
+{
+    x64_loc_t d = loc_of(e, instr->result);
+    int dreg = dst_gpr(d);
+    load_gpr(e, instr->operands[0], dreg);
+    ins1(e, op, 8, op_gpr(dreg));
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_shift(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+    x64_loc_t d = loc_of(e, instr->result);
+    int size = val_bytes(instr->result);
+    bool variable = b->kind != ANVIL_VAL_CONST_INT;
+    int dreg = dst_gpr(d);
+    const char *op = instr->op == ANVIL_OP_SHL ? "shl" : instr->op == ANVIL_OP_SHR ? "shr" : "sar";
+
+    if (variable) {
+        load_gpr(e, b, X64_RCX);
+        if (dreg == X64_RCX) dreg = X64_R11;
+    }
+
+    /* Right shifts need the value properly extended to 64 bits first */
+    if (instr->op == ANVIL_OP_SHL) load_gpr(e, a, dreg);
+    else load_ext(e, a, dreg, size, instr->op == ANVIL_OP_SAR);
+
+    opnd_t count = variable ? op_gpr(X64_RCX) : op_imm(b->data.i & 63);
+    if (e->gas) {
+        anvil_strbuf_appendf(e->out, "\t%sq ", op);
+        put_opnd(e, &count, 1);
+        anvil_strbuf_append(e->out, ", ");
+        opnd_t dst = op_gpr(dreg);
+        put_opnd(e, &dst, 8);
+        anvil_strbuf_append(e->out, "\n");
+    } else {
+        anvil_strbuf_appendf(e->out, "\t%s %s, ", op, x64_gpr64_names[dreg]);
+        put_opnd(e, &count, 1);
+        anvil_strbuf_append(e->out, "\n");
+    }
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_div(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+    x64_loc_t d = loc_of(e, instr->result);
+    int size = val_bytes(instr->result);
+    bool sign, rem;
+
+    switch (instr->op) {
+        case ANVIL_OP_SDIV: sign = true;  rem = false; break;
+        case ANVIL_OP_UDIV: sign = false; rem = false; break;
+        case ANVIL_OP_SMOD: sign = true;  rem = true;  break;
+        case ANVIL_OP_UMOD: sign = false; rem = true;  break;
+        default:
+            sign = instr->result->type ? instr->result->type->is_signed : true;
+            rem = instr->op == ANVIL_OP_MOD;
+            break;
+    }
+
+    /* Narrow operands are extended and divided in 64 bits */
+    load_ext(e, a, X64_RAX, size, sign);
+    opnd_t divisor;
+    if (size == 8) {
+        divisor = int_src(e, b, X64_R11, 8, false);
+    } else {
+        load_ext(e, b, X64_R11, size, sign);
+        divisor = op_gpr(X64_R11);
+    }
+    if (sign) anvil_strbuf_append(e->out, e->gas ? "\tcqto\n" : "\tcqo\n");
+    else ins2(e, "xor", 4, op_gpr(X64_RDX), op_gpr(X64_RDX));
+    ins1(e, sign ? "idiv" : "div", 8, divisor);
+
+    x64_loc_t src = { X64_LOC_GPR, rem ? X64_RDX : X64_RAX, 0 };
+    if (is_reg_or_slot(d)) move_loc(e, d, src);
+}
+
+static void emit_cmp(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+    x64_loc_t d = loc_of(e, instr->result);
+    int size = val_bytes(a);
+    const char *cc = cmp_cc(instr->op);
+
+    opnd_t lhs;
+    x64_loc_t la = loc_of(e, a);
+    if (la.kind == X64_LOC_GPR || la.kind == X64_LOC_STACK) {
+        lhs = op_loc(la);
+    } else {
+        load_gpr(e, a, X64_R11);
+        lhs = op_gpr(X64_R11);
+    }
+    opnd_t rhs = int_src(e, b, X64_RAX, size, true);
+    if (lhs.kind == OPND_MEM && rhs.kind == OPND_MEM) {
+        ins2(e, "mov", 8, lhs, op_gpr(X64_R11));
+        lhs = op_gpr(X64_R11);
+    }
+    ins2(e, "cmp", size, rhs, lhs);
+
+    if (d.kind == X64_LOC_FLAGS) {
+        e->be->fused_cc = cc;
+        return;
+    }
+
+    char setcc[8];
+    snprintf(setcc, sizeof(setcc), "set%s", cc);
+    int dreg = dst_gpr(d);
+    opnd_t dst = op_gpr(dreg);
+    anvil_strbuf_append_mnemonic(e->out, setcc, NULL);
+    put_opnd(e, &dst, 1);
+    anvil_strbuf_append_char(e->out, '\n');
+    insx(e, "movzbl", "movzx", dst, 1, dst, 4);
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_select(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *cond = instr->operands[0];
+    anvil_value_t *t = instr->operands[1], *f = instr->operands[2];
+    x64_loc_t d = loc_of(e, instr->result);
+    bool known = false;
+
+    const char *cc = emit_test(e, cond, &known);
+    if (!cc) {
+        if (is_reg_or_slot(d)) move_val(e, d, known ? t : f);
+        return;
+    }
+
+    if (is_float(instr->result)) {
+        char label[64];
+        snprintf(label, sizeof(label), ".L%s_sel%d", e->func->name, e->be->label_counter++);
+        load_xmm(e, f, X64_XMM_SCRATCH);
+        anvil_strbuf_appendf(e->out, "\tj%s %s\n", invert_cc(cc), label);
+        load_xmm(e, t, X64_XMM_SCRATCH);
+        anvil_strbuf_appendf(e->out, "%s:\n", label);
+        finish_xmm(e, d, X64_XMM_SCRATCH);
+        return;
+    }
+
+    load_gpr(e, f, X64_R11);
+    opnd_t src = int_src(e, t, X64_RAX, 8, false);
+    char cmov[8];
+    snprintf(cmov, sizeof(cmov), "cmov%s", cc);
+    ins2(e, cmov, 8, src, op_gpr(X64_R11));
+    finish_gpr(e, d, X64_R11);
+}
+
+static void emit_load(emit_t *e, anvil_instr_t *instr)
+{
+    x64_loc_t d = loc_of(e, instr->result);
+    opnd_t addr = addr_of(e, instr->operands[0], X64_R11);
+
+    if (is_float(instr->result)) {
+        int xmm = dst_xmm(d);
+        const char *mov = is_f32(instr->result) ? "movss" : "movsd";
+        insx(e, mov, mov, addr, is_f32(instr->result) ? 4 : 8, op_xmm(xmm), 16);
+        finish_xmm(e, d, xmm);
+        return;
+    }
+
+    int dreg = dst_gpr(d);
+    int size = val_bytes(instr->result);
+    bool sign = instr->result->type && instr->result->type->is_signed;
+    switch (size) {
+        case 1:
+            if (sign) insx(e, "movsbq", "movsx", addr, 1, op_gpr(dreg), 8);
+            else insx(e, "movzbl", "movzx", addr, 1, op_gpr(dreg), 4);
+            break;
+        case 2:
+            if (sign) insx(e, "movswq", "movsx", addr, 2, op_gpr(dreg), 8);
+            else insx(e, "movzwl", "movzx", addr, 2, op_gpr(dreg), 4);
+            break;
+        default:
+            ins2(e, "mov", size, addr, op_gpr(dreg));
+            break;
+    }
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_store(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *val = instr->operands[0], *ptr = instr->operands[1];
+    int size = val_bytes(val);
+    x64_loc_t lp = loc_of(e, ptr);
+
+    /* Constants may carry a wider type than the slot they initialize; a
+     * store to the first element of an array or struct slot keeps its own */
+    anvil_type_t *slot = ptr->type && ptr->type->kind == ANVIL_TYPE_PTR ? ptr->type->data.pointee : NULL;
+    if ((val->kind == ANVIL_VAL_CONST_INT || val->kind == ANVIL_VAL_CONST_NULL) &&
+        lp.kind == X64_LOC_FRAME && slot &&
+        slot->kind != ANVIL_TYPE_ARRAY && slot->kind != ANVIL_TYPE_STRUCT) {
+        size = type_bytes(slot);
+    }
+
+    opnd_t addr = addr_of(e, ptr, X64_R11);
+    x64_loc_t lv = loc_of(e, val);
+
+    if (is_float(val)) {
+        const char *mov = is_f32(val) ? "movss" : "movsd";
+        if (lv.kind == X64_LOC_XMM) {
+            insx(e, mov, mov, op_xmm(lv.reg), 16, addr, size);
+            return;
+        }
+        if (lv.kind == X64_LOC_STACK) {
+            ins2(e, "mov", 8, op_loc(lv), op_gpr(X64_RAX));
+        } else if (val->kind == ANVIL_VAL_CONST_FLOAT) {
+            int64_t bits = (int64_t)float_bits(val);
+            if (fits_i32(sext(bits, size))) {
+                ins2(e, "mov", size, op_imm(sext(bits, size)), addr);
+                return;
+            }
+            load_imm(e, bits, X64_RAX);
+        } else {
+            load_gpr(e, val, X64_RAX);
+        }
+        ins2(e, "mov", size, op_gpr(X64_RAX), addr);
+        return;
+    }
+
+    opnd_t src = int_src(e, val, X64_RAX, size, true);
+    if (src.kind == OPND_MEM) {
+        ins2(e, "mov", 8, src, op_gpr(X64_RAX));
+        src = op_gpr(X64_RAX);
+    }
+    ins2(e, "mov", size, src, addr);
+}
+
+static int pointee_bytes(anvil_type_t *ptr_type)
+{
+    if (!ptr_type || ptr_type->kind != ANVIL_TYPE_PTR || !ptr_type->data.pointee) return 8;
+    size_t size = ptr_type->data.pointee->size;
+    return size ? (int)size : 1;
+}
+
+/* dreg = base + disp, folding frame and symbol bases into the address */
+static void emit_offset_addr(emit_t *e, anvil_value_t *base, int64_t disp, int dreg)
+{
+    x64_loc_t lb = loc_of(e, base);
+    const char *sym;
+    if (lb.kind == X64_LOC_FRAME) {
+        lea(e, op_mem(X64_RBP, lb.offset + disp), dreg);
+    } else if (lb.kind == X64_LOC_GPR) {
+        if (disp || lb.reg != dreg) lea(e, op_mem(lb.reg, disp), dreg);
+    } else if (lb.kind == X64_LOC_NONE && (sym = symbol_of(e, base)) != NULL) {
+        lea(e, op_sym(sym, disp), dreg);
+    } else {
+        load_gpr(e, base, dreg);
+        if (disp) lea(e, op_mem(dreg, disp), dreg);
+    }
+}
+
+static void emit_gep(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *base = instr->operands[0];
+    x64_loc_t d = loc_of(e, instr->result);
+    int dreg = dst_gpr(d);
+    int elem = pointee_bytes(instr->result->type);
+
+    if (instr->num_operands < 2) {
+        emit_offset_addr(e, base, 0, dreg);
+        finish_gpr(e, d, dreg);
+        return;
+    }
+
+    anvil_value_t *idx = instr->operands[1];
+    if (idx->kind == ANVIL_VAL_CONST_INT) {
+        int64_t disp = sext(idx->data.i, val_bytes(idx)) * elem;
+        if (fits_i32(disp)) {
+            emit_offset_addr(e, base, disp, dreg);
+            finish_gpr(e, d, dreg);
+            return;
+        }
+    }
+
+    /* Index register, sign- or zero-extended to 64 bits */
+    x64_loc_t li = loc_of(e, idx);
+    int ireg;
+    if (li.kind == X64_LOC_GPR && val_bytes(idx) == 8 && li.reg != dreg) {
+        ireg = li.reg;
+    } else {
+        bool sign = !idx->type || idx->type->is_signed;
+        load_ext(e, idx, X64_RAX, val_bytes(idx), sign);
+        ireg = X64_RAX;
+    }
+    int scale = elem;
+    if (elem != 1 && elem != 2 && elem != 4 && elem != 8) {
+        if (e->gas) {
+            anvil_strbuf_appendf(e->out, "\timulq $%d, %%%s, %%rax\n", elem, x64_gpr64_names[ireg]);
+        } else {
+            anvil_strbuf_appendf(e->out, "\timul rax, %s, %d\n", x64_gpr64_names[ireg], elem);
+        }
+        ireg = X64_RAX;
+        scale = 1;
+    }
+
+    x64_loc_t lb = loc_of(e, base);
+    opnd_t addr;
+    if (lb.kind == X64_LOC_FRAME) {
+        addr = op_mem(X64_RBP, lb.offset);
+    } else if (lb.kind == X64_LOC_GPR) {
+        addr = op_mem(lb.reg, 0);
+    } else {
+        load_gpr(e, base, dreg);
+        addr = op_mem(dreg, 0);
+    }
+    addr.index = ireg;
+    addr.scale = scale;
+    lea(e, addr, dreg);
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_struct_gep(emit_t *e, anvil_instr_t *instr)
+{
+    x64_loc_t d = loc_of(e, instr->result);
+    int dreg = dst_gpr(d);
+    int64_t offset = 0;
+
+    if (instr->aux_type && instr->aux_type->kind == ANVIL_TYPE_STRUCT &&
+        instr->num_operands > 1 && instr->operands[1]->kind == ANVIL_VAL_CONST_INT) {
+        size_t field = (size_t)instr->operands[1]->data.i;
+        if (field < instr->aux_type->data.struc.num_fields)
+            offset = (int64_t)instr->aux_type->data.struc.offsets[field];
+    }
+    emit_offset_addr(e, instr->operands[0], offset, dreg);
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_call(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *callee = instr->operands[0];
+    size_t num_args = instr->num_operands - 1;
+    anvil_type_t *fty = callee->type;
+    if (fty && fty->kind == ANVIL_TYPE_PTR) fty = fty->data.pointee;
+    bool variadic = !fty || fty->kind != ANVIL_TYPE_FUNC || fty->data.func.variadic;
+    bool indirect = callee->kind != ANVIL_VAL_FUNC;
+
+    if (indirect) {
+        load_gpr(e, callee, X64_R11);
+        ins2(e, "mov", 8, op_gpr(X64_R11), op_mem(X64_RBP, e->ra->call_slot));
+    }
+
+    /* Classify: integers to rdi.., floats to xmm0-7, the rest on the stack */
+    pmove_t *moves = calloc(num_args ? num_args : 1, sizeof(pmove_t));
+    bool *on_stack = calloc(num_args ? num_args : 1, sizeof(bool));
+    if (!moves || !on_stack) {
+        free(moves);
+        free(on_stack);
+        return;
+    }
+    size_t n = 0, num_stack = 0;
+    int gp = 0, fp = 0;
+    for (size_t i = 0; i < num_args; i++) {
+        anvil_value_t *arg = instr->operands[i + 1];
+        x64_loc_t dst = { X64_LOC_NONE, -1, 0 };
+        if (is_float(arg) && fp < SYSV_NUM_XMM_ARGS) {
+            dst.kind = X64_LOC_XMM;
+            dst.reg = fp++;
+        } else if (!is_float(arg) && gp < SYSV_NUM_ARG_REGS) {
+            dst.kind = X64_LOC_GPR;
+            dst.reg = sysv_arg_regs[gp++];
+        } else {
+            on_stack[i] = true;
+            num_stack++;
+            continue;
+        }
+        pmove_add(e, moves, &n, dst, arg);
+    }
+
+    size_t stack_bytes = num_stack * 8 + (num_stack & 1 ? 8 : 0);
+    if (num_stack & 1) ins2(e, "sub", 8, op_imm(8), op_gpr(X64_RSP));
+    for (size_t i = num_args; i-- > 0;) {
+        if (!on_stack[i]) continue;
+        anvil_value_t *arg = instr->operands[i + 1];
+        x64_loc_t la = loc_of(e, arg);
+        if (la.kind == X64_LOC_XMM) {
+            ins2(e, "sub", 8, op_imm(8), op_gpr(X64_RSP));
+            insx(e, "movsd", "movsd", op_xmm(la.reg), 16, op_mem(X64_RSP, 0), 8);
+        } else {
+            ins1(e, "push", 8, int_src(e, arg, X64_RAX, 8, true));
+        }
+    }
+
+    parallel_move(e, moves, n);
+
+    /* SysV: char and short arguments are extended to 32 bits by the caller */
+    for (size_t i = 0; i < n; i++) {
+        anvil_value_t *arg = moves[i].val;
+        int size = val_bytes(arg);
+        if (moves[i].dst.kind != X64_LOC_GPR || size > 2 || is_float(arg)) continue;
+        opnd_t r = op_gpr(moves[i].dst.reg);
+        bool sign = arg->type && arg->type->is_signed;
+        if (size == 1) insx(e, sign ? "movsbl" : "movzbl", sign ? "movsx" : "movzx", r, 1, r, 4);
+        else insx(e, sign ? "movswl" : "movzwl", sign ? "movsx" : "movzx", r, 2, r, 4);
+    }
+    free(moves);
+    free(on_stack);
+
+    /* %al = number of vector registers used, for variadic callees */
+    if (variadic) ins2(e, "mov", 4, op_imm(fp), op_gpr(X64_RAX));
+
+    if (!indirect) {
+        anvil_strbuf_appendf(e->out, "\tcall %s\n", callee->name);
+    } else if (e->gas) {
+        anvil_strbuf_appendf(e->out, "\tcall *%d(%%rbp)\n", e->ra->call_slot);
+    } else {
+        anvil_strbuf_appendf(e->out, "\tcall qword [rbp%+d]\n", e->ra->call_slot);
+    }
+
+    if (stack_bytes) ins2(e, "add", 8, op_imm((int64_t)stack_bytes), op_gpr(X64_RSP));
+
+    x64_loc_t d = loc_of(e, instr->result);
+    if (is_reg_or_slot(d)) {
+        x64_loc_t ret = { is_float(instr->result) ? X64_LOC_XMM : X64_LOC_GPR, 0, 0 };
+        move_loc(e, d, ret);
+    }
+}
+
+static void emit_ret(emit_t *e, anvil_instr_t *instr)
+{
+    if (instr->num_operands > 0 && instr->operands[0]) {
+        anvil_value_t *val = instr->operands[0];
+        if (is_float(val)) load_xmm(e, val, 0);
+        else load_gpr(e, val, X64_RAX);
+    }
+    emit_epilogue(e);
+}
+
+static void emit_float_binop(emit_t *e, anvil_instr_t *instr, const char *op, bool commutative)
+{
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+    x64_loc_t d = loc_of(e, instr->result);
+    x64_loc_t la = loc_of(e, a), lb = loc_of(e, b);
+    int xmm = dst_xmm(d);
+    bool single = is_f32(instr->result);
+    char mnem[16];
+    snprintf(mnem, sizeof(mnem), "%s%s", op, single ? "ss" : "sd");
+
+    if (lb.kind == X64_LOC_XMM && lb.reg == xmm && !(la.kind == X64_LOC_XMM && la.reg == xmm)) {
+        if (commutative) {
+            anvil_value_t *tv = a; a = b; b = tv;
+        } else {
+            xmm = X64_XMM_SCRATCH;
+        }
+    }
+
+    load_xmm(e, a, xmm);
+    insx(e, mnem, mnem, float_src(e, b, X64_XMM_CONST), single ? 4 : 8, op_xmm(xmm), 16);
+    finish_xmm(e, d, xmm);
+}
+
+/* fneg/fabs: xor or and with a sign-bit mask */
+static void emit_float_mask(emit_t *e, anvil_instr_t *instr, bool negate)
+{
+    x64_loc_t d = loc_of(e, instr->result);
+    int xmm = dst_xmm(d);
+    bool single = is_f32(instr->result);
+    int64_t mask;
+    if (single) mask = negate ? 0x80000000LL : 0x7fffffffLL;
+    else mask = negate ? (int64_t)0x8000000000000000ULL : 0x7fffffffffffffffLL;
+
+    load_xmm(e, instr->operands[0], xmm);
+    load_imm(e, mask, X64_RAX);
+    insx(e, "movq", "movq", op_gpr(X64_RAX), 8, op_xmm(X64_XMM_CONST), 16);
+    insx(e, negate ? "xorps" : "andps", negate ? "xorps" : "andps",
+         op_xmm(X64_XMM_CONST), 16, op_xmm(xmm), 16);
+    finish_xmm(e, d, xmm);
+}
+
+static void emit_fcmp(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+    x64_loc_t d = loc_of(e, instr->result);
+    x64_loc_t la = loc_of(e, a);
+    bool single = is_f32(a);
+    int lhs = la.kind == X64_LOC_XMM ? la.reg : X64_XMM_SCRATCH;
+
+    if (lhs == X64_XMM_SCRATCH) load_xmm(e, a, lhs);
+    const char *ucomi = single ? "ucomiss" : "ucomisd";
+    insx(e, ucomi, ucomi, float_src(e, b, X64_XMM_CONST), single ? 4 : 8, op_xmm(lhs), 16);
+
+    /* Same semantics as the O0 path: a > b, false when unordered */
+    int dreg = dst_gpr(d);
+    opnd_t dst = op_gpr(dreg);
+    anvil_strbuf_append(e->out, "\tseta ");
+    put_opnd(e, &dst, 1);
+    anvil_strbuf_append(e->out, "\n");
+    insx(e, "movzbl", "movzx", dst, 1, dst, 4);
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_int_to_float(emit_t *e, anvil_instr_t *instr, bool sign)
+{
+    anvil_value_t *a = instr->operands[0];
+    x64_loc_t d = loc_of(e, instr->result);
+    x64_loc_t la = loc_of(e, a);
+    int xmm = dst_xmm(d);
+    int size = val_bytes(a);
+    bool single = is_f32(instr->result);
+    opnd_t src;
+    int src_size = 8;
+
+    if (size == 8 || (size == 4 && sign)) {
+        src_size = size;
+        if (la.kind == X64_LOC_GPR || la.kind == X64_LOC_STACK) {
+            src = op_loc(la);
+        } else {
+            load_gpr(e, a, X64_R11);
+            src = op_gpr(X64_R11);
+        }
+    } else {
+        load_ext(e, a, X64_R11, size, sign);
+        src = op_gpr(X64_R11);
+    }
+
+    char gas_op[16];
+    const char *nasm_op = single ? "cvtsi2ss" : "cvtsi2sd";
+    snprintf(gas_op, sizeof(gas_op), "%s%s", nasm_op, src_size == 4 ? "l" : "q");
+    insx(e, gas_op, nasm_op, src, src_size, op_xmm(xmm), 16);
+    finish_xmm(e, d, xmm);
+}
+
+static void emit_float_to_int(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *a = instr->operands[0];
+    x64_loc_t d = loc_of(e, instr->result);
+    int dreg = dst_gpr(d);
+    bool single = is_f32(a);
+    const char *op = single ? "cvttss2si" : "cvttsd2si";
+
+    insx(e, op, op, float_src(e, a, X64_XMM_CONST), single ? 4 : 8, op_gpr(dreg), 8);
+    finish_gpr(e, d, dreg);
+}
+
+static void emit_float_convert(emit_t *e, anvil_instr_t *instr)
+{
+    anvil_value_t *a = instr->operands[0];
+    x64_loc_t d = loc_of(e, instr->result);
+    int xmm = dst_xmm(d);
+    bool widen = instr->op == ANVIL_OP_FPEXT;
+    const char *op = widen ? "cvtss2sd" : "cvtsd2ss";
+
+    insx(e, op, op, float_src(e, a, X64_XMM_CONST), widen ? 4 : 8, op_xmm(xmm), 16);
+    finish_xmm(e, d, xmm);
+}
+
+static void emit_instr(emit_t *e, anvil_instr_t *instr)
+{
+    x64_loc_t d;
+
+    switch (instr->op) {
+        case ANVIL_OP_PHI:
+        case ANVIL_OP_ALLOCA:
+        case ANVIL_OP_NOP:
+            break;
+
+        case ANVIL_OP_ADD: emit_int_binop(e, instr, "add", true); break;
+        case ANVIL_OP_SUB: emit_int_binop(e, instr, "sub", false); break;
+        case ANVIL_OP_MUL: emit_int_binop(e, instr, "imul", true); break;
+        case ANVIL_OP_AND: emit_int_binop(e, instr, "and", true); break;
+        case ANVIL_OP_OR:  emit_int_binop(e, instr, "or", true); break;
+        case ANVIL_OP_XOR: emit_int_binop(e, instr, "xor", true); break;
+        case ANVIL_OP_NEG: emit_unop(e, instr, "neg"); break;
+        case ANVIL_OP_NOT: emit_unop(e, instr, "not"); break;
+
+        case ANVIL_OP_SHL:
+        case ANVIL_OP_SHR:
+        case ANVIL_OP_SAR:
+            emit_shift(e, instr);
+            break;
+
+        case ANVIL_OP_SDIV: case ANVIL_OP_UDIV: case ANVIL_OP_DIV:
+        case ANVIL_OP_SMOD: case ANVIL_OP_UMOD: case ANVIL_OP_MOD:
+            emit_div(e, instr);
+            break;
+
+        case ANVIL_OP_CMP_EQ: case ANVIL_OP_CMP_NE: case ANVIL_OP_CMP_LT:
+        case ANVIL_OP_CMP_LE: case ANVIL_OP_CMP_GT: case ANVIL_OP_CMP_GE:
+        case ANVIL_OP_CMP_ULT: case ANVIL_OP_CMP_ULE: case ANVIL_OP_CMP_UGT:
+        case ANVIL_OP_CMP_UGE:
+            emit_cmp(e, instr);
+            break;
+
+        case ANVIL_OP_SELECT: emit_select(e, instr); break;
+        case ANVIL_OP_LOAD: emit_load(e, instr); break;
+        case ANVIL_OP_STORE: emit_store(e, instr); break;
+        case ANVIL_OP_GEP: emit_gep(e, instr); break;
+        case ANVIL_OP_STRUCT_GEP: emit_struct_gep(e, instr); break;
+        case ANVIL_OP_CALL: emit_call(e, instr); break;
+
+        case ANVIL_OP_BR:
+            if (instr->true_block) emit_edge(e, instr, instr->true_block);
+            break;
+
+        case ANVIL_OP_BR_COND: emit_br_cond(e, instr); break;
+
+        case ANVIL_OP_RET: emit_ret(e, instr); break;
+
+        case ANVIL_OP_ZEXT:
+        case ANVIL_OP_SEXT:
+            d = loc_of(e, instr->result);
+            load_ext(e, instr->operands[0], dst_gpr(d), val_bytes(instr->operands[0]),
+                     instr->op == ANVIL_OP_SEXT);
+            finish_gpr(e, d, dst_gpr(d));
+            break;
+
+        case ANVIL_OP_TRUNC:
+        case ANVIL_OP_BITCAST:
+        case ANVIL_OP_PTRTOINT:
+        case ANVIL_OP_INTTOPTR:
+            d = loc_of(e, instr->result);
+            if (is_reg_or_slot(d)) move_val(e, d, instr->operands[0]);
+            break;
+
+        case ANVIL_OP_FADD: emit_float_binop(e, instr, "add", true); break;
+        case ANVIL_OP_FSUB: emit_float_binop(e, instr, "sub", false); break;
+        case ANVIL_OP_FMUL: emit_float_binop(e, instr, "mul", true); break;
+        case ANVIL_OP_FDIV: emit_float_binop(e, instr, "div", false); break;
+        case ANVIL_OP_FNEG: emit_float_mask(e, instr, true); break;
+        case ANVIL_OP_FABS: emit_float_mask(e, instr, false); break;
+        case ANVIL_OP_FCMP: emit_fcmp(e, instr); break;
+        case ANVIL_OP_SITOFP: emit_int_to_float(e, instr, true); break;
+        case ANVIL_OP_UITOFP: emit_int_to_float(e, instr, false); break;
+
+        case ANVIL_OP_FPTOSI:
+        case ANVIL_OP_FPTOUI:
+            emit_float_to_int(e, instr);
+            break;
+
+        case ANVIL_OP_FPEXT:
+        case ANVIL_OP_FPTRUNC:
+            emit_float_convert(e, instr);
+            break;
+
+        default:
+            anvil_strbuf_appendf(e->out, e->gas ? "\t# unimplemented op %d\n"
+                                                : "\t; unimplemented op %d\n", instr->op);
+            break;
+    }
+}
+
+void x64_ra_emit_func(x64_backend_t *be, anvil_func_t *func, anvil_syntax_t syntax)
+{
+    emit_t e;
+    e.be = be;
+    e.out = &be->code;
+    e.gas = syntax == ANVIL_SYNTAX_GAS;
+    e.func = func;
+    e.ra = &be->ra;
+
+    be->current_func = func;
+    if (x64_regalloc_func(&be->ra, func) != ANVIL_OK) {
+        anvil_strbuf_appendf(e.out, e.gas ? "# register allocation failed for %s\n"
+                                          : "; register allocation failed for %s\n", func->name);
+        return;
+    }
+    func->stack_size = (size_t)(8 * be->ra.num_saved + be->ra.frame_size);
+
+    emit_prologue(&e);
+    emit_param_moves(&e);
+
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        if (block != func->blocks) {
+            anvil_strbuf_append_label(e.out, ".L", func->name, block->name);
+            anvil_strbuf_append_n(e.out, ":\n", 2);
+        }
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next)
+            emit_instr(&e, instr);
+    }
+
+    anvil_strbuf_append(e.out, "\n");
+}
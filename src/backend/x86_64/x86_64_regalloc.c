@@ -0,0 +1,390 @@
+/*
+ * ANVIL - x86-64 Linear-Scan Register Allocator
+ *
+ * Takes one live interval per value from the shared liveness analysis
+ * (src/core/liveness.c) and assigns registers with linear scan (Poletto &
+ * Sarkar). A value that does not fit is spilled to an 8-byte frame slot
+ * for its whole lifetime. The spill victim is the one used in the
+ * shallowest loop (from the function's cached loop nest), and among
+ * those the one that ends last.
+ *
+ * Because an operand is read at 2k and a result written at 2k+1, an
+ * operand that dies at instruction k can share a register with k's
+ * result. Phi copies are placed at each block's copy point.
+ *
+ * RAX, R11, XMM14 and XMM15 are never allocated; the emitter uses them
+ * as scratch. That leaves 12 GPRs and 14 XMM registers.
+ */
+
+#include "x86_64_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocation order: caller-saved first so leaf code needs no saves */
+static const int gpr_order[] = {
+    X64_RCX, X64_RDX, X64_RSI, X64_RDI, X64_R8, X64_R9, X64_R10,
+    X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15
+};
+#define NUM_GPR_ORDER (sizeof(gpr_order) / sizeof(gpr_order[0]))
+#define NUM_XMM_ALLOC 14
+
+typedef struct {
+    x64_regalloc_t *ra;
+    int num_positions;
+    int *calls;                 /* Prefix counts of clobber points by position */
+    int *divs;
+    int *shifts;
+} ra_state_t;
+
+static bool type_is_float(anvil_type_t *type)
+{
+    return type && (type->kind == ANVIL_TYPE_F32 || type->kind == ANVIL_TYPE_F64);
+}
+
+static bool is_int_cmp(anvil_op_t op)
+{
+    return op >= ANVIL_OP_CMP_EQ && op <= ANVIL_OP_CMP_UGE;
+}
+
+bool x64_regalloc_fuses_cmp(anvil_instr_t *instr)
+{
+    if (!instr || !is_int_cmp(instr->op) || !instr->result) return false;
+    if (instr->result->num_uses != 1) return false;
+    anvil_instr_t *next = instr->next;
+    return next && next->op == ANVIL_OP_BR_COND && next->num_operands > 0 &&
+           next->operands[0] == instr->result;
+}
+
+x64_loc_t x64_regalloc_loc(const x64_regalloc_t *ra, anvil_value_t *val)
+{
+    x64_loc_t none = { X64_LOC_NONE, -1, 0 };
+    int32_t num = anvil_liveness_value_num(&ra->live, val);
+    return num < 0 ? none : ra->intervals[num].loc;
+}
+
+/* Raise the loop depth of the values an instruction defines and uses */
+static void note_loop_depth(x64_regalloc_t *ra, anvil_instr_t *instr, uint32_t depth)
+{
+    int32_t num = instr->result ? anvil_liveness_value_num(&ra->live, instr->result) : -1;
+    if (num >= 0 && ra->intervals[num].loop_depth < depth) ra->intervals[num].loop_depth = depth;
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        num = anvil_liveness_value_num(&ra->live, instr->operands[i]);
+        if (num >= 0 && ra->intervals[num].loop_depth < depth) ra->intervals[num].loop_depth = depth;
+    }
+}
+
+/* Build one interval per live range and record clobber points */
+static anvil_error_t ra_intervals(ra_state_t *st, anvil_func_t *func)
+{
+    x64_regalloc_t *ra = st->ra;
+    anvil_liveness_t *lv = &ra->live;
+
+    ra->num_intervals = lv->num_values;
+    ra->intervals = calloc(lv->num_values ? lv->num_values : 1, sizeof(x64_interval_t));
+    st->num_positions = 2 * lv->num_indices + 2;
+    st->calls = calloc((size_t)st->num_positions + 1, sizeof(int));
+    st->divs = calloc((size_t)st->num_positions + 1, sizeof(int));
+    st->shifts = calloc((size_t)st->num_positions + 1, sizeof(int));
+    if (!ra->intervals || !st->calls || !st->divs || !st->shifts) return ANVIL_ERR_NOMEM;
+
+    for (size_t i = 0; i < lv->num_values; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        anvil_value_t *val = lv->ranges[i].value;
+        iv->value = val;
+        iv->start = lv->ranges[i].start;
+        iv->end = lv->ranges[i].end;
+        iv->hint = -1;
+        iv->is_float = type_is_float(val->type);
+        iv->loc.kind = X64_LOC_NONE;
+        iv->loc.reg = -1;
+        if (val->kind == ANVIL_VAL_INSTR && val->data.instr) {
+            if (val->data.instr->op == ANVIL_OP_ALLOCA) {
+                iv->loc.kind = X64_LOC_FRAME;
+            } else if (x64_regalloc_fuses_cmp(val->data.instr)) {
+                iv->loc.kind = X64_LOC_FLAGS;
+            }
+        }
+    }
+
+    /* Parameters arrive in ABI registers; hint the allocator to keep them there */
+    int gp = 0, fp = 0;
+    for (size_t i = 0; i < func->num_params; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        if (iv->is_float) {
+            if (fp < SYSV_NUM_XMM_ARGS) iv->hint = fp;
+            fp++;
+        } else {
+            if (gp < SYSV_NUM_ARG_REGS) iv->hint = sysv_arg_regs[gp];
+            gp++;
+        }
+    }
+
+    const anvil_loop_info_t *li = anvil_func_loops(func);
+    for (size_t b = 0; b < lv->num_blocks; b++) {
+        anvil_live_block_t *lb = &lv->blocks[b];
+        uint32_t depth = li ? anvil_loop_depth(li, lb->block) : 0;
+        int k = lb->first;
+        for (anvil_instr_t *instr = lb->block->first; instr; instr = instr->next) {
+            if (depth > 0) note_loop_depth(ra, instr, depth);
+            if (anvil_liveness_copy_before(instr)) k++;
+            int pos = 2 * k + 1;   /* stored one past: prefix[p + 1] counts position p */
+            switch (instr->op) {
+                case ANVIL_OP_CALL:
+                    st->calls[pos]++;
+                    if (instr->num_operands > 0 && instr->operands[0]->kind != ANVIL_VAL_FUNC)
+                        ra->call_slot = 1;
+                    break;
+                case ANVIL_OP_SDIV: case ANVIL_OP_UDIV: case ANVIL_OP_DIV:
+                case ANVIL_OP_SMOD: case ANVIL_OP_UMOD: case ANVIL_OP_MOD:
+                    st->divs[pos]++;
+                    break;
+                case ANVIL_OP_SHL: case ANVIL_OP_SHR: case ANVIL_OP_SAR:
+                    if (instr->num_operands > 1 && instr->operands[1]->kind != ANVIL_VAL_CONST_INT)
+                        st->shifts[pos]++;
+                    break;
+                default:
+                    break;
+            }
+            k++;
+        }
+    }
+    for (int p = 1; p <= st->num_positions; p++) {
+        st->calls[p] += st->calls[p - 1];
+        st->divs[p] += st->divs[p - 1];
+        st->shifts[p] += st->shifts[p - 1];
+    }
+    return ANVIL_OK;
+}
+
+/* Number of clobber points at positions in [lo, hi] */
+static int points_in(const int *prefix, int lo, int hi)
+{
+    if (hi < lo) return 0;
+    return prefix[hi + 1] - prefix[lo];
+}
+
+/* Registers clobbered inside each interval */
+static void ra_forbid(ra_state_t *st)
+{
+    x64_regalloc_t *ra = st->ra;
+    for (size_t i = 0; i < ra->num_intervals; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        if (iv->loc.kind != X64_LOC_NONE || iv->start < 0) continue;
+        /* A call at 2c clobbers values live from before 2c to after 2c + 1 */
+        if (points_in(st->calls, iv->start, iv->end - 2) > 0) {
+            iv->forbidden |= iv->is_float ? 0xffffu : X64_CALLER_SAVED_MASK;
+        }
+        if (!iv->is_float) {
+            if (points_in(st->divs, iv->start, iv->end) > 0) iv->forbidden |= 1u << X64_RDX;
+            if (points_in(st->shifts, iv->start, iv->end) > 0) iv->forbidden |= 1u << X64_RCX;
+        }
+    }
+}
+
+/* Sort keys are (start << 32 | interval index) */
+static int cmp_key(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Spill a before b: a is used in a shallower loop, or ends later */
+static bool spill_before(const x64_interval_t *a, const x64_interval_t *b)
+{
+    if (a->loop_depth != b->loop_depth) return a->loop_depth < b->loop_depth;
+    return a->end > b->end;
+}
+
+static void spill(x64_interval_t *iv)
+{
+    iv->loc.kind = X64_LOC_STACK;
+    iv->loc.reg = -1;
+}
+
+static anvil_error_t ra_scan(x64_regalloc_t *ra)
+{
+    uint64_t *order = malloc((ra->num_intervals ? ra->num_intervals : 1) * sizeof(uint64_t));
+    if (!order) return ANVIL_ERR_NOMEM;
+    size_t n = 0;
+    for (size_t i = 0; i < ra->num_intervals; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        if (iv->loc.kind == X64_LOC_NONE && iv->start >= 0)
+            order[n++] = ((uint64_t)iv->start << 32) | i;
+    }
+    qsort(order, n, sizeof(uint64_t), cmp_key);
+
+    /* One active list per register class, at most 16 entries each */
+    int32_t active[2][X64_NUM_GPR];
+    int num_active[2] = { 0, 0 };
+    uint32_t free_regs[2];
+    free_regs[0] = 0;
+    for (size_t r = 0; r < NUM_GPR_ORDER; r++) free_regs[0] |= 1u << gpr_order[r];
+    free_regs[1] = (1u << NUM_XMM_ALLOC) - 1;
+
+    for (size_t o = 0; o < n; o++) {
+        int32_t cur_idx = (int32_t)(order[o] & 0xffffffffu);
+        x64_interval_t *cur = &ra->intervals[cur_idx];
+        int cls = cur->is_float ? 1 : 0;
+
+        /* Expire intervals that ended before this one starts */
+        for (int a = 0; a < num_active[cls];) {
+            x64_interval_t *iv = &ra->intervals[active[cls][a]];
+            if (iv->end < cur->start) {
+                free_regs[cls] |= 1u << iv->loc.reg;
+                active[cls][a] = active[cls][--num_active[cls]];
+            } else {
+                a++;
+            }
+        }
+
+        uint32_t allowed = free_regs[cls] & ~cur->forbidden;
+        int reg = -1;
+        if (cur->hint >= 0 && (allowed & (1u << cur->hint))) {
+            reg = cur->hint;
+        } else if (cls == 0) {
+            for (size_t r = 0; r < NUM_GPR_ORDER && reg < 0; r++) {
+                if (allowed & (1u << gpr_order[r])) reg = gpr_order[r];
+            }
+        } else if (allowed) {
+            reg = __builtin_ctz(allowed);
+        }
+
+        if (reg >= 0) {
+            cur->loc.kind = cls ? X64_LOC_XMM : X64_LOC_GPR;
+            cur->loc.reg = reg;
+            free_regs[cls] &= ~(1u << reg);
+            active[cls][num_active[cls]++] = cur_idx;
+            continue;
+        }
+
+        /* No register: spill the best victim among the usable intervals and cur */
+        int victim = -1;
+        for (int a = 0; a < num_active[cls]; a++) {
+            x64_interval_t *iv = &ra->intervals[active[cls][a]];
+            if (cur->forbidden & (1u << iv->loc.reg)) continue;
+            if (victim < 0 || spill_before(iv, &ra->intervals[active[cls][victim]])) victim = a;
+        }
+        if (victim >= 0 && spill_before(&ra->intervals[active[cls][victim]], cur)) {
+            x64_interval_t *iv = &ra->intervals[active[cls][victim]];
+            cur->loc = iv->loc;
+            spill(iv);
+            active[cls][victim] = cur_idx;
+        } else {
+            spill(cur);
+        }
+    }
+
+    free(order);
+    return ANVIL_OK;
+}
+
+static int align_up(int value, int align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* Place callee-saved pushes, allocas, spill slots and the call slot */
+/* Size of the frame slot a FRAME or STACK value needs */
+static int ra_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    x64_regalloc_t *ra = data;
+    int32_t num = anvil_liveness_value_num(&ra->live, val);
+    if (num < 0) return 0;
+    x64_interval_t *iv = &ra->intervals[num];
+    if (iv->loc.kind == X64_LOC_STACK) {
+        *align = 8;
+        return 8;
+    }
+    if (iv->loc.kind != X64_LOC_FRAME) return 0;
+    anvil_type_t *type = iv->value->type;
+    anvil_type_t *pointee = type && type->kind == ANVIL_TYPE_PTR ? type->data.pointee : NULL;
+    *align = pointee && pointee->align ? (int)pointee->align : 8;
+    if (*align > 16) *align = 16;
+    return pointee && pointee->size ? (int)pointee->size : 8;
+}
+
+/* Offset of iv's frame slot; the first member of a shared slot places it */
+static int ra_slot_offset(x64_regalloc_t *ra, x64_interval_t *iv, int *off)
+{
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&ra->colors, iv->value);
+    if (slot && slot->placed) return slot->offset;
+    int align = 8;
+    int size = slot ? slot->size : ra_slot_size(iv->value, &align, ra);
+    if (slot) align = slot->align;
+    *off = align_up(*off + size, align);
+    if (slot) {
+        slot->offset = -*off;
+        slot->placed = true;
+    }
+    return -*off;
+}
+
+static void ra_layout_frame(x64_regalloc_t *ra)
+{
+    for (size_t i = 0; i < ra->num_intervals; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        if (iv->loc.kind == X64_LOC_GPR && (X64_CALLEE_SAVED_MASK & (1u << iv->loc.reg)))
+            ra->used_callee_saved |= 1u << iv->loc.reg;
+    }
+    ra->num_saved = __builtin_popcount(ra->used_callee_saved);
+
+    /* Allocas, then spills; values with disjoint lifetimes share a slot */
+    int off = 8 * ra->num_saved;
+    for (size_t i = 0; i < ra->num_intervals; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        if (iv->loc.kind == X64_LOC_FRAME) iv->loc.offset = ra_slot_offset(ra, iv, &off);
+    }
+
+    off = align_up(off, 8);
+    for (size_t i = 0; i < ra->num_intervals; i++) {
+        x64_interval_t *iv = &ra->intervals[i];
+        if (iv->loc.kind != X64_LOC_STACK) continue;
+        iv->loc.offset = ra_slot_offset(ra, iv, &off);
+        ra->num_spills++;
+    }
+
+    if (ra->call_slot) {
+        off += 8;
+        ra->call_slot = -off;
+    }
+
+    ra->frame_size = align_up(off, 16) - 8 * ra->num_saved;
+}
+
+anvil_error_t x64_regalloc_func(x64_regalloc_t *ra, anvil_func_t *func)
+{
+    if (!ra || !func) return ANVIL_ERR_INVALID_ARG;
+
+    x64_regalloc_free(ra);
+    ra->func = func;
+
+    ra_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.ra = ra;
+
+    anvil_error_t err = anvil_liveness_compute(&ra->live, func);
+    if (err == ANVIL_OK) err = ra_intervals(&st, func);
+    if (err == ANVIL_OK) {
+        ra_forbid(&st);
+        err = ra_scan(ra);
+    }
+    if (err == ANVIL_OK) {
+        /* Without a coloring every value keeps its own slot */
+        anvil_stack_color(&ra->colors, func, &ra->live, ra_slot_size, ra);
+        ra_layout_frame(ra);
+    }
+
+    free(st.calls);
+    free(st.divs);
+    free(st.shifts);
+    return err;
+}
+
+void x64_regalloc_free(x64_regalloc_t *ra)
+{
+    if (!ra) return;
+    anvil_stack_colors_free(&ra->colors);
+    anvil_liveness_free(&ra->live);
+    free(ra->intervals);
+    memset(ra, 0, sizeof(*ra));
+}
@@ -101,12 +101,8 @@ typedef struct {
     anvil_ctx_t *ctx;  /* Context for FP format selection */
     
     /* Stack slots for local variables */
-    struct {
-        anvil_value_t *value;
-        int offset;
-    } *stack_slots;
-    size_t num_stack_slots;
-    size_t stack_slots_cap;
+    anvil_value_map_t stack_slots;  /* Value -> frame offset */
+    anvil_stack_colors_t colors;    /* Slot sharing for the current function */
     
     /* String table */
     zarch_string_entry_t *strings;
@@ -150,7 +146,8 @@ static void zarch_cleanup(anvil_backend_t *be)
     anvil_strbuf_destroy(&priv->code);
     anvil_strbuf_destroy(&priv->data);
     free(priv->strings);
-    free(priv->stack_slots);
+    anvil_value_map_free(&priv->stack_slots);
+    anvil_stack_colors_free(&priv->colors);
     free(priv);
     be->priv = NULL;
 }
@@ -162,8 +159,9 @@ static void zarch_reset(anvil_backend_t *be)
     zarch_backend_t *priv = be->priv;
     
     /* Clear stack slots (contain pointers to anvil_value_t) */
-    priv->num_stack_slots = 0;
+    anvil_value_map_reset(&priv->stack_slots, NULL);
     priv->local_vars_size = 0;
+    anvil_stack_colors_free(&priv->colors);
     
     /* Clear string table (contain pointers to string data) */
     priv->num_strings = 0;
@@ -179,34 +177,42 @@ static void zarch_reset(anvil_backend_t *be)
 /* Get stack slot offset for an ALLOCA result value */
 static int zarch_get_stack_slot(zarch_backend_t *be, anvil_value_t *val)
 {
-    for (size_t i = 0; i < be->num_stack_slots; i++) {
-        if (be->stack_slots[i].value == val) {
-            return be->stack_slots[i].offset;
-        }
-    }
-    return -1;
+    int32_t offset = anvil_value_map_get(&be->stack_slots, val);
+    return offset == ANVIL_VALUE_MAP_NONE ? -1 : offset;
 }
 
 /* Add a stack slot for an ALLOCA */
 static int zarch_add_stack_slot(zarch_backend_t *be, anvil_value_t *val)
 {
-    if (be->num_stack_slots >= be->stack_slots_cap) {
-        size_t new_cap = be->stack_slots_cap ? be->stack_slots_cap * 2 : 16;
-        void *new_slots = realloc(be->stack_slots, new_cap * sizeof(be->stack_slots[0]));
-        if (!new_slots) return -1;
-        be->stack_slots = new_slots;
-        be->stack_slots_cap = new_cap;
+    /* Values with disjoint lifetimes share a colored slot */
+    anvil_frame_slot_t *slot = anvil_stack_color_slot(&be->colors, val);
+    int offset;
+    if (slot && slot->placed) {
+        offset = slot->offset;
+    } else {
+        offset = DYN_LOCALS_OFFSET + be->local_vars_size;
+        be->local_vars_size += slot ? slot->size : 8;
+        if (slot) {
+            slot->offset = offset;
+            slot->placed = true;
+        }
     }
-    
-    int offset = DYN_LOCALS_OFFSET + be->local_vars_size;
-    be->stack_slots[be->num_stack_slots].value = val;
-    be->stack_slots[be->num_stack_slots].offset = offset;
-    be->num_stack_slots++;
-    be->local_vars_size += 8;  /* 8 bytes for 64-bit */
+    /* Lookups return the first slot recorded for a value */
+    if (anvil_value_map_get(&be->stack_slots, val) == ANVIL_VALUE_MAP_NONE &&
+        anvil_value_map_set(&be->stack_slots, val, offset) != ANVIL_OK)
+        return -1;
     
     return offset;
 }
 
+/* Frame slot size for stack-slot coloring */
+static int zarch_slot_size(anvil_value_t *val, int *align, void *data)
+{
+    (void)data;
+    *align = 8;
+    return val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA ? 8 : 0;
+}
+
 static const anvil_arch_info_t *zarch_get_arch_info(anvil_backend_t *be)
 {
     (void)be;
@@ -478,7 +484,7 @@ static void zarch_emit_instr(zarch_backend_t *be, anvil_instr_t *instr)
     
     switch (instr->op) {
         case ANVIL_OP_PHI:
-            /* PHI nodes are SSA abstractions - value already in R15 from predecessor */
+            /* Not reached: codegen refuses phis without supports_phi */
             break;
             
         case ANVIL_OP_ALLOCA:
@@ -1112,7 +1118,11 @@ static void zarch_emit_func(zarch_backend_t *be, anvil_func_t *func)
     
     be->local_vars_size = 0;
     be->max_call_args = 0;
-    be->num_stack_slots = 0;  /* Reset stack slots for new function */
+    anvil_value_map_reset(&be->stack_slots, func);  /* Reset stack slots for new function */
+    
+    /* Share slots between allocas with disjoint lifetimes (no sharing on failure) */
+    anvil_stack_colors_free(&be->colors);
+    anvil_stack_color(&be->colors, func, NULL, zarch_slot_size, be);
     
     zarch_emit_prologue(be, func);
     
@@ -1161,6 +1171,7 @@ static anvil_error_t zarch_codegen_module(anvil_backend_t *be, anvil_module_t *m
     anvil_strbuf_destroy(&priv->data);
     anvil_strbuf_init(&priv->code);
     anvil_strbuf_init(&priv->data);
+    anvil_strbuf_set_sink(&priv->code, be->sink, be->sink_data);
     
     /* Reset string table */
     priv->num_strings = 0;
@@ -1172,6 +1183,8 @@ static anvil_error_t zarch_codegen_module(anvil_backend_t *be, anvil_module_t *m
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         if (!func->is_declaration) {
             zarch_emit_func(priv, func);
+            anvil_error_t err = anvil_strbuf_flush(&priv->code);
+            if (err != ANVIL_OK) return err;
             if (!entry_point) entry_point = func->name;
         }
     }
@@ -1190,11 +1203,11 @@ static anvil_error_t zarch_codegen_module(anvil_backend_t *be, anvil_module_t *m
                     if (num_args > priv->max_call_args) {
                         priv->max_call_args = num_args;
                     }
-                } else if (instr->op == ANVIL_OP_ALLOCA) {
-                    priv->local_vars_size += 8;  /* 8 bytes for 64-bit */
                 }
             }
         }
+        /* Locals as laid out by zarch_emit_func (slots may be shared) */
+        priv->local_vars_size = (int)func->stack_size - SA64_SIZE - priv->max_call_args * 8;
         zarch_emit_func_dynsize(priv, func);
     }
     
@@ -1325,8 +1338,7 @@ static anvil_error_t zarch_codegen_module(anvil_backend_t *be, anvil_module_t *m
     
     zarch_emit_footer(priv, entry_point);
     
-    *output = anvil_strbuf_detach(&priv->code, len);
-    return ANVIL_OK;
+    return anvil_strbuf_finish(&priv->code, output, len);
 }
 
 static anvil_error_t zarch_codegen_func(anvil_backend_t *be, anvil_func_t *func,
@@ -3,22 +3,25 @@
  */
 
 #include "anvil/anvil_internal.h"
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* Maximum number of registered backends */
 #define MAX_BACKENDS 32
 
-/* Registered backends */
-static const anvil_backend_ops_t *registered_backends[MAX_BACKENDS];
-static size_t num_backends = 0;
-static bool backends_initialized = false;
+/*
+ * Registered backends. This is the library's only process-wide mutable
+ * state, and contexts are created on any thread, so it is lock-free:
+ * a registration claims a slot with an atomic counter and publishes
+ * the ops pointer into it; lookups scan the claimed slots and skip any
+ * that are not published yet. Slots are never reused.
+ */
+static _Atomic(const anvil_backend_ops_t *) registered_backends[MAX_BACKENDS];
+static atomic_size_t num_backends;
 
-void anvil_init_backends(void)
+static void register_builtin_backends(void)
 {
-    if (backends_initialized) return;
-    
-    /* Register built-in backends */
     anvil_register_backend(&anvil_backend_x86);
     anvil_register_backend(&anvil_backend_x86_64);
     anvil_register_backend(&anvil_backend_s370);
@@ -29,16 +32,37 @@ void anvil_init_backends(void)
     anvil_register_backend(&anvil_backend_ppc64);
     anvil_register_backend(&anvil_backend_ppc64le);
     anvil_register_backend(&anvil_backend_arm64);
-    
-    backends_initialized = true;
 }
 
+#ifndef _WIN32
+static pthread_once_t backends_once = PTHREAD_ONCE_INIT;
+
+void anvil_init_backends(void)
+{
+    /* Callers racing the first registration sleep until it is done */
+    pthread_once(&backends_once, register_builtin_backends);
+}
+#else
+static bool backends_registered;
+
+void anvil_init_backends(void)
+{
+    /* No worker threads on this platform */
+    if (backends_registered) return;
+    backends_registered = true;
+    register_builtin_backends();
+}
+#endif
+
 anvil_error_t anvil_register_backend(const anvil_backend_ops_t *ops)
 {
     if (!ops) return ANVIL_ERR_INVALID_ARG;
-    if (num_backends >= MAX_BACKENDS) return ANVIL_ERR_NOMEM;
     
-    registered_backends[num_backends++] = ops;
+    /* The counter may run past MAX_BACKENDS; lookups clamp it */
+    size_t slot = atomic_fetch_add(&num_backends, 1);
+    if (slot >= MAX_BACKENDS) return ANVIL_ERR_NOMEM;
+    
+    atomic_store_explicit(&registered_backends[slot], ops, memory_order_release);
     return ANVIL_OK;
 }
 
@@ -48,9 +72,13 @@ anvil_backend_t *anvil_get_backend(anvil_ctx_t *ctx, anvil_arch_t arch)
     
     /* Find backend for architecture */
     const anvil_backend_ops_t *ops = NULL;
-    for (size_t i = 0; i < num_backends; i++) {
-        if (registered_backends[i]->arch == arch) {
-            ops = registered_backends[i];
+    size_t count = atomic_load(&num_backends);
+    if (count > MAX_BACKENDS) count = MAX_BACKENDS;
+    for (size_t i = 0; i < count; i++) {
+        const anvil_backend_ops_t *slot =
+            atomic_load_explicit(&registered_backends[i], memory_order_acquire);
+        if (slot && slot->arch == arch) {
+            ops = slot;
             break;
         }
     }
@@ -231,6 +231,7 @@ anvil_value_t *anvil_build_gep(anvil_ctx_t *ctx, anvil_type_t *type, anvil_value
     anvil_instr_t *instr = anvil_instr_create(ctx, ANVIL_OP_GEP, ptr_type, name);
     if (!instr) return NULL;
     
+    anvil_instr_reserve_operands(instr, 1 + num_indices);
     anvil_instr_add_operand(instr, ptr);
     for (size_t i = 0; i < num_indices; i++) {
         anvil_instr_add_operand(instr, indices[i]);
@@ -311,6 +312,7 @@ anvil_value_t *anvil_build_call(anvil_ctx_t *ctx, anvil_type_t *type, anvil_valu
     anvil_instr_t *instr = anvil_instr_create(ctx, ANVIL_OP_CALL, ret_type, name);
     if (!instr) return NULL;
     
+    anvil_instr_reserve_operands(instr, 1 + num_args);
     anvil_instr_add_operand(instr, callee);
     for (size_t i = 0; i < num_args; i++) {
         anvil_instr_add_operand(instr, args[i]);
@@ -557,7 +559,9 @@ void anvil_phi_add_incoming(anvil_value_t *phi, anvil_value_t *val, anvil_block_
     
     /* Add block to phi_blocks array */
     size_t new_count = instr->num_phi_incoming + 1;
-    anvil_block_t **new_blocks = realloc(instr->phi_blocks, new_count * sizeof(anvil_block_t *));
+    anvil_block_t **new_blocks = anvil_pool_realloc(instr->pool, instr->phi_blocks,
+                                                    instr->num_phi_incoming * sizeof(anvil_block_t *),
+                                                    new_count * sizeof(anvil_block_t *));
     if (!new_blocks) return;
     
     new_blocks[instr->num_phi_incoming] = block;
@@ -502,6 +502,11 @@ anvil_ctx_t *anvil_ctx_create(void)
     ctx->arch = ANVIL_ARCH_X86_64;
     ctx->output = ANVIL_OUTPUT_ASM;
     ctx->syntax = ANVIL_SYNTAX_DEFAULT;
+    ctx->codegen_threads = 1;
+    anvil_mutex_init(&ctx->lock);
+    
+    /* Context arena (types, constants) */
+    anvil_pool_init(&ctx->pool, 0);
     
     /* Initialize type cache */
     anvil_type_init_sizes(ctx);
@@ -532,10 +537,10 @@ void anvil_ctx_destroy(anvil_ctx_t *ctx)
         mod = next;
     }
     
-    /* Destroy memory pool */
-    if (ctx->pool) {
-        anvil_pool_destroy(ctx->pool);
-    }
+    /* Destroy intern tables and context arena (types, constants) */
+    anvil_const_table_destroy(ctx);
+    anvil_type_table_destroy(ctx);
+    anvil_pool_destroy(&ctx->pool);
     
     /* Cleanup backend (now safe - no dangling pointers) */
     if (ctx->backend) {
@@ -550,6 +555,7 @@ void anvil_ctx_destroy(anvil_ctx_t *ctx)
         anvil_pass_manager_destroy(ctx->pass_manager);
     }
     
+    anvil_mutex_destroy(&ctx->lock);
     free(ctx);
 }
 
@@ -594,6 +600,21 @@ anvil_error_t anvil_ctx_set_output(anvil_ctx_t *ctx, anvil_output_t output)
     return ANVIL_OK;
 }
 
+anvil_error_t anvil_ctx_set_codegen_threads(anvil_ctx_t *ctx, int threads)
+{
+    if (!ctx || threads < 0) return ANVIL_ERR_INVALID_ARG;
+    ctx->codegen_threads = threads;
+    
+    /* Kept for a later switch to a target that can use it */
+    if (threads != 1 && ctx->backend && !ctx->backend->ops->parallel_codegen) {
+        anvil_set_error(ctx, ANVIL_ERR_CODEGEN,
+                        "Backend %s generates code serially; thread count ignored",
+                        ctx->backend->ops->name);
+        return ANVIL_ERR_CODEGEN;
+    }
+    return ANVIL_OK;
+}
+
 anvil_error_t anvil_ctx_set_syntax(anvil_ctx_t *ctx, anvil_syntax_t syntax)
 {
     if (!ctx) return ANVIL_ERR_INVALID_ARG;
@@ -684,6 +705,11 @@ const anvil_arch_info_t *anvil_ctx_get_arch_info(anvil_ctx_t *ctx)
     return &arch_info_table[ctx->arch];
 }
 
+bool anvil_ctx_supports_phi(anvil_ctx_t *ctx)
+{
+    return ctx && ctx->backend && ctx->backend->ops->supports_phi;
+}
+
 const anvil_arch_info_t *anvil_arch_get_info(anvil_arch_t arch)
 {
     if (arch >= ANVIL_ARCH_COUNT) return NULL;
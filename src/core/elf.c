@@ -0,0 +1,674 @@
+/*
+ * ANVIL - ELF Object Writer
+ *
+ * Lays out an anvil_elf_object_t as an ELF64 relocatable object (ET_REL)
+ * that the system linker accepts like the output of `as`. Fields are
+ * written byte by byte in the object's byte order, so the host's own
+ * endianness and struct layout do not matter.
+ *
+ * Sections, in header order: .text, .rela.text, .data, .rela.data,
+ * .rodata, .rela.rodata, .note.GNU-stack (no executable stack), .symtab,
+ * .strtab and .shstrtab. .rodata and the .rela sections appear only
+ * when they have contents.
+ *
+ * Section contents are not copied into an image of the file: the fd
+ * writer hands each buffer to pwrite at its final offset.
+ */
+
+#define _DEFAULT_SOURCE
+#include "anvil/anvil_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#define ET_REL          1
+
+#define SHT_PROGBITS    1
+#define SHT_SYMTAB      2
+#define SHT_STRTAB      3
+#define SHT_RELA        4
+
+#define SHF_WRITE       0x1
+#define SHF_ALLOC       0x2
+#define SHF_EXECINSTR   0x4
+#define SHF_INFO_LINK   0x40
+
+#define STT_SECTION     3
+
+#define EHDR_SIZE       64
+#define SHDR_SIZE       64
+#define SYM_SIZE        24
+#define RELA_SIZE       24
+
+#define MAX_SECTIONS    (1 + 2 * ANVIL_ELF_NUM_SECTIONS + 4)
+
+/* ELF64 targets: machine, byte order, e_flags, 64-bit absolute relocation */
+static const struct {
+    anvil_arch_t arch;
+    uint16_t machine;
+    bool big_endian;
+    uint32_t flags;
+    uint32_t reloc_abs64;
+} targets[] = {
+    { ANVIL_ARCH_X86_64,  62,  false, 0, 1 },      /* EM_X86_64, R_X86_64_64 */
+    { ANVIL_ARCH_ARM64,   183, false, 0, 257 },    /* EM_AARCH64, R_AARCH64_ABS64 */
+    { ANVIL_ARCH_PPC64,   21,  true,  1, 38 },     /* EM_PPC64 ELFv1, R_PPC64_ADDR64 */
+    { ANVIL_ARCH_PPC64LE, 21,  false, 2, 38 },     /* EM_PPC64 ELFv2 */
+};
+
+static const struct {
+    const char *name;
+    const char *rela;
+    uint64_t flags;
+} section_info[ANVIL_ELF_NUM_SECTIONS] = {
+    [ANVIL_ELF_TEXT]   = { ".text",   ".rela.text",   SHF_ALLOC | SHF_EXECINSTR },
+    [ANVIL_ELF_DATA]   = { ".data",   ".rela.data",   SHF_ALLOC | SHF_WRITE },
+    [ANVIL_ELF_RODATA] = { ".rodata", ".rela.rodata", SHF_ALLOC },
+};
+
+/* ============================================================================
+ * Building the object
+ * ============================================================================ */
+
+static bool grow(anvil_elf_object_t *obj, void **arr, size_t *cap, size_t need, size_t elem)
+{
+    if (need <= *cap) return true;
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    while (new_cap < need) new_cap *= 2;
+    void *p = realloc(*arr, new_cap * elem);
+    if (!p) {
+        obj->err = ANVIL_ERR_NOMEM;
+        return false;
+    }
+    *arr = p;
+    *cap = new_cap;
+    return true;
+}
+
+anvil_error_t anvil_elf_init(anvil_elf_object_t *obj, anvil_ctx_t *ctx)
+{
+    if (!obj || !ctx) return ANVIL_ERR_INVALID_ARG;
+    memset(obj, 0, sizeof(*obj));
+    obj->ctx = ctx;
+
+    size_t t = 0;
+    while (t < sizeof(targets) / sizeof(targets[0]) && targets[t].arch != ctx->arch) t++;
+    if (t == sizeof(targets) / sizeof(targets[0]) ||
+        ctx->abi == ANVIL_ABI_DARWIN || ctx->abi == ANVIL_ABI_WIN64) {
+        anvil_set_error(ctx, ANVIL_ERR_CODEGEN, "ELF object output is not available for this target");
+        return ANVIL_ERR_CODEGEN;
+    }
+    obj->machine = targets[t].machine;
+    obj->big_endian = targets[t].big_endian;
+    obj->flags = targets[t].flags;
+    obj->reloc_abs64 = targets[t].reloc_abs64;
+
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) {
+        anvil_strbuf_init(&obj->sec[s]);
+        if (!obj->sec[s].data) obj->err = ANVIL_ERR_NOMEM;
+        obj->align[s] = s == ANVIL_ELF_TEXT ? 16 : 8;
+    }
+    if (obj->err != ANVIL_OK) {
+        anvil_elf_free(obj);
+        return ANVIL_ERR_NOMEM;
+    }
+    return ANVIL_OK;
+}
+
+void anvil_elf_free(anvil_elf_object_t *obj)
+{
+    if (!obj) return;
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) anvil_strbuf_destroy(&obj->sec[s]);
+    for (size_t i = 0; i < obj->num_syms; i++) free(obj->syms[i].name);
+    free(obj->syms);
+    free(obj->sym_table);
+    free(obj->relocs);
+    obj->syms = NULL;
+    obj->sym_table = NULL;
+    obj->relocs = NULL;
+    obj->num_syms = obj->num_relocs = 0;
+}
+
+static uint64_t name_hash(const char *name, size_t len)
+{
+    uint64_t h = 1469598103934665603ull;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static bool sym_table_grow(anvil_elf_object_t *obj)
+{
+    size_t cap = obj->sym_table_cap ? obj->sym_table_cap * 2 : 256;
+    size_t *table = calloc(cap, sizeof(size_t));
+    if (!table) {
+        obj->err = ANVIL_ERR_NOMEM;
+        return false;
+    }
+    for (size_t i = 0; i < obj->num_syms; i++) {
+        const char *name = obj->syms[i].name;
+        size_t slot = name_hash(name, strlen(name)) & (cap - 1);
+        while (table[slot]) slot = (slot + 1) & (cap - 1);
+        table[slot] = i + 1;
+    }
+    free(obj->sym_table);
+    obj->sym_table = table;
+    obj->sym_table_cap = cap;
+    return true;
+}
+
+long anvil_elf_symbol(anvil_elf_object_t *obj, const char *name, size_t len)
+{
+    if (2 * (obj->num_syms + 1) > obj->sym_table_cap && !sym_table_grow(obj)) return 0;
+    size_t mask = obj->sym_table_cap - 1;
+    size_t slot = name_hash(name, len) & mask;
+    while (obj->sym_table[slot]) {
+        size_t i = obj->sym_table[slot] - 1;
+        const char *s = obj->syms[i].name;
+        if (strncmp(s, name, len) == 0 && s[len] == '\0') return (long)i;
+        slot = (slot + 1) & mask;
+    }
+
+    if (!grow(obj, (void **)&obj->syms, &obj->syms_cap, obj->num_syms + 1, sizeof(anvil_elf_symbol_t))) {
+        return 0;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        obj->err = ANVIL_ERR_NOMEM;
+        return 0;
+    }
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+
+    size_t i = obj->num_syms++;
+    anvil_elf_symbol_t *sym = &obj->syms[i];
+    memset(sym, 0, sizeof(*sym));
+    sym->name = copy;
+    sym->section = ANVIL_ELF_UNDEF;
+    sym->bind = ANVIL_ELF_GLOBAL;
+    obj->sym_table[slot] = i + 1;
+    return (long)i;
+}
+
+long anvil_elf_define(anvil_elf_object_t *obj, const char *name, int section,
+                      uint64_t offset, anvil_elf_bind_t bind, anvil_elf_sym_type_t type)
+{
+    long i = anvil_elf_symbol(obj, name, strlen(name));
+    if (obj->err != ANVIL_OK) return 0;
+    anvil_elf_symbol_t *sym = &obj->syms[i];
+    if (sym->section != ANVIL_ELF_UNDEF) return -1;
+    sym->section = section;
+    sym->offset = offset;
+    sym->bind = bind;
+    sym->type = type;
+    return i;
+}
+
+void anvil_elf_add_reloc(anvil_elf_object_t *obj, int section, uint64_t offset,
+                         uint32_t type, long sym, int64_t addend)
+{
+    if (!grow(obj, (void **)&obj->relocs, &obj->relocs_cap, obj->num_relocs + 1,
+              sizeof(anvil_elf_reloc_t))) {
+        return;
+    }
+    obj->relocs[obj->num_relocs++] = (anvil_elf_reloc_t){
+        .section = section, .offset = offset, .type = type, .sym = sym, .addend = addend
+    };
+}
+
+static void put_bytes(anvil_strbuf_t *sb, bool big_endian, uint64_t v, int bytes)
+{
+    char buf[8];
+    for (int i = 0; i < bytes; i++) {
+        int shift = big_endian ? 8 * (bytes - 1 - i) : 8 * i;
+        buf[i] = (char)(v >> shift);
+    }
+    anvil_strbuf_append_n(sb, buf, (size_t)bytes);
+}
+
+void anvil_elf_put(anvil_elf_object_t *obj, int section, uint64_t value, int bytes)
+{
+    put_bytes(&obj->sec[section], obj->big_endian, value, bytes);
+}
+
+void anvil_elf_align(anvil_elf_object_t *obj, int section, size_t align)
+{
+    if (align > obj->align[section]) obj->align[section] = align;
+    while (obj->sec[section].len % align) anvil_strbuf_append_char(&obj->sec[section], '\0');
+}
+
+/* ============================================================================
+ * Global variables
+ * ============================================================================ */
+
+static void put_zeros(anvil_elf_object_t *obj, int section, size_t n)
+{
+    for (size_t i = 0; i < n; i++) anvil_strbuf_append_char(&obj->sec[section], '\0');
+}
+
+/* A pointer-sized field holding the address of a string literal */
+static void put_string_ref(anvil_elf_object_t *obj, const char *str)
+{
+    uint64_t at = obj->sec[ANVIL_ELF_RODATA].len;
+    anvil_strbuf_append_n(&obj->sec[ANVIL_ELF_RODATA], str, strlen(str) + 1);
+    anvil_elf_add_reloc(obj, ANVIL_ELF_DATA, obj->sec[ANVIL_ELF_DATA].len, obj->reloc_abs64,
+                        -1 - ANVIL_ELF_RODATA, (int64_t)at);
+    anvil_elf_put(obj, ANVIL_ELF_DATA, 0, 8);
+}
+
+/* Emit init as a value of type into .data; missing or unsupported
+ * initializers become zeros */
+static void put_value(anvil_elf_object_t *obj, anvil_type_t *type, anvil_value_t *init)
+{
+    size_t size = anvil_type_size(type);
+    size_t start = obj->sec[ANVIL_ELF_DATA].len;
+
+    if (init) {
+        switch (init->kind) {
+            case ANVIL_VAL_CONST_INT:
+                if (size <= 8) anvil_elf_put(obj, ANVIL_ELF_DATA, init->data.u, (int)size);
+                break;
+            case ANVIL_VAL_CONST_FLOAT:
+                if (size == 4) {
+                    float f = (float)init->data.f;
+                    uint32_t bits;
+                    memcpy(&bits, &f, sizeof(bits));
+                    anvil_elf_put(obj, ANVIL_ELF_DATA, bits, 4);
+                } else if (size == 8) {
+                    uint64_t bits;
+                    memcpy(&bits, &init->data.f, sizeof(bits));
+                    anvil_elf_put(obj, ANVIL_ELF_DATA, bits, 8);
+                }
+                break;
+            case ANVIL_VAL_CONST_STRING: {
+                const char *str = init->data.str ? init->data.str : "";
+                if (type->kind == ANVIL_TYPE_ARRAY) {
+                    size_t n = strlen(str) + 1;
+                    anvil_strbuf_append_n(&obj->sec[ANVIL_ELF_DATA], str, n < size ? n : size);
+                } else if (size == 8) {
+                    put_string_ref(obj, str);
+                }
+                break;
+            }
+            case ANVIL_VAL_CONST_ARRAY:
+                if (type->kind == ANVIL_TYPE_ARRAY) {
+                    anvil_type_t *elem = type->data.array.elem;
+                    size_t n = init->data.array.num_elements;
+                    if (n > type->data.array.count) n = type->data.array.count;
+                    for (size_t i = 0; i < n; i++) {
+                        put_value(obj, elem, init->data.array.elements[i]);
+                    }
+                }
+                break;
+            case ANVIL_VAL_GLOBAL:
+            case ANVIL_VAL_FUNC:
+                if (size == 8 && init->name) {
+                    long sym = anvil_elf_symbol(obj, init->name, strlen(init->name));
+                    anvil_elf_add_reloc(obj, ANVIL_ELF_DATA, obj->sec[ANVIL_ELF_DATA].len,
+                                        obj->reloc_abs64, sym, 0);
+                    anvil_elf_put(obj, ANVIL_ELF_DATA, 0, 8);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    size_t written = obj->sec[ANVIL_ELF_DATA].len - start;
+    if (written < size) put_zeros(obj, ANVIL_ELF_DATA, size - written);
+}
+
+anvil_error_t anvil_elf_add_globals(anvil_elf_object_t *obj, anvil_module_t *mod)
+{
+    if (!obj || !mod) return ANVIL_ERR_INVALID_ARG;
+
+    for (anvil_global_t *g = mod->globals; g; g = g->next) {
+        anvil_value_t *val = g->value;
+        anvil_type_t *type = val->type;
+        if (!type || type->kind == ANVIL_TYPE_FUNC || val->data.global.is_extern || !val->name) {
+            continue;
+        }
+
+        size_t align = anvil_type_align(type);
+        anvil_elf_align(obj, ANVIL_ELF_DATA, align ? align : 1);
+        anvil_elf_bind_t bind = ANVIL_ELF_GLOBAL;
+        if (val->data.global.linkage == ANVIL_LINK_INTERNAL) bind = ANVIL_ELF_LOCAL;
+        if (val->data.global.linkage == ANVIL_LINK_WEAK) bind = ANVIL_ELF_WEAK;
+
+        long sym = anvil_elf_define(obj, val->name, ANVIL_ELF_DATA, obj->sec[ANVIL_ELF_DATA].len,
+                                    bind, ANVIL_ELF_OBJECT);
+        if (obj->err != ANVIL_OK) break;
+        if (sym < 0) {
+            anvil_set_error(obj->ctx, ANVIL_ERR_CODEGEN, "Global '%s' is defined twice", val->name);
+            return ANVIL_ERR_CODEGEN;
+        }
+        obj->syms[sym].size = anvil_type_size(type);
+        put_value(obj, type, val->data.global.init);
+    }
+
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) {
+        if (!obj->sec[s].data) obj->err = ANVIL_ERR_NOMEM;
+    }
+    return obj->err;
+}
+
+/* ============================================================================
+ * Layout
+ * ============================================================================ */
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t align;
+    uint64_t entsize;
+    const char *data;       /* Contents, NULL for none */
+} shdr_t;
+
+/* Everything but the section contents the backend produced */
+typedef struct {
+    shdr_t sh[MAX_SECTIONS];
+    int count;
+    anvil_strbuf_t symtab, strtab, shstrtab, rela[ANVIL_ELF_NUM_SECTIONS];
+    anvil_strbuf_t headers;     /* ELF header */
+    anvil_strbuf_t shdrs;       /* Section header table */
+    uint64_t shoff;
+    uint64_t size;
+} layout_t;
+
+/* Local symbols precede globals in .symtab */
+static bool is_local(const anvil_elf_symbol_t *sym)
+{
+    return sym->bind == ANVIL_ELF_LOCAL && sym->section != ANVIL_ELF_UNDEF;
+}
+
+static uint32_t add_name(anvil_strbuf_t *strtab, const char *name)
+{
+    uint32_t off = (uint32_t)strtab->len;
+    anvil_strbuf_append_n(strtab, name, strlen(name) + 1);
+    return off;
+}
+
+static void layout_free(layout_t *l)
+{
+    anvil_strbuf_destroy(&l->symtab);
+    anvil_strbuf_destroy(&l->strtab);
+    anvil_strbuf_destroy(&l->shstrtab);
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) anvil_strbuf_destroy(&l->rela[s]);
+    anvil_strbuf_destroy(&l->headers);
+    anvil_strbuf_destroy(&l->shdrs);
+}
+
+static int add_section(layout_t *l, const char *name, shdr_t sh)
+{
+    sh.name = add_name(&l->shstrtab, name);
+    l->sh[l->count] = sh;
+    return l->count++;
+}
+
+static anvil_error_t layout(const anvil_elf_object_t *obj, layout_t *l)
+{
+    bool be = obj->big_endian;
+    memset(l, 0, sizeof(*l));
+    anvil_strbuf_init(&l->symtab);
+    anvil_strbuf_init(&l->strtab);
+    anvil_strbuf_init(&l->shstrtab);
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) anvil_strbuf_init(&l->rela[s]);
+    anvil_strbuf_init(&l->headers);
+    anvil_strbuf_init(&l->shdrs);
+    if (obj->err != ANVIL_OK) return obj->err;
+
+    /* Section headers. Indices are needed by the symbol table, so the
+     * .rela sections are decided first from the relocation list. */
+    bool has_rela[ANVIL_ELF_NUM_SECTIONS] = {0};
+    bool section_sym[ANVIL_ELF_NUM_SECTIONS] = {0};
+    for (size_t i = 0; i < obj->num_relocs; i++) {
+        has_rela[obj->relocs[i].section] = true;
+        if (obj->relocs[i].sym < 0) section_sym[-1 - obj->relocs[i].sym] = true;
+    }
+
+    int shndx[ANVIL_ELF_NUM_SECTIONS] = {0};
+    int rela_shndx[ANVIL_ELF_NUM_SECTIONS] = {0};
+    anvil_strbuf_append_char(&l->shstrtab, '\0');
+    l->count = 1;
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) {
+        if (s == ANVIL_ELF_RODATA && obj->sec[s].len == 0 && !section_sym[s]) continue;
+        shndx[s] = add_section(l, section_info[s].name, (shdr_t){
+            .type = SHT_PROGBITS, .flags = section_info[s].flags, .align = obj->align[s],
+            .size = obj->sec[s].len, .data = obj->sec[s].data });
+        if (has_rela[s]) {
+            rela_shndx[s] = add_section(l, section_info[s].rela, (shdr_t){
+                .type = SHT_RELA, .flags = SHF_INFO_LINK, .info = (uint32_t)shndx[s],
+                .align = 8, .entsize = RELA_SIZE });
+        }
+    }
+    add_section(l, ".note.GNU-stack", (shdr_t){ .type = SHT_PROGBITS, .align = 1 });
+    int symtab_shndx = add_section(l, ".symtab", (shdr_t){
+        .type = SHT_SYMTAB, .align = 8, .entsize = SYM_SIZE });
+    int strtab_shndx = add_section(l, ".strtab", (shdr_t){ .type = SHT_STRTAB, .align = 1 });
+    int shstrtab_shndx = add_section(l, ".shstrtab", (shdr_t){ .type = SHT_STRTAB, .align = 1 });
+    l->sh[symtab_shndx].link = (uint32_t)strtab_shndx;
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) {
+        if (rela_shndx[s]) l->sh[rela_shndx[s]].link = (uint32_t)symtab_shndx;
+    }
+
+    /* Symbol table: null, section symbols, locals, then globals. Like
+     * GAS, only sections that relocations refer to get a symbol. */
+    uint32_t *sym_index = malloc((obj->num_syms + 1) * sizeof(uint32_t));
+    if (!sym_index) return ANVIL_ERR_NOMEM;
+    anvil_strbuf_append_char(&l->strtab, '\0');
+    uint32_t num_symbols = 0;
+    uint32_t section_index[ANVIL_ELF_NUM_SECTIONS] = {0};
+
+#define PUT_SYM(name, info, shn, value, size) do {      \
+        put_bytes(&l->symtab, be, (name), 4);             \
+        put_bytes(&l->symtab, be, (info), 1);             \
+        put_bytes(&l->symtab, be, 0, 1);                  \
+        put_bytes(&l->symtab, be, (shn), 2);              \
+        put_bytes(&l->symtab, be, (value), 8);            \
+        put_bytes(&l->symtab, be, (size), 8);             \
+        num_symbols++;                                    \
+    } while (0)
+
+    PUT_SYM(0, 0, 0, 0, 0);
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) {
+        if (!section_sym[s]) continue;
+        section_index[s] = num_symbols;
+        PUT_SYM(0, STT_SECTION, (uint64_t)shndx[s], 0, 0);
+    }
+    for (int global = 0; global <= 1; global++) {
+        if (global) l->sh[symtab_shndx].info = num_symbols;     /* First global */
+        for (size_t i = 0; i < obj->num_syms; i++) {
+            const anvil_elf_symbol_t *sym = &obj->syms[i];
+            if (is_local(sym) == (bool)global) continue;
+            anvil_elf_bind_t bind = global && sym->bind == ANVIL_ELF_LOCAL ? ANVIL_ELF_GLOBAL : sym->bind;
+            uint64_t shn = sym->section == ANVIL_ELF_UNDEF ? 0 : (uint64_t)shndx[sym->section];
+            sym_index[i] = num_symbols;
+            PUT_SYM(add_name(&l->strtab, sym->name), (uint64_t)((bind << 4) | sym->type), shn,
+                    sym->offset, sym->size);
+        }
+    }
+#undef PUT_SYM
+
+    for (size_t i = 0; i < obj->num_relocs; i++) {
+        const anvil_elf_reloc_t *rel = &obj->relocs[i];
+        uint32_t sym = rel->sym < 0 ? section_index[-1 - rel->sym] : sym_index[rel->sym];
+        anvil_strbuf_t *rb = &l->rela[rel->section];
+        put_bytes(rb, be, rel->offset, 8);
+        put_bytes(rb, be, ((uint64_t)sym << 32) | rel->type, 8);
+        put_bytes(rb, be, (uint64_t)rel->addend, 8);
+    }
+    free(sym_index);
+
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) {
+        if (!rela_shndx[s]) continue;
+        l->sh[rela_shndx[s]].size = l->rela[s].len;
+        l->sh[rela_shndx[s]].data = l->rela[s].data;
+    }
+    l->sh[symtab_shndx].size = l->symtab.len;
+    l->sh[symtab_shndx].data = l->symtab.data;
+    l->sh[strtab_shndx].size = l->strtab.len;
+    l->sh[strtab_shndx].data = l->strtab.data;
+    l->sh[shstrtab_shndx].size = l->shstrtab.len;
+    l->sh[shstrtab_shndx].data = l->shstrtab.data;
+
+    /* File offsets: contents follow the ELF header, the section header
+     * table comes last */
+    uint64_t off = EHDR_SIZE;
+    for (int i = 1; i < l->count; i++) {
+        uint64_t align = l->sh[i].align ? l->sh[i].align : 1;
+        off = (off + align - 1) / align * align;
+        l->sh[i].offset = off;
+        off += l->sh[i].size;
+    }
+    l->shoff = (off + 7) / 8 * 8;
+    l->size = l->shoff + (uint64_t)l->count * SHDR_SIZE;
+
+    for (int i = 0; i < l->count; i++) {
+        const shdr_t *sh = &l->sh[i];
+        put_bytes(&l->shdrs, be, sh->name, 4);
+        put_bytes(&l->shdrs, be, sh->type, 4);
+        put_bytes(&l->shdrs, be, sh->flags, 8);
+        put_bytes(&l->shdrs, be, 0, 8);             /* sh_addr */
+        put_bytes(&l->shdrs, be, sh->offset, 8);
+        put_bytes(&l->shdrs, be, sh->size, 8);
+        put_bytes(&l->shdrs, be, sh->link, 4);
+        put_bytes(&l->shdrs, be, sh->info, 4);
+        put_bytes(&l->shdrs, be, sh->align, 8);
+        put_bytes(&l->shdrs, be, sh->entsize, 8);
+    }
+
+    anvil_strbuf_t *hdr = &l->headers;
+    anvil_strbuf_append_n(hdr, "\177ELF", 4);
+    put_bytes(hdr, be, 2, 1);                       /* ELFCLASS64 */
+    put_bytes(hdr, be, be ? 2 : 1, 1);              /* ELFDATA2MSB / ELFDATA2LSB */
+    put_bytes(hdr, be, 1, 1);                       /* EV_CURRENT */
+    put_bytes(hdr, be, 0, 1);                       /* ELFOSABI_NONE */
+    put_bytes(hdr, be, 0, 8);                       /* ABI version, padding */
+    put_bytes(hdr, be, ET_REL, 2);
+    put_bytes(hdr, be, obj->machine, 2);
+    put_bytes(hdr, be, 1, 4);                       /* e_version */
+    put_bytes(hdr, be, 0, 8);                       /* e_entry */
+    put_bytes(hdr, be, 0, 8);                       /* e_phoff */
+    put_bytes(hdr, be, l->shoff, 8);
+    put_bytes(hdr, be, obj->flags, 4);
+    put_bytes(hdr, be, EHDR_SIZE, 2);
+    put_bytes(hdr, be, 0, 2);                       /* e_phentsize */
+    put_bytes(hdr, be, 0, 2);                       /* e_phnum */
+    put_bytes(hdr, be, SHDR_SIZE, 2);
+    put_bytes(hdr, be, (uint64_t)l->count, 2);
+    put_bytes(hdr, be, (uint64_t)shstrtab_shndx, 2);
+
+    bool ok = l->symtab.data && l->strtab.data && l->shstrtab.data && l->headers.data &&
+              l->shdrs.data && l->headers.len == EHDR_SIZE &&
+              l->shdrs.len == (size_t)l->count * SHDR_SIZE;
+    for (int s = 0; s < ANVIL_ELF_NUM_SECTIONS; s++) ok = ok && l->rela[s].data;
+    return ok ? ANVIL_OK : ANVIL_ERR_NOMEM;
+}
+
+/* ============================================================================
+ * Output
+ * ============================================================================ */
+
+anvil_error_t anvil_elf_write(const anvil_elf_object_t *obj, char **output, size_t *len)
+{
+    if (!obj || !output) return ANVIL_ERR_INVALID_ARG;
+
+    layout_t l;
+    anvil_error_t err = layout(obj, &l);
+    char *buf = err == ANVIL_OK ? calloc(1, l.size) : NULL;
+    if (err == ANVIL_OK && !buf) err = ANVIL_ERR_NOMEM;
+    if (err == ANVIL_OK) {
+        memcpy(buf, l.headers.data, EHDR_SIZE);
+        for (int i = 1; i < l.count; i++) {
+            if (l.sh[i].size) memcpy(buf + l.sh[i].offset, l.sh[i].data, l.sh[i].size);
+        }
+        memcpy(buf + l.shoff, l.shdrs.data, l.shdrs.len);
+        *output = buf;
+        if (len) *len = l.size;
+    }
+    layout_free(&l);
+    return err;
+}
+
+#ifndef _WIN32
+static bool pwrite_all(int fd, const char *data, size_t len, uint64_t off)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, (off_t)off);
+        if (n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+        off += (uint64_t)n;
+    }
+    return true;
+}
+#endif
+
+#ifndef _WIN32
+/* Gaps between sections are left as holes, which read as zeros when the
+ * object is written at the end of the file */
+static anvil_error_t write_fd(const anvil_elf_object_t *obj, int fd, uint64_t base, uint64_t *size)
+{
+    layout_t l;
+    anvil_error_t err = layout(obj, &l);
+    if (err == ANVIL_OK) {
+        bool ok = pwrite_all(fd, l.headers.data, EHDR_SIZE, base);
+        for (int i = 1; ok && i < l.count; i++) {
+            ok = pwrite_all(fd, l.sh[i].data, l.sh[i].size, base + l.sh[i].offset);
+        }
+        ok = ok && pwrite_all(fd, l.shdrs.data, l.shdrs.len, base + l.shoff);
+        if (!ok) err = ANVIL_ERR_IO;
+        if (size) *size = l.size;
+    }
+    layout_free(&l);
+    return err;
+}
+#endif
+
+anvil_error_t anvil_elf_write_fd(const anvil_elf_object_t *obj, int fd, uint64_t base)
+{
+    if (!obj || fd < 0) return ANVIL_ERR_INVALID_ARG;
+#ifdef _WIN32
+    (void)base;
+    return ANVIL_ERR_IO;
+#else
+    return write_fd(obj, fd, base, NULL);
+#endif
+}
+
+anvil_error_t anvil_elf_write_file(const anvil_elf_object_t *obj, FILE *file)
+{
+    if (!obj || !file) return ANVIL_ERR_INVALID_ARG;
+    if (fflush(file) != 0) return ANVIL_ERR_IO;
+
+#ifndef _WIN32
+    /* Pipes and terminals cannot be written at an offset, and writing in
+     * the middle of a file would leave its old bytes in the gaps */
+    int fd = fileno(file);
+    off_t pos = fd >= 0 ? lseek(fd, 0, SEEK_CUR) : -1;
+    if (pos >= 0 && lseek(fd, 0, SEEK_END) == pos) {
+        uint64_t size = 0;
+        anvil_error_t err = write_fd(obj, fd, (uint64_t)pos, &size);
+        if (err != ANVIL_OK) return err;
+        /* Leave the stream after the object, like fwrite would */
+        return fseek(file, (long)(pos + (off_t)size), SEEK_SET) == 0 ? ANVIL_OK : ANVIL_ERR_IO;
+    }
+#endif
+
+    char *buf = NULL;
+    size_t len = 0;
+    anvil_error_t err = anvil_elf_write(obj, &buf, &len);
+    if (err == ANVIL_OK && fwrite(buf, 1, len, file) != len) err = ANVIL_ERR_IO;
+    free(buf);
+    return err;
+}
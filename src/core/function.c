@@ -12,10 +12,10 @@ anvil_func_t *anvil_func_create(anvil_module_t *mod, const char *name,
     if (!mod || !name || !type) return NULL;
     if (type->kind != ANVIL_TYPE_FUNC) return NULL;
     
-    anvil_func_t *func = calloc(1, sizeof(anvil_func_t));
+    anvil_func_t *func = anvil_pool_alloc(&mod->pool, sizeof(anvil_func_t));
     if (!func) return NULL;
     
-    func->name = strdup(name);
+    func->name = anvil_pool_strdup(&mod->pool, name);
     func->type = type;
     func->linkage = linkage;
     func->cc = ANVIL_CC_DEFAULT;
@@ -28,30 +28,16 @@ anvil_func_t *anvil_func_create(anvil_module_t *mod, const char *name,
     func->num_params = num_params;
     
     if (num_params > 0) {
-        func->params = calloc(num_params, sizeof(anvil_value_t *));
-        if (!func->params) {
-            free(func->name);
-            free(func);
-            return NULL;
-        }
+        func->params = anvil_pool_alloc(&mod->pool, num_params * sizeof(anvil_value_t *));
+        if (!func->params) return NULL;
         
         for (size_t i = 0; i < num_params; i++) {
             char param_name[32];
             snprintf(param_name, sizeof(param_name), "arg%zu", i);
             
-            anvil_value_t *param = anvil_value_create(mod->ctx, ANVIL_VAL_PARAM,
+            anvil_value_t *param = anvil_value_create(mod->ctx, &mod->pool, ANVIL_VAL_PARAM,
                                                        type->data.func.params[i], param_name);
-            if (!param) {
-                /* Cleanup on failure */
-                for (size_t j = 0; j < i; j++) {
-                    free(func->params[j]->name);
-                    free(func->params[j]);
-                }
-                free(func->params);
-                free(func->name);
-                free(func);
-                return NULL;
-            }
+            if (!param) return NULL;
             
             param->data.param.index = i;
             param->data.param.func = func;
@@ -63,7 +49,7 @@ anvil_func_t *anvil_func_create(anvil_module_t *mod, const char *name,
     func->entry = anvil_block_create(func, "entry");
     
     /* Create value for function (for use in calls) */
-    func->value = anvil_value_create(mod->ctx, ANVIL_VAL_FUNC, type, name);
+    func->value = anvil_value_create(mod->ctx, &mod->pool, ANVIL_VAL_FUNC, type, name);
     if (func->value) {
         func->value->data.func = func;
     }
@@ -82,10 +68,10 @@ anvil_func_t *anvil_func_declare(anvil_module_t *mod, const char *name,
     if (!mod || !name || !type) return NULL;
     if (type->kind != ANVIL_TYPE_FUNC) return NULL;
     
-    anvil_func_t *func = calloc(1, sizeof(anvil_func_t));
+    anvil_func_t *func = anvil_pool_alloc(&mod->pool, sizeof(anvil_func_t));
     if (!func) return NULL;
     
-    func->name = strdup(name);
+    func->name = anvil_pool_strdup(&mod->pool, name);
     func->type = type;
     func->linkage = ANVIL_LINK_EXTERNAL;
     func->cc = ANVIL_CC_DEFAULT;
@@ -100,7 +86,7 @@ anvil_func_t *anvil_func_declare(anvil_module_t *mod, const char *name,
     func->blocks = NULL;
     
     /* Create value for function (for use in calls) */
-    func->value = anvil_value_create(mod->ctx, ANVIL_VAL_FUNC, type, name);
+    func->value = anvil_value_create(mod->ctx, &mod->pool, ANVIL_VAL_FUNC, type, name);
     if (func->value) {
         func->value->data.func = func;
     }
@@ -138,12 +124,13 @@ anvil_block_t *anvil_block_create(anvil_func_t *func, const char *name)
 {
     if (!func) return NULL;
     
-    anvil_block_t *block = calloc(1, sizeof(anvil_block_t));
+    anvil_pool_t *pool = &func->parent->pool;
+    anvil_block_t *block = anvil_pool_alloc(pool, sizeof(anvil_block_t));
     if (!block) return NULL;
     
-    block->name = name ? strdup(name) : NULL;
+    block->name = anvil_pool_strdup(pool, name);
     block->parent = func;
-    block->id = func->parent->ctx->next_block_id++;
+    block->id = anvil_new_block_id(func->parent->ctx);
     
     /* Add to function's block list */
     if (!func->blocks) {
@@ -154,6 +141,9 @@ anvil_block_t *anvil_block_create(anvil_func_t *func, const char *name)
         last->next = block;
     }
     func->num_blocks++;
+    block->order = ++func->last_order;
+    anvil_block_mark_changed(block);
+    anvil_func_invalidate_cfg(func);
     
     return block;
 }
@@ -170,3 +160,361 @@ bool anvil_block_has_terminator(anvil_block_t *block)
     anvil_op_t op = block->last->op;
     return op == ANVIL_OP_RET || op == ANVIL_OP_BR || op == ANVIL_OP_BR_COND;
 }
+
+/* ============================================================================
+ * Change tracking
+ *
+ * An edit records the function's current change stamp on the block it
+ * touches. The pass manager moves the stamp on before each pass, so a
+ * block whose stamp is older than a pass's last run has not changed
+ * since, and passes that only look inside one block can skip it.
+ *
+ * To skip it without looking at it, the pass manager has the function
+ * log each block the first time it is marked at a stamp, and remembers
+ * where the log stood when each pass started. A block-local pass then
+ * walks a worklist built from the log entries since its last start,
+ * sorted by each block's order in the block list; blocks it marks
+ * itself join the worklist, so it visits just the blocks a walk over
+ * every block would have found changed. A worklist covering a good part
+ * of the function is not worth sorting: the pass walks the block list
+ * and skips by stamp instead.
+ * ============================================================================ */
+
+static bool worklist_reserve(anvil_block_t ***list, size_t *cap, size_t count)
+{
+    if (count <= *cap) return true;
+    size_t new_cap = *cap ? *cap * 2 : 64;
+    if (new_cap < count) new_cap = count;
+    anvil_block_t **grown = realloc(*list, new_cap * sizeof(anvil_block_t *));
+    if (!grown) return false;
+    *list = grown;
+    *cap = new_cap;
+    return true;
+}
+
+/* Index of the first worklist block after order */
+static size_t worklist_upper(const anvil_func_t *func, uint32_t order)
+{
+    size_t lo = 0, hi = func->num_worklist;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (func->worklist[mid]->order <= order) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void worklist_insert(anvil_func_t *func, anvil_block_t *block)
+{
+    if (block->order == 0) return;  /* Unlinked */
+    if (func->num_worklist >= func->num_blocks / 2 ||
+        !worklist_reserve(&func->worklist, &func->cap_worklist, func->num_worklist + 1)) {
+        func->worklist_state = ANVIL_WORKLIST_WALK;
+        return;
+    }
+    size_t at = worklist_upper(func, block->order);
+    memmove(&func->worklist[at + 1], &func->worklist[at],
+            (func->num_worklist - at) * sizeof(anvil_block_t *));
+    func->worklist[at] = block;
+    func->num_worklist++;
+    block->worklist_stamp = func->change_stamp;
+}
+
+void anvil_block_mark_changed(anvil_block_t *block)
+{
+    if (!block || !block->parent) return;
+    anvil_func_t *func = block->parent;
+    uint32_t stamp = func->change_stamp;
+    if (block->changed_at == stamp) return;
+    
+    /* Not due for a visit before: the running pass has to see it now */
+    if (func->worklist_state == ANVIL_WORKLIST_LIST && block->changed_at < func->visit_since &&
+        block->worklist_stamp != stamp) {
+        worklist_insert(func, block);
+    }
+    block->changed_at = stamp;
+    func->last_change = stamp;
+    if (func->log_changes) {
+        if (worklist_reserve(&func->change_log, &func->cap_change_log, func->num_change_log + 1)) {
+            func->change_log[func->num_change_log++] = block;
+        } else {
+            func->log_changes = false;  /* Passes fall back to walking */
+        }
+    }
+}
+
+void anvil_func_mark_changed(anvil_func_t *func)
+{
+    if (!func) return;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        anvil_block_mark_changed(block);
+    }
+}
+
+static void renumber_blocks(anvil_func_t *func)
+{
+    uint32_t order = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        block->order = ++order;
+    }
+    func->last_order = order;
+    func->order_stale = false;
+}
+
+static int cmp_block_order(const void *a, const void *b)
+{
+    uint32_t x = (*(anvil_block_t *const *)a)->order;
+    uint32_t y = (*(anvil_block_t *const *)b)->order;
+    return x < y ? -1 : x > y;
+}
+
+static void worklist_build(anvil_func_t *func)
+{
+    func->worklist_state = ANVIL_WORKLIST_WALK;
+    func->num_worklist = 0;
+    if (!func->log_changes) return;
+    if (func->order_stale) renumber_blocks(func);
+    
+    size_t limit = func->num_blocks / 4;
+    for (size_t i = func->visit_log; i < func->num_change_log; i++) {
+        anvil_block_t *block = func->change_log[i];
+        if (block->order == 0 || block->worklist_stamp == func->change_stamp) continue;
+        if (func->num_worklist >= limit ||
+            !worklist_reserve(&func->worklist, &func->cap_worklist, func->num_worklist + 1))
+            return;
+        block->worklist_stamp = func->change_stamp;
+        func->worklist[func->num_worklist++] = block;
+    }
+    qsort(func->worklist, func->num_worklist, sizeof(anvil_block_t *), cmp_block_order);
+    func->worklist_state = ANVIL_WORKLIST_LIST;
+}
+
+static anvil_block_t *walk_from(anvil_block_t *block)
+{
+    while (block && !anvil_block_needs_visit(block)) block = block->next;
+    return block;
+}
+
+anvil_block_t *anvil_func_changed_first(anvil_func_t *func)
+{
+    if (!func) return NULL;
+    if (!func->visit_since) return func->blocks;
+    if (func->worklist_state == ANVIL_WORKLIST_NONE) worklist_build(func);
+    if (func->worklist_state == ANVIL_WORKLIST_WALK) return walk_from(func->blocks);
+    return func->num_worklist ? func->worklist[0] : NULL;
+}
+
+anvil_block_t *anvil_func_changed_next(anvil_block_t *block)
+{
+    if (!block) return NULL;
+    anvil_func_t *func = block->parent;
+    if (!func->visit_since) return block->next;
+    if (func->worklist_state == ANVIL_WORKLIST_WALK) return walk_from(block->next);
+    size_t at = worklist_upper(func, block->order);
+    return at < func->num_worklist ? func->worklist[at] : NULL;
+}
+
+void anvil_block_unlink(anvil_block_t *block)
+{
+    if (!block || !block->parent) return;
+    anvil_func_t *func = block->parent;
+    for (anvil_block_t **pp = &func->blocks; *pp; pp = &(*pp)->next) {
+        if (*pp != block) continue;
+        *pp = block->next;
+        func->num_blocks--;
+        block->order = 0;
+        return;
+    }
+}
+
+void anvil_block_move_before(anvil_block_t *block, anvil_block_t *pos)
+{
+    if (!block || !block->parent || block == pos) return;
+    anvil_func_t *func = block->parent;
+    anvil_block_t **pp = &func->blocks;
+    while (*pp && *pp != block) pp = &(*pp)->next;
+    if (!*pp) return;
+    *pp = block->next;
+    
+    pp = &func->blocks;
+    while (*pp && *pp != pos) pp = &(*pp)->next;
+    block->next = *pp;
+    *pp = block;
+    func->order_stale = true;
+}
+
+/* ============================================================================
+ * CFG edges
+ *
+ * Every block lists the blocks its last instruction branches to and the
+ * blocks whose last instruction branches to it, so predecessor and
+ * successor queries cost O(degree). The arrays live in the module arena
+ * and grow by doubling; removal keeps the order of the other entries.
+ * ============================================================================ */
+
+static bool edge_push(anvil_block_t *owner, anvil_block_t ***list, size_t *count,
+                      size_t *cap, anvil_block_t *block)
+{
+    if (*count == *cap) {
+        anvil_pool_t *pool = &owner->parent->parent->pool;
+        size_t new_cap = *cap ? *cap * 2 : 2;
+        anvil_block_t **grown = anvil_pool_realloc(pool, *list, *cap * sizeof(anvil_block_t *),
+                                                   new_cap * sizeof(anvil_block_t *));
+        if (!grown) return false;
+        *list = grown;
+        *cap = new_cap;
+    }
+    (*list)[(*count)++] = block;
+    return true;
+}
+
+/* Drop the last occurrence of block, so an edge added twice goes in LIFO order */
+static void edge_erase(anvil_block_t **list, size_t *count, const anvil_block_t *block)
+{
+    for (size_t i = *count; i-- > 0;) {
+        if (list[i] != block) continue;
+        memmove(&list[i], &list[i + 1], (*count - i - 1) * sizeof(anvil_block_t *));
+        (*count)--;
+        return;
+    }
+}
+
+void anvil_block_add_edge(anvil_block_t *from, anvil_block_t *to)
+{
+    if (!from || !to || !from->parent || !to->parent) return;
+    if (!edge_push(from, &from->succs, &from->num_succs, &from->cap_succs, to)) return;
+    if (!edge_push(to, &to->preds, &to->num_preds, &to->cap_preds, from)) from->num_succs--;
+}
+
+void anvil_block_remove_edge(anvil_block_t *from, anvil_block_t *to)
+{
+    if (!from || !to) return;
+    edge_erase(from->succs, &from->num_succs, to);
+    edge_erase(to->preds, &to->num_preds, from);
+}
+
+void anvil_block_clear_succs(anvil_block_t *block)
+{
+    if (!block) return;
+    while (block->num_succs > 0) {
+        anvil_block_remove_edge(block, block->succs[block->num_succs - 1]);
+    }
+}
+
+void anvil_block_update_succs(anvil_block_t *block)
+{
+    if (!block) return;
+    anvil_block_clear_succs(block);
+    
+    const anvil_instr_t *term = block->last;
+    if (!term) return;
+    if (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND) {
+        anvil_block_add_edge(block, term->true_block);
+    }
+    if (term->op == ANVIL_OP_BR_COND) {
+        anvil_block_add_edge(block, term->false_block);
+    }
+}
+
+void anvil_func_update_cfg(anvil_func_t *func)
+{
+    if (!func) return;
+    
+    /* Start from empty lists: blocks may have been dropped as well */
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        block->num_preds = 0;
+        block->num_succs = 0;
+    }
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        anvil_block_update_succs(block);
+    }
+    anvil_func_invalidate_cfg(func);
+}
+
+/* Occurrences of block in an edge list */
+static size_t edge_count(anvil_block_t *const *list, size_t count, const anvil_block_t *block)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (list[i] == block) n++;
+    }
+    return n;
+}
+
+bool anvil_func_verify_cfg(const anvil_func_t *func)
+{
+    if (!func) return true;
+    
+    size_t num_edges = 0;
+    size_t num_preds = 0;
+    for (const anvil_block_t *block = func->blocks; block; block = block->next) {
+        /* The successors the terminator names, as anvil_block_update_succs lists them */
+        anvil_block_t *want[2];
+        size_t n = 0;
+        const anvil_instr_t *term = block->last;
+        if (term && (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND) && term->true_block)
+            want[n++] = term->true_block;
+        if (term && term->op == ANVIL_OP_BR_COND && term->false_block)
+            want[n++] = term->false_block;
+        
+        if (block->num_succs != n) return false;
+        for (size_t i = 0; i < n; i++) {
+            size_t k = edge_count(want, n, want[i]);
+            if (want[i]->parent != func) return false;
+            if (edge_count(block->succs, block->num_succs, want[i]) != k) return false;
+            if (edge_count(want[i]->preds, want[i]->num_preds, block) != k) return false;
+        }
+        num_edges += n;
+        num_preds += block->num_preds;
+    }
+    
+    /* Each edge has its entry in the target's preds; anything more is stale */
+    return num_preds == num_edges;
+}
+
+/* ============================================================================
+ * Cached CFG analyses
+ *
+ * opt/dom.c and opt/loops.c compute the dominator tree and the loop nest
+ * and cache them on the function. Dropping them belongs here, with the
+ * block and branch edits that make them stale.
+ * ============================================================================ */
+
+void anvil_domtree_free(anvil_domtree_t *dt)
+{
+    free(dt->blocks);
+    free(dt->block_num);
+    free(dt->preds);
+    free(dt->pred_start);
+    free(dt->idom);
+    free(dt->child_start);
+    free(dt->children);
+    free(dt->pre);
+    free(dt->last);
+    free(dt->df_start);
+    free(dt->df);
+    memset(dt, 0, sizeof(*dt));
+}
+
+void anvil_loops_free(anvil_loop_info_t *li)
+{
+    free(li->loops);
+    free(li->block_loop);
+    free(li->storage);
+    memset(li, 0, sizeof(*li));
+}
+
+void anvil_func_invalidate_cfg(anvil_func_t *func)
+{
+    if (!func) return;
+    if (func->loops) {
+        anvil_loops_free(func->loops);
+        free(func->loops);
+        func->loops = NULL;
+    }
+    if (func->domtree) {
+        anvil_domtree_free(func->domtree);
+        free(func->domtree);
+        func->domtree = NULL;
+    }
+}
@@ -5,6 +5,9 @@
  * Outputs human-readable representation of modules, functions, blocks, and instructions.
  */
 
+/* open_memstream() is POSIX.1-2008, not part of plain C11 */
+#define _POSIX_C_SOURCE 200809L
+
 #include "anvil/anvil_internal.h"
 #include <stdio.h>
 #include <string.h>
@@ -491,6 +494,33 @@ void anvil_dump_module(FILE *out, anvil_module_t *mod)
     }
 }
 
+/* Print frame sizes recorded by the last codegen of the module */
+void anvil_dump_frame_sizes(FILE *out, anvil_module_t *mod)
+{
+    if (!mod) {
+        fprintf(out, "; (null module)\n");
+        return;
+    }
+    
+    fprintf(out, "; Frame sizes for '%s'\n", mod->name ? mod->name : "?");
+    fprintf(out, "; %-24s %8s %8s %8s\n", "function", "frame", "slots", "shared");
+    
+    size_t frame = 0, slots = 0, colored = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        if (func->is_declaration) continue;
+        fprintf(out, "; %-24s %8zu %8zu %8zu\n", func->name ? func->name : "?",
+                func->stack_size, func->slot_bytes, func->slot_bytes_colored);
+        frame += func->stack_size;
+        slots += func->slot_bytes;
+        colored += func->slot_bytes_colored;
+    }
+    fprintf(out, "; %-24s %8zu %8zu %8zu", "total", frame, slots, colored);
+    if (slots > 0) {
+        fprintf(out, "  (%.1f%% of slot bytes saved)", 100.0 * (double)(slots - colored) / (double)slots);
+    }
+    fprintf(out, "\n");
+}
+
 /* Print module to stdout */
 void anvil_print_module(anvil_module_t *mod)
 {
@@ -0,0 +1,522 @@
+/*
+ * ANVIL - In-Memory JIT
+ *
+ * anvil_module_jit() asks the backend for a relocatable object
+ * (ANVIL_OUTPUT_BINARY) and links it straight into executable memory:
+ * sections are laid out in one mapping, undefined symbols come from the
+ * caller's resolver and relocations are applied in place. No assembler,
+ * linker or dlopen is involved.
+ *
+ * Layout of the mapping (code and data on separate pages, W^X):
+ *
+ *   [executable sections][call stubs] | [data sections]
+ *        read + execute                   read + write
+ *
+ * Calls to externs beyond rel32 range go through a stub
+ * (jmp *addr(%rip)) placed next to the code. Other references must reach
+ * their target directly: absolute 32-bit references put the mapping in
+ * the low 2GB, and %rip-relative references to externs put it near them
+ * when the address space allows.
+ */
+
+#define _DEFAULT_SOURCE
+#include "anvil/anvil_internal.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_HOST_ARCH   ANVIL_ARCH_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+struct anvil_jit {
+    char *mem;
+    size_t size;
+    char **names;               /* Global symbols defined by the module */
+    void **addrs;
+    size_t num_syms;
+};
+
+#ifdef JIT_HOST_ARCH
+
+#define EM_X86_64       62
+#define ET_REL          1
+#define SHT_SYMTAB      2
+#define SHT_RELA        4
+#define SHT_NOBITS      8
+#define SHF_ALLOC       0x2
+#define SHF_EXECINSTR   0x4
+#define SHN_UNDEF       0
+#define SHN_ABS         0xfff1
+#define SHN_LORESERVE   0xff00
+#define STB_LOCAL       0
+
+#define R_X86_64_64     1
+#define R_X86_64_PC32   2
+#define R_X86_64_PLT32  4
+#define R_X86_64_32     10
+#define R_X86_64_32S    11
+
+#define STUB_SIZE       16      /* jmp *0(%rip); .quad target; int3; int3 */
+#define NEAR_STEP       ((uint64_t)64 << 20)
+
+typedef struct {
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t align;
+    size_t addr;                /* Offset in the mapping, or SIZE_MAX */
+} jit_section_t;
+
+typedef struct {
+    uint32_t name;
+    uint8_t info;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t addr;              /* Resolved address */
+    long stub;                  /* Stub index, or -1 */
+} jit_symbol_t;
+
+typedef struct {
+    size_t section;             /* Section being patched */
+    uint64_t offset;
+    uint32_t type;
+    jit_symbol_t *sym;
+    int64_t addend;
+} jit_reloc_t;
+
+typedef struct {
+    anvil_ctx_t *ctx;
+    const unsigned char *obj;
+    size_t len;
+    jit_section_t *secs;
+    size_t num_secs;
+    jit_symbol_t *syms;
+    size_t num_syms;
+    const char *strtab;
+    size_t strtab_len;
+    char *mem;
+    size_t size;
+    size_t code_end;            /* Start of the data pages */
+    size_t stubs;               /* Offset of the stub area */
+    size_t num_stubs;           /* Stubs reserved (one per extern) */
+    size_t used_stubs;
+} jit_loader_t;
+
+/* Where the mapping has to go */
+typedef struct {
+    bool low;                   /* Absolute 32-bit references */
+    uint64_t near_lo, near_hi;  /* Externs referenced %rip-relative */
+} jit_placement_t;
+
+static uint64_t rd(const unsigned char *p, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static size_t align_up(size_t v, size_t align)
+{
+    return align > 1 ? (v + align - 1) / align * align : v;
+}
+
+static bool fits_i32(int64_t v)
+{
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static anvil_error_t bad_object(jit_loader_t *ld, const char *what)
+{
+    anvil_set_error(ld->ctx, ANVIL_ERR_CODEGEN, "JIT: malformed object (%s)", what);
+    return ANVIL_ERR_CODEGEN;
+}
+
+static const char *sym_name(const jit_loader_t *ld, const jit_symbol_t *sym)
+{
+    return sym->name < ld->strtab_len ? ld->strtab + sym->name : "?";
+}
+
+static anvil_error_t read_sections(jit_loader_t *ld)
+{
+    const unsigned char *h = ld->obj;
+    if (ld->len < 64 || memcmp(h, "\177ELF", 4) != 0 || h[4] != 2 || h[5] != 1) {
+        return bad_object(ld, "not an ELF64 little-endian file");
+    }
+    if (rd(h + 16, 2) != ET_REL || rd(h + 18, 2) != EM_X86_64) {
+        return bad_object(ld, "not an x86-64 relocatable object");
+    }
+    uint64_t shoff = rd(h + 40, 8);
+    ld->num_secs = (size_t)rd(h + 60, 2);
+    if (rd(h + 58, 2) != 64 || shoff > ld->len || ld->num_secs > (ld->len - shoff) / 64) {
+        return bad_object(ld, "section headers");
+    }
+
+    ld->secs = calloc(ld->num_secs ? ld->num_secs : 1, sizeof(jit_section_t));
+    if (!ld->secs) return ANVIL_ERR_NOMEM;
+    for (size_t i = 0; i < ld->num_secs; i++) {
+        const unsigned char *sh = h + shoff + i * 64;
+        jit_section_t *s = &ld->secs[i];
+        s->type = (uint32_t)rd(sh + 4, 4);
+        s->flags = rd(sh + 8, 8);
+        s->offset = rd(sh + 24, 8);
+        s->size = rd(sh + 32, 8);
+        s->link = (uint32_t)rd(sh + 40, 4);
+        s->info = (uint32_t)rd(sh + 44, 4);
+        s->align = rd(sh + 48, 8);
+        s->addr = SIZE_MAX;
+        if (s->type != SHT_NOBITS && (s->offset > ld->len || s->size > ld->len - s->offset)) {
+            return bad_object(ld, "section contents");
+        }
+    }
+    return ANVIL_OK;
+}
+
+/* Reads the symbol table and resolves undefined symbols */
+static anvil_error_t read_symbols(jit_loader_t *ld, anvil_resolve_fn resolve, void *user)
+{
+    const jit_section_t *symtab = NULL;
+    for (size_t i = 0; i < ld->num_secs; i++) {
+        if (ld->secs[i].type == SHT_SYMTAB) symtab = &ld->secs[i];
+    }
+    if (!symtab) return ANVIL_OK;
+    if (symtab->link >= ld->num_secs) return bad_object(ld, "string table");
+    const jit_section_t *strtab = &ld->secs[symtab->link];
+    ld->strtab = (const char *)ld->obj + strtab->offset;
+    ld->strtab_len = (size_t)strtab->size;
+    if (ld->strtab_len == 0 || ld->strtab[ld->strtab_len - 1] != '\0') {
+        return bad_object(ld, "string table");
+    }
+
+    ld->num_syms = (size_t)(symtab->size / 24);
+    ld->syms = calloc(ld->num_syms ? ld->num_syms : 1, sizeof(jit_symbol_t));
+    if (!ld->syms) return ANVIL_ERR_NOMEM;
+    for (size_t i = 0; i < ld->num_syms; i++) {
+        const unsigned char *p = ld->obj + symtab->offset + i * 24;
+        jit_symbol_t *sym = &ld->syms[i];
+        sym->name = (uint32_t)rd(p, 4);
+        sym->info = p[4];
+        sym->shndx = (uint16_t)rd(p + 6, 2);
+        sym->value = rd(p + 8, 8);
+        sym->stub = -1;
+        if (sym->shndx != SHN_UNDEF && sym->shndx < SHN_LORESERVE && sym->shndx >= ld->num_secs) {
+            return bad_object(ld, "symbol section");
+        }
+        if (i == 0 || sym->shndx != SHN_UNDEF) continue;
+
+        const char *name = sym_name(ld, sym);
+        void *addr = resolve ? resolve(user, name) : NULL;
+        if (!addr) {
+            anvil_set_error(ld->ctx, ANVIL_ERR_CODEGEN, "JIT: unresolved symbol '%s'", name);
+            return ANVIL_ERR_CODEGEN;
+        }
+        sym->addr = (uint64_t)(uintptr_t)addr;
+        ld->num_stubs++;
+    }
+    return ANVIL_OK;
+}
+
+/* Calls fn for every relocation that patches a loaded section */
+typedef anvil_error_t (*jit_reloc_fn)(jit_loader_t *ld, const jit_reloc_t *rel, void *arg);
+
+static anvil_error_t for_each_reloc(jit_loader_t *ld, jit_reloc_fn fn, void *arg)
+{
+    for (size_t i = 0; i < ld->num_secs; i++) {
+        const jit_section_t *rela = &ld->secs[i];
+        if (rela->type != SHT_RELA) continue;
+        if (rela->info >= ld->num_secs) return bad_object(ld, "relocation section");
+        const jit_section_t *target = &ld->secs[rela->info];
+        if (!(target->flags & SHF_ALLOC)) continue;
+
+        for (uint64_t off = 0; off + 24 <= rela->size; off += 24) {
+            const unsigned char *p = ld->obj + rela->offset + off;
+            uint64_t info = rd(p + 8, 8);
+            jit_reloc_t rel = {
+                .section = rela->info,
+                .offset = rd(p, 8),
+                .type = (uint32_t)info,
+                .addend = (int64_t)rd(p + 16, 8),
+            };
+            uint64_t idx = info >> 32;
+            int width = rel.type == R_X86_64_64 ? 8 : 4;
+            if (idx == 0 || idx >= ld->num_syms || rel.offset > target->size ||
+                target->size - rel.offset < (uint64_t)width) {
+                return bad_object(ld, "relocation entry");
+            }
+            rel.sym = &ld->syms[idx];
+            anvil_error_t err = fn(ld, &rel, arg);
+            if (err != ANVIL_OK) return err;
+        }
+    }
+    return ANVIL_OK;
+}
+
+static anvil_error_t scan_reloc(jit_loader_t *ld, const jit_reloc_t *rel, void *arg)
+{
+    (void)ld;
+    jit_placement_t *pl = arg;
+    if (rel->type == R_X86_64_32 || rel->type == R_X86_64_32S) {
+        pl->low = true;
+    } else if (rel->type == R_X86_64_PC32 && rel->sym->shndx == SHN_UNDEF) {
+        if (rel->sym->addr < pl->near_lo) pl->near_lo = rel->sym->addr;
+        if (rel->sym->addr > pl->near_hi) pl->near_hi = rel->sym->addr;
+    }
+    return ANVIL_OK;
+}
+
+/* Assigns each allocated section its offset in the mapping: executable
+ * sections and the stubs first, then the data pages */
+static anvil_error_t layout(jit_loader_t *ld, size_t page)
+{
+    size_t pos = 0;
+    for (int exec = 1; exec >= 0; exec--) {
+        for (size_t i = 0; i < ld->num_secs; i++) {
+            jit_section_t *s = &ld->secs[i];
+            if (!(s->flags & SHF_ALLOC) || (bool)(s->flags & SHF_EXECINSTR) != (bool)exec) continue;
+            if (s->align > page || s->size > SIZE_MAX / 2) return bad_object(ld, "section size");
+            pos = align_up(pos, (size_t)s->align);
+            s->addr = pos;
+            pos += (size_t)s->size;
+        }
+        if (exec) {
+            ld->stubs = align_up(pos, STUB_SIZE);
+            pos = ld->code_end = align_up(ld->stubs + ld->num_stubs * STUB_SIZE, page);
+        }
+    }
+    ld->size = align_up(pos > 0 ? pos : 1, page);
+    return ANVIL_OK;
+}
+
+static char *map_at(uint64_t hint, size_t size, int flags)
+{
+    void *mem = mmap((void *)(uintptr_t)hint, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+static char *map_memory(const jit_placement_t *pl, size_t size)
+{
+#ifdef MAP_32BIT
+    if (pl->low) return map_at(0, size, MAP_32BIT);
+#endif
+    if (pl->near_lo <= pl->near_hi) {
+        /* Try just below, then just above the referenced externs */
+        for (uint64_t k = 1; k <= 16; k++) {
+            uint64_t d = k * NEAR_STEP + size;
+            uint64_t hints[2] = { pl->near_lo > d ? pl->near_lo - d : 0, pl->near_hi + k * NEAR_STEP };
+            for (int h = 0; h < 2; h++) {
+                if (!hints[h]) continue;
+                char *mem = map_at(hints[h], size, 0);
+                if (!mem) continue;
+                uint64_t lo = (uint64_t)(uintptr_t)mem;
+                if (fits_i32((int64_t)(pl->near_hi - lo)) &&
+                    fits_i32((int64_t)(pl->near_lo - (lo + size)))) {
+                    return mem;
+                }
+                munmap(mem, size);
+            }
+        }
+    }
+    return map_at(0, size, 0);
+}
+
+/* Address of the stub that jumps to an extern, created on first use */
+static uint64_t stub_for(jit_loader_t *ld, jit_symbol_t *sym)
+{
+    if (sym->stub < 0) {
+        unsigned char *p = (unsigned char *)ld->mem + ld->stubs + ld->used_stubs * STUB_SIZE;
+        static const unsigned char jmp[6] = { 0xff, 0x25, 0, 0, 0, 0 };
+        memcpy(p, jmp, 6);
+        memcpy(p + 6, &sym->addr, 8);
+        p[14] = p[15] = 0xcc;
+        sym->stub = (long)ld->used_stubs++;
+    }
+    return (uint64_t)(uintptr_t)(ld->mem + ld->stubs + (size_t)sym->stub * STUB_SIZE);
+}
+
+static anvil_error_t apply_reloc(jit_loader_t *ld, const jit_reloc_t *rel, void *arg)
+{
+    (void)arg;
+    char *p = ld->mem + ld->secs[rel->section].addr + rel->offset;
+    uint64_t place = (uint64_t)(uintptr_t)p;
+    uint64_t value = rel->sym->addr + (uint64_t)rel->addend;
+    bool fits;
+
+    switch (rel->type) {
+    case R_X86_64_64:
+        memcpy(p, &value, 8);
+        return ANVIL_OK;
+
+    case R_X86_64_PC32:
+    case R_X86_64_PLT32:
+        if (!fits_i32((int64_t)(value - place)) && rel->type == R_X86_64_PLT32 &&
+            rel->sym->shndx == SHN_UNDEF) {
+            value = stub_for(ld, rel->sym) + (uint64_t)rel->addend;
+        }
+        value -= place;
+        fits = fits_i32((int64_t)value);
+        break;
+
+    case R_X86_64_32:
+        fits = value <= UINT32_MAX;
+        break;
+
+    case R_X86_64_32S:
+        fits = fits_i32((int64_t)value);
+        break;
+
+    default:
+        anvil_set_error(ld->ctx, ANVIL_ERR_CODEGEN, "JIT: unsupported relocation type %u",
+                        rel->type);
+        return ANVIL_ERR_CODEGEN;
+    }
+
+    if (!fits) {
+        anvil_set_error(ld->ctx, ANVIL_ERR_CODEGEN,
+                        "JIT: '%s' is out of range of the generated code",
+                        sym_name(ld, rel->sym));
+        return ANVIL_ERR_CODEGEN;
+    }
+    uint32_t v = (uint32_t)value;
+    memcpy(p, &v, 4);
+    return ANVIL_OK;
+}
+
+/* Records the module's global symbols for anvil_jit_get_function */
+static anvil_error_t export_symbols(jit_loader_t *ld, anvil_jit_t *jit)
+{
+    jit->names = calloc(ld->num_syms ? ld->num_syms : 1, sizeof(char *));
+    jit->addrs = calloc(ld->num_syms ? ld->num_syms : 1, sizeof(void *));
+    if (!jit->names || !jit->addrs) return ANVIL_ERR_NOMEM;
+    for (size_t i = 1; i < ld->num_syms; i++) {
+        const jit_symbol_t *sym = &ld->syms[i];
+        if ((sym->info >> 4) == STB_LOCAL || sym->shndx == SHN_UNDEF) continue;
+        const char *name = sym_name(ld, sym);
+        size_t n = strlen(name) + 1;
+        char *copy = malloc(n);
+        if (!copy) return ANVIL_ERR_NOMEM;
+        memcpy(copy, name, n);
+        jit->names[jit->num_syms] = copy;
+        jit->addrs[jit->num_syms++] = (void *)(uintptr_t)sym->addr;
+    }
+    return ANVIL_OK;
+}
+
+static anvil_error_t jit_load(jit_loader_t *ld, anvil_resolve_fn resolve, void *user,
+                              anvil_jit_t *jit)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    anvil_error_t err = read_sections(ld);
+    if (err == ANVIL_OK) err = read_symbols(ld, resolve, user);
+
+    jit_placement_t pl = { false, UINT64_MAX, 0 };
+    if (err == ANVIL_OK) err = for_each_reloc(ld, scan_reloc, &pl);
+    if (err == ANVIL_OK) err = layout(ld, page);
+    if (err != ANVIL_OK) return err;
+
+    ld->mem = map_memory(&pl, ld->size);
+    if (!ld->mem) {
+        anvil_set_error(ld->ctx, ANVIL_ERR_NOMEM, "JIT: cannot map %zu bytes", ld->size);
+        return ANVIL_ERR_NOMEM;
+    }
+    jit->mem = ld->mem;
+    jit->size = ld->size;
+
+    /* Section contents; NOBITS stays zero from the anonymous mapping */
+    for (size_t i = 0; i < ld->num_secs; i++) {
+        const jit_section_t *s = &ld->secs[i];
+        if (s->addr != SIZE_MAX && s->type != SHT_NOBITS) {
+            memcpy(ld->mem + s->addr, ld->obj + s->offset, (size_t)s->size);
+        }
+    }
+    for (size_t i = 1; i < ld->num_syms; i++) {
+        jit_symbol_t *sym = &ld->syms[i];
+        if (sym->shndx == SHN_ABS) {
+            sym->addr = sym->value;
+        } else if (sym->shndx != SHN_UNDEF && sym->shndx < ld->num_secs &&
+                   ld->secs[sym->shndx].addr != SIZE_MAX) {
+            sym->addr = (uint64_t)(uintptr_t)(ld->mem + ld->secs[sym->shndx].addr) + sym->value;
+        }
+    }
+
+    err = for_each_reloc(ld, apply_reloc, NULL);
+    if (err == ANVIL_OK && ld->code_end > 0) {
+        __builtin___clear_cache(ld->mem, ld->mem + ld->code_end);
+        if (mprotect(ld->mem, ld->code_end, PROT_READ | PROT_EXEC) != 0) {
+            anvil_set_error(ld->ctx, ANVIL_ERR_CODEGEN, "JIT: cannot make code executable");
+            err = ANVIL_ERR_CODEGEN;
+        }
+    }
+    if (err == ANVIL_OK) err = export_symbols(ld, jit);
+    return err;
+}
+
+#endif /* JIT_HOST_ARCH */
+
+anvil_error_t anvil_module_jit(anvil_module_t *mod, anvil_resolve_fn resolve, void *user,
+                               anvil_jit_t **jit)
+{
+    if (!mod || !jit) return ANVIL_ERR_INVALID_ARG;
+    *jit = NULL;
+    anvil_ctx_t *ctx = mod->ctx;
+
+#ifdef JIT_HOST_ARCH
+    if (ctx->arch != JIT_HOST_ARCH) {
+        anvil_set_error(ctx, ANVIL_ERR_CODEGEN, "JIT: target is not the host architecture");
+        return ANVIL_ERR_CODEGEN;
+    }
+
+    anvil_output_t output = ctx->output;
+    ctx->output = ANVIL_OUTPUT_BINARY;
+    char *obj = NULL;
+    size_t len = 0;
+    anvil_error_t err = anvil_module_codegen(mod, &obj, &len);
+    ctx->output = output;
+    if (err != ANVIL_OK) return err;
+
+    anvil_jit_t *result = calloc(1, sizeof(anvil_jit_t));
+    jit_loader_t ld = { .ctx = ctx, .obj = (const unsigned char *)obj, .len = len };
+    err = result ? jit_load(&ld, resolve, user, result) : ANVIL_ERR_NOMEM;
+    free(ld.secs);
+    free(ld.syms);
+    free(obj);
+
+    if (err != ANVIL_OK) {
+        anvil_jit_destroy(result);
+        return err;
+    }
+    *jit = result;
+    return ANVIL_OK;
+#else
+    (void)resolve;
+    (void)user;
+    anvil_set_error(ctx, ANVIL_ERR_CODEGEN, "JIT: not supported on this host");
+    return ANVIL_ERR_CODEGEN;
+#endif
+}
+
+void *anvil_jit_get_function(anvil_jit_t *jit, const char *name)
+{
+    if (!jit || !name) return NULL;
+    for (size_t i = 0; i < jit->num_syms; i++) {
+        if (strcmp(jit->names[i], name) == 0) return jit->addrs[i];
+    }
+    return NULL;
+}
+
+void anvil_jit_destroy(anvil_jit_t *jit)
+{
+    if (!jit) return;
+#ifdef JIT_HOST_ARCH
+    if (jit->mem) munmap(jit->mem, jit->size);
+#endif
+    for (size_t i = 0; i < jit->num_syms; i++) free(jit->names[i]);
+    free(jit->names);
+    free(jit->addrs);
+    free(jit);
+}
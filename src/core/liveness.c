@@ -0,0 +1,449 @@
+/*
+ * ANVIL - Liveness analysis
+ *
+ * Backward dataflow over bitsets of values:
+ *
+ *   live_out(B) = U live_in(S) for successors S, plus the operands that
+ *                 phis in S take along the edge B -> S
+ *   live_in(B)  = gen(B) | (live_out(B) - defs(B))
+ *
+ * Only values that cross a block boundary get a bit, so the sets stay
+ * small when most temporaries die in the block that defines them.
+ * gen(B) and the phi inputs are kept as sparse lists, and defs(B) is a
+ * contiguous range of bits, so each block only stores its live_in and
+ * live_out sets. Blocks are processed from a worklist seeded
+ * in reverse layout order; a block whose live_in changes requeues its
+ * predecessors.
+ *
+ * Live ranges are hulls over instruction positions (see anvil_internal.h),
+ * which is what linear-scan allocation and slot coloring consume.
+ */
+
+#include "anvil/anvil_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Per-block lists built during analysis, stored as offsets into one array */
+typedef struct {
+    int32_t *gen;           /* Bits of upward-exposed uses */
+    size_t *gen_start;      /* Block b: gen[gen_start[b] .. gen_start[b + 1]) */
+    int32_t *phi_uses;      /* Bits successor phis read on edges out of b */
+    size_t *phi_start;
+} live_lists_t;
+
+bool anvil_liveness_copy_before(const anvil_instr_t *instr)
+{
+    if (!instr || !instr->parent || instr != instr->parent->last) return false;
+    switch (instr->op) {
+        case ANVIL_OP_BR:
+        case ANVIL_OP_BR_COND:
+        case ANVIL_OP_RET:
+        case ANVIL_OP_SWITCH:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool has_value(const anvil_instr_t *instr)
+{
+    return instr->result && instr->result->type &&
+           instr->result->type->kind != ANVIL_TYPE_VOID;
+}
+
+int32_t anvil_liveness_value_num(const anvil_liveness_t *lv, anvil_value_t *val)
+{
+    if (!lv || !val || (val->kind != ANVIL_VAL_INSTR && val->kind != ANVIL_VAL_PARAM)) return -1;
+    int32_t num = anvil_value_map_get(&lv->value_num, val);
+    return num == ANVIL_VALUE_MAP_NONE ? -1 : num;
+}
+
+anvil_live_block_t *anvil_liveness_block(const anvil_liveness_t *lv, anvil_block_t *block)
+{
+    if (!lv || !block || block->id < lv->block_base || block->id - lv->block_base >= lv->block_count)
+        return NULL;
+    int32_t idx = lv->block_num[block->id - lv->block_base];
+    return idx < 0 ? NULL : &lv->blocks[idx];
+}
+
+static int32_t value_bit(const anvil_liveness_t *lv, anvil_value_t *val)
+{
+    int32_t num = anvil_liveness_value_num(lv, val);
+    return num < 0 ? -1 : lv->value_bit[num];
+}
+
+bool anvil_liveness_live_in(const anvil_liveness_t *lv, anvil_block_t *block,
+                            anvil_value_t *val)
+{
+    anvil_live_block_t *lb = anvil_liveness_block(lv, block);
+    int32_t bit = value_bit(lv, val);
+    return lb && bit >= 0 && ANVIL_BITSET_TEST(lb->live_in, bit);
+}
+
+bool anvil_liveness_live_out(const anvil_liveness_t *lv, anvil_block_t *block,
+                             anvil_value_t *val)
+{
+    anvil_live_block_t *lb = anvil_liveness_block(lv, block);
+    int32_t bit = value_bit(lv, val);
+    return lb && bit >= 0 && ANVIL_BITSET_TEST(lb->live_out, bit);
+}
+
+static int32_t block_idx(const anvil_liveness_t *lv, anvil_block_t *block)
+{
+    anvil_live_block_t *lb = anvil_liveness_block(lv, block);
+    return lb ? (int32_t)(lb - lv->blocks) : -1;
+}
+
+/* Dense value and block numbering, instruction indices and copy points */
+static anvil_error_t number(anvil_liveness_t *lv, anvil_func_t *func)
+{
+    uint32_t bid_min = UINT32_MAX, bid_max = 0;
+    size_t num_values = func->num_params;
+    size_t num_blocks = 0;
+
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        num_blocks++;
+        if (block->id < bid_min) bid_min = block->id;
+        if (block->id > bid_max) bid_max = block->id;
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (has_value(instr)) num_values++;
+        }
+    }
+
+    lv->block_base = num_blocks ? bid_min : 0;
+    lv->block_count = num_blocks ? bid_max - bid_min + 1 : 0;
+    lv->ranges = malloc((num_values ? num_values : 1) * sizeof(anvil_live_range_t));
+    lv->block_num = malloc((lv->block_count ? lv->block_count : 1) * sizeof(int32_t));
+    lv->blocks = calloc(num_blocks ? num_blocks : 1, sizeof(anvil_live_block_t));
+    if (!lv->ranges || !lv->block_num || !lv->blocks ||
+        anvil_value_map_reset(&lv->value_num, func) != ANVIL_OK) return ANVIL_ERR_NOMEM;
+    memset(lv->block_num, 0xff, lv->block_count * sizeof(int32_t));
+
+    /* The map is sized for every value, so the sets below never allocate */
+    for (size_t i = 0; i < func->num_params; i++) {
+        anvil_value_t *param = func->params[i];
+        lv->ranges[lv->num_values] = (anvil_live_range_t){ param, -1, -1 };
+        anvil_value_map_set(&lv->value_num, param, (int32_t)lv->num_values++);
+    }
+
+    int k = 1;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        anvil_live_block_t *lb = &lv->blocks[lv->num_blocks];
+        lv->block_num[block->id - lv->block_base] = (int32_t)lv->num_blocks++;
+        lb->block = block;
+        lb->first = k;
+        lb->copy = -1;
+        lb->def_lo = (uint32_t)lv->num_values;
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (anvil_liveness_copy_before(instr)) lb->copy = k++;
+            k++;
+            if (!has_value(instr)) continue;
+            lv->ranges[lv->num_values] = (anvil_live_range_t){ instr->result, -1, -1 };
+            anvil_value_map_set(&lv->value_num, instr->result, (int32_t)lv->num_values++);
+        }
+        if (lb->copy < 0) lb->copy = k++;
+        lb->last = k - 1;
+        lb->def_hi = (uint32_t)lv->num_values;
+    }
+    lv->num_indices = k;
+    return ANVIL_OK;
+}
+
+/* A value needs a bit if it can be live across a block boundary */
+static bool crosses_blocks(anvil_value_t *val)
+{
+    if (val->kind == ANVIL_VAL_PARAM) return true;
+    anvil_block_t *home = val->data.instr->parent;
+    for (anvil_use_t *use = val->uses; use; use = use->next) {
+        if (use->user->op == ANVIL_OP_PHI || use->user->parent != home) return true;
+    }
+    return false;
+}
+
+static anvil_error_t assign_bits(anvil_liveness_t *lv)
+{
+    size_t n = lv->num_values;
+    lv->value_bit = malloc((n ? n : 1) * sizeof(int32_t));
+    lv->bit_value = malloc((n ? n : 1) * sizeof(int32_t));
+    if (!lv->value_bit || !lv->bit_value) return ANVIL_ERR_NOMEM;
+
+    for (size_t v = 0; v < n; v++) {
+        if (crosses_blocks(lv->ranges[v].value)) {
+            lv->value_bit[v] = (int32_t)lv->num_bits;
+            lv->bit_value[lv->num_bits++] = (int32_t)v;
+        } else {
+            lv->value_bit[v] = -1;
+        }
+    }
+
+    /* Bits follow value numbers, so each block's bits are contiguous too */
+    size_t bit = 0;
+    for (size_t b = 0; b < lv->num_blocks; b++) {
+        anvil_live_block_t *lb = &lv->blocks[b];
+        while (bit < lv->num_bits && (uint32_t)lv->bit_value[bit] < lb->def_lo) bit++;
+        lb->bit_lo = (uint32_t)bit;
+        while (bit < lv->num_bits && (uint32_t)lv->bit_value[bit] < lb->def_hi) bit++;
+        lb->bit_hi = (uint32_t)bit;
+    }
+    lv->words = ANVIL_BITSET_WORDS(lv->num_bits);
+    if (lv->words == 0) lv->words = 1;
+    return ANVIL_OK;
+}
+
+static int32_t *list_alloc(size_t **start, size_t num_blocks, const size_t *count)
+{
+    *start = malloc((num_blocks + 1) * sizeof(size_t));
+    if (!*start) return NULL;
+    size_t total = 0;
+    for (size_t b = 0; b < num_blocks; b++) {
+        (*start)[b] = total;
+        total += count[b];
+    }
+    (*start)[num_blocks] = total;
+    return malloc((total ? total : 1) * sizeof(int32_t));
+}
+
+/* Build gen lists, phi-edge uses and the CFG edges */
+static anvil_error_t build_lists(anvil_liveness_t *lv, live_lists_t *ll)
+{
+    size_t nb = lv->num_blocks;
+    size_t *count = calloc(nb ? nb : 1, sizeof(size_t));
+    size_t *fill = calloc(nb ? nb : 1, sizeof(size_t));
+    uint32_t *mark = calloc(lv->num_bits ? lv->num_bits : 1, sizeof(uint32_t));
+    lv->succs = malloc((nb ? nb : 1) * sizeof(*lv->succs));
+    anvil_error_t err = ANVIL_ERR_NOMEM;
+    if (!count || !fill || !mark || !lv->succs) goto out;
+
+    /* Upward-exposed uses; mark[] dedups per block with a two-pass stamp */
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t b = 0; b < nb; b++) {
+            anvil_live_block_t *lb = &lv->blocks[b];
+            uint32_t stamp = (uint32_t)(2 * b + pass + 1);
+            for (anvil_instr_t *instr = lb->block->first; instr; instr = instr->next) {
+                if (instr->op == ANVIL_OP_PHI) continue;
+                for (size_t i = 0; i < instr->num_operands; i++) {
+                    int32_t bit = value_bit(lv, instr->operands[i]);
+                    if (bit < 0 || ((uint32_t)bit >= lb->bit_lo && (uint32_t)bit < lb->bit_hi))
+                        continue;
+                    if (mark[bit] == stamp) continue;
+                    mark[bit] = stamp;
+                    if (pass == 0) count[b]++;
+                    else ll->gen[ll->gen_start[b] + fill[b]++] = bit;
+                }
+            }
+        }
+        if (pass == 0 && !(ll->gen = list_alloc(&ll->gen_start, nb, count))) goto out;
+    }
+
+    /* Phi inputs are live out of the incoming block */
+    memset(count, 0, nb * sizeof(size_t));
+    memset(fill, 0, nb * sizeof(size_t));
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t b = 0; b < nb; b++) {
+            for (anvil_instr_t *phi = lv->blocks[b].block->first; phi && phi->op == ANVIL_OP_PHI;
+                 phi = phi->next) {
+                for (size_t i = 0; i < phi->num_phi_incoming && i < phi->num_operands; i++) {
+                    int32_t bit = value_bit(lv, phi->operands[i]);
+                    int32_t pred = block_idx(lv, phi->phi_blocks[i]);
+                    if (bit < 0 || pred < 0) continue;
+                    if (pass == 0) count[pred]++;
+                    else ll->phi_uses[ll->phi_start[pred] + fill[pred]++] = bit;
+                }
+            }
+        }
+        if (pass == 0 && !(ll->phi_uses = list_alloc(&ll->phi_start, nb, count))) goto out;
+    }
+
+    /* Successors from the terminator, then predecessors by counting */
+    memset(count, 0, nb * sizeof(size_t));
+    memset(fill, 0, nb * sizeof(size_t));
+    for (size_t b = 0; b < nb; b++) {
+        anvil_instr_t *term = lv->blocks[b].block->last;
+        lv->succs[b][0] = lv->succs[b][1] = -1;
+        if (term && term->op == ANVIL_OP_BR) {
+            lv->succs[b][0] = block_idx(lv, term->true_block);
+        } else if (term && term->op == ANVIL_OP_BR_COND) {
+            lv->succs[b][0] = block_idx(lv, term->true_block);
+            lv->succs[b][1] = block_idx(lv, term->false_block);
+        }
+        for (int s = 0; s < 2; s++)
+            if (lv->succs[b][s] >= 0) count[lv->succs[b][s]]++;
+    }
+    if (!(lv->preds = list_alloc(&lv->pred_start, nb, count))) goto out;
+    for (size_t b = 0; b < nb; b++) {
+        for (int s = 0; s < 2; s++) {
+            int32_t succ = lv->succs[b][s];
+            if (succ >= 0) lv->preds[lv->pred_start[succ] + fill[succ]++] = (int32_t)b;
+        }
+    }
+    err = ANVIL_OK;
+
+out:
+    free(count);
+    free(fill);
+    free(mark);
+    return err;
+}
+
+static anvil_error_t solve(anvil_liveness_t *lv, const live_lists_t *ll)
+{
+    size_t nb = lv->num_blocks;
+    size_t words = lv->words;
+    lv->sets = calloc(nb * 2 * words + words, sizeof(uint64_t));
+    int32_t *worklist = malloc((nb ? nb : 1) * sizeof(int32_t));
+    bool *queued = malloc(nb ? nb : 1);
+    if (!lv->sets || !worklist || !queued) {
+        free(worklist);
+        free(queued);
+        return ANVIL_ERR_NOMEM;
+    }
+    uint64_t *tmp = lv->sets + nb * 2 * words;
+
+    size_t top = 0;
+    for (size_t b = 0; b < nb; b++) {
+        lv->blocks[b].live_in = lv->sets + (2 * b) * words;
+        lv->blocks[b].live_out = lv->sets + (2 * b + 1) * words;
+        worklist[top++] = (int32_t)b;   /* Popped last block first */
+        queued[b] = true;
+    }
+
+    while (top > 0) {
+        int32_t b = worklist[--top];
+        queued[b] = false;
+        anvil_live_block_t *lb = &lv->blocks[b];
+
+        for (int s = 0; s < 2; s++) {
+            int32_t succ = lv->succs[b][s];
+            if (succ < 0) continue;
+            const uint64_t *in = lv->blocks[succ].live_in;
+            for (size_t w = 0; w < words; w++) lb->live_out[w] |= in[w];
+        }
+        for (size_t i = ll->phi_start[b]; i < ll->phi_start[b + 1]; i++)
+            ANVIL_BITSET_SET(lb->live_out, ll->phi_uses[i]);
+
+        /* live_in = gen | (live_out - [bit_lo, bit_hi)) */
+        memcpy(tmp, lb->live_out, words * sizeof(uint64_t));
+        for (uint32_t v = lb->bit_lo; v < lb->bit_hi;) {
+            if ((v & 63) == 0 && v + 64 <= lb->bit_hi) {
+                tmp[v >> 6] = 0;
+                v += 64;
+            } else {
+                ANVIL_BITSET_CLEAR(tmp, v);
+                v++;
+            }
+        }
+        for (size_t i = ll->gen_start[b]; i < ll->gen_start[b + 1]; i++)
+            ANVIL_BITSET_SET(tmp, ll->gen[i]);
+
+        if (memcmp(tmp, lb->live_in, words * sizeof(uint64_t)) == 0) continue;
+        memcpy(lb->live_in, tmp, words * sizeof(uint64_t));
+        for (size_t i = lv->pred_start[b]; i < lv->pred_start[b + 1]; i++) {
+            int32_t p = lv->preds[i];
+            if (!queued[p]) {
+                queued[p] = true;
+                worklist[top++] = p;
+            }
+        }
+    }
+
+    free(worklist);
+    free(queued);
+    return ANVIL_OK;
+}
+
+static void extend(anvil_live_range_t *r, int pos)
+{
+    if (r->start < 0 || pos < r->start) r->start = pos;
+    if (pos > r->end) r->end = pos;
+}
+
+static void extend_set(anvil_liveness_t *lv, const uint64_t *set, int pos)
+{
+    for (size_t w = 0; w < lv->words; w++) {
+        uint64_t bits = set[w];
+        while (bits) {
+            extend(&lv->ranges[lv->bit_value[w * 64 + (size_t)__builtin_ctzll(bits)]], pos);
+            bits &= bits - 1;
+        }
+    }
+}
+
+static void build_ranges(anvil_liveness_t *lv, anvil_func_t *func)
+{
+    for (size_t i = 0; i < func->num_params; i++) extend(&lv->ranges[i], 1);
+
+    for (size_t b = 0; b < lv->num_blocks; b++) {
+        anvil_live_block_t *lb = &lv->blocks[b];
+        int bstart = 2 * lb->first;
+        extend_set(lv, lb->live_in, bstart);
+        extend_set(lv, lb->live_out, 2 * lb->last + 1);
+
+        int k = lb->first;
+        for (anvil_instr_t *instr = lb->block->first; instr; instr = instr->next) {
+            if (anvil_liveness_copy_before(instr)) k++;
+            int32_t def = has_value(instr) ? anvil_liveness_value_num(lv, instr->result) : -1;
+
+            if (instr->op == ANVIL_OP_PHI) {
+                /* The copy in each predecessor writes the phi's location */
+                if (def >= 0) extend(&lv->ranges[def], bstart);
+                for (size_t i = 0; i < instr->num_phi_incoming && i < instr->num_operands; i++) {
+                    anvil_live_block_t *pb = anvil_liveness_block(lv, instr->phi_blocks[i]);
+                    if (!pb) continue;
+                    int32_t use = anvil_liveness_value_num(lv, instr->operands[i]);
+                    if (use >= 0) extend(&lv->ranges[use], 2 * pb->copy);
+                    if (def >= 0) {
+                        extend(&lv->ranges[def], 2 * pb->copy + 1);
+                        extend(&lv->ranges[def], 2 * pb->last + 1);
+                    }
+                }
+            } else {
+                for (size_t i = 0; i < instr->num_operands; i++) {
+                    int32_t use = anvil_liveness_value_num(lv, instr->operands[i]);
+                    if (use >= 0) extend(&lv->ranges[use], 2 * k);
+                }
+                if (def >= 0) extend(&lv->ranges[def], 2 * k + 1);
+            }
+            k++;
+        }
+    }
+}
+
+anvil_error_t anvil_liveness_compute(anvil_liveness_t *lv, anvil_func_t *func)
+{
+    if (!lv || !func) return ANVIL_ERR_INVALID_ARG;
+
+    memset(lv, 0, sizeof(*lv));
+    lv->func = func;
+
+    live_lists_t ll;
+    memset(&ll, 0, sizeof(ll));
+
+    anvil_error_t err = number(lv, func);
+    if (err == ANVIL_OK) err = assign_bits(lv);
+    if (err == ANVIL_OK) err = build_lists(lv, &ll);
+    if (err == ANVIL_OK) err = solve(lv, &ll);
+    if (err == ANVIL_OK) build_ranges(lv, func);
+
+    free(ll.gen);
+    free(ll.gen_start);
+    free(ll.phi_uses);
+    free(ll.phi_start);
+    if (err != ANVIL_OK) anvil_liveness_free(lv);
+    return err;
+}
+
+void anvil_liveness_free(anvil_liveness_t *lv)
+{
+    if (!lv) return;
+    free(lv->ranges);
+    anvil_value_map_free(&lv->value_num);
+    free(lv->value_bit);
+    free(lv->bit_value);
+    free(lv->blocks);
+    free(lv->block_num);
+    free(lv->succs);
+    free(lv->preds);
+    free(lv->pred_start);
+    free(lv->sets);
+    memset(lv, 0, sizeof(*lv));
+}
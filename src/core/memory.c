@@ -1,55 +1,234 @@
 /*
  * ANVIL - Memory management utilities
+ *
+ * IR objects are allocated from bump-pointer arenas (anvil_pool_t).
+ * The context owns one arena for context-lifetime objects (types,
+ * constants) and every module owns a sub-arena for its functions,
+ * blocks, instructions and values. Nothing allocated from an arena is
+ * freed individually; destroying the arena releases all of its chunks
+ * at once, so tearing down a module costs O(chunks) instead of
+ * O(objects).
  */
 
 #include "anvil/anvil_internal.h"
 #include <stdlib.h>
 #include <string.h>
 
+#define ANVIL_POOL_ALIGN        8
+#define ANVIL_POOL_DEFAULT_SIZE (64 * 1024)
+
+#define POOL_ALIGN_UP(n) (((n) + ANVIL_POOL_ALIGN - 1) & ~(size_t)(ANVIL_POOL_ALIGN - 1))
+
+/* Chunk header size, rounded so chunk data stays aligned */
+#define POOL_CHUNK_HDR POOL_ALIGN_UP(sizeof(anvil_pool_chunk_t))
+
+static inline char *chunk_data(anvil_pool_chunk_t *chunk)
+{
+    return (char *)chunk + POOL_CHUNK_HDR;
+}
+
 void anvil_pool_init(anvil_pool_t *pool, size_t block_size)
 {
     if (!pool) return;
-    pool->blocks = NULL;
-    pool->block_size = block_size;
-    pool->used = 0;
-    pool->next = NULL;
+    memset(pool, 0, sizeof(*pool));
+    pool->block_size = block_size ? block_size : ANVIL_POOL_DEFAULT_SIZE;
 }
 
 void anvil_pool_destroy(anvil_pool_t *pool)
 {
     if (!pool) return;
-    
-    /* Free all blocks in the chain */
-    anvil_pool_t *p = pool;
-    while (p) {
-        anvil_pool_t *next = p->next;
-        free(p->blocks);
-        if (p != pool) {
-            free(p);
+
+    /* Free all chunks in the chain */
+    anvil_pool_chunk_t *chunk = pool->chunks;
+    while (chunk) {
+        anvil_pool_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    size_t block_size = pool->block_size;
+    memset(pool, 0, sizeof(*pool));
+    pool->block_size = block_size;
+}
+
+static anvil_pool_chunk_t *pool_new_chunk(anvil_pool_t *pool, size_t size)
+{
+    /* calloc: arena memory is never reused, so every allocation is zeroed */
+    anvil_pool_chunk_t *chunk = calloc(1, POOL_CHUNK_HDR + size);
+    if (!chunk) return NULL;
+
+    chunk->size = size;
+    chunk->used = 0;
+    pool->num_chunks++;
+    pool->bytes_reserved += size;
+    return chunk;
+}
+
+static void *pool_alloc(anvil_pool_t *pool, size_t size)
+{
+    if (!pool->block_size) pool->block_size = ANVIL_POOL_DEFAULT_SIZE;
+
+    size = POOL_ALIGN_UP(size ? size : 1);
+
+    anvil_pool_chunk_t *chunk = pool->chunks;
+
+    if (!chunk || chunk->size - chunk->used < size) {
+        if (size > pool->block_size / 4) {
+            /* Large request: give it a dedicated chunk behind the current
+             * one so the remaining space in the current chunk is not lost */
+            anvil_pool_chunk_t *big = pool_new_chunk(pool, size);
+            if (!big) return NULL;
+            big->used = size;
+            if (chunk) {
+                big->next = chunk->next;
+                chunk->next = big;
+            } else {
+                pool->chunks = big;
+            }
+            pool->num_allocs++;
+            pool->bytes_used += size;
+            pool->last = NULL;
+            return chunk_data(big);
         }
-        p = next;
+
+        chunk = pool_new_chunk(pool, pool->block_size);
+        if (!chunk) return NULL;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
     }
-    
-    pool->blocks = NULL;
-    pool->used = 0;
-    pool->next = NULL;
+
+    void *ptr = chunk_data(chunk) + chunk->used;
+    chunk->used += size;
+    pool->num_allocs++;
+    pool->bytes_used += size;
+    pool->last = ptr;
+    return ptr;
+}
+
+static void *pool_realloc(anvil_pool_t *pool, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!ptr) return pool_alloc(pool, new_size);
+
+    old_size = POOL_ALIGN_UP(old_size);
+    if (new_size <= old_size) return ptr;
+
+    /* Most recent allocation in the current chunk: grow in place */
+    anvil_pool_chunk_t *chunk = pool->chunks;
+    if (ptr == pool->last && chunk) {
+        size_t grow = POOL_ALIGN_UP(new_size) - old_size;
+        if (chunk->size - chunk->used >= grow) {
+            chunk->used += grow;
+            pool->bytes_used += grow;
+            return ptr;
+        }
+    }
+
+    void *new_ptr = pool_alloc(pool, new_size);
+    if (!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, old_size);
+    return new_ptr;
+}
+
+/* While passes run in parallel, each worker allocates what belongs to
+ * the module from its own arena, and the context arena takes the lock */
+void *anvil_pool_alloc(anvil_pool_t *pool, size_t size)
+{
+    if (!pool) return NULL;
+    if (pool->workers) pool = anvil_worker_pool(pool);
+    if (!pool->lock) return pool_alloc(pool, size);
+
+    anvil_mutex_lock(pool->lock);
+    void *ptr = pool_alloc(pool, size);
+    anvil_mutex_unlock(pool->lock);
+    return ptr;
+}
+
+void *anvil_pool_realloc(anvil_pool_t *pool, void *ptr, size_t old_size, size_t new_size)
+{
+    if (!pool) return NULL;
+    if (pool->workers) pool = anvil_worker_pool(pool);
+    if (!pool->lock) return pool_realloc(pool, ptr, old_size, new_size);
+
+    anvil_mutex_lock(pool->lock);
+    void *new_ptr = pool_realloc(pool, ptr, old_size, new_size);
+    anvil_mutex_unlock(pool->lock);
+    return new_ptr;
+}
+
+void anvil_pool_merge(anvil_pool_t *dst, anvil_pool_t *src)
+{
+    if (!dst || !src || !src->chunks) return;
+
+    anvil_pool_chunk_t **tail = &dst->chunks;
+    while (*tail) tail = &(*tail)->next;
+    *tail = src->chunks;
+
+    dst->num_allocs += src->num_allocs;
+    dst->num_chunks += src->num_chunks;
+    dst->bytes_used += src->bytes_used;
+    dst->bytes_reserved += src->bytes_reserved;
+
+    size_t block_size = src->block_size;
+    memset(src, 0, sizeof(*src));
+    src->block_size = block_size;
+}
+
+char *anvil_pool_strdup(anvil_pool_t *pool, const char *str)
+{
+    if (!str) return NULL;
+
+    size_t len = strlen(str) + 1;
+    char *copy = anvil_pool_alloc(pool, len);
+    if (copy) memcpy(copy, str, len);
+    return copy;
 }
 
 void *anvil_alloc(anvil_ctx_t *ctx, size_t size)
 {
-    (void)ctx;
-    return calloc(1, size);
+    if (!ctx) return NULL;
+    return anvil_pool_alloc(&ctx->pool, size);
 }
 
 void *anvil_realloc(anvil_ctx_t *ctx, void *ptr, size_t old_size, size_t new_size)
 {
-    (void)ctx;
-    (void)old_size;
-    return realloc(ptr, new_size);
+    if (!ctx) return NULL;
+    return anvil_pool_realloc(&ctx->pool, ptr, old_size, new_size);
 }
 
 char *anvil_strdup(anvil_ctx_t *ctx, const char *str)
 {
-    (void)ctx;
-    return str ? strdup(str) : NULL;
+    if (!ctx) return NULL;
+    return anvil_pool_strdup(&ctx->pool, str);
+}
+
+anvil_pool_t *anvil_ctx_ir_pool(anvil_ctx_t *ctx)
+{
+    if (!ctx) return NULL;
+
+    /* IR built at the insertion point belongs to that block's module */
+    if (ctx->insert_block && ctx->insert_block->parent &&
+        ctx->insert_block->parent->parent) {
+        return &ctx->insert_block->parent->parent->pool;
+    }
+    return &ctx->pool;
+}
+
+static void add_pool_stats(anvil_mem_stats_t *stats, const anvil_pool_t *pool)
+{
+    stats->num_allocs += pool->num_allocs;
+    stats->num_chunks += pool->num_chunks;
+    stats->bytes_used += pool->bytes_used;
+    stats->bytes_reserved += pool->bytes_reserved;
+}
+
+void anvil_ctx_get_mem_stats(anvil_ctx_t *ctx, anvil_mem_stats_t *stats)
+{
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (!ctx) return;
+
+    add_pool_stats(stats, &ctx->pool);
+    for (anvil_module_t *mod = ctx->modules; mod; mod = mod->next) {
+        add_pool_stats(stats, &mod->pool);
+    }
 }
@@ -13,7 +13,8 @@ anvil_module_t *anvil_module_create(anvil_ctx_t *ctx, const char *name)
     anvil_module_t *mod = calloc(1, sizeof(anvil_module_t));
     if (!mod) return NULL;
     
-    mod->name = name ? strdup(name) : strdup("module");
+    anvil_pool_init(&mod->pool, 0);
+    mod->name = anvil_pool_strdup(&mod->pool, name ? name : "module");
     mod->ctx = ctx;
     
     /* Add to context's module list */
@@ -37,127 +38,26 @@ void anvil_module_destroy(anvil_module_t *mod)
             }
             pp = &(*pp)->next;
         }
-    }
-    
-    /* First pass: collect ALL unique constants from ALL functions */
-    #define MAX_CONSTS 4096
-    anvil_value_t *all_consts[MAX_CONSTS];
-    size_t num_all_consts = 0;
-    
-    for (anvil_func_t *f = mod->funcs; f; f = f->next) {
-        for (anvil_block_t *b = f->blocks; b; b = b->next) {
-            for (anvil_instr_t *instr = b->first; instr; instr = instr->next) {
-                for (size_t i = 0; i < instr->num_operands; i++) {
-                    anvil_value_t *op = instr->operands[i];
-                    if (op && (op->kind == ANVIL_VAL_CONST_INT || 
-                               op->kind == ANVIL_VAL_CONST_FLOAT ||
-                               op->kind == ANVIL_VAL_CONST_NULL ||
-                               op->kind == ANVIL_VAL_CONST_STRING ||
-                               op->kind == ANVIL_VAL_CONST_ARRAY)) {
-                        /* Check if already in list */
-                        bool found = false;
-                        for (size_t j = 0; j < num_all_consts; j++) {
-                            if (all_consts[j] == op) { found = true; break; }
-                        }
-                        if (!found && num_all_consts < MAX_CONSTS) {
-                            all_consts[num_all_consts++] = op;
-                        }
-                    }
-                    instr->operands[i] = NULL;
-                }
-            }
-        }
-    }
-    
-    /* Free all collected constants */
-    for (size_t i = 0; i < num_all_consts; i++) {
-        anvil_value_t *op = all_consts[i];
-        if (op->kind == ANVIL_VAL_CONST_STRING && op->data.str) {
-            free((void*)op->data.str);
-        } else if (op->kind == ANVIL_VAL_CONST_ARRAY && op->data.array.elements) {
-            free(op->data.array.elements);
-        }
-        free(op->name);
-        free(op);
-    }
-    #undef MAX_CONSTS
-    
-    /* Destroy functions */
-    anvil_func_t *func = mod->funcs;
-    while (func) {
-        anvil_func_t *next = func->next;
         
-        anvil_block_t *block = func->blocks;
-        
-        /* Free all instruction results */
-        for (anvil_block_t *b = block; b; b = b->next) {
-            for (anvil_instr_t *instr = b->first; instr; instr = instr->next) {
-                if (instr->result) {
-                    free(instr->result->name);
-                    free(instr->result);
-                    instr->result = NULL;
-                }
-            }
+        /* Don't leave the builder pointing into freed memory */
+        if (mod->ctx->insert_block && mod->ctx->insert_block->parent &&
+            mod->ctx->insert_block->parent->parent == mod) {
+            mod->ctx->insert_block = NULL;
+            mod->ctx->insert_point = NULL;
         }
-        
-        /* Free instructions and blocks */
-        while (block) {
-            anvil_block_t *bnext = block->next;
-            
-            anvil_instr_t *instr = block->first;
-            while (instr) {
-                anvil_instr_t *inext = instr->next;
-                free(instr->operands);
-                free(instr->phi_blocks);
-                free(instr);
-                instr = inext;
-            }
-            
-            free(block->name);
-            free(block->preds);
-            free(block->succs);
-            free(block);
-            block = bnext;
-        }
-        
-        /* Destroy params */
-        if (func->params) {
-            for (size_t i = 0; i < func->num_params; i++) {
-                if (func->params[i]) {
-                    free(func->params[i]->name);
-                    free(func->params[i]);
-                }
-            }
-            free(func->params);
-        }
-        
-        /* Destroy function value */
-        if (func->value) {
-            free(func->value->name);
-            free(func->value);
-        }
-        
-        free(func->name);
-        free(func);
-        func = next;
     }
     
-    /* Destroy globals */
-    anvil_global_t *global = mod->globals;
-    while (global) {
-        anvil_global_t *next = global->next;
-        if (global->value) {
-            free(global->value->name);
-            free(global->value);
-        }
-        free(global);
-        global = next;
+    /* Functions, blocks, instructions, values and globals all live in the
+     * module arena; constants and types belong to the context arena. Only
+     * the cached analyses are on the heap. */
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        anvil_func_invalidate_cfg(func);
     }
+    anvil_pool_destroy(&mod->pool);
     
     /* Destroy string table */
     free(mod->strings.strings);
     
-    free(mod->name);
     free(mod);
 }
 
@@ -166,17 +66,15 @@ anvil_value_t *anvil_module_add_global(anvil_module_t *mod, const char *name,
 {
     if (!mod || !type) return NULL;
     
-    anvil_global_t *global = calloc(1, sizeof(anvil_global_t));
+    anvil_global_t *global = anvil_pool_alloc(&mod->pool, sizeof(anvil_global_t));
     if (!global) return NULL;
     
-    anvil_value_t *val = anvil_value_create(mod->ctx, ANVIL_VAL_GLOBAL, type, name);
-    if (!val) {
-        free(global);
-        return NULL;
-    }
+    anvil_value_t *val = anvil_value_create(mod->ctx, &mod->pool, ANVIL_VAL_GLOBAL, type, name);
+    if (!val) return NULL;
     
     val->data.global.linkage = linkage;
     val->data.global.init = NULL;
+    val->data.global.is_extern = false;
     
     global->value = val;
     global->next = mod->globals;
@@ -189,7 +87,61 @@ anvil_value_t *anvil_module_add_global(anvil_module_t *mod, const char *name,
 anvil_value_t *anvil_module_add_extern(anvil_module_t *mod, const char *name,
                                         anvil_type_t *type)
 {
-    return anvil_module_add_global(mod, name, type, ANVIL_LINK_EXTERNAL);
+    anvil_value_t *val = anvil_module_add_global(mod, name, type, ANVIL_LINK_EXTERNAL);
+    if (val) val->data.global.is_extern = true;
+    return val;
+}
+
+static bool has_phis(const anvil_module_t *mod)
+{
+    for (const anvil_func_t *func = mod->funcs; func; func = func->next) {
+        for (const anvil_block_t *block = func->blocks; block; block = block->next) {
+            if (block->first && block->first->op == ANVIL_OP_PHI) return true;
+        }
+    }
+    return false;
+}
+
+/* Check the module suits the backend, then let it prepare the IR */
+static anvil_error_t prepare_module(anvil_backend_t *be, anvil_module_t *mod)
+{
+    if (!be->ops->supports_phi && has_phis(mod)) {
+        anvil_set_error(mod->ctx, ANVIL_ERR_CODEGEN,
+                        "Backend %s cannot generate code for phi nodes", be->ops->name);
+        return ANVIL_ERR_CODEGEN;
+    }
+    return be->ops->prepare_ir ? be->ops->prepare_ir(be, mod) : ANVIL_OK;
+}
+
+/* Let the backend fill in an ELF object for mod */
+static anvil_error_t backend_object(anvil_backend_t *be, anvil_module_t *mod,
+                                    anvil_elf_object_t *obj)
+{
+    if (!be->ops->codegen_object) {
+        anvil_set_error(mod->ctx, ANVIL_ERR_CODEGEN,
+                        "Binary output is not supported for %s", be->ops->name);
+        return ANVIL_ERR_CODEGEN;
+    }
+    anvil_error_t err = anvil_elf_init(obj, mod->ctx);
+    if (err != ANVIL_OK) return err;
+    err = be->ops->codegen_object(be, mod, obj);
+    if (err != ANVIL_OK) anvil_elf_free(obj);
+    return err;
+}
+
+/* Assembly text, or an object file when the context asks for binary output */
+static anvil_error_t backend_codegen(anvil_backend_t *be, anvil_module_t *mod,
+                                     char **output, size_t *len)
+{
+    if (mod->ctx->output != ANVIL_OUTPUT_BINARY) {
+        return be->ops->codegen_module(be, mod, output, len);
+    }
+    anvil_elf_object_t obj;
+    anvil_error_t err = backend_object(be, mod, &obj);
+    if (err != ANVIL_OK) return err;
+    err = anvil_elf_write(&obj, output, len);
+    anvil_elf_free(&obj);
+    return err;
 }
 
 anvil_error_t anvil_module_codegen(anvil_module_t *mod, char **output, size_t *len)
@@ -202,35 +154,114 @@ anvil_error_t anvil_module_codegen(anvil_module_t *mod, char **output, size_t *l
         return ANVIL_ERR_NO_BACKEND;
     }
     
-    /* Call prepare_ir if the backend provides it */
-    if (ctx->backend->ops->prepare_ir) {
-        anvil_error_t err = ctx->backend->ops->prepare_ir(ctx->backend, mod);
-        if (err != ANVIL_OK) return err;
-    }
+    anvil_error_t err = prepare_module(ctx->backend, mod);
+    if (err != ANVIL_OK) return err;
     
-    return ctx->backend->ops->codegen_module(ctx->backend, mod, output, len);
+    return backend_codegen(ctx->backend, mod, output, len);
 }
 
-anvil_error_t anvil_module_write(anvil_module_t *mod, const char *filename)
+anvil_error_t anvil_module_codegen_to_sink(anvil_module_t *mod, anvil_write_fn write, void *user)
 {
-    if (!mod || !filename) return ANVIL_ERR_INVALID_ARG;
+    if (!mod || !write) return ANVIL_ERR_INVALID_ARG;
     
+    anvil_ctx_t *ctx = mod->ctx;
+    anvil_backend_t *be = ctx->backend;
+    if (!be) {
+        anvil_set_error(ctx, ANVIL_ERR_NO_BACKEND, "No backend configured");
+        return ANVIL_ERR_NO_BACKEND;
+    }
+    
+    anvil_error_t err = prepare_module(be, mod);
+    if (err != ANVIL_OK) return err;
+    
+    /* Backends stream through the sink and hand back no output; a backend
+     * that ignores the sink, and any object file, which is only complete
+     * once the whole module is laid out, comes back whole and is written here */
     char *output = NULL;
     size_t len = 0;
+    be->sink = write;
+    be->sink_data = user;
+    err = backend_codegen(be, mod, &output, &len);
+    be->sink = NULL;
+    be->sink_data = NULL;
     
-    anvil_error_t err = anvil_module_codegen(mod, &output, &len);
+    if (err == ANVIL_OK && output && len > 0) {
+        err = write(user, output, len);
+    }
+    free(output);
+    return err;
+}
+
+static anvil_error_t file_write(void *user, const char *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *)user) == len ? ANVIL_OK : ANVIL_ERR_IO;
+}
+
+/* Object files go to the file section by section, without an image of
+ * the whole file in memory */
+static anvil_error_t object_to_file(anvil_module_t *mod, FILE *file)
+{
+    anvil_ctx_t *ctx = mod->ctx;
+    anvil_backend_t *be = ctx->backend;
+    if (!be) {
+        anvil_set_error(ctx, ANVIL_ERR_NO_BACKEND, "No backend configured");
+        return ANVIL_ERR_NO_BACKEND;
+    }
+    
+    anvil_error_t err = prepare_module(be, mod);
+    if (err != ANVIL_OK) return err;
+    
+    anvil_elf_object_t obj;
+    err = backend_object(be, mod, &obj);
     if (err != ANVIL_OK) return err;
+    err = anvil_elf_write_file(&obj, file);
+    anvil_elf_free(&obj);
+    return err;
+}
+
+anvil_error_t anvil_module_codegen_to_file(anvil_module_t *mod, FILE *file)
+{
+    if (!mod || !file) return ANVIL_ERR_INVALID_ARG;
+    
+    anvil_error_t err = mod->ctx->output == ANVIL_OUTPUT_BINARY
+                        ? object_to_file(mod, file)
+                        : anvil_module_codegen_to_sink(mod, file_write, file);
+    if (err == ANVIL_ERR_IO) {
+        anvil_set_error(mod->ctx, ANVIL_ERR_IO, "Write failed");
+    }
+    return err;
+}
+
+anvil_error_t anvil_module_write(anvil_module_t *mod, const char *filename)
+{
+    if (!mod || !filename) return ANVIL_ERR_INVALID_ARG;
+    
+    /* Stream into a temporary next to the target and rename it on success,
+     * so a failed codegen leaves any existing file untouched */
+    size_t name_len = strlen(filename);
+    char *tmp = malloc(name_len + sizeof(".tmp"));
+    if (!tmp) return ANVIL_ERR_NOMEM;
+    memcpy(tmp, filename, name_len);
+    memcpy(tmp + name_len, ".tmp", sizeof(".tmp"));
     
-    FILE *f = fopen(filename, "w");
+    FILE *f = fopen(tmp, mod->ctx->output == ANVIL_OUTPUT_BINARY ? "wb" : "w");
     if (!f) {
-        free(output);
-        anvil_set_error(mod->ctx, ANVIL_ERR_IO, "Cannot open file: %s", filename);
+        anvil_set_error(mod->ctx, ANVIL_ERR_IO, "Cannot open file: %s", tmp);
+        free(tmp);
         return ANVIL_ERR_IO;
     }
     
-    fwrite(output, 1, len, f);
-    fclose(f);
-    free(output);
+    anvil_error_t err = anvil_module_codegen_to_file(mod, f);
+    if (fclose(f) != 0 && err == ANVIL_OK) {
+        anvil_set_error(mod->ctx, ANVIL_ERR_IO, "Cannot write file: %s", tmp);
+        err = ANVIL_ERR_IO;
+    }
+    if (err == ANVIL_OK && rename(tmp, filename) != 0) {
+        anvil_set_error(mod->ctx, ANVIL_ERR_IO, "Cannot write file: %s", filename);
+        err = ANVIL_ERR_IO;
+    }
     
-    return ANVIL_OK;
+    if (err != ANVIL_OK) remove(tmp);
+    free(tmp);
+    return err;
 }
@@ -0,0 +1,226 @@
+/*
+ * ANVIL - Parallel Work
+ *
+ * A minimal fork-join loop for independent per-function work. Workers
+ * claim indices from a shared atomic counter, so long and short items
+ * balance out without any up-front partitioning. Each worker has a
+ * stable number in [0, threads) that callers use to pick their private
+ * scratch state; the calling thread is worker 0.
+ *
+ * Codegen workers only read shared IR and write state owned by the item
+ * or the worker. Optimization workers also create IR: each allocates the
+ * module's IR from a private arena and numbers it from id ranges it
+ * reserves with one atomic add per batch, so only constant and type
+ * interning and the use-lists of globals and functions take ctx->lock.
+ */
+
+#define _DEFAULT_SOURCE
+#include "anvil/anvil_internal.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#define PARALLEL_THREADS 1
+#endif
+
+typedef struct {
+    anvil_parallel_fn fn;
+    void *data;
+    size_t count;
+    atomic_size_t next;
+    atomic_size_t failed;   /* Lowest failing index, or count */
+    anvil_error_t *errors;  /* Per index, read only for the lowest failure */
+} parallel_job_t;
+
+typedef struct {
+    parallel_job_t *job;
+    size_t worker;
+} parallel_worker_t;
+
+static void run_worker(parallel_job_t *job, size_t worker)
+{
+    for (;;) {
+        size_t index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->count) return;
+        /* Items past a failure are still claimed but not run */
+        if (index > atomic_load(&job->failed)) continue;
+
+        anvil_error_t err = job->fn(job->data, worker, index);
+        if (err == ANVIL_OK) continue;
+        job->errors[index] = err;
+        size_t failed = atomic_load(&job->failed);
+        while (index < failed && !atomic_compare_exchange_weak(&job->failed, &failed, index))
+            ;
+    }
+}
+
+#ifdef PARALLEL_THREADS
+static void *worker_main(void *arg)
+{
+    parallel_worker_t *w = arg;
+    run_worker(w->job, w->worker);
+    return NULL;
+}
+#endif
+
+int anvil_parallel_threads(int threads)
+{
+#ifdef PARALLEL_THREADS
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+#endif
+    return threads < 1 ? 1 : threads;
+}
+
+anvil_error_t anvil_parallel_for(int threads, size_t count, anvil_parallel_fn fn, void *data)
+{
+    if (!fn) return ANVIL_ERR_INVALID_ARG;
+    if (count == 0) return ANVIL_OK;
+    if (threads < 1) threads = 1;
+    if ((size_t)threads > count) threads = (int)count;
+
+    parallel_job_t job = { .fn = fn, .data = data, .count = count };
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, count);
+    job.errors = malloc(count * sizeof(anvil_error_t));
+    if (!job.errors) return ANVIL_ERR_NOMEM;
+
+#ifdef PARALLEL_THREADS
+    /* Threads that cannot be started just leave more work to the others */
+    pthread_t *tids = NULL;
+    parallel_worker_t *workers = NULL;
+    int started = 0;
+    if (threads > 1) {
+        tids = malloc((size_t)threads * sizeof(pthread_t));
+        workers = malloc((size_t)threads * sizeof(parallel_worker_t));
+        if (tids && workers) {
+            for (int i = 1; i < threads; i++) {
+                workers[i] = (parallel_worker_t){ &job, (size_t)i };
+                if (pthread_create(&tids[started + 1], NULL, worker_main, &workers[i]) != 0) break;
+                started++;
+            }
+        }
+    }
+    run_worker(&job, 0);
+    for (int i = 1; i <= started; i++) pthread_join(tids[i], NULL);
+    free(tids);
+    free(workers);
+#else
+    run_worker(&job, 0);
+#endif
+
+    size_t failed = atomic_load(&job.failed);
+    anvil_error_t err = failed < count ? job.errors[failed] : ANVIL_OK;
+    free(job.errors);
+    return err;
+}
+
+void anvil_mutex_init(anvil_mutex_t *mutex)
+{
+#ifdef PARALLEL_THREADS
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+#else
+    *mutex = 0;
+#endif
+}
+
+void anvil_mutex_destroy(anvil_mutex_t *mutex)
+{
+#ifdef PARALLEL_THREADS
+    pthread_mutex_destroy(mutex);
+#else
+    (void)mutex;
+#endif
+}
+
+/* Ids a worker reserves at a time; the unused rest of a range is skipped */
+#define VALUE_ID_BATCH 1024
+#define BLOCK_ID_BATCH 64
+
+#ifdef PARALLEL_THREADS
+static _Thread_local anvil_worker_t *current_worker;
+
+static uint32_t reserve_ids(uint32_t *counter, uint32_t count)
+{
+    return __atomic_fetch_add(counter, count, __ATOMIC_RELAXED);
+}
+#else
+static anvil_worker_t *current_worker;
+
+static uint32_t reserve_ids(uint32_t *counter, uint32_t count)
+{
+    uint32_t first = *counter;
+    *counter += count;
+    return first;
+}
+#endif
+
+anvil_worker_t *anvil_parallel_begin(anvil_ctx_t *ctx, anvil_module_t *mod, int threads)
+{
+    anvil_worker_t *workers = calloc((size_t)threads, sizeof(anvil_worker_t));
+    if (!workers) return NULL;
+    for (int i = 0; i < threads; i++) {
+        workers[i].shared = &mod->pool;
+        anvil_pool_init(&workers[i].arena, 0);
+    }
+    
+    ctx->workers = true;
+    ctx->pool.lock = &ctx->lock;
+    mod->pool.lock = &ctx->lock;
+    mod->pool.workers = true;
+    return workers;
+}
+
+void anvil_worker_enter(anvil_worker_t *worker)
+{
+    current_worker = worker;
+}
+
+void anvil_parallel_end(anvil_ctx_t *ctx, anvil_module_t *mod, anvil_worker_t *workers, int threads)
+{
+    current_worker = NULL;
+    ctx->workers = false;
+    ctx->pool.lock = NULL;
+    mod->pool.lock = NULL;
+    mod->pool.workers = false;
+    
+    /* The IR built in the workers' arenas lives as long as the module */
+    for (int i = 0; i < threads; i++) anvil_pool_merge(&mod->pool, &workers[i].arena);
+    free(workers);
+}
+
+anvil_pool_t *anvil_worker_pool(anvil_pool_t *pool)
+{
+    anvil_worker_t *w = current_worker;
+    return w && w->shared == pool ? &w->arena : pool;
+}
+
+uint32_t anvil_worker_value_id(anvil_ctx_t *ctx)
+{
+    anvil_worker_t *w = current_worker;
+    if (!w) return reserve_ids(&ctx->next_value_id, 1);
+    if (w->next_value_id == w->end_value_id) {
+        w->next_value_id = reserve_ids(&ctx->next_value_id, VALUE_ID_BATCH);
+        w->end_value_id = w->next_value_id + VALUE_ID_BATCH;
+    }
+    return w->next_value_id++;
+}
+
+uint32_t anvil_worker_block_id(anvil_ctx_t *ctx)
+{
+    anvil_worker_t *w = current_worker;
+    if (!w) return reserve_ids(&ctx->next_block_id, 1);
+    if (w->next_block_id == w->end_block_id) {
+        w->next_block_id = reserve_ids(&ctx->next_block_id, BLOCK_ID_BATCH);
+        w->end_block_id = w->next_block_id + BLOCK_ID_BATCH;
+    }
+    return w->next_block_id++;
+}
@@ -0,0 +1,486 @@
+/*
+ * ANVIL - Stack-slot coloring
+ *
+ * Assigns frame slots so that values whose lifetimes never overlap share
+ * storage. Lifetimes are hulls over the instruction positions numbered by
+ * the liveness analysis:
+ *
+ *   - SSA values (and parameters) use their live range, widened to cover
+ *     the whole of the instruction that last reads them, and the copy
+ *     point of every edge that feeds them to a phi (backends copy phi
+ *     inputs one at a time).
+ *
+ *   - An alloca's memory is live wherever an access lies both before it
+ *     (forward reachability) and after it (backward liveness). Accesses
+ *     are the alloca itself, and loads and stores through the alloca or
+ *     pointers derived from it by gep, struct_gep and bitcast. Any other
+ *     use lets the address escape and pins the slot for the whole
+ *     function.
+ *
+ * Slots are then handed out by a linear scan in order of start position,
+ * taking the best-fitting free slot whose last member has ended.
+ */
+
+#include "anvil/anvil_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A value that wants a slot */
+typedef struct {
+    int32_t num;            /* Value number */
+    int size;
+    int align;
+    int start;
+    int end;
+} color_item_t;
+
+static void extend(color_item_t *it, int pos)
+{
+    if (it->start < 0 || pos < it->start) it->start = pos;
+    if (pos > it->end) it->end = pos;
+}
+
+static bool is_derived_ptr(anvil_op_t op)
+{
+    return op == ANVIL_OP_GEP || op == ANVIL_OP_STRUCT_GEP || op == ANVIL_OP_BITCAST;
+}
+
+/* Operand i of instr may hold an alloca address without the address escaping */
+static bool is_access(const anvil_instr_t *instr, size_t i)
+{
+    switch (instr->op) {
+        case ANVIL_OP_LOAD:
+            return i == 0;
+        case ANVIL_OP_STORE:
+            return i == 1;
+        case ANVIL_OP_GEP:
+        case ANVIL_OP_STRUCT_GEP:
+        case ANVIL_OP_BITCAST:
+            return i == 0;
+        case ANVIL_OP_CMP_EQ:
+        case ANVIL_OP_CMP_NE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Memory ranges of the allocas in items[0 .. num_mem) */
+typedef struct {
+    const anvil_liveness_t *lv;
+    int32_t *root;          /* Value number -> alloca item, or -1 */
+    bool *escaped;          /* Per alloca item */
+    size_t words;
+    uint64_t *use;          /* Per block: allocas accessed in the block */
+    uint64_t *live_in;
+    uint64_t *live_out;
+    uint64_t *reach_in;
+    uint64_t *reach_out;
+} mem_flow_t;
+
+#define MEM_SET(mf, set, b) ((mf)->set + (size_t)(b) * (mf)->words)
+
+static int32_t root_of(const mem_flow_t *mf, anvil_value_t *val)
+{
+    int32_t num = anvil_liveness_value_num(mf->lv, val);
+    return num < 0 ? -1 : mf->root[num];
+}
+
+/* Find derived pointers and escapes, record access positions */
+static void mem_accesses(mem_flow_t *mf, color_item_t *items)
+{
+    const anvil_liveness_t *lv = mf->lv;
+
+    /* Derived pointers normally follow their base in layout order, but
+     * nothing requires it, so iterate until no root changes */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = 0; b < lv->num_blocks; b++) {
+            for (anvil_instr_t *instr = lv->blocks[b].block->first; instr; instr = instr->next) {
+                if (!is_derived_ptr(instr->op) || instr->num_operands == 0 || !instr->result) continue;
+                int32_t r = root_of(mf, instr->operands[0]);
+                int32_t num = anvil_liveness_value_num(lv, instr->result);
+                if (r >= 0 && num >= 0 && mf->root[num] != r) {
+                    mf->root[num] = r;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (size_t b = 0; b < lv->num_blocks; b++) {
+        anvil_live_block_t *lb = &lv->blocks[b];
+        uint64_t *use = MEM_SET(mf, use, b);
+        int k = lb->first;
+        for (anvil_instr_t *instr = lb->block->first; instr; instr = instr->next) {
+            if (anvil_liveness_copy_before(instr)) k++;
+            if (instr->op == ANVIL_OP_ALLOCA) {
+                int32_t r = root_of(mf, instr->result);
+                if (r >= 0) {
+                    ANVIL_BITSET_SET(use, r);
+                    extend(&items[r], 2 * k);
+                    extend(&items[r], 2 * k + 1);
+                }
+            }
+            for (size_t i = 0; i < instr->num_operands; i++) {
+                int32_t r = root_of(mf, instr->operands[i]);
+                if (r < 0) continue;
+                if (!is_access(instr, i)) {
+                    mf->escaped[r] = true;
+                } else if (instr->op == ANVIL_OP_LOAD || instr->op == ANVIL_OP_STORE) {
+                    ANVIL_BITSET_SET(use, r);
+                    extend(&items[r], 2 * k);
+                    extend(&items[r], 2 * k + 1);
+                }
+            }
+            k++;
+        }
+    }
+}
+
+static bool merge(uint64_t *dst, const uint64_t *a, const uint64_t *b, size_t words)
+{
+    bool changed = false;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t v = a[w] | b[w];
+        if (v != dst[w]) {
+            dst[w] = v;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* Backward liveness and forward reachability of the accesses */
+static anvil_error_t mem_solve(mem_flow_t *mf)
+{
+    const anvil_liveness_t *lv = mf->lv;
+    size_t nb = lv->num_blocks;
+    size_t words = mf->words;
+    int32_t *worklist = malloc((nb ? nb : 1) * sizeof(int32_t));
+    bool *queued = malloc(nb ? nb : 1);
+    if (!worklist || !queued) {
+        free(worklist);
+        free(queued);
+        return ANVIL_ERR_NOMEM;
+    }
+
+    /* live_out = U live_in(succ); live_in = use | live_out */
+    size_t top = 0;
+    for (size_t b = 0; b < nb; b++) {
+        worklist[top++] = (int32_t)b;
+        queued[b] = true;
+    }
+    while (top > 0) {
+        int32_t b = worklist[--top];
+        queued[b] = false;
+        uint64_t *out = MEM_SET(mf, live_out, b);
+        for (int s = 0; s < 2; s++) {
+            int32_t succ = lv->succs[b][s];
+            if (succ >= 0) merge(out, out, MEM_SET(mf, live_in, succ), words);
+        }
+        if (!merge(MEM_SET(mf, live_in, b), MEM_SET(mf, use, b), out, words)) continue;
+        for (size_t i = lv->pred_start[b]; i < lv->pred_start[b + 1]; i++) {
+            int32_t p = lv->preds[i];
+            if (!queued[p]) {
+                queued[p] = true;
+                worklist[top++] = p;
+            }
+        }
+    }
+
+    /* reach_in = U reach_out(pred); reach_out = use | reach_in */
+    top = 0;
+    for (size_t b = nb; b-- > 0;) {
+        worklist[top++] = (int32_t)b;   /* Popped entry block first */
+        queued[b] = true;
+    }
+    while (top > 0) {
+        int32_t b = worklist[--top];
+        queued[b] = false;
+        uint64_t *in = MEM_SET(mf, reach_in, b);
+        for (size_t i = lv->pred_start[b]; i < lv->pred_start[b + 1]; i++)
+            merge(in, in, MEM_SET(mf, reach_out, lv->preds[i]), words);
+        if (!merge(MEM_SET(mf, reach_out, b), MEM_SET(mf, use, b), in, words)) continue;
+        for (int s = 0; s < 2; s++) {
+            int32_t succ = lv->succs[b][s];
+            if (succ >= 0 && !queued[succ]) {
+                queued[succ] = true;
+                worklist[top++] = succ;
+            }
+        }
+    }
+
+    free(worklist);
+    free(queued);
+    return ANVIL_OK;
+}
+
+static void mem_extend(const mem_flow_t *mf, color_item_t *items, const uint64_t *a,
+                       const uint64_t *b, int pos)
+{
+    for (size_t w = 0; w < mf->words; w++) {
+        uint64_t bits = a[w] & b[w];
+        while (bits) {
+            extend(&items[w * 64 + (size_t)__builtin_ctzll(bits)], pos);
+            bits &= bits - 1;
+        }
+    }
+}
+
+static anvil_error_t mem_ranges(const anvil_liveness_t *lv, color_item_t *items,
+                                size_t num_mem)
+{
+    if (num_mem == 0) return ANVIL_OK;
+
+    mem_flow_t mf;
+    memset(&mf, 0, sizeof(mf));
+    mf.lv = lv;
+    mf.words = ANVIL_BITSET_WORDS(num_mem);
+    size_t nb = lv->num_blocks ? lv->num_blocks : 1;
+    size_t set_words = nb * mf.words;
+    mf.root = malloc((lv->num_values ? lv->num_values : 1) * sizeof(int32_t));
+    mf.escaped = calloc(num_mem, sizeof(bool));
+    mf.use = calloc(5 * set_words, sizeof(uint64_t));
+    anvil_error_t err = ANVIL_ERR_NOMEM;
+    if (!mf.root || !mf.escaped || !mf.use) goto out;
+    mf.live_in = mf.use + set_words;
+    mf.live_out = mf.live_in + set_words;
+    mf.reach_in = mf.live_out + set_words;
+    mf.reach_out = mf.reach_in + set_words;
+
+    memset(mf.root, 0xff, lv->num_values * sizeof(int32_t));
+    for (size_t i = 0; i < num_mem; i++) mf.root[items[i].num] = (int32_t)i;
+
+    mem_accesses(&mf, items);
+    err = mem_solve(&mf);
+    if (err != ANVIL_OK) goto out;
+
+    for (size_t b = 0; b < lv->num_blocks; b++) {
+        anvil_live_block_t *lb = &lv->blocks[b];
+        mem_extend(&mf, items, MEM_SET(&mf, live_in, b), MEM_SET(&mf, reach_in, b), 2 * lb->first);
+        mem_extend(&mf, items, MEM_SET(&mf, live_out, b), MEM_SET(&mf, reach_out, b),
+                   2 * lb->last + 1);
+    }
+    for (size_t i = 0; i < num_mem; i++) {
+        if (mf.escaped[i]) {
+            items[i].start = 0;
+            items[i].end = 2 * lv->num_indices + 1;
+        }
+    }
+
+out:
+    free(mf.root);
+    free(mf.escaped);
+    free(mf.use);
+    return err;
+}
+
+/* Phi inputs stay live until the copy into the phi is done */
+static void phi_ranges(const anvil_liveness_t *lv, const int32_t *item_of, color_item_t *items)
+{
+    for (size_t b = 0; b < lv->num_blocks; b++) {
+        for (anvil_instr_t *phi = lv->blocks[b].block->first; phi && phi->op == ANVIL_OP_PHI;
+             phi = phi->next) {
+            for (size_t i = 0; i < phi->num_phi_incoming && i < phi->num_operands; i++) {
+                anvil_live_block_t *pb = anvil_liveness_block(lv, phi->phi_blocks[i]);
+                int32_t num = anvil_liveness_value_num(lv, phi->operands[i]);
+                if (pb && num >= 0 && item_of[num] >= 0)
+                    extend(&items[item_of[num]], 2 * pb->copy + 1);
+            }
+        }
+    }
+}
+
+static int cmp_items(const void *a, const void *b)
+{
+    const color_item_t *x = a, *y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    if (x->end != y->end) return x->end < y->end ? -1 : 1;
+    return x->num < y->num ? -1 : (x->num > y->num);
+}
+
+/* Min-heap of busy slots keyed by the end of their last member */
+typedef struct {
+    int32_t *slot;
+    size_t count;
+} busy_heap_t;
+
+static void heap_push(busy_heap_t *h, const int *busy_end, int32_t slot)
+{
+    size_t i = h->count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (busy_end[h->slot[parent]] <= busy_end[slot]) break;
+        h->slot[i] = h->slot[parent];
+        i = parent;
+    }
+    h->slot[i] = slot;
+}
+
+static int32_t heap_pop(busy_heap_t *h, const int *busy_end)
+{
+    int32_t top = h->slot[0];
+    int32_t last = h->slot[--h->count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= h->count) break;
+        if (child + 1 < h->count && busy_end[h->slot[child + 1]] < busy_end[h->slot[child]])
+            child++;
+        if (busy_end[last] <= busy_end[h->slot[child]]) break;
+        h->slot[i] = h->slot[child];
+        i = child;
+    }
+    if (h->count > 0) h->slot[i] = last;
+    return top;
+}
+
+static size_t align_up(size_t size, int align)
+{
+    return align > 1 ? (size + (size_t)align - 1) & ~((size_t)align - 1) : size;
+}
+
+static anvil_error_t assign_slots(anvil_stack_colors_t *sc, color_item_t *items, size_t n)
+{
+    qsort(items, n, sizeof(color_item_t), cmp_items);
+
+    sc->slots = calloc(n ? n : 1, sizeof(anvil_frame_slot_t));
+    int *busy_end = malloc((n ? n : 1) * sizeof(int));
+    busy_heap_t heap = { malloc((n ? n : 1) * sizeof(int32_t)), 0 };
+    int32_t *free_slots = malloc((n ? n : 1) * sizeof(int32_t));
+    size_t num_free = 0;
+    anvil_error_t err = ANVIL_ERR_NOMEM;
+    if (!sc->slots || !busy_end || !heap.slot || !free_slots) goto out;
+
+    for (size_t i = 0; i < n; i++) {
+        color_item_t *it = &items[i];
+        while (heap.count > 0 && busy_end[heap.slot[0]] < it->start)
+            free_slots[num_free++] = heap_pop(&heap, busy_end);
+
+        /* Smallest free slot that fits, else the largest one (which grows) */
+        size_t best = num_free;
+        for (size_t f = 0; f < num_free; f++) {
+            anvil_frame_slot_t *cand = &sc->slots[free_slots[f]];
+            if (best == num_free) {
+                best = f;
+                continue;
+            }
+            anvil_frame_slot_t *cur = &sc->slots[free_slots[best]];
+            bool fits = cand->size >= it->size, cur_fits = cur->size >= it->size;
+            if (fits != cur_fits ? fits : (fits ? cand->size < cur->size : cand->size > cur->size))
+                best = f;
+        }
+
+        int32_t s;
+        if (best < num_free) {
+            s = free_slots[best];
+            free_slots[best] = free_slots[--num_free];
+        } else {
+            s = (int32_t)sc->num_slots++;
+            sc->slots[s].offset = 0;
+            sc->slots[s].placed = false;
+        }
+        anvil_frame_slot_t *slot = &sc->slots[s];
+        if (it->size > slot->size) slot->size = it->size;
+        if (it->align > slot->align) slot->align = it->align;
+        busy_end[s] = it->end;
+        heap_push(&heap, busy_end, s);
+        sc->value_slot[it->num] = s;
+        sc->bytes_requested += align_up((size_t)it->size, it->align);
+    }
+
+    for (size_t s = 0; s < sc->num_slots; s++)
+        sc->bytes_colored += align_up((size_t)sc->slots[s].size, sc->slots[s].align);
+    err = ANVIL_OK;
+
+out:
+    free(busy_end);
+    free(heap.slot);
+    free(free_slots);
+    return err;
+}
+
+anvil_error_t anvil_stack_color(anvil_stack_colors_t *sc, anvil_func_t *func,
+                                const anvil_liveness_t *lv,
+                                anvil_slot_size_fn size_fn, void *data)
+{
+    if (!sc || !func || !size_fn) return ANVIL_ERR_INVALID_ARG;
+
+    memset(sc, 0, sizeof(*sc));
+    if (!lv) {
+        anvil_error_t err = anvil_liveness_compute(&sc->own_live, func);
+        if (err != ANVIL_OK) return err;
+        lv = &sc->own_live;
+    }
+    sc->live = lv;
+
+    size_t nv = lv->num_values;
+    color_item_t *items = malloc((nv ? nv : 1) * sizeof(color_item_t));
+    int32_t *item_of = malloc((nv ? nv : 1) * sizeof(int32_t));
+    sc->value_slot = malloc((nv ? nv : 1) * sizeof(int32_t));
+    anvil_error_t err = ANVIL_ERR_NOMEM;
+    if (!items || !item_of || !sc->value_slot) goto out;
+    memset(item_of, 0xff, nv * sizeof(int32_t));
+    memset(sc->value_slot, 0xff, nv * sizeof(int32_t));
+
+    /* Allocas first so their item index doubles as their memory bit */
+    size_t n = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t v = 0; v < nv; v++) {
+            anvil_value_t *val = lv->ranges[v].value;
+            bool is_alloca = val->kind == ANVIL_VAL_INSTR && val->data.instr->op == ANVIL_OP_ALLOCA;
+            if (is_alloca != (pass == 0)) continue;
+            int align = 1;
+            int size = size_fn(val, &align, data);
+            if (size <= 0) continue;
+            color_item_t *it = &items[n];
+            it->num = (int32_t)v;
+            it->size = size;
+            it->align = align > 0 ? align : 1;
+            it->start = it->end = -1;
+            if (!is_alloca) {
+                /* A slot is held through the whole of its last instruction */
+                it->start = lv->ranges[v].start;
+                it->end = lv->ranges[v].end | 1;
+            }
+            item_of[v] = (int32_t)n++;
+        }
+        if (pass == 0 && (err = mem_ranges(lv, items, n)) != ANVIL_OK) goto out;
+    }
+    sc->num_values = n;
+    phi_ranges(lv, item_of, items);
+    for (size_t i = 0; i < n; i++) {
+        if (items[i].start < 0) items[i].start = items[i].end = 0;
+    }
+
+    err = assign_slots(sc, items, n);
+    if (err == ANVIL_OK) {
+        func->slot_bytes = sc->bytes_requested;
+        func->slot_bytes_colored = sc->bytes_colored;
+    }
+
+out:
+    free(items);
+    free(item_of);
+    if (err != ANVIL_OK) anvil_stack_colors_free(sc);
+    return err;
+}
+
+void anvil_stack_colors_free(anvil_stack_colors_t *sc)
+{
+    if (!sc) return;
+    free(sc->value_slot);
+    free(sc->slots);
+    anvil_liveness_free(&sc->own_live);
+    memset(sc, 0, sizeof(*sc));
+}
+
+anvil_frame_slot_t *anvil_stack_color_slot(const anvil_stack_colors_t *sc, anvil_value_t *val)
+{
+    if (!sc || !sc->value_slot) return NULL;
+    int32_t num = anvil_liveness_value_num(sc->live, val);
+    if (num < 0 || sc->value_slot[num] < 0) return NULL;
+    return &sc->slots[sc->value_slot[num]];
+}
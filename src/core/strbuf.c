@@ -16,6 +16,9 @@ void anvil_strbuf_init(anvil_strbuf_t *sb)
     sb->data = malloc(STRBUF_INIT_CAP);
     sb->len = 0;
     sb->cap = STRBUF_INIT_CAP;
+    sb->sink = NULL;
+    sb->sink_data = NULL;
+    sb->sink_err = ANVIL_OK;
     if (sb->data) sb->data[0] = '\0';
 }
 
@@ -26,6 +29,9 @@ void anvil_strbuf_destroy(anvil_strbuf_t *sb)
     sb->data = NULL;
     sb->len = 0;
     sb->cap = 0;
+    sb->sink = NULL;
+    sb->sink_data = NULL;
+    sb->sink_err = ANVIL_OK;
 }
 
 static void strbuf_grow(anvil_strbuf_t *sb, size_t needed)
@@ -49,35 +55,38 @@ static void strbuf_grow(anvil_strbuf_t *sb, size_t needed)
 void anvil_strbuf_append(anvil_strbuf_t *sb, const char *str)
 {
     if (!sb || !str) return;
-    
-    size_t len = strlen(str);
-    strbuf_grow(sb, len);
-    
-    memcpy(sb->data + sb->len, str, len);
-    sb->len += len;
-    sb->data[sb->len] = '\0';
+    anvil_strbuf_append_n(sb, str, strlen(str));
 }
 
 void anvil_strbuf_appendf(anvil_strbuf_t *sb, const char *fmt, ...)
 {
-    if (!sb || !fmt) return;
+    if (!sb || !sb->data || !fmt) return;
     
     va_list args, args_copy;
     va_start(args, fmt);
     va_copy(args_copy, args);
     
-    /* Calculate needed size */
-    int needed = vsnprintf(NULL, 0, fmt, args);
+    /* Format straight into the spare capacity; only output that does not
+     * fit needs a second pass */
+    size_t avail = sb->cap - sb->len;
+    int needed = vsnprintf(sb->data + sb->len, avail, fmt, args);
     va_end(args);
     
     if (needed < 0) {
+        sb->data[sb->len] = '\0';
         va_end(args_copy);
         return;
     }
     
-    strbuf_grow(sb, (size_t)needed);
-    
-    vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, args_copy);
+    if ((size_t)needed >= avail) {
+        strbuf_grow(sb, (size_t)needed);
+        if (sb->cap - sb->len <= (size_t)needed) {
+            sb->data[sb->len] = '\0';
+            va_end(args_copy);
+            return;
+        }
+        vsnprintf(sb->data + sb->len, sb->cap - sb->len, fmt, args_copy);
+    }
     sb->len += (size_t)needed;
     va_end(args_copy);
 }
@@ -104,3 +113,141 @@ char *anvil_strbuf_detach(anvil_strbuf_t *sb, size_t *len)
     
     return data;
 }
+
+/* ============================================================================
+ * Emission primitives
+ * ============================================================================
+ *
+ * Backends emit one line per instruction, mostly mnemonics, register
+ * names, small integers and labels. These append them directly, with
+ * table-driven number conversion, so hot paths skip format parsing.
+ */
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+void anvil_strbuf_append_n(anvil_strbuf_t *sb, const char *str, size_t len)
+{
+    if (!sb || !str) return;
+    
+    strbuf_grow(sb, len);
+    if (sb->cap - sb->len <= len) return;
+    
+    memcpy(sb->data + sb->len, str, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+}
+
+void anvil_strbuf_append_uint(anvil_strbuf_t *sb, uint64_t val)
+{
+    char buf[20];
+    char *p = buf + sizeof(buf);
+    
+    while (val >= 100) {
+        const char *pair = &digit_pairs[(val % 100) * 2];
+        val /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (val >= 10) {
+        *--p = digit_pairs[val * 2 + 1];
+        *--p = digit_pairs[val * 2];
+    } else {
+        *--p = (char)('0' + val);
+    }
+    anvil_strbuf_append_n(sb, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void anvil_strbuf_append_int(anvil_strbuf_t *sb, int64_t val)
+{
+    if (val < 0) {
+        anvil_strbuf_append_char(sb, '-');
+        anvil_strbuf_append_uint(sb, (uint64_t)0 - (uint64_t)val);
+    } else {
+        anvil_strbuf_append_uint(sb, (uint64_t)val);
+    }
+}
+
+void anvil_strbuf_append_hex(anvil_strbuf_t *sb, uint64_t val, int min_digits)
+{
+    char buf[16];
+    char *p = buf + sizeof(buf);
+    
+    do {
+        *--p = hex_digits[val & 0xf];
+        val >>= 4;
+    } while (val && p > buf);
+    while (buf + sizeof(buf) - p < min_digits && p > buf) *--p = '0';
+    anvil_strbuf_append_n(sb, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+void anvil_strbuf_append_mnemonic(anvil_strbuf_t *sb, const char *mnemonic, const char *suffix)
+{
+    anvil_strbuf_append_char(sb, '\t');
+    anvil_strbuf_append(sb, mnemonic);
+    if (suffix) anvil_strbuf_append(sb, suffix);
+    anvil_strbuf_append_char(sb, ' ');
+}
+
+void anvil_strbuf_append_reg(anvil_strbuf_t *sb, const char *prefix, const char *name)
+{
+    if (prefix) anvil_strbuf_append(sb, prefix);
+    anvil_strbuf_append(sb, name);
+}
+
+void anvil_strbuf_append_imm(anvil_strbuf_t *sb, const char *prefix, int64_t val)
+{
+    if (prefix) anvil_strbuf_append(sb, prefix);
+    anvil_strbuf_append_int(sb, val);
+}
+
+void anvil_strbuf_append_label(anvil_strbuf_t *sb, const char *prefix,
+                               const char *func, const char *block)
+{
+    if (prefix) anvil_strbuf_append(sb, prefix);
+    anvil_strbuf_append(sb, func);
+    anvil_strbuf_append_char(sb, '_');
+    anvil_strbuf_append(sb, block);
+}
+
+void anvil_strbuf_set_sink(anvil_strbuf_t *sb, anvil_write_fn sink, void *data)
+{
+    if (!sb) return;
+    sb->sink = sink;
+    sb->sink_data = data;
+    sb->sink_err = ANVIL_OK;
+}
+
+anvil_error_t anvil_strbuf_flush(anvil_strbuf_t *sb)
+{
+    if (!sb) return ANVIL_ERR_INVALID_ARG;
+    if (!sb->sink || sb->len == 0) return sb->sink_err;
+    
+    /* After a failed write, later output is dropped rather than retried */
+    if (sb->sink_err == ANVIL_OK) {
+        sb->sink_err = sb->sink(sb->sink_data, sb->data, sb->len);
+    }
+    
+    /* Keep the capacity: the next function likely needs as much */
+    sb->len = 0;
+    if (sb->data) sb->data[0] = '\0';
+    return sb->sink_err;
+}
+
+anvil_error_t anvil_strbuf_finish(anvil_strbuf_t *sb, char **output, size_t *len)
+{
+    if (!sb || !output) return ANVIL_ERR_INVALID_ARG;
+    
+    if (sb->sink) {
+        *output = NULL;
+        if (len) *len = 0;
+        return anvil_strbuf_flush(sb);
+    }
+    
+    *output = anvil_strbuf_detach(sb, len);
+    return ANVIL_OK;
+}
@@ -8,7 +8,7 @@
 
 anvil_type_t *anvil_type_create(anvil_ctx_t *ctx, anvil_type_kind_t kind)
 {
-    anvil_type_t *type = calloc(1, sizeof(anvil_type_t));
+    anvil_type_t *type = anvil_alloc(ctx, sizeof(anvil_type_t));
     if (!type) return NULL;
     type->kind = kind;
     return type;
@@ -18,9 +18,6 @@ void anvil_type_init_sizes(anvil_ctx_t *ctx)
 {
     if (!ctx) return;
     
-    const anvil_arch_info_t *arch = anvil_ctx_get_arch_info(ctx);
-    int ptr_size = arch ? arch->ptr_size : 8;
-    
     /* Create void type */
     if (!ctx->type_void) {
         ctx->type_void = anvil_type_create(ctx, ANVIL_TYPE_VOID);
@@ -162,43 +159,226 @@ anvil_type_t *anvil_type_f64(anvil_ctx_t *ctx)
     return ctx ? ctx->type_f64 : NULL;
 }
 
-anvil_type_t *anvil_type_ptr(anvil_ctx_t *ctx, anvil_type_t *pointee)
+/* ============================================================================
+ * Type interning
+ *
+ * Derived types are hash-consed per context: structurally identical
+ * pointer, array, struct and function types share one object, so type
+ * equality is pointer comparison. The pointer-to-T type is additionally
+ * cached on T itself.
+ * ============================================================================ */
+
+static uint64_t hash_mix(uint64_t h, uint64_t v)
 {
-    if (!ctx) return NULL;
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+static uint64_t hash_type_array(uint64_t h, anvil_type_t **types, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        h = hash_mix(h, (uint64_t)(uintptr_t)(types ? types[i] : NULL));
+    }
+    return h;
+}
+
+static uint64_t type_hash(const anvil_type_t *t)
+{
+    uint64_t h = hash_mix(0, (uint64_t)t->kind);
     
-    anvil_type_t *type = anvil_type_create(ctx, ANVIL_TYPE_PTR);
-    if (!type) return NULL;
+    switch (t->kind) {
+        case ANVIL_TYPE_PTR:
+            h = hash_mix(h, (uint64_t)(uintptr_t)t->data.pointee);
+            h = hash_mix(h, t->size);
+            break;
+        case ANVIL_TYPE_ARRAY:
+            h = hash_mix(h, (uint64_t)(uintptr_t)t->data.array.elem);
+            h = hash_mix(h, t->data.array.count);
+            break;
+        case ANVIL_TYPE_STRUCT:
+            if (t->data.struc.name) {
+                for (const char *c = t->data.struc.name; *c; c++) {
+                    h = hash_mix(h, (unsigned char)*c);
+                }
+            }
+            h = hash_mix(h, t->data.struc.packed);
+            h = hash_type_array(h, t->data.struc.fields, t->data.struc.num_fields);
+            break;
+        case ANVIL_TYPE_FUNC:
+            h = hash_mix(h, (uint64_t)(uintptr_t)t->data.func.ret);
+            h = hash_mix(h, t->data.func.variadic);
+            h = hash_type_array(h, t->data.func.params, t->data.func.num_params);
+            break;
+        default:
+            break;
+    }
+    
+    return h;
+}
+
+static bool type_arrays_equal(anvil_type_t **a, anvil_type_t **b, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if ((a ? a[i] : NULL) != (b ? b[i] : NULL)) return false;
+    }
+    return true;
+}
+
+static bool type_equal(const anvil_type_t *a, const anvil_type_t *b)
+{
+    if (a->kind != b->kind) return false;
+    
+    switch (a->kind) {
+        case ANVIL_TYPE_PTR:
+            return a->data.pointee == b->data.pointee && a->size == b->size;
+        case ANVIL_TYPE_ARRAY:
+            return a->data.array.elem == b->data.array.elem &&
+                   a->data.array.count == b->data.array.count;
+        case ANVIL_TYPE_STRUCT: {
+            const char *na = a->data.struc.name;
+            const char *nb = b->data.struc.name;
+            if ((na == NULL) != (nb == NULL)) return false;
+            if (na && strcmp(na, nb) != 0) return false;
+            return a->data.struc.packed == b->data.struc.packed &&
+                   a->data.struc.num_fields == b->data.struc.num_fields &&
+                   type_arrays_equal(a->data.struc.fields, b->data.struc.fields,
+                                     a->data.struc.num_fields);
+        }
+        case ANVIL_TYPE_FUNC:
+            return a->data.func.ret == b->data.func.ret &&
+                   a->data.func.variadic == b->data.func.variadic &&
+                   a->data.func.num_params == b->data.func.num_params &&
+                   type_arrays_equal(a->data.func.params, b->data.func.params,
+                                     a->data.func.num_params);
+        default:
+            return false;
+    }
+}
+
+/* Find the slot for a type key: either its interned twin or an empty slot */
+static anvil_type_t **type_table_slot(anvil_ctx_t *ctx, const anvil_type_t *key, uint64_t hash)
+{
+    size_t mask = ctx->type_table.cap - 1;
+    size_t i = (size_t)hash & mask;
+    
+    while (ctx->type_table.slots[i]) {
+        if (type_equal(ctx->type_table.slots[i], key)) break;
+        i = (i + 1) & mask;
+    }
+    return &ctx->type_table.slots[i];
+}
+
+static bool type_table_grow(anvil_ctx_t *ctx)
+{
+    size_t old_cap = ctx->type_table.cap;
+    anvil_type_t **old_slots = ctx->type_table.slots;
+    size_t new_cap = old_cap ? old_cap * 2 : 256;
+    
+    anvil_type_t **slots = calloc(new_cap, sizeof(anvil_type_t *));
+    if (!slots) return false;
+    
+    ctx->type_table.slots = slots;
+    ctx->type_table.cap = new_cap;
+    
+    for (size_t i = 0; i < old_cap; i++) {
+        anvil_type_t *t = old_slots[i];
+        if (t) *type_table_slot(ctx, t, type_hash(t)) = t;
+    }
+    
+    free(old_slots);
+    return true;
+}
+
+/* Look up a type by structure; returns NULL and sets *slot if absent */
+static anvil_type_t *type_intern_lookup(anvil_ctx_t *ctx, const anvil_type_t *key,
+                                         anvil_type_t ***slot)
+{
+    /* Keep load factor below 3/4 */
+    if ((ctx->type_table.count + 1) * 4 > ctx->type_table.cap * 3) {
+        if (!type_table_grow(ctx)) return NULL;
+    }
+    
+    *slot = type_table_slot(ctx, key, type_hash(key));
+    return **slot;
+}
+
+static void type_intern_insert(anvil_ctx_t *ctx, anvil_type_t **slot, anvil_type_t *type)
+{
+    *slot = type;
+    ctx->type_table.count++;
+}
+
+void anvil_type_table_destroy(anvil_ctx_t *ctx)
+{
+    if (!ctx) return;
+    free(ctx->type_table.slots);
+    ctx->type_table.slots = NULL;
+    ctx->type_table.count = 0;
+    ctx->type_table.cap = 0;
+}
+
+static anvil_type_t *type_ptr(anvil_ctx_t *ctx, anvil_type_t *pointee)
+{
+    if (!ctx) return NULL;
     
     const anvil_arch_info_t *arch = anvil_ctx_get_arch_info(ctx);
-    type->size = arch ? arch->ptr_size : 8;
-    type->align = type->size;
-    type->data.pointee = pointee;
+    size_t ptr_size = arch ? arch->ptr_size : 8;
+    
+    /* Fast path: pointer type cached on the pointee */
+    if (pointee && pointee->ptr_to && pointee->ptr_to->size == ptr_size) {
+        return pointee->ptr_to;
+    }
+    
+    anvil_type_t key = { .kind = ANVIL_TYPE_PTR, .size = ptr_size };
+    key.data.pointee = pointee;
     
+    anvil_type_t **slot = NULL;
+    anvil_type_t *type = type_intern_lookup(ctx, &key, &slot);
+    if (!type) {
+        if (!slot) return NULL;
+        
+        type = anvil_type_create(ctx, ANVIL_TYPE_PTR);
+        if (!type) return NULL;
+        
+        type->size = ptr_size;
+        type->align = type->size;
+        type->data.pointee = pointee;
+        type_intern_insert(ctx, slot, type);
+    }
+    
+    if (pointee) pointee->ptr_to = type;
     return type;
 }
 
-anvil_type_t *anvil_type_struct(anvil_ctx_t *ctx, const char *name,
-                                 anvil_type_t **fields, size_t num_fields)
+static anvil_type_t *type_struct(anvil_ctx_t *ctx, const char *name,
+                                anvil_type_t **fields, size_t num_fields)
 {
     if (!ctx) return NULL;
+    if (num_fields > 0 && !fields) return NULL;
     
-    anvil_type_t *type = anvil_type_create(ctx, ANVIL_TYPE_STRUCT);
+    anvil_type_t key = { .kind = ANVIL_TYPE_STRUCT };
+    key.data.struc.name = (char *)name;
+    key.data.struc.fields = fields;
+    key.data.struc.num_fields = num_fields;
+    key.data.struc.packed = false;
+    
+    anvil_type_t **slot = NULL;
+    anvil_type_t *type = type_intern_lookup(ctx, &key, &slot);
+    if (type) return type;
+    if (!slot) return NULL;
+    
+    type = anvil_type_create(ctx, ANVIL_TYPE_STRUCT);
     if (!type) return NULL;
     
-    type->data.struc.name = name ? strdup(name) : NULL;
+    type->data.struc.name = anvil_strdup(ctx, name);
     type->data.struc.num_fields = num_fields;
     type->data.struc.packed = false;
     
     if (num_fields > 0) {
-        type->data.struc.fields = calloc(num_fields, sizeof(anvil_type_t *));
-        type->data.struc.offsets = calloc(num_fields, sizeof(size_t));
+        type->data.struc.fields = anvil_alloc(ctx, num_fields * sizeof(anvil_type_t *));
+        type->data.struc.offsets = anvil_alloc(ctx, num_fields * sizeof(size_t));
         
-        if (!type->data.struc.fields || !type->data.struc.offsets) {
-            free(type->data.struc.fields);
-            free(type->data.struc.offsets);
-            free(type);
-            return NULL;
-        }
+        if (!type->data.struc.fields || !type->data.struc.offsets) return NULL;
         
         /* Calculate offsets and total size */
         size_t offset = 0;
@@ -221,14 +401,24 @@ anvil_type_t *anvil_type_struct(anvil_ctx_t *ctx, const char *name,
         type->align = max_align;
     }
     
+    type_intern_insert(ctx, slot, type);
     return type;
 }
 
-anvil_type_t *anvil_type_array(anvil_ctx_t *ctx, anvil_type_t *elem, size_t count)
+static anvil_type_t *type_array(anvil_ctx_t *ctx, anvil_type_t *elem, size_t count)
 {
     if (!ctx || !elem) return NULL;
     
-    anvil_type_t *type = anvil_type_create(ctx, ANVIL_TYPE_ARRAY);
+    anvil_type_t key = { .kind = ANVIL_TYPE_ARRAY };
+    key.data.array.elem = elem;
+    key.data.array.count = count;
+    
+    anvil_type_t **slot = NULL;
+    anvil_type_t *type = type_intern_lookup(ctx, &key, &slot);
+    if (type) return type;
+    if (!slot) return NULL;
+    
+    type = anvil_type_create(ctx, ANVIL_TYPE_ARRAY);
     if (!type) return NULL;
     
     type->data.array.elem = elem;
@@ -236,27 +426,36 @@ anvil_type_t *anvil_type_array(anvil_ctx_t *ctx, anvil_type_t *elem, size_t coun
     type->size = elem->size * count;
     type->align = elem->align;
     
+    type_intern_insert(ctx, slot, type);
     return type;
 }
 
-anvil_type_t *anvil_type_func(anvil_ctx_t *ctx, anvil_type_t *ret,
-                               anvil_type_t **params, size_t num_params, bool variadic)
+static anvil_type_t *type_func(anvil_ctx_t *ctx, anvil_type_t *ret,
+                              anvil_type_t **params, size_t num_params, bool variadic)
 {
     if (!ctx) return NULL;
     
-    anvil_type_t *type = anvil_type_create(ctx, ANVIL_TYPE_FUNC);
+    anvil_type_t key = { .kind = ANVIL_TYPE_FUNC };
+    key.data.func.ret = ret ? ret : ctx->type_void;
+    key.data.func.params = params;
+    key.data.func.num_params = num_params;
+    key.data.func.variadic = variadic;
+    
+    anvil_type_t **slot = NULL;
+    anvil_type_t *type = type_intern_lookup(ctx, &key, &slot);
+    if (type) return type;
+    if (!slot) return NULL;
+    
+    type = anvil_type_create(ctx, ANVIL_TYPE_FUNC);
     if (!type) return NULL;
     
-    type->data.func.ret = ret ? ret : ctx->type_void;
+    type->data.func.ret = key.data.func.ret;
     type->data.func.num_params = num_params;
     type->data.func.variadic = variadic;
     
     if (num_params > 0 && params) {
-        type->data.func.params = calloc(num_params, sizeof(anvil_type_t *));
-        if (!type->data.func.params) {
-            free(type);
-            return NULL;
-        }
+        type->data.func.params = anvil_alloc(ctx, num_params * sizeof(anvil_type_t *));
+        if (!type->data.func.params) return NULL;
         memcpy(type->data.func.params, params, num_params * sizeof(anvil_type_t *));
     }
     
@@ -264,6 +463,47 @@ anvil_type_t *anvil_type_func(anvil_ctx_t *ctx, anvil_type_t *ret,
     type->size = 0;
     type->align = 1;
     
+    type_intern_insert(ctx, slot, type);
+    return type;
+}
+
+/* The intern table and ptr_to caches are shared by the workers of a
+ * parallel pass run (see parallel.c) */
+anvil_type_t *anvil_type_ptr(anvil_ctx_t *ctx, anvil_type_t *pointee)
+{
+    if (!ctx) return NULL;
+    anvil_mutex_lock(ctx->pool.lock);
+    anvil_type_t *type = type_ptr(ctx, pointee);
+    anvil_mutex_unlock(ctx->pool.lock);
+    return type;
+}
+
+anvil_type_t *anvil_type_struct(anvil_ctx_t *ctx, const char *name,
+                                 anvil_type_t **fields, size_t num_fields)
+{
+    if (!ctx) return NULL;
+    anvil_mutex_lock(ctx->pool.lock);
+    anvil_type_t *type = type_struct(ctx, name, fields, num_fields);
+    anvil_mutex_unlock(ctx->pool.lock);
+    return type;
+}
+
+anvil_type_t *anvil_type_array(anvil_ctx_t *ctx, anvil_type_t *elem, size_t count)
+{
+    if (!ctx) return NULL;
+    anvil_mutex_lock(ctx->pool.lock);
+    anvil_type_t *type = type_array(ctx, elem, count);
+    anvil_mutex_unlock(ctx->pool.lock);
+    return type;
+}
+
+anvil_type_t *anvil_type_func(anvil_ctx_t *ctx, anvil_type_t *ret,
+                               anvil_type_t **params, size_t num_params, bool variadic)
+{
+    if (!ctx) return NULL;
+    anvil_mutex_lock(ctx->pool.lock);
+    anvil_type_t *type = type_func(ctx, ret, params, num_params, variadic);
+    anvil_mutex_unlock(ctx->pool.lock);
     return type;
 }
 
@@ -6,54 +6,306 @@
 #include <stdlib.h>
 #include <string.h>
 
-anvil_value_t *anvil_value_create(anvil_ctx_t *ctx, anvil_val_kind_t kind,
+static void value_init(anvil_ctx_t *ctx, anvil_pool_t *pool, anvil_value_t *val,
+                       anvil_val_kind_t kind, anvil_type_t *type, const char *name)
+{
+    val->kind = kind;
+    val->type = type;
+    val->name = name ? anvil_pool_strdup(pool, name) : NULL;
+    val->id = anvil_new_value_id(ctx);
+}
+
+anvil_value_t *anvil_value_create(anvil_ctx_t *ctx, anvil_pool_t *pool, anvil_val_kind_t kind,
                                    anvil_type_t *type, const char *name)
 {
-    if (!ctx) return NULL;
+    if (!ctx || !pool) return NULL;
     
-    anvil_value_t *val = calloc(1, sizeof(anvil_value_t));
+    anvil_value_t *val = anvil_pool_alloc(pool, sizeof(anvil_value_t));
     if (!val) return NULL;
     
-    val->kind = kind;
-    val->type = type;
-    val->name = name ? strdup(name) : NULL;
-    val->id = ctx->next_value_id++;
-    
+    value_init(ctx, pool, val, kind, type, name);
     return val;
 }
 
-anvil_instr_t *anvil_instr_create(anvil_ctx_t *ctx, anvil_op_t op,
-                                   anvil_type_t *type, const char *name)
+anvil_instr_t *anvil_instr_create_in(anvil_ctx_t *ctx, anvil_pool_t *pool, anvil_op_t op,
+                                      anvil_type_t *type, const char *name)
 {
-    if (!ctx) return NULL;
+    if (!ctx || !pool) return NULL;
     
-    anvil_instr_t *instr = calloc(1, sizeof(anvil_instr_t));
+    /* The result value is allocated together with the instruction */
+    bool has_result = type && type->kind != ANVIL_TYPE_VOID;
+    size_t size = sizeof(anvil_instr_t) + (has_result ? sizeof(anvil_value_t) : 0);
+    
+    anvil_instr_t *instr = anvil_pool_alloc(pool, size);
     if (!instr) return NULL;
     
     instr->op = op;
+    instr->pool = pool;
+    instr->operands = instr->inline_ops;
+    instr->uses = instr->inline_uses;
+    instr->cap_operands = ANVIL_INSTR_INLINE_OPS;
     
-    /* Create result value if not void */
-    if (type && type->kind != ANVIL_TYPE_VOID) {
-        instr->result = anvil_value_create(ctx, ANVIL_VAL_INSTR, type, name);
-        if (instr->result) {
-            instr->result->data.instr = instr;
-        }
+    if (has_result) {
+        instr->result = (anvil_value_t *)(instr + 1);
+        value_init(ctx, pool, instr->result, ANVIL_VAL_INSTR, type, name);
+        instr->result->data.instr = instr;
     }
     
     return instr;
 }
 
+anvil_instr_t *anvil_instr_create(anvil_ctx_t *ctx, anvil_op_t op,
+                                   anvil_type_t *type, const char *name)
+{
+    return anvil_instr_create_in(ctx, anvil_ctx_ir_pool(ctx), op, type, name);
+}
+
+/* Constants are uniqued per context and shared by every module, so they
+ * carry no use-list: a module's use nodes must not outlive the module. */
+static inline bool use_tracked(const anvil_value_t *val)
+{
+    return val && val->kind >= ANVIL_VAL_GLOBAL;
+}
+
+/* Globals and functions are used from every function of the module;
+ * while passes run in parallel, the module arena's lock guards their
+ * use-lists. Other values are only used within their own function. */
+static inline anvil_mutex_t *use_lock(const anvil_use_t *use, const anvil_value_t *val)
+{
+    if (val->kind != ANVIL_VAL_GLOBAL && val->kind != ANVIL_VAL_FUNC) return NULL;
+    return use->user->pool->lock;
+}
+
+/* An operand changed: so did the user's block, and the block defining
+ * the value, whose use count DCE and copy propagation go by */
+static void use_changed(const anvil_use_t *use, const anvil_value_t *val)
+{
+    anvil_block_mark_changed(use->user->parent);
+    if (val && val->kind == ANVIL_VAL_INSTR && val->data.instr) {
+        anvil_block_mark_changed(val->data.instr->parent);
+    }
+}
+
+/* Link a use node at the head of a value's use-list */
+static void use_link(anvil_use_t *use, anvil_value_t *val)
+{
+    use->prev = NULL;
+    use->next = NULL;
+    use_changed(use, val);
+    if (!use_tracked(val)) return;
+    
+    anvil_mutex_t *lock = use_lock(use, val);
+    anvil_mutex_lock(lock);
+    use->next = val->uses;
+    if (val->uses) val->uses->prev = use;
+    val->uses = use;
+    val->num_uses++;
+    anvil_mutex_unlock(lock);
+}
+
+/* Unlink a use node from a value's use-list */
+static void use_unlink(anvil_use_t *use, anvil_value_t *val)
+{
+    use_changed(use, val);
+    if (!use_tracked(val)) return;
+    
+    anvil_mutex_t *lock = use_lock(use, val);
+    anvil_mutex_lock(lock);
+    if (use->prev) {
+        use->prev->next = use->next;
+    } else {
+        val->uses = use->next;
+    }
+    if (use->next) use->next->prev = use->prev;
+    use->prev = NULL;
+    use->next = NULL;
+    val->num_uses--;
+    anvil_mutex_unlock(lock);
+}
+
+/* Use nodes moved to a new array: repoint their neighbours */
+static void uses_relocated(anvil_instr_t *instr, anvil_use_t *old_uses, size_t count)
+{
+    anvil_use_t *uses = instr->uses;
+    
+    /* Links between two nodes of this instruction moved together */
+    for (size_t i = 0; i < count; i++) {
+        anvil_use_t *u = &uses[i];
+        if (u->prev >= old_uses && u->prev < old_uses + count) {
+            u->prev = uses + (u->prev - old_uses);
+        }
+        if (u->next >= old_uses && u->next < old_uses + count) {
+            u->next = uses + (u->next - old_uses);
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        anvil_use_t *u = &uses[i];
+        anvil_value_t *val = instr->operands[i];
+        if (!use_tracked(val)) continue;
+        
+        anvil_mutex_t *lock = use_lock(u, val);
+        anvil_mutex_lock(lock);
+        if (u->prev) {
+            u->prev->next = u;
+        } else {
+            val->uses = u;
+        }
+        if (u->next) u->next->prev = u;
+        anvil_mutex_unlock(lock);
+    }
+}
+
+/* Move operands to arena storage with room for at least count entries */
+static bool operands_grow(anvil_instr_t *instr, size_t count)
+{
+    size_t cap = instr->cap_operands * 2;
+    if (cap < count) cap = count;
+    
+    anvil_value_t **new_ops = anvil_pool_alloc(instr->pool, cap * sizeof(anvil_value_t *));
+    anvil_use_t *new_uses = anvil_pool_alloc(instr->pool, cap * sizeof(anvil_use_t));
+    if (!new_ops || !new_uses) return false;
+    
+    size_t num = instr->num_operands;
+    anvil_use_t *old_uses = instr->uses;
+    memcpy(new_ops, instr->operands, num * sizeof(anvil_value_t *));
+    memcpy(new_uses, old_uses, num * sizeof(anvil_use_t));
+    
+    instr->operands = new_ops;
+    instr->uses = new_uses;
+    instr->cap_operands = cap;
+    uses_relocated(instr, old_uses, num);
+    return true;
+}
+
+void anvil_instr_reserve_operands(anvil_instr_t *instr, size_t count)
+{
+    if (!instr || count <= instr->cap_operands) return;
+    operands_grow(instr, count);
+}
+
 void anvil_instr_add_operand(anvil_instr_t *instr, anvil_value_t *val)
 {
     if (!instr) return;
     
-    size_t new_count = instr->num_operands + 1;
-    anvil_value_t **new_ops = realloc(instr->operands, new_count * sizeof(anvil_value_t *));
-    if (!new_ops) return;
+    size_t count = instr->num_operands;
+    if (count == instr->cap_operands && !operands_grow(instr, count + 1)) return;
     
-    new_ops[instr->num_operands] = val;
-    instr->operands = new_ops;
-    instr->num_operands = new_count;
+    instr->operands[count] = val;
+    instr->uses[count].user = instr;
+    use_link(&instr->uses[count], val);
+    instr->num_operands = count + 1;
+}
+
+void anvil_instr_set_operand(anvil_instr_t *instr, size_t index, anvil_value_t *val)
+{
+    if (!instr || index >= instr->num_operands) return;
+    
+    anvil_value_t *old = instr->operands[index];
+    if (old == val) return;
+    
+    use_unlink(&instr->uses[index], old);
+    instr->operands[index] = val;
+    use_link(&instr->uses[index], val);
+}
+
+void anvil_instr_clear_operands(anvil_instr_t *instr)
+{
+    if (!instr) return;
+    
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        use_unlink(&instr->uses[i], instr->operands[i]);
+    }
+    instr->num_operands = 0;
+    instr->num_phi_incoming = 0;
+}
+
+void anvil_phi_remove_incoming(anvil_instr_t *phi, size_t index)
+{
+    if (!phi || index >= phi->num_operands) return;
+    
+    /* The last entry takes the place of the removed one */
+    size_t last = phi->num_operands - 1;
+    anvil_instr_set_operand(phi, index, phi->operands[last]);
+    if (phi->phi_blocks && last < phi->num_phi_incoming) {
+        phi->phi_blocks[index] = phi->phi_blocks[last];
+    }
+    use_unlink(&phi->uses[last], phi->operands[last]);
+    phi->num_operands = last;
+    if (phi->num_phi_incoming > last) phi->num_phi_incoming = last;
+}
+
+/* A block's edges are those of its last instruction. When the last
+ * instruction changes, its old edges go and the new one's come in; a
+ * branch coming or going also stales the cached CFG analyses. */
+static void term_unlink(anvil_block_t *block, const anvil_instr_t *term)
+{
+    if (!block || !term) return;
+    if (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND || term->op == ANVIL_OP_SWITCH) {
+        anvil_block_clear_succs(block);
+        if (block->parent) anvil_func_invalidate_cfg(block->parent);
+    }
+}
+
+static void term_link(anvil_block_t *block, const anvil_instr_t *term)
+{
+    if (!block || !term) return;
+    if (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND || term->op == ANVIL_OP_SWITCH) {
+        anvil_block_update_succs(block);
+        if (block->parent) anvil_func_invalidate_cfg(block->parent);
+    }
+}
+
+void anvil_instr_kill(anvil_instr_t *instr)
+{
+    if (!instr) return;
+    anvil_block_t *block = instr->parent;
+    if (block && block->last == instr) term_unlink(block, instr);
+    anvil_instr_clear_operands(instr);
+    instr->op = ANVIL_OP_NOP;
+    anvil_block_mark_changed(block);
+}
+
+/* Take instr out of its block's list, keeping its operands */
+static void instr_unlink(anvil_instr_t *instr)
+{
+    anvil_block_t *block = instr->parent;
+    if (block) {
+        anvil_block_mark_changed(block);
+        bool was_last = block->last == instr;
+        if (was_last) term_unlink(block, instr);
+        
+        if (instr->prev) {
+            instr->prev->next = instr->next;
+        } else {
+            block->first = instr->next;
+        }
+        
+        if (instr->next) {
+            instr->next->prev = instr->prev;
+        } else {
+            block->last = instr->prev;
+        }
+        if (was_last) term_link(block, block->last);
+    }
+    
+    instr->prev = NULL;
+    instr->next = NULL;
+    instr->parent = NULL;
+}
+
+void anvil_instr_remove(anvil_instr_t *instr)
+{
+    if (!instr) return;
+    instr_unlink(instr);
+    anvil_instr_clear_operands(instr);
+}
+
+void anvil_instr_move_before(anvil_block_t *block, anvil_instr_t *pos, anvil_instr_t *instr)
+{
+    if (!block || !instr || instr == pos) return;
+    instr_unlink(instr);
+    anvil_instr_insert_before(block, pos, instr);
 }
 
 void anvil_instr_insert(anvil_ctx_t *ctx, anvil_instr_t *instr)
@@ -62,6 +314,8 @@ void anvil_instr_insert(anvil_ctx_t *ctx, anvil_instr_t *instr)
     
     anvil_block_t *block = ctx->insert_block;
     instr->parent = block;
+    anvil_block_mark_changed(block);
+    term_unlink(block, block->last);
     
     if (!block->first) {
         block->first = instr;
@@ -71,92 +325,247 @@ void anvil_instr_insert(anvil_ctx_t *ctx, anvil_instr_t *instr)
         block->last->next = instr;
         block->last = instr;
     }
+    term_link(block, instr);
 }
 
-/* Constants */
-anvil_value_t *anvil_const_i8(anvil_ctx_t *ctx, int8_t val)
+void anvil_instr_insert_before(anvil_block_t *block, anvil_instr_t *pos, anvil_instr_t *instr)
+{
+    if (!block || !instr) return;
+    
+    instr->parent = block;
+    anvil_block_mark_changed(block);
+    if (!pos) term_unlink(block, block->last);
+    instr->next = pos;
+    instr->prev = pos ? pos->prev : block->last;
+    if (instr->prev) {
+        instr->prev->next = instr;
+    } else {
+        block->first = instr;
+    }
+    if (pos) {
+        pos->prev = instr;
+    } else {
+        block->last = instr;
+        term_link(block, instr);
+    }
+}
+
+void anvil_instr_set_succ(anvil_instr_t *term, size_t index, anvil_block_t *dest)
+{
+    if (!term || index > 1) return;
+    
+    anvil_block_t **slot = index ? &term->false_block : &term->true_block;
+    if (*slot == dest) return;
+    
+    /* Only the last instruction's targets are edges */
+    anvil_block_t *block = term->parent;
+    bool edge = block && block->last == term &&
+                (term->op == ANVIL_OP_BR_COND || (term->op == ANVIL_OP_BR && index == 0));
+    if (edge && *slot) anvil_block_remove_edge(block, *slot);
+    *slot = dest;
+    anvil_block_mark_changed(block);
+    if (edge && dest) anvil_block_add_edge(block, dest);
+    if (edge && block->parent) anvil_func_invalidate_cfg(block->parent);
+}
+
+/* ============================================================================
+ * Constants
+ *
+ * Integer, float, null and string constants are uniqued per context,
+ * keyed by (kind, type, bits) or (type, contents) for strings. Asking for
+ * the same constant twice returns the same value, so passes can compare
+ * constants by pointer. Floats are keyed by their bit pattern: 0.0 and
+ * -0.0 stay distinct and a NaN matches itself.
+ * ============================================================================ */
+
+static uint64_t const_hash(anvil_val_kind_t kind, const anvil_type_t *type,
+                           uint64_t bits, const char *str)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_i8, NULL);
-    if (v) v->data.i = val;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    
+    h = (h ^ (uint64_t)kind) * 0x100000001b3ULL;
+    h = (h ^ (uint64_t)(uintptr_t)type) * 0x100000001b3ULL;
+    if (str) {
+        for (const char *c = str; *c; c++) {
+            h = (h ^ (unsigned char)*c) * 0x100000001b3ULL;
+        }
+    } else {
+        h = (h ^ bits) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+static uint64_t const_bits(const anvil_value_t *v)
+{
+    uint64_t bits = 0;
+    if (v->kind == ANVIL_VAL_CONST_FLOAT) {
+        memcpy(&bits, &v->data.f, sizeof(bits));
+    } else if (v->kind != ANVIL_VAL_CONST_STRING) {
+        bits = v->data.u;
+    }
+    return bits;
+}
+
+static bool const_matches(const anvil_value_t *v, anvil_val_kind_t kind,
+                          const anvil_type_t *type, uint64_t bits, const char *str)
+{
+    if (v->kind != kind || v->type != type) return false;
+    if (kind == ANVIL_VAL_CONST_STRING) return strcmp(v->data.str, str) == 0;
+    return const_bits(v) == bits;
+}
+
+static bool const_table_grow(anvil_ctx_t *ctx)
+{
+    size_t old_cap = ctx->const_table.cap;
+    anvil_value_t **old_slots = ctx->const_table.slots;
+    size_t new_cap = old_cap ? old_cap * 2 : 256;
+    
+    anvil_value_t **slots = calloc(new_cap, sizeof(anvil_value_t *));
+    if (!slots) return false;
+    
+    for (size_t i = 0; i < old_cap; i++) {
+        anvil_value_t *v = old_slots[i];
+        if (!v) continue;
+        
+        const char *str = v->kind == ANVIL_VAL_CONST_STRING ? v->data.str : NULL;
+        size_t j = (size_t)const_hash(v->kind, v->type, const_bits(v), str) & (new_cap - 1);
+        while (slots[j]) j = (j + 1) & (new_cap - 1);
+        slots[j] = v;
+    }
+    
+    free(old_slots);
+    ctx->const_table.slots = slots;
+    ctx->const_table.cap = new_cap;
+    return true;
+}
+
+static anvil_value_t *const_find_or_add(anvil_ctx_t *ctx, anvil_val_kind_t kind,
+                                        anvil_type_t *type, uint64_t bits, const char *str)
+{
+    /* Keep load factor below 3/4 */
+    if ((ctx->const_table.count + 1) * 4 > ctx->const_table.cap * 3) {
+        if (!const_table_grow(ctx)) return NULL;
+    }
+    
+    size_t mask = ctx->const_table.cap - 1;
+    size_t i = (size_t)const_hash(kind, type, bits, str) & mask;
+    while (ctx->const_table.slots[i]) {
+        anvil_value_t *v = ctx->const_table.slots[i];
+        if (const_matches(v, kind, type, bits, str)) return v;
+        i = (i + 1) & mask;
+    }
+    
+    anvil_value_t *v = anvil_value_create(ctx, &ctx->pool, kind, type, NULL);
+    if (!v) return NULL;
+    
+    if (kind == ANVIL_VAL_CONST_STRING) {
+        v->data.str = anvil_strdup(ctx, str);
+    } else if (kind == ANVIL_VAL_CONST_FLOAT) {
+        memcpy(&v->data.f, &bits, sizeof(bits));
+    } else {
+        v->data.u = bits;
+    }
+    
+    ctx->const_table.slots[i] = v;
+    ctx->const_table.count++;
     return v;
 }
 
-anvil_value_t *anvil_const_i16(anvil_ctx_t *ctx, int16_t val)
+/* Return the unique constant for a key, creating it on first use */
+static anvil_value_t *const_intern(anvil_ctx_t *ctx, anvil_val_kind_t kind,
+                                   anvil_type_t *type, uint64_t bits, const char *str)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_i16, NULL);
-    if (v) v->data.i = val;
+    if (!ctx) return NULL;
+    if (kind == ANVIL_VAL_CONST_STRING && !str) str = "";
+    
+    anvil_mutex_lock(ctx->pool.lock);
+    anvil_value_t *v = const_find_or_add(ctx, kind, type, bits, str);
+    anvil_mutex_unlock(ctx->pool.lock);
     return v;
 }
 
+void anvil_const_table_destroy(anvil_ctx_t *ctx)
+{
+    if (!ctx) return;
+    free(ctx->const_table.slots);
+    ctx->const_table.slots = NULL;
+    ctx->const_table.count = 0;
+    ctx->const_table.cap = 0;
+}
+
+static anvil_value_t *const_int(anvil_ctx_t *ctx, anvil_type_t *type, int64_t val)
+{
+    return const_intern(ctx, ANVIL_VAL_CONST_INT, type, (uint64_t)val, NULL);
+}
+
+static anvil_value_t *const_float(anvil_ctx_t *ctx, anvil_type_t *type, double val)
+{
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return const_intern(ctx, ANVIL_VAL_CONST_FLOAT, type, bits, NULL);
+}
+
+anvil_value_t *anvil_const_i8(anvil_ctx_t *ctx, int8_t val)
+{
+    return ctx ? const_int(ctx, ctx->type_i8, val) : NULL;
+}
+
+anvil_value_t *anvil_const_i16(anvil_ctx_t *ctx, int16_t val)
+{
+    return ctx ? const_int(ctx, ctx->type_i16, val) : NULL;
+}
+
 anvil_value_t *anvil_const_i32(anvil_ctx_t *ctx, int32_t val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_i32, NULL);
-    if (v) v->data.i = val;
-    return v;
+    return ctx ? const_int(ctx, ctx->type_i32, val) : NULL;
 }
 
 anvil_value_t *anvil_const_i64(anvil_ctx_t *ctx, int64_t val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_i64, NULL);
-    if (v) v->data.i = val;
-    return v;
+    return ctx ? const_int(ctx, ctx->type_i64, val) : NULL;
 }
 
 anvil_value_t *anvil_const_u8(anvil_ctx_t *ctx, uint8_t val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_u8, NULL);
-    if (v) v->data.u = val;
-    return v;
+    return ctx ? const_int(ctx, ctx->type_u8, (int64_t)val) : NULL;
 }
 
 anvil_value_t *anvil_const_u16(anvil_ctx_t *ctx, uint16_t val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_u16, NULL);
-    if (v) v->data.u = val;
-    return v;
+    return ctx ? const_int(ctx, ctx->type_u16, (int64_t)val) : NULL;
 }
 
 anvil_value_t *anvil_const_u32(anvil_ctx_t *ctx, uint32_t val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_u32, NULL);
-    if (v) v->data.u = val;
-    return v;
+    return ctx ? const_int(ctx, ctx->type_u32, (int64_t)val) : NULL;
 }
 
 anvil_value_t *anvil_const_u64(anvil_ctx_t *ctx, uint64_t val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_INT, ctx->type_u64, NULL);
-    if (v) v->data.u = val;
-    return v;
+    return ctx ? const_int(ctx, ctx->type_u64, (int64_t)val) : NULL;
 }
 
 anvil_value_t *anvil_const_f32(anvil_ctx_t *ctx, float val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_FLOAT, ctx->type_f32, NULL);
-    if (v) v->data.f = val;
-    return v;
+    return ctx ? const_float(ctx, ctx->type_f32, val) : NULL;
 }
 
 anvil_value_t *anvil_const_f64(anvil_ctx_t *ctx, double val)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_FLOAT, ctx->type_f64, NULL);
-    if (v) v->data.f = val;
-    return v;
+    return ctx ? const_float(ctx, ctx->type_f64, val) : NULL;
 }
 
 anvil_value_t *anvil_const_null(anvil_ctx_t *ctx, anvil_type_t *ptr_type)
 {
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_NULL, ptr_type, NULL);
-    if (v) v->data.u = 0;
-    return v;
+    return const_intern(ctx, ANVIL_VAL_CONST_NULL, ptr_type, 0, NULL);
 }
 
 anvil_value_t *anvil_const_string(anvil_ctx_t *ctx, const char *str)
 {
+    if (!ctx) return NULL;
     anvil_type_t *type = anvil_type_ptr(ctx, ctx->type_i8);
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_STRING, type, NULL);
-    if (v) v->data.str = str ? strdup(str) : NULL;
-    return v;
+    return const_intern(ctx, ANVIL_VAL_CONST_STRING, type, 0, str);
 }
 
 anvil_value_t *anvil_const_array(anvil_ctx_t *ctx, anvil_type_t *elem_type,
@@ -165,15 +574,12 @@ anvil_value_t *anvil_const_array(anvil_ctx_t *ctx, anvil_type_t *elem_type,
     if (!ctx || !elem_type) return NULL;
     
     anvil_type_t *arr_type = anvil_type_array(ctx, elem_type, num_elements);
-    anvil_value_t *v = anvil_value_create(ctx, ANVIL_VAL_CONST_ARRAY, arr_type, NULL);
+    anvil_value_t *v = anvil_value_create(ctx, &ctx->pool, ANVIL_VAL_CONST_ARRAY, arr_type, NULL);
     if (!v) return NULL;
     
     if (num_elements > 0 && elements) {
-        v->data.array.elements = malloc(num_elements * sizeof(anvil_value_t *));
-        if (!v->data.array.elements) {
-            free(v);
-            return NULL;
-        }
+        v->data.array.elements = anvil_alloc(ctx, num_elements * sizeof(anvil_value_t *));
+        if (!v->data.array.elements) return NULL;
         memcpy(v->data.array.elements, elements, num_elements * sizeof(anvil_value_t *));
     } else {
         v->data.array.elements = NULL;
@@ -194,6 +600,26 @@ anvil_type_t *anvil_value_get_type(anvil_value_t *val)
     return val ? val->type : NULL;
 }
 
+size_t anvil_value_num_uses(anvil_value_t *val)
+{
+    return val ? val->num_uses : 0;
+}
+
+size_t anvil_value_replace_all_uses(anvil_value_t *old_val, anvil_value_t *new_val)
+{
+    if (!old_val || old_val == new_val) return 0;
+    
+    size_t count = 0;
+    while (old_val->uses) {
+        anvil_use_t *use = old_val->uses;
+        anvil_instr_t *user = use->user;
+        anvil_instr_set_operand(user, (size_t)(use - user->uses), new_val);
+        count++;
+    }
+    
+    return count;
+}
+
 bool anvil_value_is_bool(anvil_value_t *val)
 {
     if (!val) return false;
@@ -0,0 +1,197 @@
+/*
+ * ANVIL - Dense value map
+ *
+ * Value ids are handed out per context in creation order, so the values
+ * of one function usually occupy a narrow id range. A flat array over that
+ * range replaces the linear searches backends used to find a value's slot.
+ *
+ * Passes that run after the whole module was built break that: the values
+ * they create get ids past every function, so one function's range can
+ * span the module. Sizing a dense table to such a range per function is
+ * quadratic, so a map whose range is much larger than its values hashes
+ * the ids instead (open addressing, linear probing, load at most 1/2).
+ */
+
+#include "anvil/anvil_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* A dense table may cover at most this many ids per value */
+#define SPARSE_FACTOR 4
+#define MIN_SLOTS 64
+
+static bool too_sparse(size_t range, size_t values)
+{
+    return range > SPARSE_FACTOR * values + MIN_SLOTS;
+}
+
+static size_t hash_size(size_t values)
+{
+    size_t size = MIN_SLOTS;
+    while (size < 2 * values) size *= 2;
+    return size;
+}
+
+static void fill_none(int32_t *entries, size_t count)
+{
+    for (size_t i = 0; i < count; i++) entries[i] = ANVIL_VALUE_MAP_NONE;
+}
+
+/* Grow to at least count slots; keys are kept the same size once hashed */
+static anvil_error_t reserve(anvil_value_map_t *map, size_t count)
+{
+    if (count <= map->cap && (!map->hashed || map->keys)) return ANVIL_OK;
+    size_t cap = map->cap ? map->cap : MIN_SLOTS;
+    while (cap < count) cap *= 2;
+
+    int32_t *entries = realloc(map->entries, cap * sizeof(int32_t));
+    if (!entries) return ANVIL_ERR_NOMEM;
+    map->entries = entries;
+    if (map->hashed || map->keys) {
+        uint32_t *keys = realloc(map->keys, cap * sizeof(uint32_t));
+        if (!keys) return ANVIL_ERR_NOMEM;
+        map->keys = keys;
+    }
+    map->cap = cap;
+    return ANVIL_OK;
+}
+
+static size_t probe(const anvil_value_map_t *map, uint32_t id)
+{
+    size_t mask = map->count - 1;
+    size_t i = (id * 2654435761u) & mask;
+    while (map->entries[i] != ANVIL_VALUE_MAP_NONE && map->keys[i] != id) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void hash_insert(anvil_value_map_t *map, uint32_t id, int32_t entry)
+{
+    size_t i = probe(map, id);
+    if (map->entries[i] == ANVIL_VALUE_MAP_NONE) map->used++;
+    map->keys[i] = id;
+    map->entries[i] = entry;
+}
+
+/* Move every entry into a fresh hash table of the given size */
+static anvil_error_t rehash(anvil_value_map_t *map, size_t size)
+{
+    int32_t *entries = malloc(size * sizeof(int32_t));
+    uint32_t *keys = malloc(size * sizeof(uint32_t));
+    if (!entries || !keys) {
+        free(entries);
+        free(keys);
+        return ANVIL_ERR_NOMEM;
+    }
+    fill_none(entries, size);
+
+    anvil_value_map_t old = *map;
+    map->entries = entries;
+    map->keys = keys;
+    map->base = 0;
+    map->count = (uint32_t)size;
+    map->used = 0;
+    map->cap = size;
+    map->hashed = true;
+    for (size_t i = 0; i < old.count; i++) {
+        if (old.entries[i] == ANVIL_VALUE_MAP_NONE) continue;
+        hash_insert(map, old.hashed ? old.keys[i] : old.base + (uint32_t)i, old.entries[i]);
+    }
+    free(old.entries);
+    free(old.keys);
+    return ANVIL_OK;
+}
+
+anvil_error_t anvil_value_map_reset(anvil_value_map_t *map, anvil_func_t *func)
+{
+    if (!map) return ANVIL_ERR_INVALID_ARG;
+
+    uint32_t lo = UINT32_MAX, hi = 0;
+    size_t values = 0;
+    if (func) {
+        for (size_t i = 0; i < func->num_params; i++) {
+            uint32_t id = func->params[i]->id;
+            if (id < lo) lo = id;
+            if (id > hi) hi = id;
+            values++;
+        }
+        for (anvil_block_t *block = func->blocks; block; block = block->next) {
+            for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+                if (!instr->result) continue;
+                if (instr->result->id < lo) lo = instr->result->id;
+                if (instr->result->id > hi) hi = instr->result->id;
+                values++;
+            }
+        }
+    }
+
+    size_t range = values ? (size_t)hi - lo + 1 : 0;
+    map->used = 0;
+    map->hashed = too_sparse(range, values);
+    map->base = map->hashed || !values ? 0 : lo;
+    map->count = (uint32_t)(map->hashed ? hash_size(values) : range);
+    if (reserve(map, map->count) != ANVIL_OK) {
+        map->count = 0;
+        map->hashed = false;
+        return ANVIL_ERR_NOMEM;
+    }
+    fill_none(map->entries, map->count);
+    return ANVIL_OK;
+}
+
+anvil_error_t anvil_value_map_set(anvil_value_map_t *map, anvil_value_t *val, int32_t entry)
+{
+    if (!map || !val || entry == ANVIL_VALUE_MAP_NONE) return ANVIL_ERR_INVALID_ARG;
+
+    if (!map->hashed) {
+        /* Grow the range to cover val, rebasing if it lies below */
+        uint32_t lo = map->count && map->base < val->id ? map->base : val->id;
+        uint32_t hi = map->count && map->base + map->count - 1 > val->id
+                    ? map->base + map->count - 1 : val->id;
+        size_t range = (size_t)hi - lo + 1;
+
+        if (range > map->count && too_sparse(range, map->used + 1)) {
+            if (rehash(map, hash_size(map->used + 1)) != ANVIL_OK) return ANVIL_ERR_NOMEM;
+        } else {
+            if (range > map->count) {
+                if (reserve(map, range) != ANVIL_OK) return ANVIL_ERR_NOMEM;
+                uint32_t shift = map->count ? map->base - lo : 0;
+                if (shift) {
+                    memmove(map->entries + shift, map->entries, map->count * sizeof(int32_t));
+                }
+                fill_none(map->entries, shift);
+                fill_none(map->entries + shift + map->count, range - shift - map->count);
+                map->base = lo;
+                map->count = (uint32_t)range;
+            }
+            int32_t *slot = &map->entries[val->id - map->base];
+            if (*slot == ANVIL_VALUE_MAP_NONE) map->used++;
+            *slot = entry;
+            return ANVIL_OK;
+        }
+    }
+
+    if (2 * (map->used + 1) > map->count &&
+        rehash(map, (size_t)map->count * 2) != ANVIL_OK) {
+        return ANVIL_ERR_NOMEM;
+    }
+    hash_insert(map, val->id, entry);
+    return ANVIL_OK;
+}
+
+int32_t anvil_value_map_get(const anvil_value_map_t *map, const anvil_value_t *val)
+{
+    if (!map || !val || map->count == 0) return ANVIL_VALUE_MAP_NONE;
+    if (map->hashed) return map->entries[probe(map, val->id)];
+    if (val->id < map->base || val->id - map->base >= map->count) return ANVIL_VALUE_MAP_NONE;
+    return map->entries[val->id - map->base];
+}
+
+void anvil_value_map_free(anvil_value_map_t *map)
+{
+    if (!map) return;
+    free(map->entries);
+    free(map->keys);
+    memset(map, 0, sizeof(*map));
+}
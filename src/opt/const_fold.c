@@ -62,26 +62,6 @@ static bool is_all_ones(anvil_value_t *val)
     return v == -1 || v == (int64_t)0xFFFFFFFFFFFFFFFFLL;
 }
 
-/* Replace all uses of old_val with new_val in the function */
-static void replace_uses(anvil_func_t *func, anvil_value_t *old_val, anvil_value_t *new_val)
-{
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
-            for (size_t i = 0; i < instr->num_operands; i++) {
-                if (instr->operands[i] == old_val) {
-                    instr->operands[i] = new_val;
-                }
-            }
-        }
-    }
-}
-
-/* Mark instruction for deletion by setting op to NOP */
-static void mark_dead(anvil_instr_t *instr)
-{
-    instr->op = ANVIL_OP_NOP;
-}
-
 /* Create a constant value with the same type */
 static anvil_value_t *make_const_int(anvil_ctx_t *ctx, anvil_type_t *type, int64_t val)
 {
@@ -362,7 +342,8 @@ bool anvil_pass_const_fold(anvil_func_t *func)
     anvil_ctx_t *ctx = func->parent->ctx;
     bool changed = false;
     
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
             if (instr->op == ANVIL_OP_NOP) continue;
             if (!instr->result) continue;
@@ -434,8 +415,8 @@ bool anvil_pass_const_fold(anvil_func_t *func)
             
             /* Replace uses if we folded something */
             if (folded) {
-                replace_uses(func, instr->result, folded);
-                mark_dead(instr);
+                anvil_value_replace_all_uses(instr->result, folded);
+                anvil_instr_kill(instr);
                 changed = true;
             }
         }
@@ -67,25 +67,6 @@ static anvil_value_t *get_copy_source(anvil_instr_t *instr)
     return instr->operands[0];
 }
 
-/* Replace all uses of old_val with new_val in the function */
-static int replace_uses(anvil_func_t *func, anvil_value_t *old_val, anvil_value_t *new_val)
-{
-    int count = 0;
-    
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
-            for (size_t i = 0; i < instr->num_operands; i++) {
-                if (instr->operands[i] == old_val) {
-                    instr->operands[i] = new_val;
-                    count++;
-                }
-            }
-        }
-    }
-    
-    return count;
-}
-
 /* Main copy propagation pass */
 bool anvil_pass_copy_prop(anvil_func_t *func)
 {
@@ -94,7 +75,8 @@ bool anvil_pass_copy_prop(anvil_func_t *func)
     bool changed = false;
     
     /* Iterate through all instructions looking for copies */
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
             if (!is_copy_instr(instr)) continue;
             
@@ -105,7 +87,7 @@ bool anvil_pass_copy_prop(anvil_func_t *func)
             if (src == dst) continue;  /* Self-copy, skip */
             
             /* Replace all uses of dst with src */
-            int replaced = replace_uses(func, dst, src);
+            size_t replaced = anvil_value_replace_all_uses(dst, src);
             if (replaced > 0) {
                 changed = true;
             }
@@ -149,24 +149,6 @@ static void expr_table_invalidate(expr_table_t *table, anvil_value_t *val)
     }
 }
 
-/* Replace all uses of old_val with new_val after start instruction */
-static int replace_uses_after(anvil_instr_t *start, anvil_value_t *old_val, 
-                               anvil_value_t *new_val)
-{
-    int count = 0;
-    
-    for (anvil_instr_t *instr = start->next; instr; instr = instr->next) {
-        for (size_t i = 0; i < instr->num_operands; i++) {
-            if (instr->operands[i] == old_val) {
-                instr->operands[i] = new_val;
-                count++;
-            }
-        }
-    }
-    
-    return count;
-}
-
 /* Process a single basic block for CSE */
 static bool cse_block(anvil_block_t *block)
 {
@@ -195,11 +177,12 @@ static bool cse_block(anvil_block_t *block)
         anvil_value_t *existing = expr_table_lookup(&table, instr->op, op1, op2);
         
         if (existing && instr->result) {
-            /* Found a common subexpression - replace uses */
-            int replaced = replace_uses_after(instr, instr->result, existing);
+            /* Found a common subexpression - replace uses.
+             * The earlier computation dominates every use of this one. */
+            size_t replaced = anvil_value_replace_all_uses(instr->result, existing);
             if (replaced > 0) {
                 /* Mark instruction as dead (NOP) */
-                instr->op = ANVIL_OP_NOP;
+                anvil_instr_kill(instr);
                 changed = true;
             }
         } else if (instr->result) {
@@ -219,7 +202,8 @@ bool anvil_pass_cse(anvil_func_t *func)
     bool changed = false;
     
     /* Process each basic block independently (local CSE) */
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
         if (cse_block(block)) {
             changed = true;
         }
@@ -26,53 +26,44 @@ static bool has_side_effects(anvil_instr_t *instr)
     }
 }
 
-/* Check if a value is used anywhere in the function */
-static bool is_value_used(anvil_func_t *func, anvil_value_t *val)
+/* Check if an instruction can be deleted */
+static bool is_dead(anvil_instr_t *instr)
 {
-    if (!val) return false;
-    
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
-            if (instr->op == ANVIL_OP_NOP) continue;
-            
-            for (size_t i = 0; i < instr->num_operands; i++) {
-                if (instr->operands[i] == val) {
-                    return true;
-                }
-            }
-            
-            /* Check PHI incoming values */
-            if (instr->op == ANVIL_OP_PHI) {
-                for (size_t i = 0; i < instr->num_phi_incoming; i++) {
-                    if (instr->operands[i] == val) {
-                        return true;
-                    }
-                }
-            }
-        }
-    }
-    
-    return false;
+    if (instr->op == ANVIL_OP_NOP) return true;
+    if (has_side_effects(instr)) return false;
+    if (!instr->result) return false;
+    return anvil_value_num_uses(instr->result) == 0;
 }
 
-/* Remove an instruction from its block */
-static void remove_instr(anvil_instr_t *instr)
+/* Worklist of instructions whose results may have become unused */
+typedef struct {
+    anvil_instr_t **items;
+    size_t count;
+    size_t cap;
+} dce_worklist_t;
+
+static void worklist_push(dce_worklist_t *wl, anvil_instr_t *instr)
 {
-    anvil_block_t *block = instr->parent;
-    if (!block) return;
-    
-    /* Unlink from list */
-    if (instr->prev) {
-        instr->prev->next = instr->next;
-    } else {
-        block->first = instr->next;
+    if (wl->count >= wl->cap) {
+        size_t new_cap = wl->cap ? wl->cap * 2 : 64;
+        anvil_instr_t **new_items = realloc(wl->items, new_cap * sizeof(anvil_instr_t *));
+        if (!new_items) return;
+        wl->items = new_items;
+        wl->cap = new_cap;
     }
-    
-    if (instr->next) {
-        instr->next->prev = instr->prev;
-    } else {
-        block->last = instr->prev;
+    wl->items[wl->count++] = instr;
+}
+
+/* Remove a dead instruction and queue operands that may now be dead */
+static void remove_dead(anvil_instr_t *instr, dce_worklist_t *wl)
+{
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        anvil_value_t *op = instr->operands[i];
+        if (op && op->kind == ANVIL_VAL_INSTR) {
+            worklist_push(wl, op->data.instr);
+        }
     }
+    anvil_instr_remove(instr);
 }
 
 /* Dead code elimination pass */
@@ -81,50 +72,39 @@ bool anvil_pass_dce(anvil_func_t *func)
     if (!func) return false;
     
     bool changed = false;
-    bool any_removed;
+    dce_worklist_t wl = { NULL, 0, 0 };
     
-    /* Iterate until no more dead code is found */
-    do {
-        any_removed = false;
+    /* Sweep the changed blocks once: an instruction elsewhere only dies
+     * by losing a use, and that marks its block changed */
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
+        anvil_instr_t *instr = block->first;
         
-        for (anvil_block_t *block = func->blocks; block; block = block->next) {
-            anvil_instr_t *instr = block->first;
+        while (instr) {
+            anvil_instr_t *next = instr->next;
             
-            while (instr) {
-                anvil_instr_t *next = instr->next;
-                
-                /* Remove NOP instructions */
-                if (instr->op == ANVIL_OP_NOP) {
-                    remove_instr(instr);
-                    any_removed = true;
-                    changed = true;
-                    instr = next;
-                    continue;
-                }
-                
-                /* Skip instructions with side effects */
-                if (has_side_effects(instr)) {
-                    instr = next;
-                    continue;
-                }
-                
-                /* Skip instructions without results */
-                if (!instr->result) {
-                    instr = next;
-                    continue;
-                }
-                
-                /* Remove if result is not used */
-                if (!is_value_used(func, instr->result)) {
-                    remove_instr(instr);
-                    any_removed = true;
-                    changed = true;
-                }
-                
-                instr = next;
+            if (is_dead(instr)) {
+                remove_dead(instr, &wl);
+                changed = true;
             }
+            
+            instr = next;
         }
-    } while (any_removed);
+    }
+    
+    /* Follow chains of values that lost their last use */
+    while (wl.count > 0) {
+        anvil_instr_t *instr = wl.items[--wl.count];
+        
+        /* Already removed, or not part of this function */
+        if (!instr->parent || instr->parent->parent != func) continue;
+        
+        if (is_dead(instr)) {
+            remove_dead(instr, &wl);
+            changed = true;
+        }
+    }
     
+    free(wl.items);
     return changed;
 }
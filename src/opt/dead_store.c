@@ -121,7 +121,8 @@ bool anvil_pass_dead_store(anvil_func_t *func)
     bool changed = false;
     
     /* Iterate through all blocks */
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
         anvil_instr_t *instr = block->first;
         
         while (instr) {
@@ -129,7 +130,7 @@ bool anvil_pass_dead_store(anvil_func_t *func)
             
             if (instr->op == ANVIL_OP_STORE && is_dead_store(instr)) {
                 /* Mark as NOP (will be cleaned by DCE) */
-                instr->op = ANVIL_OP_NOP;
+                anvil_instr_kill(instr);
                 changed = true;
             }
             
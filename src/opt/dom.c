@@ -0,0 +1,296 @@
+/*
+ * ANVIL - Dominator Tree
+ *
+ * Blocks reachable from the entry are numbered in reverse postorder and
+ * every analysis result is indexed by that number. Immediate dominators
+ * come from the iterative algorithm of Cooper, Harvey and Kennedy, which
+ * converges in a couple of sweeps over the RPO for the reducible CFGs a
+ * front end emits. Dominance frontiers use the same paper's walk up from
+ * each predecessor of a join point and are only built when asked for.
+ *
+ * Unreachable blocks get no number: passes skip them or treat them on
+ * their own.
+ *
+ * The tree is cached on the function (anvil_func_domtree) until the CFG
+ * changes, so the passes between two CFG edits share one computation.
+ */
+
+#include "anvil/anvil_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+size_t anvil_block_succs(const anvil_block_t *block, anvil_block_t *succs[2])
+{
+    const anvil_instr_t *term = block->last;
+    size_t n = 0;
+    if (term && (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND) && term->true_block)
+        succs[n++] = term->true_block;
+    if (term && term->op == ANVIL_OP_BR_COND && term->false_block &&
+        term->false_block != term->true_block)
+        succs[n++] = term->false_block;
+    return n;
+}
+
+int32_t anvil_domtree_index(const anvil_domtree_t *dt, const anvil_block_t *block)
+{
+    if (!block || block->id < dt->block_base || block->id - dt->block_base >= dt->block_count)
+        return -1;
+    return dt->block_num[block->id - dt->block_base];
+}
+
+/* Reverse postorder of the blocks reachable from the entry */
+static bool order_blocks(anvil_domtree_t *dt, anvil_func_t *func)
+{
+    uint32_t bid_min = UINT32_MAX, bid_max = 0;
+    size_t total = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        total++;
+        if (block->id < bid_min) bid_min = block->id;
+        if (block->id > bid_max) bid_max = block->id;
+    }
+    dt->block_base = bid_min;
+    dt->block_count = bid_max - bid_min + 1;
+    dt->block_num = malloc(dt->block_count * sizeof(int32_t));
+    dt->blocks = malloc(total * sizeof(anvil_block_t *));
+    anvil_block_t **stack = malloc(total * sizeof(anvil_block_t *));
+    uint8_t *next_succ = calloc(total, 1);
+    if (!dt->block_num || !dt->blocks || !stack || !next_succ) {
+        free(stack);
+        free(next_succ);
+        return false;
+    }
+    memset(dt->block_num, 0xff, dt->block_count * sizeof(int32_t));
+
+    /* Iterative DFS; block_num holds the stack depth while a block is open */
+    size_t depth = 0, post = total;
+    stack[depth] = func->entry;
+    dt->block_num[func->entry->id - bid_min] = 0;
+    depth++;
+    while (depth > 0) {
+        anvil_block_t *block = stack[depth - 1];
+        anvil_block_t *succs[2];
+        size_t n = anvil_block_succs(block, succs);
+        uint8_t *k = &next_succ[depth - 1];
+        if (*k < n) {
+            anvil_block_t *succ = succs[(*k)++];
+            if (anvil_domtree_index(dt, succ) == -1 && succ->parent == func) {
+                dt->block_num[succ->id - bid_min] = (int32_t)depth;
+                next_succ[depth] = 0;
+                stack[depth++] = succ;
+            }
+            continue;
+        }
+        dt->blocks[--post] = block;
+        depth--;
+    }
+    free(stack);
+    free(next_succ);
+
+    /* Postorder was filled from the back: shift to the front */
+    dt->num_blocks = total - post;
+    memmove(dt->blocks, dt->blocks + post, dt->num_blocks * sizeof(anvil_block_t *));
+    memset(dt->block_num, 0xff, dt->block_count * sizeof(int32_t));
+    for (size_t i = 0; i < dt->num_blocks; i++) {
+        dt->block_num[dt->blocks[i]->id - bid_min] = (int32_t)i;
+    }
+    return true;
+}
+
+/* Predecessor lists of the reachable blocks, CSR by RPO index */
+static bool build_preds(anvil_domtree_t *dt)
+{
+    size_t nb = dt->num_blocks;
+    dt->pred_start = calloc(nb + 1, sizeof(int32_t));
+    int32_t *fill = calloc(nb + 1, sizeof(int32_t));
+    if (!dt->pred_start || !fill) {
+        free(fill);
+        return false;
+    }
+
+    for (size_t b = 0; b < nb; b++) {
+        anvil_block_t *succs[2];
+        size_t n = anvil_block_succs(dt->blocks[b], succs);
+        for (size_t s = 0; s < n; s++) {
+            int32_t succ = anvil_domtree_index(dt, succs[s]);
+            if (succ >= 0) dt->pred_start[succ + 1]++;
+        }
+    }
+    for (size_t b = 0; b < nb; b++) dt->pred_start[b + 1] += dt->pred_start[b];
+    dt->preds = malloc((dt->pred_start[nb] ? (size_t)dt->pred_start[nb] : 1) * sizeof(int32_t));
+    if (!dt->preds) {
+        free(fill);
+        return false;
+    }
+    for (size_t b = 0; b < nb; b++) {
+        anvil_block_t *succs[2];
+        size_t n = anvil_block_succs(dt->blocks[b], succs);
+        for (size_t s = 0; s < n; s++) {
+            int32_t succ = anvil_domtree_index(dt, succs[s]);
+            if (succ >= 0) dt->preds[dt->pred_start[succ] + fill[succ]++] = (int32_t)b;
+        }
+    }
+    free(fill);
+    return true;
+}
+
+static int32_t intersect(const int32_t *idom, int32_t a, int32_t b)
+{
+    while (a != b) {
+        while (a > b) a = idom[a];
+        while (b > a) b = idom[b];
+    }
+    return a;
+}
+
+/* Immediate dominators, the children lists and preorder intervals */
+static bool build_tree(anvil_domtree_t *dt)
+{
+    size_t nb = dt->num_blocks;
+    dt->idom = malloc(nb * sizeof(int32_t));
+    dt->child_start = calloc(nb + 1, sizeof(int32_t));
+    dt->children = malloc(nb * sizeof(int32_t));
+    dt->pre = malloc(nb * sizeof(int32_t));
+    dt->last = malloc(nb * sizeof(int32_t));
+    int32_t *fill = calloc(nb, sizeof(int32_t));
+    int32_t *stack = malloc(nb * sizeof(int32_t));
+    bool ok = dt->idom && dt->child_start && dt->children && dt->pre && dt->last && fill && stack;
+    if (!ok) goto out;
+
+    dt->idom[0] = 0;
+    for (size_t b = 1; b < nb; b++) dt->idom[b] = -1;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t b = 1; b < nb; b++) {
+            int32_t new_idom = -1;
+            for (int32_t i = dt->pred_start[b]; i < dt->pred_start[b + 1]; i++) {
+                int32_t p = dt->preds[i];
+                if (dt->idom[p] < 0) continue;
+                new_idom = new_idom < 0 ? p : intersect(dt->idom, p, new_idom);
+            }
+            if (new_idom != dt->idom[b]) {
+                dt->idom[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t b = 1; b < nb; b++) dt->child_start[dt->idom[b] + 1]++;
+    for (size_t b = 0; b < nb; b++) dt->child_start[b + 1] += dt->child_start[b];
+    for (size_t b = 1; b < nb; b++) {
+        int32_t parent = dt->idom[b];
+        dt->children[dt->child_start[parent] + fill[parent]++] = (int32_t)b;
+    }
+
+    /* Number the tree in preorder: a dominates b iff pre[a] <= pre[b] <= last[a] */
+    int32_t counter = 0;
+    size_t depth = 0;
+    stack[depth++] = 0;
+    dt->pre[0] = counter++;
+    memset(fill, 0, nb * sizeof(int32_t));
+    while (depth > 0) {
+        int32_t b = stack[depth - 1];
+        if (dt->child_start[b] + fill[b] < dt->child_start[b + 1]) {
+            int32_t child = dt->children[dt->child_start[b] + fill[b]++];
+            dt->pre[child] = counter++;
+            stack[depth++] = child;
+            continue;
+        }
+        dt->last[b] = counter - 1;
+        depth--;
+    }
+
+out:
+    free(fill);
+    free(stack);
+    return ok;
+}
+
+anvil_error_t anvil_domtree_compute(anvil_domtree_t *dt, anvil_func_t *func)
+{
+    memset(dt, 0, sizeof(*dt));
+    if (!func || !func->blocks || !func->entry) return ANVIL_ERR_INVALID_ARG;
+    dt->func = func;
+
+    if (!order_blocks(dt, func) || !build_preds(dt) || !build_tree(dt)) {
+        anvil_domtree_free(dt);
+        return ANVIL_ERR_NOMEM;
+    }
+    return ANVIL_OK;
+}
+
+bool anvil_domtree_dominates(const anvil_domtree_t *dt, int32_t a, int32_t b)
+{
+    return dt->pre[a] <= dt->pre[b] && dt->pre[b] <= dt->last[a];
+}
+
+/* Every block where the dominance of a join point's preds ends: walk up
+ * from each pred to the join point's idom. A runner meets the same join
+ * point only in a row, so checking the last entry keeps the sets unique. */
+static size_t walk_frontiers(anvil_domtree_t *dt, int32_t *last_join, int32_t *fill)
+{
+    size_t total = 0;
+    for (size_t b = 0; b < dt->num_blocks; b++) last_join[b] = -1;
+    for (size_t b = 1; b < dt->num_blocks; b++) {
+        if (dt->pred_start[b + 1] - dt->pred_start[b] < 2) continue;
+        for (int32_t i = dt->pred_start[b]; i < dt->pred_start[b + 1]; i++) {
+            for (int32_t r = dt->preds[i]; r != dt->idom[b]; r = dt->idom[r]) {
+                if (last_join[r] == (int32_t)b) continue;
+                last_join[r] = (int32_t)b;
+                if (fill) dt->df[dt->df_start[r] + fill[r]++] = (int32_t)b;
+                else dt->df_start[r + 1]++;
+                total++;
+            }
+        }
+    }
+    return total;
+}
+
+anvil_error_t anvil_domtree_frontiers(anvil_domtree_t *dt)
+{
+    if (dt->df_start) return ANVIL_OK;
+
+    size_t nb = dt->num_blocks;
+    int32_t *last_join = malloc(nb * sizeof(int32_t));
+    int32_t *fill = calloc(nb, sizeof(int32_t));
+    dt->df_start = calloc(nb + 1, sizeof(int32_t));
+    if (!last_join || !fill || !dt->df_start) goto fail;
+
+    size_t total = walk_frontiers(dt, last_join, NULL);
+    for (size_t b = 0; b < nb; b++) dt->df_start[b + 1] += dt->df_start[b];
+    dt->df = malloc((total ? total : 1) * sizeof(int32_t));
+    if (!dt->df) goto fail;
+    walk_frontiers(dt, last_join, fill);
+
+    free(last_join);
+    free(fill);
+    return ANVIL_OK;
+
+fail:
+    free(last_join);
+    free(fill);
+    free(dt->df_start);
+    dt->df_start = NULL;
+    return ANVIL_ERR_NOMEM;
+}
+
+anvil_domtree_t *anvil_func_domtree(anvil_func_t *func)
+{
+    if (!func || func->is_declaration) return NULL;
+    if (func->domtree) return func->domtree;
+
+    anvil_domtree_t *dt = malloc(sizeof(anvil_domtree_t));
+    if (!dt) return NULL;
+    if (anvil_domtree_compute(dt, func) != ANVIL_OK) {
+        free(dt);
+        return NULL;
+    }
+    func->domtree = dt;
+    return dt;
+}
+
+anvil_domtree_t *anvil_func_dom_frontiers(anvil_func_t *func)
+{
+    anvil_domtree_t *dt = anvil_func_domtree(func);
+    return dt && anvil_domtree_frontiers(dt) == ANVIL_OK ? dt : NULL;
+}
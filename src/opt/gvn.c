@@ -0,0 +1,323 @@
+/*
+ * ANVIL - Global Value Numbering (GVN) Pass
+ *
+ * Reuses the result of a pure computation when the same computation was
+ * already made on every path leading to it:
+ *
+ *   entry:  a = x + y               entry:  a = x + y
+ *           br c, then, else                br c, then, else
+ *   then:   b = y + x        ->     then:   (uses of b now use a)
+ *
+ * Blocks are visited in dominator tree preorder with a scoped hash table
+ * of available expressions: a block sees what its dominators computed
+ * and nothing from its siblings, and entries are popped on the way back
+ * up. Keys are normalized so equivalent forms meet: commutative operands
+ * are put in a fixed order, GT/GE compares become LT/LE with the operands
+ * swapped, and constants compare by type and value.
+ *
+ * Only operations that read nothing but their operands are numbered;
+ * loads are left to load_elim and store_load_prop. This supersedes the
+ * block-local CSE pass at O2.
+ */
+
+#include "anvil/anvil_internal.h"
+#include "anvil/anvil_opt.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Available expression; chained to older entries in the same bucket */
+typedef struct {
+    anvil_instr_t *instr;
+    anvil_op_t op;          /* Normalized opcode */
+    bool swap;              /* First two operands taken in reverse order */
+    uint32_t hash;
+    int32_t next;           /* Older entry in the bucket, or -1 */
+} gvn_entry_t;
+
+typedef struct {
+    anvil_domtree_t *dt;
+
+    gvn_entry_t *entries;   /* Stack; a block's entries are popped after it */
+    size_t num_entries;
+    int32_t *buckets;
+    size_t mask;
+} gvn_t;
+
+/* Check if an operation depends only on its operands */
+static bool is_gvn_candidate(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_ADD:
+        case ANVIL_OP_SUB:
+        case ANVIL_OP_MUL:
+        case ANVIL_OP_DIV:
+        case ANVIL_OP_SDIV:
+        case ANVIL_OP_UDIV:
+        case ANVIL_OP_MOD:
+        case ANVIL_OP_SMOD:
+        case ANVIL_OP_UMOD:
+        case ANVIL_OP_NEG:
+        case ANVIL_OP_AND:
+        case ANVIL_OP_OR:
+        case ANVIL_OP_XOR:
+        case ANVIL_OP_NOT:
+        case ANVIL_OP_SHL:
+        case ANVIL_OP_SHR:
+        case ANVIL_OP_SAR:
+        case ANVIL_OP_CMP_EQ:
+        case ANVIL_OP_CMP_NE:
+        case ANVIL_OP_CMP_LT:
+        case ANVIL_OP_CMP_LE:
+        case ANVIL_OP_CMP_GT:
+        case ANVIL_OP_CMP_GE:
+        case ANVIL_OP_CMP_ULT:
+        case ANVIL_OP_CMP_ULE:
+        case ANVIL_OP_CMP_UGT:
+        case ANVIL_OP_CMP_UGE:
+        case ANVIL_OP_GEP:
+        case ANVIL_OP_STRUCT_GEP:
+        case ANVIL_OP_TRUNC:
+        case ANVIL_OP_ZEXT:
+        case ANVIL_OP_SEXT:
+        case ANVIL_OP_FPTRUNC:
+        case ANVIL_OP_FPEXT:
+        case ANVIL_OP_FPTOSI:
+        case ANVIL_OP_FPTOUI:
+        case ANVIL_OP_SITOFP:
+        case ANVIL_OP_UITOFP:
+        case ANVIL_OP_PTRTOINT:
+        case ANVIL_OP_INTTOPTR:
+        case ANVIL_OP_BITCAST:
+        case ANVIL_OP_FADD:
+        case ANVIL_OP_FSUB:
+        case ANVIL_OP_FMUL:
+        case ANVIL_OP_FDIV:
+        case ANVIL_OP_FNEG:
+        case ANVIL_OP_FABS:
+        case ANVIL_OP_FCMP:
+        case ANVIL_OP_SELECT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Check if operation is commutative */
+static bool is_commutative(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_ADD:
+        case ANVIL_OP_MUL:
+        case ANVIL_OP_AND:
+        case ANVIL_OP_OR:
+        case ANVIL_OP_XOR:
+        case ANVIL_OP_CMP_EQ:
+        case ANVIL_OP_CMP_NE:
+        case ANVIL_OP_FADD:
+        case ANVIL_OP_FMUL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Compare with the operands swapped: a > b is b < a */
+static anvil_op_t swapped_cmp(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_GT:  return ANVIL_OP_CMP_LT;
+        case ANVIL_OP_CMP_GE:  return ANVIL_OP_CMP_LE;
+        case ANVIL_OP_CMP_UGT: return ANVIL_OP_CMP_ULT;
+        case ANVIL_OP_CMP_UGE: return ANVIL_OP_CMP_ULE;
+        default:               return op;
+    }
+}
+
+static bool is_const_scalar(const anvil_value_t *val)
+{
+    return val->kind == ANVIL_VAL_CONST_INT || val->kind == ANVIL_VAL_CONST_FLOAT ||
+           val->kind == ANVIL_VAL_CONST_NULL;
+}
+
+/* Constants are equal by type and bits, everything else by identity */
+static bool same_operand(const anvil_value_t *a, const anvil_value_t *b)
+{
+    if (a == b) return true;
+    return is_const_scalar(a) && a->kind == b->kind && a->type == b->type &&
+           (a->kind == ANVIL_VAL_CONST_NULL || a->data.u == b->data.u);
+}
+
+static uint64_t operand_hash(const anvil_value_t *val)
+{
+    if (!is_const_scalar(val)) return (uintptr_t)val;
+    uint64_t bits = val->kind == ANVIL_VAL_CONST_NULL ? 0 : val->data.u;
+    return (bits * 0x9e3779b97f4a7c15ULL) ^ (uintptr_t)val->type ^ (uint64_t)val->kind;
+}
+
+/* Fixed order for commutative operands: values by id, then constants */
+static bool operands_reversed(const anvil_value_t *a, const anvil_value_t *b)
+{
+    bool ca = is_const_scalar(a), cb = is_const_scalar(b);
+    if (ca != cb) return ca;
+    if (ca) return a->data.u > b->data.u;
+    return a->id > b->id;
+}
+
+static anvil_value_t *key_operand(const anvil_instr_t *instr, bool swap, size_t i)
+{
+    return swap && i < 2 ? instr->operands[1 - i] : instr->operands[i];
+}
+
+/* Normalized opcode and operand order of an instruction */
+static void make_key(const anvil_instr_t *instr, gvn_entry_t *key)
+{
+    key->instr = (anvil_instr_t *)instr;
+    key->op = instr->op;
+    key->swap = false;
+    if (instr->num_operands == 2) {
+        anvil_op_t op = swapped_cmp(instr->op);
+        if (op != instr->op) {
+            key->op = op;
+            key->swap = true;
+        } else if (is_commutative(op)) {
+            key->swap = operands_reversed(instr->operands[0], instr->operands[1]);
+        }
+    }
+
+    uint64_t h = (uint64_t)key->op * 0xff51afd7ed558ccdULL;
+    h ^= (uintptr_t)instr->result->type + (uintptr_t)instr->aux_type;
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        h = (h ^ operand_hash(key_operand(instr, key->swap, i))) * 0xc4ceb9fe1a85ec53ULL;
+    }
+    key->hash = (uint32_t)(h ^ (h >> 32));
+}
+
+static bool same_key(const gvn_entry_t *a, const gvn_entry_t *b)
+{
+    const anvil_instr_t *x = a->instr, *y = b->instr;
+    if (a->hash != b->hash || a->op != b->op || x->num_operands != y->num_operands ||
+        x->result->type != y->result->type || x->aux_type != y->aux_type) {
+        return false;
+    }
+    for (size_t i = 0; i < x->num_operands; i++) {
+        if (!same_operand(key_operand(x, a->swap, i), key_operand(y, b->swap, i))) return false;
+    }
+    return true;
+}
+
+static bool can_number(const anvil_instr_t *instr)
+{
+    if (!is_gvn_candidate(instr->op) || !instr->result || instr->num_operands == 0) return false;
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        if (!instr->operands[i]) return false;
+    }
+    return true;
+}
+
+static bool alloc_table(gvn_t *g)
+{
+    size_t count = 0;
+    for (size_t b = 0; b < g->dt->num_blocks; b++) {
+        for (anvil_instr_t *instr = g->dt->blocks[b]->first; instr; instr = instr->next) {
+            if (can_number(instr)) count++;
+        }
+    }
+    size_t size = 16;
+    while (size < 2 * count) size *= 2;
+    g->mask = size - 1;
+    g->entries = malloc((count ? count : 1) * sizeof(gvn_entry_t));
+    g->buckets = malloc(size * sizeof(int32_t));
+    if (!g->entries || !g->buckets) return false;
+    memset(g->buckets, 0xff, size * sizeof(int32_t));
+    return true;
+}
+
+/* Number one block's instructions against everything its dominators made */
+static bool number_block(gvn_t *g, anvil_block_t *block)
+{
+    bool changed = false;
+    for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+        if (!can_number(instr)) continue;
+
+        gvn_entry_t key;
+        make_key(instr, &key);
+        int32_t *bucket = &g->buckets[key.hash & g->mask];
+        const gvn_entry_t *found = NULL;
+        for (int32_t e = *bucket; e >= 0; e = g->entries[e].next) {
+            if (same_key(&g->entries[e], &key)) {
+                found = &g->entries[e];
+                break;
+            }
+        }
+
+        if (found) {
+            /* The earlier computation dominates every use of this one */
+            anvil_value_replace_all_uses(instr->result, found->instr->result);
+            anvil_instr_kill(instr);
+            changed = true;
+        } else {
+            key.next = *bucket;
+            *bucket = (int32_t)g->num_entries;
+            g->entries[g->num_entries++] = key;
+        }
+    }
+    return changed;
+}
+
+/* Drop the entries made since the table held `mark` of them */
+static void pop_entries(gvn_t *g, size_t mark)
+{
+    while (g->num_entries > mark) {
+        const gvn_entry_t *e = &g->entries[--g->num_entries];
+        g->buckets[e->hash & g->mask] = e->next;
+    }
+}
+
+/* Preorder walk of the dominator tree */
+static bool walk_domtree(gvn_t *g)
+{
+    typedef struct {
+        int32_t block;
+        int32_t next_child;
+        size_t mark;
+    } frame_t;
+
+    const anvil_domtree_t *dt = g->dt;
+    frame_t *stack = malloc(dt->num_blocks * sizeof(frame_t));
+    if (!stack) return false;
+
+    bool changed = false;
+    size_t depth = 0;
+    stack[depth++] = (frame_t){ 0, dt->child_start[0], 0 };
+    changed |= number_block(g, dt->blocks[0]);
+    while (depth > 0) {
+        frame_t *top = &stack[depth - 1];
+        if (top->next_child < dt->child_start[top->block + 1]) {
+            int32_t child = dt->children[top->next_child++];
+            stack[depth++] = (frame_t){ child, dt->child_start[child], g->num_entries };
+            changed |= number_block(g, dt->blocks[child]);
+            continue;
+        }
+        pop_entries(g, top->mark);
+        depth--;
+    }
+    free(stack);
+    return changed;
+}
+
+/* Main GVN pass */
+bool anvil_pass_gvn(anvil_func_t *func)
+{
+    if (!func || !func->blocks || !func->entry) return false;
+
+    gvn_t g = { 0 };
+    bool changed = false;
+    g.dt = anvil_func_domtree(func);
+    if (g.dt && alloc_table(&g)) {
+        changed = walk_domtree(&g);
+    }
+
+    free(g.entries);
+    free(g.buckets);
+    return changed;
+}
@@ -0,0 +1,520 @@
+/*
+ * ANVIL - Loop-Invariant Code Motion Pass
+ *
+ * Moves computations that give the same result on every iteration of a
+ * loop into its preheader, so they run once per entry into the loop:
+ *
+ *   pre:   br outer                   pre:   row = gep a, i
+ *   ...                                      br outer
+ *   inner: row = gep a, i       ->    ...
+ *          p = gep row, j             inner: p = gep row, j
+ *
+ * Loops come from the cached loop nest (opt/loops.c) and are visited
+ * innermost first, so code hoisted out of an inner loop into its
+ * preheader can leave the enclosing loop in the same run.
+ *
+ * What moves:
+ * - Pure operations (the ones GVN numbers) whose operands are defined
+ *   outside the loop. Division and remainder can trap, so they move only
+ *   by a constant other than 0 and -1.
+ * - Loads from an invariant address that no store or call in the loop
+ *   can write. Running the load ahead of the loop must also be safe:
+ *   the address is a fixed offset into a local or global, or the load's
+ *   block runs on every trip through a loop without calls.
+ *
+ * A loop whose header is entered from several blocks, or from a block
+ * that branches elsewhere too, has no preheader. When such a loop has
+ * something to hoist, a new block is put in front of the header, the
+ * entering edges are sent through it and the header's phis take their
+ * values from outside the loop through it.
+ */
+
+#include "anvil/anvil_internal.h"
+#include "anvil/anvil_opt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Memory writes in the loop being processed */
+typedef struct {
+    anvil_instr_t **stores;
+    size_t num_stores;
+    size_t cap_stores;
+    bool has_call;
+
+    int32_t *exiting;       /* Blocks of the loop with a successor outside it */
+    size_t num_exiting;
+} loop_mem_t;
+
+typedef struct {
+    anvil_func_t *func;
+    anvil_loop_info_t *li;
+    const anvil_domtree_t *dt;
+    loop_mem_t mem;
+} licm_t;
+
+/* ============================================================================
+ * Invariance
+ * ============================================================================ */
+
+/* Check if an operation depends only on its operands */
+static bool is_pure(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_ADD:
+        case ANVIL_OP_SUB:
+        case ANVIL_OP_MUL:
+        case ANVIL_OP_NEG:
+        case ANVIL_OP_AND:
+        case ANVIL_OP_OR:
+        case ANVIL_OP_XOR:
+        case ANVIL_OP_NOT:
+        case ANVIL_OP_SHL:
+        case ANVIL_OP_SHR:
+        case ANVIL_OP_SAR:
+        case ANVIL_OP_CMP_EQ:
+        case ANVIL_OP_CMP_NE:
+        case ANVIL_OP_CMP_LT:
+        case ANVIL_OP_CMP_LE:
+        case ANVIL_OP_CMP_GT:
+        case ANVIL_OP_CMP_GE:
+        case ANVIL_OP_CMP_ULT:
+        case ANVIL_OP_CMP_ULE:
+        case ANVIL_OP_CMP_UGT:
+        case ANVIL_OP_CMP_UGE:
+        case ANVIL_OP_GEP:
+        case ANVIL_OP_STRUCT_GEP:
+        case ANVIL_OP_TRUNC:
+        case ANVIL_OP_ZEXT:
+        case ANVIL_OP_SEXT:
+        case ANVIL_OP_FPTRUNC:
+        case ANVIL_OP_FPEXT:
+        case ANVIL_OP_FPTOSI:
+        case ANVIL_OP_FPTOUI:
+        case ANVIL_OP_SITOFP:
+        case ANVIL_OP_UITOFP:
+        case ANVIL_OP_PTRTOINT:
+        case ANVIL_OP_INTTOPTR:
+        case ANVIL_OP_BITCAST:
+        case ANVIL_OP_FADD:
+        case ANVIL_OP_FSUB:
+        case ANVIL_OP_FMUL:
+        case ANVIL_OP_FDIV:
+        case ANVIL_OP_FNEG:
+        case ANVIL_OP_FABS:
+        case ANVIL_OP_FCMP:
+        case ANVIL_OP_SELECT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Division that cannot trap wherever it runs: by a constant that is
+ * neither 0 nor, when signed, -1 (INT_MIN / -1 overflows) */
+static bool is_safe_division(const anvil_instr_t *instr)
+{
+    bool is_signed;
+    switch (instr->op) {
+        case ANVIL_OP_DIV:
+        case ANVIL_OP_SDIV:
+        case ANVIL_OP_MOD:
+        case ANVIL_OP_SMOD:
+            is_signed = true;
+            break;
+        case ANVIL_OP_UDIV:
+        case ANVIL_OP_UMOD:
+            is_signed = false;
+            break;
+        default:
+            return false;
+    }
+    if (instr->num_operands < 2) return false;
+    const anvil_value_t *divisor = instr->operands[1];
+    if (divisor->kind != ANVIL_VAL_CONST_INT || divisor->data.i == 0) return false;
+    return !is_signed || divisor->data.i != -1;
+}
+
+/* Block index of the loop-side definition of val, or -1 if it has none */
+static int32_t def_block(const licm_t *lc, const anvil_value_t *val)
+{
+    if (!val || val->kind != ANVIL_VAL_INSTR) return -1;
+    const anvil_instr_t *def = val->data.instr;
+    return def->parent ? anvil_domtree_index(lc->dt, def->parent) : -1;
+}
+
+/* Every operand is defined outside loop l */
+static bool operands_invariant(const licm_t *lc, int32_t l, const anvil_instr_t *instr)
+{
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        int32_t b = def_block(lc, instr->operands[i]);
+        if (b >= 0 && anvil_loop_contains(lc->li, l, b)) return false;
+    }
+    return true;
+}
+
+/* ============================================================================
+ * Memory
+ * ============================================================================ */
+
+/* The alloca or global a pointer points into, or NULL if unknown */
+static anvil_value_t *base_object(anvil_value_t *ptr)
+{
+    while (ptr && ptr->kind == ANVIL_VAL_INSTR) {
+        anvil_instr_t *def = ptr->data.instr;
+        if (def->op == ANVIL_OP_ALLOCA) return ptr;
+        if ((def->op != ANVIL_OP_GEP && def->op != ANVIL_OP_STRUCT_GEP &&
+             def->op != ANVIL_OP_BITCAST) || def->num_operands == 0)
+            return NULL;
+        ptr = def->operands[0];
+    }
+    return ptr && ptr->kind == ANVIL_VAL_GLOBAL ? ptr : NULL;
+}
+
+/* Address at a constant offset into an alloca or global: it can be read
+ * even on a path where the original load would not have run */
+static bool is_fixed_address(anvil_value_t *ptr)
+{
+    while (ptr && ptr->kind == ANVIL_VAL_INSTR) {
+        anvil_instr_t *def = ptr->data.instr;
+        if (def->op == ANVIL_OP_ALLOCA) return true;
+        if ((def->op != ANVIL_OP_STRUCT_GEP && def->op != ANVIL_OP_BITCAST) ||
+            def->num_operands == 0)
+            return false;
+        ptr = def->operands[0];
+    }
+    return ptr && ptr->kind == ANVIL_VAL_GLOBAL;
+}
+
+/* Some address derived from ptr is used other than to load or store through */
+static bool address_escapes(const anvil_value_t *ptr)
+{
+    for (anvil_use_t *use = ptr->uses; use; use = use->next) {
+        const anvil_instr_t *user = use->user;
+        size_t idx = (size_t)(use - user->uses);
+        if (user->op == ANVIL_OP_LOAD && idx == 0) continue;
+        if (user->op == ANVIL_OP_STORE && idx == 1) continue;
+        if ((user->op == ANVIL_OP_GEP || user->op == ANVIL_OP_STRUCT_GEP ||
+             user->op == ANVIL_OP_BITCAST) && idx == 0 && user->result &&
+            !address_escapes(user->result))
+            continue;
+        return true;
+    }
+    return false;
+}
+
+/* An alloca whose address never leaves the function's own loads and
+ * stores: no call and no store through another pointer can reach it */
+static bool is_local_object(const anvil_value_t *base)
+{
+    return base && base->kind == ANVIL_VAL_INSTR &&
+           base->data.instr->op == ANVIL_OP_ALLOCA && !address_escapes(base);
+}
+
+/* Different constant fields of one struct pointer */
+static bool distinct_fields(const anvil_value_t *p, const anvil_value_t *q)
+{
+    if (p->kind != ANVIL_VAL_INSTR || q->kind != ANVIL_VAL_INSTR) return false;
+    const anvil_instr_t *a = p->data.instr, *b = q->data.instr;
+    if (a->op != ANVIL_OP_STRUCT_GEP || b->op != ANVIL_OP_STRUCT_GEP) return false;
+    if (a->num_operands < 2 || b->num_operands < 2 || a->operands[0] != b->operands[0]) return false;
+    const anvil_value_t *fa = a->operands[1], *fb = b->operands[1];
+    return fa->kind == ANVIL_VAL_CONST_INT && fb->kind == ANVIL_VAL_CONST_INT &&
+           fa->data.i != fb->data.i;
+}
+
+/* Check if a store to q may write memory a load from p reads */
+static bool may_alias(anvil_value_t *p, anvil_value_t *q)
+{
+    if (p == q) return true;
+    if (distinct_fields(p, q)) return false;
+
+    anvil_value_t *a = base_object(p);
+    anvil_value_t *b = base_object(q);
+    if (a && b) return a == b;
+    return !is_local_object(a) && !is_local_object(b);
+}
+
+/* Stores, calls and exiting blocks of loop l */
+static bool scan_loop(licm_t *lc, int32_t l)
+{
+    const anvil_loop_t *loop = &lc->li->loops[l];
+    loop_mem_t *mem = &lc->mem;
+    mem->num_stores = 0;
+    mem->num_exiting = 0;
+    mem->has_call = false;
+
+    for (size_t i = 0; i < loop->num_blocks; i++) {
+        anvil_block_t *block = lc->dt->blocks[loop->blocks[i]];
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_CALL) mem->has_call = true;
+            if (instr->op != ANVIL_OP_STORE || instr->num_operands < 2) continue;
+            if (mem->num_stores == mem->cap_stores) {
+                size_t cap = mem->cap_stores ? mem->cap_stores * 2 : 16;
+                anvil_instr_t **stores = realloc(mem->stores, cap * sizeof(anvil_instr_t *));
+                if (!stores) return false;
+                mem->stores = stores;
+                mem->cap_stores = cap;
+            }
+            mem->stores[mem->num_stores++] = instr;
+        }
+        for (size_t s = 0; s < block->num_succs; s++) {
+            int32_t succ = anvil_domtree_index(lc->dt, block->succs[s]);
+            if (succ >= 0 && !anvil_loop_contains(lc->li, l, succ)) {
+                mem->exiting[mem->num_exiting++] = loop->blocks[i];
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/* Block b runs every time control goes round loop l or leaves it */
+static bool runs_every_trip(const licm_t *lc, int32_t l, int32_t b)
+{
+    const anvil_loop_t *loop = &lc->li->loops[l];
+    for (size_t i = 0; i < loop->num_latches; i++) {
+        if (!anvil_domtree_dominates(lc->dt, b, loop->latches[i])) return false;
+    }
+    for (size_t i = 0; i < lc->mem.num_exiting; i++) {
+        if (!anvil_domtree_dominates(lc->dt, b, lc->mem.exiting[i])) return false;
+    }
+    return true;
+}
+
+static bool can_hoist_load(const licm_t *lc, int32_t l, const anvil_instr_t *load)
+{
+    if (load->num_operands < 1 || !load->result) return false;
+    anvil_value_t *ptr = load->operands[0];
+
+    /* Nothing in the loop writes the location */
+    if (lc->mem.has_call && !is_local_object(base_object(ptr))) return false;
+    for (size_t i = 0; i < lc->mem.num_stores; i++) {
+        if (may_alias(ptr, lc->mem.stores[i]->operands[1])) return false;
+    }
+
+    /* Reading it before the loop cannot fault where the loop would not.
+     * A call could end the program before the load, so trip-count
+     * reasoning needs a loop without calls. */
+    if (is_fixed_address(ptr)) return true;
+    if (lc->mem.has_call) return false;
+    return runs_every_trip(lc, l, anvil_domtree_index(lc->dt, load->parent));
+}
+
+static bool can_hoist(const licm_t *lc, int32_t l, const anvil_instr_t *instr)
+{
+    if (!operands_invariant(lc, l, instr)) return false;
+    if (instr->op == ANVIL_OP_LOAD) return can_hoist_load(lc, l, instr);
+    return is_pure(instr->op) || is_safe_division(instr);
+}
+
+/* ============================================================================
+ * Preheaders
+ * ============================================================================ */
+
+static bool is_outside_pred(const licm_t *lc, int32_t l, anvil_block_t *pred)
+{
+    int32_t p = anvil_domtree_index(lc->dt, pred);
+    return p >= 0 && !anvil_loop_contains(lc->li, l, p);
+}
+
+/* Entries into the header from outside the loop now come from pre */
+static bool move_phi_entries(licm_t *lc, int32_t l, anvil_block_t *header, anvil_block_t *pre)
+{
+    anvil_ctx_t *ctx = lc->func->parent->ctx;
+    anvil_pool_t *pool = &lc->func->parent->pool;
+
+    for (anvil_instr_t *phi = header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        /* One value from every entering block goes through as is */
+        anvil_value_t *same = NULL;
+        bool differ = false;
+        for (size_t i = 0; i < phi->num_phi_incoming; i++) {
+            if (!is_outside_pred(lc, l, phi->phi_blocks[i])) continue;
+            if (same && same != phi->operands[i]) differ = true;
+            same = phi->operands[i];
+        }
+        if (!same) continue;
+
+        anvil_value_t *incoming = same;
+        if (differ) {
+            anvil_instr_t *merge = anvil_instr_create_in(ctx, pool, ANVIL_OP_PHI, phi->result->type,
+                                                         phi->result->name);
+            if (!merge) return false;
+            anvil_instr_insert_before(pre, pre->first, merge);
+            for (size_t i = 0; i < phi->num_phi_incoming; i++) {
+                if (is_outside_pred(lc, l, phi->phi_blocks[i]))
+                    anvil_phi_add_incoming(merge->result, phi->operands[i], phi->phi_blocks[i]);
+            }
+            incoming = merge->result;
+        }
+        for (size_t i = phi->num_phi_incoming; i-- > 0;) {
+            if (is_outside_pred(lc, l, phi->phi_blocks[i])) anvil_phi_remove_incoming(phi, i);
+        }
+        anvil_phi_add_incoming(phi->result, incoming, pre);
+    }
+    return true;
+}
+
+/* Give loop l a preheader */
+static bool make_preheader(licm_t *lc, int32_t l)
+{
+    anvil_func_t *func = lc->func;
+    anvil_block_t *header = lc->dt->blocks[lc->li->loops[l].header];
+
+    /* Entering blocks, once each */
+    size_t num_outside = 0;
+    anvil_block_t **outside = malloc((header->num_preds ? header->num_preds : 1) * sizeof(anvil_block_t *));
+    if (!outside) return false;
+    for (size_t i = 0; i < header->num_preds; i++) {
+        anvil_block_t *pred = header->preds[i];
+        if (!is_outside_pred(lc, l, pred)) continue;
+        bool seen = false;
+        for (size_t j = 0; j < num_outside; j++) seen |= outside[j] == pred;
+        if (!seen) outside[num_outside++] = pred;
+    }
+    if (num_outside == 0) {
+        free(outside);
+        return false;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s_ph", header->name ? header->name : "loop");
+    anvil_block_t *pre = anvil_block_create(func, name);
+    anvil_instr_t *br = pre ? anvil_instr_create_in(func->parent->ctx, &func->parent->pool, ANVIL_OP_BR,
+                                                   anvil_type_void(func->parent->ctx), NULL) : NULL;
+    if (!br) {
+        free(outside);
+        return false;
+    }
+    anvil_block_move_before(pre, header);
+    br->true_block = header;
+    anvil_instr_insert_before(pre, NULL, br);
+
+    bool ok = move_phi_entries(lc, l, header, pre);
+    for (size_t i = 0; i < num_outside; i++) {
+        anvil_instr_t *term = outside[i]->last;
+        if (term->true_block == header) anvil_instr_set_succ(term, 0, pre);
+        if (term->op == ANVIL_OP_BR_COND && term->false_block == header)
+            anvil_instr_set_succ(term, 1, pre);
+    }
+    free(outside);
+    return ok;
+}
+
+/* ============================================================================
+ * Pass
+ * ============================================================================ */
+
+static bool has_candidate(const licm_t *lc, int32_t l)
+{
+    const anvil_loop_t *loop = &lc->li->loops[l];
+    for (size_t i = 0; i < loop->num_blocks; i++) {
+        anvil_block_t *block = lc->dt->blocks[loop->blocks[i]];
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (can_hoist(lc, l, instr)) return true;
+        }
+    }
+    return false;
+}
+
+/* Hoist what can leave loop l, in RPO so operands move before their users */
+static bool hoist_loop(licm_t *lc, int32_t l)
+{
+    const anvil_loop_t *loop = &lc->li->loops[l];
+    anvil_block_t *pre = lc->dt->blocks[loop->preheader];
+    bool changed = false;
+
+    for (size_t i = 0; i < loop->num_blocks; i++) {
+        anvil_block_t *block = lc->dt->blocks[loop->blocks[i]];
+        anvil_instr_t *instr = block->first;
+        while (instr) {
+            anvil_instr_t *next = instr->next;
+            if (can_hoist(lc, l, instr)) {
+                anvil_instr_move_before(pre, pre->last, instr);
+                changed = true;
+            }
+            instr = next;
+        }
+    }
+    return changed;
+}
+
+static bool alloc_exiting(licm_t *lc)
+{
+    free(lc->mem.exiting);
+    lc->mem.exiting = malloc(lc->dt->num_blocks * sizeof(int32_t));
+    return lc->mem.exiting != NULL;
+}
+
+/* Create the preheaders loops with something to hoist are missing. Block
+ * creation drops the cached analyses, so this works on a private copy of
+ * them that keeps describing the CFG as it was. An empty preheader would
+ * just be folded away again by simplify-cfg. */
+static bool add_preheaders(licm_t *lc)
+{
+    anvil_domtree_t dt;
+    anvil_loop_info_t li;
+    if (anvil_domtree_compute(&dt, lc->func) != ANVIL_OK) return false;
+    if (anvil_loops_compute(&li, &dt) != ANVIL_OK) {
+        anvil_domtree_free(&dt);
+        return false;
+    }
+    lc->dt = &dt;
+    lc->li = &li;
+
+    /* Decide for every loop before the first edit */
+    int32_t *todo = malloc(li.num_loops * sizeof(int32_t));
+    size_t num_todo = 0;
+    bool ok = todo && alloc_exiting(lc);
+    for (size_t l = 0; ok && l < li.num_loops; l++) {
+        if (li.loops[l].preheader >= 0) continue;
+        ok = scan_loop(lc, (int32_t)l);
+        if (ok && has_candidate(lc, (int32_t)l)) todo[num_todo++] = (int32_t)l;
+    }
+
+    bool made = false;
+    for (size_t i = 0; ok && i < num_todo; i++) {
+        made |= make_preheader(lc, todo[i]);
+    }
+
+    free(todo);
+    anvil_loops_free(&li);
+    anvil_domtree_free(&dt);
+    lc->li = NULL;
+    lc->dt = NULL;
+    return made;
+}
+
+bool anvil_pass_licm(anvil_func_t *func)
+{
+    if (!func || !func->blocks) return false;
+
+    licm_t lc = { .func = func };
+    bool changed = false;
+    anvil_loop_info_t *li = anvil_func_loops(func);
+    if (!li || li->num_loops == 0) return false;
+
+    bool missing = false;
+    for (size_t l = 0; l < li->num_loops; l++) missing |= li->loops[l].preheader < 0;
+    if (missing && add_preheaders(&lc)) {
+        changed = true;
+        li = anvil_func_loops(func);
+        if (!li) goto out;
+    }
+
+    /* Hoisting moves no branches, so the nest stays valid throughout.
+     * Inner loops have later headers in RPO. */
+    lc.li = li;
+    lc.dt = li->dt;
+    if (!alloc_exiting(&lc)) goto out;
+    for (size_t l = li->num_loops; l-- > 0;) {
+        if (li->loops[l].preheader < 0) continue;
+        if (!scan_loop(&lc, (int32_t)l)) break;
+        if (hoist_loop(&lc, (int32_t)l)) changed = true;
+    }
+
+out:
+    free(lc.mem.stores);
+    free(lc.mem.exiting);
+    return changed;
+}
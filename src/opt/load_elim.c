@@ -97,39 +97,6 @@ static anvil_value_t *find_available_load(anvil_instr_t *load_instr)
     return NULL;
 }
 
-/* Replace all uses of old_val with new_val in the function */
-static int replace_uses_after(anvil_instr_t *start, anvil_value_t *old_val, anvil_value_t *new_val)
-{
-    int count = 0;
-    
-    /* Replace in remaining instructions of this block */
-    for (anvil_instr_t *instr = start->next; instr; instr = instr->next) {
-        for (size_t i = 0; i < instr->num_operands; i++) {
-            if (instr->operands[i] == old_val) {
-                instr->operands[i] = new_val;
-                count++;
-            }
-        }
-    }
-    
-    /* Replace in subsequent blocks */
-    anvil_block_t *block = start->parent;
-    if (block) {
-        for (anvil_block_t *b = block->next; b; b = b->next) {
-            for (anvil_instr_t *instr = b->first; instr; instr = instr->next) {
-                for (size_t i = 0; i < instr->num_operands; i++) {
-                    if (instr->operands[i] == old_val) {
-                        instr->operands[i] = new_val;
-                        count++;
-                    }
-                }
-            }
-        }
-    }
-    
-    return count;
-}
-
 /* Main redundant load elimination pass */
 bool anvil_pass_load_elim(anvil_func_t *func)
 {
@@ -138,7 +105,8 @@ bool anvil_pass_load_elim(anvil_func_t *func)
     bool changed = false;
     
     /* Iterate through all blocks */
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
             if (instr->op != ANVIL_OP_LOAD) continue;
             
@@ -146,11 +114,12 @@ bool anvil_pass_load_elim(anvil_func_t *func)
             anvil_value_t *available = find_available_load(instr);
             if (!available) continue;
             
-            /* Replace uses of this load's result with the available value */
+            /* Replace uses of this load's result with the available value
+             * (the earlier load in this block dominates all of them) */
             anvil_value_t *old_result = instr->result;
-            if (old_result && replace_uses_after(instr, old_result, available) > 0) {
+            if (old_result && anvil_value_replace_all_uses(old_result, available) > 0) {
                 /* Mark the redundant load as NOP */
-                instr->op = ANVIL_OP_NOP;
+                anvil_instr_kill(instr);
                 changed = true;
             }
         }
@@ -1,632 +1,812 @@
 /*
  * ANVIL - Loop Unrolling Pass
- * 
- * Unrolls small loops with known trip counts to reduce branch overhead
- * and enable further optimizations.
- * 
- * Supported loop patterns:
- * - Simple counted loops with constant bounds
- * - Loops with single back-edge
- * - Loops without complex control flow (no nested loops, no early exits)
- * 
- * Unrolling strategies:
- * - Full unroll: for very small trip counts (<=8)
- * - Partial unroll: for larger loops (factor of 2 or 4)
+ *
+ * Unrolls innermost counted loops. A loop whose trip count is known and
+ * small is replaced by straight-line copies of its body. Other counted
+ * loops run a copy unrolled by 2, 4 or 8 first, with the exit tests
+ * dropped, and finish in the original loop:
+ *
+ *   pre:   br head                     pre:   s = i0 (+ step, if the test reads i + step)
+ *   head:  i = phi [i0, pre], ...             br_cond s < n, trip, rem
+ *          br_cond i < n, body, exit   trip:  b = trips left; m = b & -U
+ *   body:  ...                                br_cond m != 0, head_u0, rem
+ *          i1 = i + 1                  head_u0 ... body_u<U-1>: U iterations
+ *          br head                     step:  k += U; br_cond k != m, head_u0, rem
+ *                                      rem:   phis of the values from pre,
+ *                                             trip and step; br head
+ *                                      head, body: the original loop
+ *
+ * The trip count is worked out in the loop's own integer type: the loop
+ * test holds for the first b iterations, and b never comes out larger
+ * than the real count, so the unrolled copy only runs iterations the
+ * original would have run. If the induction variable would wrap before
+ * the test fails, the remainder loop runs the rest.
+ *
+ * Candidates come from the loop nest (opt/loops.c): an innermost loop
+ * with a preheader and one latch, left only from the header or the latch
+ * on a compare of a header phi stepped by a constant (or that phi plus
+ * its step) against a value defined outside the loop. The body may have
+ * any control flow of its own. Loops holding a switch or an alloca are
+ * left alone.
+ *
+ * Cost model, in instructions of the loop other than phis: a full unroll
+ * may produce up to UNROLL_FULL_MAX_SIZE of them, and the unrolled copy
+ * of a partial unroll up to UNROLL_MAX_SIZE, which picks the factor.
+ * The loops a partial unroll makes and leaves behind are marked so later
+ * runs do not unroll them again.
  */
 
 #include "anvil/anvil_internal.h"
 #include "anvil/anvil_opt.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* Configuration */
-#define MAX_FULL_UNROLL_TRIP_COUNT 8
-#define MAX_PARTIAL_UNROLL_FACTOR 4
-#define MAX_LOOP_BODY_INSTRS 32
+#define UNROLL_FULL_MAX_SIZE    128     /* Instructions after a full unroll */
+#define UNROLL_FULL_MAX_TRIPS   64
+#define UNROLL_MAX_SIZE         64      /* Instructions in the unrolled copy */
+#define UNROLL_MAX_FACTOR       8
 
-/* Loop information structure */
+/* A candidate loop. Values are read from the IR when the loop is
+ * unrolled: unrolling an earlier loop may have replaced them. */
 typedef struct {
-    anvil_block_t *header;       /* Loop header (condition check) */
-    anvil_block_t *body;         /* Loop body */
-    anvil_block_t *latch;        /* Back-edge block (jumps to header) */
-    anvil_block_t *exit;         /* Exit block */
-    anvil_block_t *preheader;    /* Block before loop */
-    
-    anvil_value_t *iv;           /* Induction variable (PHI node) */
-    anvil_value_t *iv_init;      /* Initial value */
-    anvil_value_t *iv_step;      /* Step value (increment) */
-    anvil_value_t *iv_limit;     /* Loop bound */
-    
-    anvil_op_t cmp_op;           /* Comparison operation */
-    int64_t trip_count;          /* Number of iterations (-1 if unknown) */
-    size_t body_instr_count;     /* Number of instructions in body */
-    
-    bool is_simple;              /* True if loop is simple enough to unroll */
-} loop_info_t;
-
-/* Check if a value is a constant integer */
-static bool is_const_int(anvil_value_t *val)
+    anvil_block_t *header;
+    anvil_block_t *latch;
+    anvil_block_t *preheader;
+    anvil_block_t *exiting;         /* Header or latch */
+    anvil_block_t *exit;
+    anvil_block_t *stay;            /* Exiting block's successor in the loop */
+    anvil_block_t **blocks;         /* In RPO, the header first */
+    size_t num_blocks;
+
+    anvil_instr_t *iv;              /* Header phi */
+    anvil_instr_t *cmp;             /* Exit test */
+    size_t limit_index;             /* Operand of cmp that is the bound */
+    bool tests_next;                /* cmp reads iv + step */
+    anvil_op_t stay_op;             /* x stay_op bound: loop again */
+    int64_t step;
+    unsigned width;                 /* Bits in the iv type */
+
+    size_t size;                    /* Instructions other than phis */
+    size_t header_size;
+    int64_t trips;                  /* Times the exit test holds, or -1 */
+    bool body_escapes;              /* A value of a block after the header is used outside */
+} unroll_loop_t;
+
+typedef struct {
+    anvil_func_t *func;
+    anvil_ctx_t *ctx;
+    anvil_pool_t *pool;
+
+    /* Values defined in the loop being unrolled, numbered; their
+     * counterparts in the copy being made */
+    anvil_value_map_t index;
+    anvil_value_t **cur;
+    size_t num_vals;
+    anvil_block_t **copy;           /* Blocks of the copy being made */
+} unroll_t;
+
+/* ============================================================================
+ * Analysis
+ * ============================================================================ */
+
+static unsigned int_width(const anvil_type_t *type)
+{
+    switch (type ? type->kind : ANVIL_TYPE_VOID) {
+        case ANVIL_TYPE_I8:  case ANVIL_TYPE_U8:  return 8;
+        case ANVIL_TYPE_I16: case ANVIL_TYPE_U16: return 16;
+        case ANVIL_TYPE_I32: case ANVIL_TYPE_U32: return 32;
+        case ANVIL_TYPE_I64: case ANVIL_TYPE_U64: return 64;
+        default: return 0;
+    }
+}
+
+static uint64_t truncate_to(uint64_t val, unsigned width)
+{
+    return width >= 64 ? val : val & ((UINT64_C(1) << width) - 1);
+}
+
+static int64_t sign_extend(uint64_t val, unsigned width)
+{
+    if (width >= 64) return (int64_t)val;
+    uint64_t sign = UINT64_C(1) << (width - 1);
+    val = truncate_to(val, width);
+    return (int64_t)((val ^ sign) - sign);
+}
+
+static bool is_const_int(const anvil_value_t *val)
 {
     return val && val->kind == ANVIL_VAL_CONST_INT;
 }
 
-/* Get integer constant value */
-static int64_t get_const_int(anvil_value_t *val)
+static bool in_loop(const anvil_loop_info_t *li, int32_t l, const anvil_block_t *block)
 {
-    return val->data.i;
+    int32_t b = anvil_domtree_index(li->dt, block);
+    return b >= 0 && anvil_loop_contains(li, l, b);
 }
 
-/* Check if block is a loop header (has PHI nodes and conditional branch) */
-static bool is_loop_header(anvil_block_t *block)
+static bool defined_outside(const anvil_loop_info_t *li, int32_t l, const anvil_value_t *val)
 {
-    if (!block) return false;
-    if (!block->first) return false;
-    if (!block->last) return false;
-    
-    /* Must have at least one PHI node as first instruction */
-    if (block->first->op != ANVIL_OP_PHI) return false;
-    
-    /* Must have a conditional branch as terminator */
-    if (block->last->op != ANVIL_OP_BR_COND) return false;
-    
-    return true;
+    return val->kind != ANVIL_VAL_INSTR || !in_loop(li, l, val->data.instr->parent);
 }
 
-/* Find the preheader block (predecessor that's not the latch) */
-static anvil_block_t *find_preheader(anvil_func_t *func, anvil_block_t *header, 
-                                      anvil_block_t *latch)
+static anvil_value_t *phi_incoming(const anvil_instr_t *phi, const anvil_block_t *block)
 {
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        if (block == latch) continue;
-        
-        anvil_instr_t *term = block->last;
-        if (!term) continue;
-        
-        if (term->op == ANVIL_OP_BR && term->true_block == header) {
-            return block;
-        }
-        if (term->op == ANVIL_OP_BR_COND) {
-            if (term->true_block == header || term->false_block == header) {
-                return block;
-            }
-        }
+    for (size_t i = 0; i < phi->num_phi_incoming; i++) {
+        if (phi->phi_blocks[i] == block) return phi->operands[i];
     }
     return NULL;
 }
 
-/* Find the latch block (block that branches back to header) */
-static anvil_block_t *find_latch(anvil_func_t *func, anvil_block_t *header)
+static bool is_int_compare(anvil_op_t op)
 {
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        if (block == header) continue;
-        
-        anvil_instr_t *term = block->last;
-        if (!term) continue;
-        
-        if (term->op == ANVIL_OP_BR && term->true_block == header) {
-            return block;
-        }
+    return op >= ANVIL_OP_CMP_EQ && op <= ANVIL_OP_CMP_UGE;
+}
+
+/* a op b == b swap_compare(op) a */
+static anvil_op_t swap_compare(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_LT:  return ANVIL_OP_CMP_GT;
+        case ANVIL_OP_CMP_LE:  return ANVIL_OP_CMP_GE;
+        case ANVIL_OP_CMP_GT:  return ANVIL_OP_CMP_LT;
+        case ANVIL_OP_CMP_GE:  return ANVIL_OP_CMP_LE;
+        case ANVIL_OP_CMP_ULT: return ANVIL_OP_CMP_UGT;
+        case ANVIL_OP_CMP_ULE: return ANVIL_OP_CMP_UGE;
+        case ANVIL_OP_CMP_UGT: return ANVIL_OP_CMP_ULT;
+        case ANVIL_OP_CMP_UGE: return ANVIL_OP_CMP_ULE;
+        default: return op;
     }
-    return NULL;
 }
 
-/* Count instructions in a block (excluding PHI and terminator) */
-static size_t count_body_instrs(anvil_block_t *block)
-{
-    size_t count = 0;
-    for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
-        if (instr->op == ANVIL_OP_PHI) continue;
-        if (instr->op == ANVIL_OP_BR || instr->op == ANVIL_OP_BR_COND) continue;
-        count++;
-    }
-    return count;
-}
-
-/* Analyze a potential loop and fill in loop_info */
-static bool analyze_loop(anvil_func_t *func, anvil_block_t *header, loop_info_t *info)
-{
-    memset(info, 0, sizeof(*info));
-    info->trip_count = -1;
-    info->header = header;
-    
-    /* Find latch block (block that branches back to header) */
-    info->latch = find_latch(func, header);
-    if (!info->latch) return false;
-    
-    /* Find preheader (predecessor that's not the latch) */
-    info->preheader = find_preheader(func, header, info->latch);
-    if (!info->preheader) return false;
-    
-    /* Get terminator and find exit block */
-    anvil_instr_t *term = header->last;
-    if (!term || term->op != ANVIL_OP_BR_COND) return false;
-    
-    /* Determine which branch is the body and which is the exit.
-     * The body is the branch that eventually leads back to header.
-     * For simple loops: body == latch (single block loop body)
-     * For multi-block: body leads to latch which leads to header
-     */
-    anvil_block_t *true_target = term->true_block;
-    anvil_block_t *false_target = term->false_block;
-    
-    /* Check if true branch leads to loop body */
-    bool true_is_body = (true_target == info->latch);
-    if (!true_is_body && true_target && true_target != info->exit && true_target->last) {
-        /* Check if true_target eventually goes to latch or header */
-        anvil_instr_t *t = true_target->last;
-        if (t && t->op == ANVIL_OP_BR && t->true_block &&
-            (t->true_block == info->latch || t->true_block == header)) {
-            true_is_body = true;
-        }
+/* !(a op b) == a invert_compare(op) b */
+static anvil_op_t invert_compare(anvil_op_t op)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_EQ:  return ANVIL_OP_CMP_NE;
+        case ANVIL_OP_CMP_NE:  return ANVIL_OP_CMP_EQ;
+        case ANVIL_OP_CMP_LT:  return ANVIL_OP_CMP_GE;
+        case ANVIL_OP_CMP_LE:  return ANVIL_OP_CMP_GT;
+        case ANVIL_OP_CMP_GT:  return ANVIL_OP_CMP_LE;
+        case ANVIL_OP_CMP_GE:  return ANVIL_OP_CMP_LT;
+        case ANVIL_OP_CMP_ULT: return ANVIL_OP_CMP_UGE;
+        case ANVIL_OP_CMP_ULE: return ANVIL_OP_CMP_UGT;
+        case ANVIL_OP_CMP_UGT: return ANVIL_OP_CMP_ULE;
+        case ANVIL_OP_CMP_UGE: return ANVIL_OP_CMP_ULT;
+        default: return op;
+    }
+}
+
+/* Check that the loop test can run out when x moves by step: the
+ * compare points the way the induction variable goes */
+static bool counts_toward_bound(anvil_op_t op, int64_t step)
+{
+    switch (op) {
+        case ANVIL_OP_CMP_LT: case ANVIL_OP_CMP_LE:
+        case ANVIL_OP_CMP_ULT: case ANVIL_OP_CMP_ULE:
+            return step > 0;
+        case ANVIL_OP_CMP_GT: case ANVIL_OP_CMP_GE:
+        case ANVIL_OP_CMP_UGT: case ANVIL_OP_CMP_UGE:
+            return step < 0;
+        case ANVIL_OP_CMP_NE:
+            return step == 1 || step == -1;
+        default:
+            return false;
     }
-    
-    if (true_is_body) {
-        info->body = true_target;
-        info->exit = false_target;
+}
+
+static bool eval_compare(anvil_op_t op, uint64_t a, uint64_t b, unsigned width)
+{
+    int64_t sa = sign_extend(a, width), sb = sign_extend(b, width);
+    a = truncate_to(a, width);
+    b = truncate_to(b, width);
+    switch (op) {
+        case ANVIL_OP_CMP_NE:  return a != b;
+        case ANVIL_OP_CMP_LT:  return sa < sb;
+        case ANVIL_OP_CMP_LE:  return sa <= sb;
+        case ANVIL_OP_CMP_GT:  return sa > sb;
+        case ANVIL_OP_CMP_GE:  return sa >= sb;
+        case ANVIL_OP_CMP_ULT: return a < b;
+        case ANVIL_OP_CMP_ULE: return a <= b;
+        case ANVIL_OP_CMP_UGT: return a > b;
+        case ANVIL_OP_CMP_UGE: return a >= b;
+        default: return false;
+    }
+}
+
+/* Step of a header phi whose value from the latch is phi +/- constant */
+static bool iv_step(const anvil_instr_t *phi, const anvil_value_t *next, unsigned width, int64_t *step)
+{
+    if (!next || next->kind != ANVIL_VAL_INSTR) return false;
+    const anvil_instr_t *instr = next->data.instr;
+    if (instr->num_operands != 2) return false;
+    anvil_value_t *a = instr->operands[0], *b = instr->operands[1];
+
+    int64_t s;
+    if (instr->op == ANVIL_OP_ADD && a == phi->result && is_const_int(b)) {
+        s = sign_extend(b->data.u, width);
+    } else if (instr->op == ANVIL_OP_ADD && b == phi->result && is_const_int(a)) {
+        s = sign_extend(a->data.u, width);
+    } else if (instr->op == ANVIL_OP_SUB && a == phi->result && is_const_int(b)) {
+        s = -sign_extend(b->data.u, width);
     } else {
-        info->body = false_target;
-        info->exit = true_target;
-    }
-    
-    /* Verify body leads back to header (directly or via latch) */
-    if (info->body != info->latch) {
-        anvil_instr_t *body_term = info->body->last;
-        if (!body_term || body_term->op != ANVIL_OP_BR) return false;
-        if (body_term->true_block != info->latch && body_term->true_block != header) {
-            return false;  /* Complex control flow */
-        }
+        return false;
     }
-    
-    /* Find induction variable (first PHI in header) */
-    anvil_instr_t *phi_instr = header->first;
-    if (!phi_instr || phi_instr->op != ANVIL_OP_PHI) return false;
-    
-    info->iv = phi_instr->result;
-    
-    /* Get initial value and step from PHI incoming values */
-    if (phi_instr->num_operands < 2 || phi_instr->num_phi_incoming < 2) return false;
-    
-    for (size_t i = 0; i < phi_instr->num_phi_incoming; i++) {
-        if (phi_instr->phi_blocks[i] == info->preheader) {
-            info->iv_init = phi_instr->operands[i];
-        } else if (phi_instr->phi_blocks[i] == info->latch || 
-                   phi_instr->phi_blocks[i] == info->body) {
-            info->iv_step = phi_instr->operands[i];
+    /* Keep step * UNROLL_MAX_FACTOR and the trip count arithmetic in range */
+    if (s == 0 || s > (INT64_C(1) << 30) || s < -(INT64_C(1) << 30)) return false;
+    *step = s;
+    return true;
+}
+
+/* Find the induction variable the exit test counts with */
+static bool find_iv(const anvil_loop_info_t *li, int32_t l, unroll_loop_t *lp)
+{
+    anvil_instr_t *term = lp->exiting->last;
+    anvil_value_t *cond = term->num_operands ? term->operands[0] : NULL;
+    if (!cond || cond->kind != ANVIL_VAL_INSTR) return false;
+    anvil_instr_t *cmp = cond->data.instr;
+    if (!is_int_compare(cmp->op) || cmp->num_operands != 2) return false;
+
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        unsigned width = int_width(phi->result->type);
+        anvil_value_t *next = phi_incoming(phi, lp->latch);
+        int64_t step;
+        if (!width || !iv_step(phi, next, width, &step)) continue;
+
+        for (size_t side = 0; side < 2; side++) {
+            anvil_value_t *x = cmp->operands[side], *bound = cmp->operands[1 - side];
+            if (x != phi->result && x != next) continue;
+            if (!defined_outside(li, l, bound) || int_width(bound->type) != width) continue;
+
+            anvil_op_t op = side ? swap_compare(cmp->op) : cmp->op;
+            if (lp->stay != term->true_block) op = invert_compare(op);
+            if (!counts_toward_bound(op, step)) continue;
+
+            lp->iv = phi;
+            lp->cmp = cmp;
+            lp->limit_index = 1 - side;
+            lp->tests_next = x == next;
+            lp->stay_op = op;
+            lp->step = step;
+            lp->width = width;
+            return true;
         }
     }
-    
-    if (!info->iv_init || !info->iv_step) return false;
-    
-    /* Find the comparison instruction */
-    anvil_instr_t *cmp_instr = NULL;
-    if (term->num_operands > 0 && term->operands[0]) {
-        anvil_value_t *cond = term->operands[0];
-        if (cond->kind == ANVIL_VAL_INSTR) {
-            cmp_instr = cond->data.instr;
-        }
+    return false;
+}
+
+/* Times the exit test holds when the start and the bound are constants,
+ * in the wrapping arithmetic of the loop's type; -1 if unknown or more
+ * than UNROLL_FULL_MAX_TRIPS */
+static int64_t const_trips(const unroll_loop_t *lp)
+{
+    anvil_value_t *init = phi_incoming(lp->iv, lp->preheader);
+    anvil_value_t *bound = lp->cmp->operands[lp->limit_index];
+    if (!is_const_int(init) || !is_const_int(bound)) return -1;
+
+    uint64_t x = init->data.u + (lp->tests_next ? (uint64_t)lp->step : 0);
+    for (int64_t j = 0; j <= UNROLL_FULL_MAX_TRIPS; j++) {
+        if (!eval_compare(lp->stay_op, x, bound->data.u, lp->width)) return j;
+        x += (uint64_t)lp->step;
     }
-    
-    if (!cmp_instr) return false;
-    
-    info->cmp_op = cmp_instr->op;
-    
-    /* Get loop bound from comparison */
-    if (cmp_instr->num_operands >= 2) {
-        anvil_value_t *cmp_lhs = cmp_instr->operands[0];
-        anvil_value_t *cmp_rhs = cmp_instr->operands[1];
-        
-        /* Determine which operand is the IV and which is the bound */
-        if (cmp_lhs == info->iv) {
-            info->iv_limit = cmp_rhs;
-        } else if (cmp_rhs == info->iv) {
-            info->iv_limit = cmp_lhs;
-        } else {
-            return false;
+    return -1;
+}
+
+/* A value defined after the header, used outside the loop */
+static bool body_escapes(const anvil_loop_info_t *li, int32_t l, const unroll_loop_t *lp)
+{
+    for (size_t i = 1; i < lp->num_blocks; i++) {
+        for (anvil_instr_t *instr = lp->blocks[i]->first; instr; instr = instr->next) {
+            if (!instr->result) continue;
+            for (anvil_use_t *use = instr->result->uses; use; use = use->next) {
+                if (!use->user->parent || !in_loop(li, l, use->user->parent)) return true;
+            }
         }
     }
-    
-    /* Count body instructions */
-    info->body_instr_count = count_body_instrs(info->body);
-    if (info->body != info->latch) {
-        info->body_instr_count += count_body_instrs(info->latch);
-    }
-    
-    /* Calculate trip count if possible */
-    if (is_const_int(info->iv_init) && is_const_int(info->iv_limit)) {
-        int64_t init = get_const_int(info->iv_init);
-        int64_t limit = get_const_int(info->iv_limit);
-        
-        /* Try to determine step value */
-        int64_t step = 1;  /* Default assumption */
-        
-        /* Check if iv_step is result of add instruction */
-        if (info->iv_step && info->iv_step->kind == ANVIL_VAL_INSTR) {
-            anvil_instr_t *step_instr = info->iv_step->data.instr;
-            if (step_instr->op == ANVIL_OP_ADD && step_instr->num_operands >= 2) {
-                anvil_value_t *step_rhs = step_instr->operands[1];
-                if (is_const_int(step_rhs)) {
-                    step = get_const_int(step_rhs);
-                }
-            }
+    return false;
+}
+
+/* Fill in lp for loop l if it can be unrolled */
+static bool analyze_loop(const anvil_loop_info_t *li, int32_t l, unroll_loop_t *lp)
+{
+    const anvil_domtree_t *dt = li->dt;
+    const anvil_loop_t *loop = &li->loops[l];
+    memset(lp, 0, sizeof(*lp));
+    lp->trips = -1;
+
+    if (loop->num_latches != 1 || loop->preheader < 0) return false;
+    for (size_t i = 0; i < li->num_loops; i++) {
+        if (li->loops[i].parent == l) return false;  /* Innermost loops only */
+    }
+    lp->header = dt->blocks[loop->header];
+    lp->latch = dt->blocks[loop->latches[0]];
+    lp->preheader = dt->blocks[loop->preheader];
+    if (lp->header->no_unroll) return false;
+    if (!lp->preheader->last || lp->preheader->last->op != ANVIL_OP_BR) return false;
+
+    /* Plain branches only, and a single way out */
+    for (size_t i = 0; i < loop->num_blocks; i++) {
+        anvil_block_t *block = dt->blocks[loop->blocks[i]];
+        anvil_instr_t *term = block->last;
+        if (!term || (term->op != ANVIL_OP_BR && term->op != ANVIL_OP_BR_COND)) return false;
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_ALLOCA || instr->op == ANVIL_OP_SWITCH) return false;
+            if (instr->op == ANVIL_OP_PHI) continue;
+            lp->size++;
+            if (block == lp->header) lp->header_size++;
         }
-        
-        if (step > 0) {
-            switch (info->cmp_op) {
-                case ANVIL_OP_CMP_LT:
-                case ANVIL_OP_CMP_ULT:
-                    info->trip_count = (limit - init + step - 1) / step;
-                    break;
-                case ANVIL_OP_CMP_LE:
-                case ANVIL_OP_CMP_ULE:
-                    info->trip_count = (limit - init) / step + 1;
-                    break;
-                case ANVIL_OP_CMP_NE:
-                    info->trip_count = (limit - init) / step;
-                    break;
-                default:
-                    break;
-            }
+        for (size_t s = 0; s < block->num_succs; s++) {
+            if (in_loop(li, l, block->succs[s])) continue;
+            if (lp->exiting && (lp->exiting != block || lp->exit != block->succs[s])) return false;
+            lp->exiting = block;
+            lp->exit = block->succs[s];
         }
     }
-    
-    /* Determine if loop is simple enough to unroll */
-    info->is_simple = (info->body_instr_count <= MAX_LOOP_BODY_INSTRS);
-    
+    if (!lp->exiting || (lp->exiting != lp->header && lp->exiting != lp->latch)) return false;
+    anvil_instr_t *term = lp->exiting->last;
+    if (term->op != ANVIL_OP_BR_COND || term->true_block == term->false_block) return false;
+    lp->stay = term->true_block == lp->exit ? term->false_block : term->true_block;
+
+    /* Header phis merge the preheader and the latch */
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        if (phi->num_phi_incoming != 2 || !phi_incoming(phi, lp->preheader) ||
+            !phi_incoming(phi, lp->latch)) return false;
+    }
+    if (!find_iv(li, l, lp)) return false;
+
+    lp->blocks = malloc(loop->num_blocks * sizeof(anvil_block_t *));
+    if (!lp->blocks) return false;
+    lp->num_blocks = loop->num_blocks;
+    for (size_t i = 0; i < loop->num_blocks; i++) lp->blocks[i] = dt->blocks[loop->blocks[i]];
+
+    lp->trips = const_trips(lp);
+    lp->body_escapes = lp->exiting == lp->header && body_escapes(li, l, lp);
     return true;
 }
 
-/* Value mapping for cloning */
-typedef struct {
-    anvil_value_t *orig;
-    anvil_value_t *clone;
-} value_map_entry_t;
+/* Instructions a full unroll produces, or 0 if it cannot be done */
+static size_t full_size(const unroll_loop_t *lp)
+{
+    if (lp->trips < 0 || lp->body_escapes) return 0;
+    size_t last = lp->exiting == lp->header ? lp->header_size : lp->size;
+    return (size_t)lp->trips * lp->size + last;
+}
 
-typedef struct {
-    value_map_entry_t *entries;
-    size_t count;
-    size_t cap;
-} value_map_t;
+/* Factor for a partial unroll, or 0 */
+static unsigned partial_factor(const unroll_loop_t *lp)
+{
+    /* The trip count is computed at run time with udiv */
+    if (lp->width != 32 && lp->width != 64) return 0;
+    unsigned factor = UNROLL_MAX_FACTOR;
+    while (factor > 1 && factor * lp->size > UNROLL_MAX_SIZE) factor /= 2;
+    if (factor < 2) return 0;
+    if (lp->trips >= 0 && lp->trips < (int64_t)factor) return 0;
+    return factor;
+}
+
+/* ============================================================================
+ * Cloning
+ * ============================================================================ */
+
+static anvil_value_t *const_of(anvil_ctx_t *ctx, anvil_type_t *type, int64_t val)
+{
+    switch (type->kind) {
+        case ANVIL_TYPE_I8:  return anvil_const_i8(ctx, (int8_t)val);
+        case ANVIL_TYPE_U8:  return anvil_const_u8(ctx, (uint8_t)val);
+        case ANVIL_TYPE_I16: return anvil_const_i16(ctx, (int16_t)val);
+        case ANVIL_TYPE_U16: return anvil_const_u16(ctx, (uint16_t)val);
+        case ANVIL_TYPE_U32: return anvil_const_u32(ctx, (uint32_t)val);
+        case ANVIL_TYPE_I64: return anvil_const_i64(ctx, val);
+        case ANVIL_TYPE_U64: return anvil_const_u64(ctx, (uint64_t)val);
+        default:             return anvil_const_i32(ctx, (int32_t)val);
+    }
+}
 
-static void value_map_init(value_map_t *map)
+/* New block named after a loop block, placed before the loop header */
+static anvil_block_t *new_block(unroll_t *u, const unroll_loop_t *lp, const anvil_block_t *like,
+                                const char *suffix, size_t k)
 {
-    map->entries = NULL;
-    map->count = 0;
-    map->cap = 0;
+    char name[96];
+    const char *base = like->name ? like->name : "loop";
+    if (suffix) snprintf(name, sizeof(name), "%s_%s", base, suffix);
+    else snprintf(name, sizeof(name), "%s_u%zu", base, k);
+    anvil_block_t *block = anvil_block_create(u->func, name);
+    if (block) anvil_block_move_before(block, lp->header);
+    return block;
 }
 
-static void value_map_destroy(value_map_t *map)
+/* Append an instruction before block's terminator, or at the end */
+static anvil_instr_t *emit(unroll_t *u, anvil_block_t *block, anvil_op_t op, anvil_type_t *type,
+                           anvil_value_t *a, anvil_value_t *b)
 {
-    free(map->entries);
-    map->entries = NULL;
-    map->count = 0;
-    map->cap = 0;
+    anvil_instr_t *instr = anvil_instr_create_in(u->ctx, u->pool, op, type, NULL);
+    if (!instr) return NULL;
+    if (a) anvil_instr_add_operand(instr, a);
+    if (b) anvil_instr_add_operand(instr, b);
+    anvil_instr_t *term = block->last;
+    bool before_term = term && (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND);
+    anvil_instr_insert_before(block, before_term ? term : NULL, instr);
+    return instr;
 }
 
-static void value_map_add(value_map_t *map, anvil_value_t *orig, anvil_value_t *clone)
+static anvil_value_t *emit_value(unroll_t *u, anvil_block_t *block, anvil_op_t op, anvil_type_t *type,
+                                 anvil_value_t *a, anvil_value_t *b)
 {
-    if (map->count >= map->cap) {
-        size_t new_cap = map->cap ? map->cap * 2 : 16;
-        value_map_entry_t *new_entries = realloc(map->entries, 
-                                                  new_cap * sizeof(value_map_entry_t));
-        if (!new_entries) return;
-        map->entries = new_entries;
-        map->cap = new_cap;
-    }
-    map->entries[map->count].orig = orig;
-    map->entries[map->count].clone = clone;
-    map->count++;
+    anvil_instr_t *instr = emit(u, block, op, type, a, b);
+    return instr ? instr->result : NULL;
 }
 
-static anvil_value_t *value_map_get(value_map_t *map, anvil_value_t *orig)
+static bool emit_branch(unroll_t *u, anvil_block_t *block, anvil_value_t *cond,
+                        anvil_block_t *dest, anvil_block_t *other)
 {
-    for (size_t i = 0; i < map->count; i++) {
-        if (map->entries[i].orig == orig) {
-            return map->entries[i].clone;
+    anvil_instr_t *br = anvil_instr_create_in(u->ctx, u->pool, cond ? ANVIL_OP_BR_COND : ANVIL_OP_BR,
+                                              u->ctx->type_void, NULL);
+    if (!br) return false;
+    if (cond) anvil_instr_add_operand(br, cond);
+    br->true_block = dest;
+    br->false_block = other;
+    anvil_instr_insert_before(block, NULL, br);
+    return true;
+}
+
+/* Number the values the loop defines */
+static bool index_values(unroll_t *u, const unroll_loop_t *lp)
+{
+    if (anvil_value_map_reset(&u->index, u->func) != ANVIL_OK) return false;
+    u->num_vals = 0;
+    for (size_t i = 0; i < lp->num_blocks; i++) {
+        for (anvil_instr_t *instr = lp->blocks[i]->first; instr; instr = instr->next) {
+            if (!instr->result) continue;
+            if (anvil_value_map_set(&u->index, instr->result, (int32_t)u->num_vals) != ANVIL_OK) return false;
+            u->num_vals++;
         }
     }
-    return orig;  /* Return original if not mapped */
+    free(u->cur);
+    free(u->copy);
+    u->cur = calloc(u->num_vals ? u->num_vals : 1, sizeof(anvil_value_t *));
+    u->copy = calloc(lp->num_blocks, sizeof(anvil_block_t *));
+    return u->cur && u->copy;
+}
+
+/* A value as seen by the copy being made */
+static anvil_value_t *map_value(const unroll_t *u, anvil_value_t *val)
+{
+    int32_t idx = anvil_value_map_get(&u->index, val);
+    return idx == ANVIL_VALUE_MAP_NONE || !u->cur[idx] ? val : u->cur[idx];
 }
 
-/* Insert instruction at end of block (before terminator) */
-static void insert_instr_before_term(anvil_block_t *block, anvil_instr_t *instr)
+static anvil_block_t *map_block(const unroll_t *u, const unroll_loop_t *lp, anvil_block_t *block)
 {
-    instr->parent = block;
-    
-    if (!block->first) {
-        block->first = block->last = instr;
-        instr->prev = instr->next = NULL;
-        return;
+    for (size_t i = 0; i < lp->num_blocks; i++) {
+        if (lp->blocks[i] == block) return u->copy[i];
     }
-    
-    /* Insert before terminator */
-    anvil_instr_t *term = block->last;
-    if (term->op == ANVIL_OP_BR || term->op == ANVIL_OP_BR_COND || 
-        term->op == ANVIL_OP_RET) {
-        instr->next = term;
-        instr->prev = term->prev;
-        if (term->prev) {
-            term->prev->next = instr;
-        } else {
-            block->first = instr;
-        }
-        term->prev = instr;
-    } else {
-        /* No terminator, append at end */
-        instr->prev = block->last;
-        instr->next = NULL;
-        block->last->next = instr;
-        block->last = instr;
-    }
-}
-
-/* Clone an instruction with value remapping */
-static anvil_instr_t *clone_instr_with_map(anvil_ctx_t *ctx, anvil_instr_t *orig, 
-                                            value_map_t *map)
-{
-    if (!orig) return NULL;
-    if (orig->op == ANVIL_OP_PHI) return NULL;
-    if (orig->op == ANVIL_OP_BR || orig->op == ANVIL_OP_BR_COND) return NULL;
-    if (orig->op == ANVIL_OP_RET) return NULL;
-    
-    anvil_type_t *type = orig->result ? orig->result->type : ctx->type_void;
-    anvil_instr_t *clone = anvil_instr_create(ctx, orig->op, type, NULL);
-    if (!clone) return NULL;
-    
-    /* Copy operands with remapping */
-    for (size_t i = 0; i < orig->num_operands; i++) {
-        anvil_value_t *op = orig->operands[i];
-        anvil_value_t *mapped = value_map_get(map, op);
-        anvil_instr_add_operand(clone, mapped);
-    }
-    
-    /* Map the result */
-    if (orig->result && clone->result) {
-        value_map_add(map, orig->result, clone->result);
-    }
-    
-    return clone;
-}
-
-/* Create a constant for the IV at a specific iteration */
-static anvil_value_t *make_iv_const(anvil_ctx_t *ctx, anvil_type_t *type, 
-                                     int64_t init, int64_t step, int iter)
-{
-    int64_t val = init + step * iter;
-    
-    switch (type->kind) {
-        case ANVIL_TYPE_I8:
-        case ANVIL_TYPE_U8:
-            return anvil_const_i8(ctx, (int8_t)val);
-        case ANVIL_TYPE_I16:
-        case ANVIL_TYPE_U16:
-            return anvil_const_i16(ctx, (int16_t)val);
-        case ANVIL_TYPE_I32:
-        case ANVIL_TYPE_U32:
-            return anvil_const_i32(ctx, (int32_t)val);
-        case ANVIL_TYPE_I64:
-        case ANVIL_TYPE_U64:
-            return anvil_const_i64(ctx, val);
-        default:
-            return anvil_const_i32(ctx, (int32_t)val);
+    return block;
+}
+
+/* Values the header phis take in the next copy, from the current one */
+static void next_header_values(const unroll_t *u, const unroll_loop_t *lp, anvil_value_t **vals)
+{
+    size_t n = 0;
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        vals[n++] = map_value(u, phi_incoming(phi, lp->latch));
     }
 }
 
-/* Get step value from IV update instruction */
-static int64_t get_step_value(loop_info_t *info)
+static void set_header_values(unroll_t *u, const unroll_loop_t *lp, anvil_value_t **vals)
 {
-    if (!info->iv_step) return 1;
-    
-    if (info->iv_step->kind == ANVIL_VAL_INSTR) {
-        anvil_instr_t *step_instr = info->iv_step->data.instr;
-        if (step_instr->op == ANVIL_OP_ADD && step_instr->num_operands >= 2) {
-            anvil_value_t *step_rhs = step_instr->operands[1];
-            if (is_const_int(step_rhs)) {
-                return get_const_int(step_rhs);
-            }
-        }
+    size_t n = 0;
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        u->cur[anvil_value_map_get(&u->index, phi->result)] = vals[n++];
     }
-    return 1;
 }
 
-/* Perform full loop unrolling */
-static bool unroll_loop_full(anvil_func_t *func, loop_info_t *info)
+/*
+ * Make one copy of an iteration, starting in head (already created). The
+ * exit test is dropped: the copy goes on to the next iteration, whose
+ * header is next, or if leave is set, out to the loop exit, in which case
+ * a copy that leaves from the header is only the header.
+ */
+static bool clone_iteration(unroll_t *u, const unroll_loop_t *lp, size_t k,
+                            anvil_block_t *head, anvil_block_t *next, bool leave)
 {
-    if (info->trip_count <= 0 || info->trip_count > MAX_FULL_UNROLL_TRIP_COUNT) {
-        return false;
+    size_t num_copied = leave && lp->exiting == lp->header ? 1 : lp->num_blocks;
+    u->copy[0] = head;
+    for (size_t i = 1; i < lp->num_blocks; i++) {
+        u->copy[i] = i < num_copied ? new_block(u, lp, lp->blocks[i], NULL, k) : NULL;
+        if (i < num_copied && !u->copy[i]) return false;
     }
-    
-    anvil_ctx_t *ctx = func->parent->ctx;
-    
-    /* Get IV info */
-    int64_t init_val = is_const_int(info->iv_init) ? get_const_int(info->iv_init) : 0;
-    int64_t step_val = get_step_value(info);
-    anvil_type_t *iv_type = info->iv->type;
-    
-    /* For full unrolling:
-     * 1. Clone body instructions N times into preheader
-     * 2. Replace IV with constant for each iteration
-     * 3. Redirect preheader to exit block
-     * 4. Mark loop blocks as dead (will be cleaned by DCE/SimplifyCFG)
-     */
-    
-    value_map_t map;
-    value_map_init(&map);
-    
-    /* Clone body for each iteration */
-    for (int64_t iter = 0; iter < info->trip_count; iter++) {
-        /* Create constant for IV at this iteration */
-        anvil_value_t *iv_const = make_iv_const(ctx, iv_type, init_val, step_val, (int)iter);
-        value_map_add(&map, info->iv, iv_const);
-        
-        /* Clone body instructions */
-        for (anvil_instr_t *instr = info->body->first; instr; instr = instr->next) {
-            if (instr->op == ANVIL_OP_PHI) continue;
-            if (instr->op == ANVIL_OP_BR || instr->op == ANVIL_OP_BR_COND) continue;
-            
-            anvil_instr_t *clone = clone_instr_with_map(ctx, instr, &map);
-            if (clone) {
-                insert_instr_before_term(info->preheader, clone);
+
+    for (size_t i = 0; i < num_copied; i++) {
+        anvil_block_t *block = lp->blocks[i];
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_PHI && block == lp->header) continue;
+
+            if (instr == block->last) {
+                anvil_block_t *dest = instr->true_block, *other = instr->false_block;
+                anvil_value_t *cond = instr->op == ANVIL_OP_BR_COND ? instr->operands[0] : NULL;
+                if (block == lp->exiting) {
+                    cond = NULL;
+                    dest = leave ? lp->exit : lp->stay;
+                    other = NULL;
+                }
+                dest = dest == lp->header ? next : (leave && dest == lp->exit ? dest : map_block(u, lp, dest));
+                if (other) other = other == lp->header ? next : map_block(u, lp, other);
+                if (!emit_branch(u, u->copy[i], cond, dest, other)) return false;
+                continue;
             }
-        }
-        
-        /* If body != latch, also clone latch instructions */
-        if (info->body != info->latch) {
-            for (anvil_instr_t *instr = info->latch->first; instr; instr = instr->next) {
-                if (instr->op == ANVIL_OP_PHI) continue;
-                if (instr->op == ANVIL_OP_BR || instr->op == ANVIL_OP_BR_COND) continue;
-                
-                anvil_instr_t *clone = clone_instr_with_map(ctx, instr, &map);
-                if (clone) {
-                    insert_instr_before_term(info->preheader, clone);
+
+            anvil_type_t *type = instr->result ? instr->result->type : u->ctx->type_void;
+            anvil_instr_t *clone = anvil_instr_create_in(u->ctx, u->pool, instr->op, type,
+                                                         instr->result ? instr->result->name : NULL);
+            if (!clone) return false;
+            clone->aux_type = instr->aux_type;
+            if (instr->op == ANVIL_OP_PHI) {
+                for (size_t j = 0; j < instr->num_phi_incoming; j++) {
+                    anvil_phi_add_incoming(clone->result, instr->operands[j],
+                                           map_block(u, lp, instr->phi_blocks[j]));
+                }
+            } else {
+                anvil_instr_reserve_operands(clone, instr->num_operands);
+                for (size_t j = 0; j < instr->num_operands; j++) {
+                    anvil_instr_add_operand(clone, instr->operands[j]);
                 }
             }
+            anvil_instr_insert_before(u->copy[i], NULL, clone);
+            if (instr->result) u->cur[anvil_value_map_get(&u->index, instr->result)] = clone->result;
+        }
+    }
+
+    /* Operands were copied as they are; every value of the copy exists now */
+    for (size_t i = 0; i < num_copied; i++) {
+        for (anvil_instr_t *instr = u->copy[i]->first; instr; instr = instr->next) {
+            for (size_t j = 0; j < instr->num_operands; j++) {
+                anvil_value_t *val = map_value(u, instr->operands[j]);
+                if (val != instr->operands[j]) anvil_instr_set_operand(instr, j, val);
+            }
         }
     }
-    
-    /* Redirect preheader to exit block */
-    anvil_instr_t *preheader_term = info->preheader->last;
-    if (preheader_term && preheader_term->op == ANVIL_OP_BR) {
-        preheader_term->true_block = info->exit;
-    }
-    
-    /* Mark header's PHI result with final value for uses after loop */
-    anvil_value_t *final_iv = make_iv_const(ctx, iv_type, init_val, step_val, 
-                                             (int)info->trip_count);
-    value_map_add(&map, info->iv, final_iv);
-    
-    value_map_destroy(&map);
-    
     return true;
 }
 
-/* Perform partial loop unrolling */
-static bool unroll_loop_partial(anvil_func_t *func, loop_info_t *info, int factor)
+/* ============================================================================
+ * Full unrolling
+ * ============================================================================ */
+
+/* Drop the original loop once nothing reaches it */
+static void remove_loop(const unroll_loop_t *lp)
 {
-    if (factor <= 1 || factor > MAX_PARTIAL_UNROLL_FACTOR) {
-        return false;
+    for (size_t i = 0; i < lp->num_blocks; i++) {
+        for (anvil_instr_t *instr = lp->blocks[i]->first; instr; instr = instr->next) {
+            anvil_instr_clear_operands(instr);
+        }
     }
-    
-    anvil_ctx_t *ctx = func->parent->ctx;
-    
-    /* Partial unrolling:
-     * 1. Duplicate body instructions (factor-1) times within the loop
-     * 2. Multiply the step by factor
-     * 3. Add epilogue for remaining iterations (if trip count not divisible)
-     * 
-     * For simplicity, we only do partial unroll when trip count is unknown
-     * or divisible by factor.
-     */
-    
-    /* Check if we can safely unroll */
-    if (info->trip_count > 0 && (info->trip_count % factor) != 0) {
-        /* Would need epilogue - skip for now */
-        return false;
+    for (size_t i = 0; i < lp->num_blocks; i++) {
+        anvil_block_t *block = lp->blocks[i];
+        anvil_block_clear_succs(block);
+        anvil_block_unlink(block);
     }
-    
-    int64_t step_val = get_step_value(info);
-    
-    value_map_t map;
-    value_map_init(&map);
-    
-    /* Start with IV mapped to itself */
-    value_map_add(&map, info->iv, info->iv);
-    
-    /* Clone body (factor-1) times after original body */
-    anvil_instr_t *insert_point = info->latch->last;  /* Before branch back */
-    
-    for (int i = 1; i < factor; i++) {
-        /* Update IV mapping: add step to previous IV */
-        anvil_value_t *prev_iv = value_map_get(&map, info->iv);
-        
-        /* Create add instruction for new IV value */
-        anvil_value_t *step_const = make_iv_const(ctx, info->iv->type, step_val, 1, 0);
-        anvil_instr_t *new_iv_instr = anvil_instr_create(ctx, ANVIL_OP_ADD, 
-                                                          info->iv->type, NULL);
-        if (new_iv_instr) {
-            anvil_instr_add_operand(new_iv_instr, prev_iv);
-            anvil_instr_add_operand(new_iv_instr, step_const);
-            
-            /* Insert before terminator */
-            new_iv_instr->parent = info->latch;
-            new_iv_instr->next = insert_point;
-            new_iv_instr->prev = insert_point->prev;
-            if (insert_point->prev) {
-                insert_point->prev->next = new_iv_instr;
-            } else {
-                info->latch->first = new_iv_instr;
-            }
-            insert_point->prev = new_iv_instr;
-            
-            /* Update map */
-            value_map_add(&map, info->iv, new_iv_instr->result);
+}
+
+static bool unroll_full(unroll_t *u, const unroll_loop_t *lp, anvil_value_t **vals)
+{
+    size_t n = 0;
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        vals[n++] = phi_incoming(phi, lp->preheader);
+    }
+
+    anvil_block_t *head = new_block(u, lp, lp->header, NULL, 0);
+    if (!head) return false;
+    anvil_instr_set_succ(lp->preheader->last, 0, head);
+    for (size_t k = 0; k <= (size_t)lp->trips; k++) {
+        bool leave = k == (size_t)lp->trips;
+        anvil_block_t *next = leave ? NULL : new_block(u, lp, lp->header, NULL, k + 1);
+        if (!leave && !next) return false;
+        set_header_values(u, lp, vals);
+        if (!clone_iteration(u, lp, k, head, next, leave)) return false;
+        next_header_values(u, lp, vals);
+        head = next;
+    }
+
+    /* The exit is entered from the last copy now, with its values */
+    anvil_block_t *exiting = map_block(u, lp, lp->exiting);
+    for (anvil_instr_t *phi = lp->exit->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        for (size_t i = 0; i < phi->num_phi_incoming; i++) {
+            if (phi->phi_blocks[i] != lp->exiting) continue;
+            phi->phi_blocks[i] = exiting;
+            anvil_block_mark_changed(lp->exit);
         }
-        
-        /* Clone body instructions */
-        for (anvil_instr_t *instr = info->body->first; instr; instr = instr->next) {
-            if (instr->op == ANVIL_OP_PHI) continue;
-            if (instr->op == ANVIL_OP_BR || instr->op == ANVIL_OP_BR_COND) continue;
-            
-            /* Skip IV increment - we handle it specially */
-            if (instr->result == info->iv_step) continue;
-            
-            anvil_instr_t *clone = clone_instr_with_map(ctx, instr, &map);
-            if (clone) {
-                clone->parent = info->latch;
-                clone->next = insert_point;
-                clone->prev = insert_point->prev;
-                if (insert_point->prev) {
-                    insert_point->prev->next = clone;
-                } else {
-                    info->latch->first = clone;
-                }
-                insert_point->prev = clone;
+    }
+    remove_loop(lp);
+    for (size_t i = 0; i < lp->num_blocks; i++) {
+        for (anvil_instr_t *instr = lp->blocks[i]->first; instr; instr = instr->next) {
+            if (instr->result && instr->result->uses) {
+                anvil_value_replace_all_uses(instr->result, map_value(u, instr->result));
             }
         }
     }
-    
-    /* Update the original IV increment to use factor * step */
-    if (info->iv_step && info->iv_step->kind == ANVIL_VAL_INSTR) {
-        anvil_instr_t *step_instr = info->iv_step->data.instr;
-        if (step_instr->op == ANVIL_OP_ADD && step_instr->num_operands >= 2) {
-            /* Replace step constant with factor * step */
-            anvil_value_t *new_step = make_iv_const(ctx, info->iv->type, 
-                                                     step_val * factor, 1, 0);
-            step_instr->operands[1] = new_step;
+    return true;
+}
+
+/* ============================================================================
+ * Partial unrolling
+ * ============================================================================ */
+
+/* Trips the exit test holds for from start, as an unsigned count that
+ * may come out lower than the real one but never higher; emitted into
+ * block. Called with the test known to hold for start. */
+static anvil_value_t *emit_trip_count(unroll_t *u, const unroll_loop_t *lp, anvil_block_t *block,
+                                      anvil_value_t *start, anvil_value_t *bound)
+{
+    anvil_type_t *type = start->type;
+    uint64_t mag = lp->step < 0 ? (uint64_t)-lp->step : (uint64_t)lp->step;
+    anvil_value_t *diff = lp->step > 0 ? emit_value(u, block, ANVIL_OP_SUB, type, bound, start)
+                                       : emit_value(u, block, ANVIL_OP_SUB, type, start, bound);
+    if (!diff) return NULL;
+    anvil_value_t *one = const_of(u->ctx, type, 1);
+
+    switch (lp->stay_op) {
+        case ANVIL_OP_CMP_NE:
+            return diff;
+        case ANVIL_OP_CMP_LT: case ANVIL_OP_CMP_ULT:
+        case ANVIL_OP_CMP_GT: case ANVIL_OP_CMP_UGT:
+            /* (diff - 1) / step + 1, diff >= 1 */
+            if (mag == 1) return diff;
+            diff = emit_value(u, block, ANVIL_OP_SUB, type, diff, one);
+            break;
+        default:
+            /* diff / step + 1; wraps to 0 only for a loop that never ends */
+            break;
+    }
+    if (mag != 1 && diff) {
+        diff = emit_value(u, block, ANVIL_OP_UDIV, type, diff, const_of(u->ctx, type, (int64_t)mag));
+    }
+    return diff ? emit_value(u, block, ANVIL_OP_ADD, type, diff, one) : NULL;
+}
+
+static bool unroll_partial(unroll_t *u, const unroll_loop_t *lp, unsigned factor,
+                           anvil_value_t **vals)
+{
+    anvil_block_t *pre = lp->preheader;
+    anvil_type_t *type = lp->iv->result->type;
+    anvil_type_t *bool_type = u->ctx->type_i8;
+    anvil_value_t *init = phi_incoming(lp->iv, pre);
+    anvil_value_t *bound = lp->cmp->operands[lp->limit_index];
+
+    anvil_block_t *trip = new_block(u, lp, lp->header, "trip", 0);
+    anvil_block_t *head = new_block(u, lp, lp->header, NULL, 0);
+    if (!trip || !head) return false;
+
+    /* pre: does the loop run at all */
+    anvil_value_t *start = lp->tests_next
+        ? emit_value(u, pre, ANVIL_OP_ADD, type, init, const_of(u->ctx, type, lp->step)) : init;
+    anvil_value_t *runs = start ? emit_value(u, pre, lp->stay_op, bool_type, start, bound) : NULL;
+    if (!runs) return false;
+    anvil_instr_remove(pre->last);
+
+    /* trip: iterations for the unrolled copy, a multiple of factor */
+    anvil_value_t *trips = emit_trip_count(u, lp, trip, start, bound);
+    anvil_value_t *main_trips = trips ? emit_value(u, trip, ANVIL_OP_AND, type, trips,
+                                                   const_of(u->ctx, type, -(int64_t)factor)) : NULL;
+    anvil_value_t *any = main_trips ? emit_value(u, trip, ANVIL_OP_CMP_NE, bool_type, main_trips,
+                                                 const_of(u->ctx, type, 0)) : NULL;
+    if (!any) return false;
+
+    /* head_u0: a counter, and the header phis entered from trip and step */
+    anvil_instr_t *counter = emit(u, head, ANVIL_OP_PHI, type, NULL, NULL);
+    if (!counter) return false;
+    size_t num_phis = 0;
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+        anvil_instr_t *entry = emit(u, head, ANVIL_OP_PHI, phi->result->type, NULL, NULL);
+        if (!entry) return false;
+        vals[num_phis++] = entry->result;
+    }
+
+    anvil_block_t *first = head;
+    for (size_t k = 0; k < factor; k++) {
+        anvil_block_t *next = k + 1 < factor ? new_block(u, lp, lp->header, NULL, k + 1)
+                                             : new_block(u, lp, lp->header, "step", 0);
+        if (!next) return false;
+        set_header_values(u, lp, vals);
+        if (!clone_iteration(u, lp, k, head, next, false)) return false;
+        next_header_values(u, lp, vals);
+        head = next;
+    }
+    anvil_block_t *step = head;
+    anvil_block_t *rem = new_block(u, lp, lp->header, "rem", 0);
+    if (!rem) return false;
+
+    /* step: next round of factor iterations, or on to the remainder */
+    anvil_value_t *count = emit_value(u, step, ANVIL_OP_ADD, type, counter->result,
+                                      const_of(u->ctx, type, factor));
+    anvil_value_t *again = count ? emit_value(u, step, ANVIL_OP_CMP_NE, bool_type, count, main_trips) : NULL;
+    if (!again) return false;
+    anvil_phi_add_incoming(counter->result, const_of(u->ctx, type, 0), trip);
+    anvil_phi_add_incoming(counter->result, count, step);
+
+    /* rem: the original loop starts where the unrolled copy stopped */
+    size_t n = 0;
+    anvil_instr_t *entry = counter->next;
+    for (anvil_instr_t *phi = lp->header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next, n++) {
+        anvil_value_t *from_pre = phi_incoming(phi, pre);
+        anvil_phi_add_incoming(entry->result, from_pre, trip);
+        anvil_phi_add_incoming(entry->result, vals[n], step);
+        entry = entry->next;
+
+        anvil_instr_t *merge = emit(u, rem, ANVIL_OP_PHI, phi->result->type, NULL, NULL);
+        if (!merge) return false;
+        anvil_phi_add_incoming(merge->result, from_pre, pre);
+        anvil_phi_add_incoming(merge->result, from_pre, trip);
+        anvil_phi_add_incoming(merge->result, vals[n], step);
+        for (size_t i = 0; i < phi->num_phi_incoming; i++) {
+            if (phi->phi_blocks[i] != pre) continue;
+            anvil_instr_set_operand(phi, i, merge->result);
+            phi->phi_blocks[i] = rem;
         }
     }
-    
-    value_map_destroy(&map);
-    
+
+    if (!emit_branch(u, pre, runs, trip, rem) || !emit_branch(u, trip, any, first, rem) ||
+        !emit_branch(u, step, again, first, rem) || !emit_branch(u, rem, NULL, lp->header, NULL))
+        return false;
+
+    first->no_unroll = true;
+    lp->header->no_unroll = true;
     return true;
 }
 
-/* Main loop unrolling pass */
+/* ============================================================================
+ * Pass
+ * ============================================================================ */
+
 bool anvil_pass_loop_unroll(anvil_func_t *func)
 {
     if (!func || !func->blocks) return false;
-    
+
+    /* Unrolling creates blocks, which drops the cached analyses: work
+     * from a private copy, and decide on every loop before any edit */
+    anvil_domtree_t dt;
+    anvil_loop_info_t li;
+    if (anvil_domtree_compute(&dt, func) != ANVIL_OK) return false;
+    if (anvil_loops_compute(&li, &dt) != ANVIL_OK) {
+        anvil_domtree_free(&dt);
+        return false;
+    }
+
+    unroll_loop_t *cands = li.num_loops ? malloc(li.num_loops * sizeof(unroll_loop_t)) : NULL;
+    size_t num_cands = 0, max_phis = 1;
+    for (size_t l = 0; cands && l < li.num_loops; l++) {
+        if (!analyze_loop(&li, (int32_t)l, &cands[num_cands])) {
+            free(cands[num_cands].blocks);
+            continue;
+        }
+        size_t phis = 0;
+        for (anvil_instr_t *phi = cands[num_cands].header->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next)
+            phis++;
+        if (phis > max_phis) max_phis = phis;
+        num_cands++;
+    }
+    anvil_loops_free(&li);
+    anvil_domtree_free(&dt);
+
+    unroll_t u = { .func = func, .ctx = func->parent->ctx, .pool = &func->parent->pool };
+    anvil_value_t **vals = malloc(max_phis * sizeof(anvil_value_t *));
     bool changed = false;
-    
-    /* Find and analyze loops */
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        /* Safety checks */
-        if (!block->first || !block->last) continue;
-        if (!is_loop_header(block)) continue;
-        
-        loop_info_t info;
-        if (!analyze_loop(func, block, &info)) continue;
-        
-        if (!info.is_simple) continue;
-        
-        /* For now, only attempt full unrolling for very simple cases */
-        if (info.trip_count > 0 && info.trip_count <= MAX_FULL_UNROLL_TRIP_COUNT) {
-            /* Full unroll for small trip counts */
-            if (unroll_loop_full(func, &info)) {
-                changed = true;
-            }
+    for (size_t i = 0; vals && i < num_cands; i++) {
+        unroll_loop_t *lp = &cands[i];
+        size_t full = full_size(lp);
+        unsigned factor = partial_factor(lp);
+        if ((full || factor) && index_values(&u, lp)) {
+            if (full && full <= UNROLL_FULL_MAX_SIZE) changed |= unroll_full(&u, lp, vals);
+            else if (factor) changed |= unroll_partial(&u, lp, factor, vals);
         }
-        /* Partial unrolling disabled for now - needs more testing */
     }
-    
+    for (size_t i = 0; i < num_cands; i++) free(cands[i].blocks);
+    free(cands);
+    free(vals);
+    free(u.cur);
+    free(u.copy);
+    anvil_value_map_free(&u.index);
+
+    if (changed) anvil_func_invalidate_cfg(func);
     return changed;
 }
@@ -0,0 +1,237 @@
+/*
+ * ANVIL - Loop Nest
+ *
+ * Natural loops over the dominator tree. An edge p -> h is a back edge
+ * when h dominates p, and the loop of header h is h plus every block that
+ * reaches one of its latches without passing through h. Back edges into
+ * one header share a loop, so two loops are either disjoint or nested. A
+ * retreating edge whose target does not dominate its source closes an
+ * irreducible cycle, which gets no loop.
+ *
+ * Headers are visited in RPO, which puts an enclosing loop before the
+ * loops inside it: when a loop is built, the innermost loop recorded for
+ * its header so far is its parent.
+ */
+
+#include "anvil/anvil_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int32_t *data;
+    size_t count;
+    size_t cap;
+} int_list_t;
+
+/* Where a loop's lists start in storage, while storage can still move */
+typedef struct {
+    size_t blocks;
+    size_t latches;
+    size_t exits;
+} loop_offsets_t;
+
+typedef struct {
+    anvil_loop_info_t *li;
+    int_list_t store;
+    loop_offsets_t *offsets;
+    int32_t *mark;                  /* Loop whose body holds the block */
+    int32_t *exit_mark;             /* Loop that lists the block as an exit */
+    int32_t *stack;
+} loop_builder_t;
+
+static bool list_push(int_list_t *list, int32_t value)
+{
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        int32_t *data = realloc(list->data, cap * sizeof(int32_t));
+        if (!data) return false;
+        list->data = data;
+        list->cap = cap;
+    }
+    list->data[list->count++] = value;
+    return true;
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool is_header(const anvil_domtree_t *dt, int32_t h)
+{
+    for (int32_t i = dt->pred_start[h]; i < dt->pred_start[h + 1]; i++) {
+        if (anvil_domtree_dominates(dt, h, dt->preds[i])) return true;
+    }
+    return false;
+}
+
+/* Latches and body of the loop headed by h */
+static bool collect_body(loop_builder_t *lb, int32_t l, int32_t h)
+{
+    const anvil_domtree_t *dt = lb->li->dt;
+    anvil_loop_t *loop = &lb->li->loops[l];
+    loop_offsets_t *off = &lb->offsets[l];
+    size_t depth = 0;
+
+    lb->mark[h] = l;
+    off->latches = lb->store.count;
+    for (int32_t i = dt->pred_start[h]; i < dt->pred_start[h + 1]; i++) {
+        int32_t p = dt->preds[i];
+        if (!anvil_domtree_dominates(dt, h, p)) continue;
+        if (!list_push(&lb->store, p)) return false;
+        loop->num_latches++;
+        if (lb->mark[p] != l) {
+            lb->mark[p] = l;
+            lb->stack[depth++] = p;
+        }
+    }
+
+    off->blocks = lb->store.count;
+    if (!list_push(&lb->store, h)) return false;
+    while (depth > 0) {
+        int32_t b = lb->stack[--depth];
+        if (!list_push(&lb->store, b)) return false;
+        for (int32_t i = dt->pred_start[b]; i < dt->pred_start[b + 1]; i++) {
+            int32_t p = dt->preds[i];
+            if (lb->mark[p] == l) continue;
+            lb->mark[p] = l;
+            lb->stack[depth++] = p;
+        }
+    }
+    loop->num_blocks = lb->store.count - off->blocks;
+    qsort(lb->store.data + off->blocks, loop->num_blocks, sizeof(int32_t), cmp_index);
+    return true;
+}
+
+static bool build_loop(loop_builder_t *lb, int32_t h)
+{
+    anvil_loop_info_t *li = lb->li;
+    const anvil_domtree_t *dt = li->dt;
+    int32_t l = (int32_t)li->num_loops;
+    anvil_loop_t *loop = &li->loops[l];
+    loop->header = h;
+    loop->preheader = -1;
+    if (!collect_body(lb, l, h)) return false;
+
+    /* Exits: successors of the body outside it */
+    loop_offsets_t *off = &lb->offsets[l];
+    off->exits = lb->store.count;
+    for (size_t i = 0; i < loop->num_blocks; i++) {
+        anvil_block_t *succs[2];
+        size_t n = anvil_block_succs(dt->blocks[lb->store.data[off->blocks + i]], succs);
+        for (size_t s = 0; s < n; s++) {
+            int32_t succ = anvil_domtree_index(dt, succs[s]);
+            if (succ < 0 || lb->mark[succ] == l || lb->exit_mark[succ] == l) continue;
+            lb->exit_mark[succ] = l;
+            if (!list_push(&lb->store, succ)) return false;
+            loop->num_exits++;
+        }
+    }
+
+    /* The one pred from outside, if the header is all it branches to */
+    int32_t outside = -1;
+    size_t num_outside = 0;
+    for (int32_t i = dt->pred_start[h]; i < dt->pred_start[h + 1]; i++) {
+        if (lb->mark[dt->preds[i]] == l) continue;
+        outside = dt->preds[i];
+        num_outside++;
+    }
+    anvil_block_t *succs[2];
+    if (num_outside == 1 && anvil_block_succs(dt->blocks[outside], succs) == 1)
+        loop->preheader = outside;
+
+    loop->parent = li->block_loop[h];
+    loop->depth = loop->parent < 0 ? 1 : li->loops[loop->parent].depth + 1;
+    for (size_t i = 0; i < loop->num_blocks; i++) {
+        li->block_loop[lb->store.data[off->blocks + i]] = l;
+    }
+    li->num_loops++;
+    return true;
+}
+
+anvil_error_t anvil_loops_compute(anvil_loop_info_t *li, const anvil_domtree_t *dt)
+{
+    memset(li, 0, sizeof(*li));
+    if (!dt || dt->num_blocks == 0) return ANVIL_ERR_INVALID_ARG;
+    li->dt = dt;
+
+    size_t nb = dt->num_blocks;
+    size_t num_headers = 0;
+    for (size_t h = 0; h < nb; h++) {
+        if (is_header(dt, (int32_t)h)) num_headers++;
+    }
+
+    loop_builder_t lb = { .li = li };
+    li->block_loop = malloc(nb * sizeof(int32_t));
+    li->loops = calloc(num_headers ? num_headers : 1, sizeof(anvil_loop_t));
+    lb.offsets = malloc((num_headers ? num_headers : 1) * sizeof(loop_offsets_t));
+    lb.mark = malloc(nb * sizeof(int32_t));
+    lb.exit_mark = malloc(nb * sizeof(int32_t));
+    lb.stack = malloc(nb * sizeof(int32_t));
+    bool ok = li->block_loop && li->loops && lb.offsets && lb.mark && lb.exit_mark && lb.stack;
+    if (ok) {
+        for (size_t b = 0; b < nb; b++) {
+            li->block_loop[b] = -1;
+            lb.mark[b] = -1;
+            lb.exit_mark[b] = -1;
+        }
+    }
+    for (size_t h = 0; ok && h < nb; h++) {
+        if (is_header(dt, (int32_t)h)) ok = build_loop(&lb, (int32_t)h);
+    }
+
+    /* Storage is final: point the loops into it */
+    li->storage = lb.store.data;
+    for (size_t l = 0; ok && l < li->num_loops; l++) {
+        anvil_loop_t *loop = &li->loops[l];
+        loop->blocks = li->storage + lb.offsets[l].blocks;
+        loop->latches = li->storage + lb.offsets[l].latches;
+        loop->exits = li->storage + lb.offsets[l].exits;
+    }
+
+    free(lb.offsets);
+    free(lb.mark);
+    free(lb.exit_mark);
+    free(lb.stack);
+    if (!ok) {
+        anvil_loops_free(li);
+        return ANVIL_ERR_NOMEM;
+    }
+    return ANVIL_OK;
+}
+
+bool anvil_loop_contains(const anvil_loop_info_t *li, int32_t l, int32_t b)
+{
+    if (b < 0 || (size_t)b >= li->dt->num_blocks) return false;
+    for (int32_t x = li->block_loop[b]; x >= 0; x = li->loops[x].parent) {
+        if (x == l) return true;
+    }
+    return false;
+}
+
+uint32_t anvil_loop_depth(const anvil_loop_info_t *li, const anvil_block_t *block)
+{
+    int32_t b = anvil_domtree_index(li->dt, block);
+    if (b < 0 || li->block_loop[b] < 0) return 0;
+    return li->loops[li->block_loop[b]].depth;
+}
+
+anvil_loop_info_t *anvil_func_loops(anvil_func_t *func)
+{
+    if (!func) return NULL;
+    if (func->loops) return func->loops;
+
+    anvil_domtree_t *dt = anvil_func_domtree(func);
+    anvil_loop_info_t *li = malloc(sizeof(anvil_loop_info_t));
+    if (!dt || !li) {
+        free(li);
+        return NULL;
+    }
+    if (anvil_loops_compute(li, dt) != ANVIL_OK) {
+        free(li);
+        return NULL;
+    }
+    func->loops = li;
+    return li;
+}
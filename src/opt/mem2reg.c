@@ -0,0 +1,563 @@
+/*
+ * ANVIL - Register Promotion (mem2reg) Pass
+ *
+ * Front ends give every local variable a stack slot and access it with
+ * loads and stores. When a slot's address never escapes, its value can
+ * live in SSA values instead:
+ *
+ *   entry:  x = alloca i32             entry:  br c, then, join
+ *           store 1, x
+ *           br c, then, join
+ *   then:   store 2, x          ->     then:   br join
+ *           br join
+ *   join:   v = load x                 join:   v = phi [1, entry], [2, then]
+ *
+ * Struct slots whose fields are only reached through constant struct_gep
+ * are first split into one slot per field (scalar replacement), so the
+ * fields can be promoted on their own.
+ *
+ * Promotion follows Cytron et al.: phis go into the iterated dominance
+ * frontier of the blocks that store to the slot, pruned to the blocks
+ * where the slot is live on entry, and a walk of the dominator tree then
+ * renames every load to the value stored last on the path. A load with no
+ * store before it reads zero, as the backends' zeroed slots did. Phis
+ * that end up with one distinct incoming value are folded away.
+ */
+
+#include "anvil/anvil_internal.h"
+#include "anvil/anvil_opt.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Undo record for the renaming walk */
+typedef struct {
+    int32_t slot;
+    anvil_value_t *value;
+} rename_undo_t;
+
+typedef struct {
+    anvil_ctx_t *ctx;
+    anvil_func_t *func;
+    anvil_domtree_t *dt;
+
+    /* Promotable allocas; values map alloca results to their index and
+     * the phis placed for slot a to num_slots + a */
+    anvil_instr_t **slots;
+    size_t num_slots;
+    anvil_value_map_t index;
+
+    /* Per slot: the blocks that store to it and those that read it first */
+    int32_t *def_start;
+    int32_t *defs;
+    int32_t *use_start;
+    int32_t *uses;
+
+    anvil_instr_t **phis;       /* Placed phis */
+    size_t num_phis;
+    size_t cap_phis;
+
+    anvil_value_t **current;    /* Renaming: value of each slot */
+    rename_undo_t *undo;        /* One entry per store and phi at most */
+    size_t num_undo;
+    size_t num_stores;
+} mem2reg_t;
+
+static bool is_scalar_type(const anvil_type_t *type)
+{
+    return type && type->kind >= ANVIL_TYPE_I8 && type->kind <= ANVIL_TYPE_PTR;
+}
+
+static anvil_instr_t *alloca_of(const anvil_value_t *val)
+{
+    if (!val || val->kind != ANVIL_VAL_INSTR || !val->data.instr) return NULL;
+    return val->data.instr->op == ANVIL_OP_ALLOCA ? val->data.instr : NULL;
+}
+
+static anvil_type_t *slot_type(const anvil_instr_t *alloca_instr)
+{
+    const anvil_type_t *ptr = alloca_instr->result ? alloca_instr->result->type : NULL;
+    return ptr && ptr->kind == ANVIL_TYPE_PTR ? ptr->data.pointee : NULL;
+}
+
+/* The value a slot holds before anything is stored to it */
+static anvil_value_t *zero_value(anvil_ctx_t *ctx, anvil_type_t *type)
+{
+    switch (type->kind) {
+        case ANVIL_TYPE_I8:  return anvil_const_i8(ctx, 0);
+        case ANVIL_TYPE_I16: return anvil_const_i16(ctx, 0);
+        case ANVIL_TYPE_I32: return anvil_const_i32(ctx, 0);
+        case ANVIL_TYPE_I64: return anvil_const_i64(ctx, 0);
+        case ANVIL_TYPE_U8:  return anvil_const_u8(ctx, 0);
+        case ANVIL_TYPE_U16: return anvil_const_u16(ctx, 0);
+        case ANVIL_TYPE_U32: return anvil_const_u32(ctx, 0);
+        case ANVIL_TYPE_U64: return anvil_const_u64(ctx, 0);
+        case ANVIL_TYPE_F32: return anvil_const_f32(ctx, 0.0f);
+        case ANVIL_TYPE_F64: return anvil_const_f64(ctx, 0.0);
+        case ANVIL_TYPE_PTR: return anvil_const_null(ctx, type);
+        default:             return NULL;
+    }
+}
+
+/* ============================================================================
+ * Scalar replacement of struct allocas
+ * ============================================================================ */
+
+/* A field pointer may be loaded through, stored through or indexed again */
+static bool field_ptr_splittable(const anvil_value_t *field)
+{
+    for (anvil_use_t *use = field->uses; use; use = use->next) {
+        const anvil_instr_t *user = use->user;
+        size_t idx = (size_t)(use - user->uses);
+        if (user->op == ANVIL_OP_LOAD && idx == 0) continue;
+        if (user->op == ANVIL_OP_STORE && idx == 1 && user->operands[0] != field) continue;
+        if (user->op == ANVIL_OP_STRUCT_GEP && idx == 0) continue;
+        return false;
+    }
+    return true;
+}
+
+/* Every use is a struct_gep with a constant field into this alloca */
+static bool struct_splittable(const anvil_instr_t *alloca_instr, const anvil_type_t *type)
+{
+    if (!type || type->kind != ANVIL_TYPE_STRUCT || type->data.struc.num_fields == 0) return false;
+    if (!alloca_instr->result->uses) return false;
+
+    for (anvil_use_t *use = alloca_instr->result->uses; use; use = use->next) {
+        const anvil_instr_t *gep = use->user;
+        if (gep->op != ANVIL_OP_STRUCT_GEP || use != &gep->uses[0]) return false;
+        if (gep->aux_type != type || gep->num_operands < 2 || !gep->result) return false;
+        const anvil_value_t *field = gep->operands[1];
+        if (field->kind != ANVIL_VAL_CONST_INT || field->data.u >= type->data.struc.num_fields)
+            return false;
+        if (!field_ptr_splittable(gep->result)) return false;
+    }
+    return true;
+}
+
+/* Give each field of a struct alloca its own alloca */
+static bool split_struct(mem2reg_t *m, anvil_instr_t *alloca_instr, const anvil_type_t *type)
+{
+    size_t num_fields = type->data.struc.num_fields;
+    anvil_instr_t **fields = calloc(num_fields, sizeof(anvil_instr_t *));
+    if (!fields) return false;
+
+    /* Stopping early leaves the fields split so far in their own allocas */
+    bool changed = false;
+    while (alloca_instr->result->uses) {
+        anvil_instr_t *gep = alloca_instr->result->uses->user;
+        size_t f = (size_t)gep->operands[1]->data.u;
+        if (!fields[f]) {
+            fields[f] = anvil_instr_create_in(m->ctx, alloca_instr->pool, ANVIL_OP_ALLOCA,
+                                              gep->result->type, gep->result->name);
+            if (!fields[f]) break;
+            anvil_instr_insert_before(alloca_instr->parent, alloca_instr, fields[f]);
+        }
+        anvil_value_replace_all_uses(gep->result, fields[f]->result);
+        anvil_instr_kill(gep);
+        changed = true;
+    }
+
+    if (!alloca_instr->result->uses) anvil_instr_kill(alloca_instr);
+    free(fields);
+    return changed;
+}
+
+/* Split struct allocas until none is left to split (fields may be structs) */
+static bool scalar_replace(mem2reg_t *m)
+{
+    bool changed = false;
+    bool again = true;
+    while (again) {
+        again = false;
+        for (anvil_block_t *block = m->func->blocks; block; block = block->next) {
+            for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+                if (instr->op != ANVIL_OP_ALLOCA || !instr->result) continue;
+                const anvil_type_t *type = slot_type(instr);
+                if (!struct_splittable(instr, type) || !split_struct(m, instr, type)) continue;
+                /* Only a completely split struct can have struct fields to split next */
+                changed = true;
+                if (instr->op == ANVIL_OP_NOP) again = true;
+            }
+        }
+    }
+    return changed;
+}
+
+/* ============================================================================
+ * Promotion
+ * ============================================================================ */
+
+/* Loads and stores of the slot's own type are the only uses */
+static bool is_promotable(const anvil_instr_t *alloca_instr)
+{
+    anvil_type_t *type = slot_type(alloca_instr);
+    if (!is_scalar_type(type)) return false;
+
+    for (anvil_use_t *use = alloca_instr->result->uses; use; use = use->next) {
+        const anvil_instr_t *user = use->user;
+        size_t idx = (size_t)(use - user->uses);
+        if (user->op == ANVIL_OP_LOAD && idx == 0 && user->result && user->result->type == type)
+            continue;
+        if (user->op == ANVIL_OP_STORE && idx == 1 && user->operands[0]->type == type &&
+            user->operands[0] != alloca_instr->result)
+            continue;
+        return false;
+    }
+    return true;
+}
+
+/* Slot index of a load or store address, or -1 */
+static int32_t slot_index(const mem2reg_t *m, const anvil_value_t *ptr)
+{
+    if (!alloca_of(ptr)) return -1;
+    int32_t a = anvil_value_map_get(&m->index, ptr);
+    return a == ANVIL_VALUE_MAP_NONE || (size_t)a >= m->num_slots ? -1 : a;
+}
+
+static bool collect_slots(mem2reg_t *m)
+{
+    size_t count = 0;
+    for (anvil_block_t *block = m->func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_ALLOCA && instr->result && is_promotable(instr)) count++;
+        }
+    }
+    if (count == 0) return true;
+
+    m->slots = malloc(count * sizeof(anvil_instr_t *));
+    if (!m->slots || anvil_value_map_reset(&m->index, m->func) != ANVIL_OK) return false;
+    for (anvil_block_t *block = m->func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op != ANVIL_OP_ALLOCA || !instr->result || !is_promotable(instr)) continue;
+            if (anvil_value_map_set(&m->index, instr->result, (int32_t)m->num_slots) != ANVIL_OK)
+                return false;
+            m->slots[m->num_slots++] = instr;
+        }
+    }
+    return true;
+}
+
+/* Def and upward-exposed use blocks of every slot. Run once to count
+ * (lists NULL) and once to fill; a block is listed once per slot. */
+static void scan_accesses(mem2reg_t *m, int32_t *def_last, int32_t *use_last, int32_t *fill)
+{
+    for (size_t a = 0; a < m->num_slots; a++) def_last[a] = use_last[a] = -1;
+
+    for (size_t b = 0; b < m->dt->num_blocks; b++) {
+        for (anvil_instr_t *instr = m->dt->blocks[b]->first; instr; instr = instr->next) {
+            int32_t a;
+            if (instr->op == ANVIL_OP_LOAD && instr->num_operands == 1) {
+                a = slot_index(m, instr->operands[0]);
+                /* Read before any store in this block */
+                if (a < 0 || def_last[a] == (int32_t)b || use_last[a] == (int32_t)b) continue;
+                use_last[a] = (int32_t)b;
+                if (fill) m->uses[m->use_start[a] + fill[2 * a + 1]++] = (int32_t)b;
+                else m->use_start[a + 1]++;
+            } else if (instr->op == ANVIL_OP_STORE && instr->num_operands == 2) {
+                a = slot_index(m, instr->operands[1]);
+                if (a < 0) continue;
+                if (!fill) m->num_stores++;
+                if (def_last[a] == (int32_t)b) continue;
+                def_last[a] = (int32_t)b;
+                if (fill) m->defs[m->def_start[a] + fill[2 * a]++] = (int32_t)b;
+                else m->def_start[a + 1]++;
+            }
+        }
+    }
+}
+
+static bool collect_accesses(mem2reg_t *m)
+{
+    size_t n = m->num_slots;
+    int32_t *def_last = malloc(n * sizeof(int32_t));
+    int32_t *use_last = malloc(n * sizeof(int32_t));
+    int32_t *fill = calloc(2 * n, sizeof(int32_t));
+    m->def_start = calloc(n + 1, sizeof(int32_t));
+    m->use_start = calloc(n + 1, sizeof(int32_t));
+    bool ok = def_last && use_last && fill && m->def_start && m->use_start;
+
+    if (ok) {
+        scan_accesses(m, def_last, use_last, NULL);
+        for (size_t a = 0; a < n; a++) {
+            m->def_start[a + 1] += m->def_start[a];
+            m->use_start[a + 1] += m->use_start[a];
+        }
+        m->defs = malloc((m->def_start[n] ? (size_t)m->def_start[n] : 1) * sizeof(int32_t));
+        m->uses = malloc((m->use_start[n] ? (size_t)m->use_start[n] : 1) * sizeof(int32_t));
+        ok = m->defs && m->uses;
+    }
+    if (ok) scan_accesses(m, def_last, use_last, fill);
+
+    free(def_last);
+    free(use_last);
+    free(fill);
+    return ok;
+}
+
+static bool add_phi(mem2reg_t *m, size_t a, int32_t b)
+{
+    if (m->num_phis == m->cap_phis) {
+        size_t cap = m->cap_phis ? m->cap_phis * 2 : 16;
+        anvil_instr_t **phis = realloc(m->phis, cap * sizeof(anvil_instr_t *));
+        if (!phis) return false;
+        m->phis = phis;
+        m->cap_phis = cap;
+    }
+
+    anvil_instr_t *alloca_instr = m->slots[a];
+    anvil_instr_t *phi = anvil_instr_create_in(m->ctx, alloca_instr->pool, ANVIL_OP_PHI,
+                                               slot_type(alloca_instr), alloca_instr->result->name);
+    if (!phi) return false;
+    anvil_block_t *block = m->dt->blocks[b];
+    anvil_instr_insert_before(block, block->first, phi);
+    m->phis[m->num_phis++] = phi;
+    return anvil_value_map_set(&m->index, phi->result, (int32_t)(m->num_slots + a)) == ANVIL_OK;
+}
+
+/* Phis in the iterated dominance frontier of the stores, where live */
+static bool place_phis(mem2reg_t *m)
+{
+    size_t nb = m->dt->num_blocks;
+    int32_t *live = malloc(nb * sizeof(int32_t));      /* Slot live on entry */
+    int32_t *defined = malloc(nb * sizeof(int32_t));   /* Slot stored or phi'd */
+    int32_t *has_phi = malloc(nb * sizeof(int32_t));
+    int32_t *work = malloc(nb * sizeof(int32_t));
+    bool ok = live && defined && has_phi && work;
+    if (ok) {
+        for (size_t b = 0; b < nb; b++) live[b] = defined[b] = has_phi[b] = -1;
+    }
+
+    for (size_t a = 0; ok && a < m->num_slots; a++) {
+        int32_t tag = (int32_t)a;
+        size_t n = 0;
+
+        /* Live-in blocks: walk back from the reads, stopping at stores */
+        for (int32_t i = m->def_start[a]; i < m->def_start[a + 1]; i++) defined[m->defs[i]] = tag;
+        for (int32_t i = m->use_start[a]; i < m->use_start[a + 1]; i++) {
+            live[m->uses[i]] = tag;
+            work[n++] = m->uses[i];
+        }
+        while (n > 0) {
+            int32_t b = work[--n];
+            for (int32_t i = m->dt->pred_start[b]; i < m->dt->pred_start[b + 1]; i++) {
+                int32_t p = m->dt->preds[i];
+                if (live[p] == tag || defined[p] == tag) continue;
+                live[p] = tag;
+                work[n++] = p;
+            }
+        }
+        if (m->use_start[a] == m->use_start[a + 1]) continue;
+
+        /* Iterated frontier of the stores */
+        for (int32_t i = m->def_start[a]; i < m->def_start[a + 1]; i++) work[n++] = m->defs[i];
+        while (ok && n > 0) {
+            int32_t b = work[--n];
+            for (int32_t i = m->dt->df_start[b]; i < m->dt->df_start[b + 1]; i++) {
+                int32_t y = m->dt->df[i];
+                if (has_phi[y] == tag || live[y] != tag) continue;
+                has_phi[y] = tag;
+                ok = add_phi(m, a, y);
+                if (defined[y] != tag) {
+                    defined[y] = tag;
+                    work[n++] = y;
+                }
+            }
+        }
+    }
+
+    free(live);
+    free(defined);
+    free(has_phi);
+    free(work);
+    return ok;
+}
+
+static void set_current(mem2reg_t *m, int32_t a, anvil_value_t *value)
+{
+    m->undo[m->num_undo++] = (rename_undo_t){ a, m->current[a] };
+    m->current[a] = value;
+}
+
+/* Slot of a phi placed by this pass, or -1 */
+static int32_t phi_slot(const mem2reg_t *m, const anvil_instr_t *phi)
+{
+    int32_t v = anvil_value_map_get(&m->index, phi->result);
+    if (v == ANVIL_VALUE_MAP_NONE || (size_t)v < m->num_slots) return -1;
+    return v - (int32_t)m->num_slots;
+}
+
+/* Replace the block's loads, drop its stores and feed successor phis */
+static void rename_block(mem2reg_t *m, int32_t b)
+{
+    anvil_block_t *block = m->dt->blocks[b];
+    for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+        int32_t a;
+        if (instr->op == ANVIL_OP_PHI) {
+            a = phi_slot(m, instr);
+            if (a >= 0) set_current(m, a, instr->result);
+        } else if (instr->op == ANVIL_OP_LOAD && instr->num_operands == 1) {
+            a = slot_index(m, instr->operands[0]);
+            if (a < 0) continue;
+            anvil_value_replace_all_uses(instr->result, m->current[a]);
+            anvil_instr_kill(instr);
+        } else if (instr->op == ANVIL_OP_STORE && instr->num_operands == 2) {
+            a = slot_index(m, instr->operands[1]);
+            if (a < 0) continue;
+            set_current(m, a, instr->operands[0]);
+            anvil_instr_kill(instr);
+        }
+    }
+
+    anvil_block_t *succs[2];
+    size_t n = anvil_block_succs(block, succs);
+    for (size_t s = 0; s < n; s++) {
+        for (anvil_instr_t *phi = succs[s]->first; phi && phi->op == ANVIL_OP_PHI; phi = phi->next) {
+            int32_t a = phi_slot(m, phi);
+            if (a >= 0) anvil_phi_add_incoming(phi->result, m->current[a], block);
+        }
+    }
+}
+
+typedef struct {
+    int32_t block;
+    int32_t next_child;
+    size_t mark;
+} rename_frame_t;
+
+/* Preorder walk of the dominator tree, undoing each block's values after
+ * it. Everything is allocated up front: once the first load is rewritten
+ * the walk has to finish. */
+static void rename_slots(mem2reg_t *m, rename_frame_t *stack)
+{
+    const anvil_domtree_t *dt = m->dt;
+    for (size_t a = 0; a < m->num_slots; a++) {
+        m->current[a] = zero_value(m->ctx, slot_type(m->slots[a]));
+    }
+
+    rename_block(m, 0);
+    size_t depth = 0;
+    stack[depth++] = (rename_frame_t){ 0, dt->child_start[0], 0 };
+    while (depth > 0) {
+        rename_frame_t *top = &stack[depth - 1];
+        if (top->next_child < dt->child_start[top->block + 1]) {
+            int32_t child = dt->children[top->next_child++];
+            stack[depth++] = (rename_frame_t){ child, dt->child_start[child], m->num_undo };
+            rename_block(m, child);
+            continue;
+        }
+        while (m->num_undo > top->mark) {
+            const rename_undo_t *u = &m->undo[--m->num_undo];
+            m->current[u->slot] = u->value;
+        }
+        depth--;
+    }
+}
+
+/* Accesses in blocks the entry never reaches read zero and store nothing */
+static void drop_unreachable(mem2reg_t *m)
+{
+    for (anvil_block_t *block = m->func->blocks; block; block = block->next) {
+        if (anvil_domtree_index(m->dt, block) >= 0) continue;
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            int32_t a;
+            if (instr->op == ANVIL_OP_LOAD && instr->num_operands == 1 &&
+                (a = slot_index(m, instr->operands[0])) >= 0) {
+                anvil_value_replace_all_uses(instr->result, zero_value(m->ctx, slot_type(m->slots[a])));
+                anvil_instr_kill(instr);
+            } else if (instr->op == ANVIL_OP_STORE && instr->num_operands == 2 &&
+                       slot_index(m, instr->operands[1]) >= 0) {
+                anvil_instr_kill(instr);
+            }
+        }
+    }
+}
+
+/* The one value a phi merges apart from itself, or NULL if there are two */
+static anvil_value_t *trivial_phi_value(const anvil_instr_t *phi)
+{
+    anvil_value_t *same = NULL;
+    for (size_t i = 0; i < phi->num_operands; i++) {
+        anvil_value_t *v = phi->operands[i];
+        if (v == same || v == phi->result) continue;
+        if (same) return NULL;
+        same = v;
+    }
+    return same;
+}
+
+/* Fold phis that merge a single value; folding one may make others trivial */
+static void fold_trivial_phis(mem2reg_t *m)
+{
+    bool again = true;
+    while (again) {
+        again = false;
+        for (size_t i = 0; i < m->num_phis; i++) {
+            anvil_instr_t *phi = m->phis[i];
+            if (phi->op != ANVIL_OP_PHI) continue;
+            anvil_value_t *same = trivial_phi_value(phi);
+            if (!same) continue;
+            anvil_value_replace_all_uses(phi->result, same);
+            anvil_instr_kill(phi);
+            again = true;
+        }
+    }
+}
+
+static bool promote(mem2reg_t *m)
+{
+    rename_frame_t *stack = NULL;
+    bool ok = collect_accesses(m) && anvil_domtree_frontiers(m->dt) == ANVIL_OK &&
+              place_phis(m);
+    if (ok) {
+        stack = malloc(m->dt->num_blocks * sizeof(rename_frame_t));
+        m->current = malloc(m->num_slots * sizeof(anvil_value_t *));
+        m->undo = malloc((m->num_stores + m->num_phis + 1) * sizeof(rename_undo_t));
+        ok = stack && m->current && m->undo;
+    }
+    if (!ok) {
+        /* Nothing was rewritten yet: take back the phis placed so far */
+        for (size_t i = 0; i < m->num_phis; i++) anvil_instr_remove(m->phis[i]);
+        free(stack);
+        return false;
+    }
+
+    rename_slots(m, stack);
+    free(stack);
+    drop_unreachable(m);
+    fold_trivial_phis(m);
+
+    for (size_t a = 0; a < m->num_slots; a++) {
+        if (!m->slots[a]->result->uses) anvil_instr_kill(m->slots[a]);
+    }
+    return true;
+}
+
+/* Main mem2reg pass */
+bool anvil_pass_mem2reg(anvil_func_t *func)
+{
+    if (!func || !func->blocks || !func->entry) return false;
+
+    mem2reg_t m = { 0 };
+    m.ctx = func->parent->ctx;
+    m.func = func;
+
+    bool changed = scalar_replace(&m);
+
+    /* Only build the dominator tree for slots to promote; a branch back
+     * to the entry would need a phi on the way in */
+    if (collect_slots(&m) && m.num_slots > 0) {
+        m.dt = anvil_func_domtree(func);
+        if (m.dt && m.dt->pred_start[1] == 0) changed |= promote(&m);
+    }
+
+    anvil_value_map_free(&m.index);
+    free(m.slots);
+    free(m.def_start);
+    free(m.defs);
+    free(m.use_start);
+    free(m.uses);
+    free(m.phis);
+    free(m.current);
+    free(m.undo);
+    return changed;
+}
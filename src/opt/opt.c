@@ -6,17 +6,32 @@
 #include "anvil/anvil_opt.h"
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* Pass manager structure */
 struct anvil_pass_manager {
     anvil_ctx_t *ctx;
     anvil_opt_level_t level;
     bool enabled[ANVIL_PASS_COUNT];
+    int threads;            /* Functions optimized at once (0 = one per CPU) */
+    bool verify_cfg;        /* Check the edge lists after every pass */
+    
+    /* Pass order from anvil_pass_manager_set_pipeline (slot numbers, see
+     * pass_slot_info); without one, default_order then custom passes */
+    size_t *pipeline;
+    size_t num_pipeline;
+    bool has_pipeline;
     
     /* Custom passes */
     anvil_pass_info_t *custom_passes;
     size_t num_custom;
     size_t cap_custom;
+    
+    /* Statistics (see anvil_pass_manager_set_stats) */
+    bool stats_enabled;
+    anvil_opt_stats_t stats;
+    anvil_pass_stats_t *pass_stats;  /* Built-in passes, then custom ones */
+    anvil_mutex_t stats_lock;        /* Functions optimized in parallel add to them */
 };
 
 /* Built-in pass definitions
@@ -24,10 +39,15 @@ struct anvil_pass_manager {
  * Optimization levels:
  *   O0 (NONE)       - No optimizations
  *   Og (DEBUG)      - Debug-friendly: copy_prop, store_load_prop (minimal IR cleanup)
- *   O1 (BASIC)      - Basic: const_fold, dce, copy_prop, store_load_prop
- *   O2 (STANDARD)   - Standard: O1 + simplify_cfg, strength_reduce, dead_store, load_elim, cse
+ *   O1 (BASIC)      - Basic: mem2reg, const_fold, dce, copy_prop, store_load_prop
+ *   O2 (STANDARD)   - Standard: O1 + simplify_cfg, strength_reduce, dead_store, load_elim, gvn, licm
  *   O3 (AGGRESSIVE) - Aggressive: O2 + loop_unroll
+ *
+ * cse is enabled by no level (gvn finds everything it does) but can still
+ * be enabled by id or listed in a pipeline.
  */
+#define OPT_LEVEL_NEVER ((anvil_opt_level_t)(ANVIL_OPT_AGGRESSIVE + 1))
+
 static const anvil_pass_info_t builtin_passes[ANVIL_PASS_COUNT] = {
     {
         .id = ANVIL_PASS_CONST_FOLD,
@@ -89,7 +109,7 @@ static const anvil_pass_info_t builtin_passes[ANVIL_PASS_COUNT] = {
         .id = ANVIL_PASS_LOOP_UNROLL,
         .name = "loop-unroll",
         .description = "Loop unrolling",
-        .run = NULL,  /* Disabled - needs more testing */
+        .run = anvil_pass_loop_unroll,
         .min_level = ANVIL_OPT_AGGRESSIVE
     },
     {
@@ -97,10 +117,49 @@ static const anvil_pass_info_t builtin_passes[ANVIL_PASS_COUNT] = {
         .name = "cse",
         .description = "Common subexpression elimination",
         .run = anvil_pass_cse,
+        .min_level = OPT_LEVEL_NEVER
+    },
+    {
+        .id = ANVIL_PASS_GVN,
+        .name = "gvn",
+        .description = "Global value numbering",
+        .run = anvil_pass_gvn,
+        .min_level = ANVIL_OPT_STANDARD
+    },
+    {
+        .id = ANVIL_PASS_MEM2REG,
+        .name = "mem2reg",
+        .description = "Promote allocas to SSA registers",
+        .run = anvil_pass_mem2reg,
+        .min_level = ANVIL_OPT_BASIC
+    },
+    {
+        .id = ANVIL_PASS_LICM,
+        .name = "licm",
+        .description = "Loop-invariant code motion",
+        .run = anvil_pass_licm,
         .min_level = ANVIL_OPT_STANDARD
     }
 };
 
+/* Default order of the built-in passes: promotion first, so the others
+ * see SSA values instead of loads and stores */
+static const anvil_pass_id_t default_order[ANVIL_PASS_COUNT] = {
+    ANVIL_PASS_MEM2REG,
+    ANVIL_PASS_CONST_FOLD,
+    ANVIL_PASS_DCE,
+    ANVIL_PASS_SIMPLIFY_CFG,
+    ANVIL_PASS_STRENGTH_REDUCE,
+    ANVIL_PASS_COPY_PROP,
+    ANVIL_PASS_DEAD_STORE,
+    ANVIL_PASS_LOAD_ELIM,
+    ANVIL_PASS_STORE_LOAD_PROP,
+    ANVIL_PASS_LOOP_UNROLL,
+    ANVIL_PASS_COMMON_SUBEXPR,
+    ANVIL_PASS_GVN,
+    ANVIL_PASS_LICM
+};
+
 /* ============================================================================
  * Pass Manager Implementation
  * ============================================================================ */
@@ -114,6 +173,17 @@ anvil_pass_manager_t *anvil_pass_manager_create(anvil_ctx_t *ctx)
     
     pm->ctx = ctx;
     pm->level = ANVIL_OPT_NONE;
+    pm->threads = 1;
+    
+    pm->pass_stats = calloc(ANVIL_PASS_COUNT, sizeof(anvil_pass_stats_t));
+    if (!pm->pass_stats) {
+        free(pm);
+        return NULL;
+    }
+    anvil_mutex_init(&pm->stats_lock);
+    for (int i = 0; i < ANVIL_PASS_COUNT; i++) {
+        pm->pass_stats[i].name = builtin_passes[i].name;
+    }
     
     /* All passes disabled by default */
     for (int i = 0; i < ANVIL_PASS_COUNT; i++) {
@@ -127,6 +197,9 @@ void anvil_pass_manager_destroy(anvil_pass_manager_t *pm)
 {
     if (!pm) return;
     free(pm->custom_passes);
+    free(pm->pass_stats);
+    free(pm->pipeline);
+    anvil_mutex_destroy(&pm->stats_lock);
     free(pm);
 }
 
@@ -165,52 +238,668 @@ bool anvil_pass_manager_is_enabled(anvil_pass_manager_t *pm, anvil_pass_id_t pas
     return pm->enabled[pass];
 }
 
+void anvil_pass_manager_set_threads(anvil_pass_manager_t *pm, int threads)
+{
+    if (!pm) return;
+    pm->threads = threads < 0 ? 1 : threads;
+}
+
+int anvil_pass_manager_get_threads(anvil_pass_manager_t *pm)
+{
+    return pm ? pm->threads : 1;
+}
+
+void anvil_pass_manager_set_verify(anvil_pass_manager_t *pm, bool enable)
+{
+    if (!pm) return;
+    pm->verify_cfg = enable;
+}
+
+/* ============================================================================
+ * Statistics
+ *
+ * While enabled, each function run gets a probe that fingerprints the
+ * live instructions before every pass and matches them up afterwards, so
+ * a pass is charged for what it removed, added and rewrote. The probe is
+ * merged into the pass manager when the function is done, under the lock
+ * parallel runs install, so workers never share counters.
+ * ============================================================================ */
+
+typedef struct {
+    anvil_instr_t *instr;
+    uint64_t hash;
+    bool seen;
+} instr_print_t;
+
+typedef struct {
+    anvil_pass_stats_t *passes;     /* One per pass slot */
+    size_t num_passes;
+    instr_print_t *prints;          /* Live instructions before the pass */
+    size_t num_prints;
+    size_t cap_prints;
+    bool have_prints;
+    uint64_t before;
+    uint64_t peak;
+    double time_ms;
+} pass_probe_t;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+#define HASH_MIX(h, v) ((h) = ((h) ^ (uint64_t)(v)) * 1099511628211ull)
+
+/* Everything a pass may rewrite in place */
+static uint64_t instr_hash(const anvil_instr_t *instr)
+{
+    uint64_t h = 1469598103934665603ull;
+    HASH_MIX(h, instr->op);
+    HASH_MIX(h, instr->num_operands);
+    for (size_t i = 0; i < instr->num_operands; i++) {
+        HASH_MIX(h, (uintptr_t)instr->operands[i]);
+    }
+    for (size_t i = 0; i < instr->num_phi_incoming && instr->phi_blocks; i++) {
+        HASH_MIX(h, (uintptr_t)instr->phi_blocks[i]);
+    }
+    HASH_MIX(h, (uintptr_t)instr->true_block);
+    HASH_MIX(h, (uintptr_t)instr->false_block);
+    HASH_MIX(h, (uintptr_t)instr->aux_type);
+    return h;
+}
+
+static size_t count_instrs(anvil_func_t *func)
+{
+    size_t n = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op != ANVIL_OP_NOP) n++;
+        }
+    }
+    return n;
+}
+
+static int cmp_prints(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)((const instr_print_t *)a)->instr;
+    uintptr_t y = (uintptr_t)((const instr_print_t *)b)->instr;
+    return x < y ? -1 : x > y;
+}
+
+static bool probe_init(pass_probe_t *probe, anvil_pass_manager_t *pm, anvil_func_t *func)
+{
+    memset(probe, 0, sizeof(*probe));
+    probe->num_passes = ANVIL_PASS_COUNT + pm->num_custom;
+    probe->passes = calloc(probe->num_passes, sizeof(anvil_pass_stats_t));
+    if (!probe->passes) return false;
+    probe->before = count_instrs(func);
+    probe->peak = probe->before;
+    return true;
+}
+
+/* Fingerprint the live instructions, sorted by address for lookup */
+static void probe_snapshot(pass_probe_t *probe, anvil_func_t *func)
+{
+    size_t count = count_instrs(func);
+    probe->have_prints = false;
+    if (count > probe->cap_prints) {
+        instr_print_t *prints = realloc(probe->prints, count * sizeof(instr_print_t));
+        if (!prints) return;
+        probe->prints = prints;
+        probe->cap_prints = count;
+    }
+    
+    size_t n = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_NOP) continue;
+            probe->prints[n++] = (instr_print_t){ instr, instr_hash(instr), false };
+        }
+    }
+    if (n > 1) qsort(probe->prints, n, sizeof(instr_print_t), cmp_prints);
+    probe->num_prints = n;
+    probe->have_prints = true;
+}
+
+/* Charge the pass for the difference against the snapshot */
+static void probe_compare(pass_probe_t *probe, anvil_func_t *func, anvil_pass_stats_t *stats)
+{
+    uint64_t live = 0;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+            if (instr->op == ANVIL_OP_NOP) continue;
+            live++;
+            if (!probe->have_prints) continue;
+            
+            instr_print_t key = { .instr = instr };
+            instr_print_t *print = bsearch(&key, probe->prints, probe->num_prints,
+                                           sizeof(instr_print_t), cmp_prints);
+            if (!print) {
+                stats->instrs_added++;
+            } else {
+                print->seen = true;
+                if (print->hash != instr_hash(instr)) stats->instrs_rewritten++;
+            }
+        }
+    }
+    for (size_t i = 0; probe->have_prints && i < probe->num_prints; i++) {
+        if (!probe->prints[i].seen) stats->instrs_removed++;
+    }
+    if (live > probe->peak) probe->peak = live;
+}
+
+static bool run_pass(pass_probe_t *probe, size_t slot, anvil_pass_func_t run, anvil_func_t *func)
+{
+    if (!probe) return run(func);
+    
+    probe_snapshot(probe, func);
+    double start = now_ms();
+    bool changed = run(func);
+    double ms = now_ms() - start;
+    
+    anvil_pass_stats_t *stats = &probe->passes[slot];
+    stats->runs++;
+    if (changed) stats->changed++;
+    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        if (block->changed_at == func->change_stamp) stats->blocks_changed++;
+    }
+    stats->time_ms += ms;
+    probe->time_ms += ms;
+    probe_compare(probe, func, stats);
+    return changed;
+}
+
+static void probe_finish(pass_probe_t *probe, anvil_pass_manager_t *pm, anvil_func_t *func,
+                         int iterations)
+{
+    size_t after = count_instrs(func);
+    anvil_mutex_lock(&pm->stats_lock);
+    for (size_t i = 0; i < probe->num_passes; i++) {
+        anvil_pass_stats_t *src = &probe->passes[i];
+        anvil_pass_stats_t *dst = &pm->pass_stats[i];
+        dst->runs += src->runs;
+        dst->skipped += src->skipped;
+        dst->changed += src->changed;
+        dst->blocks_changed += src->blocks_changed;
+        dst->time_ms += src->time_ms;
+        dst->instrs_removed += src->instrs_removed;
+        dst->instrs_added += src->instrs_added;
+        dst->instrs_rewritten += src->instrs_rewritten;
+    }
+    anvil_opt_stats_t *stats = &pm->stats;
+    stats->funcs++;
+    stats->iterations += (uint64_t)iterations;
+    if ((uint64_t)iterations > stats->max_iterations) stats->max_iterations = (uint64_t)iterations;
+    stats->instrs_before += probe->before;
+    stats->instrs_after += after;
+    if (probe->peak > stats->peak_instrs) stats->peak_instrs = probe->peak;
+    stats->time_ms += probe->time_ms;
+    anvil_mutex_unlock(&pm->stats_lock);
+    
+    free(probe->passes);
+    free(probe->prints);
+}
+
+void anvil_pass_manager_set_stats(anvil_pass_manager_t *pm, bool enable)
+{
+    if (!pm) return;
+    pm->stats_enabled = enable;
+}
+
+void anvil_pass_manager_reset_stats(anvil_pass_manager_t *pm)
+{
+    if (!pm) return;
+    memset(&pm->stats, 0, sizeof(pm->stats));
+    for (size_t i = 0; i < ANVIL_PASS_COUNT + pm->num_custom; i++) {
+        const char *name = pm->pass_stats[i].name;
+        memset(&pm->pass_stats[i], 0, sizeof(anvil_pass_stats_t));
+        pm->pass_stats[i].name = name;
+    }
+}
+
+const anvil_opt_stats_t *anvil_pass_manager_get_stats(anvil_pass_manager_t *pm)
+{
+    return pm ? &pm->stats : NULL;
+}
+
+const anvil_pass_stats_t *anvil_pass_manager_get_pass_stats(anvil_pass_manager_t *pm,
+                                                            size_t *count)
+{
+    if (!pm) {
+        if (count) *count = 0;
+        return NULL;
+    }
+    if (count) *count = ANVIL_PASS_COUNT + pm->num_custom;
+    return pm->pass_stats;
+}
+
+static int cmp_pass_time(const void *a, const void *b)
+{
+    const anvil_pass_stats_t *x = *(const anvil_pass_stats_t *const *)a;
+    const anvil_pass_stats_t *y = *(const anvil_pass_stats_t *const *)b;
+    return x->time_ms < y->time_ms ? 1 : x->time_ms > y->time_ms ? -1 : 0;
+}
+
+void anvil_pass_manager_print_stats(anvil_pass_manager_t *pm, FILE *out)
+{
+    if (!pm || !out) return;
+    
+    const anvil_opt_stats_t *st = &pm->stats;
+    fprintf(out, "===== ANVIL pass statistics =====\n");
+    if (st->funcs == 0) {
+        fprintf(out, "  No functions optimized\n");
+        return;
+    }
+    fprintf(out, "  Functions: %llu, iterations: %llu (max %llu per function)\n",
+            (unsigned long long)st->funcs, (unsigned long long)st->iterations,
+            (unsigned long long)st->max_iterations);
+    fprintf(out, "  Instructions: %llu -> %llu (largest function: %llu)\n",
+            (unsigned long long)st->instrs_before, (unsigned long long)st->instrs_after,
+            (unsigned long long)st->peak_instrs);
+    fprintf(out, "  Pass time: %.3f ms\n\n", st->time_ms);
+    
+    size_t count = ANVIL_PASS_COUNT + pm->num_custom;
+    const anvil_pass_stats_t **rows = malloc(count * sizeof(*rows));
+    if (!rows) return;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pm->pass_stats[i].runs > 0) rows[n++] = &pm->pass_stats[i];
+    }
+    qsort(rows, n, sizeof(*rows), cmp_pass_time);
+    
+    fprintf(out, "  %-18s %10s %6s %7s %8s %8s %8s %8s %8s %9s\n", "Pass", "Time (ms)", "%",
+            "Runs", "Skipped", "Changed", "Blocks", "Removed", "Added", "Rewritten");
+    for (size_t i = 0; i < n; i++) {
+        const anvil_pass_stats_t *r = rows[i];
+        double pct = st->time_ms > 0 ? 100.0 * r->time_ms / st->time_ms : 0.0;
+        fprintf(out, "  %-18s %10.3f %6.1f %7llu %8llu %8llu %8llu %8llu %8llu %9llu\n",
+                r->name ? r->name : "(custom)", r->time_ms, pct,
+                (unsigned long long)r->runs, (unsigned long long)r->skipped,
+                (unsigned long long)r->changed, (unsigned long long)r->blocks_changed,
+                (unsigned long long)r->instrs_removed, (unsigned long long)r->instrs_added,
+                (unsigned long long)r->instrs_rewritten);
+    }
+    free(rows);
+}
+
+/* ============================================================================
+ * Pipeline and Scheduling
+ *
+ * Passes are numbered by slot: built-in passes by anvil_pass_id_t, then
+ * custom passes from ANVIL_PASS_COUNT in registration order. Statistics
+ * use the same numbering.
+ * ============================================================================ */
+
+static const anvil_pass_info_t *pass_slot_info(anvil_pass_manager_t *pm, size_t slot)
+{
+    if (slot < ANVIL_PASS_COUNT) return &builtin_passes[slot];
+    return &pm->custom_passes[slot - ANVIL_PASS_COUNT];
+}
+
+/* Slots to run, in order; disabled and unimplemented passes are left out */
+/* mem2reg, licm and loop-unroll create phis, and leave values live across
+ * blocks. A backend without supports_phi emits each value into one fixed
+ * register as it goes, so for its context they stay out of the schedule
+ * even when enabled. */
+static bool builtin_runs(const anvil_pass_manager_t *pm, size_t slot)
+{
+    if (!pm->enabled[slot] || !builtin_passes[slot].run) return false;
+    if (slot != ANVIL_PASS_MEM2REG && slot != ANVIL_PASS_LICM && slot != ANVIL_PASS_LOOP_UNROLL)
+        return true;
+    const anvil_backend_t *be = pm->ctx->backend;
+    return !be || be->ops->supports_phi;
+}
+
+static size_t build_schedule(anvil_pass_manager_t *pm, size_t *slots)
+{
+    size_t n = 0;
+    if (pm->has_pipeline) {
+        for (size_t i = 0; i < pm->num_pipeline; i++) {
+            size_t slot = pm->pipeline[i];
+            if (slot < ANVIL_PASS_COUNT ? builtin_runs(pm, slot) : pass_slot_info(pm, slot)->run != NULL)
+                slots[n++] = slot;
+        }
+        return n;
+    }
+    for (size_t i = 0; i < ANVIL_PASS_COUNT; i++) {
+        size_t slot = default_order[i];
+        if (builtin_runs(pm, slot)) slots[n++] = slot;
+    }
+    for (size_t slot = ANVIL_PASS_COUNT; slot < ANVIL_PASS_COUNT + pm->num_custom; slot++) {
+        if (pass_slot_info(pm, slot)->run) slots[n++] = slot;
+    }
+    return n;
+}
+
+static size_t schedule_capacity(anvil_pass_manager_t *pm)
+{
+    size_t all = ANVIL_PASS_COUNT + pm->num_custom;
+    return pm->has_pipeline && pm->num_pipeline > all ? pm->num_pipeline : all;
+}
+
+static bool find_pass_slot(anvil_pass_manager_t *pm, const char *name, size_t len, size_t *slot)
+{
+    for (size_t i = 0; i < ANVIL_PASS_COUNT + pm->num_custom; i++) {
+        const char *pass_name = pass_slot_info(pm, i)->name;
+        if (pass_name && strlen(pass_name) == len && strncmp(pass_name, name, len) == 0) {
+            *slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+anvil_error_t anvil_pass_manager_set_pipeline(anvil_pass_manager_t *pm, const char *pipeline)
+{
+    if (!pm) return ANVIL_ERR_INVALID_ARG;
+    
+    /* NULL or empty: back to the default order */
+    if (!pipeline || !*pipeline) {
+        free(pm->pipeline);
+        pm->pipeline = NULL;
+        pm->num_pipeline = 0;
+        pm->has_pipeline = false;
+        return ANVIL_OK;
+    }
+    
+    size_t cap = 1;
+    for (const char *p = pipeline; *p; p++) {
+        if (*p == ',') cap++;
+    }
+    size_t *slots = malloc(cap * sizeof(size_t));
+    if (!slots) return ANVIL_ERR_NOMEM;
+    
+    size_t n = 0;
+    const char *p = pipeline;
+    for (;;) {
+        while (*p == ' ' || *p == '\t') p++;
+        const char *name = p;
+        while (*p && *p != ',' && *p != ' ' && *p != '\t') p++;
+        size_t len = (size_t)(p - name);
+        while (*p == ' ' || *p == '\t') p++;
+        
+        if (len == 0 || (*p && *p != ',') || !find_pass_slot(pm, name, len, &slots[n])) {
+            anvil_set_error(pm->ctx, ANVIL_ERR_INVALID_ARG, "Unknown pass '%.*s' in pipeline",
+                            (int)strcspn(name, ","), name);
+            free(slots);
+            return ANVIL_ERR_INVALID_ARG;
+        }
+        n++;
+        if (!*p) break;
+        p++;  /* Skip ',' */
+    }
+    
+    /* Listed built-in passes run even below their usual level */
+    for (size_t i = 0; i < n; i++) {
+        if (slots[i] < ANVIL_PASS_COUNT) pm->enabled[slots[i]] = true;
+    }
+    free(pm->pipeline);
+    pm->pipeline = slots;
+    pm->num_pipeline = n;
+    pm->has_pipeline = true;
+    return ANVIL_OK;
+}
+
+static size_t append_str(char *buf, size_t size, size_t len, const char *str)
+{
+    size_t n = strlen(str);
+    for (size_t i = 0; buf && i < n && len + i + 1 < size; i++) buf[len + i] = str[i];
+    return n;
+}
+
+size_t anvil_pass_manager_get_pipeline(anvil_pass_manager_t *pm, char *buf, size_t size)
+{
+    if (buf && size > 0) buf[0] = '\0';
+    if (!pm) return 0;
+    
+    size_t *slots = malloc(schedule_capacity(pm) * sizeof(size_t));
+    if (!slots) return 0;
+    size_t n = build_schedule(pm, slots);
+    
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        const char *name = pass_slot_info(pm, slots[i])->name;
+        if (i > 0) len += append_str(buf, size, len, ",");
+        len += append_str(buf, size, len, name ? name : "");
+    }
+    if (buf && size > 0) buf[len < size ? len : size - 1] = '\0';
+    free(slots);
+    return len;
+}
+
+/* Change-driven scheduling
+ *
+ * Passes run in schedule order, round after round, until a round changes
+ * nothing or ten rounds have run. Every edit marks the block it touched
+ * with the function's change stamp (see core/function.c), and each pass
+ * starts on a fresh stamp, so a pass's start stamp tells what changed
+ * since it last ran:
+ *
+ *  - nothing anywhere: the pass is skipped, since it found all it could
+ *    on this IR (a pass that changed something marked blocks itself, so
+ *    it runs again);
+ *  - some blocks: the pass runs with visit_since at its last start, and
+ *    the passes that work within one block (const-fold, strength-reduce,
+ *    copy-prop, dead-store, load-elim, store-load-prop, cse and dce's
+ *    first sweep) only look at those blocks; the rest look at the whole
+ *    function, as their work crosses blocks.
+ *
+ * The function logs the blocks marked at each stamp, and each pass keeps
+ * its place in the log, so a block-local pass gets a sorted worklist of
+ * just the blocks changed since its last run instead of walking them
+ * all; the log is trimmed to the oldest place still needed each round.
+ *
+ * Either way a pass does what it would have done on the whole function,
+ * so the result matches running every pass blind. A custom pass edits
+ * through the public API, but may have written fields by hand: once it
+ * reports a change, the edges are rebuilt and every block counts as
+ * changed. */
 bool anvil_pass_manager_run_func(anvil_pass_manager_t *pm, anvil_func_t *func)
 {
     if (!pm || !func) return false;
     if (func->is_declaration) return false;  /* Skip declarations */
     
+    /* Schedule, and the stamp and log position each pass last started
+     * on (stamp 0: never ran) */
+    size_t slot_buf[32];
+    uint32_t start_buf[32];
+    size_t log_buf[32];
+    size_t *slots = slot_buf;
+    uint32_t *last_start = start_buf;
+    size_t *log_pos = log_buf;
+    size_t cap = schedule_capacity(pm);
+    if (cap > 32) {
+        slots = malloc(cap * sizeof(size_t));
+        last_start = malloc(cap * sizeof(uint32_t));
+        log_pos = malloc(cap * sizeof(size_t));
+        if (!slots || !last_start || !log_pos) {
+            free(slots);
+            free(last_start);
+            free(log_pos);
+            return false;
+        }
+    }
+    size_t n = build_schedule(pm, slots);
+    
+    pass_probe_t probe_buf;
+    pass_probe_t *probe = NULL;
+    if (pm->stats_enabled && probe_init(&probe_buf, pm, func)) probe = &probe_buf;
+    
+    for (size_t i = 0; i < n; i++) {
+        last_start[i] = 0;
+        log_pos[i] = 0;
+    }
+    func->log_changes = true;
+    func->num_change_log = 0;
+    
     bool changed = false;
     bool any_changed;
     int iterations = 0;
     const int max_iterations = 10;  /* Prevent infinite loops */
     
-    /* Run passes until fixpoint or max iterations */
+    /* Run passes with changes to look at until fixpoint or max iterations */
     do {
         any_changed = false;
         
-        /* Run built-in passes */
-        for (int i = 0; i < ANVIL_PASS_COUNT; i++) {
-            if (pm->enabled[i] && builtin_passes[i].run) {
-                if (builtin_passes[i].run(func)) {
-                    any_changed = true;
-                    changed = true;
+        for (size_t i = 0; i < n; i++) {
+            size_t slot = slots[i];
+            uint32_t since = last_start[i];
+            if (since && func->last_change < since) {
+                if (probe) probe->passes[slot].skipped++;
+                continue;
+            }
+            
+            last_start[i] = ++func->change_stamp;
+            func->visit_since = since;
+            func->visit_log = log_pos[i];
+            func->worklist_state = ANVIL_WORKLIST_NONE;
+            log_pos[i] = func->num_change_log;
+            bool pass_changed = run_pass(probe, slot, pass_slot_info(pm, slot)->run, func);
+            func->visit_since = 0;
+            func->worklist_state = ANVIL_WORKLIST_NONE;
+            func->num_worklist = 0;
+            
+            if (pass_changed) {
+                if (slot >= ANVIL_PASS_COUNT) anvil_func_update_cfg(func);
+                if (slot >= ANVIL_PASS_COUNT || func->last_change != func->change_stamp) {
+                    anvil_func_mark_changed(func);
                 }
+                any_changed = true;
+                changed = true;
+            }
+            if (pm->verify_cfg && !anvil_func_verify_cfg(func)) {
+                fprintf(stderr, "anvil: pass %s left stale CFG edges in %s\n",
+                        pass_slot_info(pm, slot)->name, func->name);
+                abort();
             }
         }
         
-        /* Run custom passes */
-        for (size_t i = 0; i < pm->num_custom; i++) {
-            if (pm->custom_passes[i].run) {
-                if (pm->custom_passes[i].run(func)) {
-                    any_changed = true;
-                    changed = true;
-                }
-            }
+        /* Drop the log entries every pass has seen */
+        size_t keep = func->num_change_log;
+        for (size_t i = 0; i < n; i++) {
+            if (last_start[i] && log_pos[i] < keep) keep = log_pos[i];
+        }
+        if (keep > 0) {
+            memmove(func->change_log, func->change_log + keep,
+                    (func->num_change_log - keep) * sizeof(anvil_block_t *));
+            func->num_change_log -= keep;
+            for (size_t i = 0; i < n; i++) log_pos[i] = log_pos[i] > keep ? log_pos[i] - keep : 0;
         }
         
         iterations++;
     } while (any_changed && iterations < max_iterations);
     
+    func->log_changes = false;
+    free(func->change_log);
+    free(func->worklist);
+    func->change_log = NULL;
+    func->worklist = NULL;
+    func->num_change_log = func->cap_change_log = 0;
+    func->num_worklist = func->cap_worklist = 0;
+    
+    if (probe) probe_finish(probe, pm, func, iterations);
+    if (slots != slot_buf) {
+        free(slots);
+        free(last_start);
+        free(log_pos);
+    }
     return changed;
 }
 
+/* Parallel module run: one job per defined function, biggest first so a
+ * large function picked up last does not leave the other workers idle */
+typedef struct {
+    anvil_pass_manager_t *pm;
+    anvil_func_t **funcs;
+    bool *changed;
+    anvil_worker_t *workers;
+} opt_job_t;
+
+typedef struct {
+    anvil_func_t *func;
+    size_t size;
+    size_t index;
+} opt_item_t;
+
+static int cmp_items(const void *a, const void *b)
+{
+    const opt_item_t *x = a, *y = b;
+    if (x->size != y->size) return x->size > y->size ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+static anvil_error_t opt_job(void *data, size_t worker, size_t index)
+{
+    opt_job_t *job = data;
+    anvil_worker_enter(&job->workers[worker]);
+    job->changed[index] = anvil_pass_manager_run_func(job->pm, job->funcs[index]);
+    return ANVIL_OK;
+}
+
+static anvil_error_t run_module_parallel(anvil_pass_manager_t *pm, anvil_module_t *mod,
+                                         int threads, bool *changed)
+{
+    size_t count = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        if (!func->is_declaration) count++;
+    }
+    if (count < 2) return ANVIL_ERR_INVALID_ARG;
+    
+    opt_item_t *items = malloc(count * sizeof(opt_item_t));
+    anvil_func_t **funcs = malloc(count * sizeof(anvil_func_t *));
+    bool *func_changed = calloc(count, sizeof(bool));
+    if (!items || !funcs || !func_changed) {
+        free(items);
+        free(funcs);
+        free(func_changed);
+        return ANVIL_ERR_NOMEM;
+    }
+    
+    size_t n = 0;
+    for (anvil_func_t *func = mod->funcs; func; func = func->next) {
+        if (func->is_declaration) continue;
+        /* Blocks stand in for size: counting instructions would walk
+         * every body once more before any work starts */
+        items[n] = (opt_item_t){ func, func->num_blocks, n };
+        n++;
+    }
+    qsort(items, count, sizeof(opt_item_t), cmp_items);
+    for (size_t i = 0; i < count; i++) funcs[i] = items[i].func;
+    free(items);
+    
+    anvil_worker_t *workers = anvil_parallel_begin(pm->ctx, mod, threads);
+    if (!workers) {
+        free(funcs);
+        free(func_changed);
+        return ANVIL_ERR_NOMEM;
+    }
+    opt_job_t job = { pm, funcs, func_changed, workers };
+    anvil_error_t err = anvil_parallel_for(threads, count, opt_job, &job);
+    anvil_parallel_end(pm->ctx, mod, workers, threads);
+    
+    for (size_t i = 0; i < count; i++) {
+        if (func_changed[i]) *changed = true;
+    }
+    free(funcs);
+    free(func_changed);
+    return err;
+}
+
 bool anvil_pass_manager_run_module(anvil_pass_manager_t *pm, anvil_module_t *mod)
 {
     if (!pm || !mod) return false;
     
     bool changed = false;
     
+    /* Functions are independent, so they can be optimized concurrently.
+     * With fewer than two bodies or no memory for the job, run serially. */
+    int threads = anvil_parallel_threads(pm->threads);
+    if (threads > 1 && run_module_parallel(pm, mod, threads, &changed) == ANVIL_OK) {
+        return changed;
+    }
+    
     /* Run passes on each function */
     for (anvil_func_t *func = mod->funcs; func; func = func->next) {
         if (anvil_pass_manager_run_func(pm, func)) {
@@ -226,9 +915,14 @@ anvil_error_t anvil_pass_manager_register(anvil_pass_manager_t *pm,
 {
     if (!pm || !pass) return ANVIL_ERR_INVALID_ARG;
     
-    /* Grow array if needed */
+    /* Grow arrays if needed (statistics first, so cap_custom covers both) */
     if (pm->num_custom >= pm->cap_custom) {
         size_t new_cap = pm->cap_custom ? pm->cap_custom * 2 : 4;
+        anvil_pass_stats_t *new_stats = realloc(pm->pass_stats,
+                                                (ANVIL_PASS_COUNT + new_cap) * sizeof(anvil_pass_stats_t));
+        if (!new_stats) return ANVIL_ERR_NOMEM;
+        pm->pass_stats = new_stats;
+        
         anvil_pass_info_t *new_passes = realloc(pm->custom_passes,
                                                  new_cap * sizeof(anvil_pass_info_t));
         if (!new_passes) return ANVIL_ERR_NOMEM;
@@ -236,6 +930,7 @@ anvil_error_t anvil_pass_manager_register(anvil_pass_manager_t *pm,
         pm->cap_custom = new_cap;
     }
     
+    pm->pass_stats[ANVIL_PASS_COUNT + pm->num_custom] = (anvil_pass_stats_t){ .name = pass->name };
     pm->custom_passes[pm->num_custom++] = *pass;
     return ANVIL_OK;
 }
@@ -10,103 +10,74 @@
 
 #include "anvil/anvil_internal.h"
 #include "anvil/anvil_opt.h"
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* Mark blocks reachable from entry */
-static void mark_reachable(anvil_block_t *block, bool *reachable, size_t num_blocks)
+/* Check if block has only one instruction (the terminator) */
+static bool is_empty_block(anvil_block_t *block)
 {
-    if (!block || block->id >= num_blocks || reachable[block->id]) return;
-    
-    reachable[block->id] = true;
-    
-    /* Find terminator and mark successors */
-    anvil_instr_t *term = block->last;
-    if (!term) return;
-    
-    if (term->op == ANVIL_OP_BR) {
-        mark_reachable(term->true_block, reachable, num_blocks);
-    } else if (term->op == ANVIL_OP_BR_COND) {
-        mark_reachable(term->true_block, reachable, num_blocks);
-        mark_reachable(term->false_block, reachable, num_blocks);
-    }
+    return block->first == block->last && 
+           block->first && 
+           block->first->op == ANVIL_OP_BR;
 }
 
-/* Count predecessors of a block */
-static size_t count_preds(anvil_func_t *func, anvil_block_t *target)
+/* Replace all branches to old_block with branches to new_block */
+static void replace_branch_target(anvil_block_t *old_block, anvil_block_t *new_block)
 {
-    size_t count = 0;
-    
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        anvil_instr_t *term = block->last;
-        if (!term) continue;
-        
-        if (term->op == ANVIL_OP_BR && term->true_block == target) {
-            count++;
-        } else if (term->op == ANVIL_OP_BR_COND) {
-            if (term->true_block == target) count++;
-            if (term->false_block == target) count++;
-        }
+    while (old_block->num_preds > 0) {
+        size_t before = old_block->num_preds;
+        anvil_instr_t *term = old_block->preds[before - 1]->last;
+        if (term->false_block == old_block) anvil_instr_set_succ(term, 1, new_block);
+        if (term->true_block == old_block) anvil_instr_set_succ(term, 0, new_block);
+        /* Each retarget drops an entry from old_block's preds */
+        assert(old_block->num_preds < before);
     }
-    
-    return count;
 }
 
-/* Check if block has only one instruction (the terminator) */
-static bool is_empty_block(anvil_block_t *block)
+static bool has_phis(const anvil_block_t *block)
 {
-    return block->first == block->last && 
-           block->first && 
-           block->first->op == ANVIL_OP_BR;
+    return block && block->first && block->first->op == ANVIL_OP_PHI;
 }
 
-/* Replace all branches to old_block with branches to new_block */
-static void replace_branch_target(anvil_func_t *func, 
-                                   anvil_block_t *old_block, 
-                                   anvil_block_t *new_block)
+/* The edge from old_pred into block now comes from new_pred */
+static void rename_phi_incoming(anvil_block_t *block, anvil_block_t *old_pred,
+                                anvil_block_t *new_pred)
 {
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
-        anvil_instr_t *term = block->last;
-        if (!term) continue;
-        
-        if (term->op == ANVIL_OP_BR) {
-            if (term->true_block == old_block) {
-                term->true_block = new_block;
-            }
-        } else if (term->op == ANVIL_OP_BR_COND) {
-            if (term->true_block == old_block) {
-                term->true_block = new_block;
-            }
-            if (term->false_block == old_block) {
-                term->false_block = new_block;
-            }
+    for (anvil_instr_t *instr = block->first; instr && instr->op == ANVIL_OP_PHI; instr = instr->next) {
+        for (size_t i = 0; i < instr->num_phi_incoming; i++) {
+            if (instr->phi_blocks[i] != old_pred) continue;
+            instr->phi_blocks[i] = new_pred;
+            anvil_block_mark_changed(block);
         }
     }
-    
-    /* Update PHI nodes in new_block */
-    for (anvil_instr_t *instr = new_block->first; instr; instr = instr->next) {
-        if (instr->op == ANVIL_OP_PHI) {
-            for (size_t i = 0; i < instr->num_phi_incoming; i++) {
-                if (instr->phi_blocks[i] == old_block) {
-                    instr->phi_blocks[i] = new_block;
-                }
-            }
+}
+
+/* The edge from pred into block is gone */
+static void remove_phi_incoming(anvil_block_t *block, anvil_block_t *pred)
+{
+    for (anvil_instr_t *instr = block->first; instr && instr->op == ANVIL_OP_PHI; instr = instr->next) {
+        for (size_t i = instr->num_phi_incoming; i-- > 0;) {
+            if (instr->phi_blocks[i] == pred) anvil_phi_remove_incoming(instr, i);
         }
     }
 }
 
-/* Remove a block from the function */
-static void remove_block(anvil_func_t *func, anvil_block_t *block)
+/* Single predecessor of a block, or NULL if it has none or several */
+static anvil_block_t *single_pred(const anvil_block_t *target)
 {
-    anvil_block_t **pp = &func->blocks;
-    while (*pp) {
-        if (*pp == block) {
-            *pp = block->next;
-            func->num_blocks--;
-            return;
-        }
-        pp = &(*pp)->next;
+    return target->num_preds == 1 ? target->preds[0] : NULL;
+}
+
+/* Check if a block's terminator already branches to target */
+static bool branches_to(const anvil_block_t *block, const anvil_block_t *target)
+{
+    anvil_block_t *succs[2];
+    size_t n = anvil_block_succs(block, succs);
+    for (size_t i = 0; i < n; i++) {
+        if (succs[i] == target) return true;
     }
+    return false;
 }
 
 /* Simplify conditional branch with constant condition */
@@ -122,11 +93,15 @@ static bool simplify_const_branch(anvil_func_t *func, anvil_block_t *block)
     int64_t val = cond->data.i;
     anvil_block_t *target = val ? term->true_block : term->false_block;
     
+    /* The other successor loses this edge */
+    anvil_block_t *other = val ? term->false_block : term->true_block;
+    if (other && other != target) remove_phi_incoming(other, block);
+    
     /* Convert to unconditional branch */
+    anvil_instr_set_succ(term, 0, target);
+    anvil_instr_set_succ(term, 1, NULL);
     term->op = ANVIL_OP_BR;
-    term->true_block = target;
-    term->false_block = NULL;
-    term->num_operands = 0;
+    anvil_instr_clear_operands(term);
     
     return true;
 }
@@ -141,15 +116,16 @@ static bool try_merge_blocks(anvil_func_t *func, anvil_block_t *block)
     if (!succ) return false;
     
     /* Don't merge entry block's successor if it has multiple preds */
-    if (count_preds(func, succ) != 1) return false;
+    if (succ->num_preds != 1) return false;
     
     /* Don't merge if successor has PHI nodes */
-    if (succ->first && succ->first->op == ANVIL_OP_PHI) return false;
+    if (has_phis(succ)) return false;
     
-    /* Don't merge block with itself */
-    if (block == succ) return false;
+    /* Don't merge block with itself, or swallow the entry */
+    if (block == succ || succ == func->entry) return false;
     
     /* Remove the branch instruction */
+    anvil_block_clear_succs(block);
     if (term->prev) {
         term->prev->next = NULL;
         block->last = term->prev;
@@ -173,12 +149,23 @@ static bool try_merge_blocks(anvil_func_t *func, anvil_block_t *block)
             instr->parent = block;
         }
     }
+    anvil_block_mark_changed(block);
+    
+    /* Hand the successor's edge lists over to this block */
+    succ->first = succ->last = NULL;
+    anvil_block_clear_succs(succ);
+    anvil_block_update_succs(block);
     
     /* Update branches to successor to point to this block */
-    replace_branch_target(func, succ, block);
+    replace_branch_target(succ, block);
+    
+    /* Edges out of the successor now leave from this block */
+    anvil_block_t *succs[2];
+    size_t n = anvil_block_succs(block, succs);
+    for (size_t i = 0; i < n; i++) rename_phi_incoming(succs[i], succ, block);
     
     /* Remove successor block */
-    remove_block(func, succ);
+    anvil_block_unlink(succ);
     
     return true;
 }
@@ -209,46 +196,58 @@ bool anvil_pass_simplify_cfg(anvil_func_t *func)
             
             if (is_empty_block(block)) {
                 anvil_block_t *target = block->last->true_block;
-                if (target && target != block) {
-                    replace_branch_target(func, block, target);
-                    /* Block will be removed as unreachable */
-                    any_changed = true;
-                    changed = true;
+                if (!target || target == block) continue;
+                
+                /* Phis in the target tell its preds apart: bypass the block
+                 * only for a single pred that is not a pred already */
+                if (has_phis(target)) {
+                    anvil_block_t *pred = single_pred(block);
+                    if (!pred || pred == block || branches_to(pred, target)) continue;
+                    rename_phi_incoming(target, block, pred);
                 }
+                replace_branch_target(block, target);
+                /* Block will be removed as unreachable */
+                any_changed = true;
+                changed = true;
             }
         }
         
-        /* Try to merge blocks */
+        /* Try to merge blocks: a merged block may take in a whole chain */
         for (anvil_block_t *block = func->blocks; block; block = block->next) {
-            if (try_merge_blocks(func, block)) {
+            while (try_merge_blocks(func, block)) {
                 any_changed = true;
                 changed = true;
-                break;  /* Restart iteration after modification */
             }
         }
         
-        /* Remove unreachable blocks */
-        size_t max_id = 0;
-        for (anvil_block_t *block = func->blocks; block; block = block->next) {
-            if (block->id > max_id) max_id = block->id;
-        }
+        /* The branches above were edited in place. Dropping unreachable
+         * blocks below leaves the tree of the reachable ones intact. */
+        if (any_changed) anvil_func_invalidate_cfg(func);
         
-        bool *reachable = calloc(max_id + 1, sizeof(bool));
-        if (reachable) {
-            mark_reachable(func->entry, reachable, max_id + 1);
-            
-            anvil_block_t *block = func->blocks;
-            while (block) {
-                anvil_block_t *next = block->next;
-                if (!reachable[block->id] && block != func->entry) {
-                    remove_block(func, block);
+        /* Remove unreachable blocks: the dominator tree numbers the rest */
+        const anvil_domtree_t *dt = anvil_func_domtree(func);
+        if (dt) {
+            anvil_block_t **pp = &func->blocks;
+            while (*pp) {
+                anvil_block_t *block = *pp;
+                if (anvil_domtree_index(dt, block) < 0 && block != func->entry) {
+                    /* Drop the dead block's edges and uses before unlinking it */
+                    anvil_block_t *succs[2];
+                    size_t n = anvil_block_succs(block, succs);
+                    for (size_t i = 0; i < n; i++) remove_phi_incoming(succs[i], block);
+                    for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
+                        anvil_instr_clear_operands(instr);
+                    }
+                    anvil_block_clear_succs(block);
+                    *pp = block->next;
+                    func->num_blocks--;
+                    block->order = 0;
                     any_changed = true;
                     changed = true;
+                    continue;
                 }
-                block = next;
+                pp = &block->next;
             }
-            
-            free(reachable);
         }
         
     } while (any_changed);
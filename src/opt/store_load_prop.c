@@ -31,22 +31,6 @@ static bool values_equal(anvil_value_t *a, anvil_value_t *b)
     return false;
 }
 
-/* Replace all uses of old_val with new_val starting from instruction */
-static int replace_uses(anvil_value_t *old_val, anvil_value_t *new_val, anvil_instr_t *start)
-{
-    int count = 0;
-    for (anvil_instr_t *i = start; i; i = i->next) {
-        if (i->op == ANVIL_OP_NOP) continue;
-        for (size_t j = 0; j < i->num_operands; j++) {
-            if (i->operands[j] == old_val) {
-                i->operands[j] = new_val;
-                count++;
-            }
-        }
-    }
-    return count;
-}
-
 /*
  * Pattern: STORE followed by LOAD from same address
  * STORE %val -> %addr
@@ -64,15 +48,16 @@ static bool opt_store_load_propagate(anvil_instr_t *store, anvil_instr_t *load)
     /* Check if loading from same address we just stored to */
     if (!values_equal(store->operands[1], load->operands[0])) return false;
     
-    /* Replace all uses of load result with the stored value */
+    /* Replace all uses of load result with the stored value
+     * (it is defined before the store, so it dominates every use) */
     anvil_value_t *stored_val = store->operands[0];
     anvil_value_t *load_result = load->result;
     
-    int replaced = replace_uses(load_result, stored_val, load->next);
+    size_t replaced = anvil_value_replace_all_uses(load_result, stored_val);
     
     if (replaced > 0) {
         /* Eliminate the load */
-        load->op = ANVIL_OP_NOP;
+        anvil_instr_kill(load);
         return true;
     }
     
@@ -93,7 +78,8 @@ bool anvil_pass_store_load_prop(anvil_func_t *func)
         any_changed = false;
         iterations++;
         
-        for (anvil_block_t *block = func->blocks; block; block = block->next) {
+        for (anvil_block_t *block = anvil_func_changed_first(func); block;
+             block = anvil_func_changed_next(block)) {
             for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
                 if (instr->op == ANVIL_OP_NOP) continue;
                 if (instr->op != ANVIL_OP_STORE) continue;
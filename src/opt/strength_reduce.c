@@ -97,7 +97,8 @@ bool anvil_pass_strength_reduce(anvil_func_t *func)
     anvil_ctx_t *ctx = func->parent->ctx;
     bool changed = false;
     
-    for (anvil_block_t *block = func->blocks; block; block = block->next) {
+    for (anvil_block_t *block = anvil_func_changed_first(func); block;
+         block = anvil_func_changed_next(block)) {
         for (anvil_instr_t *instr = block->first; instr; instr = instr->next) {
             if (instr->op == ANVIL_OP_NOP) continue;
             if (instr->num_operands < 2) continue;
@@ -111,13 +112,13 @@ bool anvil_pass_strength_reduce(anvil_func_t *func)
                     /* x * 2^n -> x << n */
                     if (is_power_of_2(rhs, &shift)) {
                         instr->op = ANVIL_OP_SHL;
-                        instr->operands[1] = make_shift_const(ctx, lhs->type, shift);
+                        anvil_instr_set_operand(instr, 1, make_shift_const(ctx, lhs->type, shift));
                         changed = true;
                     } else if (is_power_of_2(lhs, &shift)) {
                         /* 2^n * x -> x << n */
                         instr->op = ANVIL_OP_SHL;
-                        instr->operands[0] = rhs;
-                        instr->operands[1] = make_shift_const(ctx, rhs->type, shift);
+                        anvil_instr_set_operand(instr, 0, rhs);
+                        anvil_instr_set_operand(instr, 1, make_shift_const(ctx, rhs->type, shift));
                         changed = true;
                     }
                     break;
@@ -126,7 +127,7 @@ bool anvil_pass_strength_reduce(anvil_func_t *func)
                     /* x / 2^n -> x >> n (unsigned) */
                     if (is_power_of_2(rhs, &shift)) {
                         instr->op = ANVIL_OP_SHR;
-                        instr->operands[1] = make_shift_const(ctx, lhs->type, shift);
+                        anvil_instr_set_operand(instr, 1, make_shift_const(ctx, lhs->type, shift));
                         changed = true;
                     }
                     break;
@@ -141,7 +142,7 @@ bool anvil_pass_strength_reduce(anvil_func_t *func)
                     /* x % 2^n -> x & (2^n - 1) (unsigned) */
                     if (is_power_of_2(rhs, &shift)) {
                         instr->op = ANVIL_OP_AND;
-                        instr->operands[1] = make_mask_const(ctx, lhs->type, shift);
+                        anvil_instr_set_operand(instr, 1, make_mask_const(ctx, lhs->type, shift));
                         changed = true;
                     }
                     break;